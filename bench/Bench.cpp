@@ -0,0 +1,204 @@
+// bench/Bench.cpp
+#include "Bench.h"
+#include <json/json.h>
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace Bench {
+
+    namespace {
+        struct Case {
+            std::string name;
+            Body body;
+        };
+
+        std::vector<Case>& Registry() {
+            static std::vector<Case> cases;
+            return cases;
+        }
+
+        constexpr size_t TARGET_BATCHES = 20;
+        constexpr size_t MIN_SAMPLES = 5;
+
+        double Percentile(std::vector<double> values, double q) {
+            if (values.empty()) return 0;
+            size_t index = static_cast<size_t>(q * static_cast<double>(values.size() - 1) + 0.5);
+            std::nth_element(values.begin(), values.begin() + index, values.end());
+            return values[index];
+        }
+
+        Json::Value ToJson(const Result& result) {
+            Json::Value value;
+            value["name"] = result.name;
+            if (!result.error.empty()) {
+                value["skipped"] = result.error;
+                return value;
+            }
+            value["iterations"] = static_cast<Json::UInt64>(result.iterations);
+            value["batches"] = static_cast<Json::UInt64>(result.batches);
+            value["meanNs"] = result.meanNs;
+            value["p50Ns"] = result.p50Ns;
+            value["p99Ns"] = result.p99Ns;
+            value["minNs"] = result.minNs;
+            if (result.itemsPerSecond > 0) {
+                value["itemsPerSecond"] = result.itemsPerSecond;
+            }
+            Json::Value counters(Json::objectValue);
+            for (const auto& [name, counter] : result.counters) {
+                counters[name] = counter;
+            }
+            value["counters"] = counters;
+            return value;
+        }
+
+        std::string FormatNs(double ns) {
+            if (ns >= 1e6) return std::format("{:.2f} ms", ns / 1e6);
+            if (ns >= 1e3) return std::format("{:.2f} us", ns / 1e3);
+            return std::format("{:.1f} ns", ns);
+        }
+    }
+
+    State::State(std::chrono::nanoseconds minTime) : minTime(minTime) {
+    }
+
+    void State::SetCounter(std::string name, double value) {
+        for (auto& [existing, counter] : counters) {
+            if (existing == name) {
+                counter = value;
+                return;
+            }
+        }
+        counters.emplace_back(std::move(name), value);
+    }
+
+    bool State::NextBatch() {
+        if (finished) {
+            return false;
+        }
+
+        auto now = Clock::now();
+        if (!started) {
+            started = true;
+            batchSize = 1;
+        }
+        else {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - batchStart);
+            // Первая пачка прогревает кэши и пулы и в статистику не идёт
+            if (warmedUp) {
+                samples.push_back(static_cast<double>(elapsed.count()) / static_cast<double>(batchSize));
+                measured += elapsed;
+                iterations += batchSize;
+            }
+            warmedUp = true;
+
+            if (measured >= minTime && samples.size() >= MIN_SAMPLES) {
+                finished = true;
+                return false;
+            }
+
+            // Пачка растёт, пока не займёт примерно 1/TARGET_BATCHES минимального времени
+            auto target = minTime / TARGET_BATCHES;
+            if (elapsed < target) {
+                uint64_t scaled = elapsed.count() > 0 ?
+                    static_cast<uint64_t>(static_cast<double>(batchSize) * target.count() / elapsed.count()) : batchSize * 10;
+                batchSize = std::clamp<uint64_t>(scaled, batchSize, batchSize * 10);
+            }
+        }
+
+        remaining = batchSize - 1;
+        batchStart = Clock::now();
+        return true;
+    }
+
+    Result State::Finish(const std::string& name) const {
+        Result result;
+        result.name = name;
+        result.error = error;
+        result.counters = counters;
+        if (!error.empty() || samples.empty()) {
+            if (result.error.empty()) result.error = "no iterations";
+            return result;
+        }
+
+        result.iterations = iterations;
+        result.batches = samples.size();
+        result.meanNs = static_cast<double>(measured.count()) / static_cast<double>(iterations);
+        result.p50Ns = Percentile(samples, 0.50);
+        result.p99Ns = Percentile(samples, 0.99);
+        result.minNs = *std::min_element(samples.begin(), samples.end());
+        if (itemsPerIteration > 0) {
+            result.itemsPerSecond = itemsPerIteration * 1e9 / result.meanNs;
+        }
+        return result;
+    }
+
+    void Register(std::string name, Body body) {
+        Registry().push_back({ std::move(name), std::move(body) });
+    }
+
+    int Run(const Options& options) {
+        std::vector<Result> results;
+        for (const Case& benchCase : Registry()) {
+            if (!options.filter.empty() && benchCase.name.find(options.filter) == std::string::npos) continue;
+            if (options.listOnly) {
+                std::cout << benchCase.name << "\n";
+                continue;
+            }
+
+            State state(options.minTime);
+            try {
+                benchCase.body(state);
+            }
+            catch (const std::exception& e) {
+                state.Skip(std::format("exception: {}", e.what()));
+            }
+
+            Result result = state.Finish(benchCase.name);
+            if (result.error.empty()) {
+                std::cerr << std::format("{:<56} {:>12} {:>12} {:>12} {:>12}\n", result.name,
+                    FormatNs(result.meanNs), FormatNs(result.p50Ns), FormatNs(result.p99Ns), result.iterations);
+            }
+            else {
+                std::cerr << std::format("{:<56} skipped: {}\n", result.name, result.error);
+            }
+            results.push_back(std::move(result));
+        }
+
+        if (options.listOnly) {
+            return 0;
+        }
+
+        Json::Value root;
+        root["schema"] = 1;
+        root["minTimeMs"] = static_cast<Json::Int64>(options.minTime.count());
+        root["hardwareThreads"] = std::thread::hardware_concurrency();
+        Json::Value list(Json::arrayValue);
+        for (const Result& result : results) {
+            list.append(ToJson(result));
+        }
+        root["results"] = list;
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+        if (options.outputPath.empty()) {
+            writer->write(root, &std::cout);
+            std::cout << "\n";
+        }
+        else {
+            std::ofstream file(options.outputPath);
+            if (!file.is_open()) {
+                std::cerr << std::format("Cannot write {}\n", options.outputPath);
+                return 2;
+            }
+            writer->write(root, &file);
+        }
+
+        bool anySkipped = std::ranges::any_of(results, [](const Result& result) { return !result.error.empty(); });
+        return anySkipped ? 1 : 0;
+    }
+}
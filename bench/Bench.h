@@ -0,0 +1,92 @@
+// bench/Bench.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal benchmark harness. A case body sets up its fixture and then loops
+// on State::KeepRunning(); the harness times the loop in batches, grows the
+// batch until one takes about a twentieth of the minimum run time, drops the
+// first (warm-up) batch and reports the mean and percentiles of per-iteration
+// time across batches. Results are printed as a table to stderr and written
+// as JSON for tooling that tracks regressions.
+namespace Bench {
+
+    struct Options {
+        std::string filter;                     // Подстрока имени, пусто - все
+        std::chrono::milliseconds minTime{ 500 };
+        std::string outputPath;                 // JSON; пусто - stdout
+        bool listOnly = false;
+    };
+
+    struct Result {
+        std::string name;
+        uint64_t iterations = 0;
+        size_t batches = 0;
+        double meanNs = 0;
+        double p50Ns = 0;
+        double p99Ns = 0;
+        double minNs = 0;
+        double itemsPerSecond = 0;              // 0, если элементы не заданы
+        std::vector<std::pair<std::string, double>> counters;
+        std::string error;
+    };
+
+    class State {
+    public:
+        explicit State(std::chrono::nanoseconds minTime);
+
+        // Горячий путь - один декремент, граница пачки уходит в NextBatch
+        bool KeepRunning() {
+            if (remaining > 0) {
+                remaining--;
+                return true;
+            }
+            return NextBatch();
+        }
+
+        // Сколько единиц работы (маршрутов, сообщений) делает одна итерация
+        void SetItemsPerIteration(double items) { itemsPerIteration = items; }
+        void SetCounter(std::string name, double value);
+        // Пропуск случая с объяснением, например нет нужной привилегии
+        void Skip(std::string reason) { error = std::move(reason); remaining = 0; finished = true; }
+
+        Result Finish(const std::string& name) const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::chrono::nanoseconds minTime;
+        Clock::time_point batchStart;
+        uint64_t batchSize = 0;
+        uint64_t remaining = 0;
+        uint64_t iterations = 0;
+        std::chrono::nanoseconds measured{ 0 };
+        std::vector<double> samples;            // нс на итерацию по пачкам
+        double itemsPerIteration = 0;
+        std::vector<std::pair<std::string, double>> counters;
+        std::string error;
+        bool started = false;
+        bool warmedUp = false;
+        bool finished = false;
+
+        bool NextBatch();
+    };
+
+    using Body = std::function<void(State&)>;
+
+    void Register(std::string name, Body body);
+    int Run(const Options& options);
+
+    // Значение, которое компилятор обязан вычислить
+    template<typename T>
+    inline void DoNotOptimize(const T& value) {
+        static const void* volatile sink;
+        sink = &value;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
@@ -0,0 +1,36 @@
+// bench/BenchAccess.h
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include "../src/service/RouteController.h"
+#include "../src/service/DnsProxy.h"
+#include "../src/service/NetworkMonitor.h"
+
+// Friend of RouteController, DnsProxy and NetworkMonitor: lets the benchmarks
+// and the replay driver call private hot paths the way the service threads
+// do, with the same locks held.
+struct BenchAccess {
+    // Как AddRoute: проверка покрытия под shared-блокировкой routesMutex
+    static bool IsIPCovered(RouteController& controller, uint32_t hostOrder, int prefixLength) {
+        std::shared_lock<std::shared_mutex> lock(controller.routesMutex);
+        return controller.IsIPCoveredByExistingRoute(hostOrder, prefixLength);
+    }
+
+    static void ParseDnsResponse(DnsProxy& proxy, std::span<const uint8_t> payload) {
+        proxy.ParseDnsResponseAndAddRoutes(payload);
+    }
+
+    // Как воркер классификации после PopBatch
+    static void ProcessFlowEvent(NetworkMonitor& monitor, const FlowRecord& record) {
+        monitor.ProcessFlowEvent(record);
+    }
+};
+
+// Наборы случаев, регистрируются из BenchMain до Bench::Run
+void RegisterRouteBenchmarks();
+void RegisterServiceBenchmarks();
+
+// Один контроллер на весь прогон: конструктор поднимает потоки и читает state.bin
+RouteController& SharedRouteController();
@@ -0,0 +1,88 @@
+// bench/BenchMain.cpp
+#include "Bench.h"
+#include "BenchAccess.h"
+#include "FakeIpHelper.h"
+#include "Replay.h"
+#include <windows.h>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// RouteManagerBench.exe [--filter=<substring>] [--min-time-ms=<n>] [--out=<file.json>] [--list]
+// RouteManagerBench.exe --replay=<capture.rmcap> [--speed=<N|max>] [--out=<file.json>]
+//
+// Runs without admin rights and without the WinDivert driver: IP Helper is
+// replaced by an in-memory table and WinDivert.dll is delay-loaded and never
+// touched. The working directory is switched to %TEMP%\RouteManagerBench so
+// state.bin and logs of an installed service are left alone.
+int main(int argc, char** argv) {
+    Bench::Options options;
+    Replay::Options replay;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--filter=")) {
+            options.filter = arg.substr(9);
+        }
+        else if (arg.starts_with("--min-time-ms=")) {
+            try {
+                options.minTime = std::chrono::milliseconds(std::stoi(std::string(arg.substr(14))));
+            }
+            catch (const std::exception&) {
+                std::cerr << std::format("Invalid --min-time-ms: {}\n", arg.substr(14));
+                return 2;
+            }
+        }
+        else if (arg.starts_with("--out=")) {
+            options.outputPath = std::filesystem::absolute(std::string(arg.substr(6))).string();
+        }
+        else if (arg == "--list") {
+            options.listOnly = true;
+        }
+        else if (arg.starts_with("--replay=")) {
+            replay.capturePath = std::filesystem::absolute(std::string(arg.substr(9))).string();
+        }
+        else if (arg.starts_with("--speed=")) {
+            std::string speed(arg.substr(8));
+            try {
+                replay.speed = speed == "max" ? 0 : std::stod(speed);
+            }
+            catch (const std::exception&) {
+                replay.speed = -1;
+            }
+            if (replay.speed < 0) {
+                std::cerr << std::format("Invalid --speed: {}\n", speed);
+                return 2;
+            }
+        }
+        else {
+            std::cerr << std::format("Unknown argument: {}\n"
+                "Usage: RouteManagerBench [--filter=<substring>] [--min-time-ms=<n>] [--out=<file.json>] [--list]\n"
+                "       RouteManagerBench --replay=<capture.rmcap> [--speed=<N|max>] [--out=<file.json>]\n", arg);
+            return 2;
+        }
+    }
+
+    // Пути --out и --replay разрешены выше, до смены каталога
+    std::error_code ec;
+    std::filesystem::path scratch = std::filesystem::temp_directory_path(ec) / "RouteManagerBench";
+    std::filesystem::remove_all(scratch, ec);
+    std::filesystem::create_directories(scratch, ec);
+    std::filesystem::current_path(scratch, ec);
+    if (ec) {
+        std::cerr << std::format("Cannot use scratch directory {}: {}\n", scratch.string(), ec.message());
+        return 2;
+    }
+
+    FakeIpHelper::Install();
+    if (!replay.capturePath.empty()) {
+        replay.outputPath = options.outputPath;
+        return Replay::Run(replay);
+    }
+
+    RegisterRouteBenchmarks();
+    RegisterServiceBenchmarks();
+
+    return Bench::Run(options);
+}
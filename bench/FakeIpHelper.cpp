@@ -0,0 +1,157 @@
+// bench/FakeIpHelper.cpp
+#include "FakeIpHelper.h"
+#include "../src/service/IpHelperApi.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace FakeIpHelper {
+
+    namespace {
+        constexpr NET_IFINDEX FAKE_INTERFACE = 1;
+
+        // Ключ - (адрес в сетевом порядке, длина префикса), как у системной таблицы
+        using RouteKey = std::pair<ULONG, UINT8>;
+
+        std::mutex tableMutex;
+        std::map<RouteKey, MIB_IPFORWARD_ROW2> table;
+        Counters counters;
+
+        bool IsIpv4(const MIB_IPFORWARD_ROW2* row) {
+            return row->DestinationPrefix.Prefix.si_family == AF_INET;
+        }
+
+        RouteKey KeyOf(const MIB_IPFORWARD_ROW2* row) {
+            return { row->DestinationPrefix.Prefix.Ipv4.sin_addr.s_addr, row->DestinationPrefix.PrefixLength };
+        }
+
+        DWORD WINAPI CreateEntry2(const MIB_IPFORWARD_ROW2* row) {
+            std::lock_guard<std::mutex> lock(tableMutex);
+            counters.creates++;
+            // IPv6-маршруты принимаем, но не храним: бенчмарки их не читают обратно
+            if (!IsIpv4(row)) return NO_ERROR;
+            if (!table.emplace(KeyOf(row), *row).second) return ERROR_OBJECT_ALREADY_EXISTS;
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI DeleteEntry2(const MIB_IPFORWARD_ROW2* row) {
+            std::lock_guard<std::mutex> lock(tableMutex);
+            counters.deletes++;
+            if (!IsIpv4(row)) return NO_ERROR;
+            return table.erase(KeyOf(row)) > 0 ? NO_ERROR : ERROR_NOT_FOUND;
+        }
+
+        DWORD WINAPI GetEntry2(MIB_IPFORWARD_ROW2* row) {
+            std::lock_guard<std::mutex> lock(tableMutex);
+            counters.lookups++;
+            if (!IsIpv4(row)) return ERROR_NOT_FOUND;
+            auto it = table.find(KeyOf(row));
+            if (it == table.end()) return ERROR_NOT_FOUND;
+            *row = it->second;
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI GetTable2(ADDRESS_FAMILY family, PMIB_IPFORWARD_TABLE2* result) {
+            std::lock_guard<std::mutex> lock(tableMutex);
+            counters.tableReads++;
+            size_t count = family == AF_INET || family == AF_UNSPEC ? table.size() : 0;
+            size_t bytes = offsetof(MIB_IPFORWARD_TABLE2, Table) + (count > 0 ? count : 1) * sizeof(MIB_IPFORWARD_ROW2);
+            auto* out = static_cast<PMIB_IPFORWARD_TABLE2>(std::calloc(1, bytes));
+            if (!out) return ERROR_NOT_ENOUGH_MEMORY;
+
+            out->NumEntries = static_cast<ULONG>(count);
+            if (count > 0) {
+                ULONG i = 0;
+                for (const auto& [key, row] : table) {
+                    out->Table[i++] = row;
+                }
+            }
+            *result = out;
+            return NO_ERROR;
+        }
+
+        VOID WINAPI FreeTable(PVOID memory) {
+            std::free(memory);
+        }
+
+        // Старый API нужен только как запасной путь при ошибке нового
+        DWORD WINAPI CreateEntry(PMIB_IPFORWARDROW) {
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI DeleteEntry(PMIB_IPFORWARDROW) {
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI BestInterface(IPAddr, PDWORD index) {
+            *index = FAKE_INTERFACE;
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI NotifyRoutes(ADDRESS_FAMILY, PIPFORWARD_CHANGE_CALLBACK, PVOID, BOOLEAN, HANDLE* handle) {
+            *handle = nullptr;
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        DWORD WINAPI NotifyInterfaces(ADDRESS_FAMILY, PIPINTERFACE_CHANGE_CALLBACK, PVOID, BOOLEAN, HANDLE* handle) {
+            *handle = nullptr;
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        DWORD WINAPI CancelNotify(HANDLE) {
+            return NO_ERROR;
+        }
+
+        // Пустые таблицы сокетов: PID владельца DNS-запроса в бенчмарке не ищется
+        DWORD WINAPI TcpTable(PVOID buffer, PDWORD size, BOOL, ULONG, TCP_TABLE_CLASS, ULONG) {
+            if (!buffer || *size < sizeof(MIB_TCPTABLE_OWNER_PID)) {
+                *size = sizeof(MIB_TCPTABLE_OWNER_PID);
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+            static_cast<MIB_TCPTABLE_OWNER_PID*>(buffer)->dwNumEntries = 0;
+            return NO_ERROR;
+        }
+
+        DWORD WINAPI UdpTable(PVOID buffer, PDWORD size, BOOL, ULONG, UDP_TABLE_CLASS, ULONG) {
+            if (!buffer || *size < sizeof(MIB_UDPTABLE_OWNER_PID)) {
+                *size = sizeof(MIB_UDPTABLE_OWNER_PID);
+                return ERROR_INSUFFICIENT_BUFFER;
+            }
+            static_cast<MIB_UDPTABLE_OWNER_PID*>(buffer)->dwNumEntries = 0;
+            return NO_ERROR;
+        }
+    }
+
+    void Install() {
+        IpHelperApi& api = IpHelper::Api();
+        api.CreateIpForwardEntry2 = &CreateEntry2;
+        api.DeleteIpForwardEntry2 = &DeleteEntry2;
+        api.GetIpForwardEntry2 = &GetEntry2;
+        api.GetIpForwardTable2 = &GetTable2;
+        api.FreeMibTable = &FreeTable;
+        api.CreateIpForwardEntry = &CreateEntry;
+        api.DeleteIpForwardEntry = &DeleteEntry;
+        api.GetBestInterface = &BestInterface;
+        api.NotifyRouteChange2 = &NotifyRoutes;
+        api.NotifyIpInterfaceChange = &NotifyInterfaces;
+        api.CancelMibChangeNotify2 = &CancelNotify;
+        api.GetExtendedTcpTable = &TcpTable;
+        api.GetExtendedUdpTable = &UdpTable;
+    }
+
+    Counters GetCounters() {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        Counters result = counters;
+        result.routes = table.size();
+        return result;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        table.clear();
+        counters = {};
+    }
+}
@@ -0,0 +1,24 @@
+// bench/FakeIpHelper.h
+#pragma once
+#include <cstdint>
+
+// In-memory stand-in for the IP Helper routing calls. Routes created through
+// CreateIpForwardEntry2 are kept in a map and reported back by
+// GetIpForwardEntry2/GetIpForwardTable2, so RouteController's verification
+// and repair paths see a consistent table. Change notifications are refused,
+// which makes the controller fall back to polling as on a system without them.
+namespace FakeIpHelper {
+
+    struct Counters {
+        uint64_t creates = 0;
+        uint64_t deletes = 0;
+        uint64_t lookups = 0;
+        uint64_t tableReads = 0;
+        uint64_t routes = 0;                // Сейчас в таблице
+    };
+
+    // Подменяет IpHelper::Api(); вызывать до создания RouteController и DnsProxy
+    void Install();
+    Counters GetCounters();
+    void Reset();
+}
@@ -0,0 +1,228 @@
+// bench/Replay.cpp
+#include "Replay.h"
+#include "BenchAccess.h"
+#include "FakeIpHelper.h"
+#include "../src/service/TrafficCapture.h"
+#include "../src/service/ProcessManager.h"
+#include "../src/common/Utils.h"
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Replay {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // Снимок процессов ProcessManager заменяет кэш PID живыми процессами этой машины,
+        // поэтому процессы из записи подкладываются заново с этим периодом
+        constexpr auto RESEED_INTERVAL = std::chrono::seconds(1);
+
+        struct LatencySummary {
+            uint64_t count = 0;
+            double p50Ns = 0;
+            double p99Ns = 0;
+            double p999Ns = 0;
+            double maxNs = 0;
+        };
+
+        LatencySummary Summarize(std::vector<uint64_t>& samples) {
+            LatencySummary summary;
+            summary.count = samples.size();
+            if (samples.empty()) return summary;
+
+            std::ranges::sort(samples);
+            auto at = [&](double q) {
+                return static_cast<double>(samples[static_cast<size_t>(q * static_cast<double>(samples.size() - 1))]);
+            };
+            summary.p50Ns = at(0.50);
+            summary.p99Ns = at(0.99);
+            summary.p999Ns = at(0.999);
+            summary.maxNs = static_cast<double>(samples.back());
+            return summary;
+        }
+
+        Json::Value ToJson(const LatencySummary& summary) {
+            Json::Value value;
+            value["count"] = static_cast<Json::UInt64>(summary.count);
+            value["p50Ns"] = summary.p50Ns;
+            value["p99Ns"] = summary.p99Ns;
+            value["p999Ns"] = summary.p999Ns;
+            value["maxNs"] = summary.maxNs;
+            return value;
+        }
+
+        // Выбор процессов восстанавливается по записям Process: их пишут только для выбранных
+        class ProcessSeed {
+        public:
+            explicit ProcessSeed(const std::vector<CaptureReader::Record>& records) {
+                for (const auto& record : records) {
+                    if (record.type == CaptureRecordType::Process) {
+                        selected[record.processId] = Utils::StringToWString(record.processName);
+                    }
+                    else if (record.type == CaptureRecordType::Flow) {
+                        seen.push_back(record.flow.processId);
+                    }
+                }
+                std::ranges::sort(seen);
+                seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+            }
+
+            std::vector<std::string> SelectedNames() const {
+                std::vector<std::string> names;
+                for (const auto& [pid, name] : selected) {
+                    names.push_back(Utils::WStringToString(name));
+                }
+                std::ranges::sort(names);
+                names.erase(std::unique(names.begin(), names.end()), names.end());
+                return names;
+            }
+
+            void Apply(ProcessManager& manager) const {
+                auto now = Clock::now();
+                for (DWORD pid : seen) {
+                    CachedProcessInfo info{};
+                    auto it = selected.find(pid);
+                    info.isSelected = it != selected.end();
+                    if (info.isSelected) info.name = it->second;
+                    info.lastVerified = now;
+                    manager.AddToPidCache(pid, info);
+                }
+            }
+
+            size_t SelectedCount() const { return selected.size(); }
+            size_t ProcessCount() const { return seen.size(); }
+
+        private:
+            std::unordered_map<uint32_t, std::wstring> selected;
+            std::vector<uint32_t> seen;
+        };
+    }
+
+    int Run(const Options& options) {
+        CaptureReader reader;
+        if (!reader.Load(options.capturePath)) {
+            std::cerr << std::format("Cannot read capture {}\n", options.capturePath);
+            return 2;
+        }
+        const auto& records = reader.Records();
+        ProcessSeed seed(records);
+
+        ServiceConfig config;
+        config.selectedProcesses = seed.SelectedNames();
+        RouteController routeController(config);
+        ProcessManager processManager(config);
+        NetworkMonitor monitor(&routeController, &processManager, config.monitorSettings);
+        DnsProxy dnsProxy(&processManager, &routeController, config.dnsProxySettings);
+        seed.Apply(processManager);
+
+        std::vector<uint64_t> flowLatency;
+        std::vector<uint64_t> dnsLatency;
+        std::vector<uint64_t> lag;              // Насколько событие опоздало к своему сроку
+        flowLatency.reserve(records.size());
+        auto ns = [](Clock::duration d) {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        };
+
+        auto start = Clock::now();
+        auto lastSeed = start;
+        for (const auto& record : records) {
+            if (record.type == CaptureRecordType::Process) continue;
+
+            Clock::time_point due = start;
+            if (options.speed > 0) {
+                due = start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(record.timeNs) / options.speed)));
+                std::this_thread::sleep_until(due);
+            }
+
+            auto begin = Clock::now();
+            if (begin - lastSeed >= RESEED_INTERVAL) {
+                seed.Apply(processManager);
+                lastSeed = begin;
+                begin = Clock::now();
+            }
+            if (options.speed > 0) {
+                lag.push_back(ns(begin - due));
+            }
+
+            if (record.type == CaptureRecordType::Flow) {
+                BenchAccess::ProcessFlowEvent(monitor, record.flow);
+                flowLatency.push_back(ns(Clock::now() - begin));
+            }
+            else {
+                BenchAccess::ParseDnsResponse(dnsProxy, record.message);
+                dnsLatency.push_back(ns(Clock::now() - begin));
+            }
+        }
+        auto fed = Clock::now();
+
+        // Маршруты ставятся writer-потоками контроллера: итог считаем после очереди
+        auto drainDeadline = fed + std::chrono::seconds(options.drainTimeoutSec);
+        while (routeController.GetPendingRouteCount() > 0 && Clock::now() < drainDeadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto drained = Clock::now();
+
+        size_t events = flowLatency.size() + dnsLatency.size();
+        double feedSeconds = std::chrono::duration<double>(fed - start).count();
+        double captureSeconds = records.empty() ? 0 : static_cast<double>(records.back().timeNs) / 1e9;
+        LatencySummary flows = Summarize(flowLatency);
+        LatencySummary dns = Summarize(dnsLatency);
+        LatencySummary lateness = Summarize(lag);
+        FakeIpHelper::Counters system = FakeIpHelper::GetCounters();
+
+        Json::Value root;
+        root["schema"] = 1;
+        root["capture"] = options.capturePath;
+        root["captureSeconds"] = captureSeconds;
+        root["truncated"] = reader.Truncated();
+        root["speed"] = options.speed > 0 ? Json::Value(options.speed) : Json::Value("max");
+        root["processes"] = static_cast<Json::UInt64>(seed.ProcessCount());
+        root["selectedProcesses"] = static_cast<Json::UInt64>(seed.SelectedCount());
+        root["events"] = static_cast<Json::UInt64>(events);
+        root["feedMs"] = feedSeconds * 1000;
+        root["drainMs"] = std::chrono::duration<double, std::milli>(drained - fed).count();
+        root["eventsPerSecond"] = feedSeconds > 0 ? static_cast<double>(events) / feedSeconds : 0;
+        root["flowLatency"] = ToJson(flows);
+        root["dnsLatency"] = ToJson(dns);
+        if (options.speed > 0) {
+            root["lag"] = ToJson(lateness);
+        }
+        root["routes"] = static_cast<Json::UInt64>(routeController.GetRouteCount());
+        root["pendingRoutes"] = static_cast<Json::UInt64>(routeController.GetPendingRouteCount());
+        root["systemRoutes"] = static_cast<Json::UInt64>(system.routes);
+        root["systemRouteCreates"] = static_cast<Json::UInt64>(system.creates);
+
+        std::cerr << std::format("Replayed {} events ({} flow, {} dns) in {:.1f} ms, {:.0f} events/s\n",
+            events, flows.count, dns.count, feedSeconds * 1000, root["eventsPerSecond"].asDouble());
+        std::cerr << std::format("Flow latency p50 {:.0f} ns, p99 {:.0f} ns, max {:.0f} ns; DNS p50 {:.0f} ns, p99 {:.0f} ns\n",
+            flows.p50Ns, flows.p99Ns, flows.maxNs, dns.p50Ns, dns.p99Ns);
+        std::cerr << std::format("Routes: {} in table, {} pending, {} system\n",
+            routeController.GetRouteCount(), routeController.GetPendingRouteCount(), system.routes);
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+        if (options.outputPath.empty()) {
+            writer->write(root, &std::cout);
+            std::cout << "\n";
+        }
+        else {
+            std::ofstream file(options.outputPath);
+            if (!file.is_open()) {
+                std::cerr << std::format("Cannot write {}\n", options.outputPath);
+                return 2;
+            }
+            writer->write(root, &file);
+        }
+        return 0;
+    }
+}
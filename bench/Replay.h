@@ -0,0 +1,18 @@
+// bench/Replay.h
+#pragma once
+#include <string>
+
+// Replays a TrafficCapture file through NetworkMonitor::ProcessFlowEvent and
+// DnsProxy::ParseDnsResponseAndAddRoutes against the in-memory IP Helper
+// table, then reports throughput, per-event latency and the final route table.
+namespace Replay {
+
+    struct Options {
+        std::string capturePath;
+        double speed = 0;                   // 1 - темп записи, N - в N раз быстрее, 0 - без пауз
+        std::string outputPath;             // JSON; пусто - stdout
+        int drainTimeoutSec = 30;           // Ожидание очереди программирования маршрутов в конце
+    };
+
+    int Run(const Options& options);
+}
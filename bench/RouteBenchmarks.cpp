@@ -0,0 +1,149 @@
+// bench/RouteBenchmarks.cpp
+#include "Bench.h"
+#include "BenchAccess.h"
+#include "FakeIpHelper.h"
+#include "../src/service/RouteOptimizer.h"
+#include "../src/common/Utils.h"
+#include <format>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+    constexpr uint32_t FIXTURE_SEED = 20240611;
+    constexpr size_t QUERY_COUNT = 4096;            // Степень двойки: индекс по маске
+    constexpr size_t COVERING_AGGREGATES = 1000;
+
+    // Случайная публичная /24 в порядке хоста
+    uint32_t RandomPublic24(std::mt19937& rng) {
+        std::uniform_int_distribution<uint32_t> firstOctet(1, 223);
+        std::uniform_int_distribution<uint32_t> rest(0, 0xFFFF);
+        for (;;) {
+            uint32_t base = (firstOctet(rng) << 24) | (rest(rng) << 8);
+            if (!Utils::IsPrivateIPv4(base) && (base >> 24) != 127) return base;
+        }
+    }
+
+    // Хосты кучкуются по /24, как адреса CDN одного сервиса: часть /24 набирает
+    // достаточно хостов для агрегации, часть остаётся одиночками
+    std::vector<HostRoute> MakeHostRoutes(size_t count) {
+        std::mt19937 rng(FIXTURE_SEED);
+        std::uniform_int_distribution<uint32_t> clusterSize(1, 12);
+        std::uniform_int_distribution<uint32_t> hostByte(1, 254);
+
+        std::vector<HostRoute> routes;
+        routes.reserve(count);
+        while (routes.size() < count) {
+            uint32_t base = RandomPublic24(rng);
+            uint32_t hosts = clusterSize(rng);
+            for (uint32_t i = 0; i < hosts && routes.size() < count; i++) {
+                uint32_t address = base | hostByte(rng);
+                routes.push_back({ Utils::FastUIntToIP(address), address, "bench.exe", 32 });
+            }
+        }
+        return routes;
+    }
+
+    void OptimizeRoutesCase(Bench::State& state, size_t count, bool cached) {
+        RouteOptimizer optimizer(OptimizerConfig{});
+        std::vector<HostRoute> routes = MakeHostRoutes(count);
+        uint64_t contentHash = RouteOptimizer::ContentHash(routes);
+        size_t routesAfter = 0;
+
+        state.SetItemsPerIteration(static_cast<double>(count));
+        while (state.KeepRunning()) {
+            // Новый хэш на каждой итерации обходит кэш планов
+            OptimizationPlan plan = optimizer.OptimizeRoutes(routes, cached ? contentHash : contentHash++);
+            routesAfter = static_cast<size_t>(plan.routesAfter);
+            Bench::DoNotOptimize(plan);
+        }
+        state.SetCounter("routesAfter", static_cast<double>(routesAfter));
+        state.SetCounter("memoryBytes", static_cast<double>(optimizer.GetMemoryBytes()));
+    }
+
+    struct CoverageFixture {
+        std::vector<uint32_t> covered;
+        std::vector<uint32_t> uncovered;
+    };
+
+    // Агрегаты ставятся через обычный AddRouteWithMask, поэтому индекс префиксов
+    // и таблица маршрутов в том же виде, что после работы оптимизатора
+    const CoverageFixture& Coverage() {
+        static const CoverageFixture fixture = [] {
+            RouteController& controller = SharedRouteController();
+            std::mt19937 rng(FIXTURE_SEED + 1);
+            std::uniform_int_distribution<uint32_t> hostByte(1, 254);
+
+            std::vector<uint32_t> aggregates;
+            aggregates.reserve(COVERING_AGGREGATES);
+            while (aggregates.size() < COVERING_AGGREGATES) {
+                uint32_t base = RandomPublic24(rng);
+                if (controller.AddRouteWithMask(Utils::FastUIntToIP(base), 24, "bench-aggregate")) {
+                    aggregates.push_back(base);
+                }
+            }
+
+            CoverageFixture result;
+            std::uniform_int_distribution<size_t> pick(0, aggregates.size() - 1);
+            for (size_t i = 0; i < QUERY_COUNT; i++) {
+                result.covered.push_back(aggregates[pick(rng)] | hostByte(rng));
+            }
+            while (result.uncovered.size() < QUERY_COUNT) {
+                uint32_t address = RandomPublic24(rng) | hostByte(rng);
+                if (!BenchAccess::IsIPCovered(controller, address, 32)) {
+                    result.uncovered.push_back(address);
+                }
+            }
+            return result;
+        }();
+        return fixture;
+    }
+
+    void CoverageCase(Bench::State& state, bool covered) {
+        RouteController& controller = SharedRouteController();
+        const auto& queries = covered ? Coverage().covered : Coverage().uncovered;
+        size_t index = 0;
+        size_t hits = 0;
+
+        while (state.KeepRunning()) {
+            hits += BenchAccess::IsIPCovered(controller, queries[index++ & (QUERY_COUNT - 1)], 32) ? 1 : 0;
+        }
+        Bench::DoNotOptimize(hits);
+        state.SetCounter("routes", static_cast<double>(controller.GetRouteCount()));
+    }
+}
+
+RouteController& SharedRouteController() {
+    static std::unique_ptr<RouteController> controller = [] {
+        ServiceConfig config;
+        config.aiPreloadEnabled = false;
+        return std::make_unique<RouteController>(config);
+    }();
+    return *controller;
+}
+
+void RegisterRouteBenchmarks() {
+    for (size_t count : { 1000, 10000, 100000 }) {
+        Bench::Register(std::format("RouteOptimizer.OptimizeRoutes/{}", count),
+            [count](Bench::State& state) { OptimizeRoutesCase(state, count, false); });
+    }
+    Bench::Register("RouteOptimizer.OptimizeRoutes/10000/cached",
+        [](Bench::State& state) { OptimizeRoutesCase(state, 10000, true); });
+
+    Bench::Register("RouteController.IsIPCoveredByExistingRoute/covered",
+        [](Bench::State& state) { CoverageCase(state, true); });
+    Bench::Register("RouteController.IsIPCoveredByExistingRoute/uncovered",
+        [](Bench::State& state) { CoverageCase(state, false); });
+
+    Bench::Register("RouteController.AddRouteWithMask/fake-iphlpapi", [](Bench::State& state) {
+        RouteController& controller = SharedRouteController();
+        std::mt19937 rng(FIXTURE_SEED + 2);
+        auto before = FakeIpHelper::GetCounters();
+        while (state.KeepRunning()) {
+            // Новые /32 каждый раз: путь до системного маршрута и вставки в таблицу
+            Bench::DoNotOptimize(controller.AddRouteWithMask(Utils::FastUIntToIP(RandomPublic24(rng) | 1), 32, "bench.exe"));
+        }
+        auto after = FakeIpHelper::GetCounters();
+        state.SetCounter("systemCreates", static_cast<double>(after.creates - before.creates));
+    });
+}
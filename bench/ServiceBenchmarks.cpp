@@ -0,0 +1,341 @@
+// bench/ServiceBenchmarks.cpp
+#include "Bench.h"
+#include "BenchAccess.h"
+#include "../src/service/DnsMessageReader.h"
+#include "../src/service/DnsTcpReassembler.h"
+#include "../src/service/ProcessManager.h"
+#include "../src/common/IPCProtocol.h"
+#include "../src/common/Logger.h"
+#include "../src/common/Models.h"
+#include "../src/common/Utils.h"
+#include <windows.h>
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    // PID, которого заведомо нет: кратен 4, но вне диапазона, который выдаёт ядро
+    constexpr DWORD MISSING_PID = 0x7FFFFFF0;
+
+    // Выбран сам процесс бенчмарка: попадание в кэш PID с вердиктом "выбран"
+    ServiceConfig SelfSelectedConfig() {
+        wchar_t path[MAX_PATH] = {};
+        GetModuleFileNameW(nullptr, path, MAX_PATH);
+        ServiceConfig config;
+        config.selectedProcesses = { Utils::WStringToString(std::filesystem::path(path).filename().wstring()) };
+        return config;
+    }
+
+    ProcessManager& SharedProcessManager() {
+        static ProcessManager manager(SelfSelectedConfig());
+        return manager;
+    }
+
+    void PidCase(Bench::State& state, DWORD pid) {
+        ProcessManager& manager = SharedProcessManager();
+        uint64_t hitsBefore = 0, missesBefore = 0;
+        manager.GetCacheStats(hitsBefore, missesBefore);
+
+        bool selected = false;
+        while (state.KeepRunning()) {
+            selected = manager.IsSelectedProcessByPid(pid);
+            Bench::DoNotOptimize(selected);
+        }
+
+        uint64_t hits = 0, misses = 0;
+        manager.GetCacheStats(hits, misses);
+        state.SetCounter("selected", selected ? 1 : 0);
+        state.SetCounter("cacheHits", static_cast<double>(hits - hitsBefore));
+        state.SetCounter("cacheMisses", static_cast<double>(misses - missesBefore));
+    }
+
+    // Ответ на cdn.example.com: CNAME на edge.example.net и четыре A-записи,
+    // имена в ответах - указатели сжатия на вопрос и на цель CNAME
+    std::vector<uint8_t> MakeDnsResponse() {
+        std::vector<uint8_t> message = {
+            0x12, 0x34,             // ID
+            0x81, 0x80,             // QR, RD, RA, NOERROR
+            0x00, 0x01,             // QDCOUNT
+            0x00, 0x05,             // ANCOUNT
+            0x00, 0x00, 0x00, 0x00  // NSCOUNT, ARCOUNT
+        };
+        auto appendName = [&](std::initializer_list<std::string_view> labels) {
+            for (std::string_view label : labels) {
+                message.push_back(static_cast<uint8_t>(label.size()));
+                message.insert(message.end(), label.begin(), label.end());
+            }
+            message.push_back(0);
+        };
+        auto append16 = [&](uint16_t value) {
+            message.push_back(static_cast<uint8_t>(value >> 8));
+            message.push_back(static_cast<uint8_t>(value));
+        };
+        auto appendTtl = [&] {
+            message.insert(message.end(), { 0x00, 0x00, 0x01, 0x2C });     // 300 с
+        };
+
+        const uint16_t questionName = static_cast<uint16_t>(message.size());
+        appendName({ "cdn", "example", "com" });
+        append16(1);                // A
+        append16(1);                // IN
+
+        append16(0xC000 | questionName);
+        append16(5);                // CNAME
+        append16(1);
+        appendTtl();
+        append16(18);               // \4edge\7example\3net\0
+        const uint16_t cnameTarget = static_cast<uint16_t>(message.size());
+        appendName({ "edge", "example", "net" });
+
+        for (uint8_t host : { 10, 11, 12, 13 }) {
+            append16(0xC000 | cnameTarget);
+            append16(1);
+            append16(1);
+            appendTtl();
+            append16(4);
+            message.insert(message.end(), { 93, 184, 216, host });
+        }
+        return message;
+    }
+
+    // Испорченные копии ответа: замена байтов, обрезка, указатели сжатия на себя.
+    // Сид фиксирован, прогоны повторяемы
+    std::vector<std::vector<uint8_t>> MakeMutatedResponses(size_t count) {
+        const std::vector<uint8_t> original = MakeDnsResponse();
+        std::mt19937 rng(0x5EED);
+        std::vector<std::vector<uint8_t>> messages;
+        messages.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            std::vector<uint8_t> message = original;
+            switch (i % 3) {
+            case 0:
+                for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+                    message[rng() % message.size()] = static_cast<uint8_t>(rng());
+                }
+                break;
+            case 1:
+                message.resize(rng() % message.size());
+                break;
+            default: {
+                size_t at = DnsMessageReader::HEADER_SIZE + rng() % (message.size() - DnsMessageReader::HEADER_SIZE - 1);
+                message[at] = static_cast<uint8_t>(0xC0 | (at >> 8));
+                message[at + 1] = static_cast<uint8_t>(at);
+                break;
+            }
+            }
+            messages.push_back(std::move(message));
+        }
+        return messages;
+    }
+
+    // Весь разбор, который делает прокси: каждая запись и имя в ней
+    size_t WalkDnsMessage(std::span<const uint8_t> message, std::string& name) {
+        DnsMessageReader reader(message);
+        if (!reader.Valid()) return 0;
+        size_t records = 0;
+        DnsMessageReader::Record record;
+        while (reader.Next(record)) {
+            DnsMessageReader::ReadName(message, record.nameOffset, name);
+            if (record.type == DnsMessageReader::TYPE_CNAME) {
+                DnsMessageReader::ReadName(message, record.rdataOffset, name);
+            }
+            records++;
+        }
+        return records;
+    }
+
+    std::vector<RouteInfo> MakeRouteList(size_t count) {
+        std::vector<RouteInfo> routes;
+        routes.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            RouteInfo route(Utils::FastUIntToIP(0x5DB80000u + static_cast<uint32_t>(i)), "Discord.exe");
+            route.prefixLength = (i % 8 == 0) ? 24 : 32;
+            routes.push_back(route);
+        }
+        return routes;
+    }
+
+    ProcessListDelta MakeProcessDelta(size_t count) {
+        ProcessListDelta delta;
+        delta.version = 42;
+        for (size_t i = 0; i < count; i++) {
+            DWORD pid = static_cast<DWORD>(1000 + i * 4);
+            delta.upserts.push_back({ std::format(L"process{}.exe", i),
+                std::format(L"C:\\Program Files\\Vendor\\process{}.exe", i), pid, i % 5 == 0, false, false, 133500000000000000ull + i });
+        }
+        delta.removed.push_back({ 4, 0 });
+        return delta;
+    }
+
+    MemoryReport MakeMemoryReport() {
+        MemoryReport report;
+        report.workingSetBytes = 180ull << 20;
+        report.budgetBytes = 500ull << 20;
+        for (const char* name : { "Routes", "Flows", "ProcessCaches", "Dns", "Logger", "Optimizer" }) {
+            report.subsystems.push_back({ name, 12ull << 20, 64ull << 20, 1 });
+        }
+        return report;
+    }
+
+    template<typename Serialize, typename Deserialize>
+    void RoundTripCase(Bench::State& state, double items, Serialize serialize, Deserialize deserialize) {
+        size_t bytes = 0;
+        state.SetItemsPerIteration(items);
+        while (state.KeepRunning()) {
+            std::vector<uint8_t> data = serialize();
+            bytes = data.size();
+            deserialize(data);
+        }
+        state.SetCounter("bytes", static_cast<double>(bytes));
+    }
+}
+
+void RegisterServiceBenchmarks() {
+    Bench::Register("ProcessManager.IsSelectedProcessByPid/hit", [](Bench::State& state) {
+        PidCase(state, GetCurrentProcessId());
+    });
+    Bench::Register("ProcessManager.IsSelectedProcessByPid/miss", [](Bench::State& state) {
+        PidCase(state, MISSING_PID);
+    });
+
+    Bench::Register("DnsProxy.ParseDnsResponseAndAddRoutes/cname+4A", [](Bench::State& state) {
+        // Первый разбор ставит маршруты, дальше - установившийся режим: продление по повторным ответам
+        DnsProxy proxy(&SharedProcessManager(), &SharedRouteController());
+        std::vector<uint8_t> response = MakeDnsResponse();
+        state.SetItemsPerIteration(4);
+        while (state.KeepRunning()) {
+            BenchAccess::ParseDnsResponse(proxy, response);
+        }
+        state.SetCounter("memoryBytes", static_cast<double>(proxy.GetMemoryBytes()));
+    });
+
+    // Устойчивость разбора: испорченный ответ не должен ни читать за буфер, ни зацикливаться
+    Bench::Register("DnsMessageReader.Walk/mutated", [](Bench::State& state) {
+        std::vector<std::vector<uint8_t>> messages = MakeMutatedResponses(256);
+        std::string name;
+        size_t records = 0;
+        state.SetItemsPerIteration(static_cast<double>(messages.size()));
+        while (state.KeepRunning()) {
+            for (const std::vector<uint8_t>& message : messages) {
+                records += WalkDnsMessage(message, name);
+            }
+        }
+        Bench::DoNotOptimize(records);
+    });
+    // Поток из 16 ответов, нарезанный на сегменты и выданный не по порядку, как его забирают воркеры
+    Bench::Register("DnsTcpReassembler.Feed/shuffled", [](Bench::State& state) {
+        const std::vector<uint8_t> response = MakeDnsResponse();
+        std::vector<uint8_t> stream;
+        for (int i = 0; i < 16; i++) {
+            stream.push_back(static_cast<uint8_t>(response.size() >> 8));
+            stream.push_back(static_cast<uint8_t>(response.size()));
+            stream.insert(stream.end(), response.begin(), response.end());
+        }
+        std::mt19937 rng(0x5EED);
+        std::vector<std::pair<uint32_t, size_t>> segments;      // Смещение, длина
+        for (size_t offset = 0; offset < stream.size();) {
+            size_t length = std::min<size_t>(stream.size() - offset, 1 + rng() % 96);
+            segments.emplace_back(static_cast<uint32_t>(offset), length);
+            offset += length;
+        }
+        // Соседние сегменты меняются местами: разброс по воркерам, а не произвольный порядок
+        for (size_t i = 0; i + 1 < segments.size(); i += 2 + rng() % 3) {
+            std::swap(segments[i], segments[i + 1]);
+        }
+
+        const DnsNatTable::Key key{ 0x0100007F, 0x3500, 6 };
+        const uint32_t firstSeq = 0xFFFFFF00;   // Через переполнение номера
+        DnsTcpReassembler reassembler(4);
+        std::vector<uint8_t> out;
+        size_t messages = 0;
+        std::string name;
+        state.SetItemsPerIteration(16);
+        while (state.KeepRunning()) {
+            messages = 0;
+            reassembler.Open(key, firstSeq, 0);
+            for (const auto& [offset, length] : segments) {
+                out.clear();
+                std::span<const uint8_t> payload(stream.data() + offset, length);
+                DnsTcpReassembler::Result result = reassembler.Feed(key, firstSeq + offset, payload, 0, out);
+                std::span<const uint8_t> complete = result == DnsTcpReassembler::Result::Direct ? payload
+                    : result == DnsTcpReassembler::Result::Reassembled ? std::span<const uint8_t>(out) : std::span<const uint8_t>();
+                while (complete.size() >= 2) {
+                    size_t length = (static_cast<size_t>(complete[0]) << 8) | complete[1];
+                    WalkDnsMessage(complete.subspan(2, length), name);
+                    complete = complete.subspan(2 + length);
+                    messages++;
+                }
+            }
+            reassembler.Erase(key);
+        }
+        // Меньше 16 - сборка потеряла сообщение
+        state.SetCounter("messagesPerStream", static_cast<double>(messages));
+    });
+
+    Bench::Register("IPCSerializer.ServiceStatus/roundtrip", [](Bench::State& state) {
+        ServiceStatus status{};
+        status.isRunning = true;
+        status.monitorActive = true;
+        status.activeRoutes = 1234;
+        status.memoryUsageMB = 180;
+        status.uptime = std::chrono::seconds(86400);
+        RoundTripCase(state, 1,
+            [&] { return IPCSerializer::SerializeServiceStatus(status); },
+            [](const std::vector<uint8_t>& data) { Bench::DoNotOptimize(IPCSerializer::DeserializeServiceStatus(data)); });
+    });
+    Bench::Register("IPCSerializer.RouteList/1000/roundtrip", [](Bench::State& state) {
+        std::vector<RouteInfo> routes = MakeRouteList(1000);
+        RoundTripCase(state, 1000,
+            [&] { return IPCSerializer::SerializeRouteList(routes); },
+            [](const std::vector<uint8_t>& data) { Bench::DoNotOptimize(IPCSerializer::DeserializeRouteList(data)); });
+    });
+    Bench::Register("IPCSerializer.ProcessChanges/200/roundtrip", [](Bench::State& state) {
+        ProcessListDelta delta = MakeProcessDelta(200);
+        RoundTripCase(state, 200,
+            [&] { return IPCSerializer::SerializeProcessChanges(delta); },
+            [](const std::vector<uint8_t>& data) {
+                ProcessListDelta decoded;
+                Bench::DoNotOptimize(IPCSerializer::DeserializeProcessChanges(data, decoded));
+            });
+    });
+    Bench::Register("IPCSerializer.MemoryReport/roundtrip", [](Bench::State& state) {
+        MemoryReport report = MakeMemoryReport();
+        RoundTripCase(state, 1,
+            [&] { return IPCSerializer::SerializeMemoryReport(report); },
+            [](const std::vector<uint8_t>& data) {
+                MemoryReport decoded;
+                Bench::DoNotOptimize(IPCSerializer::DeserializeMemoryReport(data, decoded));
+            });
+    });
+
+    Bench::Register("Utils.IsValidIPv4+IsPrivateIP/mixed", [](Bench::State& state) {
+        // Половина - публичные адреса из DNS, остальное - приватные, мусор и IPv6
+        const std::array<std::string, 8> inputs = {
+            "93.184.216.34", "162.159.135.232", "10.200.210.1", "192.168.1.20",
+            "256.1.1.1", "1.2.3", "2606:4700::6810:84e5", "104.16.132.229"
+        };
+        size_t index = 0;
+        size_t accepted = 0;
+        state.SetItemsPerIteration(1);
+        while (state.KeepRunning()) {
+            const std::string& ip = inputs[index++ & (inputs.size() - 1)];
+            accepted += Utils::IsValidIPv4(ip) && !Utils::IsPrivateIP(ip) ? 1 : 0;
+        }
+        Bench::DoNotOptimize(accepted);
+    });
+
+    Bench::Register("Logger.AsyncInfo/throughput", [](Bench::State& state) {
+        Logger& logger = Logger::Instance();
+        uint64_t droppedBefore = logger.DroppedCount();
+        uint64_t sequence = 0;
+        while (state.KeepRunning()) {
+            LOG_INFO("Bench route {} -> {} for {}", sequence++, "93.184.216.34", "Discord.exe");
+        }
+        logger.Flush();
+        state.SetCounter("dropped", static_cast<double>(logger.DroppedCount() - droppedBefore));
+    });
+}
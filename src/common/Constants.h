@@ -9,24 +9,38 @@
 namespace Constants {
     // File paths
     inline const std::string PIPE_NAME = "\\\\.\\pipe\\RouteManagerPro";
+    inline const std::string STATUS_SECTION_NAME = "Global\\RouteManagerProStatus";
+    inline const std::string STATUS_SECTION_LOCAL_NAME = "Local\\RouteManagerProStatus";  // Сервис запущен без прав на Global
     inline const std::string CONFIG_FILE = "config.json";
-    inline const std::string STATE_FILE = "state.json";
+    inline const std::string STATE_FILE = "state.json";            // Legacy text state, read once for migration
+    inline const std::string STATE_SNAPSHOT_FILE = "state.bin";
+    inline const std::string STATE_JOURNAL_FILE = "state.journal";
     inline const std::string LOG_FILE = "route_manager.log";
     inline const std::string PRELOAD_CONFIG_FILE = "preload_ips.json";
+    inline const std::string PRELOAD_CACHE_FILE = "preload_ips.bin";      // Скомпилированный PRELOAD_CONFIG_FILE
 
     // Limits
     const int MAX_ROUTES = 10000;
-    const int MAX_MEMORY_MB = 500;
     const int MAX_CONNECTIONS = 10000;
     const int MAX_RETRY_ATTEMPTS = 10;
 
     // Timing intervals
     const int CLEANUP_INTERVAL_SEC = 300;
     const int WATCHDOG_INTERVAL_SEC = 10;
-    const int ROUTE_VERIFY_INTERVAL_SEC = 30;
+    const int MEMORY_SHED_AFTER_CHECKS = 2;         // Проверок подряд над общим бюджетом: первая ужимает, дальше - сброс
+    const int ROUTE_VERIFY_INTERVAL_SEC = 30;       // Polling fallback when change notifications are unavailable
+    const int ROUTE_AUDIT_INTERVAL_SEC = 600;       // Safety-net audit with change notifications active
+    const auto ROUTE_REPAIR_DEBOUNCE = std::chrono::milliseconds(100);
+    const auto ROUTE_NOTIFY_DEBOUNCE = std::chrono::milliseconds(150);
     const int PROCESS_UPDATE_INTERVAL_SEC = 2;
+    const int PROCESS_SNAPSHOT_INTERVAL_SEC = 5;        // Без ETW снимок - единственный источник
+    const int PROCESS_RECONCILE_INTERVAL_SEC = 300;     // С ETW снимок только сверяет кэш
+    const size_t PROCESS_TOMBSTONE_CAPACITY = 1024;     // Завершённых процессов, которые UI может догнать без полного списка
+    const uint64_t PID_VIEW_PUBLISH_INTERVAL_MS = 50;   // Не чаще: каждое перестроение view - O(n) под эксклюзивной блокировкой
     const auto CONNECTION_RETRY_DELAY = std::chrono::milliseconds(100);
     const auto SAVE_INTERVAL = std::chrono::minutes(10);
+    const auto JOURNAL_FLUSH_INTERVAL = std::chrono::seconds(5);
+    const size_t JOURNAL_COMPACT_RECORDS = 4096;
     const auto UI_UPDATE_INTERVAL = std::chrono::seconds(1);
     const auto REFRESH_INTERVAL = std::chrono::seconds(5);
 
@@ -40,6 +54,17 @@ namespace Constants {
     const int QUEUE_SIZE_DEVELOPMENT = 200;
     const int QUEUE_SIZE_NORMAL = 500;
 
+    // Route programming pipeline
+    const int ROUTE_PROGRAMMER_THREADS = 2;
+    const size_t ROUTE_PROGRAM_BATCH_SIZE = 64;
+    const size_t ROUTE_PROGRAM_QUEUE_LIMIT = 10000;
+    const size_t ROUTE_BULK_BATCH_SIZE = 16;        // Фоновые (preload) маршруты за батч, только при пустой основной очереди
+    const auto ROUTE_REROUTE_RETRY_MIN = std::chrono::seconds(1);   // Неудачный перенос на новый шлюз: пауза, удваивается
+    const auto ROUTE_REROUTE_RETRY_MAX = std::chrono::seconds(60);
+    const int ROUTE_RESTORE_THREADS = 4;            // Startup restore of persisted routes
+    const int ROUTE_OPTIMIZER_MAX_THREADS = 8;      // Разделы /8 оптимизируются параллельно
+    const size_t ROUTE_OPTIMIZER_PARALLEL_MIN_ROUTES = 4096;   // Меньше - быстрее одним потоком
+
     // Windows messages
     const int WM_TRAY_ICON = WM_USER + 1;
     const int WM_ROUTES_CLEARED = WM_USER + 100;
@@ -47,7 +72,11 @@ namespace Constants {
 
     // Cleanup thresholds
     const int CONNECTION_CLEANUP_HOURS = 1;
-    const int ROUTE_CLEANUP_HOURS = 48;
+    const int ROUTE_CLEANUP_HOURS = 48;             // Idle TTL since last use
+    const auto ROUTE_EXPIRY_TICK = std::chrono::seconds(60);
+    const size_t ROUTE_JOURNAL_CAPACITY = 8192;    // Изменений, которые UI может догнать без полного списка
+    const auto ROUTE_EVICT_MIN_IDLE = std::chrono::minutes(10);  // Never evict routes used more recently
+    const size_t ROUTE_EVICT_HEADROOM = 256;        // Evict down to MAX_ROUTES - headroom
     const auto AGGRESSIVE_CLEANUP_AGE = std::chrono::minutes(30);
 
     // Process filters - system processes to ignore
@@ -106,12 +135,57 @@ namespace Constants {
 
     // Network monitoring
     const int WINDIVERT_QUEUE_LENGTH = 16384;
-    const int WINDIVERT_QUEUE_TIME = 1;
+    const int WINDIVERT_QUEUE_TIME = 2000;      // ms, драйвер принимает 100..16000
     const int WINDIVERT_QUEUE_SIZE = 8388608;
+    const int FLOW_WORKER_MAX_THREADS = 16;
+    const int FLOW_RING_MAX_CAPACITY = 1 << 20;
+    const size_t FLOW_WORKER_POP_BATCH = 64;
+    const size_t FLOW_RECENT_SLOTS = 1024;          // Таблица недавних назначений для backpressure, степень 2
+    const int FLOW_RECV_MAX_OUTSTANDING = 16;
+    const int FLOW_SUMMARY_INTERVAL_SEC = 60;       // Сводка по FLOW-событиям вместо строки на событие
+
+    // Traffic capture
+    const auto CAPTURE_FLUSH_INTERVAL = std::chrono::milliseconds(500);
+    const size_t CAPTURE_FLUSH_BYTES = 1 << 20;             // Больше в буфере - писатель будится раньше срока
+    const size_t CAPTURE_MAX_PENDING_BYTES = 32 << 20;      // Диск не успевает: записи теряются, а не копятся в памяти
+
+    // Gateway pool
+    const size_t GATEWAY_POOL_MAX = 8;
+    const int GATEWAY_HEALTH_HOLD_PROBES = 3;       // Состояние шлюза меняется после стольких проб подряд
+    const int GATEWAY_MIN_SAMPLES = 5;              // Меньше проб в окне - про задержку ещё не судим
+    const auto GATEWAY_POLICY_REFRESH = std::chrono::seconds(5);    // Как часто пересматривать запущенные процессы
+
+    // DNS proxy
+    const size_t DNS_PID_CACHE_MAX_ENTRIES = 16384;
+    const int DNS_PID_CACHE_TTL_SEC = 300;          // Страховка на случай пропущенного CLOSE
+    const size_t DNS_SOCKET_RECV_BATCH = 64;
+    const int DNS_PROXY_MAX_WORKERS = 16;
+    const int DNS_RECV_MAX_OUTSTANDING = 8;
+    const size_t DNS_BATCH_BUFFER_BYTES = 131072;   // Вмещает пакет максимального размера и пачку обычных
+    const size_t DNS_NAT_MAX_ENTRIES = 8192;
+    const int DNS_NAT_UDP_TTL_SEC = 30;             // Ответ так и не пришёл
+    const int DNS_NAT_TCP_IDLE_SEC = 120;
+    const int DNS_NAT_TCP_LINGER_SEC = 10;          // После FIN, чтобы переписать оставшиеся сегменты
+    const int DNS_NAT_SWEEP_INTERVAL_SEC = 5;
+    const size_t DNS_ANSWER_CACHE_MAX_ENTRIES = 16384;
+    const int DNS_ROUTE_MIN_TTL_SEC = 60;           // TTL 0..59 не должен снимать маршрут раньше соединения
+    const int DNS_ROUTE_MAX_TTL_SEC = 86400;
+    const uint16_t DNS_EDNS_MAX_UDP_PAYLOAD = 1232;  // Без фрагментации даже через туннель
+    const size_t DNS_TCP_MAX_STREAMS = 256;         // Одновременно отслеживаемых TCP-потоков ответов
+
+    // Метрики производительности
+    const int PERF_ETW_INTERVAL_SEC = 1;            // Публикация в ETW, только пока провайдер включён сессией
+    const UINT PERF_PANEL_REFRESH_MS = 1000;        // Обновление панели, только пока она открыта
 
     // IPC buffer sizes
     const size_t IPC_INITIAL_BUFFER_SIZE = 65536;
     const size_t IPC_MAX_MESSAGE_SIZE = 1048576; // 1MB
+    const size_t IPC_READ_CHUNK_SIZE = 4096;        // Запросы почти всегда укладываются в один кусок
+    const int IPC_LISTEN_INSTANCES = 4;             // Экземпляров канала, ждущих клиента одновременно
+    const int IPC_WORKER_THREADS = 4;               // Потоки порта завершения: чтение, запись, короткие команды
+    const size_t IPC_MAX_QUEUED_NOTIFICATIONS = 2;  // Больше в очереди записи - клиент не читает, уведомление пропускаем
+    const auto STATUS_PUBLISH_INTERVAL = std::chrono::seconds(1);
+    const uint64_t STATUS_STALE_MS = 5000;          // Секция не обновлялась дольше - сервис не работает
 
     // Cache sizes
     const size_t MAIN_CACHE_MAX_SIZE = 10000;
@@ -1,5 +1,7 @@
 // src/common/IPCProtocol.h
 #pragma once
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 #include "Models.h"
@@ -17,22 +19,41 @@ enum class IPCMessageType {
     OptimizeRoutes = 10,
     SetAIPreload = 12,
     CleanupRedundantRoutes = 13,
-    SetDnsProxy = 14
+    SetDnsProxy = 14,
+    GetPerfReport = 15,
+    SubscribeRoutes = 16,           // Ответ, затем уведомление с тем же ID при каждом изменении: номер журнала
+    GetRouteChangesSince = 17,
+    GetProcessChangesSince = 18,
+    GetMemoryReport = 19,
+    GetPreloadStatus = 20,
+    SetPreloadService = 21          // Включение одного сервиса preload: флаг и имя
 };
 
+// Request frame: type, request ID, payload. Response frame: the same ID,
+// success flag, payload, error text. The client picks the IDs, so it may send
+// several requests without waiting: the server answers each one as it
+// completes, long-running commands last, and IDs pair the answers back up.
 struct IPCMessage {
     IPCMessageType type;
+    uint32_t requestId = 0;
     std::vector<uint8_t> data;
 };
 
 struct IPCResponse {
-    bool success;
+    uint32_t requestId = 0;
+    bool success = false;
     std::vector<uint8_t> data;
     std::string error;
 };
 
 class IPCSerializer {
 public:
+    static std::vector<uint8_t> SerializeRequest(const IPCMessage& message);
+    static bool DeserializeRequest(std::span<const uint8_t> frame, IPCMessage& message);
+
+    static std::vector<uint8_t> SerializeResponse(const IPCResponse& response);
+    static bool DeserializeResponse(std::span<const uint8_t> frame, IPCResponse& response);
+
     static std::vector<uint8_t> SerializeServiceStatus(const ServiceStatus& status);
     static ServiceStatus DeserializeServiceStatus(const std::vector<uint8_t>& data);
 
@@ -47,4 +68,25 @@ public:
 
     static std::vector<uint8_t> SerializeStringList(const std::vector<std::string>& strings);
     static std::vector<std::string> DeserializeStringList(const std::vector<uint8_t>& data);
+
+    static std::vector<uint8_t> SerializePerfReport(const PerfReportData& report);
+    static PerfReportData DeserializePerfReport(const std::vector<uint8_t>& data);
+
+    static std::vector<uint8_t> SerializeSequence(uint64_t sequence);
+    static uint64_t DeserializeSequence(const std::vector<uint8_t>& data);
+
+    static std::vector<uint8_t> SerializeRouteChanges(const RouteChangeSet& changes);
+    static bool DeserializeRouteChanges(const std::vector<uint8_t>& data, RouteChangeSet& changes);
+
+    static std::vector<uint8_t> SerializeProcessChanges(const ProcessListDelta& delta);
+    static bool DeserializeProcessChanges(const std::vector<uint8_t>& data, ProcessListDelta& delta);
+
+    static std::vector<uint8_t> SerializeMemoryReport(const MemoryReport& report);
+    static bool DeserializeMemoryReport(const std::vector<uint8_t>& data, MemoryReport& report);
+
+    static std::vector<uint8_t> SerializePreloadStatus(const PreloadStatus& status);
+    static bool DeserializePreloadStatus(const std::vector<uint8_t>& data, PreloadStatus& status);
+
+    static std::vector<uint8_t> SerializePreloadService(const std::string& service, bool enabled);
+    static bool DeserializePreloadService(const std::vector<uint8_t>& data, std::string& service, bool& enabled);
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 ﻿// src/common/IPCSerializer.cpp
 #include "IPCProtocol.h"
+#include <algorithm>
 #include <cstring>
 #include <span>
 
@@ -20,6 +21,20 @@ static void WriteBytes(std::span<uint8_t> buffer, size_t& offset, const void* da
     }
 }
 
+// LEB128: счётчики и микросекунды в отчёте производительности обычно укладываются в 1-3 байта
+static void WriteVarint(std::vector<uint8_t>& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+static void WriteShortString(std::vector<uint8_t>& buffer, const std::string& str) {
+    WriteVarint(buffer, str.size());
+    buffer.insert(buffer.end(), str.begin(), str.end());
+}
+
 // Вспомогательная функция для чтения данных
 template<typename T>
 static bool ReadData(std::span<const uint8_t> buffer, size_t& offset, T& data) {
@@ -41,6 +56,81 @@ static bool ReadBytes(std::span<const uint8_t> buffer, size_t& offset, void* dat
     return false;
 }
 
+static bool ReadVarint(std::span<const uint8_t> buffer, size_t& offset, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && offset < buffer.size(); shift += 7) {
+        uint8_t byte = buffer[offset++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static bool ReadShortString(std::span<const uint8_t> buffer, size_t& offset, std::string& str) {
+    uint64_t length;
+    if (!ReadVarint(buffer, offset, length) || length > buffer.size() - offset) return false;
+    str.assign(reinterpret_cast<const char*>(buffer.data() + offset), static_cast<size_t>(length));
+    offset += static_cast<size_t>(length);
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeRequest(const IPCMessage& message) {
+    std::vector<uint8_t> frame(sizeof(uint32_t) * 2 + message.data.size());
+    size_t offset = 0;
+    WriteData(frame, offset, static_cast<uint32_t>(message.type));
+    WriteData(frame, offset, message.requestId);
+    if (!message.data.empty()) {
+        WriteBytes(frame, offset, message.data.data(), message.data.size());
+    }
+    return frame;
+}
+
+bool IPCSerializer::DeserializeRequest(std::span<const uint8_t> frame, IPCMessage& message) {
+    size_t offset = 0;
+    uint32_t type;
+    if (!ReadData(frame, offset, type) || !ReadData(frame, offset, message.requestId)) {
+        return false;
+    }
+    message.type = static_cast<IPCMessageType>(type);
+    message.data.assign(frame.begin() + offset, frame.end());
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeResponse(const IPCResponse& response) {
+    std::vector<uint8_t> frame(sizeof(uint32_t) * 3 + sizeof(uint8_t) + response.data.size() + response.error.size());
+    size_t offset = 0;
+    WriteData(frame, offset, response.requestId);
+    WriteData(frame, offset, static_cast<uint8_t>(response.success ? 1 : 0));
+    WriteData(frame, offset, static_cast<uint32_t>(response.data.size()));
+    if (!response.data.empty()) {
+        WriteBytes(frame, offset, response.data.data(), response.data.size());
+    }
+    WriteData(frame, offset, static_cast<uint32_t>(response.error.size()));
+    if (!response.error.empty()) {
+        WriteBytes(frame, offset, response.error.data(), response.error.size());
+    }
+    return frame;
+}
+
+bool IPCSerializer::DeserializeResponse(std::span<const uint8_t> frame, IPCResponse& response) {
+    size_t offset = 0;
+    uint8_t success;
+    uint32_t dataSize, errorSize;
+    if (!ReadData(frame, offset, response.requestId) || !ReadData(frame, offset, success) ||
+        !ReadData(frame, offset, dataSize) || dataSize > frame.size() - offset) {
+        return false;
+    }
+    response.success = success != 0;
+    response.data.assign(frame.begin() + offset, frame.begin() + offset + dataSize);
+    offset += dataSize;
+
+    if (!ReadData(frame, offset, errorSize) || errorSize > frame.size() - offset) {
+        return false;
+    }
+    response.error.assign(reinterpret_cast<const char*>(frame.data() + offset), errorSize);
+    return true;
+}
+
 std::vector<uint8_t> IPCSerializer::SerializeServiceStatus(const ServiceStatus& status) {
     std::vector<uint8_t> data;
     data.resize(sizeof(bool) * 2 + sizeof(size_t) * 2 + sizeof(int64_t));
@@ -54,6 +144,29 @@ std::vector<uint8_t> IPCSerializer::SerializeServiceStatus(const ServiceStatus&
     int64_t uptimeCount = status.uptime.count();
     WriteData(std::span(data), offset, uptimeCount);
 
+    data.resize(data.size() + sizeof(bool) + sizeof(size_t) * 2);
+    WriteData(std::span(data), offset, status.routesRestored);
+    WriteData(std::span(data), offset, status.restoreTotal);
+    WriteData(std::span(data), offset, status.restoreDone);
+
+    data.resize(data.size() + sizeof(size_t) * 4 + sizeof(int64_t));
+    WriteData(std::span(data), offset, status.lastPlanAggregates);
+    WriteData(std::span(data), offset, status.lastPlanRolledBack);
+    WriteData(std::span(data), offset, status.lastPlanRoutesRetired);
+    WriteData(std::span(data), offset, status.lastPlanFailures);
+    WriteData(std::span(data), offset, status.lastPlanDurationMs);
+
+    data.resize(data.size() + sizeof(bool) + sizeof(uint64_t) + sizeof(size_t) * 3 + sizeof(int64_t));
+    WriteData(std::span(data), offset, status.migrationActive);
+    WriteData(std::span(data), offset, status.configGeneration);
+    WriteData(std::span(data), offset, status.migrationTotal);
+    WriteData(std::span(data), offset, status.migrationDone);
+    WriteData(std::span(data), offset, status.migrationFailed);
+    WriteData(std::span(data), offset, status.migrationDurationMs);
+
+    data.resize(data.size() + sizeof(size_t));
+    WriteData(std::span(data), offset, status.lastPlanSyscalls);
+
     return data;
 }
 
@@ -73,6 +186,36 @@ ServiceStatus IPCSerializer::DeserializeServiceStatus(const std::vector<uint8_t>
     ReadData(std::span(data), offset, uptimeCount);
     status.uptime = std::chrono::seconds(uptimeCount);
 
+    // Прогресс восстановления маршрутов; старый сервис его не передаёт
+    if (!ReadData(std::span(data), offset, status.routesRestored)) {
+        status.routesRestored = true;
+        return status;
+    }
+    ReadData(std::span(data), offset, status.restoreTotal);
+    ReadData(std::span(data), offset, status.restoreDone);
+
+    // Итог последнего плана оптимизации
+    if (!ReadData(std::span(data), offset, status.lastPlanAggregates)) {
+        return status;
+    }
+    ReadData(std::span(data), offset, status.lastPlanRolledBack);
+    ReadData(std::span(data), offset, status.lastPlanRoutesRetired);
+    ReadData(std::span(data), offset, status.lastPlanFailures);
+    ReadData(std::span(data), offset, status.lastPlanDurationMs);
+
+    // Миграция шлюза
+    if (!ReadData(std::span(data), offset, status.migrationActive)) {
+        return status;
+    }
+    ReadData(std::span(data), offset, status.configGeneration);
+    ReadData(std::span(data), offset, status.migrationTotal);
+    ReadData(std::span(data), offset, status.migrationDone);
+    ReadData(std::span(data), offset, status.migrationFailed);
+    ReadData(std::span(data), offset, status.migrationDurationMs);
+
+    // Системные вызовы плана; старый сервис их не передаёт, остаётся 0
+    ReadData(std::span(data), offset, status.lastPlanSyscalls);
+
     return status;
 }
 
@@ -434,4 +577,404 @@ std::vector<std::string> IPCSerializer::DeserializeStringList(const std::vector<
     }
 
     return strings;
-}
\ No newline at end of file
+}
+
+std::vector<uint8_t> IPCSerializer::SerializePerfReport(const PerfReportData& report) {
+    std::vector<uint8_t> data;
+    data.reserve(64 + (report.counters.size() + report.timers.size()) * 48);
+
+    WriteVarint(data, report.uptimeMs);
+
+    for (const auto* values : { &report.counters, &report.gauges }) {
+        WriteVarint(data, values->size());
+        for (const auto& [name, value] : *values) {
+            WriteShortString(data, name);
+            WriteVarint(data, value);
+        }
+    }
+
+    WriteVarint(data, report.timers.size());
+    for (const auto& timer : report.timers) {
+        WriteShortString(data, timer.name);
+        WriteVarint(data, timer.count);
+        WriteVarint(data, timer.avgUs);
+        WriteVarint(data, timer.p50Us);
+        WriteVarint(data, timer.p99Us);
+        WriteVarint(data, timer.p999Us);
+        WriteVarint(data, timer.maxUs);
+    }
+
+    return data;
+}
+
+PerfReportData IPCSerializer::DeserializePerfReport(const std::vector<uint8_t>& data) {
+    PerfReportData report;
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+
+    uint64_t count;
+    if (!ReadVarint(buffer, offset, report.uptimeMs)) {
+        return report;
+    }
+
+    // Числу элементов не доверяем для reserve: каждый занимает хотя бы 2 байта
+    for (auto* values : { &report.counters, &report.gauges }) {
+        if (!ReadVarint(buffer, offset, count)) {
+            return report;
+        }
+        values->reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 2))));
+        for (uint64_t i = 0; i < count; i++) {
+            std::string name;
+            uint64_t value;
+            if (!ReadShortString(buffer, offset, name) || !ReadVarint(buffer, offset, value)) {
+                return report;
+            }
+            values->emplace_back(std::move(name), value);
+        }
+    }
+
+    if (!ReadVarint(buffer, offset, count)) {
+        return report;
+    }
+    report.timers.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 7))));
+    for (uint64_t i = 0; i < count; i++) {
+        PerfTimerSample timer;
+        if (!ReadShortString(buffer, offset, timer.name) ||
+            !ReadVarint(buffer, offset, timer.count) ||
+            !ReadVarint(buffer, offset, timer.avgUs) ||
+            !ReadVarint(buffer, offset, timer.p50Us) ||
+            !ReadVarint(buffer, offset, timer.p99Us) ||
+            !ReadVarint(buffer, offset, timer.p999Us) ||
+            !ReadVarint(buffer, offset, timer.maxUs)) {
+            return report;
+        }
+        report.timers.push_back(std::move(timer));
+    }
+
+    return report;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeSequence(uint64_t sequence) {
+    std::vector<uint8_t> data(sizeof(uint64_t));
+    size_t offset = 0;
+    WriteData(data, offset, sequence);
+    return data;
+}
+
+uint64_t IPCSerializer::DeserializeSequence(const std::vector<uint8_t>& data) {
+    size_t offset = 0;
+    uint64_t sequence = 0;
+    ReadData(std::span<const uint8_t>(data), offset, sequence);
+    return sequence;
+}
+
+// Маршрут в дельте: адрес и имя короткими строками, числа в LEB128
+static void WriteRoute(std::vector<uint8_t>& buffer, const RouteInfo& route) {
+    WriteShortString(buffer, route.ip);
+    WriteShortString(buffer, route.processName);
+    WriteVarint(buffer, static_cast<uint64_t>((std::max)(route.refCount.load(), 0)));
+    WriteVarint(buffer, static_cast<uint64_t>((std::max)(std::chrono::duration_cast<std::chrono::seconds>(
+        route.createdAt.time_since_epoch()).count(), int64_t{ 0 })));
+    buffer.push_back(static_cast<uint8_t>(route.prefixLength));
+}
+
+static bool ReadRoute(std::span<const uint8_t> buffer, size_t& offset, RouteInfo& route) {
+    uint64_t refCount, createdAt;
+    uint8_t prefixLength;
+    if (!ReadShortString(buffer, offset, route.ip) ||
+        !ReadShortString(buffer, offset, route.processName) ||
+        !ReadVarint(buffer, offset, refCount) ||
+        !ReadVarint(buffer, offset, createdAt) ||
+        !ReadData(buffer, offset, prefixLength)) {
+        return false;
+    }
+    route.refCount = static_cast<int>((std::min)(refCount, static_cast<uint64_t>(INT32_MAX)));
+    route.createdAt = std::chrono::system_clock::time_point(std::chrono::seconds(createdAt));
+    route.prefixLength = prefixLength;
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeRouteChanges(const RouteChangeSet& changes) {
+    std::vector<uint8_t> data;
+    data.reserve(16 + (changes.routes.size() + changes.changes.size()) * 40);
+
+    WriteVarint(data, changes.sequence);
+    data.push_back(changes.fullResync ? 1 : 0);
+
+    WriteVarint(data, changes.routes.size());
+    for (const auto& route : changes.routes) {
+        WriteRoute(data, route);
+    }
+
+    WriteVarint(data, changes.changes.size());
+    for (const auto& change : changes.changes) {
+        data.push_back(static_cast<uint8_t>(change.type));
+        WriteRoute(data, change.route);
+    }
+
+    return data;
+}
+
+bool IPCSerializer::DeserializeRouteChanges(const std::vector<uint8_t>& data, RouteChangeSet& changes) {
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+    uint8_t fullResync;
+    uint64_t count;
+
+    if (!ReadVarint(buffer, offset, changes.sequence) || !ReadData(buffer, offset, fullResync)) {
+        return false;
+    }
+    changes.fullResync = fullResync != 0;
+
+    // Каждый маршрут занимает не меньше 5 байт: reserve не доверяет счётчику
+    if (!ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    changes.routes.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 5))));
+    for (uint64_t i = 0; i < count; i++) {
+        RouteInfo route;
+        if (!ReadRoute(buffer, offset, route)) {
+            return false;
+        }
+        changes.routes.push_back(std::move(route));
+    }
+
+    if (!ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    changes.changes.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 6))));
+    for (uint64_t i = 0; i < count; i++) {
+        RouteChange change;
+        uint8_t type;
+        if (!ReadData(buffer, offset, type) || !ReadRoute(buffer, offset, change.route)) {
+            return false;
+        }
+        change.type = static_cast<RouteChangeType>(type);
+        changes.changes.push_back(std::move(change));
+    }
+
+    return true;
+}
+
+// UTF-16 как есть, длина в символах
+static void WriteWideString(std::vector<uint8_t>& buffer, const std::wstring& str) {
+    WriteVarint(buffer, str.size());
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(str.data());
+    buffer.insert(buffer.end(), bytes, bytes + str.size() * sizeof(wchar_t));
+}
+
+static bool ReadWideString(std::span<const uint8_t> buffer, size_t& offset, std::wstring& str) {
+    uint64_t length;
+    if (!ReadVarint(buffer, offset, length) || length > (buffer.size() - offset) / sizeof(wchar_t)) return false;
+    str.resize(static_cast<size_t>(length));
+    return ReadBytes(buffer, offset, str.data(), str.size() * sizeof(wchar_t));
+}
+
+// Флаги процесса одним байтом: isSelected, isGame, isDiscord
+static void WriteProcess(std::vector<uint8_t>& buffer, const ProcessInfo& process) {
+    WriteVarint(buffer, process.pid);
+    WriteVarint(buffer, process.creationTime);
+    WriteWideString(buffer, process.name);
+    WriteWideString(buffer, process.executablePath);
+    buffer.push_back(static_cast<uint8_t>((process.isSelected ? 1 : 0) | (process.isGame ? 2 : 0) | (process.isDiscord ? 4 : 0)));
+}
+
+static bool ReadProcess(std::span<const uint8_t> buffer, size_t& offset, ProcessInfo& process) {
+    uint64_t pid;
+    uint8_t flags;
+    if (!ReadVarint(buffer, offset, pid) ||
+        !ReadVarint(buffer, offset, process.creationTime) ||
+        !ReadWideString(buffer, offset, process.name) ||
+        !ReadWideString(buffer, offset, process.executablePath) ||
+        !ReadData(buffer, offset, flags)) {
+        return false;
+    }
+    process.pid = static_cast<DWORD>(pid);
+    process.isSelected = (flags & 1) != 0;
+    process.isGame = (flags & 2) != 0;
+    process.isDiscord = (flags & 4) != 0;
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeProcessChanges(const ProcessListDelta& delta) {
+    std::vector<uint8_t> data;
+    data.reserve(16 + delta.upserts.size() * 120 + delta.removed.size() * 12);
+
+    WriteVarint(data, delta.version);
+    data.push_back(delta.fullResync ? 1 : 0);
+
+    WriteVarint(data, delta.upserts.size());
+    for (const auto& process : delta.upserts) {
+        WriteProcess(data, process);
+    }
+
+    WriteVarint(data, delta.removed.size());
+    for (const auto& key : delta.removed) {
+        WriteVarint(data, key.pid);
+        WriteVarint(data, key.creationTime);
+    }
+
+    return data;
+}
+
+bool IPCSerializer::DeserializeProcessChanges(const std::vector<uint8_t>& data, ProcessListDelta& delta) {
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+    uint8_t fullResync;
+    uint64_t count;
+
+    if (!ReadVarint(buffer, offset, delta.version) || !ReadData(buffer, offset, fullResync)) {
+        return false;
+    }
+    delta.fullResync = fullResync != 0;
+
+    // Процесс занимает не меньше 5 байт, ключ - не меньше 2: reserve не доверяет счётчику
+    if (!ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    delta.upserts.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 5))));
+    for (uint64_t i = 0; i < count; i++) {
+        ProcessInfo process;
+        if (!ReadProcess(buffer, offset, process)) {
+            return false;
+        }
+        delta.upserts.push_back(std::move(process));
+    }
+
+    if (!ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    delta.removed.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 2))));
+    for (uint64_t i = 0; i < count; i++) {
+        ProcessKey key;
+        uint64_t pid;
+        if (!ReadVarint(buffer, offset, pid) || !ReadVarint(buffer, offset, key.creationTime)) {
+            return false;
+        }
+        key.pid = static_cast<DWORD>(pid);
+        delta.removed.push_back(key);
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializeMemoryReport(const MemoryReport& report) {
+    std::vector<uint8_t> data;
+    data.reserve(32 + report.subsystems.size() * 32);
+
+    WriteVarint(data, report.workingSetBytes);
+    WriteVarint(data, report.budgetBytes);
+    data.push_back(static_cast<uint8_t>(report.pressure));
+    WriteVarint(data, report.sheds);
+
+    WriteVarint(data, report.subsystems.size());
+    for (const auto& subsystem : report.subsystems) {
+        WriteShortString(data, subsystem.name);
+        WriteVarint(data, subsystem.usedBytes);
+        WriteVarint(data, subsystem.budgetBytes);
+        WriteVarint(data, subsystem.trims);
+    }
+
+    return data;
+}
+
+bool IPCSerializer::DeserializeMemoryReport(const std::vector<uint8_t>& data, MemoryReport& report) {
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+    uint8_t pressure;
+    uint64_t count;
+
+    if (!ReadVarint(buffer, offset, report.workingSetBytes) ||
+        !ReadVarint(buffer, offset, report.budgetBytes) ||
+        !ReadData(buffer, offset, pressure) ||
+        !ReadVarint(buffer, offset, report.sheds) ||
+        !ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    report.pressure = pressure <= static_cast<uint8_t>(MemoryPressure::Shed) ?
+        static_cast<MemoryPressure>(pressure) : MemoryPressure::Normal;
+
+    // Подсистема занимает не меньше 4 байт
+    report.subsystems.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 4))));
+    for (uint64_t i = 0; i < count; i++) {
+        MemorySubsystemUsage subsystem;
+        if (!ReadShortString(buffer, offset, subsystem.name) ||
+            !ReadVarint(buffer, offset, subsystem.usedBytes) ||
+            !ReadVarint(buffer, offset, subsystem.budgetBytes) ||
+            !ReadVarint(buffer, offset, subsystem.trims)) {
+            return false;
+        }
+        report.subsystems.push_back(std::move(subsystem));
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializePreloadStatus(const PreloadStatus& status) {
+    std::vector<uint8_t> data;
+    data.reserve(16 + status.services.size() * 24);
+
+    data.push_back(status.active ? 1 : 0);
+    WriteVarint(data, status.queued);
+
+    WriteVarint(data, status.services.size());
+    for (const auto& service : status.services) {
+        WriteShortString(data, service.name);
+        data.push_back(service.enabled ? 1 : 0);
+        WriteVarint(data, service.ranges);
+        WriteVarint(data, service.installed);
+    }
+
+    return data;
+}
+
+bool IPCSerializer::DeserializePreloadStatus(const std::vector<uint8_t>& data, PreloadStatus& status) {
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+    uint8_t active;
+    uint64_t count;
+
+    if (!ReadData(buffer, offset, active) ||
+        !ReadVarint(buffer, offset, status.queued) ||
+        !ReadVarint(buffer, offset, count)) {
+        return false;
+    }
+    status.active = active != 0;
+
+    // Сервис занимает не меньше 4 байт
+    status.services.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(data.size() / 4))));
+    for (uint64_t i = 0; i < count; i++) {
+        PreloadServiceStatus service;
+        uint8_t enabled;
+        if (!ReadShortString(buffer, offset, service.name) ||
+            !ReadData(buffer, offset, enabled) ||
+            !ReadVarint(buffer, offset, service.ranges) ||
+            !ReadVarint(buffer, offset, service.installed)) {
+            return false;
+        }
+        service.enabled = enabled != 0;
+        status.services.push_back(std::move(service));
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> IPCSerializer::SerializePreloadService(const std::string& service, bool enabled) {
+    std::vector<uint8_t> data;
+    data.reserve(service.size() + 3);
+    data.push_back(enabled ? 1 : 0);
+    WriteShortString(data, service);
+    return data;
+}
+
+bool IPCSerializer::DeserializePreloadService(const std::vector<uint8_t>& data, std::string& service, bool& enabled) {
+    std::span<const uint8_t> buffer(data);
+    size_t offset = 0;
+    uint8_t flag;
+
+    if (!ReadData(buffer, offset, flag) || !ReadShortString(buffer, offset, service)) {
+        return false;
+    }
+    enabled = flag != 0;
+    return !service.empty();
+}
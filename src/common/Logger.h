@@ -1,22 +1,32 @@
 ﻿// src/common/Logger.h
 #pragma once
 #include <string>
-#include <fstream>
+#include <string_view>
 #include <mutex>
 #include <chrono>
-#include <sstream>
 #include <filesystem>
 #include <ctime>
+#include <cstdio>
 #include <format>
-#include <deque>
+#include <memory>
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <bit>
+#include <algorithm>
 
 #ifdef __cpp_lib_stacktrace
 #include <stacktrace>
 #endif
 
+// Asynchronous logger. Producers claim a preallocated slot in a bounded
+// lock-free MPSC ring (Vyukov-style per-slot sequence numbers), format the
+// message straight into it and publish; a single writer thread drains the
+// ring, prefixes timestamps and writes each batch with one unbuffered fwrite
+// (one WriteFile), rotating files by size. A full ring either drops the
+// message (counted and reported by the writer) or makes the caller wait,
+// per LogConfig::overflowPolicy. Use the LOG_* macros on hot paths: when the
+// level is off they skip argument evaluation and formatting entirely.
 class Logger {
 public:
     enum class LogLevel {
@@ -26,12 +36,18 @@ public:
         LEVEL_ERROR = 3
     };
 
+    enum class OverflowPolicy {
+        Drop,       // Полное кольцо: сообщение теряется, писатель сообщает, сколько
+        Block       // Ждать место в кольце; не для потоков программирования маршрутов
+    };
+
     struct LogConfig {
         size_t maxFileSize = 10 * 1024 * 1024;  // 10MB
         size_t maxFiles = 5;
         bool asyncLogging = true;
-        size_t bufferSize = 1000;
-        std::chrono::milliseconds flushInterval{ 1000 };
+        size_t bufferSize = 4096;               // Записей в кольце, округляется до степени 2
+        OverflowPolicy overflowPolicy = OverflowPolicy::Drop;
+        std::chrono::milliseconds flushInterval{ 1000 };    // Наибольший сон писателя без сигнала
     };
 
     static Logger& Instance() {
@@ -40,18 +56,25 @@ public:
     }
 
     void SetLogLevel(LogLevel level) {
-        currentLogLevel = level;
+        currentLogLevel.store(level, std::memory_order_relaxed);
+    }
+
+    // Для горячих путей: проверить уровень до того, как форматировать сообщение
+    bool IsEnabled(LogLevel level) const {
+        return level >= currentLogLevel.load(std::memory_order_relaxed);
     }
 
+    // Переразмечает кольцо: вызывать при старте, пока другие потоки не пишут в лог
     void SetConfig(const LogConfig& cfg) {
         std::lock_guard<std::mutex> lock(configMutex);
-        config = cfg;
+        StopAsyncLogging();
 
-        if (config.asyncLogging && !asyncThread.joinable()) {
-            StartAsyncLogging();
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex);
+            config = cfg;
         }
-        else if (!config.asyncLogging && asyncThread.joinable()) {
-            StopAsyncLogging();
+        if (config.asyncLogging) {
+            StartAsyncLogging();
         }
     }
 
@@ -60,54 +83,84 @@ public:
     }
 
     void Log(const std::string& message, LogLevel level) {
-        if (level < currentLogLevel) {
-            return;
-        }
-
-        auto now = std::chrono::system_clock::now();
-        LogEntry entry{ now, level, message };
+        if (!IsEnabled(level)) return;
+        Write(level, {}, message);
+    }
 
-        if (config.asyncLogging) {
-            std::lock_guard<std::mutex> lock(bufferMutex);
-            if (buffer.size() >= config.bufferSize) {
-                buffer.pop_front();
-            }
-            buffer.push_back(entry);
-            bufferCV.notify_one();
-        }
-        else {
-            WriteEntry(entry);
-        }
+    void Error(std::string_view message) {
+        if (IsEnabled(LogLevel::LEVEL_ERROR)) Write(LogLevel::LEVEL_ERROR, "ERROR: ", message);
     }
 
-    void Error(const std::string& message) {
-        Log("ERROR: " + message, LogLevel::LEVEL_ERROR);
+    void Info(std::string_view message) {
+        if (IsEnabled(LogLevel::LEVEL_INFO)) Write(LogLevel::LEVEL_INFO, "INFO: ", message);
     }
 
-    void Info(const std::string& message) {
-        Log("INFO: " + message, LogLevel::LEVEL_INFO);
+    void Debug(std::string_view message) {
+        if (IsEnabled(LogLevel::LEVEL_DEBUG)) Write(LogLevel::LEVEL_DEBUG, "DEBUG: ", message);
     }
 
-    void Debug(const std::string& message) {
-        Log("DEBUG: " + message, LogLevel::LEVEL_DEBUG);
+    void Warning(std::string_view message) {
+        if (IsEnabled(LogLevel::LEVEL_WARNING)) Write(LogLevel::LEVEL_WARNING, "WARNING: ", message);
     }
 
-    void Warning(const std::string& message) {
-        Log("WARNING: " + message, LogLevel::LEVEL_WARNING);
+    // Форматирует прямо в слот кольца; длинное сообщение уходит в строку слота
+    template<typename... Args>
+    void Format(LogLevel level, std::string_view prefix, std::format_string<Args...> fmt, Args&&... args) {
+        size_t pos = 0;
+        Slot* slot = asyncActive.load(std::memory_order_acquire) ? Claim(pos) : nullptr;
+        if (!slot) {
+            if (!asyncActive.load(std::memory_order_acquire)) {
+                WriteSync(level, std::string(prefix) + std::format(fmt, std::forward<Args>(args)...));
+            }
+            return;
+        }
+
+        size_t prefixLength = (std::min)(prefix.size(), Slot::INLINE_TEXT);
+        std::copy_n(prefix.data(), prefixLength, slot->text);
+        // Слот уже занят: исключение форматтера не должно оставить его неопубликованным,
+        // иначе писатель встанет на нём навсегда
+        try {
+            // format_to_n не перемещает аргументы, поэтому второй проход для длинного сообщения безопасен
+            auto result = std::format_to_n(slot->text + prefixLength, Slot::INLINE_TEXT - prefixLength,
+                fmt, std::forward<Args>(args)...);
+            if (static_cast<size_t>(result.size) <= Slot::INLINE_TEXT - prefixLength) {
+                slot->length = static_cast<uint32_t>(prefixLength + result.size);
+            }
+            else {
+                slot->overflow.assign(prefix);
+                std::format_to(std::back_inserter(slot->overflow), fmt, std::forward<Args>(args)...);
+                slot->length = Slot::USE_OVERFLOW;
+            }
+        }
+        catch (...) {
+            constexpr std::string_view FORMAT_FAILED = "<log message formatting failed>";
+            size_t failedLength = (std::min)(FORMAT_FAILED.size(), Slot::INLINE_TEXT - prefixLength);
+            std::copy_n(FORMAT_FAILED.data(), failedLength, slot->text + prefixLength);
+            slot->length = static_cast<uint32_t>(prefixLength + failedLength);
+        }
+        Publish(slot, pos, level);
     }
 
+    // Ждёт, пока писатель сбросит всё, что было в кольце на момент вызова
     void Flush() {
-        if (config.asyncLogging) {
-            std::unique_lock<std::mutex> lock(bufferMutex);
-            while (!buffer.empty()) {
-                bufferCV.wait(lock);
+        if (asyncActive.load(std::memory_order_acquire)) {
+            size_t target = enqueuePos.load(std::memory_order_acquire);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (writtenPos.load(std::memory_order_acquire) < target &&
+                std::chrono::steady_clock::now() < deadline) {
+                WakeWriter();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
         }
+    }
 
-        std::lock_guard<std::mutex> lock(fileMutex);
-        if (logFile_.is_open()) {
-            logFile_.flush();
-        }
+    uint64_t DroppedCount() const {
+        return droppedTotal.load(std::memory_order_relaxed);
+    }
+
+    // Кольцо выделяется один раз при старте асинхронной записи; overflow-строки слотов не учитываются
+    size_t MemoryBytes() const {
+        return asyncActive.load(std::memory_order_acquire) ? (ringMask + 1) * sizeof(Slot) : 0;
     }
 
 #ifdef __cpp_lib_stacktrace
@@ -123,12 +176,12 @@ public:
 #endif
 
     ~Logger() {
-        if (config.asyncLogging) {
-            StopAsyncLogging();
-        }
+        StopAsyncLogging();
 
-        if (logFile_.is_open()) {
-            logFile_.close();
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (logFile) {
+            std::fclose(logFile);
+            logFile = nullptr;
         }
     }
 
@@ -144,105 +197,273 @@ private:
         }
     }
 
-    struct LogEntry {
+    struct alignas(64) Slot {
+        static constexpr size_t INLINE_TEXT = 200;
+        static constexpr uint32_t USE_OVERFLOW = UINT32_MAX;
+
+        std::atomic<size_t> sequence{ 0 };
         std::chrono::system_clock::time_point timestamp;
-        LogLevel level;
-        std::string message;
+        LogLevel level = LogLevel::LEVEL_INFO;
+        uint32_t length = 0;
+        char text[INLINE_TEXT];
+        std::string overflow;               // Только для сообщений длиннее INLINE_TEXT
+
+        std::string_view Text() const {
+            return length == USE_OVERFLOW ? std::string_view(overflow) : std::string_view(text, length);
+        }
     };
 
+    static constexpr size_t WRITE_BATCH_BYTES = 64 * 1024;
+
+    void Write(LogLevel level, std::string_view prefix, std::string_view message) {
+        size_t pos = 0;
+        Slot* slot = asyncActive.load(std::memory_order_acquire) ? Claim(pos) : nullptr;
+        if (!slot) {
+            if (!asyncActive.load(std::memory_order_acquire)) {
+                std::string text;
+                text.reserve(prefix.size() + message.size());
+                text.append(prefix).append(message);
+                WriteSync(level, text);
+            }
+            return;
+        }
+
+        if (prefix.size() + message.size() <= Slot::INLINE_TEXT) {
+            std::copy_n(prefix.data(), prefix.size(), slot->text);
+            std::copy_n(message.data(), message.size(), slot->text + prefix.size());
+            slot->length = static_cast<uint32_t>(prefix.size() + message.size());
+        }
+        else {
+            slot->overflow.reserve(prefix.size() + message.size());
+            slot->overflow.assign(prefix).append(message);
+            slot->length = Slot::USE_OVERFLOW;
+        }
+        Publish(slot, pos, level);
+    }
+
+    // nullptr - кольцо полно и сообщение отброшено
+    Slot* Claim(size_t& pos) {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = ring[pos & ringMask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.timestamp = std::chrono::system_clock::now();
+                    return &slot;
+                }
+            }
+            else if (diff < 0) {
+                if (config.overflowPolicy == OverflowPolicy::Drop || !writerRunning.load(std::memory_order_acquire)) {
+                    droppedPending.fetch_add(1, std::memory_order_relaxed);
+                    droppedTotal.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                WakeWriter();
+                std::this_thread::yield();
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Publish(Slot* slot, size_t pos, LogLevel level) {
+        slot->level = level;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        // Писателя будим, только если он уснул: под нагрузкой публикация обходится без системных вызовов
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writerSleeping.load(std::memory_order_relaxed)) {
+            WakeWriter();
+        }
+    }
+
+    void WakeWriter() {
+        if (writerSleeping.exchange(false, std::memory_order_acq_rel)) {
+            { std::lock_guard<std::mutex> lock(wakeMutex); }
+            wakeCV.notify_one();
+        }
+    }
+
+    bool HasPending() const {
+        const Slot& slot = ring[dequeuePos & ringMask];
+        return slot.sequence.load(std::memory_order_acquire) == dequeuePos + 1;
+    }
+
     void StartAsyncLogging() {
-        asyncRunning = true;
-        asyncThread = std::thread(&Logger::AsyncLogThread, this);
+        size_t capacity = std::bit_ceil((std::max)(config.bufferSize, size_t{ 2 }));
+        if (capacity != ringMask + 1 || !ring) {
+            ring = std::make_unique<Slot[]>(capacity);
+            ringMask = capacity - 1;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos = 0;
+        writtenPos.store(0, std::memory_order_relaxed);
+
+        writerRunning.store(true, std::memory_order_release);
+        asyncActive.store(true, std::memory_order_release);
+        writerThread = std::jthread([this](std::stop_token token) { WriterThreadFunc(token); });
     }
 
+    // Сообщения, опубликованные после финального прохода писателя, теряются; остановка бывает раз за процесс
     void StopAsyncLogging() {
-        {
-            std::lock_guard<std::mutex> lock(bufferMutex);
-            asyncRunning = false;
-            bufferCV.notify_all();
-        }
+        if (!writerThread.joinable()) return;
 
-        if (asyncThread.joinable()) {
-            asyncThread.join();
+        asyncActive.store(false, std::memory_order_release);
+        writerThread.request_stop();
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            writerSleeping.store(false, std::memory_order_relaxed);
         }
+        wakeCV.notify_one();
+        writerThread.join();
+        writerRunning.store(false, std::memory_order_release);
     }
 
-    void AsyncLogThread() {
-        while (asyncRunning) {
-            std::unique_lock<std::mutex> lock(bufferMutex);
+    void WriterThreadFunc(std::stop_token stopToken) {
+        std::string batch;
+        batch.reserve(WRITE_BATCH_BYTES + Slot::INLINE_TEXT * 2);
+
+        for (;;) {
+            if (Drain(batch) > 0) continue;
+            if (stopToken.stop_requested()) break;
 
-            bufferCV.wait_for(lock, config.flushInterval, [this] {
-                return !buffer.empty() || !asyncRunning;
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            writerSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (HasPending() || droppedPending.load(std::memory_order_relaxed) > 0) {
+                writerSleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            wakeCV.wait_for(lock, stopToken, config.flushInterval, [this] {
+                return !writerSleeping.load(std::memory_order_relaxed);
                 });
+            writerSleeping.store(false, std::memory_order_relaxed);
+        }
 
-            if (!buffer.empty()) {
-                std::deque<LogEntry> localBuffer;
-                localBuffer.swap(buffer);
-                lock.unlock();
+        // Финальный проход: после asyncActive = false новые записи в кольцо не попадают
+        std::this_thread::yield();
+        while (Drain(batch) > 0) {}
+    }
 
-                for (const auto& entry : localBuffer) {
-                    WriteEntry(entry);
-                }
+    // Пачка записей кольца - один вызов WriteFile
+    size_t Drain(std::string& batch) {
+        batch.clear();
+        size_t count = 0;
+
+        while (batch.size() < WRITE_BATCH_BYTES) {
+            Slot& slot = ring[dequeuePos & ringMask];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) break;
+
+            AppendLine(batch, slot.timestamp, slot.level, slot.Text());
+            if (slot.length == Slot::USE_OVERFLOW) {
+                slot.overflow.clear();
+                if (slot.overflow.capacity() > 4096) slot.overflow.shrink_to_fit();
             }
+
+            slot.sequence.store(dequeuePos + ringMask + 1, std::memory_order_release);
+            dequeuePos++;
+            count++;
+        }
+
+        uint64_t dropped = droppedPending.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            AppendLine(batch, std::chrono::system_clock::now(), LogLevel::LEVEL_WARNING,
+                std::format("WARNING: Logger: {} messages dropped, ring full", dropped));
+            count++;
         }
 
-        // Flush remaining entries
-        for (const auto& entry : buffer) {
-            WriteEntry(entry);
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> lock(fileMutex);
+            WriteBatchLocked(batch);
         }
+        writtenPos.store(dequeuePos, std::memory_order_release);
+        return count;
     }
 
-    void WriteEntry(const LogEntry& entry) {
+    void WriteSync(LogLevel level, std::string_view text) {
         std::lock_guard<std::mutex> lock(fileMutex);
+        syncLine.clear();
+        AppendLine(syncLine, std::chrono::system_clock::now(), level, text);
+        WriteBatchLocked(syncLine);
+    }
+
+    // Отметка времени форматируется не чаще раза в секунду на поток
+    void AppendLine(std::string& out, std::chrono::system_clock::time_point timestamp, LogLevel level, std::string_view text) {
+        std::time_t seconds = std::chrono::system_clock::to_time_t(timestamp);
+        TimeCache& cache = TimeCacheForThread();
+        if (seconds != cache.second) {
+            struct tm timeinfo;
+            localtime_s(&timeinfo, &seconds);
+            cache.length = std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+            cache.second = seconds;
+        }
 
-        CheckRotation();
+        out += '[';
+        out.append(cache.text, cache.length);
+        out += "] ";
+        out += GetLevelString(level);
+        out += ' ';
+        out += text;
+        out += "\r\n";
+    }
+
+    void WriteBatchLocked(const std::string& batch) {
+        CheckRotation(batch.size());
 
-        if (!logFile_.is_open()) {
+        if (!logFile) {
             OpenLogFile();
+            if (!logFile) return;
         }
 
-        auto time_t = std::chrono::system_clock::to_time_t(entry.timestamp);
-        char timeStr[100];
-        struct tm timeinfo;
-        localtime_s(&timeinfo, &time_t);
-        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &timeinfo);
-
-        logFile_ << "[" << timeStr << "] "
-            << GetLevelString(entry.level) << " "
-            << entry.message << std::endl;
+        std::fwrite(batch.data(), 1, batch.size(), logFile);
+        currentFileSize += batch.size();
     }
 
     void OpenLogFile() {
-        std::filesystem::create_directories("logs");
+        std::error_code ec;
+        std::filesystem::create_directories("logs", ec);
         currentLogPath = "logs/route_manager.log";
-        logFile_.open(currentLogPath, std::ios::app);
-        currentFileSize = std::filesystem::exists(currentLogPath) ?
-            std::filesystem::file_size(currentLogPath) : 0;
+        logFile = std::fopen(currentLogPath.c_str(), "ab");
+        if (!logFile) return;
+
+        // Без буфера CRT: каждая пачка писателя - ровно один WriteFile
+        std::setvbuf(logFile, nullptr, _IONBF, 0);
+        currentFileSize = std::filesystem::exists(currentLogPath, ec) ?
+            static_cast<size_t>(std::filesystem::file_size(currentLogPath, ec)) : 0;
     }
 
-    void CheckRotation() {
-        if (!logFile_.is_open() || currentFileSize < config.maxFileSize) {
+    void CheckRotation(size_t incoming) {
+        if (!logFile || currentFileSize == 0 || currentFileSize + incoming < config.maxFileSize) {
             return;
         }
 
-        logFile_.close();
+        std::fclose(logFile);
+        logFile = nullptr;
 
         // Rotate files
+        std::error_code ec;
         for (size_t i = config.maxFiles - 1; i > 0; --i) {
             auto oldPath = std::format("logs/route_manager.{}.log", i - 1);
             auto newPath = std::format("logs/route_manager.{}.log", i);
 
-            if (std::filesystem::exists(oldPath)) {
-                std::filesystem::rename(oldPath, newPath);
+            if (std::filesystem::exists(oldPath, ec)) {
+                std::filesystem::rename(oldPath, newPath, ec);
             }
         }
 
-        std::filesystem::rename(currentLogPath, "logs/route_manager.0.log");
+        std::filesystem::rename(currentLogPath, "logs/route_manager.0.log", ec);
 
         OpenLogFile();
     }
 
-    std::string GetLevelString(LogLevel level) {
+    static std::string_view GetLevelString(LogLevel level) {
         switch (level) {
         case LogLevel::LEVEL_DEBUG: return "[DEBUG]";
         case LogLevel::LEVEL_INFO: return "[INFO]";
@@ -252,23 +473,55 @@ private:
         }
     }
 
+    struct TimeCache {
+        std::time_t second = -1;
+        size_t length = 0;
+        char text[32] = {};
+    };
+
+    static TimeCache& TimeCacheForThread() {
+        thread_local TimeCache cache;
+        return cache;
+    }
+
     // Configuration
     LogConfig config;
     std::mutex configMutex;
 
     // File handling
-    std::ofstream logFile_;
+    std::FILE* logFile = nullptr;
     std::string currentLogPath;
     size_t currentFileSize = 0;
+    std::string syncLine;
     std::mutex fileMutex;
 
     // Log level
-    LogLevel currentLogLevel;
-
-    // Async logging
-    std::deque<LogEntry> buffer;
-    std::mutex bufferMutex;
-    std::condition_variable bufferCV;
-    std::thread asyncThread;
-    std::atomic<bool> asyncRunning{ false };
-};
\ No newline at end of file
+    std::atomic<LogLevel> currentLogLevel;
+
+    // Async logging: кольцо и его позиции
+    std::unique_ptr<Slot[]> ring;
+    size_t ringMask = 0;
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) size_t dequeuePos = 0;                  // Только писатель
+    std::atomic<size_t> writtenPos{ 0 };
+    std::atomic<uint64_t> droppedPending{ 0 };
+    std::atomic<uint64_t> droppedTotal{ 0 };
+
+    std::atomic<bool> asyncActive{ false };
+    std::atomic<bool> writerRunning{ false };
+    std::atomic<bool> writerSleeping{ false };
+    std::mutex wakeMutex;
+    std::condition_variable_any wakeCV;
+    std::jthread writerThread;
+};
+
+// Level-gated logging: arguments are neither evaluated nor formatted when the level is off
+#define LOG_AT(level, prefix, ...) \
+    do { \
+        auto& _logger = Logger::Instance(); \
+        if (_logger.IsEnabled(level)) _logger.Format(level, prefix, __VA_ARGS__); \
+    } while (0)
+#define LOG_DEBUG(...) LOG_AT(Logger::LogLevel::LEVEL_DEBUG, "DEBUG: ", __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(Logger::LogLevel::LEVEL_INFO, "INFO: ", __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(Logger::LogLevel::LEVEL_WARNING, "WARNING: ", __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(Logger::LogLevel::LEVEL_ERROR, "ERROR: ", __VA_ARGS__)
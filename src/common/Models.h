@@ -15,6 +15,24 @@ struct ProcessInfo {
     bool isSelected;
     bool isGame;
     bool isDiscord;
+    uint64_t creationTime = 0;          // FILETIME запуска; вместе с pid отличает переиспользованный PID
+
+    bool operator==(const ProcessInfo&) const = default;
+};
+
+struct ProcessKey {
+    DWORD pid = 0;
+    uint64_t creationTime = 0;
+};
+
+// Изменения списка процессов после запрошенной версии. Клиент сначала удаляет
+// removed, затем применяет upserts. При fullResync в upserts весь список,
+// а removed пуст: клиент заменяет свою копию целиком
+struct ProcessListDelta {
+    uint64_t version = 0;               // Передаётся в следующий GetProcessChangesSince
+    bool fullResync = false;
+    std::vector<ProcessInfo> upserts;
+    std::vector<ProcessKey> removed;
 };
 
 struct RouteInfo {
@@ -46,6 +64,27 @@ struct RouteInfo {
     }
 };
 
+// Изменение таблицы маршрутов для UI: у Removed значимы только ip и prefixLength, у RefCount ещё refCount
+enum class RouteChangeType : uint8_t {
+    Added = 1,
+    Removed = 2,
+    RefCount = 3
+};
+
+struct RouteChange {
+    RouteChangeType type = RouteChangeType::Added;
+    RouteInfo route;
+};
+
+// Изменения после запрошенного номера по порядку. Если журнал их уже не хранит
+// (или номер из прошлого запуска сервиса), приходит полный список с fullResync
+struct RouteChangeSet {
+    uint64_t sequence = 0;              // Передаётся в следующий GetRouteChangesSince
+    bool fullResync = false;
+    std::vector<RouteInfo> routes;      // Только при fullResync
+    std::vector<RouteChange> changes;
+};
+
 struct NetworkEvent {
     std::string processName;
     std::string remoteIp;
@@ -62,6 +101,94 @@ struct OptimizerSettings {
         {30, 0.75f}, {29, 0.80f}, {28, 0.85f},
         {27, 0.90f}, {26, 0.90f}, {25, 0.92f}, {24, 0.95f}
     };
+    // Агрегировать сразу при добавлении маршрута, не дожидаясь периодического прогона
+    bool incremental = true;
+    // Периодический прогон по стоимости: маршрут против "лишних" покрытых адресов, с лимитом маршрутов
+    bool costBased = false;
+    float routeCost = 1.0f;
+    float wastedAddressCost = 0.05f;
+    int maxRoutes = 0;
+    int minAggregatePrefix = 16;
+    int workerThreads = 0;              // 0 - по числу ядер
+    // Темп применения плана, системных вызовов в секунду; 0 - без ограничения
+    int planSyscallsPerSecond = 200;
+};
+
+// Что делать с новыми событиями, когда кольцо воркера заполнено выше ringPressurePercent
+enum class FlowBackpressure {
+    DropNewest,             // Только отбрасывать при полном кольце
+    DropDuplicates,         // Пропускать ESTABLISHED того же pid/адреса/порта, ещё стоящий в кольце
+    CoalesceByDestination   // Пропускать ESTABLISHED к адресу, который уже стоит в кольце
+};
+
+// Приём FLOW-событий WinDivert; значения очереди драйвера ограничиваются его пределами
+struct MonitorSettings {
+    int workerThreads = 2;                  // Потоки классификации событий
+    int recvBatchSize = 64;                 // Адресов на один WinDivertRecvEx, не больше WINDIVERT_BATCH_MAX
+    int recvOutstanding = 4;                // Одновременно выставленных overlapped-приёмов
+    unsigned long long recvAffinityMask = 0;    // 0 = без привязки к ядрам
+    int recvThreadPriority = THREAD_PRIORITY_HIGHEST;
+    int queueLength = 16384;
+    int queueTimeMs = 2000;
+    int queueSizeBytes = 16777216;
+    int ringCapacity = 8192;                // Записей в кольце каждого воркера, округляется до степени 2
+    int ringPressurePercent = 75;
+    FlowBackpressure backpressure = FlowBackpressure::CoalesceByDestination;
+};
+
+struct DnsProxySettings {
+    int workersPerDirection = 2;            // Потоков на outbound и на inbound
+    int batchSize = 16;                     // Пакетов на один WinDivertRecvEx/SendEx, не больше WINDIVERT_BATCH_MAX
+    int recvOutstanding = 2;                // Overlapped-приёмов в полёте на каждый поток
+    int routeTtlGraceSec = 300;             // DNS-маршрут живёт TTL записи + grace без использования
+    // "*.openai.com", "discord.gg": всё, что резолвится под этими доменами, идёт через шлюз для любого процесса
+    std::vector<std::string> domainRules;
+};
+
+// Запись FLOW-событий и DNS-ответов для воспроизведения; файл закрывается по достижении maxMB
+struct CaptureSettings {
+    bool enabled = false;
+    std::string path = "captures/traffic.rmcap";
+    int maxMB = 512;
+};
+
+// Как пул выбирает шлюз: первый живой по порядку или живой с наименьшей задержкой
+enum class GatewayPolicy : uint8_t {
+    PrimaryWithFailover,
+    LowestLatency
+};
+
+struct GatewayPolicyRule {
+    std::string process;                    // Имя exe, без учёта регистра
+    GatewayPolicy policy = GatewayPolicy::LowestLatency;
+};
+
+// Пул шлюзов: gatewayIp - основной, additionalGateways - резервные в порядке приоритета.
+// Следующий переход у всех маршрутов общий; пока запущен выбранный процесс с правилом
+// LowestLatency (или игра/Discord при latencySensitiveFastest), пул выбирает по задержке
+struct GatewaySettings {
+    std::vector<std::string> additionalGateways;
+    GatewayPolicy policy = GatewayPolicy::PrimaryWithFailover;
+    bool latencySensitiveFastest = true;
+    std::vector<GatewayPolicyRule> processPolicies;
+    int probeIntervalMs = 1000;
+    int probeTimeoutMs = 1000;
+    int windowSize = 20;                    // Проб в скользящем окне RTT/потерь/джиттера
+    int maxLossPercent = 20;                // Выше - шлюз нездоров
+    int maxRttMs = 300;                     // 0 - без ограничения
+    int switchMarginMs = 15;                // LowestLatency: новый шлюз должен быть быстрее на столько
+    int minDwellSec = 30;                   // Не переключаться чаще, пока текущий шлюз здоров
+};
+
+// Бюджеты памяти по подсистемам, МБ. totalMB - предел рабочего набора процесса
+struct MemoryBudgetSettings {
+    int totalMB = 500;
+    int routesMB = 64;
+    int flowsMB = 32;
+    int processCachesMB = 32;
+    int dnsMB = 16;
+    int loggerMB = 16;
+    int optimizerMB = 64;
 };
 
 struct ServiceConfig {
@@ -73,6 +200,65 @@ struct ServiceConfig {
     bool aiPreloadEnabled = false;
     bool dnsProxyEnabled = false;
     OptimizerSettings optimizerSettings;
+    MonitorSettings monitorSettings;
+    DnsProxySettings dnsProxySettings;
+    MemoryBudgetSettings memoryBudgets;
+    CaptureSettings captureSettings;
+    GatewaySettings gatewaySettings;
+    std::unordered_map<std::string, bool> preloadServiceOverrides;   // Включение сервиса preload поверх preload_ips.json
+};
+
+// Снимок PerformanceMonitor для панели производительности
+struct PerfTimerSample {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t avgUs = 0;
+    uint64_t p50Us = 0;
+    uint64_t p99Us = 0;
+    uint64_t p999Us = 0;
+    uint64_t maxUs = 0;
+};
+
+struct PerfReportData {
+    uint64_t uptimeMs = 0;                  // Монотонное время сервиса: UI считает скорости по нему
+    std::vector<std::pair<std::string, uint64_t>> counters;     // Накопительные, UI считает по ним скорость
+    std::vector<std::pair<std::string, uint64_t>> gauges;       // Мгновенные значения
+    std::vector<PerfTimerSample> timers;
+};
+
+// Trim - подсистема сбрасывает устаревшее и лишнюю ёмкость, Shed - всё, что можно восстановить заново
+enum class MemoryPressure : uint8_t {
+    Normal,
+    Trim,
+    Shed
+};
+
+struct MemorySubsystemUsage {
+    std::string name;
+    uint64_t usedBytes = 0;                 // Оценка по размерам контейнеров, не по куче
+    uint64_t budgetBytes = 0;
+    uint64_t trims = 0;                     // Сколько раз подсистему просили освободить память
+};
+
+struct MemoryReport {
+    uint64_t workingSetBytes = 0;
+    uint64_t budgetBytes = 0;               // Предел рабочего набора
+    MemoryPressure pressure = MemoryPressure::Normal;
+    uint64_t sheds = 0;
+    std::vector<MemorySubsystemUsage> subsystems;
+};
+
+struct PreloadServiceStatus {
+    std::string name;
+    bool enabled = false;
+    uint64_t ranges = 0;                    // После слияния
+    uint64_t installed = 0;
+};
+
+struct PreloadStatus {
+    bool active = false;
+    uint64_t queued = 0;                    // Ждут установки в фоновой очереди
+    std::vector<PreloadServiceStatus> services;
 };
 
 struct ServiceStatus {
@@ -81,4 +267,21 @@ struct ServiceStatus {
     size_t activeRoutes;
     size_t memoryUsageMB;
     std::chrono::seconds uptime;
+    bool routesRestored = false;
+    size_t restoreTotal = 0;
+    size_t restoreDone = 0;
+    // Последний применённый план оптимизации
+    size_t lastPlanAggregates = 0;
+    size_t lastPlanRolledBack = 0;
+    size_t lastPlanRoutesRetired = 0;
+    size_t lastPlanFailures = 0;
+    int64_t lastPlanDurationMs = 0;
+    size_t lastPlanSyscalls = 0;            // Вызовов IP Helper, которые сделал план
+    // Фоновая миграция на новый шлюз или метрику
+    bool migrationActive = false;
+    uint64_t configGeneration = 0;          // Последнее применённое изменение шлюза
+    size_t migrationTotal = 0;
+    size_t migrationDone = 0;
+    size_t migrationFailed = 0;
+    int64_t migrationDurationMs = 0;        // Текущей или последней миграции
 };
\ No newline at end of file
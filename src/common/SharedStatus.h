@@ -0,0 +1,118 @@
+// src/common/SharedStatus.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+// Layout of the read-only status section the service publishes for the UI and
+// tools. Readers map it with FILE_MAP_READ and never talk to the pipe for
+// status. Each region is guarded by its own seqlock generation: the writer
+// makes it odd, fills the region and makes it even again; a reader copies what
+// it needs and retries while the generation is odd or has moved. The status
+// region is a few hundred bytes, so a status read never waits on a route
+// snapshot being rewritten.
+namespace SharedStatus {
+
+    constexpr uint32_t MAGIC = 0x53504D52;      // "RMPS"
+    constexpr uint32_t VERSION = 3;
+    constexpr size_t MAX_COUNTERS = 64;
+    constexpr size_t MAX_ROUTES = 20000;        // IPv4 + IPv6, с запасом над Constants::MAX_ROUTES
+    constexpr size_t COUNTER_NAME_SIZE = 48;
+    constexpr size_t IP_SIZE = 46;                  // INET6_ADDRSTRLEN
+    constexpr size_t PROCESS_NAME_SIZE = 40;
+
+    struct Status {
+        uint8_t isRunning;
+        uint8_t monitorActive;
+        uint8_t routesRestored;
+        uint8_t migrationActive;
+        uint8_t reserved[4];
+        uint64_t activeRoutes;
+        uint64_t memoryUsageMB;
+        int64_t uptimeSeconds;
+        uint64_t restoreTotal;
+        uint64_t restoreDone;
+        uint64_t lastPlanAggregates;
+        uint64_t lastPlanRolledBack;
+        uint64_t lastPlanRoutesRetired;
+        uint64_t lastPlanFailures;
+        int64_t lastPlanDurationMs;
+        uint64_t lastPlanSyscalls;
+        uint64_t configGeneration;
+        uint64_t migrationTotal;
+        uint64_t migrationDone;
+        uint64_t migrationFailed;
+        int64_t migrationDurationMs;
+        uint64_t routeJournalSequence;          // Совпадает с курсором читателя - в таблице ничего не менялось
+        uint64_t publishedTick;                 // GetTickCount64() записи; по нему читатель видит остановленный сервис
+    };
+
+    struct Counter {
+        char name[COUNTER_NAME_SIZE];
+        uint64_t value;
+    };
+
+    struct Route {
+        char ip[IP_SIZE];                       // В том виде, в каком его показывает UI
+        uint8_t prefixLength;
+        uint8_t reserved;
+        int32_t refCount;
+        int64_t createdAt;                      // Секунды от эпохи
+        char processName[PROCESS_NAME_SIZE];
+    };
+
+    struct Section {
+        uint32_t magic;
+        uint32_t version;
+
+        std::atomic<uint32_t> statusGeneration;
+        uint32_t counterCount;
+        Status status;
+        Counter counters[MAX_COUNTERS];
+
+        alignas(64) std::atomic<uint32_t> routesGeneration;
+        uint32_t routeCount;
+        uint64_t routeSequence;                 // Снимок содержит все изменения журнала до этого номера
+        uint8_t routesTruncated;
+        uint8_t reserved[7];
+        Route routes[MAX_ROUTES];
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "Seqlock generation must be lock-free across processes");
+
+    // Писатель один - поток StatusPublisher
+    template<typename Fill>
+    inline void Write(std::atomic<uint32_t>& generation, Fill&& fill) {
+        uint32_t value = generation.load(std::memory_order_relaxed);
+        generation.store(value + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        fill();
+        generation.store(value + 2, std::memory_order_release);
+    }
+
+    // false, если писатель так и не отпустил регион за отведённые попытки
+    template<typename Copy>
+    inline bool Read(const std::atomic<uint32_t>& generation, Copy&& copy, int attempts = 64) {
+        for (int i = 0; i < attempts; i++) {
+            uint32_t before = generation.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                copy();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (generation.load(std::memory_order_relaxed) == before) {
+                    return true;
+                }
+            }
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    inline void CopyName(char* target, size_t size, std::string_view name) {
+        size_t length = (std::min)(name.size(), size - 1);
+        std::memcpy(target, name.data(), length);
+        std::memset(target + length, 0, size - length);
+    }
+}
@@ -83,20 +83,7 @@ bool Utils::IsPrivateIP(const std::string& ip) {
     // Собираем адрес
     addr = (octets[0] << 24) | (octets[1] << 16) | (octets[2] << 8) | octets[3];
 
-    // Битовые проверки для приватных диапазонов
-    // 10.0.0.0/8
-    if ((addr & 0xFF000000) == 0x0A000000) return true;
-
-    // 172.16.0.0/12
-    if ((addr & 0xFFF00000) == 0xAC100000) return true;
-
-    // 192.168.0.0/16
-    if ((addr & 0xFFFF0000) == 0xC0A80000) return true;
-
-    // 127.0.0.0/8 (loopback)
-    if ((addr & 0xFF000000) == 0x7F000000) return true;
-
-    return false;
+    return IsPrivateIPv4(addr);
 }
 
 std::string Utils::WStringToString(const std::wstring& wstr) {
@@ -15,6 +15,14 @@ public:
     static bool IsValidIPv4(const std::string& ip);
     static bool IsPrivateIP(const std::string& ip);
 
+    // Приватные и loopback диапазоны по адресу в host order, без строк
+    inline static bool IsPrivateIPv4(uint32_t addr) {
+        return (addr & 0xFF000000) == 0x0A000000 ||     // 10.0.0.0/8
+            (addr & 0xFFF00000) == 0xAC100000 ||        // 172.16.0.0/12
+            (addr & 0xFFFF0000) == 0xC0A80000 ||        // 192.168.0.0/16
+            (addr & 0xFF000000) == 0x7F000000;          // 127.0.0.0/8
+    }
+
     // Супер-быстрое преобразование IP в uint32_t (inline)
     inline static uint32_t FastIPToUInt(const std::string& ip) {
         uint32_t addr = 0;
@@ -39,6 +47,20 @@ public:
         return (octets[0] << 24) | (octets[1] << 16) | (octets[2] << 8) | octets[3];
     }
 
+    // Обратное преобразование uint32_t (host order) в строку без аллокаций на форматирование
+    inline static std::string FastUIntToIP(uint32_t addr) {
+        char buffer[16];
+        char* out = buffer;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            unsigned octet = (addr >> shift) & 0xFF;
+            if (octet >= 100) *out++ = char('0' + octet / 100);
+            if (octet >= 10) *out++ = char('0' + (octet / 10) % 10);
+            *out++ = char('0' + octet % 10);
+            if (shift > 0) *out++ = '.';
+        }
+        return std::string(buffer, out);
+    }
+
     static std::string WStringToString(const std::wstring& wstr);
     static std::wstring StringToWString(const std::string& str);
     static std::vector<std::string> SplitString(const std::string& str, char delimiter);
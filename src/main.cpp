@@ -48,16 +48,23 @@ void LogPerformanceReport() {
         Logger::Instance().Info(std::format("Counter {}: {}", name, count));
     }
 
+    for (const auto& [name, value] : report.gauges) {
+        Logger::Instance().Info(std::format("Gauge {}: {}", name, value));
+    }
+
     // Log operation timings
     for (const auto& op : report.operations) {
         if (op.count > 0) {
             Logger::Instance().Info(std::format(
-                "Operation {}: {} calls, avg: {}us, min: {}us, max: {}us, p95: {}us",
+                "Operation {}: {} calls, avg: {}us, min: {}us, max: {}us, p50: {}us, p95: {}us, p99: {}us, p999: {}us",
                 op.name, op.count,
                 op.avgTime.count(),
                 op.minTime.count(),
                 op.maxTime.count(),
-                op.p95Time.count()
+                op.p50Time.count(),
+                op.p95Time.count(),
+                op.p99Time.count(),
+                op.p999Time.count()
             ));
         }
     }
@@ -69,7 +76,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     logConfig.maxFileSize = 10 * 1024 * 1024;  // 10MB
     logConfig.maxFiles = 5;
     logConfig.asyncLogging = true;
-    logConfig.bufferSize = 1000;
+    logConfig.bufferSize = 4096;                          // Слотов кольца, степень двойки
+    logConfig.overflowPolicy = Logger::OverflowPolicy::Drop;  // Поток трафика не ждёт диск
 
 #ifdef NDEBUG
     Logger::Instance().SetLogLevel(Logger::LogLevel::LEVEL_INFO);
@@ -90,6 +90,15 @@ void ConfigManager::SetDnsProxyEnabled(bool enabled) {
     SaveConfig();
 }
 
+void ConfigManager::SetPreloadServiceEnabled(const std::string& service, bool enabled) {
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        config.preloadServiceOverrides[service] = enabled;
+    }
+
+    SaveConfig();
+}
+
 void ConfigManager::LoadConfig() {
     if (!Utils::FileExists(configPath)) {
         Logger::Instance().Info("ConfigManager::LoadConfig - Config file not found, using defaults");
@@ -126,6 +135,22 @@ void ConfigManager::LoadConfig() {
     if (optimizer.isObject()) {
         config.optimizerSettings.minHostsToAggregate =
             optimizer.get("minHostsToAggregate", config.optimizerSettings.minHostsToAggregate).asInt();
+        config.optimizerSettings.incremental =
+            optimizer.get("incremental", config.optimizerSettings.incremental).asBool();
+        config.optimizerSettings.costBased =
+            optimizer.get("costBased", config.optimizerSettings.costBased).asBool();
+        config.optimizerSettings.routeCost =
+            optimizer.get("routeCost", config.optimizerSettings.routeCost).asFloat();
+        config.optimizerSettings.wastedAddressCost =
+            optimizer.get("wastedAddressCost", config.optimizerSettings.wastedAddressCost).asFloat();
+        config.optimizerSettings.maxRoutes =
+            optimizer.get("maxRoutes", config.optimizerSettings.maxRoutes).asInt();
+        config.optimizerSettings.minAggregatePrefix =
+            optimizer.get("minAggregatePrefix", config.optimizerSettings.minAggregatePrefix).asInt();
+        config.optimizerSettings.workerThreads =
+            optimizer.get("workerThreads", config.optimizerSettings.workerThreads).asInt();
+        config.optimizerSettings.planSyscallsPerSecond =
+            optimizer.get("planSyscallsPerSecond", config.optimizerSettings.planSyscallsPerSecond).asInt();
 
         const Json::Value& thresholds = optimizer["wasteThresholds"];
         if (thresholds.isObject()) {
@@ -142,6 +167,122 @@ void ConfigManager::LoadConfig() {
         }
     }
 
+    const Json::Value& monitor = root["monitorSettings"];
+    if (monitor.isObject()) {
+        MonitorSettings& ms = config.monitorSettings;
+        ms.workerThreads = monitor.get("workerThreads", ms.workerThreads).asInt();
+        ms.recvBatchSize = monitor.get("recvBatchSize", ms.recvBatchSize).asInt();
+        ms.recvOutstanding = monitor.get("recvOutstanding", ms.recvOutstanding).asInt();
+        ms.recvAffinityMask = monitor.get("recvAffinityMask", static_cast<Json::UInt64>(ms.recvAffinityMask)).asUInt64();
+        ms.recvThreadPriority = monitor.get("recvThreadPriority", ms.recvThreadPriority).asInt();
+        ms.queueLength = monitor.get("queueLength", ms.queueLength).asInt();
+        ms.queueTimeMs = monitor.get("queueTimeMs", ms.queueTimeMs).asInt();
+        ms.queueSizeBytes = monitor.get("queueSizeBytes", ms.queueSizeBytes).asInt();
+        ms.ringCapacity = monitor.get("ringCapacity", ms.ringCapacity).asInt();
+        ms.ringPressurePercent = monitor.get("ringPressurePercent", ms.ringPressurePercent).asInt();
+
+        std::string backpressure = monitor.get("backpressure", "").asString();
+        if (backpressure == "drop") {
+            ms.backpressure = FlowBackpressure::DropNewest;
+        }
+        else if (backpressure == "dedupe") {
+            ms.backpressure = FlowBackpressure::DropDuplicates;
+        }
+        else if (backpressure == "coalesce") {
+            ms.backpressure = FlowBackpressure::CoalesceByDestination;
+        }
+    }
+
+    const Json::Value& dnsProxy = root["dnsProxySettings"];
+    if (dnsProxy.isObject()) {
+        DnsProxySettings& ds = config.dnsProxySettings;
+        ds.workersPerDirection = dnsProxy.get("workersPerDirection", ds.workersPerDirection).asInt();
+        ds.batchSize = dnsProxy.get("batchSize", ds.batchSize).asInt();
+        ds.recvOutstanding = dnsProxy.get("recvOutstanding", ds.recvOutstanding).asInt();
+        ds.routeTtlGraceSec = dnsProxy.get("routeTtlGraceSec", ds.routeTtlGraceSec).asInt();
+
+        const Json::Value& rules = dnsProxy["domainRules"];
+        if (rules.isArray()) {
+            ds.domainRules.clear();
+            for (const auto& rule : rules) {
+                ds.domainRules.push_back(rule.asString());
+            }
+        }
+    }
+
+    const Json::Value& budgets = root["memoryBudgets"];
+    if (budgets.isObject()) {
+        MemoryBudgetSettings& mb = config.memoryBudgets;
+        mb.totalMB = budgets.get("totalMB", mb.totalMB).asInt();
+        mb.routesMB = budgets.get("routesMB", mb.routesMB).asInt();
+        mb.flowsMB = budgets.get("flowsMB", mb.flowsMB).asInt();
+        mb.processCachesMB = budgets.get("processCachesMB", mb.processCachesMB).asInt();
+        mb.dnsMB = budgets.get("dnsMB", mb.dnsMB).asInt();
+        mb.loggerMB = budgets.get("loggerMB", mb.loggerMB).asInt();
+        mb.optimizerMB = budgets.get("optimizerMB", mb.optimizerMB).asInt();
+    }
+
+    const Json::Value& capture = root["captureSettings"];
+    if (capture.isObject()) {
+        CaptureSettings& cs = config.captureSettings;
+        cs.enabled = capture.get("enabled", cs.enabled).asBool();
+        cs.path = capture.get("path", cs.path).asString();
+        cs.maxMB = capture.get("maxMB", cs.maxMB).asInt();
+    }
+
+    const Json::Value& gateways = root["gatewaySettings"];
+    if (gateways.isObject()) {
+        GatewaySettings& gs = config.gatewaySettings;
+        const Json::Value& additional = gateways["additionalGateways"];
+        if (additional.isArray()) {
+            gs.additionalGateways.clear();
+            for (const auto& gateway : additional) {
+                gs.additionalGateways.push_back(gateway.asString());
+            }
+        }
+
+        std::string policy = gateways.get("policy", "").asString();
+        if (policy == "failover") {
+            gs.policy = GatewayPolicy::PrimaryWithFailover;
+        }
+        else if (policy == "lowestLatency") {
+            gs.policy = GatewayPolicy::LowestLatency;
+        }
+
+        gs.latencySensitiveFastest = gateways.get("latencySensitiveFastest", gs.latencySensitiveFastest).asBool();
+        gs.probeIntervalMs = gateways.get("probeIntervalMs", gs.probeIntervalMs).asInt();
+        gs.probeTimeoutMs = gateways.get("probeTimeoutMs", gs.probeTimeoutMs).asInt();
+        gs.windowSize = gateways.get("windowSize", gs.windowSize).asInt();
+        gs.maxLossPercent = gateways.get("maxLossPercent", gs.maxLossPercent).asInt();
+        gs.maxRttMs = gateways.get("maxRttMs", gs.maxRttMs).asInt();
+        gs.switchMarginMs = gateways.get("switchMarginMs", gs.switchMarginMs).asInt();
+        gs.minDwellSec = gateways.get("minDwellSec", gs.minDwellSec).asInt();
+
+        // {"process": "cs2.exe", "policy": "lowestLatency"}
+        const Json::Value& rules = gateways["processPolicies"];
+        if (rules.isArray()) {
+            gs.processPolicies.clear();
+            for (const auto& rule : rules) {
+                GatewayPolicyRule parsed;
+                parsed.process = rule.get("process", "").asString();
+                parsed.policy = rule.get("policy", "").asString() == "failover" ?
+                    GatewayPolicy::PrimaryWithFailover : GatewayPolicy::LowestLatency;
+                if (!parsed.process.empty()) {
+                    gs.processPolicies.push_back(std::move(parsed));
+                }
+            }
+        }
+    }
+
+    // {"Discord": false} - переключатели сервисов поверх preload_ips.json
+    const Json::Value& preloadServices = root["preloadServices"];
+    if (preloadServices.isObject()) {
+        config.preloadServiceOverrides.clear();
+        for (const auto& name : preloadServices.getMemberNames()) {
+            config.preloadServiceOverrides[name] = preloadServices[name].asBool();
+        }
+    }
+
     const Json::Value& processes = root["selectedProcesses"];
     if (processes.isArray()) {
         config.selectedProcesses.clear();
@@ -180,6 +321,14 @@ void ConfigManager::SaveConfig() {
 
     Json::Value optimizer;
     optimizer["minHostsToAggregate"] = configCopy.optimizerSettings.minHostsToAggregate;
+    optimizer["incremental"] = configCopy.optimizerSettings.incremental;
+    optimizer["costBased"] = configCopy.optimizerSettings.costBased;
+    optimizer["routeCost"] = configCopy.optimizerSettings.routeCost;
+    optimizer["wastedAddressCost"] = configCopy.optimizerSettings.wastedAddressCost;
+    optimizer["maxRoutes"] = configCopy.optimizerSettings.maxRoutes;
+    optimizer["minAggregatePrefix"] = configCopy.optimizerSettings.minAggregatePrefix;
+    optimizer["workerThreads"] = configCopy.optimizerSettings.workerThreads;
+    optimizer["planSyscallsPerSecond"] = configCopy.optimizerSettings.planSyscallsPerSecond;
 
     Json::Value thresholds;
     for (const auto& [prefix, threshold] : configCopy.optimizerSettings.wasteThresholds) {
@@ -188,6 +337,86 @@ void ConfigManager::SaveConfig() {
     optimizer["wasteThresholds"] = thresholds;
     root["optimizerSettings"] = optimizer;
 
+    const MonitorSettings& ms = configCopy.monitorSettings;
+    Json::Value monitor;
+    monitor["workerThreads"] = ms.workerThreads;
+    monitor["recvBatchSize"] = ms.recvBatchSize;
+    monitor["recvOutstanding"] = ms.recvOutstanding;
+    monitor["recvAffinityMask"] = static_cast<Json::UInt64>(ms.recvAffinityMask);
+    monitor["recvThreadPriority"] = ms.recvThreadPriority;
+    monitor["queueLength"] = ms.queueLength;
+    monitor["queueTimeMs"] = ms.queueTimeMs;
+    monitor["queueSizeBytes"] = ms.queueSizeBytes;
+    monitor["ringCapacity"] = ms.ringCapacity;
+    monitor["ringPressurePercent"] = ms.ringPressurePercent;
+    monitor["backpressure"] =
+        ms.backpressure == FlowBackpressure::DropNewest ? "drop" :
+        ms.backpressure == FlowBackpressure::DropDuplicates ? "dedupe" : "coalesce";
+    root["monitorSettings"] = monitor;
+
+    const DnsProxySettings& ds = configCopy.dnsProxySettings;
+    Json::Value dnsProxy;
+    dnsProxy["workersPerDirection"] = ds.workersPerDirection;
+    dnsProxy["batchSize"] = ds.batchSize;
+    dnsProxy["recvOutstanding"] = ds.recvOutstanding;
+    dnsProxy["routeTtlGraceSec"] = ds.routeTtlGraceSec;
+    Json::Value rules(Json::arrayValue);
+    for (const auto& rule : ds.domainRules) {
+        rules.append(rule);
+    }
+    dnsProxy["domainRules"] = rules;
+    root["dnsProxySettings"] = dnsProxy;
+
+    const MemoryBudgetSettings& mb = configCopy.memoryBudgets;
+    Json::Value budgets;
+    budgets["totalMB"] = mb.totalMB;
+    budgets["routesMB"] = mb.routesMB;
+    budgets["flowsMB"] = mb.flowsMB;
+    budgets["processCachesMB"] = mb.processCachesMB;
+    budgets["dnsMB"] = mb.dnsMB;
+    budgets["loggerMB"] = mb.loggerMB;
+    budgets["optimizerMB"] = mb.optimizerMB;
+    root["memoryBudgets"] = budgets;
+
+    const CaptureSettings& cs = configCopy.captureSettings;
+    Json::Value capture;
+    capture["enabled"] = cs.enabled;
+    capture["path"] = cs.path;
+    capture["maxMB"] = cs.maxMB;
+    root["captureSettings"] = capture;
+
+    const GatewaySettings& gs = configCopy.gatewaySettings;
+    Json::Value gateways;
+    Json::Value additional(Json::arrayValue);
+    for (const auto& gateway : gs.additionalGateways) {
+        additional.append(gateway);
+    }
+    gateways["additionalGateways"] = additional;
+    gateways["policy"] = gs.policy == GatewayPolicy::LowestLatency ? "lowestLatency" : "failover";
+    gateways["latencySensitiveFastest"] = gs.latencySensitiveFastest;
+    gateways["probeIntervalMs"] = gs.probeIntervalMs;
+    gateways["probeTimeoutMs"] = gs.probeTimeoutMs;
+    gateways["windowSize"] = gs.windowSize;
+    gateways["maxLossPercent"] = gs.maxLossPercent;
+    gateways["maxRttMs"] = gs.maxRttMs;
+    gateways["switchMarginMs"] = gs.switchMarginMs;
+    gateways["minDwellSec"] = gs.minDwellSec;
+    Json::Value policyRules(Json::arrayValue);
+    for (const auto& rule : gs.processPolicies) {
+        Json::Value value;
+        value["process"] = rule.process;
+        value["policy"] = rule.policy == GatewayPolicy::LowestLatency ? "lowestLatency" : "failover";
+        policyRules.append(value);
+    }
+    gateways["processPolicies"] = policyRules;
+    root["gatewaySettings"] = gateways;
+
+    Json::Value preloadServices(Json::objectValue);
+    for (const auto& [name, enabled] : configCopy.preloadServiceOverrides) {
+        preloadServices[name] = enabled;
+    }
+    root["preloadServices"] = preloadServices;
+
     Json::Value processes(Json::arrayValue);
     for (const auto& process : configCopy.selectedProcesses) {
         processes.append(process);
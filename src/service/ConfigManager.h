@@ -16,6 +16,7 @@ public:
     void SetConfig(const ServiceConfig& config);
     void SetAIPreloadEnabled(bool enabled);
     void SetDnsProxyEnabled(bool enabled);
+    void SetPreloadServiceEnabled(const std::string& service, bool enabled);
 
 private:
     mutable std::mutex configMutex;
@@ -0,0 +1,49 @@
+// src/service/DnsAnswerCache.cpp
+#include "DnsAnswerCache.h"
+#include <algorithm>
+#include <vector>
+
+DnsAnswerCache::DnsAnswerCache(size_t maxAddresses)
+    : answers((std::max)(maxAddresses, size_t{ 1 })) {
+}
+
+bool DnsAnswerCache::Record(uint32_t address, int64_t expiresAt, int64_t now) {
+    std::lock_guard lock(mutex);
+
+    int64_t previous = 0;
+    bool wasLive = answers.Visit(address, [&previous](int64_t cached) { previous = cached; }) && previous > now;
+    answers.Put(address, wasLive ? (std::max)(previous, expiresAt) : expiresAt);
+    return !wasLive;
+}
+
+size_t DnsAnswerCache::Sweep(int64_t now) {
+    std::lock_guard lock(mutex);
+
+    std::vector<uint32_t> expired;
+    answers.ForEach([&](uint32_t address, int64_t expiresAt) {
+        if (expiresAt <= now) {
+            expired.push_back(address);
+        }
+        });
+    for (uint32_t address : expired) {
+        answers.Erase(address);
+    }
+    expiredTotal += expired.size();
+    return expired.size();
+}
+
+void DnsAnswerCache::Clear() {
+    std::lock_guard lock(mutex);
+    answers.Clear();
+}
+
+DnsAnswerCache::Stats DnsAnswerCache::GetStats() const {
+    Stats stats;
+    auto cache = answers.GetStats();
+    stats.addresses = cache.size;
+    stats.memoryBytes = answers.MemoryBytes();
+    stats.evicted = cache.evictions;
+    std::lock_guard lock(mutex);
+    stats.expired = expiredTotal;
+    return stats;
+}
@@ -0,0 +1,36 @@
+// src/service/DnsAnswerCache.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "ShardedLruCache.h"
+
+// A records seen by the DNS proxy: address -> when the answer stops being
+// valid (record TTL plus grace). Tells a new or re-resolved address from a
+// repeated answer. Answers past their expiry are swept; the cache is bounded
+// by a CLOCK ring, so when full an insert evicts the first answer no
+// response has refreshed since the hand last passed. Thread-safe.
+class DnsAnswerCache {
+public:
+    struct Stats {
+        size_t addresses = 0;
+        size_t memoryBytes = 0;
+        uint64_t expired = 0;
+        uint64_t evicted = 0;
+    };
+
+    explicit DnsAnswerCache(size_t maxAddresses);
+
+    // Returns true if the address is new or its previous answer had already expired
+    bool Record(uint32_t address, int64_t expiresAt, int64_t now);
+
+    size_t Sweep(int64_t now);
+    void Clear();
+    Stats GetStats() const;
+
+private:
+    ShardedLruCache<uint32_t, int64_t> answers;     // Адрес -> expiresAt
+    uint64_t expiredTotal = 0;
+    // Чтение и продление одного ответа - одна операция; кэш сам по себе потокобезопасен
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,184 @@
+// src/service/DnsMessageReader.cpp
+#include "DnsMessageReader.h"
+
+namespace {
+    uint8_t ToLower(uint8_t c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<uint8_t>(c - 'A' + 'a') : c;
+    }
+}
+
+DnsMessageReader::DnsMessageReader(std::span<const uint8_t> message) : data(message) {
+    if (data.size() < HEADER_SIZE) {
+        static constexpr uint8_t empty[HEADER_SIZE] = {};
+        data = empty;   // Аксессоры заголовка остаются безопасными
+        malformed = true;
+        return;
+    }
+
+    uint16_t questions = QuestionCount();
+    for (uint16_t i = 0; i < questions; i++) {
+        if (i == 0) {
+            questionName = offset;
+        }
+        offset = SkipName(data, offset);
+        if (offset == 0 || offset + 4 > data.size()) {
+            malformed = true;
+            return;
+        }
+        offset += 4;    // QTYPE(2) + QCLASS(2)
+    }
+
+    remaining[0] = AnswerCount();
+    remaining[1] = ReadU16(8);
+    remaining[2] = ReadU16(10);
+    valid = true;
+}
+
+bool DnsMessageReader::Next(Record& record) {
+    if (!valid || malformed) {
+        return false;
+    }
+    while (section < 3 && remaining[section] == 0) {
+        section++;
+    }
+    if (section >= 3) {
+        return false;
+    }
+
+    size_t nameEnd = SkipName(data, offset);
+    // TYPE(2) + CLASS(2) + TTL(4) + RDLENGTH(2)
+    if (nameEnd == 0 || nameEnd + 10 > data.size()) {
+        malformed = true;
+        return false;
+    }
+
+    record.nameOffset = offset;
+    record.type = ReadU16(nameEnd);
+    record.rclass = ReadU16(nameEnd + 2);
+    record.ttl = (static_cast<uint32_t>(ReadU16(nameEnd + 4)) << 16) | ReadU16(nameEnd + 6);
+    record.rdlength = ReadU16(nameEnd + 8);
+    record.rdataOffset = nameEnd + 10;
+    record.section = static_cast<Section>(section);
+
+    if (record.rdataOffset + record.rdlength > data.size()) {
+        malformed = true;
+        return false;
+    }
+
+    offset = record.rdataOffset + record.rdlength;
+    remaining[section]--;
+    return true;
+}
+
+int DnsMessageReader::NextLabel(std::span<const uint8_t> message, NameCursor& cursor, std::span<const uint8_t>& label) {
+    while (cursor.offset < message.size()) {
+        uint8_t length = message[cursor.offset];
+        if (length == 0) {
+            return 0;
+        }
+        if ((length & 0xC0) == 0xC0) {
+            if (cursor.offset + 1 >= message.size() || ++cursor.jumps > MAX_POINTER_JUMPS) {
+                return -1;
+            }
+            cursor.offset = (static_cast<size_t>(length & 0x3F) << 8) | message[cursor.offset + 1];
+            continue;
+        }
+        // 0x40 и 0x80 - зарезервированные типы меток
+        if ((length & 0xC0) != 0 || cursor.offset + 1 + length > message.size()) {
+            return -1;
+        }
+        label = message.subspan(cursor.offset + 1, length);
+        cursor.offset += 1 + length;
+        return 1;
+    }
+    return -1;
+}
+
+size_t DnsMessageReader::SkipName(std::span<const uint8_t> message, size_t offset) {
+    while (offset < message.size()) {
+        uint8_t length = message[offset];
+        if (length == 0) {
+            return offset + 1;
+        }
+        if ((length & 0xC0) == 0xC0) {
+            return offset + 1 < message.size() ? offset + 2 : 0;
+        }
+        if ((length & 0xC0) != 0) {
+            return 0;
+        }
+        offset += 1 + length;
+    }
+    return 0;
+}
+
+size_t DnsMessageReader::ReadName(std::span<const uint8_t> message, size_t offset, std::string& name) {
+    name.clear();
+    size_t end = SkipName(message, offset);
+    if (end == 0) {
+        return 0;
+    }
+
+    NameCursor cursor{ offset };
+    std::span<const uint8_t> label;
+    int result;
+    while ((result = NextLabel(message, cursor, label)) > 0) {
+        if (name.size() + label.size() + 1 > MAX_NAME_LENGTH) {
+            return 0;
+        }
+        if (!name.empty()) {
+            name.push_back('.');
+        }
+        for (uint8_t c : label) {
+            name.push_back(static_cast<char>(ToLower(c)));
+        }
+    }
+    return result == 0 ? end : 0;
+}
+
+bool DnsMessageReader::NamesEqual(std::span<const uint8_t> message, size_t first, size_t second) {
+    if (first == second) {
+        return SkipName(message, first) != 0;
+    }
+
+    NameCursor a{ first };
+    NameCursor b{ second };
+    std::span<const uint8_t> labelA;
+    std::span<const uint8_t> labelB;
+    for (;;) {
+        int resultA = NextLabel(message, a, labelA);
+        int resultB = NextLabel(message, b, labelB);
+        if (resultA < 0 || resultB < 0 || resultA != resultB) {
+            return false;
+        }
+        if (resultA == 0) {
+            return true;
+        }
+        if (labelA.size() != labelB.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < labelA.size(); i++) {
+            if (ToLower(labelA[i]) != ToLower(labelB[i])) {
+                return false;
+            }
+        }
+    }
+}
+
+bool DnsMessageReader::ClampEdnsPayloadSize(std::span<uint8_t> query, uint16_t maxSize) {
+    DnsMessageReader reader(query);
+    Record record;
+    while (reader.Next(record)) {
+        if (record.section != Section::Additional || record.type != TYPE_OPT) {
+            continue;
+        }
+        if (record.rclass <= maxSize) {
+            return false;
+        }
+        // CLASS стоит за TYPE: 8 байт до начала RDATA
+        size_t classOffset = record.rdataOffset - 8;
+        query[classOffset] = static_cast<uint8_t>(maxSize >> 8);
+        query[classOffset + 1] = static_cast<uint8_t>(maxSize & 0xFF);
+        return true;
+    }
+    return false;
+}
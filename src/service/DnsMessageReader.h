@@ -0,0 +1,87 @@
+// src/service/DnsMessageReader.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Bounds-checked, allocation-free reader over a DNS message (RFC 1035).
+// Records are returned as offsets into the original buffer and names are
+// compared or materialized on demand, following compression pointers with
+// a jump limit, so a hostile or truncated message can neither read outside
+// the buffer nor loop. A record cut off by the end of the buffer stops the
+// walk and sets Malformed(); everything before it stays usable.
+class DnsMessageReader {
+public:
+    static constexpr uint16_t TYPE_A = 1;
+    static constexpr uint16_t TYPE_CNAME = 5;
+    static constexpr uint16_t TYPE_AAAA = 28;
+    static constexpr uint16_t TYPE_OPT = 41;
+    static constexpr uint16_t CLASS_IN = 1;
+    static constexpr size_t HEADER_SIZE = 12;
+
+    enum class Section : uint8_t { Answer, Authority, Additional };
+
+    struct Record {
+        size_t nameOffset = 0;
+        uint16_t type = 0;
+        uint16_t rclass = 0;            // Для OPT - размер UDP-пакета отправителя
+        uint32_t ttl = 0;
+        size_t rdataOffset = 0;
+        uint16_t rdlength = 0;
+        Section section = Section::Answer;
+    };
+
+    explicit DnsMessageReader(std::span<const uint8_t> message);
+
+    // Заголовок цел и секция вопросов прочитана
+    bool Valid() const { return valid; }
+    bool Malformed() const { return malformed; }
+
+    bool IsResponse() const { return (data[2] & 0x80) != 0; }
+    bool Truncated() const { return (data[2] & 0x02) != 0; }
+    uint8_t Rcode() const { return data[3] & 0x0F; }
+    uint16_t QuestionCount() const { return ReadU16(4); }
+    uint16_t AnswerCount() const { return ReadU16(6); }
+
+    // Имя первого вопроса, 0 - вопросов нет
+    size_t FirstQuestionName() const { return questionName; }
+
+    // Следующая RR из секций answer, authority, additional по порядку
+    bool Next(Record& record);
+
+    std::span<const uint8_t> Message() const { return data; }
+    std::span<const uint8_t> RData(const Record& record) const { return data.subspan(record.rdataOffset, record.rdlength); }
+
+    // Смещение сразу за именем, 0 - имя повреждено
+    static size_t SkipName(std::span<const uint8_t> message, size_t offset);
+    // Lowercase, dot-separated; смещение за именем или 0
+    static size_t ReadName(std::span<const uint8_t> message, size_t offset, std::string& name);
+    // Сравнение без копирования, регистр не учитывается
+    static bool NamesEqual(std::span<const uint8_t> message, size_t first, size_t second);
+
+    // Lowers the EDNS0 UDP payload size advertised by a query; true if the message was changed
+    static bool ClampEdnsPayloadSize(std::span<uint8_t> query, uint16_t maxSize);
+
+private:
+    struct NameCursor {
+        size_t offset;
+        int jumps = 0;
+    };
+
+    static constexpr int MAX_POINTER_JUMPS = 16;
+    static constexpr size_t MAX_NAME_LENGTH = 255;
+
+    std::span<const uint8_t> data;
+    size_t offset = HEADER_SIZE;
+    size_t questionName = 0;
+    uint16_t remaining[3] = {};
+    int section = 0;
+    bool valid = false;
+    bool malformed = false;
+
+    uint16_t ReadU16(size_t at) const { return static_cast<uint16_t>((data[at] << 8) | data[at + 1]); }
+
+    // 1 - метка прочитана, 0 - конец имени, -1 - имя повреждено
+    static int NextLabel(std::span<const uint8_t> message, NameCursor& cursor, std::span<const uint8_t>& label);
+};
@@ -0,0 +1,169 @@
+// src/service/DnsNatTable.cpp
+#include "DnsNatTable.h"
+#include <algorithm>
+
+namespace {
+    constexpr uint8_t PROTOCOL_TCP = 6;
+}
+
+DnsNatTable::DnsNatTable(size_t capacity, int udpTtlSeconds, int tcpIdleSeconds, int tcpLingerSeconds)
+    : stripeCapacity((std::max)(capacity / STRIPES, size_t{ 1 })),
+    udpTtl((std::max)(udpTtlSeconds, 1)),
+    tcpIdle((std::max)(tcpIdleSeconds, 1)),
+    tcpLinger((std::max)(tcpLingerSeconds, 1)) {
+    // Память под полосы выделяется сразу, дальше таблица не растёт
+    for (auto& stripe : stripes) {
+        stripe.entries.reserve(stripeCapacity);
+    }
+}
+
+int64_t DnsNatTable::TtlFor(const Key& key) const {
+    return key.protocol == PROTOCOL_TCP ? tcpIdle : udpTtl;
+}
+
+void DnsNatTable::Insert(const Key& key, uint32_t originalDst, int64_t now) {
+    Stripe& stripe = StripeFor(key);
+    std::lock_guard lock(stripe.mutex);
+
+    auto it = stripe.entries.find(key);
+    if (it != stripe.entries.end()) {
+        it->second.originalDst = originalDst;
+        // ACK на FIN сервера не должен воскрешать закрывающееся соединение
+        if (!it->second.closing) {
+            it->second.deadline = now + TtlFor(key);
+        }
+        return;
+    }
+
+    if (stripe.entries.size() >= stripeCapacity && SweepStripeLocked(stripe, now) == 0) {
+        EvictOneLocked(stripe);
+    }
+
+    stripe.entries.emplace(key, Entry{ originalDst, now + TtlFor(key), false });
+    insertedTotal.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool DnsNatTable::Take(const Key& key, int64_t now, uint32_t& originalDst) {
+    Stripe& stripe = StripeFor(key);
+    std::lock_guard lock(stripe.mutex);
+
+    auto it = stripe.entries.find(key);
+    if (it == stripe.entries.end()) {
+        return false;
+    }
+
+    bool live = it->second.deadline > now;
+    originalDst = it->second.originalDst;
+    stripe.entries.erase(it);
+    if (!live) {
+        expiredTotal.fetch_add(1, std::memory_order_relaxed);
+    }
+    return live;
+}
+
+bool DnsNatTable::Find(const Key& key, int64_t now, uint32_t& originalDst) {
+    Stripe& stripe = StripeFor(key);
+    std::lock_guard lock(stripe.mutex);
+
+    auto it = stripe.entries.find(key);
+    if (it == stripe.entries.end()) {
+        return false;
+    }
+    if (it->second.deadline <= now) {
+        stripe.entries.erase(it);
+        expiredTotal.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    originalDst = it->second.originalDst;
+    if (!it->second.closing) {
+        it->second.deadline = now + TtlFor(key);
+    }
+    return true;
+}
+
+void DnsNatTable::Close(const Key& key, int64_t now) {
+    Stripe& stripe = StripeFor(key);
+    std::lock_guard lock(stripe.mutex);
+
+    auto it = stripe.entries.find(key);
+    if (it != stripe.entries.end() && !it->second.closing) {
+        it->second.closing = true;
+        it->second.deadline = (std::min)(it->second.deadline, now + tcpLinger);
+        closedTotal.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool DnsNatTable::Erase(const Key& key) {
+    Stripe& stripe = StripeFor(key);
+    std::lock_guard lock(stripe.mutex);
+
+    if (stripe.entries.erase(key) == 0) {
+        return false;
+    }
+    closedTotal.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool DnsNatTable::SweepIfDue(int64_t now, int intervalSeconds) {
+    int64_t last = lastSweep.load(std::memory_order_relaxed);
+    if (now - last < intervalSeconds) {
+        return false;
+    }
+    // Одну очистку выполняет один поток, остальные идут дальше
+    if (!lastSweep.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return false;
+    }
+    Sweep(now);
+    return true;
+}
+
+size_t DnsNatTable::Sweep(int64_t now) {
+    size_t removed = 0;
+    for (auto& stripe : stripes) {
+        std::lock_guard lock(stripe.mutex);
+        removed += SweepStripeLocked(stripe, now);
+    }
+    return removed;
+}
+
+void DnsNatTable::Clear() {
+    for (auto& stripe : stripes) {
+        std::lock_guard lock(stripe.mutex);
+        stripe.entries.clear();
+    }
+}
+
+size_t DnsNatTable::SweepStripeLocked(Stripe& stripe, int64_t now) {
+    size_t removed = std::erase_if(stripe.entries, [now](const auto& entry) {
+        return entry.second.deadline <= now;
+    });
+    expiredTotal.fetch_add(removed, std::memory_order_relaxed);
+    return removed;
+}
+
+void DnsNatTable::EvictOneLocked(Stripe& stripe) {
+    // Полоса маленькая (capacity / STRIPES), линейный проход дешевле отдельной очереди
+    auto oldest = std::min_element(stripe.entries.begin(), stripe.entries.end(),
+        [](const auto& a, const auto& b) { return a.second.deadline < b.second.deadline; });
+    if (oldest != stripe.entries.end()) {
+        stripe.entries.erase(oldest);
+        evictedTotal.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+DnsNatTable::Stats DnsNatTable::GetStats() const {
+    Stats stats;
+    stats.capacity = stripeCapacity * STRIPES;
+    for (auto& stripe : stripes) {
+        std::lock_guard lock(stripe.mutex);
+        stats.size += stripe.entries.size();
+        stats.memoryBytes += stripe.entries.bucket_count() * sizeof(void*) +
+            stripe.entries.size() * (sizeof(std::pair<const Key, Entry>) + sizeof(void*) * 2);
+    }
+    stats.inserted = insertedTotal.load(std::memory_order_relaxed);
+    stats.expired = expiredTotal.load(std::memory_order_relaxed);
+    stats.evicted = evictedTotal.load(std::memory_order_relaxed);
+    stats.closed = closedTotal.load(std::memory_order_relaxed);
+    return stats;
+}
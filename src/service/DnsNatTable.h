@@ -0,0 +1,95 @@
+// src/service/DnsNatTable.h
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// NAT state of the DNS proxy: (client ip, client port, protocol) -> original
+// DNS server. Capacity is fixed and split across lock stripes, so outbound
+// inserts and inbound lookups for different clients never share a mutex.
+// Every entry carries a deadline: UDP entries live until the response or the
+// UDP TTL, TCP entries are refreshed by traffic, shortened on FIN and dropped
+// on RST. A full stripe first drops expired entries, then evicts the entry
+// closest to its deadline. Addresses and ports are in network byte order.
+class DnsNatTable {
+public:
+    struct Key {
+        uint32_t srcIp = 0;
+        uint16_t srcPort = 0;
+        uint8_t protocol = 0;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept {
+            uint64_t value = (static_cast<uint64_t>(key.srcIp) << 24) |
+                (static_cast<uint64_t>(key.srcPort) << 8) | key.protocol;
+            value *= 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(value ^ (value >> 32));
+        }
+    };
+
+    struct Stats {
+        size_t size = 0;
+        size_t capacity = 0;
+        size_t memoryBytes = 0;             // Оценка: узлы и корзины полос
+        uint64_t inserted = 0;
+        uint64_t expired = 0;
+        uint64_t evicted = 0;
+        uint64_t closed = 0;
+    };
+
+    // now - секунды монотонных часов
+    DnsNatTable(size_t capacity, int udpTtlSeconds, int tcpIdleSeconds, int tcpLingerSeconds);
+
+    void Insert(const Key& key, uint32_t originalDst, int64_t now);
+    // UDP: запрос-ответ, запись удаляется при чтении
+    bool Take(const Key& key, int64_t now, uint32_t& originalDst);
+    // TCP: чтение продлевает запись
+    bool Find(const Key& key, int64_t now, uint32_t& originalDst);
+    // FIN: оставшиеся сегменты ещё нужно переписать, поэтому только укорачиваем срок
+    void Close(const Key& key, int64_t now);
+    bool Erase(const Key& key);
+
+    // Sweeps all stripes if the sweep interval has passed; false if another thread is on it
+    bool SweepIfDue(int64_t now, int intervalSeconds);
+    size_t Sweep(int64_t now);
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        uint32_t originalDst = 0;
+        int64_t deadline = 0;
+        bool closing = false;           // Был FIN: срок больше не продлевается
+    };
+
+    struct alignas(64) Stripe {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+    };
+
+    static constexpr size_t STRIPES = 16;
+
+    std::array<Stripe, STRIPES> stripes;
+    const size_t stripeCapacity;
+    const int udpTtl;
+    const int tcpIdle;
+    const int tcpLinger;
+
+    std::atomic<int64_t> lastSweep{ 0 };
+    std::atomic<uint64_t> insertedTotal{ 0 };
+    std::atomic<uint64_t> expiredTotal{ 0 };
+    std::atomic<uint64_t> evictedTotal{ 0 };
+    std::atomic<uint64_t> closedTotal{ 0 };
+
+    Stripe& StripeFor(const Key& key) { return stripes[(KeyHash{}(key) >> 7) & (STRIPES - 1)]; }
+    int64_t TtlFor(const Key& key) const;
+    size_t SweepStripeLocked(Stripe& stripe, int64_t now);
+    void EvictOneLocked(Stripe& stripe);
+};
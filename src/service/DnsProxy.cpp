@@ -6,18 +6,51 @@
 #include "DnsProxy.h"
 #include "ProcessManager.h"
 #include "RouteController.h"
+#include "IpHelperApi.h"
+#include "TrafficCapture.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
 #include "../common/Logger.h"
 #include "../common/ShutdownCoordinator.h"
 #include "../common/Utils.h"
+#include "../common/WinHandles.h"
 #include <format>
+#include <algorithm>
+#include <array>
 
-DnsProxy::DnsProxy(ProcessManager* pm, RouteController* rc)
+namespace {
+    int64_t SteadySeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // UDP datagram or TCP segment payload; for TCP it is a piece of the length-prefixed DNS stream
+    std::span<uint8_t> TransportPayload(uint8_t* packet, UINT packetLen,
+        PWINDIVERT_TCPHDR tcpHdr, PWINDIVERT_UDPHDR udpHdr) {
+        uint8_t* payload = udpHdr
+            ? reinterpret_cast<uint8_t*>(udpHdr) + sizeof(WINDIVERT_UDPHDR)
+            : reinterpret_cast<uint8_t*>(tcpHdr) + tcpHdr->HdrLength * 4;
+        if (payload >= packet + packetLen) {
+            return {};
+        }
+        return { payload, static_cast<size_t>(packet + packetLen - payload) };
+    }
+}
+
+DnsProxy::DnsProxy(ProcessManager* pm, RouteController* rc, const DnsProxySettings& proxySettings)
     : processManager(pm),
     routeController(rc),
+    settings(proxySettings),
+    natTable(Constants::DNS_NAT_MAX_ENTRIES, Constants::DNS_NAT_UDP_TTL_SEC,
+        Constants::DNS_NAT_TCP_IDLE_SEC, Constants::DNS_NAT_TCP_LINGER_SEC),
+    answerCache(Constants::DNS_ANSWER_CACHE_MAX_ENTRIES),
+    tcpStreams(Constants::DNS_TCP_MAX_STREAMS),
+    domainMatcher(proxySettings.domainRules),
     outboundHandle(INVALID_HANDLE_VALUE),
     inboundHandle(INVALID_HANDLE_VALUE),
+    socketHandle(INVALID_HANDLE_VALUE),
     active(false) {
-    Logger::Instance().Info("DnsProxy: Created");
+    Logger::Instance().Info(std::format("DnsProxy: Created, {} domain rules", domainMatcher.RuleCount()));
 }
 
 DnsProxy::~DnsProxy() {
@@ -32,6 +65,18 @@ void DnsProxy::Start() {
 
     Logger::Instance().Info("DnsProxy::Start - Starting DNS proxy");
 
+    // SOCKET layer sniff handle: endpoint events arrive before the endpoint's first packet,
+    // so the outbound path usually finds the owner without scanning system tables.
+    // Without it the proxy still works, every query just takes the table-scan fallback
+    socketHandle = WinDivertOpen(
+        "ip and (udp or tcp) and (event == BIND or event == CLOSE or (event == CONNECT and remotePort == 53))",
+        WINDIVERT_LAYER_SOCKET, 0, WINDIVERT_FLAG_SNIFF | WINDIVERT_FLAG_RECV_ONLY
+    );
+
+    if (socketHandle == INVALID_HANDLE_VALUE) {
+        Logger::Instance().Warning(std::format("DnsProxy::Start - Failed to open socket handle: {}, PID lookups fall back to table scans", GetLastError()));
+    }
+
     // Open NETWORK layer handle for outbound DNS interception (UDP and TCP port 53)
     outboundHandle = WinDivertOpen(
         "outbound and (udp.DstPort == 53 or tcp.DstPort == 53)",
@@ -40,6 +85,10 @@ void DnsProxy::Start() {
 
     if (outboundHandle == INVALID_HANDLE_VALUE) {
         Logger::Instance().Error(std::format("DnsProxy::Start - Failed to open outbound handle: {}", GetLastError()));
+        if (socketHandle != INVALID_HANDLE_VALUE) {
+            WinDivertClose(socketHandle);
+            socketHandle = INVALID_HANDLE_VALUE;
+        }
         return;
     }
 
@@ -53,6 +102,10 @@ void DnsProxy::Start() {
         Logger::Instance().Error(std::format("DnsProxy::Start - Failed to open inbound handle: {}", GetLastError()));
         WinDivertClose(outboundHandle);
         outboundHandle = INVALID_HANDLE_VALUE;
+        if (socketHandle != INVALID_HANDLE_VALUE) {
+            WinDivertClose(socketHandle);
+            socketHandle = INVALID_HANDLE_VALUE;
+        }
         return;
     }
 
@@ -64,10 +117,20 @@ void DnsProxy::Start() {
 
     active = true;
 
-    outboundThread = std::jthread([this](std::stop_token token) { OutboundThreadFunc(token); });
-    inboundThread = std::jthread([this](std::stop_token token) { InboundThreadFunc(token); });
+    LARGE_INTEGER frequency;
+    qpcFrequency = QueryPerformanceFrequency(&frequency) ? frequency.QuadPart : 0;
+
+    const int workers = std::clamp(settings.workersPerDirection, 1, Constants::DNS_PROXY_MAX_WORKERS);
+    for (int i = 0; i < workers; i++) {
+        outboundWorkers.emplace_back([this](std::stop_token token) { PacketWorkerThreadFunc(token, outboundHandle, true); });
+        inboundWorkers.emplace_back([this](std::stop_token token) { PacketWorkerThreadFunc(token, inboundHandle, false); });
+    }
+    if (socketHandle != INVALID_HANDLE_VALUE) {
+        socketThread = std::jthread([this](std::stop_token token) { SocketThreadFunc(token); });
+    }
 
-    Logger::Instance().Info("DnsProxy::Start - DNS proxy started successfully (UDP + TCP)");
+    Logger::Instance().Info(std::format("DnsProxy::Start - DNS proxy started successfully (UDP + TCP, {} workers per direction, batch {})",
+        workers, std::clamp(settings.batchSize, 1, static_cast<int>(WINDIVERT_BATCH_MAX))));
 }
 
 void DnsProxy::Stop() {
@@ -86,10 +149,14 @@ void DnsProxy::Stop() {
     if (inboundHandle != INVALID_HANDLE_VALUE) {
         WinDivertShutdown(inboundHandle, WINDIVERT_SHUTDOWN_BOTH);
     }
+    if (socketHandle != INVALID_HANDLE_VALUE) {
+        WinDivertShutdown(socketHandle, WINDIVERT_SHUTDOWN_BOTH);
+    }
 
     // std::jthread automatically calls request_stop() and join() on destruction
-    outboundThread = {};
-    inboundThread = {};
+    outboundWorkers.clear();
+    inboundWorkers.clear();
+    socketThread = {};
 
     // Close handles
     if (outboundHandle != INVALID_HANDLE_VALUE) {
@@ -100,6 +167,10 @@ void DnsProxy::Stop() {
         WinDivertClose(inboundHandle);
         inboundHandle = INVALID_HANDLE_VALUE;
     }
+    if (socketHandle != INVALID_HANDLE_VALUE) {
+        WinDivertClose(socketHandle);
+        socketHandle = INVALID_HANDLE_VALUE;
+    }
 
     // Remove route for 8.8.8.8
     if (routeController) {
@@ -108,16 +179,117 @@ void DnsProxy::Stop() {
     }
 
     // Clear NAT table and route cache
+    natTable.Clear();
+    answerCache.Clear();
+    tcpStreams.Clear();
     {
-        std::lock_guard lock(natMutex);
-        natTable.clear();
+        std::lock_guard lock(socketPidsMutex);
+        socketPids.clear();
     }
+
+    Logger::Instance().Info("DnsProxy::Stop - DNS proxy stopped");
+}
+
+DWORD DnsProxy::LookupPid(uint32_t localAddr, uint16_t localPort, bool isUdp) {
+    // localAddr and localPort are in network byte order (from packet headers)
+    uint8_t protocol = isUdp ? IPPROTO_UDP : IPPROTO_TCP;
+    auto now = std::chrono::steady_clock::now();
+    uint64_t lookups = pidLookups.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t hits = pidCacheHits.load(std::memory_order_relaxed);
+
+    DWORD pid = 0;
     {
-        std::lock_guard lock(addedRoutesMutex);
-        addedRoutes.clear();
+        std::lock_guard lock(socketPidsMutex);
+        // Точный адрес (connect) или сокет, привязанный к 0.0.0.0 (bind)
+        auto it = socketPids.find({ localAddr, localPort, protocol });
+        if (it == socketPids.end()) {
+            it = socketPids.find({ 0, localPort, protocol });
+        }
+        if (it != socketPids.end() && now - it->second.lastSeen < std::chrono::seconds(Constants::DNS_PID_CACHE_TTL_SEC)) {
+            it->second.lastSeen = now;
+            pid = it->second.pid;
+        }
     }
 
-    Logger::Instance().Info("DnsProxy::Stop - DNS proxy stopped");
+    if (pid != 0) {
+        hits = pidCacheHits.fetch_add(1, std::memory_order_relaxed) + 1;
+        PERF_COUNT("DnsProxy.PidCache.Hit");
+    }
+    else {
+        PERF_COUNT("DnsProxy.PidCache.Miss");
+        {
+            PERF_TIMER("DnsProxy::LookupPidTableScan");
+            pid = isUdp ? LookupUdpPid(localAddr, localPort) : LookupTcpPid(localAddr, localPort);
+        }
+        // Событие сокета могло ещё не дойти: запоминаем, чтобы повторы запроса попали в кэш
+        if (pid != 0) {
+            RememberSocketPid({ localAddr, localPort, protocol }, pid);
+        }
+    }
+
+    PerformanceMonitor::Instance().SetGauge("DnsProxy.PidCache.HitRatePercent", hits * 100 / lookups);
+    return pid;
+}
+
+void DnsProxy::RememberSocketPid(const SocketKey& key, DWORD pid) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(socketPidsMutex);
+
+    if (socketPids.size() >= Constants::DNS_PID_CACHE_MAX_ENTRIES && !socketPids.contains(key)) {
+        std::erase_if(socketPids, [now](const auto& entry) {
+            return now - entry.second.lastSeen >= std::chrono::seconds(Constants::DNS_PID_CACHE_TTL_SEC);
+        });
+        // Всё живое - кэш лишь ускоряет поиск, промахи обслужит сканирование таблиц
+        if (socketPids.size() >= Constants::DNS_PID_CACHE_MAX_ENTRIES) {
+            socketPids.clear();
+            PERF_COUNT("DnsProxy.PidCache.Flushed");
+        }
+    }
+
+    socketPids[key] = { pid, now };
+}
+
+void DnsProxy::SocketThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("DnsProxy::SocketThreadFunc - Socket event tracking started");
+
+    WINDIVERT_ADDRESS addrs[Constants::DNS_SOCKET_RECV_BATCH];
+
+    while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+        UINT addrLen = sizeof(addrs);
+        if (!WinDivertRecvEx(socketHandle, nullptr, 0, nullptr, 0, addrs, &addrLen, nullptr)) {
+            if (!stopToken.stop_requested()) {
+                DWORD err = GetLastError();
+                if (err != ERROR_NO_DATA && err != ERROR_INVALID_HANDLE) {
+                    LOG_DEBUG("DnsProxy::SocketThreadFunc - Recv failed: {}", err);
+                }
+            }
+            break;
+        }
+
+        size_t count = addrLen / sizeof(WINDIVERT_ADDRESS);
+        for (size_t i = 0; i < count; i++) {
+            const WINDIVERT_ADDRESS& addr = addrs[i];
+            if (addr.IPv6) continue;
+
+            // SOCKET layer отдаёт адрес и порт в host order, пакеты - в network order
+            SocketKey key{ htonl(addr.Socket.LocalAddr[0]), htons(addr.Socket.LocalPort), addr.Socket.Protocol };
+
+            if (addr.Event == WINDIVERT_EVENT_SOCKET_CLOSE) {
+                std::lock_guard lock(socketPidsMutex);
+                // Порт мог уже достаться другому процессу - удаляем только свою запись
+                auto it = socketPids.find(key);
+                if (it != socketPids.end() && it->second.pid == addr.Socket.ProcessId) {
+                    socketPids.erase(it);
+                }
+            }
+            else if (addr.Socket.ProcessId != 0) {
+                RememberSocketPid(key, addr.Socket.ProcessId);
+            }
+        }
+        PERF_COUNT("DnsProxy.SocketEvents.Batches");
+    }
+
+    Logger::Instance().Info("DnsProxy::SocketThreadFunc - Socket event tracking exiting");
 }
 
 DWORD DnsProxy::LookupUdpPid(uint32_t localAddr, uint16_t localPort) {
@@ -125,13 +297,13 @@ DWORD DnsProxy::LookupUdpPid(uint32_t localAddr, uint16_t localPort) {
     // GetExtendedUdpTable also stores them in network byte order
 
     ULONG size = 0;
-    GetExtendedUdpTable(nullptr, &size, FALSE, AF_INET, UDP_TABLE_OWNER_PID, 0);
+    IpHelper::Api().GetExtendedUdpTable(nullptr, &size, FALSE, AF_INET, UDP_TABLE_OWNER_PID, 0);
     if (size == 0) return 0;
 
     auto buffer = std::make_unique<uint8_t[]>(size);
     auto* table = reinterpret_cast<MIB_UDPTABLE_OWNER_PID*>(buffer.get());
 
-    if (GetExtendedUdpTable(table, &size, FALSE, AF_INET, UDP_TABLE_OWNER_PID, 0) != NO_ERROR) {
+    if (IpHelper::Api().GetExtendedUdpTable(table, &size, FALSE, AF_INET, UDP_TABLE_OWNER_PID, 0) != NO_ERROR) {
         return 0;
     }
 
@@ -152,13 +324,13 @@ DWORD DnsProxy::LookupTcpPid(uint32_t localAddr, uint16_t localPort) {
     // localAddr and localPort are in network byte order (from packet headers)
 
     ULONG size = 0;
-    GetExtendedTcpTable(nullptr, &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_ALL, 0);
+    IpHelper::Api().GetExtendedTcpTable(nullptr, &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_ALL, 0);
     if (size == 0) return 0;
 
     auto buffer = std::make_unique<uint8_t[]>(size);
     auto* table = reinterpret_cast<MIB_TCPTABLE_OWNER_PID*>(buffer.get());
 
-    if (GetExtendedTcpTable(table, &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_ALL, 0) != NO_ERROR) {
+    if (IpHelper::Api().GetExtendedTcpTable(table, &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_ALL, 0) != NO_ERROR) {
         return 0;
     }
 
@@ -173,261 +345,469 @@ DWORD DnsProxy::LookupTcpPid(uint32_t localAddr, uint16_t localPort) {
     return 0;
 }
 
-void DnsProxy::OutboundThreadFunc(std::stop_token stopToken) {
-    Logger::Instance().Info("DnsProxy::OutboundThreadFunc - Outbound DNS interception started");
+bool DnsProxy::MatchesDomainRule(std::span<const uint8_t> dns) const {
+    // Только запрос (QR=0) хотя бы с одним вопросом
+    if (domainMatcher.Empty()) {
+        return false;
+    }
 
-    uint8_t packet[PACKET_BUFSIZE];
-    WINDIVERT_ADDRESS addr;
-    UINT packetLen;
-    PWINDIVERT_IPHDR ipHdr;
-    PWINDIVERT_UDPHDR udpHdr;
-    PWINDIVERT_TCPHDR tcpHdr;
+    DnsMessageReader reader(dns);
+    if (!reader.Valid() || reader.IsResponse() || reader.QuestionCount() == 0) {
+        return false;
+    }
 
-    while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
-        if (!WinDivertRecv(outboundHandle, packet, sizeof(packet), &packetLen, &addr)) {
-            if (!stopToken.stop_requested()) {
-                DWORD err = GetLastError();
-                if (err != ERROR_NO_DATA && err != ERROR_INVALID_HANDLE) {
-                    Logger::Instance().Debug(std::format("DnsProxy::OutboundThreadFunc - Recv failed: {}", err));
-                }
-            }
-            break;
-        }
+    std::string queryName;
+    return DnsMessageReader::ReadName(dns, reader.FirstQuestionName(), queryName) != 0 &&
+        domainMatcher.Match(queryName) >= 0;
+}
 
-        WinDivertHelperParsePacket(
-            packet, packetLen,
-            &ipHdr, nullptr, nullptr, nullptr, nullptr,
-            &tcpHdr, &udpHdr,
-            nullptr, nullptr, nullptr, nullptr
-        );
+bool DnsProxy::RewriteOutbound(uint8_t* packet, UINT packetLen,
+    PWINDIVERT_IPHDR ipHdr, PWINDIVERT_TCPHDR tcpHdr, PWINDIVERT_UDPHDR udpHdr) {
+    bool isUdp = (udpHdr != nullptr);
+    uint16_t srcPort = isUdp ? udpHdr->SrcPort : tcpHdr->SrcPort;
+    uint32_t originalDst = ipHdr->DstAddr;
 
-        if (!ipHdr || (!udpHdr && !tcpHdr)) {
-            WinDivertSend(outboundHandle, packet, packetLen, nullptr, &addr);
-            continue;
-        }
+    // Skip if already going to target DNS
+    if (originalDst == htonl(TARGET_DNS_NBO)) {
+        return false;
+    }
 
-        bool isUdp = (udpHdr != nullptr);
-        uint16_t srcPort = isUdp ? udpHdr->SrcPort : tcpHdr->SrcPort;
-        uint32_t originalDst = ipHdr->DstAddr;
+    // Socket event cache first, system tables only on a miss
+    DWORD pid = LookupPid(ipHdr->SrcAddr, srcPort, isUdp);
 
-        // Skip if already going to target DNS
-        if (originalDst == htonl(TARGET_DNS_NBO)) {
-            WinDivertSend(outboundHandle, packet, packetLen, nullptr, &addr);
-            continue;
+    if (pid == 0 || !processManager->IsSelectedProcessByPid(pid)) {
+        // Чужой процесс: перенаправляем только UDP-запросы под доменными правилами.
+        // TCP решается на SYN, где имени ещё нет, поэтому он проходит как есть
+        if (!isUdp || !MatchesDomainRule(TransportPayload(packet, packetLen, tcpHdr, udpHdr))) {
+            return false;
         }
+        PERF_COUNT("DnsProxy.Outbound.DomainRule");
+    }
 
-        // Look up PID via system tables
-        DWORD pid = isUdp
-            ? LookupUdpPid(ipHdr->SrcAddr, srcPort)
-            : LookupTcpPid(ipHdr->SrcAddr, srcPort);
-
-        if (pid == 0 || !processManager->IsSelectedProcessByPid(pid)) {
-            // Not a selected process — pass through unchanged
-            WinDivertSend(outboundHandle, packet, packetLen, nullptr, &addr);
-            continue;
+    if (Logger::Instance().IsEnabled(Logger::LogLevel::LEVEL_DEBUG)) {
+        char srcIpStr[INET_ADDRSTRLEN], dstIpStr[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &ipHdr->SrcAddr, srcIpStr, sizeof(srcIpStr));
+        inet_ntop(AF_INET, &originalDst, dstIpStr, sizeof(dstIpStr));
+        LOG_DEBUG("DnsProxy::Outbound - PID {} -> redirecting {}:{} -> {}:53 to 8.8.8.8",
+            pid, srcIpStr, ntohs(srcPort), dstIpStr);
+    }
+    PERF_COUNT("DnsProxy.Outbound.Redirected");
+
+    // Store original DNS server in NAT table
+    DnsNatTable::Key key{ ipHdr->SrcAddr, srcPort, static_cast<uint8_t>(isUdp ? IPPROTO_UDP : IPPROTO_TCP) };
+    int64_t now = SteadySeconds();
+    natTable.Insert(key, originalDst, now);
+    if (tcpHdr) {
+        // RST от клиента: ответов больше не будет. FIN: ответ сервера ещё может прийти
+        if (tcpHdr->Rst) {
+            natTable.Erase(key);
+        }
+        else if (tcpHdr->Fin) {
+            natTable.Close(key, now);
         }
+    }
 
-        {
-            char srcIpStr[INET_ADDRSTRLEN], dstIpStr[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &ipHdr->SrcAddr, srcIpStr, sizeof(srcIpStr));
-            inet_ntop(AF_INET, &originalDst, dstIpStr, sizeof(dstIpStr));
-            Logger::Instance().Info(std::format("DnsProxy::Outbound - PID {} -> redirecting {}:{} -> {}:53 to 8.8.8.8",
-                pid, srcIpStr, ntohs(srcPort), dstIpStr));
+    // Большой EDNS0-ответ пришёл бы фрагментами, а фрагменты без UDP-заголовка мимо фильтра
+    // не переписываются. С ограничением сервер ставит TC, и клиент повторяет запрос по TCP
+    if (isUdp && DnsMessageReader::ClampEdnsPayloadSize(TransportPayload(packet, packetLen, tcpHdr, udpHdr),
+        Constants::DNS_EDNS_MAX_UDP_PAYLOAD)) {
+        PERF_COUNT("DnsProxy.Outbound.EdnsClamped");
+    }
+
+    // Rewrite destination to 8.8.8.8
+    ipHdr->DstAddr = htonl(TARGET_DNS_NBO);
+    return true;
+}
+
+bool DnsProxy::RewriteInbound(uint8_t* packet, UINT packetLen,
+    PWINDIVERT_IPHDR ipHdr, PWINDIVERT_TCPHDR tcpHdr, PWINDIVERT_UDPHDR udpHdr) {
+    // For inbound: DstAddr is our local IP, DstPort is our local port
+    uint16_t dstPort = udpHdr ? udpHdr->DstPort : (tcpHdr ? tcpHdr->DstPort : 0);
+    DnsNatTable::Key key{ ipHdr->DstAddr, dstPort, static_cast<uint8_t>(udpHdr ? IPPROTO_UDP : IPPROTO_TCP) };
+    int64_t now = SteadySeconds();
+
+    // For UDP, remove after use (single request-response)
+    // For TCP, keep entry alive until FIN/RST or idle timeout (multiple exchanges)
+    uint32_t originalDns = 0;
+    bool found = udpHdr ? natTable.Take(key, now, originalDns) : natTable.Find(key, now, originalDns);
+    if (!found) {
+        return false;
+    }
+
+    // Parse DNS response and proactively add routes for resolved IPs
+    if (routeController) {
+        std::span<const uint8_t> payload = TransportPayload(packet, packetLen, tcpHdr, udpHdr);
+        if (udpHdr && payload.size() >= DnsMessageReader::HEADER_SIZE) {
+            ParseDnsResponseAndAddRoutes(payload);
+        }
+        else if (tcpHdr && !payload.empty()) {
+            ParseTcpDnsSegment(key, tcpHdr, payload);
         }
+        else if (tcpHdr && tcpHdr->Syn && tcpHdr->Ack) {
+            // Начало потока ответов: с ним сборка переживает сегменты, забранные воркерами не по порядку
+            tcpStreams.Open(key, ntohl(tcpHdr->SeqNum) + 1, now);
+        }
+    }
 
-        // Store original DNS server in NAT table
-        NatKey key{ ipHdr->SrcAddr, srcPort };
-        {
-            std::lock_guard lock(natMutex);
-            natTable[key] = originalDst;
+    if (tcpHdr && (tcpHdr->Rst || tcpHdr->Fin)) {
+        tcpStreams.Erase(key);
+        if (tcpHdr->Rst) {
+            natTable.Erase(key);
         }
+        else {
+            natTable.Close(key, now);
+        }
+    }
 
-        // Rewrite destination to 8.8.8.8
-        ipHdr->DstAddr = htonl(TARGET_DNS_NBO);
-        WinDivertHelperCalcChecksums(packet, packetLen, &addr, 0);
+    // Rewrite source IP back to original DNS server
+    ipHdr->SrcAddr = originalDns;
+    PERF_COUNT("DnsProxy.Inbound.Rewritten");
+    return true;
+}
 
-        if (!WinDivertSend(outboundHandle, packet, packetLen, nullptr, &addr)) {
-            Logger::Instance().Debug(std::format("DnsProxy::OutboundThreadFunc - Send failed: {}", GetLastError()));
+void DnsProxy::PacketWorkerThreadFunc(std::stop_token stopToken, HANDLE handle, bool outbound) {
+    const char* direction = outbound ? "Outbound" : "Inbound";
+    Logger::Instance().Info(std::format("DnsProxy::PacketWorkerThreadFunc - {} worker started", direction));
+
+    // Пока пачка переписывается и отправляется, драйвер заполняет следующие слоты.
+    // Слоты забираются строго по кругу, каждый со своим буфером пакетов и адресов.
+    struct RecvSlot {
+        OVERLAPPED overlapped{};
+        UniqueHandle event;
+        std::vector<uint8_t> packets;
+        std::vector<WINDIVERT_ADDRESS> addrs;
+        UINT recvLen = 0;
+        UINT addrLen = 0;
+        bool pending = false;
+    };
+
+    const int batchSize = std::clamp(settings.batchSize, 1, static_cast<int>(WINDIVERT_BATCH_MAX));
+    const int outstanding = std::clamp(settings.recvOutstanding, 1, Constants::DNS_RECV_MAX_OUTSTANDING);
+
+    std::vector<RecvSlot> slots(outstanding);
+    for (auto& slot : slots) {
+        slot.event.reset(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+        if (!slot.event) {
+            Logger::Instance().Error(std::format("DnsProxy::PacketWorkerThreadFunc - CreateEvent failed: {}", GetLastError()));
+            return;
         }
+        slot.packets.resize(Constants::DNS_BATCH_BUFFER_BYTES);
+        slot.addrs.resize(batchSize);
     }
 
-    Logger::Instance().Info("DnsProxy::OutboundThreadFunc - Outbound DNS interception exiting");
-}
+    auto issueRecv = [handle](RecvSlot& slot) -> DWORD {
+        ResetEvent(slot.event.get());
+        slot.overlapped = {};
+        slot.overlapped.hEvent = slot.event.get();
+        slot.recvLen = 0;
+        slot.addrLen = static_cast<UINT>(slot.addrs.size() * sizeof(WINDIVERT_ADDRESS));
+
+        if (WinDivertRecvEx(handle, slot.packets.data(), static_cast<UINT>(slot.packets.size()), nullptr, 0,
+            slot.addrs.data(), &slot.addrLen, &slot.overlapped)) {
+            slot.pending = true;
+            return ERROR_SUCCESS;
+        }
 
-void DnsProxy::InboundThreadFunc(std::stop_token stopToken) {
-    Logger::Instance().Info("DnsProxy::InboundThreadFunc - Inbound DNS response rewriting started");
+        DWORD error = GetLastError();
+        slot.pending = (error == ERROR_IO_PENDING);
+        return slot.pending ? ERROR_SUCCESS : error;
+    };
 
-    uint8_t packet[PACKET_BUFSIZE];
-    WINDIVERT_ADDRESS addr;
-    UINT packetLen;
-    PWINDIVERT_IPHDR ipHdr;
-    PWINDIVERT_UDPHDR udpHdr;
-    PWINDIVERT_TCPHDR tcpHdr;
+    auto shouldStop = [&stopToken] {
+        return stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown;
+    };
 
-    while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
-        if (!WinDivertRecv(inboundHandle, packet, sizeof(packet), &packetLen, &addr)) {
-            if (!stopToken.stop_requested()) {
-                DWORD err = GetLastError();
-                if (err != ERROR_NO_DATA && err != ERROR_INVALID_HANDLE) {
-                    Logger::Instance().Debug(std::format("DnsProxy::InboundThreadFunc - Recv failed: {}", err));
-                }
-            }
+    auto logRecvError = [&](DWORD err) {
+        if (!shouldStop() && err != ERROR_NO_DATA && err != ERROR_INVALID_HANDLE && err != ERROR_OPERATION_ABORTED) {
+            LOG_DEBUG("DnsProxy::PacketWorkerThreadFunc - {} recv failed: {}", direction, err);
+        }
+    };
+
+    bool keepRunning = true;
+    for (auto& slot : slots) {
+        DWORD error = issueRecv(slot);
+        if (error != ERROR_SUCCESS) {
+            logRecvError(error);
+            keepRunning = false;
             break;
         }
+    }
 
-        WinDivertHelperParsePacket(
-            packet, packetLen,
-            &ipHdr, nullptr, nullptr, nullptr, nullptr,
-            &tcpHdr, &udpHdr,
-            nullptr, nullptr, nullptr, nullptr
-        );
+    size_t next = 0;
+    while (keepRunning && !shouldStop()) {
+        RecvSlot& slot = slots[next];
+        next = (next + 1) % slots.size();
 
-        if (!ipHdr || (!udpHdr && !tcpHdr)) {
-            WinDivertSend(inboundHandle, packet, packetLen, nullptr, &addr);
-            continue;
+        DWORD transferred = 0;
+        BOOL ok = GetOverlappedResult(handle, &slot.overlapped, &transferred, TRUE);
+        slot.pending = false;
+        if (!ok) {
+            logRecvError(GetLastError());
+            break;
+        }
+        if (shouldStop()) {
+            break;
         }
 
-        // For inbound: DstAddr is our local IP, DstPort is our local port
-        uint16_t dstPort = udpHdr ? udpHdr->DstPort : (tcpHdr ? tcpHdr->DstPort : 0);
-        NatKey key{ ipHdr->DstAddr, dstPort };
+        // Для WinDivert число принятых байт пакетов возвращается через overlapped
+        slot.recvLen = transferred;
+        size_t count = slot.addrLen / sizeof(WINDIVERT_ADDRESS);
+        if (outbound) {
+            PERF_COUNT("DnsProxy.Outbound.Batches");
+        }
+        else {
+            PERF_COUNT("DnsProxy.Inbound.Batches");
+        }
 
-        uint32_t originalDns = 0;
-        {
-            std::lock_guard lock(natMutex);
-            auto it = natTable.find(key);
-            if (it != natTable.end()) {
-                originalDns = it->second;
-                // For UDP, remove after use (single request-response)
-                // For TCP, keep entry alive (connection-oriented, multiple exchanges)
-                if (udpHdr) {
-                    natTable.erase(it);
+        // Пакеты в буфере идут подряд, каждый переписывается на месте
+        uint8_t* packet = slot.packets.data();
+        UINT remaining = slot.recvLen;
+        for (size_t i = 0; i < count && packet != nullptr && remaining > 0; i++) {
+            PWINDIVERT_IPHDR ipHdr = nullptr;
+            PWINDIVERT_TCPHDR tcpHdr = nullptr;
+            PWINDIVERT_UDPHDR udpHdr = nullptr;
+            PVOID nextPacket = nullptr;
+            UINT nextLen = 0;
+
+            WinDivertHelperParsePacket(
+                packet, remaining,
+                &ipHdr, nullptr, nullptr, nullptr, nullptr,
+                &tcpHdr, &udpHdr,
+                nullptr, nullptr, &nextPacket, &nextLen
+            );
+
+            UINT packetLen = nextPacket ? static_cast<UINT>(static_cast<uint8_t*>(nextPacket) - packet) : remaining;
+
+            if (ipHdr && (udpHdr || tcpHdr)) {
+                bool modified = outbound
+                    ? RewriteOutbound(packet, packetLen, ipHdr, tcpHdr, udpHdr)
+                    : RewriteInbound(packet, packetLen, ipHdr, tcpHdr, udpHdr);
+                // Контрольные суммы пересчитываем только у изменённых пакетов
+                if (modified) {
+                    WinDivertHelperCalcChecksums(packet, packetLen, &slot.addrs[i], 0);
                 }
             }
+
+            packet = static_cast<uint8_t*>(nextPacket);
+            remaining = nextLen;
         }
 
-        if (originalDns != 0) {
-            // Parse DNS response and proactively add routes for resolved IPs
-            if (routeController && udpHdr) {
-                const auto* dnsPayload = reinterpret_cast<const uint8_t*>(udpHdr) + sizeof(WINDIVERT_UDPHDR);
-                size_t dnsLen = packetLen - (dnsPayload - packet);
-                if (dnsLen >= 12) {
-                    ParseDnsResponseAndAddRoutes({dnsPayload, dnsLen});
-                }
-            }
-            else if (routeController && tcpHdr) {
-                // TCP DNS: payload starts after TCP header, first 2 bytes are length prefix
-                uint32_t tcpHeaderLen = tcpHdr->HdrLength * 4;
-                const auto* tcpPayload = reinterpret_cast<const uint8_t*>(tcpHdr) + tcpHeaderLen;
-                size_t tcpPayloadLen = packetLen - (tcpPayload - packet);
-                if (tcpPayloadLen > 2) {
-                    const auto* dnsPayload = tcpPayload + 2; // skip 2-byte length prefix
-                    size_t dnsLen = tcpPayloadLen - 2;
-                    if (dnsLen >= 12) {
-                        ParseDnsResponseAndAddRoutes({dnsPayload, dnsLen});
+        // Вся пачка, изменённая и нет, уходит одним вызовом
+        if (!WinDivertSendEx(handle, slot.packets.data(), slot.recvLen, nullptr, 0,
+            slot.addrs.data(), slot.addrLen, nullptr)) {
+            LOG_DEBUG("DnsProxy::PacketWorkerThreadFunc - {} send failed: {}", direction, GetLastError());
+        }
+
+        // Задержка, добавленная прокси: от захвата драйвером до повторной инъекции
+        if (qpcFrequency > 0) {
+            LARGE_INTEGER qpcNow;
+            QueryPerformanceCounter(&qpcNow);
+            for (size_t i = 0; i < count; i++) {
+                if (slot.addrs[i].Timestamp > 0 && qpcNow.QuadPart > slot.addrs[i].Timestamp) {
+                    auto latency = std::chrono::microseconds((qpcNow.QuadPart - slot.addrs[i].Timestamp) * 1000000 / qpcFrequency);
+                    if (outbound) {
+                        PERF_RECORD("DnsProxy.OutboundLatency", latency);
+                    }
+                    else {
+                        PERF_RECORD("DnsProxy.InboundLatency", latency);
                     }
                 }
             }
+        }
 
-            // Rewrite source IP back to original DNS server
-            ipHdr->SrcAddr = originalDns;
-            WinDivertHelperCalcChecksums(packet, packetLen, &addr, 0);
+        int64_t now = SteadySeconds();
+        if (natTable.SweepIfDue(now, Constants::DNS_NAT_SWEEP_INTERVAL_SEC)) {
+            answerCache.Sweep(now);
+            tcpStreams.Sweep(now, Constants::DNS_NAT_TCP_IDLE_SEC);
+            PublishNatStats();
         }
 
-        if (!WinDivertSend(inboundHandle, packet, packetLen, nullptr, &addr)) {
-            Logger::Instance().Debug(std::format("DnsProxy::InboundThreadFunc - Send failed: {}", GetLastError()));
+        DWORD error = issueRecv(slot);
+        if (error != ERROR_SUCCESS) {
+            logRecvError(error);
+            break;
+        }
+    }
+
+    // Буферы слотов принадлежат драйверу, пока приём не завершён: отменяем свои и дожидаемся
+    for (auto& slot : slots) {
+        if (slot.pending) {
+            CancelIoEx(handle, &slot.overlapped);
+            DWORD transferred = 0;
+            GetOverlappedResult(handle, &slot.overlapped, &transferred, TRUE);
+            slot.pending = false;
         }
     }
 
-    Logger::Instance().Info("DnsProxy::InboundThreadFunc - Inbound DNS response rewriting exiting");
+    Logger::Instance().Info(std::format("DnsProxy::PacketWorkerThreadFunc - {} worker exiting", direction));
 }
 
-void DnsProxy::ParseDnsResponseAndAddRoutes(std::span<const uint8_t> dns) {
-    // DNS header: ID(2) Flags(2) QDCOUNT(2) ANCOUNT(2) NSCOUNT(2) ARCOUNT(2)
-    if (dns.size() < 12) return;
+size_t DnsProxy::GetMemoryBytes() {
+    size_t bytes = natTable.GetStats().memoryBytes + answerCache.GetStats().memoryBytes;
+    std::lock_guard lock(socketPidsMutex);
+    return bytes + socketPids.bucket_count() * sizeof(void*) +
+        socketPids.size() * (sizeof(std::pair<const SocketKey, SocketOwner>) + sizeof(void*) * 2);
+}
 
-    uint16_t flags = (dns[2] << 8) | dns[3];
-    bool isResponse = (flags & 0x8000) != 0;
-    uint8_t rcode = flags & 0x0F;
+void DnsProxy::TrimMemory(MemoryPressure pressure) {
+    if (pressure == MemoryPressure::Normal) {
+        return;
+    }
 
-    if (!isResponse || rcode != 0) return;
+    int64_t now = SteadySeconds();
+    size_t swept = natTable.Sweep(now) + answerCache.Sweep(now);
+    tcpStreams.Sweep(now, Constants::DNS_NAT_TCP_IDLE_SEC);
 
-    uint16_t qdcount = (dns[4] << 8) | dns[5];
-    uint16_t ancount = (dns[6] << 8) | dns[7];
+    if (pressure == MemoryPressure::Shed) {
+        // Кэш ответов и PID сокетов восстанавливаются сами; NAT-таблицу не трогаем - без неё потеряются ответы в полёте
+        answerCache.Clear();
+        std::lock_guard lock(socketPidsMutex);
+        socketPids.clear();
+        socketPids.rehash(0);
+    }
 
-    if (ancount == 0) return;
+    PublishNatStats();
+    Logger::Instance().Info(std::format("DnsProxy::TrimMemory - Swept {} entries{}", swept,
+        pressure == MemoryPressure::Shed ? ", answer cache cleared" : ""));
+}
 
-    // Skip question section
-    size_t offset = 12;
-    for (uint16_t i = 0; i < qdcount; i++) {
-        // Skip QNAME
-        while (offset < dns.size()) {
-            uint8_t labelLen = dns[offset];
-            if (labelLen == 0) {
-                offset++; // null terminator
-                break;
-            }
-            if ((labelLen & 0xC0) == 0xC0) {
-                offset += 2; // compression pointer
-                break;
-            }
-            offset += 1 + labelLen;
-        }
-        offset += 4; // QTYPE(2) + QCLASS(2)
-    }
+void DnsProxy::PublishNatStats() {
+    DnsNatTable::Stats stats = natTable.GetStats();
+    auto& perf = PerformanceMonitor::Instance();
+    perf.SetGauge("DnsProxy.Nat.Size", stats.size);
+    perf.SetGauge("DnsProxy.Nat.Capacity", stats.capacity);
+    perf.SetGauge("DnsProxy.Nat.Inserted", stats.inserted);
+    perf.SetGauge("DnsProxy.Nat.Expired", stats.expired);
+    perf.SetGauge("DnsProxy.Nat.Evicted", stats.evicted);
+    perf.SetGauge("DnsProxy.Nat.Closed", stats.closed);
+
+    DnsAnswerCache::Stats answers = answerCache.GetStats();
+    perf.SetGauge("DnsProxy.Answers.Addresses", answers.addresses);
+    perf.SetGauge("DnsProxy.Answers.Expired", answers.expired);
+    perf.SetGauge("DnsProxy.Answers.Evicted", answers.evicted);
+    perf.SetGauge("DnsProxy.Tcp.Streams", tcpStreams.Size());
+}
 
-    // Parse answer section
-    for (uint16_t i = 0; i < ancount && offset < dns.size(); i++) {
-        // Skip NAME (may be compressed)
-        while (offset < dns.size()) {
-            uint8_t labelLen = dns[offset];
-            if (labelLen == 0) {
-                offset++;
-                break;
-            }
-            if ((labelLen & 0xC0) == 0xC0) {
-                offset += 2;
-                break;
-            }
-            offset += 1 + labelLen;
+void DnsProxy::ParseDnsResponseAndAddRoutes(std::span<const uint8_t> dns) {
+    TrafficCapture::Instance().RecordDnsResponse(dns);
+
+    DnsMessageReader reader(dns);
+    if (!reader.Valid() || !reader.IsResponse() || reader.Rcode() != 0) return;
+    if (reader.AnswerCount() == 0 || reader.QuestionCount() == 0) return;
+
+    // Группа маршрутов - первое запрошенное имя
+    std::string queryName;
+    if (DnsMessageReader::ReadName(dns, reader.FirstQuestionName(), queryName) == 0) return;
+
+    // CNAME chain: смещения имён, через которые ответ ведёт от запроса к адресам
+    std::array<size_t, MAX_CNAME_CHAIN> chain{ reader.FirstQuestionName() };
+    size_t chainLength = 1;
+    int64_t now = SteadySeconds();
+    std::string routeOwner;
+    std::string target;
+
+    // Правило может совпасть с запросом или с любым CNAME по пути к адресам
+    int rule = domainMatcher.Match(queryName);
+    auto ownerName = [&]() -> const std::string& {
+        if (routeOwner.empty()) {
+            routeOwner = rule >= 0 ? std::format("domain:{}", domainMatcher.Rule(rule)) : std::format("dns:{}", queryName);
         }
+        return routeOwner;
+    };
 
-        // Need at least TYPE(2) + CLASS(2) + TTL(4) + RDLENGTH(2) = 10 bytes
-        if (offset + 10 > dns.size()) break;
+    DnsMessageReader::Record record;
+    while (reader.Next(record) && record.section == DnsMessageReader::Section::Answer) {
+        if (record.rclass != DnsMessageReader::CLASS_IN) continue;
 
-        uint16_t rtype = (dns[offset] << 8) | dns[offset + 1];
-        uint16_t rclass = (dns[offset + 2] << 8) | dns[offset + 3];
-        // TTL at offset+4..+7 (skip)
-        uint16_t rdlength = (dns[offset + 8] << 8) | dns[offset + 9];
-        offset += 10;
+        bool inChain = std::any_of(chain.begin(), chain.begin() + chainLength,
+            [&](size_t name) { return DnsMessageReader::NamesEqual(dns, record.nameOffset, name); });
+        if (!inChain) continue;
 
-        if (offset + rdlength > dns.size()) break;
+        std::span<const uint8_t> rdata = reader.RData(record);
 
-        // A record: type=1, class=IN(1), rdlength=4
-        if (rtype == 1 && rclass == 1 && rdlength == 4) {
-            uint32_t ipAddr;
-            memcpy(&ipAddr, &dns[offset], 4);
+        if (record.type == DnsMessageReader::TYPE_CNAME) {
+            if (chainLength < MAX_CNAME_CHAIN && DnsMessageReader::SkipName(dns, record.rdataOffset) != 0) {
+                chain[chainLength++] = record.rdataOffset;
+                if (rule < 0 && !domainMatcher.Empty() && DnsMessageReader::ReadName(dns, record.rdataOffset, target) != 0) {
+                    rule = domainMatcher.Match(target);
+                    if (rule >= 0) routeOwner.clear();
+                }
+            }
+        }
+        else if (record.type == DnsMessageReader::TYPE_AAAA && record.rdlength == 16) {
+            // IPv6-маршруты живут по своему idle TTL: стоящий только продлеваем, без новой ссылки,
+            // а новый ставят потоки программирования - на пути пакета системных вызовов нет
+            Ipv6Address address = Ipv6Address::FromBytes(rdata.data());
+            if (address.IsGlobalUnicast()) {
+                if (!routeController->TouchRoute6(address)) {
+                    routeController->EnqueueRoute6(address, ownerName());
+                }
+                PERF_COUNT("DnsProxy.Answers.AAAA");
+            }
+        }
+        else if (record.type == DnsMessageReader::TYPE_A && record.rdlength == 4) {
+            uint32_t address = (static_cast<uint32_t>(rdata[0]) << 24) | (rdata[1] << 16) | (rdata[2] << 8) | rdata[3];
+
+            if (!Utils::IsPrivateIPv4(address)) {
+                // Маршрут живёт TTL записи + grace, пока его не начнёт использовать flow
+                int64_t recordTtl = std::clamp<int64_t>(record.ttl, Constants::DNS_ROUTE_MIN_TTL_SEC, Constants::DNS_ROUTE_MAX_TTL_SEC);
+                int64_t idleTtl = recordTtl + (std::max)(settings.routeTtlGraceSec, 0);
+                bool isNew = answerCache.Record(address, now + idleTtl, now);
+
+                if (rule >= 0) {
+                    // Маршрут правила ставим синхронно: ответ уйдёт клиенту только после него,
+                    // так SYN к этому адресу уже пойдёт через шлюз. Срок жизни обычный, не DNS TTL.
+                    // Повторный ответ только продлевает маршрут: новая ссылка на каждый запрос его бы закрепила
+                    if (!routeController->TouchRoute(address)) {
+                        routeController->AddRoute(Utils::FastUIntToIP(address), ownerName());
+                    }
+                    PERF_COUNT("DnsProxy.Answers.DomainRule");
+                }
+                // Уже стоящий маршрут только продлеваем, без учёта новой ссылки
+                else if (!routeController->TouchRoute(address, idleTtl)) {
+                    routeController->EnqueueRoute(address, ownerName(), idleTtl);
+                }
 
-            // Skip if already added this route
-            {
-                std::lock_guard lock(addedRoutesMutex);
-                if (addedRoutes.contains(ipAddr)) {
-                    offset += rdlength;
-                    continue;
+                if (isNew) {
+                    Logger::Instance().Info(std::format("DnsProxy: DNS resolved {} -> {} (ttl {}s, chain {}), pre-adding route",
+                        queryName, Utils::FastUIntToIP(address), record.ttl, chainLength));
+                    PERF_COUNT("DnsProxy.Answers.New");
+                }
+                else {
+                    PERF_COUNT("DnsProxy.Answers.Refreshed");
                 }
             }
+        }
+    }
 
-            auto ip = std::format("{}.{}.{}.{}",
-                dns[offset], dns[offset + 1], dns[offset + 2], dns[offset + 3]);
+    // Обрезанный ответ: уже разобранные записи сохранены, остальное клиент перезапросит по TCP
+    if (reader.Malformed()) {
+        PERF_COUNT("DnsProxy.Answers.Truncated");
+    }
+}
 
-            if (!Utils::IsPrivateIP(ip)) {
-                Logger::Instance().Info(std::format("DnsProxy: DNS resolved -> {}, pre-adding route", ip));
-                routeController->AddRoute(ip, "dns-prefetch");
+void DnsProxy::ParseTcpDnsSegment(const DnsNatTable::Key& key, PWINDIVERT_TCPHDR tcpHdr, std::span<const uint8_t> payload) {
+    std::vector<uint8_t> reassembled;
+    std::span<const uint8_t> stream;
+    switch (tcpStreams.Feed(key, ntohl(tcpHdr->SeqNum), payload, SteadySeconds(), reassembled)) {
+    case DnsTcpReassembler::Result::Direct:
+        stream = payload;
+        break;
+    case DnsTcpReassembler::Result::Reassembled:
+        stream = reassembled;
+        PERF_COUNT("DnsProxy.Tcp.Reassembled");
+        break;
+    default:
+        return;
+    }
 
-                std::lock_guard lock(addedRoutesMutex);
-                addedRoutes.insert(ipAddr);
-            }
+    // Только целые сообщения, каждое с 2-байтным префиксом длины
+    while (stream.size() >= 2) {
+        size_t length = (static_cast<size_t>(stream[0]) << 8) | stream[1];
+        if (stream.size() < 2 + length) break;
+        if (length >= DnsMessageReader::HEADER_SIZE) {
+            ParseDnsResponseAndAddRoutes(stream.subspan(2, length));
         }
-
-        offset += rdlength;
+        stream = stream.subspan(2 + length);
     }
 }
@@ -6,69 +6,116 @@
 #include <atomic>
 #include <thread>
 #include <unordered_map>
-#include <unordered_set>
 #include <mutex>
 #include <span>
+#include <chrono>
+#include <vector>
 #include <cstdint>
+#include "../common/Models.h"
+#include "DnsNatTable.h"
+#include "DnsAnswerCache.h"
+#include "DomainMatcher.h"
+#include "DnsMessageReader.h"
+#include "DnsTcpReassembler.h"
+#include "Ipv6Address.h"
 
 class ProcessManager;
 class RouteController;
 
 class DnsProxy {
 public:
-    DnsProxy(ProcessManager* processManager, RouteController* routeController);
+    DnsProxy(ProcessManager* processManager, RouteController* routeController,
+        const DnsProxySettings& settings = {});
     ~DnsProxy();
 
     void Start();
     void Stop();
     [[nodiscard]] bool IsActive() const { return active.load(); }
 
+    // Для Watchdog: NAT-таблица, кэш ответов и PID сокетов
+    size_t GetMemoryBytes();
+    void TrimMemory(MemoryPressure pressure);
+
 private:
+    friend struct BenchAccess;              // bench/: горячие пути без публичного API
+
     ProcessManager* processManager;
     RouteController* routeController;
+    DnsProxySettings settings;
 
     // WinDivert handles
     HANDLE outboundHandle;  // NETWORK layer: rewrite outbound DNS dst -> 8.8.8.8
     HANDLE inboundHandle;   // NETWORK layer: rewrite inbound DNS src <- original
+    HANDLE socketHandle;    // SOCKET layer (sniff): bind/connect/close events feed the PID cache
 
     std::atomic<bool> active;
 
-    std::jthread outboundThread;
-    std::jthread inboundThread;
+    // Несколько воркеров на направление читают один handle пачками, у каждого свои буферы
+    std::vector<std::jthread> outboundWorkers;
+    std::vector<std::jthread> inboundWorkers;
+    std::jthread socketThread;
+    int64_t qpcFrequency = 0;
 
     // Target DNS IP (8.8.8.8) in network byte order
     static constexpr uint32_t TARGET_DNS_NBO = 0x08080808;
 
-    static constexpr size_t PACKET_BUFSIZE = 65535;
+    // NAT table: maps (src_ip, src_port, proto) -> original DNS server IP, bounded and lock-striped
+    DnsNatTable natTable;
 
-    // NAT table key: (src_ip, src_port) in network byte order
-    struct NatKey {
-        uint32_t srcIp;
-        uint16_t srcPort;
+    // Socket owner cache: (local_ip, local_port, proto) in network byte order -> pid.
+    // Filled from SOCKET layer events; the system table scan is only a fallback on a miss
+    struct SocketKey {
+        uint32_t localAddr;
+        uint16_t localPort;
+        uint8_t protocol;
 
-        bool operator==(const NatKey&) const = default;
+        bool operator==(const SocketKey&) const = default;
     };
 
-    struct NatKeyHash {
-        [[nodiscard]] size_t operator()(const NatKey& k) const noexcept {
-            return std::hash<uint64_t>{}(((uint64_t)k.srcIp << 16) | k.srcPort);
+    struct SocketKeyHash {
+        [[nodiscard]] size_t operator()(const SocketKey& k) const noexcept {
+            return std::hash<uint64_t>{}(((uint64_t)k.localAddr << 24) | ((uint64_t)k.localPort << 8) | k.protocol);
         }
     };
 
-    // NAT table: maps (src_ip, src_port) -> original DNS server IP
-    std::unordered_map<NatKey, uint32_t, NatKeyHash> natTable;
-    std::mutex natMutex;
+    struct SocketOwner {
+        DWORD pid;
+        std::chrono::steady_clock::time_point lastSeen;
+    };
+
+    std::unordered_map<SocketKey, SocketOwner, SocketKeyHash> socketPids;
+    std::mutex socketPidsMutex;
+    std::atomic<uint64_t> pidLookups{ 0 };
+    std::atomic<uint64_t> pidCacheHits{ 0 };
 
-    // Cache of IPs already added as routes (avoid repeated AddRoute calls and ref count inflation)
-    std::unordered_set<uint32_t> addedRoutes;
-    std::mutex addedRoutesMutex;
+    // A records by address with TTL-based expiry, grouped by query name (CNAME chain head)
+    DnsAnswerCache answerCache;
+    static constexpr size_t MAX_CNAME_CHAIN = 16;
+
+    // DNS-over-TCP responses split across segments, per client connection
+    DnsTcpReassembler tcpStreams;
+
+    // Domain rules compiled once from settings; a hit redirects the query of any process
+    // and installs routes for its answers before the response reaches the client
+    const DomainMatcher domainMatcher;
 
     // Thread functions
-    void OutboundThreadFunc(std::stop_token stopToken);
-    void InboundThreadFunc(std::stop_token stopToken);
+    void PacketWorkerThreadFunc(std::stop_token stopToken, HANDLE handle, bool outbound);
+    void SocketThreadFunc(std::stop_token stopToken);
+
+    // Per-packet rewrite inside a received batch; true if the packet was modified and needs checksums
+    [[nodiscard]] bool RewriteOutbound(uint8_t* packet, UINT packetLen,
+        PWINDIVERT_IPHDR ipHdr, PWINDIVERT_TCPHDR tcpHdr, PWINDIVERT_UDPHDR udpHdr);
+    [[nodiscard]] bool RewriteInbound(uint8_t* packet, UINT packetLen,
+        PWINDIVERT_IPHDR ipHdr, PWINDIVERT_TCPHDR tcpHdr, PWINDIVERT_UDPHDR udpHdr);
 
     // Helpers
+    [[nodiscard]] DWORD LookupPid(uint32_t localAddr, uint16_t localPort, bool isUdp);
+    void RememberSocketPid(const SocketKey& key, DWORD pid);
+    [[nodiscard]] bool MatchesDomainRule(std::span<const uint8_t> dnsQuery) const;
+    void PublishNatStats();
     [[nodiscard]] DWORD LookupUdpPid(uint32_t localAddr, uint16_t localPort);
     [[nodiscard]] DWORD LookupTcpPid(uint32_t localAddr, uint16_t localPort);
     void ParseDnsResponseAndAddRoutes(std::span<const uint8_t> dnsPayload);
+    void ParseTcpDnsSegment(const DnsNatTable::Key& key, PWINDIVERT_TCPHDR tcpHdr, std::span<const uint8_t> payload);
 };
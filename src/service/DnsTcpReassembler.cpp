@@ -0,0 +1,158 @@
+// src/service/DnsTcpReassembler.cpp
+#include "DnsTcpReassembler.h"
+#include <algorithm>
+
+DnsTcpReassembler::DnsTcpReassembler(size_t maxStreamCount)
+    : maxStreams((std::max)(maxStreamCount, size_t{ 1 })) {
+}
+
+size_t DnsTcpReassembler::CompleteLength(std::span<const uint8_t> data) {
+    size_t complete = 0;
+    while (data.size() - complete >= 2) {
+        size_t length = 2 + ((static_cast<size_t>(data[complete]) << 8) | data[complete + 1]);
+        if (data.size() - complete < length) {
+            break;
+        }
+        complete += length;
+    }
+    return complete;
+}
+
+DnsTcpReassembler::Stream& DnsTcpReassembler::InsertStreamLocked(const DnsNatTable::Key& key) {
+    if (streams.size() >= maxStreams && !streams.contains(key)) {
+        // Вытесняем самый старый поток: неполные ответы к этому моменту почти наверняка потеряны
+        auto oldest = std::min_element(streams.begin(), streams.end(),
+            [](const auto& a, const auto& b) { return a.second.lastSeen < b.second.lastSeen; });
+        streams.erase(oldest);
+    }
+    return streams[key];
+}
+
+bool DnsTcpReassembler::AppendLocked(Stream& stream, uint32_t seq, std::span<const uint8_t> payload) {
+    size_t overlap = static_cast<size_t>(-static_cast<int64_t>(static_cast<int32_t>(seq - stream.nextSeq)));
+    if (overlap >= payload.size()) {
+        return true;                // Чистая ретрансмиссия
+    }
+    payload = payload.subspan(overlap);
+
+    if (stream.buffer.size() + payload.size() > MAX_BUFFER) {
+        return false;
+    }
+    stream.buffer.insert(stream.buffer.end(), payload.begin(), payload.end());
+    stream.nextSeq += static_cast<uint32_t>(payload.size());
+    return true;
+}
+
+void DnsTcpReassembler::Open(const DnsNatTable::Key& key, uint32_t firstSeq, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Данные могли обогнать SYN-ACK: тогда поток уже заведён по первому сегменту
+    if (streams.contains(key)) {
+        return;
+    }
+    Stream& stream = InsertStreamLocked(key);
+    stream.nextSeq = firstSeq;
+    stream.lastSeen = now;
+    stream.opened = true;
+}
+
+DnsTcpReassembler::Result DnsTcpReassembler::Feed(const DnsNatTable::Key& key, uint32_t seq,
+    std::span<const uint8_t> payload, int64_t now, std::vector<uint8_t>& out) {
+    if (payload.empty()) {
+        return Result::Pending;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = streams.find(key);
+    if (it == streams.end()) {
+        // Начало потока не видели: считаем, что сегмент начинается с границы сообщения
+        size_t complete = CompleteLength(payload);
+        if (complete == payload.size()) {
+            return Result::Direct;
+        }
+
+        out.insert(out.end(), payload.begin(), payload.begin() + complete);
+        Stream& stream = InsertStreamLocked(key);
+        stream.nextSeq = seq + static_cast<uint32_t>(payload.size());
+        stream.lastSeen = now;
+        stream.buffer.assign(payload.begin() + complete, payload.end());
+        return complete != 0 ? Result::Reassembled : Result::Pending;
+    }
+
+    Stream& stream = it->second;
+    stream.lastSeen = now;
+
+    if (static_cast<int32_t>(seq - stream.nextSeq) > 0) {
+        // Сегмент обогнал предыдущий: держим, пока не придёт недостающее
+        if (stream.ahead.size() >= MAX_AHEAD_SEGMENTS ||
+            stream.buffer.size() + stream.aheadBytes + payload.size() > MAX_BUFFER) {
+            // Дыра не закрылась: границу сообщений уже не восстановить
+            streams.erase(it);
+            return Result::Pending;
+        }
+        stream.ahead.emplace_back(seq, std::vector<uint8_t>(payload.begin(), payload.end()));
+        stream.aheadBytes += payload.size();
+        return Result::Pending;
+    }
+
+    // Частый случай открытого потока: сегмент по порядку и сам из целых сообщений
+    if (seq == stream.nextSeq && stream.buffer.empty() && stream.ahead.empty() &&
+        CompleteLength(payload) == payload.size()) {
+        stream.nextSeq += static_cast<uint32_t>(payload.size());
+        return Result::Direct;
+    }
+
+    if (!AppendLocked(stream, seq, payload)) {
+        streams.erase(it);
+        return Result::Pending;
+    }
+
+    // Отложенные сегменты, до которых дошла очередь
+    for (size_t i = 0; i < stream.ahead.size();) {
+        if (static_cast<int32_t>(stream.ahead[i].first - stream.nextSeq) > 0) {
+            i++;
+            continue;
+        }
+        auto segment = std::move(stream.ahead[i]);
+        stream.ahead.erase(stream.ahead.begin() + i);
+        stream.aheadBytes -= segment.second.size();
+        if (!AppendLocked(stream, segment.first, segment.second)) {
+            streams.erase(it);
+            return Result::Pending;
+        }
+        i = 0;                      // nextSeq сдвинулся: проверяем оставшиеся заново
+    }
+
+    size_t complete = CompleteLength(stream.buffer);
+    if (complete == 0) {
+        return Result::Pending;
+    }
+
+    out.insert(out.end(), stream.buffer.begin(), stream.buffer.begin() + complete);
+    stream.buffer.erase(stream.buffer.begin(), stream.buffer.begin() + complete);
+    if (stream.buffer.empty() && stream.ahead.empty() && !stream.opened) {
+        streams.erase(it);
+    }
+    return Result::Reassembled;
+}
+
+void DnsTcpReassembler::Erase(const DnsNatTable::Key& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    streams.erase(key);
+}
+
+size_t DnsTcpReassembler::Sweep(int64_t now, int idleSeconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::erase_if(streams, [&](const auto& entry) { return entry.second.lastSeen + idleSeconds <= now; });
+}
+
+void DnsTcpReassembler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    streams.clear();
+}
+
+size_t DnsTcpReassembler::Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return streams.size();
+}
@@ -0,0 +1,66 @@
+// src/service/DnsTcpReassembler.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "DnsNatTable.h"
+
+// Reassembles DNS-over-TCP responses per client connection. Each message is
+// prefixed with its 2-byte length (RFC 1035 4.2.2); a message may span
+// segments and one segment may carry several messages. Packet workers pull
+// from one WinDivert queue, so segments of a stream can be fed out of order:
+// a segment ahead of the expected sequence is held (a few per stream) until
+// the gap fills, a retransmitted prefix is trimmed, and only a gap that never
+// fills drops the stream. A stream opened from its SYN-ACK knows where the
+// first message starts and is tracked until FIN/RST or the idle sweep; one
+// first seen mid-connection exists only while a message is incomplete. The
+// common in-order single-segment reply is handed back without copying.
+class DnsTcpReassembler {
+public:
+    enum class Result : uint8_t {
+        Pending,        // Целых сообщений пока нет
+        Direct,         // Сегмент сам состоит из целых сообщений, разбирать его напрямую
+        Reassembled,    // Целые сообщения скопированы в out
+    };
+
+    // now - секунды монотонных часов
+    explicit DnsTcpReassembler(size_t maxStreams);
+
+    // SYN-ACK сервера: firstSeq - номер первого байта данных (ISN + 1, host order)
+    void Open(const DnsNatTable::Key& key, uint32_t firstSeq, int64_t now);
+    // seq - номер первого байта payload (host order). Сообщения в out идут с 2-байтным префиксом длины
+    Result Feed(const DnsNatTable::Key& key, uint32_t seq, std::span<const uint8_t> payload,
+        int64_t now, std::vector<uint8_t>& out);
+    void Erase(const DnsNatTable::Key& key);
+    size_t Sweep(int64_t now, int idleSeconds);
+    void Clear();
+    size_t Size() const;
+
+private:
+    struct Stream {
+        uint32_t nextSeq = 0;
+        int64_t lastSeen = 0;
+        bool opened = false;                // Начало потока известно по SYN-ACK
+        std::vector<uint8_t> buffer;
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> ahead;  // Пришли раньше предыдущих
+        size_t aheadBytes = 0;
+    };
+
+    // Одно сообщение максимальной длины вместе с префиксом
+    static constexpr size_t MAX_BUFFER = 2 + 65535;
+    static constexpr size_t MAX_AHEAD_SEGMENTS = 8;
+
+    mutable std::mutex mutex;
+    std::unordered_map<DnsNatTable::Key, Stream, DnsNatTable::KeyHash> streams;
+    const size_t maxStreams;
+
+    // Длина префикса из целых сообщений в начале data
+    static size_t CompleteLength(std::span<const uint8_t> data);
+    Stream& InsertStreamLocked(const DnsNatTable::Key& key);
+    // Дописывает сегмент, начинающийся не позже nextSeq; false - переполнение буфера
+    static bool AppendLocked(Stream& stream, uint32_t seq, std::span<const uint8_t> payload);
+};
@@ -0,0 +1,98 @@
+// src/service/DomainMatcher.cpp
+#include "DomainMatcher.h"
+#include <algorithm>
+
+DomainMatcher::DomainMatcher(const std::vector<std::string>& ruleList) {
+    nodes.emplace_back();   // Корень
+
+    for (const auto& raw : ruleList) {
+        std::string rule = Normalize(raw);
+        if (rule.empty() || std::find(rules.begin(), rules.end(), rule) != rules.end()) {
+            continue;
+        }
+
+        uint32_t node = 0;
+        std::string_view rest = rule;
+        while (!rest.empty()) {
+            size_t dot = rest.rfind('.');
+            std::string_view label = dot == std::string_view::npos ? rest : rest.substr(dot + 1);
+            rest = dot == std::string_view::npos ? std::string_view{} : rest.substr(0, dot);
+
+            int child = FindChild(node, label);
+            if (child < 0) {
+                child = static_cast<int>(nodes.size());
+                auto& children = nodes[node].children;
+                auto pos = std::lower_bound(children.begin(), children.end(), label,
+                    [](const auto& entry, std::string_view value) { return entry.first < value; });
+                children.insert(pos, { std::string(label), static_cast<uint32_t>(child) });
+                nodes.emplace_back();
+            }
+            node = static_cast<uint32_t>(child);
+        }
+
+        nodes[node].rule = static_cast<int>(rules.size());
+        rules.push_back(std::move(rule));
+    }
+}
+
+int DomainMatcher::FindChild(uint32_t node, std::string_view label) const {
+    const auto& children = nodes[node].children;
+    auto pos = std::lower_bound(children.begin(), children.end(), label,
+        [](const auto& entry, std::string_view value) { return entry.first < value; });
+    if (pos == children.end() || pos->first != label) {
+        return -1;
+    }
+    return static_cast<int>(pos->second);
+}
+
+int DomainMatcher::Match(std::string_view name) const {
+    if (rules.empty()) {
+        return -1;
+    }
+    if (!name.empty() && name.back() == '.') {
+        name.remove_suffix(1);
+    }
+
+    int matched = -1;
+    uint32_t node = 0;
+    while (!name.empty()) {
+        size_t dot = name.rfind('.');
+        std::string_view label = dot == std::string_view::npos ? name : name.substr(dot + 1);
+        name = dot == std::string_view::npos ? std::string_view{} : name.substr(0, dot);
+
+        int child = FindChild(node, label);
+        if (child < 0) {
+            break;
+        }
+        node = static_cast<uint32_t>(child);
+        if (nodes[node].rule >= 0) {
+            matched = nodes[node].rule;     // Глубже - конкретнее
+        }
+    }
+    return matched;
+}
+
+std::string DomainMatcher::Normalize(std::string_view rule) {
+    while (!rule.empty() && (rule.front() == ' ' || rule.front() == '\t')) rule.remove_prefix(1);
+    while (!rule.empty() && (rule.back() == ' ' || rule.back() == '\t' || rule.back() == '.')) rule.remove_suffix(1);
+    if (rule.starts_with("*.")) {
+        rule.remove_prefix(2);
+    }
+    else if (rule.starts_with(".")) {
+        rule.remove_prefix(1);
+    }
+
+    std::string result;
+    result.reserve(rule.size());
+    for (char c : rule) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        // Пустые метки и подстановки в середине не поддерживаются
+        if (c == '*' || (c == '.' && (result.empty() || result.back() == '.'))) {
+            return {};
+        }
+        result.push_back(c);
+    }
+    return result;
+}
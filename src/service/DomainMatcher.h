@@ -0,0 +1,40 @@
+// src/service/DomainMatcher.h
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Domain routing rules compiled into a trie over reversed labels
+// ("com" -> "openai" -> ...). A rule matches the domain itself and every
+// name under it; "*.openai.com" and "openai.com" are the same rule. Match
+// walks the name from the last label to the first with one binary search
+// per label and reports the most specific rule, so the cost is O(labels)
+// regardless of the rule count. Immutable after construction: one compiled
+// matcher is shared by all packet workers and replaced as a whole.
+class DomainMatcher {
+public:
+    explicit DomainMatcher(const std::vector<std::string>& rules);
+
+    // name - lowercase, dot-separated, как возвращает разбор DNS-имени. -1, если ни одно правило не подошло
+    int Match(std::string_view name) const;
+
+    const std::string& Rule(int index) const { return rules[index]; }
+    size_t RuleCount() const { return rules.size(); }
+    bool Empty() const { return rules.empty(); }
+
+    // "*.OpenAI.com." -> "openai.com"; пустая строка - правило некорректно
+    static std::string Normalize(std::string_view rule);
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;    // Отсортированы по метке
+        int rule = -1;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::string> rules;
+
+    int FindChild(uint32_t node, std::string_view label) const;
+};
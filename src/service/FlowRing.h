@@ -0,0 +1,112 @@
+// src/service/FlowRing.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Compact FLOW event as handed from the capture thread to classification
+// workers: one cache line, no owning members, copied by value into the ring.
+struct alignas(64) FlowRecord {
+    uint64_t endpointId = 0;
+    int64_t timestamp = 0;          // WINDIVERT_ADDRESS::Timestamp (QPC)
+    uint32_t processId = 0;
+    uint32_t localAddr[4] = {};     // Порядок WinDivert (IPv4 как ::ffff:a.b.c.d)
+    uint32_t remoteAddr[4] = {};
+    uint16_t localPort = 0;
+    uint16_t remotePort = 0;
+    uint8_t protocol = 0;
+    uint8_t event = 0;              // WINDIVERT_EVENT_*
+};
+static_assert(sizeof(FlowRecord) == 64);
+
+// Bounded single-producer/single-consumer ring. Storage is allocated once in
+// the constructor; push and pop are wait-free and never allocate. The producer
+// and consumer indices live on separate cache lines, each side keeps a cached
+// copy of the other's index and refreshes it only when the ring looks full or
+// empty. A consumer with nothing to do sleeps in WaitForData until the
+// producer (or shutdown) calls WakeConsumer.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mask(std::bit_ceil((std::max)(capacity, size_t{ 2 })) - 1),
+        slots(std::make_unique<T[]>(mask + 1)) {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t Capacity() const { return mask + 1; }
+
+    // Только поток-производитель
+    bool TryPush(const T& item) {
+        uint64_t head = writeIndex.load(std::memory_order_relaxed);
+        if (head - cachedRead >= Capacity()) {
+            cachedRead = readIndex.load(std::memory_order_acquire);
+            if (head - cachedRead >= Capacity()) {
+                return false;
+            }
+        }
+        slots[head & mask] = item;
+        writeIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Index the next pushed item will get; items with index >= ReadIndex() are still queued
+    uint64_t WriteIndex() const { return writeIndex.load(std::memory_order_relaxed); }
+
+    // Только поток-потребитель
+    size_t PopBatch(T* out, size_t maxItems) {
+        uint64_t tail = readIndex.load(std::memory_order_relaxed);
+        if (cachedWrite == tail) {
+            cachedWrite = writeIndex.load(std::memory_order_acquire);
+        }
+
+        size_t count = static_cast<size_t>((std::min)(cachedWrite - tail, static_cast<uint64_t>(maxItems)));
+        for (size_t i = 0; i < count; i++) {
+            out[i] = slots[(tail + i) & mask];
+        }
+        readIndex.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    uint64_t ReadIndex() const { return readIndex.load(std::memory_order_acquire); }
+
+    // Приблизительно: индексы читаются не атомарно вместе
+    size_t Size() const {
+        uint64_t tail = readIndex.load(std::memory_order_acquire);
+        uint64_t head = writeIndex.load(std::memory_order_acquire);
+        return head > tail ? static_cast<size_t>(head - tail) : 0;
+    }
+
+    void WakeConsumer() {
+        wakeSignal.fetch_add(1, std::memory_order_release);
+        wakeSignal.notify_one();
+    }
+
+    // Blocks the consumer until data is available or WakeConsumer is called
+    void WaitForData() {
+        uint32_t observed = wakeSignal.load(std::memory_order_acquire);
+        if (writeIndex.load(std::memory_order_acquire) != readIndex.load(std::memory_order_relaxed)) {
+            return;
+        }
+        wakeSignal.wait(observed, std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    const size_t mask;
+    const std::unique_ptr<T[]> slots;
+
+    alignas(CACHE_LINE) std::atomic<uint64_t> writeIndex{ 0 };
+    uint64_t cachedRead = 0;        // Копия readIndex у производителя
+
+    alignas(CACHE_LINE) std::atomic<uint64_t> readIndex{ 0 };
+    uint64_t cachedWrite = 0;       // Копия writeIndex у потребителя
+
+    alignas(CACHE_LINE) std::atomic<uint32_t> wakeSignal{ 0 };
+};
@@ -0,0 +1,236 @@
+// src/service/FlowTable.cpp
+#include "FlowTable.h"
+#include <algorithm>
+#include <bit>
+
+FlowTable::FlowTable(size_t maxFlows, int64_t ttlSeconds, int64_t now)
+    : maxFlows((std::max)(maxFlows, size_t{ 1 })),
+    ttl((std::max)(ttlSeconds, int64_t{ 1 })) {
+    // Колесо покрывает TTL целиком, поэтому любой дедлайн попадает в один оборот
+    tickSeconds = (std::max)((ttl + static_cast<int64_t>(WHEEL_SLOTS) - 2) / static_cast<int64_t>(WHEEL_SLOTS - 1), int64_t{ 1 });
+    currentTick = now / tickSeconds;
+    slots.resize(INITIAL_CAPACITY);
+    mask = INITIAL_CAPACITY - 1;
+}
+
+size_t FlowTable::Hash(const FlowKey& key) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 0x100000001B3ull;
+        hash ^= hash >> 29;
+    };
+
+    for (int i = 0; i < 4; i++) {
+        mix((static_cast<uint64_t>(key.remoteAddr[i]) << 32) | key.localAddr[i]);
+    }
+    mix((static_cast<uint64_t>(key.processId) << 32) | (static_cast<uint64_t>(key.localPort) << 16) | key.remotePort);
+    mix(key.protocol);
+    return static_cast<size_t>(hash);
+}
+
+size_t FlowTable::FindSlot(const FlowKey& key) const {
+    for (size_t index = Hash(key) & mask;; index = (index + 1) & mask) {
+        const Slot& slot = slots[index];
+        if (slot.state == SlotState::Empty) {
+            return npos;
+        }
+        if (slot.state == SlotState::Used && slot.key == key) {
+            return index;
+        }
+    }
+}
+
+void FlowTable::Upsert(const FlowKey& key, StringInterner::Id processName, int64_t now) {
+    // Держим заполнение (вместе с надгробиями) не выше 3/4
+    if ((liveCount + deletedCount + 1) * 4 > slots.size() * 3) {
+        Rehash((liveCount + 1) * 2 > slots.size() ? slots.size() * 2 : slots.size());
+    }
+
+    size_t firstDeleted = npos;
+    size_t index = Hash(key) & mask;
+    for (;; index = (index + 1) & mask) {
+        Slot& slot = slots[index];
+        if (slot.state == SlotState::Empty) {
+            break;
+        }
+        if (slot.state == SlotState::Deleted) {
+            if (firstDeleted == npos) firstDeleted = index;
+            continue;
+        }
+        if (slot.key == key) {
+            // Колесо не трогаем: устаревшая ссылка переложится при срабатывании
+            slot.lastSeen = static_cast<uint32_t>(now);
+            slot.processName = processName;
+            return;
+        }
+    }
+
+    if (liveCount >= maxFlows) {
+        EvictOldest();
+    }
+
+    size_t target = firstDeleted != npos ? firstDeleted : index;
+    Slot& slot = slots[target];
+    if (slot.state == SlotState::Deleted) {
+        deletedCount--;
+    }
+
+    slot.key = key;
+    slot.lastSeen = static_cast<uint32_t>(now);
+    slot.processName = processName;
+    slot.state = SlotState::Used;
+    liveCount++;
+    Schedule(target);
+}
+
+bool FlowTable::Erase(const FlowKey& key) {
+    size_t index = FindSlot(key);
+    if (index == npos) {
+        return false;
+    }
+    RemoveSlot(index);
+    return true;
+}
+
+void FlowTable::RemoveSlot(size_t index) {
+    Slot& slot = slots[index];
+    slot.state = SlotState::Deleted;
+    slot.generation++;
+    liveCount--;
+    deletedCount++;
+}
+
+void FlowTable::Schedule(size_t index) {
+    const Slot& slot = slots[index];
+    int64_t deadline = static_cast<int64_t>(slot.lastSeen) + ttl;
+    int64_t tick = (std::max)((deadline + tickSeconds - 1) / tickSeconds, currentTick + 1);
+
+    wheel[tick % WHEEL_SLOTS].push_back({ static_cast<uint32_t>(index), slot.generation });
+    wheelRefs++;
+}
+
+size_t FlowTable::Expire(int64_t now) {
+    int64_t targetTick = now / tickSeconds;
+    if (targetTick <= currentTick) {
+        return 0;
+    }
+
+    // После долгого перерыва достаточно одного оборота: каждый слот проверяется с текущим now
+    int64_t steps = (std::min)(targetTick - currentTick, static_cast<int64_t>(WHEEL_SLOTS));
+    currentTick = targetTick;
+
+    size_t removed = 0;
+    std::vector<WheelRef> fired;
+    for (int64_t tick = targetTick - steps + 1; tick <= targetTick; tick++) {
+        fired.clear();
+        fired.swap(wheel[tick % WHEEL_SLOTS]);
+        wheelRefs -= fired.size();
+
+        for (const WheelRef& ref : fired) {
+            const Slot& slot = slots[ref.index];
+            if (slot.state != SlotState::Used || slot.generation != ref.generation) continue;
+
+            if (static_cast<int64_t>(slot.lastSeen) + ttl <= now) {
+                RemoveSlot(ref.index);
+                removed++;
+            }
+            else {
+                Schedule(ref.index);
+            }
+        }
+
+        // Возвращаем буфер слоту, чтобы не аллоцировать его заново
+        if (wheel[tick % WHEEL_SLOTS].empty()) {
+            fired.clear();
+            fired.swap(wheel[tick % WHEEL_SLOTS]);
+        }
+    }
+
+    expiredTotal += removed;
+    return removed;
+}
+
+void FlowTable::EvictOldest() {
+    for (int64_t tick = currentTick + 1; tick <= currentTick + static_cast<int64_t>(WHEEL_SLOTS); tick++) {
+        auto& bucket = wheel[tick % WHEEL_SLOTS];
+        while (!bucket.empty()) {
+            WheelRef ref = bucket.back();
+            bucket.pop_back();
+            wheelRefs--;
+
+            const Slot& slot = slots[ref.index];
+            if (slot.state != SlotState::Used || slot.generation != ref.generation) continue;
+
+            // Ссылка отстала от lastSeen - flow использовался позже, перекладываем
+            int64_t deadline = static_cast<int64_t>(slot.lastSeen) + ttl;
+            int64_t dueTick = (std::max)((deadline + tickSeconds - 1) / tickSeconds, currentTick + 1);
+            if (dueTick % static_cast<int64_t>(WHEEL_SLOTS) != tick % static_cast<int64_t>(WHEEL_SLOTS)) {
+                Schedule(ref.index);
+                continue;
+            }
+
+            RemoveSlot(ref.index);
+            evictedTotal++;
+            return;
+        }
+    }
+}
+
+size_t FlowTable::Shrink(size_t targetFlows) {
+    size_t evicted = 0;
+    while (liveCount > targetFlows) {
+        size_t before = liveCount;
+        EvictOldest();
+        if (liveCount == before) break;
+        evicted++;
+    }
+
+    // Надгробия уходят при перестроении, заполнение после него не выше половины
+    size_t capacity = std::bit_ceil((std::max)(INITIAL_CAPACITY, (liveCount + 1) * 2));
+    if (capacity < slots.size() || deletedCount > 0) {
+        Rehash((std::min)(capacity, slots.size()));
+    }
+    for (auto& bucket : wheel) {
+        bucket.shrink_to_fit();
+    }
+    return evicted;
+}
+
+void FlowTable::Rehash(size_t newCapacity) {
+    std::vector<Slot> old(std::bit_ceil(newCapacity));
+    old.swap(slots);
+    mask = slots.size() - 1;
+    liveCount = 0;
+    deletedCount = 0;
+
+    for (auto& bucket : wheel) {
+        bucket.clear();
+    }
+    wheelRefs = 0;
+
+    for (const Slot& slot : old) {
+        if (slot.state != SlotState::Used) continue;
+
+        size_t index = Hash(slot.key) & mask;
+        while (slots[index].state != SlotState::Empty) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = slot;
+        liveCount++;
+        Schedule(index);
+    }
+}
+
+FlowTable::Stats FlowTable::GetStats() const {
+    Stats stats;
+    stats.flows = liveCount;
+    stats.capacity = slots.size();
+    stats.memoryBytes = slots.size() * sizeof(Slot);
+    for (const auto& bucket : wheel) {
+        stats.memoryBytes += bucket.capacity() * sizeof(WheelRef);
+    }
+    stats.expired = expiredTotal;
+    stats.evicted = evictedTotal;
+    return stats;
+}
@@ -0,0 +1,102 @@
+// src/service/FlowTable.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "StringInterner.h"
+
+// Полный ключ соединения: 5-tuple плюс pid. Адреса в порядке WinDivert (IPv4 как ::ffff:a.b.c.d).
+struct FlowKey {
+    uint32_t localAddr[4] = {};
+    uint32_t remoteAddr[4] = {};
+    uint32_t processId = 0;
+    uint16_t localPort = 0;
+    uint16_t remotePort = 0;
+    uint8_t protocol = 0;
+
+    bool operator==(const FlowKey&) const = default;
+};
+
+// Open-addressing (linear probing) table of tracked flows with idle expiry.
+// Entries hold only binary addresses and an interned process name, so a
+// flow costs one fixed-size slot and no heap allocation. Expiry uses a
+// single-level timing wheel spanning the idle TTL: each live flow has one
+// wheel reference, refreshing a flow only updates lastSeen and the stale
+// reference is re-placed when its bucket comes due. When the table is at
+// maxFlows the flows with the nearest deadlines are evicted one by one, so
+// neither expiry nor overflow ever sorts or scans the whole table.
+// There is no per-flow packet or byte accounting: NetworkMonitor listens on
+// the WinDivert FLOW layer, which reports flow establish/delete events but
+// never the packets themselves, so there is nothing to count.
+// Not thread-safe, the owner serializes access.
+class FlowTable {
+public:
+    struct Stats {
+        size_t flows = 0;
+        size_t capacity = 0;
+        size_t memoryBytes = 0;
+        uint64_t expired = 0;
+        uint64_t evicted = 0;
+    };
+
+    // now и lastSeen - секунды монотонных часов
+    FlowTable(size_t maxFlows, int64_t ttlSeconds, int64_t now);
+
+    // Вставляет flow или обновляет lastSeen существующего
+    void Upsert(const FlowKey& key, StringInterner::Id processName, int64_t now);
+    bool Erase(const FlowKey& key);
+
+    // Removes flows idle for at least the TTL, returns how many
+    size_t Expire(int64_t now);
+    // Вытесняет flows с ближайшими дедлайнами до targetFlows и отдаёт лишнюю ёмкость
+    // таблицы и колеса; возвращает, сколько вытеснено
+    size_t Shrink(size_t targetFlows);
+
+    size_t Size() const { return liveCount; }
+    Stats GetStats() const;
+
+private:
+    enum class SlotState : uint8_t { Empty, Used, Deleted };
+
+    struct Slot {
+        FlowKey key;
+        uint32_t generation = 0;        // Растёт при удалении, отсекает устаревшие ссылки колеса
+        uint32_t lastSeen = 0;
+        StringInterner::Id processName = StringInterner::OverflowId;
+        SlotState state = SlotState::Empty;
+    };
+    // Запись фиксированного размера без счётчиков трафика: 44 байта ключа и 12 служебных
+    static_assert(sizeof(Slot) == 56);
+
+    struct WheelRef {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    static constexpr size_t INITIAL_CAPACITY = 1024;
+    static constexpr size_t WHEEL_SLOTS = 64;
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t liveCount = 0;
+    size_t deletedCount = 0;
+    size_t maxFlows;
+
+    int64_t ttl;
+    int64_t tickSeconds;
+    int64_t currentTick;
+    std::vector<WheelRef> wheel[WHEEL_SLOTS];
+    size_t wheelRefs = 0;
+
+    uint64_t expiredTotal = 0;
+    uint64_t evictedTotal = 0;
+
+    static size_t Hash(const FlowKey& key);
+    size_t FindSlot(const FlowKey& key) const;     // npos, если нет
+    void RemoveSlot(size_t index);
+    void Schedule(size_t index);
+    void EvictOldest();
+    void Rehash(size_t newCapacity);
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+};
@@ -0,0 +1,450 @@
+// src/service/GatewayProber.cpp
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <icmpapi.h>
+#include "GatewayProber.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include "../common/ShutdownCoordinator.h"
+#include "../common/Utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <format>
+#include <utility>
+
+#pragma comment(lib, "iphlpapi.lib")
+
+namespace {
+    constexpr char PROBE_PAYLOAD[] = "RouteManagerProbe";
+    // Ответ, эхо данных, 8 байт ICMP-ошибки и запас под IO_STATUS_BLOCK
+    constexpr size_t REPLY_BUFFER_SIZE = sizeof(ICMP_ECHO_REPLY) + sizeof(PROBE_PAYLOAD) + 8 + 64;
+    // Драйвер сам завершает запрос по таймауту; сверх него ждём не дольше этого
+    constexpr DWORD COMPLETION_SLACK_MS = 500;
+
+    std::string ToLower(std::string value) {
+        std::ranges::transform(value, value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return value;
+    }
+
+    const char* PolicyName(GatewayPolicy policy) {
+        return policy == GatewayPolicy::LowestLatency ? "lowest latency" : "primary with failover";
+    }
+}
+
+GatewayProber::Probe::~Probe() {
+    if (event) {
+        CloseHandle(event);
+    }
+}
+
+void GatewayProber::Probe::Record(int rtt) {
+    if (window.empty()) return;
+    window[next] = rtt;
+    next = (next + 1) % window.size();
+    filled = (std::min)(filled + 1, window.size());
+}
+
+GatewayProber::GatewayProber(const std::string& primaryGateway, const GatewaySettings& initialSettings,
+    SwitchFunc onSwitch, ProcessListFunc processes)
+    : onSwitch(std::move(onSwitch)), processes(std::move(processes)), lastSwitch(std::chrono::steady_clock::now()) {
+    ApplyConfig(primaryGateway, initialSettings, true);
+}
+
+GatewayProber::~GatewayProber() {
+    Stop();
+}
+
+bool GatewayProber::Start() {
+    if (probeThread.joinable()) return true;
+
+    icmp = IcmpCreateFile();
+    if (icmp == INVALID_HANDLE_VALUE) {
+        Logger::Instance().Error(std::format("GatewayProber::Start - IcmpCreateFile failed: {}", ::GetLastError()));
+        return false;
+    }
+
+    probeThread = std::jthread([this](std::stop_token token) { ProbeThreadFunc(token); });
+    return true;
+}
+
+void GatewayProber::Stop() {
+    if (probeThread.joinable()) {
+        probeThread.request_stop();
+        probeThread.join();
+    }
+
+    // Буферы ответов должны пережить запросы в полёте, а те завершаются по таймауту драйвера
+    std::vector<HANDLE> pending;
+    for (const auto* list : { &probes, &draining }) {
+        for (const auto& probe : *list) {
+            if (probe->inFlight) pending.push_back(probe->event);
+        }
+    }
+    if (!pending.empty()) {
+        WaitForMultipleObjects(static_cast<DWORD>(pending.size()), pending.data(), TRUE,
+            static_cast<DWORD>((std::max)(settings.probeTimeoutMs, 100)) + COMPLETION_SLACK_MS);
+    }
+    draining.clear();
+
+    if (icmp != INVALID_HANDLE_VALUE) {
+        IcmpCloseHandle(icmp);
+        icmp = INVALID_HANDLE_VALUE;
+    }
+}
+
+void GatewayProber::UpdateConfig(const std::string& primaryGateway, const GatewaySettings& newSettings) {
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        pendingPrimary = primaryGateway;
+        pendingSettings = newSettings;
+        configPending = true;
+    }
+    wakeCV.notify_all();
+}
+
+void GatewayProber::ApplyConfig(const std::string& primaryGateway, const GatewaySettings& newSettings, bool primaryChanged) {
+    std::vector<std::string> pool;
+    auto addGateway = [&pool](const std::string& ip) {
+        if (!Utils::IsValidIPv4(ip)) {
+            Logger::Instance().Warning(std::format("GatewayProber - Ignoring invalid gateway '{}'", ip));
+            return;
+        }
+        if (std::ranges::find(pool, ip) != pool.end()) return;
+        if (pool.size() >= Constants::GATEWAY_POOL_MAX) {
+            Logger::Instance().Warning(std::format("GatewayProber - Pool is limited to {} gateways, ignoring {}",
+                Constants::GATEWAY_POOL_MAX, ip));
+            return;
+        }
+        pool.push_back(ip);
+    };
+    addGateway(primaryGateway);
+    for (const auto& ip : newSettings.additionalGateways) {
+        addGateway(ip);
+    }
+
+    std::string activeIp = primaryChanged || probes.empty() ? std::string() : probes[activeIndex]->ip;
+    size_t windowSize = static_cast<size_t>(std::clamp(newSettings.windowSize, Constants::GATEWAY_MIN_SAMPLES, 1000));
+
+    // Уже известные шлюзы сохраняют окно, новые начинают здоровыми и без проб
+    std::vector<std::unique_ptr<Probe>> rebuilt;
+    for (const auto& ip : pool) {
+        auto it = std::ranges::find_if(probes, [&ip](const auto& probe) { return probe && probe->ip == ip; });
+        std::unique_ptr<Probe> probe;
+        if (it != probes.end()) {
+            probe = std::move(*it);
+        }
+        else {
+            probe = std::make_unique<Probe>();
+            probe->ip = ip;
+            probe->address = inet_addr(ip.c_str());
+            probe->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+            probe->reply.resize(REPLY_BUFFER_SIZE);
+        }
+        if (probe->window.size() != windowSize) {
+            probe->window.assign(windowSize, -1);
+            probe->next = 0;
+            probe->filled = 0;
+        }
+        rebuilt.push_back(std::move(probe));
+    }
+    for (auto& removed : probes) {
+        if (removed && removed->inFlight) {
+            draining.push_back(std::move(removed));
+        }
+    }
+    probes = std::move(rebuilt);
+
+    std::string switchTo;
+    auto active = std::ranges::find_if(probes, [&activeIp](const auto& probe) { return probe->ip == activeIp; });
+    if (active != probes.end()) {
+        activeIndex = static_cast<size_t>(active - probes.begin());
+    }
+    else {
+        activeIndex = 0;
+        // Активный шлюз убран из пула - маршруты уходят на основной
+        if (!activeIp.empty() && !probes.empty()) {
+            switchTo = probes.front()->ip;
+            lastSwitch = std::chrono::steady_clock::now();
+        }
+    }
+
+    settings = newSettings;
+    for (auto& rule : settings.processPolicies) {
+        rule.process = ToLower(rule.process);
+    }
+    nextPolicyRefresh = {};
+
+    Logger::Instance().Info(std::format("GatewayProber - Pool of {} gateways, default policy: {}",
+        probes.size(), PolicyName(settings.policy)));
+
+    if (!switchTo.empty() && onSwitch) {
+        Logger::Instance().Warning(std::format("Active gateway {} left the pool, switching to {}", activeIp, switchTo));
+        onSwitch(switchTo);
+    }
+}
+
+void GatewayProber::ProbeThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("GatewayProber thread started");
+
+    try {
+        while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+            std::string primary;
+            GatewaySettings newSettings;
+            bool reconfigure = false;
+            {
+                std::lock_guard<std::mutex> lock(configMutex);
+                if (std::exchange(configPending, false)) {
+                    primary = pendingPrimary;
+                    newSettings = pendingSettings;
+                    reconfigure = true;
+                }
+            }
+            if (reconfigure) {
+                bool primaryChanged = probes.empty() || probes.front()->ip != primary;
+                ApplyConfig(primary, newSettings, primaryChanged);
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now >= nextPolicyRefresh) {
+                nextPolicyRefresh = now + Constants::GATEWAY_POLICY_REFRESH;
+                GatewayPolicy resolved = ResolvePolicy();
+                if (resolved != policy) {
+                    Logger::Instance().Info(std::format("Gateway policy: {} -> {}", PolicyName(policy), PolicyName(resolved)));
+                    policy = resolved;
+                }
+            }
+
+            ProbeRound();
+            Evaluate();
+            ReapDraining();
+            PublishGauges();
+
+            std::unique_lock<std::mutex> lock(configMutex);
+            wakeCV.wait_for(lock, stopToken, std::chrono::milliseconds((std::max)(settings.probeIntervalMs, 100)),
+                [this] { return configPending; });
+        }
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("GatewayProber thread exception: {}", e.what()));
+    }
+
+    Logger::Instance().Info("GatewayProber thread exiting");
+}
+
+void GatewayProber::ProbeRound() {
+    PERF_TIMER("GatewayProber::ProbeRound");
+
+    DWORD timeout = static_cast<DWORD>((std::max)(settings.probeTimeoutMs, 100));
+    std::vector<HANDLE> waits;
+    waits.reserve(probes.size());
+
+    // Все шлюзы опрашиваются одновременно: раунд длится не дольше одного таймаута
+    for (auto& probe : probes) {
+        if (!probe->event) continue;
+        if (probe->inFlight) {
+            // Прошлый запрос ещё не завершился - новый в тот же буфер не шлём
+            probe->Record(-1);
+            waits.push_back(probe->event);
+            continue;
+        }
+
+        ResetEvent(probe->event);
+        DWORD sent = IcmpSendEcho2(icmp, probe->event, nullptr, nullptr, probe->address,
+            const_cast<char*>(PROBE_PAYLOAD), static_cast<WORD>(sizeof(PROBE_PAYLOAD)), nullptr,
+            probe->reply.data(), static_cast<DWORD>(probe->reply.size()), timeout);
+        if (sent == 0 && ::GetLastError() != ERROR_IO_PENDING) {
+            probe->Record(-1);
+            continue;
+        }
+
+        probe->inFlight = true;
+        probe->overdue = false;
+        waits.push_back(probe->event);
+    }
+
+    if (waits.empty()) return;
+    WaitForMultipleObjects(static_cast<DWORD>(waits.size()), waits.data(), TRUE, timeout + COMPLETION_SLACK_MS);
+
+    for (auto& probe : probes) {
+        if (!probe->inFlight) continue;
+
+        if (WaitForSingleObject(probe->event, 0) != WAIT_OBJECT_0) {
+            if (!probe->overdue) {
+                probe->overdue = true;
+                probe->Record(-1);
+            }
+            continue;
+        }
+
+        probe->inFlight = false;
+        if (probe->overdue) continue;
+
+        const auto* reply = reinterpret_cast<const ICMP_ECHO_REPLY*>(probe->reply.data());
+        if (IcmpParseReplies(probe->reply.data(), static_cast<DWORD>(probe->reply.size())) > 0 &&
+            reply->Status == IP_SUCCESS) {
+            probe->Record(static_cast<int>(reply->RoundTripTime));
+        }
+        else {
+            probe->Record(-1);
+        }
+    }
+}
+
+void GatewayProber::UpdateHealth(Probe& probe) const {
+    // Окно обходим от старых проб к новым: джиттер считается по соседним ответам
+    size_t start = probe.filled < probe.window.size() ? 0 : probe.next;
+    int received = 0;
+    int lost = 0;
+    double rttSum = 0;
+    double jitterSum = 0;
+    int jitterCount = 0;
+    int previous = -1;
+    for (size_t i = 0; i < probe.filled; i++) {
+        int rtt = probe.window[(start + i) % probe.window.size()];
+        if (rtt < 0) {
+            lost++;
+            continue;
+        }
+        received++;
+        rttSum += rtt;
+        if (previous >= 0) {
+            jitterSum += std::abs(rtt - previous);
+            jitterCount++;
+        }
+        previous = rtt;
+    }
+
+    probe.lossPercent = probe.filled > 0 ? static_cast<int>(lost * 100 / probe.filled) : 0;
+    probe.rttMs = received > 0 ? rttSum / received : 0;
+    probe.jitterMs = jitterCount > 0 ? jitterSum / jitterCount : 0;
+
+    if (probe.filled < static_cast<size_t>(Constants::GATEWAY_MIN_SAMPLES)) return;
+
+    bool degraded = received == 0 || probe.lossPercent > settings.maxLossPercent ||
+        (settings.maxRttMs > 0 && probe.rttMs > settings.maxRttMs);
+    if (degraded != probe.healthy) {
+        probe.streak = 0;
+        return;
+    }
+
+    if (++probe.streak < Constants::GATEWAY_HEALTH_HOLD_PROBES) return;
+    probe.streak = 0;
+    probe.healthy = !degraded;
+
+    PERF_COUNT("Gateway.HealthChanged");
+    Logger::Instance().Warning(std::format("Gateway {} is {}: rtt {:.1f}ms, jitter {:.1f}ms, loss {}%",
+        probe.ip, probe.healthy ? "healthy again" : "degraded", probe.rttMs, probe.jitterMs, probe.lossPercent));
+}
+
+size_t GatewayProber::Select(std::chrono::steady_clock::time_point now) const {
+    const Probe& current = *probes[activeIndex];
+    bool dwellElapsed = now - lastSwitch >= std::chrono::seconds(settings.minDwellSec);
+
+    if (policy == GatewayPolicy::LowestLatency) {
+        auto score = [](const Probe& probe) { return probe.rttMs + probe.jitterMs; };
+        auto measured = [](const Probe& probe) {
+            return probe.filled >= static_cast<size_t>(Constants::GATEWAY_MIN_SAMPLES);
+        };
+
+        size_t fastest = probes.size();
+        for (size_t i = 0; i < probes.size(); i++) {
+            const Probe& probe = *probes[i];
+            if (!probe.healthy || !measured(probe)) continue;
+            if (fastest == probes.size() || score(probe) < score(*probes[fastest])) {
+                fastest = i;
+            }
+        }
+
+        // Пока задержки не измерены, выбираем как failover
+        if (fastest < probes.size()) {
+            if (!current.healthy) return fastest;
+            if (fastest != activeIndex && dwellElapsed && measured(current) &&
+                score(*probes[fastest]) + settings.switchMarginMs < score(current)) {
+                return fastest;
+            }
+            return activeIndex;
+        }
+    }
+
+    size_t preferred = activeIndex;
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (probes[i]->healthy) {
+            preferred = i;
+            break;
+        }
+    }
+
+    // С упавшего шлюза уходим сразу, на более приоритетный возвращаемся после minDwellSec
+    if (preferred != activeIndex && (!current.healthy || dwellElapsed)) {
+        return preferred;
+    }
+    return activeIndex;
+}
+
+void GatewayProber::Evaluate() {
+    if (probes.empty()) return;
+
+    for (auto& probe : probes) {
+        UpdateHealth(*probe);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    size_t selected = Select(now);
+    if (selected == activeIndex) return;
+
+    std::string previous = probes[activeIndex]->ip;
+    activeIndex = selected;
+    lastSwitch = now;
+
+    const Probe& next = *probes[selected];
+    PERF_COUNT("Gateway.Switches");
+    Logger::Instance().Warning(std::format("Switching gateway {} -> {} ({}): rtt {:.1f}ms, jitter {:.1f}ms, loss {}%",
+        previous, next.ip, PolicyName(policy), next.rttMs, next.jitterMs, next.lossPercent));
+
+    if (onSwitch) {
+        onSwitch(next.ip);
+    }
+}
+
+GatewayPolicy GatewayProber::ResolvePolicy() const {
+    if (!processes) return settings.policy;
+
+    // Правило процесса важнее автоопределения; LowestLatency любого запущенного процесса действует на весь пул
+    for (const auto& process : processes()) {
+        if (!process.isSelected) continue;
+
+        std::string name = ToLower(Utils::WStringToString(process.name));
+        auto rule = std::ranges::find(settings.processPolicies, name, &GatewayPolicyRule::process);
+        if (rule != settings.processPolicies.end()) {
+            if (rule->policy == GatewayPolicy::LowestLatency) return GatewayPolicy::LowestLatency;
+            continue;
+        }
+
+        if (settings.latencySensitiveFastest && (process.isGame || process.isDiscord)) {
+            return GatewayPolicy::LowestLatency;
+        }
+    }
+
+    return settings.policy;
+}
+
+void GatewayProber::ReapDraining() {
+    std::erase_if(draining, [](const auto& probe) {
+        return WaitForSingleObject(probe->event, 0) == WAIT_OBJECT_0;
+        });
+}
+
+void GatewayProber::PublishGauges() const {
+    auto& monitor = PerformanceMonitor::Instance();
+    for (size_t i = 0; i < probes.size(); i++) {
+        const Probe& probe = *probes[i];
+        monitor.SetGauge(std::format("Gateway.{}.RttUs", probe.ip), static_cast<uint64_t>(probe.rttMs * 1000));
+        monitor.SetGauge(std::format("Gateway.{}.JitterUs", probe.ip), static_cast<uint64_t>(probe.jitterMs * 1000));
+        monitor.SetGauge(std::format("Gateway.{}.LossPercent", probe.ip), static_cast<uint64_t>(probe.lossPercent));
+        monitor.SetGauge(std::format("Gateway.{}.Active", probe.ip), i == activeIndex ? 1 : 0);
+    }
+}
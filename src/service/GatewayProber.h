@@ -0,0 +1,95 @@
+// src/service/GatewayProber.h
+#pragma once
+#include <winsock2.h>
+#include <windows.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../common/Models.h"
+
+// Health prober for the gateway pool. One thread sends an ICMP echo to every
+// gateway per interval, all in flight at once, and keeps RTT, loss and jitter
+// over a sliding window. A gateway changes state only after several probes in
+// a row agree, and the active gateway changes only when the policy's choice
+// differs: on failure at once, for a better gateway after minDwellSec and, for
+// LowestLatency, only if it is faster by switchMarginMs. The switch itself is
+// reported through the callback; routes move through RouteController's
+// programming queue. The policy in force is re-resolved from the running
+// selected processes every GATEWAY_POLICY_REFRESH.
+class GatewayProber {
+public:
+    using SwitchFunc = std::function<void(const std::string& gatewayIp)>;
+    using ProcessListFunc = std::function<std::vector<ProcessInfo>()>;
+
+    GatewayProber(const std::string& primaryGateway, const GatewaySettings& settings,
+        SwitchFunc onSwitch, ProcessListFunc processes);
+    ~GatewayProber();
+
+    GatewayProber(const GatewayProber&) = delete;
+    GatewayProber& operator=(const GatewayProber&) = delete;
+
+    bool Start();
+    void Stop();
+    // Применяется потоком проб между раундами; смена основного шлюза делает его активным
+    void UpdateConfig(const std::string& primaryGateway, const GatewaySettings& settings);
+
+private:
+    struct Probe {
+        std::string ip;
+        uint32_t address = 0;               // network order
+        HANDLE event = nullptr;
+        std::vector<uint8_t> reply;         // Буфер IcmpSendEcho2, живёт, пока запрос в полёте
+        bool inFlight = false;
+        bool overdue = false;               // Уже засчитан потерей, ответ не учитываем
+        std::vector<int> window;            // RTT в мс, -1 - потеря; кольцо на windowSize
+        size_t next = 0;
+        size_t filled = 0;
+        int streak = 0;                     // Проб подряд, противоречащих текущему состоянию
+        // Итог по окну
+        double rttMs = 0;                   // Среднее по ответам
+        double jitterMs = 0;                // Среднее |RTT(i) - RTT(i-1)| соседних ответов
+        int lossPercent = 0;
+        bool healthy = true;
+
+        ~Probe();
+        void Record(int rttMs);
+    };
+
+    SwitchFunc onSwitch;
+    ProcessListFunc processes;
+
+    // Пул и статистика принадлежат потоку проб (и Stop после его завершения)
+    std::vector<std::unique_ptr<Probe>> probes;
+    std::vector<std::unique_ptr<Probe>> draining;   // Убраны из пула, но ответ ещё может прийти
+    size_t activeIndex = 0;
+    GatewaySettings settings;
+    GatewayPolicy policy = GatewayPolicy::PrimaryWithFailover;
+    std::chrono::steady_clock::time_point lastSwitch;
+    std::chrono::steady_clock::time_point nextPolicyRefresh;
+
+    // Новая конфигурация ждёт следующего раунда
+    std::mutex configMutex;
+    std::condition_variable_any wakeCV;
+    bool configPending = false;
+    std::string pendingPrimary;
+    GatewaySettings pendingSettings;
+
+    HANDLE icmp = INVALID_HANDLE_VALUE;
+    std::jthread probeThread;
+
+    void ProbeThreadFunc(std::stop_token stopToken);
+    void ApplyConfig(const std::string& primaryGateway, const GatewaySettings& newSettings, bool primaryChanged);
+    void ProbeRound();
+    void Evaluate();
+    void UpdateHealth(Probe& probe) const;
+    size_t Select(std::chrono::steady_clock::time_point now) const;
+    GatewayPolicy ResolvePolicy() const;
+    void ReapDraining();
+    void PublishGauges() const;
+};
@@ -0,0 +1,136 @@
+// src/service/IncrementalAggregator.cpp
+#include "IncrementalAggregator.h"
+#include "RoutePrefixIndex.h"
+#include <algorithm>
+#include <cmath>
+
+IncrementalAggregator::IncrementalAggregator() {
+    nodes.emplace_back();
+    thresholds.fill(-1.0f);
+}
+
+void IncrementalAggregator::Configure(int minHosts, const std::unordered_map<int, float>& wasteThresholds) {
+    thresholds.fill(-1.0f);
+    for (const auto& [prefixLength, threshold] : wasteThresholds) {
+        // /32 агрегировать некуда, как и в полном прогоне
+        if (prefixLength >= 0 && prefixLength < 32) {
+            thresholds[prefixLength] = threshold;
+        }
+    }
+    // Агрегат из одного маршрута ничего не экономит
+    minRoutes = static_cast<uint32_t>((std::max)(minHosts, 2));
+}
+
+uint32_t IncrementalAggregator::Allocate() {
+    if (!freeNodes.empty()) {
+        uint32_t index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = Node();
+        return index;
+    }
+    nodes.emplace_back();
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+bool IncrementalAggregator::Insert(uint32_t address, int prefixLength) {
+    if (prefixLength <= 0 || prefixLength > 32) return false;
+
+    std::array<uint32_t, 33> path;
+    uint32_t current = ROOT;
+    path[0] = current;
+    for (int depth = 0; depth < prefixLength; depth++) {
+        int bit = Bit(address, depth);
+        if (nodes[current].children[bit] == NONE) {
+            // Allocate может переложить пул, поэтому только индексы
+            uint32_t child = Allocate();
+            nodes[current].children[bit] = child;
+        }
+        current = nodes[current].children[bit];
+        path[depth + 1] = current;
+    }
+
+    if (nodes[current].isRoute) return false;
+
+    nodes[current].isRoute = true;
+    for (int depth = 0; depth <= prefixLength; depth++) {
+        nodes[path[depth]].routes++;
+    }
+    return true;
+}
+
+bool IncrementalAggregator::Erase(uint32_t address, int prefixLength) {
+    if (prefixLength <= 0 || prefixLength > 32) return false;
+
+    std::array<uint32_t, 33> path;
+    uint32_t current = ROOT;
+    path[0] = current;
+    for (int depth = 0; depth < prefixLength; depth++) {
+        current = nodes[current].children[Bit(address, depth)];
+        if (current == NONE) return false;
+        path[depth + 1] = current;
+    }
+
+    if (!nodes[current].isRoute) return false;
+
+    nodes[current].isRoute = false;
+    for (int depth = 0; depth <= prefixLength; depth++) {
+        nodes[path[depth]].routes--;
+    }
+
+    // Опустевшие узлы возвращаются в пул снизу вверх
+    for (int depth = prefixLength; depth > 0 && nodes[path[depth]].routes == 0; depth--) {
+        nodes[path[depth - 1]].children[Bit(address, depth - 1)] = NONE;
+        freeNodes.push_back(path[depth]);
+    }
+    return true;
+}
+
+void IncrementalAggregator::Clear() {
+    nodes.resize(1);
+    nodes[ROOT] = Node();
+    freeNodes.clear();
+}
+
+std::optional<IncrementalAggregator::Aggregate> IncrementalAggregator::FindAggregate(uint32_t address, int prefixLength) const {
+    if (prefixLength <= 0 || prefixLength > 32) return std::nullopt;
+
+    uint32_t current = ROOT;
+    for (int depth = 0; depth < prefixLength; depth++) {
+        const Node& node = nodes[current];
+        // Узел под установленным маршрутом уже покрыт
+        if (node.isRoute) return std::nullopt;
+
+        if (thresholds[depth] >= 0.0f && node.routes >= minRoutes) {
+            long double totalPossibleHosts = std::exp2l(32 - depth);
+            float wasteRatio = static_cast<float>((totalPossibleHosts - node.routes) / totalPossibleHosts);
+            if (wasteRatio <= thresholds[depth]) {
+                Aggregate aggregate;
+                aggregate.network = address & RoutePrefixIndex::MaskFor(depth);
+                aggregate.prefixLength = depth;
+                aggregate.covered.reserve(node.routes);
+                CollectRoutes(current, aggregate.network, depth, aggregate.covered);
+                return aggregate;
+            }
+        }
+
+        current = node.children[Bit(address, depth)];
+        if (current == NONE) return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+void IncrementalAggregator::CollectRoutes(uint32_t node, uint32_t network, int depth, std::vector<RouteKey>& out) const {
+    // Глубина поддерева не больше 32 - рекурсия ограничена
+    const Node& current = nodes[node];
+    if (current.isRoute) {
+        out.push_back(MakeRouteKey(network, depth));
+    }
+    if (depth >= 32) return;
+
+    if (current.children[0] != NONE) {
+        CollectRoutes(current.children[0], network, depth + 1, out);
+    }
+    if (current.children[1] != NONE) {
+        CollectRoutes(current.children[1], network | (1u << (31 - depth)), depth + 1, out);
+    }
+}
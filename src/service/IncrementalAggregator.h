@@ -0,0 +1,59 @@
+// src/service/IncrementalAggregator.h
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "RouteTable.h"
+
+// Persistent binary trie over the installed IPv4 routes, kept in step with
+// the route table on every insert and erase. Each node counts the routes in
+// its subtree, so after an insert the path to the new route (at most 32
+// nodes) is enough to tell whether some ancestor now passes its waste
+// threshold. The rules match RouteOptimizer::OptimizeRoutes: the shallowest
+// eligible ancestor wins, and nothing at or below an installed route is
+// aggregated. Nodes live in one pool with a free list. Not thread-safe; the
+// owner serializes access.
+class IncrementalAggregator {
+public:
+    struct Aggregate {
+        uint32_t network = 0;
+        int prefixLength = 0;
+        std::vector<RouteKey> covered;      // Маршруты поддерева в порядке обхода
+    };
+
+    IncrementalAggregator();
+
+    void Configure(int minHosts, const std::unordered_map<int, float>& wasteThresholds);
+
+    // false, если префикс уже есть или не отслеживается (длина 0 и больше 32)
+    bool Insert(uint32_t address, int prefixLength);
+    bool Erase(uint32_t address, int prefixLength);
+    void Clear();
+
+    // Агрегат, который стал выгоден с появлением маршрута address/prefixLength
+    std::optional<Aggregate> FindAggregate(uint32_t address, int prefixLength) const;
+
+    size_t RouteCount() const { return nodes[ROOT].routes; }
+    size_t NodeCount() const { return nodes.size() - freeNodes.size(); }
+
+private:
+    static constexpr uint32_t ROOT = 0;
+    static constexpr uint32_t NONE = 0;     // Корень ничьим ребёнком не бывает
+
+    struct Node {
+        uint32_t children[2] = { NONE, NONE };
+        uint32_t routes = 0;                // Маршрутов в поддереве, включая сам узел
+        bool isRoute = false;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::array<float, 33> thresholds;       // < 0 - на этой длине не агрегируем
+    uint32_t minRoutes = 2;
+
+    uint32_t Allocate();
+    void CollectRoutes(uint32_t node, uint32_t network, int depth, std::vector<RouteKey>& out) const;
+    static int Bit(uint32_t address, int depth) { return (address >> (31 - depth)) & 1; }
+};
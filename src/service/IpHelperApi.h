@@ -0,0 +1,34 @@
+// src/service/IpHelperApi.h
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+// IP Helper entry points the service calls, gathered in one table so the
+// benchmark harness can replace them with an in-memory routing table and run
+// without admin rights. The table is read without synchronization: fakes are
+// installed before any RouteController or DnsProxy is created.
+struct IpHelperApi {
+    decltype(&::CreateIpForwardEntry2) CreateIpForwardEntry2 = &::CreateIpForwardEntry2;
+    decltype(&::DeleteIpForwardEntry2) DeleteIpForwardEntry2 = &::DeleteIpForwardEntry2;
+    decltype(&::GetIpForwardEntry2) GetIpForwardEntry2 = &::GetIpForwardEntry2;
+    decltype(&::GetIpForwardTable2) GetIpForwardTable2 = &::GetIpForwardTable2;
+    decltype(&::FreeMibTable) FreeMibTable = &::FreeMibTable;
+    decltype(&::CreateIpForwardEntry) CreateIpForwardEntry = &::CreateIpForwardEntry;
+    decltype(&::DeleteIpForwardEntry) DeleteIpForwardEntry = &::DeleteIpForwardEntry;
+    decltype(&::GetBestInterface) GetBestInterface = &::GetBestInterface;
+    decltype(&::NotifyRouteChange2) NotifyRouteChange2 = &::NotifyRouteChange2;
+    decltype(&::NotifyIpInterfaceChange) NotifyIpInterfaceChange = &::NotifyIpInterfaceChange;
+    decltype(&::CancelMibChangeNotify2) CancelMibChangeNotify2 = &::CancelMibChangeNotify2;
+    decltype(&::GetExtendedTcpTable) GetExtendedTcpTable = &::GetExtendedTcpTable;
+    decltype(&::GetExtendedUdpTable) GetExtendedUdpTable = &::GetExtendedUdpTable;
+};
+
+namespace IpHelper {
+    inline IpHelperApi& Api() {
+        static IpHelperApi api;
+        return api;
+    }
+}
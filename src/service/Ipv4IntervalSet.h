@@ -0,0 +1,50 @@
+// src/service/Ipv4IntervalSet.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// IPv4 CIDR blocks merged into sorted, non-overlapping [first, last] address
+// ranges. Collect with Add(), call Build() once, then each containment query
+// is a binary search: filtering N routes against M aggregates costs
+// O((N + M) log M) instead of N x M mask compares. Starts and ends are kept
+// in separate arrays so the search only touches the starts.
+class Ipv4IntervalSet {
+public:
+    void Add(uint32_t network, int prefixLength) {
+        if (prefixLength < 0 || prefixLength > 32) return;
+        uint32_t span = prefixLength == 0 ? 0xFFFFFFFFu : (prefixLength == 32 ? 0 : (1u << (32 - prefixLength)) - 1);
+        uint32_t first = network & ~span;
+        pending.emplace_back(first, first + span);
+    }
+
+    void Build() {
+        std::ranges::sort(pending);
+        starts.clear();
+        ends.clear();
+        for (const auto& [first, last] : pending) {
+            // Соседние и пересекающиеся блоки склеиваются; last + 1 не переполняется при last < 0xFFFFFFFF
+            if (!ends.empty() && (ends.back() == 0xFFFFFFFFu || first <= ends.back() + 1)) {
+                ends.back() = (std::max)(ends.back(), last);
+                continue;
+            }
+            starts.push_back(first);
+            ends.push_back(last);
+        }
+        pending.clear();
+    }
+
+    bool Contains(uint32_t address) const {
+        auto it = std::upper_bound(starts.begin(), starts.end(), address);
+        if (it == starts.begin()) return false;
+        return address <= ends[(it - starts.begin()) - 1];
+    }
+
+    bool Empty() const { return starts.empty(); }
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> pending;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> ends;
+};
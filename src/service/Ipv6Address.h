@@ -0,0 +1,87 @@
+// src/service/Ipv6Address.h
+#pragma once
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// 128-bit address in host order as two 64-bit halves, cheap to mask,
+// compare and hash. Strings are produced only for logging and IPC.
+struct Ipv6Address {
+    uint64_t hi = 0;    // Старшие 64 бита (первые 8 байт адреса)
+    uint64_t lo = 0;
+
+    auto operator<=>(const Ipv6Address&) const = default;
+
+    // WinDivert хранит адрес словами в host order, младшее слово первым
+    static Ipv6Address FromWinDivert(const uint32_t words[4]) {
+        return { (static_cast<uint64_t>(words[3]) << 32) | words[2],
+                 (static_cast<uint64_t>(words[1]) << 32) | words[0] };
+    }
+
+    static Ipv6Address FromBytes(const uint8_t bytes[16]) {
+        Ipv6Address address;
+        for (int i = 0; i < 8; i++) {
+            address.hi = (address.hi << 8) | bytes[i];
+            address.lo = (address.lo << 8) | bytes[i + 8];
+        }
+        return address;
+    }
+
+    void ToBytes(uint8_t bytes[16]) const {
+        for (int i = 0; i < 8; i++) {
+            bytes[7 - i] = static_cast<uint8_t>(hi >> (i * 8));
+            bytes[15 - i] = static_cast<uint8_t>(lo >> (i * 8));
+        }
+    }
+
+    static bool Parse(const std::string& text, Ipv6Address& out) {
+        IN6_ADDR addr;
+        if (inet_pton(AF_INET6, text.c_str(), &addr) != 1) {
+            return false;
+        }
+        out = FromBytes(addr.u.Byte);
+        return true;
+    }
+
+    std::string ToString() const {
+        IN6_ADDR addr;
+        ToBytes(addr.u.Byte);
+        char buffer[INET6_ADDRSTRLEN];
+        if (!inet_ntop(AF_INET6, &addr, buffer, sizeof(buffer))) {
+            return {};
+        }
+        return buffer;
+    }
+
+    static constexpr Ipv6Address MaskFor(int prefixLength) {
+        if (prefixLength <= 0) return { 0, 0 };
+        if (prefixLength >= 128) return { ~0ull, ~0ull };
+        if (prefixLength <= 64) {
+            return { prefixLength == 64 ? ~0ull : ~((1ull << (64 - prefixLength)) - 1), 0 };
+        }
+        return { ~0ull, ~((1ull << (128 - prefixLength)) - 1) };
+    }
+
+    constexpr Ipv6Address Masked(int prefixLength) const {
+        Ipv6Address mask = MaskFor(prefixLength);
+        return { hi & mask.hi, lo & mask.lo };
+    }
+
+    // ::ffff:a.b.c.d - так WinDivert отдаёт IPv4-потоки
+    bool IsV4Mapped() const { return hi == 0 && (lo >> 32) == 0xFFFF; }
+    uint32_t MappedV4() const { return static_cast<uint32_t>(lo); }
+
+    // Только глобальный unicast (2000::/3) имеет смысл заворачивать в туннель
+    bool IsGlobalUnicast() const { return (hi >> 61) == 0x1; }
+};
+
+struct Ipv6AddressHash {
+    size_t operator()(const Ipv6Address& address) const {
+        uint64_t hash = address.hi * 0x9E3779B97F4A7C15ull;
+        hash ^= address.lo + 0x7F4A7C159E3779B9ull + (hash << 6) + (hash >> 2);
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
@@ -0,0 +1,103 @@
+// src/service/LogLinearHistogram.h
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Fixed-bucket log-linear (HDR-style) histogram: every power of two is split
+// into SUB_BUCKETS equal buckets, so a bucket is never wider than 1/8 of its
+// value. Recording is one bit_width and a few relaxed stores. A histogram has
+// a single writer - it uses load + store instead of read-modify-write - while
+// any thread may read it concurrently through MergeInto(). Values at or above
+// 2^MAX_BITS land in the last bucket.
+class LogLinearHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr uint64_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+    static constexpr int MAX_BITS = 40;                 // 2^40 нс - около 18 минут
+    static constexpr size_t BUCKETS = SUB_BUCKETS * (MAX_BITS - SUB_BUCKET_BITS + 1);
+
+    static constexpr size_t BucketFor(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        int shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        if (shift + SUB_BUCKET_BITS >= MAX_BITS) return BUCKETS - 1;
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1)));
+    }
+
+    // Наибольшее значение, попадающее в корзину
+    static constexpr uint64_t BucketUpperBound(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+        uint64_t low = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return low + (1ull << shift) - 1;
+    }
+
+    // Plain copy summed over several histograms; percentiles are read from it
+    struct Snapshot {
+        std::array<uint64_t, BUCKETS> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min = (std::numeric_limits<uint64_t>::max)();
+        uint64_t max = 0;
+
+        // Верхняя граница корзины, в которую попал ранг q * count, но не больше максимума
+        uint64_t Percentile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.999999);
+            if (rank == 0) rank = 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; i++) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    return (std::min)(BucketUpperBound(i), max);
+                }
+            }
+            return max;
+        }
+    };
+
+    void Record(uint64_t value) {
+        Bump(buckets[BucketFor(value)], 1);
+        Bump(count, 1);
+        Bump(sum, value);
+        if (value < min.load(std::memory_order_relaxed)) min.store(value, std::memory_order_relaxed);
+        if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+    }
+
+    void MergeInto(Snapshot& snapshot) const {
+        uint64_t recorded = count.load(std::memory_order_relaxed);
+        if (recorded == 0) return;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            snapshot.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.count += recorded;
+        snapshot.sum += sum.load(std::memory_order_relaxed);
+        snapshot.min = (std::min)(snapshot.min, min.load(std::memory_order_relaxed));
+        snapshot.max = (std::max)(snapshot.max, max.load(std::memory_order_relaxed));
+    }
+
+    // Запись, идущая одновременно со сбросом, может его пережить
+    void Clear() {
+        for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        min.store((std::numeric_limits<uint64_t>::max)(), std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> sum{ 0 };
+    std::atomic<uint64_t> min{ (std::numeric_limits<uint64_t>::max)() };
+    std::atomic<uint64_t> max{ 0 };
+
+    // Писатель один: без lock-префикса
+    static void Bump(std::atomic<uint64_t>& cell, uint64_t delta) {
+        cell.store(cell.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+};
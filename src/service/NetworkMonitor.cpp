@@ -3,6 +3,8 @@
 #include "RouteController.h"
 #include "ProcessManager.h"
 #include "PerformanceMonitor.h"
+#include "Ipv6Address.h"
+#include "TrafficCapture.h"
 #include "../common/Constants.h"
 #include "../common/Utils.h"
 #include "../common/Logger.h"
@@ -15,13 +17,90 @@
 #include <format>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
 
 #pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "WinDivert.lib")
 
-NetworkMonitor::NetworkMonitor(RouteController* rc, ProcessManager* pm)
-    : routeController(rc), processManager(pm),
-    divertHandle(INVALID_HANDLE_VALUE), running(false), active(false) {
+namespace {
+    // Драйвер отвергает значения вне своих пределов целиком, поэтому сначала зажимаем
+    void SetDivertParam(HANDLE handle, WINDIVERT_PARAM param, const char* name,
+        int value, int minValue, int maxValue) {
+        int clamped = std::clamp(value, minValue, maxValue);
+        if (clamped != value) {
+            Logger::Instance().Warning(std::format("WinDivert {} {} out of range, using {}", name, value, clamped));
+        }
+        if (!WinDivertSetParam(handle, param, static_cast<UINT64>(clamped))) {
+            Logger::Instance().Error(std::format("WinDivertSetParam({}) failed: {}", name, ::GetLastError()));
+        }
+    }
+
+    bool IsTrackedFlowEvent(const WINDIVERT_ADDRESS& addr) {
+        return addr.Layer == WINDIVERT_LAYER_FLOW &&
+            (addr.Event == WINDIVERT_EVENT_FLOW_ESTABLISHED || addr.Event == WINDIVERT_EVENT_FLOW_DELETED);
+    }
+
+    FlowRecord MakeFlowRecord(const WINDIVERT_ADDRESS& addr) {
+        FlowRecord record;
+        record.endpointId = addr.Flow.EndpointId;
+        record.timestamp = addr.Timestamp;
+        record.processId = addr.Flow.ProcessId;
+        std::copy(std::begin(addr.Flow.LocalAddr), std::end(addr.Flow.LocalAddr), record.localAddr);
+        std::copy(std::begin(addr.Flow.RemoteAddr), std::end(addr.Flow.RemoteAddr), record.remoteAddr);
+        record.localPort = addr.Flow.LocalPort;
+        record.remotePort = addr.Flow.RemotePort;
+        record.protocol = addr.Flow.Protocol;
+        record.event = static_cast<uint8_t>(addr.Event);
+        return record;
+    }
+
+    FlowKey MakeFlowKey(const FlowRecord& record) {
+        FlowKey key;
+        std::copy(std::begin(record.localAddr), std::end(record.localAddr), key.localAddr);
+        std::copy(std::begin(record.remoteAddr), std::end(record.remoteAddr), key.remoteAddr);
+        key.processId = record.processId;
+        key.localPort = record.localPort;
+        key.remotePort = record.remotePort;
+        key.protocol = record.protocol;
+        return key;
+    }
+
+    int64_t SteadySeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t MixKey(uint64_t hash, uint64_t value) {
+        hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    // Ключ назначения: также выбирает воркера, так что склейка по адресу видит все его события
+    uint64_t DestinationKey(const FlowRecord& record) {
+        uint64_t hash = 0;
+        for (uint32_t word : record.remoteAddr) {
+            hash = MixKey(hash, word);
+        }
+        return hash;
+    }
+
+    // Склейка по назначению учитывает процесс: событие невыбранного процесса к тому же адресу
+    // не должно поглотить событие выбранного, иначе его маршрут не появится
+    uint64_t ProcessDestinationKey(const FlowRecord& record) {
+        return MixKey(DestinationKey(record), record.processId);
+    }
+
+    uint64_t DuplicateKey(const FlowRecord& record) {
+        uint64_t hash = ProcessDestinationKey(record);
+        hash = MixKey(hash, (static_cast<uint64_t>(record.remotePort) << 8) | record.protocol);
+        return hash;
+    }
+}
+
+NetworkMonitor::NetworkMonitor(RouteController* rc, ProcessManager* pm, const MonitorSettings& settings)
+    : routeController(rc), processManager(pm), settings(settings),
+    divertHandle(INVALID_HANDLE_VALUE), running(false), active(false),
+    connections(MAX_CONNECTIONS, Constants::CONNECTION_CLEANUP_HOURS * 3600, SteadySeconds()) {
     Logger::Instance().Info("NetworkMonitor created");
 }
 
@@ -43,14 +122,34 @@ void NetworkMonitor::Start() {
 
     Logger::Instance().Info("WinDivert handle opened successfully");
 
-    WinDivertSetParam(divertHandle, WINDIVERT_PARAM_QUEUE_LENGTH, 32768);
-    WinDivertSetParam(divertHandle, WINDIVERT_PARAM_QUEUE_TIME, 1);
-    WinDivertSetParam(divertHandle, WINDIVERT_PARAM_QUEUE_SIZE, 16777216);
+    SetDivertParam(divertHandle, WINDIVERT_PARAM_QUEUE_LENGTH, "QUEUE_LENGTH", settings.queueLength,
+        WINDIVERT_PARAM_QUEUE_LENGTH_MIN, WINDIVERT_PARAM_QUEUE_LENGTH_MAX);
+    SetDivertParam(divertHandle, WINDIVERT_PARAM_QUEUE_TIME, "QUEUE_TIME", settings.queueTimeMs,
+        WINDIVERT_PARAM_QUEUE_TIME_MIN, WINDIVERT_PARAM_QUEUE_TIME_MAX);
+    SetDivertParam(divertHandle, WINDIVERT_PARAM_QUEUE_SIZE, "QUEUE_SIZE", settings.queueSizeBytes,
+        WINDIVERT_PARAM_QUEUE_SIZE_MIN, WINDIVERT_PARAM_QUEUE_SIZE_MAX);
 
     running.store(true, std::memory_order_release);
+
+    LARGE_INTEGER frequency;
+    qpcFrequency = QueryPerformanceFrequency(&frequency) ? frequency.QuadPart : 0;
+
+    int workerCount = std::clamp(settings.workerThreads, 1, Constants::FLOW_WORKER_MAX_THREADS);
+    int ringCapacity = std::clamp(settings.ringCapacity, 64, Constants::FLOW_RING_MAX_CAPACITY);
+    workers.clear();
+    for (int i = 0; i < workerCount; i++) {
+        workers.push_back(std::make_unique<FlowWorker>(static_cast<size_t>(ringCapacity)));
+    }
+    captureBatch.reserve(static_cast<size_t>(std::clamp(settings.recvBatchSize, 1, static_cast<int>(WINDIVERT_BATCH_MAX))));
+    for (auto& worker : workers) {
+        FlowWorker* w = worker.get();
+        w->thread = std::jthread([this, w](std::stop_token token) { FlowWorkerThreadFunc(token, *w); });
+    }
+
     monitorThread = std::thread(&NetworkMonitor::MonitorThreadFunc, this);
 
-    Logger::Instance().Info("NetworkMonitor started - monitoring FLOW events");
+    Logger::Instance().Info(std::format("NetworkMonitor started - monitoring FLOW events ({} workers, ring {}, batch {}, {} outstanding recvs)",
+        workerCount, workers.front()->ring.Capacity(), settings.recvBatchSize, settings.recvOutstanding));
 }
 
 void NetworkMonitor::Stop() {
@@ -78,64 +177,136 @@ void NetworkMonitor::Stop() {
         divertHandle = INVALID_HANDLE_VALUE;
     }
 
+    // jthread воркеров останавливается и присоединяется в деструкторе FlowWorker
+    workers.clear();
+
     Logger::Instance().Info("NetworkMonitor stopped");
 }
 
+void NetworkMonitor::ConfigureRecvThread() {
+    if (!SetThreadPriority(GetCurrentThread(), settings.recvThreadPriority)) {
+        Logger::Instance().Warning(std::format("Monitor thread: SetThreadPriority({}) failed: {}",
+            settings.recvThreadPriority, ::GetLastError()));
+    }
+
+    if (settings.recvAffinityMask != 0) {
+        if (!SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(settings.recvAffinityMask))) {
+            Logger::Instance().Warning(std::format("Monitor thread: SetThreadAffinityMask(0x{:x}) failed: {}",
+                settings.recvAffinityMask, ::GetLastError()));
+        }
+    }
+}
+
 void NetworkMonitor::MonitorThreadFunc() {
-    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
-    DWORD_PTR mask = 1;
-    SetThreadAffinityMask(GetCurrentThread(), mask);
+    ConfigureRecvThread();
+
+    // Несколько overlapped-приёмов в полёте: пока обрабатывается одна пачка,
+    // драйвер уже заполняет следующие. Пачки забираются строго по кругу.
+    struct RecvSlot {
+        OVERLAPPED overlapped{};
+        UniqueHandle event;
+        std::vector<WINDIVERT_ADDRESS> addrs;
+        UINT addrLen = 0;
+        bool pending = false;
+    };
+
+    const int batchSize = std::clamp(settings.recvBatchSize, 1, static_cast<int>(WINDIVERT_BATCH_MAX));
+    const int outstanding = std::clamp(settings.recvOutstanding, 1, Constants::FLOW_RECV_MAX_OUTSTANDING);
+
+    std::vector<RecvSlot> slots(outstanding);
+    for (auto& slot : slots) {
+        slot.event.reset(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+        slot.addrs.resize(batchSize);
+        if (!slot.event) {
+            Logger::Instance().Error(std::format("Monitor thread: CreateEvent failed: {}", ::GetLastError()));
+            return;
+        }
+    }
 
-    WINDIVERT_ADDRESS addr;
+    auto issueRecv = [this](RecvSlot& slot) -> DWORD {
+        ResetEvent(slot.event.get());
+        slot.overlapped = {};
+        slot.overlapped.hEvent = slot.event.get();
+        slot.addrLen = static_cast<UINT>(slot.addrs.size() * sizeof(WINDIVERT_ADDRESS));
+
+        // Синхронное завершение тоже сигналит событие, результат забираем одинаково
+        if (WinDivertRecvEx(divertHandle, nullptr, 0, nullptr, 0,
+            slot.addrs.data(), &slot.addrLen, &slot.overlapped)) {
+            slot.pending = true;
+            return ERROR_SUCCESS;
+        }
+
+        DWORD error = ::GetLastError();
+        slot.pending = (error == ERROR_IO_PENDING);
+        return slot.pending ? ERROR_SUCCESS : error;
+    };
+
+    // true - продолжать приём после ошибки
+    auto handleRecvError = [this](DWORD error) -> bool {
+        if (!running.load(std::memory_order_acquire) || ShutdownCoordinator::Instance().isShuttingDown) {
+            Logger::Instance().Info("Monitor thread: Shutdown detected during recv, exiting");
+            return false;
+        }
+
+        if (error == ERROR_NO_DATA) {
+            Logger::Instance().Info("Monitor thread: WinDivert handle shut down (ERROR_NO_DATA)");
+            return false;
+        }
+        else if (error == ERROR_INVALID_PARAMETER) {
+            Logger::Instance().Info("Monitor thread: WinDivert handle closed");
+            return false;
+        }
+        else if (error != ERROR_INSUFFICIENT_BUFFER) {
+            Logger::Instance().Error(std::format("WinDivertRecvEx failed: {}", error));
+            if (error == ERROR_INVALID_HANDLE) {
+                return false;
+            }
+        }
+        return true;
+    };
 
     active.store(true, std::memory_order_release);
     auto lastCleanup = std::chrono::steady_clock::now();
     auto lastStats = std::chrono::steady_clock::now();
-    int eventCount = 0;
+    auto lastSummary = std::chrono::steady_clock::now();
 
     Logger::Instance().Info("Monitor thread started - waiting for FLOW events");
 
-    while (running.load(std::memory_order_acquire) && !ShutdownCoordinator::Instance().isShuttingDown) {
-        UINT recvLen = 0;
+    bool keepRunning = true;
+    for (auto& slot : slots) {
+        DWORD error = issueRecv(slot);
+        if (error != ERROR_SUCCESS && !handleRecvError(error)) {
+            keepRunning = false;
+            break;
+        }
+    }
 
-        if (!WinDivertRecv(divertHandle, NULL, 0, &recvLen, &addr)) {
-            DWORD error = ::GetLastError();
+    size_t next = 0;
+    while (keepRunning && running.load(std::memory_order_acquire) && !ShutdownCoordinator::Instance().isShuttingDown) {
+        RecvSlot& slot = slots[next];
+        next = (next + 1) % slots.size();
 
-            if (!running.load(std::memory_order_acquire) || ShutdownCoordinator::Instance().isShuttingDown) {
-                Logger::Instance().Info("Monitor thread: Shutdown detected during recv, exiting");
-                break;
-            }
+        if (slot.pending) {
+            DWORD transferred = 0;
+            BOOL ok = GetOverlappedResult(divertHandle, &slot.overlapped, &transferred, TRUE);
+            slot.pending = false;
 
-            if (error == ERROR_NO_DATA) {
-                Logger::Instance().Info("Monitor thread: WinDivert handle shut down (ERROR_NO_DATA)");
-                break;
-            }
-            else if (error == ERROR_INVALID_PARAMETER) {
-                Logger::Instance().Info("Monitor thread: WinDivert handle closed");
-                break;
+            if (!ok) {
+                if (!handleRecvError(::GetLastError())) break;
             }
-            else if (error != ERROR_INSUFFICIENT_BUFFER) {
-                Logger::Instance().Error(std::format("WinDivertRecv failed: {}", error));
-                if (error == ERROR_INVALID_HANDLE) {
+            else {
+                if (!running.load(std::memory_order_acquire) || ShutdownCoordinator::Instance().isShuttingDown) {
+                    Logger::Instance().Info("Monitor thread: Shutdown detected after recv, exiting");
                     break;
                 }
-            }
-            continue;
-        }
 
-        if (!running.load(std::memory_order_acquire) || ShutdownCoordinator::Instance().isShuttingDown) {
-            Logger::Instance().Info("Monitor thread: Shutdown detected after recv, exiting");
-            break;
-        }
-
-        if (addr.Layer == WINDIVERT_LAYER_FLOW) {
-            if (addr.Event == WINDIVERT_EVENT_FLOW_ESTABLISHED ||
-                addr.Event == WINDIVERT_EVENT_FLOW_DELETED) {
-                eventCount++;
-                if (eventCount <= 10 || eventCount % 100 == 0) {
-                    Logger::Instance().Info(std::format("Processing FLOW event #{}", eventCount));
+                size_t count = slot.addrLen / sizeof(WINDIVERT_ADDRESS);
+                PERF_COUNT("NetworkMonitor.Recv.Batches");
+                // Полная пачка означает, что в очереди драйвера остались события - прокси отставания
+                if (count == slot.addrs.size()) {
+                    PERF_COUNT("NetworkMonitor.Recv.FullBatches");
                 }
-                ProcessFlowEvent(addr);
+                DispatchBatch(slot.addrs.data(), count);
             }
         }
 
@@ -146,135 +317,298 @@ void NetworkMonitor::MonitorThreadFunc() {
             lastCleanup = now;
         }
 
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - lastSummary).count() >= Constants::FLOW_SUMMARY_INTERVAL_SEC) {
+            LogFlowSummary();
+            lastSummary = now;
+        }
+
         if (std::chrono::duration_cast<std::chrono::minutes>(now - lastStats).count() >= 5) {
             LogPerformanceStats();
             lastStats = now;
         }
+
+        DWORD error = issueRecv(slot);
+        if (error != ERROR_SUCCESS && !handleRecvError(error)) break;
+    }
+
+    // Буферы слотов принадлежат драйверу, пока приём не завершён: отменяем и дожидаемся
+    CancelIoEx(divertHandle, nullptr);
+    for (auto& slot : slots) {
+        if (slot.pending) {
+            DWORD transferred = 0;
+            GetOverlappedResult(divertHandle, &slot.overlapped, &transferred, TRUE);
+            slot.pending = false;
+        }
     }
 
     active.store(false, std::memory_order_release);
-    Logger::Instance().Info(std::format("Monitor thread exiting cleanly after processing {} events", eventCount));
+    Logger::Instance().Info(std::format("Monitor thread exiting cleanly after processing {} events ({} dropped)",
+        eventCount.load(std::memory_order_relaxed), droppedEvents.load(std::memory_order_relaxed)));
 }
 
-void NetworkMonitor::ProcessFlowEvent(const WINDIVERT_ADDRESS& addr) {
-    PERF_TIMER("NetworkMonitor::ProcessFlowEvent");
+void NetworkMonitor::DispatchBatch(const WINDIVERT_ADDRESS* addrs, size_t count) {
+    const size_t workerCount = workers.size();
+    uint64_t dropped = 0;
+    uint64_t coalesced = 0;
+
+    // Запись трафика видит события до склейки и сброса: воспроизведение повторяет вход, а не итог
+    TrafficCapture& capture = TrafficCapture::Instance();
+    bool capturing = capture.IsRecording();
+    captureBatch.clear();
+
+    // Отслеживаем только кольца, в которые что-то попало, и будим их потребителей один раз
+    uint64_t touched = 0;
+    for (size_t i = 0; i < count; i++) {
+        const WINDIVERT_ADDRESS& addr = addrs[i];
+        if (!IsTrackedFlowEvent(addr)) continue;
+
+        FlowRecord record = MakeFlowRecord(addr);
+        if (capturing) {
+            captureBatch.push_back(record);
+        }
+        size_t index = static_cast<size_t>(DestinationKey(record) % workerCount);
+        FlowWorker& worker = *workers[index];
 
-    auto eventStartTime = std::chrono::high_resolution_clock::now();
+        size_t occupancy = static_cast<size_t>(worker.ring.WriteIndex() - worker.ring.ReadIndex());
+        if (ShouldCoalesce(worker, record, occupancy)) {
+            coalesced++;
+            continue;
+        }
 
-    bool isSelected = processManager->IsSelectedProcessByPid(addr.Flow.ProcessId);
-    if (!isSelected) {
-        PERF_COUNT("NetworkMonitor.FlowEvent.Filtered");
-        return;
+        uint64_t sequence = worker.ring.WriteIndex();
+        if (!worker.ring.TryPush(record)) {
+            dropped++;
+            continue;
+        }
+
+        if (record.event == WINDIVERT_EVENT_FLOW_ESTABLISHED) {
+            uint64_t key = settings.backpressure == FlowBackpressure::DropDuplicates ?
+                DuplicateKey(record) : ProcessDestinationKey(record);
+            worker.recent[key & (Constants::FLOW_RECENT_SLOTS - 1)] = { key, sequence + 1 };
+        }
+        worker.highWater = (std::max)(worker.highWater, occupancy + 1);
+        touched |= 1ull << index;
+    }
+
+    if (capturing) {
+        capture.RecordFlows(captureBatch);
     }
 
-    auto cachedInfo = processManager->GetCachedInfo(addr.Flow.ProcessId);
-    std::string processName = cachedInfo.has_value() ?
-        Utils::WStringToString(cachedInfo->name) : "Unknown";
+    size_t maxOccupancy = 0;
+    size_t highWater = 0;
+    for (size_t w = 0; w < workerCount; w++) {
+        FlowWorker& worker = *workers[w];
+        if (touched & (1ull << w)) {
+            worker.ring.WakeConsumer();
+        }
+        maxOccupancy = (std::max)(maxOccupancy, worker.ring.Size());
+        highWater = (std::max)(highWater, worker.highWater);
+    }
 
-    thread_local char localStr[INET6_ADDRSTRLEN];
-    thread_local char remoteStr[INET6_ADDRSTRLEN];
+    PerformanceMonitor::Instance().SetGauge("NetworkMonitor.Ring.Occupancy", maxOccupancy);
+    PerformanceMonitor::Instance().SetGauge("NetworkMonitor.Ring.HighWater", highWater);
 
-    WinDivertHelperFormatIPv6Address(addr.Flow.LocalAddr, localStr, sizeof(localStr));
-    WinDivertHelperFormatIPv6Address(addr.Flow.RemoteAddr, remoteStr, sizeof(remoteStr));
+    if (coalesced > 0) {
+        uint64_t total = coalescedEvents.fetch_add(coalesced, std::memory_order_relaxed) + coalesced;
+        PerformanceMonitor::Instance().SetGauge("NetworkMonitor.Ring.Coalesced", total);
+    }
+    if (dropped > 0) {
+        uint64_t total = droppedEvents.fetch_add(dropped, std::memory_order_relaxed) + dropped;
+        PerformanceMonitor::Instance().SetGauge("NetworkMonitor.Ring.Dropped", total);
+        Logger::Instance().Warning(std::format("Flow rings full, dropped {} events ({} total)", dropped, total));
+    }
+}
 
-    std::string remoteIp = remoteStr;
+bool NetworkMonitor::ShouldCoalesce(FlowWorker& worker, const FlowRecord& record, size_t occupancy) {
+    // DELETED не склеиваем: по ним чистится таблица соединений
+    if (settings.backpressure == FlowBackpressure::DropNewest ||
+        record.event != WINDIVERT_EVENT_FLOW_ESTABLISHED) {
+        return false;
+    }
 
-    if (remoteIp.starts_with("::ffff:")) {
-        remoteIp = remoteIp.substr(7);
+    size_t threshold = worker.ring.Capacity() * static_cast<size_t>(std::clamp(settings.ringPressurePercent, 0, 100)) / 100;
+    if (occupancy < threshold) {
+        return false;
     }
-    else if (remoteIp.contains(':')) {
-        PERF_COUNT("NetworkMonitor.FlowEvent.IPv6Skipped");
-        Logger::Instance().Debug(std::format("Skipping IPv6 address: {} for process: {}", remoteIp, processName));
+
+    uint64_t key = settings.backpressure == FlowBackpressure::DropDuplicates ?
+        DuplicateKey(record) : ProcessDestinationKey(record);
+    const RecentDestination& recent = worker.recent[key & (Constants::FLOW_RECENT_SLOTS - 1)];
+
+    // Запись с тем же ключом ещё не забрана воркером - новая ничего не добавит
+    return recent.key == key && recent.sequence > worker.ring.ReadIndex();
+}
+
+void NetworkMonitor::FlowWorkerThreadFunc(std::stop_token stopToken, FlowWorker& worker) {
+    std::stop_callback wake(stopToken, [&worker] { worker.ring.WakeConsumer(); });
+    std::array<FlowRecord, Constants::FLOW_WORKER_POP_BATCH> batch;
+
+    while (!stopToken.stop_requested()) {
+        size_t count = worker.ring.PopBatch(batch.data(), batch.size());
+        if (count == 0) {
+            worker.ring.WaitForData();
+            continue;
+        }
+
+        LARGE_INTEGER qpcNow;
+        QueryPerformanceCounter(&qpcNow);
+
+        for (size_t i = 0; i < count; i++) {
+            if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) break;
+
+            const FlowRecord& record = batch[i];
+            eventCount.fetch_add(1, std::memory_order_relaxed);
+            PERF_COUNT("NetworkMonitor.Recv.Events");
+
+            // Время от захвата драйвером до классификации, без учёта программирования маршрута
+            if (qpcFrequency > 0 && record.timestamp > 0 && qpcNow.QuadPart > record.timestamp) {
+                PERF_RECORD("NetworkMonitor.CaptureLatency",
+                    std::chrono::microseconds((qpcNow.QuadPart - record.timestamp) * 1000000 / qpcFrequency));
+            }
+            ProcessFlowEvent(record);
+        }
+    }
+}
+
+void NetworkMonitor::ProcessFlowEvent(const FlowRecord& record) {
+    PERF_TIMER("NetworkMonitor::ProcessFlowEvent");
+
+    // Отфильтрованные и уже покрытые события не аллоцируют: адреса и pid остаются двоичными,
+    // строки форматируются только для debug-лога или при постановке нового маршрута
+    if (!processManager->IsSelectedProcessByPid(record.processId)) {
+        PERF_COUNT("NetworkMonitor.FlowEvent.Filtered");
+        flowSummary.filtered.fetch_add(1, std::memory_order_relaxed);
         return;
     }
+    flowSummary.selected.fetch_add(1, std::memory_order_relaxed);
 
-    Logger::Instance().Info(std::format("Flow event: {} Process: {} ({}) Remote: {}:{} Protocol: {}",
-        addr.Event == WINDIVERT_EVENT_FLOW_ESTABLISHED ? "ESTABLISHED" : "DELETED",
-        processName, addr.Flow.ProcessId, remoteIp, addr.Flow.RemotePort,
-        static_cast<int>(addr.Flow.Protocol)));
+    // Семейство определяем по двоичному адресу; IPv4 приходит как ::ffff:a.b.c.d
+    Ipv6Address remoteAddress = Ipv6Address::FromWinDivert(record.remoteAddr);
+    bool isIpv6 = !remoteAddress.IsV4Mapped();
+    bool verbose = Logger::Instance().IsEnabled(Logger::LogLevel::LEVEL_DEBUG);
+    auto remoteText = [&] {
+        return isIpv6 ? remoteAddress.ToString() : Utils::FastUIntToIP(remoteAddress.MappedV4());
+    };
 
-    if (Utils::IsPrivateIP(remoteIp)) {
+    if (isIpv6 ? !remoteAddress.IsGlobalUnicast() : Utils::IsPrivateIPv4(remoteAddress.MappedV4())) {
         PERF_COUNT("NetworkMonitor.FlowEvent.PrivateIPSkipped");
-        Logger::Instance().Debug(std::format("Skipping private IP: {}", remoteIp));
+        flowSummary.skipped.fetch_add(1, std::memory_order_relaxed);
+        if (verbose) {
+            LOG_DEBUG("Skipping private IP: {}", remoteText());
+        }
         return;
     }
 
-    Logger::Instance().Info(std::format("Selected process detected: {} -> {}", processName, remoteIp));
+    StringInterner::Id processNameId = StringInterner::OverflowId;
+    std::string_view processName = ProcessNameFor(record.processId, processNameId);
+    if (verbose) {
+        LOG_DEBUG("Flow event: {} Process: {} ({}) Remote: {}:{} Protocol: {}",
+            record.event == WINDIVERT_EVENT_FLOW_ESTABLISHED ? "ESTABLISHED" : "DELETED",
+            processName, record.processId, remoteText(), record.remotePort,
+            static_cast<int>(record.protocol));
+    }
 
-    if (addr.Event == WINDIVERT_EVENT_FLOW_ESTABLISHED) {
+    if (record.event == WINDIVERT_EVENT_FLOW_ESTABLISHED) {
         PERF_COUNT("NetworkMonitor.FlowEvent.Established");
 
-        // IMMEDIATE PROCESSING - NO BATCHING!
-        Logger::Instance().Info(std::format("Adding route IMMEDIATELY for {} (process: {})", remoteIp, processName));
-
-        auto routeAddStart = std::chrono::high_resolution_clock::now();
-        bool success = routeController->AddRoute(remoteIp, processName);
-        auto routeAddEnd = std::chrono::high_resolution_clock::now();
-
-        auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(routeAddEnd - routeAddStart);
-        PerformanceMonitor::Instance().RecordOperation("RouteAddLatency", totalTime);
+        bool routed = false;
+        if (isIpv6) {
+            // IPv6-маршрут ставится прямо из воркера, поток захвата его не ждёт
+            PERF_COUNT("NetworkMonitor.FlowEvent.IPv6");
+            routed = routeController->AddRoute6(remoteAddress, 128, processName);
+        }
+        // Маршрут программируется writer-потоками RouteController, поток приёма не ждёт IP Helper API.
+        // RouteAddLatency теперь записывается там и означает время от постановки в очередь до ядра.
+        else {
+            routed = routeController->EnqueueRoute(remoteAddress.MappedV4(), processName);
+            if (routed) {
+                PERF_COUNT("NetworkMonitor.RouteQueued");
+            }
+        }
 
-        if (success) {
-            PERF_COUNT("NetworkMonitor.RouteAdded");
-            Logger::Instance().Info(std::format("Route added successfully for {}: {}µs", remoteIp, totalTime.count()));
+        if (routed) {
+            flowSummary.routed.fetch_add(1, std::memory_order_relaxed);
         }
         else {
-            Logger::Instance().Error(std::format("Failed to add route for {}", remoteIp));
+            flowSummary.failed.fetch_add(1, std::memory_order_relaxed);
+            Logger::Instance().Error(std::format("Failed to {} route for {}", isIpv6 ? "add IPv6" : "queue", remoteText()));
         }
 
-        // Update connections tracking
+        // Update connections tracking; при переполнении таблица сама вытесняет самые старые
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.Upsert(MakeFlowKey(record), processNameId, SteadySeconds());
+    }
+    else if (record.event == WINDIVERT_EVENT_FLOW_DELETED) {
+        PERF_COUNT("NetworkMonitor.FlowEvent.Deleted");
         std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.Erase(MakeFlowKey(record));
+    }
+}
 
-        if (connections.size() >= MAX_CONNECTIONS) {
-            PERF_COUNT("NetworkMonitor.ConnectionLimitReached");
-            Logger::Instance().Warning(std::format("Connection limit reached ({}), cleaning up old connections", MAX_CONNECTIONS));
-            ForceCleanupOldConnections();
+std::string_view NetworkMonitor::ProcessNameFor(uint32_t processId, StringInterner::Id& nameId) {
+    // Строки интернера не удаляются, view остаётся валидным после снятия блокировки
+    {
+        std::shared_lock lock(processNamesMutex);
+        if (auto it = processNameIds.find(processId); it != processNameIds.end()) {
+            nameId = it->second;
+            return connectionProcessNames.Lookup(nameId);
         }
+    }
 
-        UINT64 flowId = ((UINT64)addr.Flow.ProcessId << 32) |
-            ((UINT64)addr.Flow.LocalPort << 16) |
-            addr.Flow.RemotePort;
+    // Первое событие процесса: единственное место, где имя конвертируется в UTF-8, и без блокировки
+    auto cachedInfo = processManager->GetCachedInfo(processId);
+    std::string name = cachedInfo.has_value() ? Utils::WStringToString(cachedInfo->name) : std::string();
 
-        connections[flowId] = {
-            processName,
-            remoteIp,
-            addr.Flow.RemotePort,
-            std::chrono::system_clock::now(),
-            0
-        };
+    std::unique_lock lock(processNamesMutex);
+    auto [it, inserted] = processNameIds.try_emplace(processId, StringInterner::OverflowId);
+    if (inserted) {
+        if (cachedInfo.has_value()) {
+            it->second = connectionProcessNames.Intern(name);
+        }
+        // Сюда попадают только выбранные процессы: по этим записям воспроизведение восстанавливает выбор
+        TrafficCapture::Instance().RecordProcess(processId, connectionProcessNames.Lookup(it->second));
     }
-    else if (addr.Event == WINDIVERT_EVENT_FLOW_DELETED) {
-        PERF_COUNT("NetworkMonitor.FlowEvent.Deleted");
-        std::lock_guard<std::mutex> lock(connectionsMutex);
-        UINT64 flowId = ((UINT64)addr.Flow.ProcessId << 32) |
-            ((UINT64)addr.Flow.LocalPort << 16) |
-            addr.Flow.RemotePort;
-        connections.erase(flowId);
-        Logger::Instance().Debug(std::format("Flow deleted for {}", processName));
+    nameId = it->second;
+    return connectionProcessNames.Lookup(nameId);
+}
+
+void NetworkMonitor::LogFlowSummary() {
+    uint64_t filtered = flowSummary.filtered.exchange(0, std::memory_order_relaxed);
+    uint64_t selected = flowSummary.selected.exchange(0, std::memory_order_relaxed);
+    uint64_t skipped = flowSummary.skipped.exchange(0, std::memory_order_relaxed);
+    uint64_t routed = flowSummary.routed.exchange(0, std::memory_order_relaxed);
+    uint64_t failed = flowSummary.failed.exchange(0, std::memory_order_relaxed);
+
+    if (filtered + selected == 0) {
+        return;
     }
 
-    auto eventEndTime = std::chrono::high_resolution_clock::now();
-    auto eventTotalTime = std::chrono::duration_cast<std::chrono::microseconds>(eventEndTime - eventStartTime);
-    Logger::Instance().Debug(std::format("Total event processing time: {}µs", eventTotalTime.count()));
+    Logger::Instance().Info(std::format(
+        "Flow events (last {}s): {} selected, {} filtered, {} private skipped, {} routed, {} failed, {} total",
+        Constants::FLOW_SUMMARY_INTERVAL_SEC, selected, filtered, skipped, routed, failed,
+        eventCount.load(std::memory_order_relaxed)));
 }
 
 void NetworkMonitor::CleanupOldConnections() {
     PERF_TIMER("NetworkMonitor::CleanupOldConnections");
 
-    std::lock_guard<std::mutex> lock(connectionsMutex);
-    auto now = std::chrono::system_clock::now();
-    int cleaned = 0;
-
-    for (auto it = connections.begin(); it != connections.end();) {
-        auto duration = std::chrono::duration_cast<std::chrono::hours>(now - it->second.lastSeen);
-        if (duration.count() >= Constants::CONNECTION_CLEANUP_HOURS) {
-            it = connections.erase(it);
-            cleaned++;
-        }
-        else {
-            ++it;
-        }
+    size_t cleaned = 0;
+    FlowTable::Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        cleaned = connections.Expire(SteadySeconds());
+        stats = connections.GetStats();
     }
+    {
+        std::unique_lock lock(processNamesMutex);
+        processNameIds.clear();
+    }
+
+    auto& perf = PerformanceMonitor::Instance();
+    perf.SetGauge("NetworkMonitor.Flows.Active", stats.flows);
+    perf.SetGauge("NetworkMonitor.Flows.MemoryBytes", stats.memoryBytes);
+    perf.SetGauge("NetworkMonitor.Flows.Expired", stats.expired);
+    perf.SetGauge("NetworkMonitor.Flows.Evicted", stats.evicted);
 
     if (cleaned > 0) {
         PERF_COUNT("NetworkMonitor.ConnectionsCleaned");
@@ -282,42 +616,38 @@ void NetworkMonitor::CleanupOldConnections() {
     }
 }
 
-void NetworkMonitor::ForceCleanupOldConnections() {
-    auto now = std::chrono::system_clock::now();
-    int cleaned = 0;
-
-    for (auto it = connections.begin(); it != connections.end();) {
-        auto duration = std::chrono::duration_cast<std::chrono::minutes>(now - it->second.lastSeen);
-        if (duration.count() >= 30) {
-            it = connections.erase(it);
-            cleaned++;
-        }
-        else {
-            ++it;
-        }
+size_t NetworkMonitor::GetMemoryBytes() {
+    size_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        bytes = connections.GetStats().memoryBytes;
     }
+    std::shared_lock lock(processNamesMutex);
+    return bytes + processNameIds.bucket_count() * sizeof(void*) +
+        processNameIds.size() * (sizeof(std::pair<const uint32_t, StringInterner::Id>) + sizeof(void*) * 2);
+}
 
-    if (connections.size() > MAX_CONNECTIONS * 0.8) {
-        std::vector<std::pair<UINT64, std::chrono::system_clock::time_point>> sortedConnections;
-        sortedConnections.reserve(connections.size());
-
-        for (const auto& [id, info] : connections) {
-            sortedConnections.emplace_back(id, info.lastSeen);
-        }
-
-        size_t toRemove = connections.size() - static_cast<size_t>(MAX_CONNECTIONS * 0.8);
-        std::partial_sort(sortedConnections.begin(),
-            sortedConnections.begin() + toRemove,
-            sortedConnections.end(),
-            [](const auto& a, const auto& b) { return a.second < b.second; });
+void NetworkMonitor::TrimMemory(MemoryPressure pressure) {
+    if (pressure == MemoryPressure::Normal) {
+        return;
+    }
 
-        for (size_t i = 0; i < toRemove; ++i) {
-            connections.erase(sortedConnections[i].first);
-            cleaned++;
-        }
+    size_t expired = 0;
+    size_t evicted = 0;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        expired = connections.Expire(SteadySeconds());
+        // Shed: половина соединений с ближайшими дедлайнами; маршруты остаются, теряется только учёт
+        size_t target = pressure == MemoryPressure::Shed ? connections.Size() / 2 : connections.Size();
+        evicted = connections.Shrink(target);
+    }
+    {
+        std::unique_lock lock(processNamesMutex);
+        processNameIds.clear();
+        processNameIds.rehash(0);
     }
 
-    Logger::Instance().Info(std::format("Force cleanup removed {} connections", cleaned));
+    Logger::Instance().Info(std::format("NetworkMonitor::TrimMemory - Expired {}, evicted {} connections", expired, evicted));
 }
 
 std::string NetworkMonitor::GetProcessPathFromFlowId(UINT64 flowId, UINT32 processId) {
@@ -344,10 +674,16 @@ void NetworkMonitor::LogPerformanceStats() {
         }
     }
 
+    for (const auto& [name, value] : report.gauges) {
+        if (name.starts_with("NetworkMonitor.")) {
+            Logger::Instance().Info(std::format("{}: {}", name, value));
+        }
+    }
+
     for (const auto& op : report.operations) {
         if (op.name.starts_with("NetworkMonitor::") || op.name == "RouteAddLatency") {
-            Logger::Instance().Info(std::format("{}: {} calls, avg: {}us, p95: {}us",
-                op.name, op.count, op.avgTime.count(), op.p95Time.count()));
+            Logger::Instance().Info(std::format("{}: {} calls, avg: {}us, p50: {}us, p99: {}us, p999: {}us",
+                op.name, op.count, op.avgTime.count(), op.p50Time.count(), op.p99Time.count(), op.p999Time.count()));
         }
     }
 }
\ No newline at end of file
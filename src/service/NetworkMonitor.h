@@ -7,46 +7,98 @@
 #include <thread>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
 #include <chrono>
+#include <memory>
+#include <vector>
+#include <array>
 #include "../common/Models.h"
+#include "../common/Constants.h"
+#include "FlowRing.h"
+#include "FlowTable.h"
+#include "StringInterner.h"
 
 class RouteController;
 class ProcessManager;
 
 class NetworkMonitor {
 public:
-    NetworkMonitor(RouteController* routeController, ProcessManager* processManager);
+    NetworkMonitor(RouteController* routeController, ProcessManager* processManager,
+        const MonitorSettings& settings = {});
     ~NetworkMonitor();
 
     void Start();
     void Stop();
     bool IsActive() const { return active.load(); }
 
+    // Для Watchdog: таблица соединений и кэш имён процессов
+    size_t GetMemoryBytes();
+    void TrimMemory(MemoryPressure pressure);
+
 private:
+    friend struct BenchAccess;              // bench/: воспроизведение записи через ProcessFlowEvent
+
     RouteController* routeController;
     ProcessManager* processManager;
+    MonitorSettings settings;
 
     HANDLE divertHandle;
     std::atomic<bool> running;
     std::atomic<bool> active;
     std::thread monitorThread;
 
-    struct ConnectionInfo {
-        std::string processName;
-        std::string remoteIp;
-        UINT16 remotePort;
-        std::chrono::system_clock::time_point lastSeen;
-        size_t packetCount;
+    // Поток приёма только забирает пачки адресов из драйвера, сжимает их в FlowRecord и
+    // раскладывает по кольцам воркеров по удалённому адресу: события одного flow и
+    // одного назначения обрабатываются одним воркером по порядку
+    struct RecentDestination {
+        uint64_t key = 0;
+        uint64_t sequence = 0;      // Индекс записи в кольце + 1, 0 - пусто
+    };
+
+    struct FlowWorker {
+        explicit FlowWorker(size_t capacity) : ring(capacity) {}
+
+        SpscRing<FlowRecord> ring;
+        // Дальше - только поток приёма
+        std::array<RecentDestination, Constants::FLOW_RECENT_SLOTS> recent{};
+        size_t highWater = 0;
+        std::jthread thread;        // Последним: join до разрушения кольца
     };
+    std::vector<std::unique_ptr<FlowWorker>> workers;
+    std::vector<FlowRecord> captureBatch;   // Только поток приёма, пока идёт запись трафика
+    std::atomic<uint64_t> eventCount{ 0 };
+    std::atomic<uint64_t> droppedEvents{ 0 };
+    std::atomic<uint64_t> coalescedEvents{ 0 };
+    // Счётчики для периодической сводки; сбрасываются при каждом выводе
+    struct FlowSummary {
+        std::atomic<uint64_t> filtered{ 0 };
+        std::atomic<uint64_t> selected{ 0 };
+        std::atomic<uint64_t> skipped{ 0 };     // Приватные и не-global IPv6
+        std::atomic<uint64_t> routed{ 0 };      // Покрыто или поставлено в очередь
+        std::atomic<uint64_t> failed{ 0 };
+    } flowSummary;
+    int64_t qpcFrequency = 0;
 
+    // Отслеживаемые соединения выбранных процессов, ключ - полный 5-tuple + pid
     static constexpr size_t MAX_CONNECTIONS = 10000;
-    std::unordered_map<UINT64, ConnectionInfo> connections;
-    std::mutex connectionsMutex;
+    FlowTable connections;
+    std::mutex connectionsMutex;        // connections
+    StringInterner connectionProcessNames;
+    // pid -> имя в connectionProcessNames: UTF-8 строим один раз на процесс, а не на каждое событие.
+    // Чистится вместе с устаревшими соединениями, так что переиспользованный pid отстаёт не дольше цикла очистки
+    std::unordered_map<uint32_t, StringInterner::Id> processNameIds;
+    // connectionProcessNames и processNameIds: воркеры находят имя под shared-блокировкой, параллельно
+    std::shared_mutex processNamesMutex;
 
     void MonitorThreadFunc();
-    void ProcessFlowEvent(const WINDIVERT_ADDRESS& addr);
+    void ConfigureRecvThread();
+    void DispatchBatch(const WINDIVERT_ADDRESS* addrs, size_t count);
+    bool ShouldCoalesce(FlowWorker& worker, const FlowRecord& record, size_t occupancy);
+    void FlowWorkerThreadFunc(std::stop_token stopToken, FlowWorker& worker);
+    void ProcessFlowEvent(const FlowRecord& record);
+    std::string_view ProcessNameFor(uint32_t processId, StringInterner::Id& nameId);
+    void LogFlowSummary();
     void CleanupOldConnections();
-    void ForceCleanupOldConnections();
     std::string GetProcessPathFromFlowId(UINT64 flowId, UINT32 processId);
     void LogPerformanceStats();
 };
\ No newline at end of file
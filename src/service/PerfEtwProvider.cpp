@@ -0,0 +1,85 @@
+// src/service/PerfEtwProvider.cpp
+#include <winsock2.h>
+#include <windows.h>
+#include <TraceLoggingProvider.h>
+#include "PerfEtwProvider.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include <format>
+
+// {AB3DAEF4-8480-4FF7-9ADE-2ED5B9E6924D}
+TRACELOGGING_DEFINE_PROVIDER(g_perfProvider, "RouteManagerPro-Performance",
+    (0xab3daef4, 0x8480, 0x4ff7, 0x9a, 0xde, 0x2e, 0xd5, 0xb9, 0xe6, 0x92, 0x4d));
+
+PerfEtwProvider::~PerfEtwProvider() {
+    Stop();
+}
+
+void PerfEtwProvider::Start() {
+    if (registered.load()) return;
+
+    HRESULT hr = TraceLoggingRegister(g_perfProvider);
+    if (FAILED(hr)) {
+        Logger::Instance().Warning(std::format("PerfEtwProvider::Start - TraceLoggingRegister failed: 0x{:08X}",
+            static_cast<unsigned long>(hr)));
+        return;
+    }
+
+    registered = true;
+    publishThread = std::jthread([this](std::stop_token token) { PublishThreadFunc(token); });
+    Logger::Instance().Info("PerfEtwProvider: RouteManagerPro-Performance provider registered");
+}
+
+void PerfEtwProvider::Stop() {
+    if (!registered.exchange(false)) return;
+
+    if (publishThread.joinable()) {
+        publishThread.request_stop();
+        waitCV.notify_all();
+        publishThread.join();
+    }
+    TraceLoggingUnregister(g_perfProvider);
+}
+
+void PerfEtwProvider::PublishThreadFunc(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        {
+            std::unique_lock<std::mutex> lock(waitMutex);
+            waitCV.wait_for(lock, stopToken, std::chrono::seconds(Constants::PERF_ETW_INTERVAL_SEC), [] { return false; });
+        }
+        if (stopToken.stop_requested()) break;
+
+        // Без сессии отчёт не собираем вовсе
+        if (TraceLoggingProviderEnabled(g_perfProvider, 0, 0)) {
+            Publish();
+        }
+    }
+}
+
+void PerfEtwProvider::Publish() {
+    auto report = PerformanceMonitor::Instance().GetReport();
+
+    for (const auto& [name, value] : report.counters) {
+        TraceLoggingWrite(g_perfProvider, "Counter",
+            TraceLoggingString(name.c_str(), "Name"),
+            TraceLoggingUInt64(value, "Value"));
+    }
+
+    for (const auto& [name, value] : report.gauges) {
+        TraceLoggingWrite(g_perfProvider, "Gauge",
+            TraceLoggingString(name.c_str(), "Name"),
+            TraceLoggingUInt64(value, "Value"));
+    }
+
+    for (const auto& op : report.operations) {
+        TraceLoggingWrite(g_perfProvider, "Timer",
+            TraceLoggingString(op.name.c_str(), "Name"),
+            TraceLoggingUInt64(op.count, "Count"),
+            TraceLoggingInt64(op.avgTime.count(), "AvgUs"),
+            TraceLoggingInt64(op.p50Time.count(), "P50Us"),
+            TraceLoggingInt64(op.p99Time.count(), "P99Us"),
+            TraceLoggingInt64(op.p999Time.count(), "P999Us"),
+            TraceLoggingInt64(op.maxTime.count(), "MaxUs"));
+    }
+}
@@ -0,0 +1,30 @@
+// src/service/PerfEtwProvider.h
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// TraceLogging provider "RouteManagerPro-Performance". Every
+// PERF_ETW_INTERVAL_SEC it writes the PerformanceMonitor report, one event per
+// counter, gauge and timer (with its percentiles), but only while some
+// ETW session has the provider enabled; without a listener the cost is one
+// TraceLoggingProviderEnabled check per interval. Record it with e.g.
+// `wpr`, `tracelog` or PerfView (*RouteManagerPro-Performance).
+class PerfEtwProvider {
+public:
+    PerfEtwProvider() = default;
+    ~PerfEtwProvider();
+
+    void Start();
+    void Stop();
+
+private:
+    std::atomic<bool> registered{ false };
+    std::mutex waitMutex;
+    std::condition_variable_any waitCV;
+    std::jthread publishThread;
+
+    void PublishThreadFunc(std::stop_token stopToken);
+    void Publish();
+};
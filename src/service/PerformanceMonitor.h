@@ -1,66 +1,83 @@
 // src/service/PerformanceMonitor.h
 #pragma once
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <unordered_map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
-#include <deque>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
-#include <algorithm>
+#include "LogLinearHistogram.h"
 
+// Metrics are addressed by small integer IDs. PERF_TIMER / PERF_COUNT /
+// PERF_RECORD resolve their literal name once per call site (a function-local
+// static), after which recording touches only the calling thread's shard:
+// a counter is one relaxed load + store, a timing is a LogLinearHistogram
+// record. Shards are leased per thread and reused after the thread exits;
+// GetReport() sums them on read. Names passed at run time go through the
+// registry under a shared lock, which is the slow path.
 class PerformanceMonitor {
 public:
+    using MetricId = uint32_t;
+
+    static constexpr size_t MAX_METRICS = 256;          // На каждый вид: таймеры, счётчики, датчики
+    static constexpr MetricId OVERFLOW_METRIC = 0;      // Сюда попадает всё сверх MAX_METRICS
+
     static PerformanceMonitor& Instance() {
         static PerformanceMonitor instance;
         return instance;
     }
 
+    MetricId RegisterTimer(std::string_view name) { return timerNames.Register(name); }
+    MetricId RegisterCounter(std::string_view name) { return counterNames.Register(name); }
+    MetricId RegisterGauge(std::string_view name) { return gaugeNames.Register(name); }
+
     // Timer for measuring operations
     class ScopedTimer {
     public:
-        ScopedTimer(const std::string& operation)
-            : op(operation), start(std::chrono::high_resolution_clock::now()) {
+        explicit ScopedTimer(MetricId operation)
+            : id(operation), start(std::chrono::steady_clock::now()) {
         }
 
         ~ScopedTimer() {
-            auto end = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-            PerformanceMonitor::Instance().RecordOperation(op, duration);
+            PerformanceMonitor::Instance().RecordOperation(id, std::chrono::steady_clock::now() - start);
         }
 
     private:
-        std::string op;
-        std::chrono::high_resolution_clock::time_point start;
+        MetricId id;
+        std::chrono::steady_clock::time_point start;
     };
 
     // Counter for events
-    void IncrementCounter(const std::string& name) {
-        std::lock_guard<std::mutex> lock(countersMutex);
-        counters[name]++;
+    void IncrementCounter(MetricId id) {
+        auto& cell = LocalShard().counters[id];
+        cell.store(cell.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
 
-    // Record operation timing
-    void RecordOperation(const std::string& operation, std::chrono::microseconds duration) {
-        std::lock_guard<std::mutex> lock(timingsMutex);
+    void IncrementCounter(std::string_view name) {
+        IncrementCounter(RegisterCounter(name));
+    }
 
-        auto& timing = timings[operation];
-        timing.count++;
-        timing.totalTime += duration;
-        timing.lastTime = duration;
+    // Gauge for instantaneous values (queue depths and similar)
+    void SetGauge(MetricId id, uint64_t value) {
+        gauges[id].store(value, std::memory_order_relaxed);
+    }
 
-        if (duration < timing.minTime || timing.minTime.count() == 0) {
-            timing.minTime = duration;
-        }
-        if (duration > timing.maxTime) {
-            timing.maxTime = duration;
-        }
+    void SetGauge(std::string_view name, uint64_t value) {
+        SetGauge(RegisterGauge(name), value);
+    }
 
-        // Keep last N samples for percentile calculations
-        timing.recentSamples.push_back(duration);
-        if (timing.recentSamples.size() > MAX_SAMPLES) {
-            timing.recentSamples.pop_front();
-        }
+    // Record operation timing
+    void RecordOperation(MetricId id, std::chrono::nanoseconds duration) {
+        LocalShard().Timer(id).Record(static_cast<uint64_t>((std::max)(duration.count(), int64_t{ 0 })));
+    }
+
+    void RecordOperation(std::string_view operation, std::chrono::nanoseconds duration) {
+        RecordOperation(RegisterTimer(operation), duration);
     }
 
     // Get performance report
@@ -71,11 +88,15 @@ public:
             std::chrono::microseconds avgTime;
             std::chrono::microseconds minTime;
             std::chrono::microseconds maxTime;
+            std::chrono::microseconds p50Time;
             std::chrono::microseconds p95Time;
+            std::chrono::microseconds p99Time;
+            std::chrono::microseconds p999Time;
         };
 
         std::vector<OperationStats> operations;
         std::unordered_map<std::string, uint64_t> counters;
+        std::unordered_map<std::string, uint64_t> gauges;
         std::chrono::system_clock::time_point reportTime;
     };
 
@@ -83,77 +104,185 @@ public:
         PerformanceReport report;
         report.reportTime = std::chrono::system_clock::now();
 
-        // Copy counters - need to extract values from atomics
-        {
-            std::lock_guard<std::mutex> lock(countersMutex);
-            for (const auto& [name, value] : counters) {
-                report.counters[name] = value.load();
-            }
-        }
+        std::vector<std::string> timerList = timerNames.Names();
+        std::vector<std::string> counterList = counterNames.Names();
+        std::vector<std::string> gaugeList = gaugeNames.Names();
 
-        // Process timings
+        std::vector<uint64_t> counterTotals(counterList.size(), 0);
+        std::vector<LogLinearHistogram::Snapshot> snapshots(timerList.size());
         {
-            std::lock_guard<std::mutex> lock(timingsMutex);
-            for (const auto& [op, timing] : timings) {
-                PerformanceReport::OperationStats stats;
-                stats.name = op;
-                stats.count = timing.count;
-                stats.minTime = timing.minTime;
-                stats.maxTime = timing.maxTime;
-
-                if (timing.count > 0) {
-                    stats.avgTime = timing.totalTime / timing.count;
-                    stats.p95Time = CalculatePercentile(timing.recentSamples, 95);
+            std::lock_guard<std::mutex> lock(shardsMutex);
+            for (const auto& shard : shards) {
+                for (size_t i = 0; i < counterTotals.size(); i++) {
+                    counterTotals[i] += shard->counters[i].load(std::memory_order_relaxed);
+                }
+                for (size_t i = 0; i < snapshots.size(); i++) {
+                    if (const auto* timer = shard->timers[i].load(std::memory_order_acquire)) {
+                        timer->MergeInto(snapshots[i]);
+                    }
                 }
+            }
+        }
 
-                report.operations.push_back(stats);
+        for (size_t i = 0; i < counterList.size(); i++) {
+            if (counterTotals[i] > 0) report.counters[counterList[i]] = counterTotals[i];
+        }
+        for (size_t i = 0; i < gaugeList.size(); i++) {
+            if (i != OVERFLOW_METRIC || gauges[i].load(std::memory_order_relaxed) > 0) {
+                report.gauges[gaugeList[i]] = gauges[i].load(std::memory_order_relaxed);
             }
         }
 
+        auto toMicros = [](uint64_t nanoseconds) {
+            return std::chrono::microseconds(nanoseconds / 1000);
+        };
+        for (size_t i = 0; i < snapshots.size(); i++) {
+            const auto& snapshot = snapshots[i];
+            if (snapshot.count == 0) continue;
+
+            PerformanceReport::OperationStats stats;
+            stats.name = timerList[i];
+            stats.count = snapshot.count;
+            stats.avgTime = toMicros(snapshot.sum / snapshot.count);
+            stats.minTime = toMicros(snapshot.min);
+            stats.maxTime = toMicros(snapshot.max);
+            stats.p50Time = toMicros(snapshot.Percentile(0.50));
+            stats.p95Time = toMicros(snapshot.Percentile(0.95));
+            stats.p99Time = toMicros(snapshot.Percentile(0.99));
+            stats.p999Time = toMicros(snapshot.Percentile(0.999));
+            report.operations.push_back(stats);
+        }
+
         return report;
     }
 
+    // Имена и ID остаются: они уже закэшированы в точках вызова
     void Reset() {
-        std::lock_guard<std::mutex> lock1(countersMutex);
-        std::lock_guard<std::mutex> lock2(timingsMutex);
-        counters.clear();
-        timings.clear();
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        for (const auto& shard : shards) {
+            for (auto& counter : shard->counters) counter.store(0, std::memory_order_relaxed);
+            for (auto& timer : shard->timers) {
+                if (auto* histogram = timer.load(std::memory_order_acquire)) histogram->Clear();
+            }
+        }
+        for (auto& gauge : gauges) gauge.store(0, std::memory_order_relaxed);
     }
 
 private:
     PerformanceMonitor() = default;
 
-    struct TimingInfo {
-        uint64_t count = 0;
-        std::chrono::microseconds totalTime{ 0 };
-        std::chrono::microseconds lastTime{ 0 };
-        std::chrono::microseconds minTime{ 0 };
-        std::chrono::microseconds maxTime{ 0 };
-        std::deque<std::chrono::microseconds> recentSamples;
+    // Прозрачный хеш: поиск по string_view без временной std::string
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>{}(name);
+        }
     };
 
-    static constexpr size_t MAX_SAMPLES = 1000;
+    class Registry {
+    public:
+        Registry() {
+            names.reserve(MAX_METRICS);
+            names.emplace_back("PerformanceMonitor.Overflow");
+            ids.try_emplace(names.back(), OVERFLOW_METRIC);
+        }
+
+        MetricId Register(std::string_view name) {
+            {
+                std::shared_lock lock(mutex);
+                auto it = ids.find(name);
+                if (it != ids.end()) return it->second;
+            }
+
+            std::unique_lock lock(mutex);
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+            if (names.size() >= MAX_METRICS) return OVERFLOW_METRIC;
 
-    mutable std::mutex countersMutex;
-    std::unordered_map<std::string, std::atomic<uint64_t>> counters;
+            MetricId id = static_cast<MetricId>(names.size());
+            names.emplace_back(name);
+            ids.try_emplace(names.back(), id);
+            return id;
+        }
 
-    mutable std::mutex timingsMutex;
-    std::unordered_map<std::string, TimingInfo> timings;
+        std::vector<std::string> Names() const {
+            std::shared_lock lock(mutex);
+            return names;
+        }
 
-    std::chrono::microseconds CalculatePercentile(
-        const std::deque<std::chrono::microseconds>& samples, int percentile) const {
-        if (samples.empty()) return std::chrono::microseconds{ 0 };
+    private:
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, MetricId, NameHash, std::equal_to<>> ids;
+        std::vector<std::string> names;
+    };
+
+    // Пишет только поток-владелец; читатели только загружают
+    struct alignas(64) ThreadShard {
+        std::array<std::atomic<uint64_t>, MAX_METRICS> counters{};
+        std::array<std::atomic<LogLinearHistogram*>, MAX_METRICS> timers{};
+        bool leased = false;                // Под shardsMutex
 
-        std::vector<std::chrono::microseconds> sorted(samples.begin(), samples.end());
-        std::sort(sorted.begin(), sorted.end());
+        ~ThreadShard() {
+            for (auto& timer : timers) delete timer.load(std::memory_order_relaxed);
+        }
 
-        size_t index = (sorted.size() * percentile) / 100;
-        if (index >= sorted.size()) index = sorted.size() - 1;
+        // Гистограмма создаётся при первой записи потока в этот таймер
+        LogLinearHistogram& Timer(MetricId id) {
+            LogLinearHistogram* histogram = timers[id].load(std::memory_order_relaxed);
+            if (!histogram) {
+                histogram = new LogLinearHistogram();
+                timers[id].store(histogram, std::memory_order_release);
+            }
+            return *histogram;
+        }
+    };
+
+    // Осколок закреплён за потоком до его завершения, затем достаётся следующему
+    struct ShardLease {
+        ThreadShard* shard;
+        ShardLease() : shard(PerformanceMonitor::Instance().AcquireShard()) {}
+        ~ShardLease() { PerformanceMonitor::Instance().ReleaseShard(shard); }
+    };
+
+    Registry timerNames;
+    Registry counterNames;
+    Registry gaugeNames;
+    std::array<std::atomic<uint64_t>, MAX_METRICS> gauges{};
+
+    mutable std::mutex shardsMutex;
+    std::vector<std::unique_ptr<ThreadShard>> shards;
+
+    static ThreadShard& LocalShard() {
+        thread_local ShardLease lease;
+        return *lease.shard;
+    }
+
+    ThreadShard* AcquireShard() {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        for (const auto& shard : shards) {
+            if (!shard->leased) {
+                shard->leased = true;
+                return shard.get();
+            }
+        }
+        shards.push_back(std::make_unique<ThreadShard>());
+        shards.back()->leased = true;
+        return shards.back().get();
+    }
 
-        return sorted[index];
+    void ReleaseShard(ThreadShard* shard) {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        shard->leased = false;
     }
 };
 
-// Convenience macros
-#define PERF_TIMER(operation) PerformanceMonitor::ScopedTimer _timer(operation)
-#define PERF_COUNT(counter) PerformanceMonitor::Instance().IncrementCounter(counter)
\ No newline at end of file
+// Convenience macros. The name must be a literal: it is resolved once per call site
+#define PERF_METRIC_ID(kind, name) \
+    ([]() -> PerformanceMonitor::MetricId { \
+        static const PerformanceMonitor::MetricId id = PerformanceMonitor::Instance().Register##kind(name); \
+        return id; }())
+#define PERF_TIMER(operation) PerformanceMonitor::ScopedTimer _timer(PERF_METRIC_ID(Timer, operation))
+#define PERF_COUNT(counter) PerformanceMonitor::Instance().IncrementCounter(PERF_METRIC_ID(Counter, counter))
+#define PERF_RECORD(operation, duration) \
+    PerformanceMonitor::Instance().RecordOperation(PERF_METRIC_ID(Timer, operation), duration)
+#define PERF_GAUGE(gauge, value) PerformanceMonitor::Instance().SetGauge(PERF_METRIC_ID(Gauge, gauge), value)
@@ -0,0 +1,441 @@
+// src/service/PipeServer.cpp
+#include "PipeServer.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include <chrono>
+#include <format>
+
+PipeServer::Connection::~Connection() {
+    if (pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(pipe);
+    }
+}
+
+PipeServer::PipeServer(Handler handler, Classifier classify)
+    : handler(std::move(handler)), classify(std::move(classify)) {
+}
+
+PipeServer::~PipeServer() {
+    Stop();
+}
+
+bool PipeServer::Start() {
+    completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, Constants::IPC_WORKER_THREADS);
+    if (!completionPort) {
+        Logger::Instance().Error(std::format("PipeServer::Start - CreateIoCompletionPort failed: {}", ::GetLastError()));
+        return false;
+    }
+
+    stopping = false;
+    for (int i = 0; i < Constants::IPC_WORKER_THREADS; i++) {
+        workers.emplace_back([this]() { WorkerThreadFunc(); });
+    }
+    jobThread = std::jthread([this](std::stop_token stopToken) { JobThreadFunc(stopToken); });
+
+    for (int i = 0; i < Constants::IPC_LISTEN_INSTANCES; i++) {
+        Listen();
+    }
+
+    bool listening;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        listening = !connections.empty();
+    }
+    if (!listening) {
+        Logger::Instance().Error("PipeServer::Start - No pipe instance could be created");
+        Stop();
+        return false;
+    }
+
+    Logger::Instance().Info(std::format("PipeServer::Start - Listening with {} instances, {} I/O threads",
+        Constants::IPC_LISTEN_INSTANCES, Constants::IPC_WORKER_THREADS));
+    return true;
+}
+
+void PipeServer::Stop() {
+    if (!completionPort || stopping.exchange(true)) {
+        return;
+    }
+
+    Logger::Instance().Info("PipeServer::Stop - Stopping");
+
+    // Текущая долгая команда доработает: оптимизация сама прерывается по остановке сервиса
+    jobThread.request_stop();
+    if (jobThread.joinable()) {
+        jobThread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(subscriptionsMutex);
+        subscriptions.clear();
+    }
+
+    std::vector<std::shared_ptr<Connection>> open;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        open.assign(connections.begin(), connections.end());
+    }
+    for (const auto& connection : open) {
+        Close(connection);
+    }
+    open.clear();
+
+    // Отменённые операции возвращаются через порт и отпускают свои соединения
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (pendingIo.load(std::memory_order_acquire) > 0 && std::chrono::steady_clock::now() < deadline) {
+        Sleep(10);
+    }
+    if (pendingIo.load(std::memory_order_acquire) > 0) {
+        Logger::Instance().Warning(std::format("PipeServer::Stop - {} I/O operations still pending",
+            pendingIo.load(std::memory_order_acquire)));
+    }
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+    }
+    workers.clear();
+
+    CloseHandle(completionPort);
+    completionPort = nullptr;
+    Logger::Instance().Info("PipeServer::Stop - Stopped");
+}
+
+void PipeServer::Listen() {
+    if (stopping.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    auto connection = std::make_shared<Connection>();
+    connection->pipe = CreateNamedPipeA(
+        Constants::PIPE_NAME.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        PIPE_UNLIMITED_INSTANCES,
+        static_cast<DWORD>(Constants::IPC_INITIAL_BUFFER_SIZE),
+        static_cast<DWORD>(Constants::IPC_INITIAL_BUFFER_SIZE),
+        0,
+        nullptr
+    );
+    if (connection->pipe == INVALID_HANDLE_VALUE) {
+        Logger::Instance().Error(std::format("PipeServer::Listen - CreateNamedPipe failed: {}", ::GetLastError()));
+        return;
+    }
+    if (!CreateIoCompletionPort(connection->pipe, completionPort, 0, 0)) {
+        Logger::Instance().Error(std::format("PipeServer::Listen - Failed to bind pipe to completion port: {}", ::GetLastError()));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+        connections.insert(connection);
+    }
+
+    connection->readHold = connection;
+    pendingIo.fetch_add(1, std::memory_order_acq_rel);
+    if (!ConnectNamedPipe(connection->pipe, &connection->connectIo.overlapped)) {
+        DWORD error = ::GetLastError();
+        if (error == ERROR_IO_PENDING) {
+            return;
+        }
+
+        // Клиент успел подключиться до ConnectNamedPipe: пакета завершения не будет
+        connection->readHold.reset();
+        pendingIo.fetch_sub(1, std::memory_order_acq_rel);
+        if (error == ERROR_PIPE_CONNECTED) {
+            OnConnected(connection, ERROR_SUCCESS);
+            return;
+        }
+        Logger::Instance().Error(std::format("PipeServer::Listen - ConnectNamedPipe failed: {}", error));
+        Close(connection);
+    }
+}
+
+void PipeServer::WorkerThreadFunc() {
+    for (;;) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = nullptr;
+        BOOL ok = GetQueuedCompletionStatus(completionPort, &bytes, &key, &overlapped, INFINITE);
+        if (!overlapped) {
+            break;  // Пакет останова из Stop()
+        }
+
+        DWORD error = ok ? ERROR_SUCCESS : ::GetLastError();
+        IoContext* io = CONTAINING_RECORD(overlapped, IoContext, overlapped);
+        Connection* owner = io->owner;
+
+        switch (io->kind) {
+        case IoKind::Connect: {
+            auto connection = std::move(owner->readHold);
+            OnConnected(connection, error);
+            break;
+        }
+        case IoKind::Read: {
+            auto connection = std::move(owner->readHold);
+            OnRead(connection, bytes, error);
+            break;
+        }
+        case IoKind::Write: {
+            std::shared_ptr<Connection> connection;
+            {
+                std::lock_guard<std::mutex> lock(owner->writeMutex);
+                connection = std::move(owner->writeHold);
+            }
+            OnWritten(connection, error);
+            break;
+        }
+        }
+
+        pendingIo.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void PipeServer::JobThreadFunc(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            if (!jobsCV.wait(lock, stopToken, [this]() { return !jobs.empty(); })) {
+                break;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        PERF_TIMER("PipeServer.LongRunning");
+        Send(job.connection, Execute(job.message));
+    }
+}
+
+void PipeServer::OnConnected(const std::shared_ptr<Connection>& connection, DWORD error) {
+    // Занятый экземпляр сразу замещается новым
+    Listen();
+
+    if (error != ERROR_SUCCESS && error != ERROR_PIPE_CONNECTED) {
+        if (error != ERROR_OPERATION_ABORTED) {
+            LOG_DEBUG("PipeServer::OnConnected - Connect failed: {}", error);
+        }
+        Close(connection);
+        return;
+    }
+
+    PERF_COUNT("PipeServer.Accepted");
+    PostRead(connection);
+}
+
+void PipeServer::OnRead(const std::shared_ptr<Connection>& connection, DWORD bytes, DWORD error) {
+    if (error != ERROR_SUCCESS && error != ERROR_MORE_DATA) {
+        if (error != ERROR_BROKEN_PIPE && error != ERROR_OPERATION_ABORTED) {
+            LOG_DEBUG("PipeServer::OnRead - ReadFile failed: {}", error);
+        }
+        Close(connection);
+        return;
+    }
+
+    auto& message = connection->message;
+    message.insert(message.end(), connection->readChunk.begin(), connection->readChunk.begin() + bytes);
+    if (message.size() > Constants::IPC_MAX_MESSAGE_SIZE) {
+        Logger::Instance().Warning(std::format("PipeServer::OnRead - Request larger than {} bytes, dropping client",
+            Constants::IPC_MAX_MESSAGE_SIZE));
+        Close(connection);
+        return;
+    }
+    if (error == ERROR_MORE_DATA) {
+        PostRead(connection);
+        return;
+    }
+
+    std::vector<uint8_t> frame = std::move(message);
+    message.clear();
+
+    // Следующий запрос читается, пока обрабатывается этот
+    PostRead(connection);
+    if (!frame.empty()) {
+        Dispatch(connection, std::move(frame));
+    }
+}
+
+void PipeServer::OnWritten(const std::shared_ptr<Connection>& connection, DWORD error) {
+    bool failed = error != ERROR_SUCCESS;
+    {
+        std::lock_guard<std::mutex> lock(connection->writeMutex);
+        if (!connection->pendingWrites.empty()) {
+            connection->pendingWrites.pop_front();
+        }
+        if (!failed && !connection->pendingWrites.empty()) {
+            failed = !StartWriteLocked(connection);
+        }
+        if (failed) {
+            connection->pendingWrites.clear();
+        }
+    }
+
+    if (failed) {
+        if (error != ERROR_SUCCESS && error != ERROR_BROKEN_PIPE && error != ERROR_OPERATION_ABORTED && error != ERROR_NO_DATA) {
+            LOG_DEBUG("PipeServer::OnWritten - WriteFile failed: {}", error);
+        }
+        Close(connection);
+    }
+}
+
+void PipeServer::PostRead(const std::shared_ptr<Connection>& connection) {
+    if (connection->closed.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    connection->readChunk.resize(Constants::IPC_READ_CHUNK_SIZE);
+    connection->readIo.overlapped = {};
+    connection->readHold = connection;
+    pendingIo.fetch_add(1, std::memory_order_acq_rel);
+
+    // Синхронное завершение, в том числе с ERROR_MORE_DATA, тоже приходит через порт
+    if (!ReadFile(connection->pipe, connection->readChunk.data(), static_cast<DWORD>(connection->readChunk.size()),
+        nullptr, &connection->readIo.overlapped)) {
+        DWORD error = ::GetLastError();
+        if (error != ERROR_IO_PENDING && error != ERROR_MORE_DATA) {
+            connection->readHold.reset();
+            pendingIo.fetch_sub(1, std::memory_order_acq_rel);
+            if (error != ERROR_BROKEN_PIPE) {
+                LOG_DEBUG("PipeServer::PostRead - ReadFile failed: {}", error);
+            }
+            Close(connection);
+            return;
+        }
+    }
+
+    // Close() мог проскочить между проверкой и ReadFile
+    if (connection->closed.load(std::memory_order_acquire)) {
+        CancelIoEx(connection->pipe, &connection->readIo.overlapped);
+    }
+}
+
+void PipeServer::Dispatch(const std::shared_ptr<Connection>& connection, std::vector<uint8_t> frame) {
+    IPCMessage message;
+    if (!IPCSerializer::DeserializeRequest(frame, message)) {
+        IPCResponse response;
+        response.error = "Malformed request";
+        Send(connection, response);
+        return;
+    }
+
+    PERF_COUNT("PipeServer.Requests");
+    Mode mode = classify ? classify(message.type) : Mode::Inline;
+    if (mode == Mode::Job) {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            jobs.push_back({ connection, std::move(message) });
+        }
+        jobsCV.notify_one();
+        return;
+    }
+
+    IPCResponse response = Execute(message);
+    if (mode == Mode::Subscribe && response.success) {
+        // Регистрируем до первого ответа, чтобы не пропустить изменение между ними
+        std::lock_guard<std::mutex> lock(subscriptionsMutex);
+        subscriptions.push_back({ connection, message.requestId, message.type });
+    }
+    Send(connection, response);
+}
+
+void PipeServer::Publish(IPCMessageType type, const std::vector<uint8_t>& data) {
+    std::vector<std::pair<std::shared_ptr<Connection>, uint32_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(subscriptionsMutex);
+        std::erase_if(subscriptions, [](const Subscription& subscription) {
+            auto connection = subscription.connection.lock();
+            return !connection || connection->closed.load(std::memory_order_acquire);
+            });
+        for (const Subscription& subscription : subscriptions) {
+            if (subscription.type == type) {
+                targets.emplace_back(subscription.connection.lock(), subscription.requestId);
+            }
+        }
+    }
+
+    IPCResponse notification;
+    notification.success = true;
+    notification.data = data;
+    for (const auto& [connection, requestId] : targets) {
+        notification.requestId = requestId;
+        if (connection && !Send(connection, notification, Constants::IPC_MAX_QUEUED_NOTIFICATIONS)) {
+            PERF_COUNT("PipeServer.NotificationsSkipped");
+        }
+    }
+}
+
+IPCResponse PipeServer::Execute(const IPCMessage& message) {
+    IPCResponse response;
+    try {
+        response = handler(message);
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("PipeServer::Execute - Exception processing message: {}", e.what()));
+        response = IPCResponse();
+        response.error = e.what();
+    }
+    response.requestId = message.requestId;
+    return response;
+}
+
+bool PipeServer::Send(const std::shared_ptr<Connection>& connection, const IPCResponse& response, size_t maxQueued) {
+    std::vector<uint8_t> frame = IPCSerializer::SerializeResponse(response);
+
+    bool failed = false;
+    {
+        std::lock_guard<std::mutex> lock(connection->writeMutex);
+        if (connection->closed.load(std::memory_order_acquire) || connection->pendingWrites.size() >= maxQueued) {
+            return false;
+        }
+        connection->pendingWrites.push_back(std::move(frame));
+        if (!connection->writeHold) {
+            failed = !StartWriteLocked(connection);
+            if (failed) {
+                connection->pendingWrites.clear();
+            }
+        }
+    }
+
+    if (failed) {
+        Close(connection);
+    }
+    return !failed;
+}
+
+bool PipeServer::StartWriteLocked(const std::shared_ptr<Connection>& connection) {
+    const auto& frame = connection->pendingWrites.front();
+    connection->writeIo.overlapped = {};
+    connection->writeHold = connection;
+    pendingIo.fetch_add(1, std::memory_order_acq_rel);
+
+    if (!WriteFile(connection->pipe, frame.data(), static_cast<DWORD>(frame.size()),
+        nullptr, &connection->writeIo.overlapped) && ::GetLastError() != ERROR_IO_PENDING) {
+        connection->writeHold.reset();
+        pendingIo.fetch_sub(1, std::memory_order_acq_rel);
+        return false;
+    }
+
+    if (connection->closed.load(std::memory_order_acquire)) {
+        CancelIoEx(connection->pipe, &connection->writeIo.overlapped);
+    }
+    return true;
+}
+
+void PipeServer::Close(const std::shared_ptr<Connection>& connection) {
+    if (connection->closed.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    // Отменённые операции завершатся через порт; дескриптор закроет деструктор
+    CancelIoEx(connection->pipe, nullptr);
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.erase(connection);
+}
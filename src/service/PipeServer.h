@@ -0,0 +1,120 @@
+// src/service/PipeServer.h
+#pragma once
+#include <winsock2.h>
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "../common/IPCProtocol.h"
+
+// Named-pipe IPC server on an I/O completion port. IPC_LISTEN_INSTANCES pipe
+// instances wait for clients at once and every connection keeps one
+// overlapped read posted, so the next request is read while the previous one
+// is still being handled: a slow GetRoutes holds up neither other clients nor
+// later requests on the same pipe. Responses carry the request ID and are
+// written in completion order. Requests the classifier marks long-running
+// (optimize, cleanup) run one at a time on a separate job thread and are
+// answered when they finish. A subscribe request is answered inline and then
+// keeps its request ID: every Publish() of its type sends another response
+// with that ID until the client disconnects.
+class PipeServer {
+public:
+    enum class Mode { Inline, Job, Subscribe };
+
+    using Handler = std::function<IPCResponse(const IPCMessage&)>;
+    using Classifier = std::function<Mode(IPCMessageType)>;
+
+    PipeServer(Handler handler, Classifier classify);
+    ~PipeServer();
+
+    PipeServer(const PipeServer&) = delete;
+    PipeServer& operator=(const PipeServer&) = delete;
+
+    bool Start();
+    void Stop();
+
+    // Уведомление подписчикам type; тем, кто не разобрал прошлые, не отправляется
+    void Publish(IPCMessageType type, const std::vector<uint8_t>& data);
+
+private:
+    enum class IoKind { Connect, Read, Write };
+    struct Connection;
+
+    struct IoContext {
+        OVERLAPPED overlapped{};
+        IoKind kind;
+        Connection* owner;
+    };
+
+    // Канал закрывается в деструкторе, когда отпущена последняя ссылка;
+    // Close() только отменяет ввод-вывод, чтобы дескриптор не переиспользовался
+    struct Connection {
+        HANDLE pipe = INVALID_HANDLE_VALUE;
+        IoContext connectIo{ {}, IoKind::Connect, this };
+        IoContext readIo{ {}, IoKind::Read, this };
+        IoContext writeIo{ {}, IoKind::Write, this };
+
+        std::vector<uint8_t> readChunk;
+        std::vector<uint8_t> message;          // Куски сообщения длиннее readChunk
+        std::shared_ptr<Connection> readHold;  // Держит соединение, пока ожидание или чтение в полёте
+
+        std::mutex writeMutex;
+        std::deque<std::vector<uint8_t>> pendingWrites;
+        std::shared_ptr<Connection> writeHold; // Под writeMutex, пока запись в полёте
+
+        std::atomic<bool> closed{ false };
+
+        ~Connection();
+    };
+
+    struct Job {
+        std::shared_ptr<Connection> connection;
+        IPCMessage message;
+    };
+
+    struct Subscription {
+        std::weak_ptr<Connection> connection;
+        uint32_t requestId;
+        IPCMessageType type;
+    };
+
+    Handler handler;
+    Classifier classify;
+
+    HANDLE completionPort = nullptr;
+    std::atomic<bool> stopping{ false };
+    std::atomic<int> pendingIo{ 0 };
+    std::vector<std::jthread> workers;
+
+    std::mutex connectionsMutex;
+    std::unordered_set<std::shared_ptr<Connection>> connections;
+
+    std::mutex jobsMutex;
+    std::condition_variable_any jobsCV;
+    std::deque<Job> jobs;
+    std::jthread jobThread;
+
+    std::mutex subscriptionsMutex;
+    std::vector<Subscription> subscriptions;
+
+    void Listen();
+    void WorkerThreadFunc();
+    void JobThreadFunc(std::stop_token stopToken);
+
+    void OnConnected(const std::shared_ptr<Connection>& connection, DWORD error);
+    void OnRead(const std::shared_ptr<Connection>& connection, DWORD bytes, DWORD error);
+    void OnWritten(const std::shared_ptr<Connection>& connection, DWORD error);
+
+    void PostRead(const std::shared_ptr<Connection>& connection);
+    void Dispatch(const std::shared_ptr<Connection>& connection, std::vector<uint8_t> frame);
+    IPCResponse Execute(const IPCMessage& message);
+    bool Send(const std::shared_ptr<Connection>& connection, const IPCResponse& response, size_t maxQueued = SIZE_MAX);
+    bool StartWriteLocked(const std::shared_ptr<Connection>& connection);
+    void Close(const std::shared_ptr<Connection>& connection);
+};
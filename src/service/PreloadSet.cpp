@@ -0,0 +1,371 @@
+// src/service/PreloadSet.cpp
+#include "PreloadSet.h"
+#include "PerformanceMonitor.h"
+#include "../common/Logger.h"
+#include "../common/Utils.h"
+#include <json/json.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <span>
+
+namespace {
+#pragma pack(push, 1)
+    struct PreloadCacheHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t serviceCount;
+        uint64_t sourceSize;
+        int64_t sourceWriteTime;    // file_time_type ticks
+    };
+
+    // За записью: имя, rangeCount RouteKey, range6Count PreloadCacheRange6
+    struct PreloadCacheService {
+        uint16_t nameLength;
+        uint8_t enabled;
+        uint8_t reserved;
+        uint32_t rangeCount;
+        uint32_t range6Count;
+    };
+
+    struct PreloadCacheRange6 {
+        uint64_t hi;
+        uint64_t lo;
+        uint8_t prefixLength;
+    };
+#pragma pack(pop)
+
+    template<typename T>
+    bool ReadPod(std::span<const uint8_t> data, size_t& offset, T& out) {
+        if (offset + sizeof(T) > data.size()) return false;
+        std::memcpy(&out, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    void WritePod(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // "a.b.c.d/len", "a.b.c.d", то же для IPv6; false - диапазон отбрасывается
+    bool ParseRange(const std::string& text, std::vector<RouteKey>& ranges, std::vector<Route6Key>& ranges6) {
+        size_t slash = text.find('/');
+        std::string base = text.substr(0, slash);
+        bool isV6 = base.contains(':');
+        int prefixLength = isV6 ? 128 : 32;
+
+        if (slash != std::string::npos) {
+            std::string_view digits = std::string_view(text).substr(slash + 1);
+            if (digits.empty() || digits.size() > 3 || !std::ranges::all_of(digits, [](char c) { return c >= '0' && c <= '9'; })) {
+                return false;
+            }
+            prefixLength = std::stoi(std::string(digits));
+            if (prefixLength > (isV6 ? 128 : 32)) {
+                return false;
+            }
+        }
+
+        if (isV6) {
+            Ipv6Address address;
+            if (!Ipv6Address::Parse(base, address) || !address.IsGlobalUnicast()) {
+                return false;
+            }
+            ranges6.push_back({ address.Masked(prefixLength), static_cast<uint8_t>(prefixLength) });
+            return true;
+        }
+
+        if (!Utils::IsValidIPv4(base)) {
+            return false;
+        }
+        uint32_t address = Utils::FastIPToUInt(base) & RoutePrefixIndex::MaskFor(prefixLength);
+        if (Utils::IsPrivateIPv4(address)) {
+            return false;
+        }
+        ranges.push_back(MakeRouteKey(address, prefixLength));
+        return true;
+    }
+
+    // Сортировка, удаление покрытых и слияние соседних половин в один префикс
+    void NormalizeRanges(std::vector<RouteKey>& ranges) {
+        // По адресу, при равном адресе короткий префикс первым: покрывающий идёт раньше покрытых
+        std::ranges::sort(ranges);
+
+        std::vector<RouteKey> merged;
+        merged.reserve(ranges.size());
+        for (RouteKey key : ranges) {
+            uint32_t address = RouteKeyAddress(key);
+            int prefixLength = RouteKeyPrefix(key);
+
+            // Оставленные диапазоны не пересекаются, поэтому покрывать может только последний
+            if (!merged.empty()) {
+                int lastPrefix = RouteKeyPrefix(merged.back());
+                if (lastPrefix <= prefixLength &&
+                    (address & RoutePrefixIndex::MaskFor(lastPrefix)) == RouteKeyAddress(merged.back())) {
+                    continue;
+                }
+            }
+
+            merged.push_back(key);
+            while (merged.size() >= 2) {
+                RouteKey upper = merged.back();
+                RouteKey lower = merged[merged.size() - 2];
+                int length = RouteKeyPrefix(upper);
+                if (length == 0 || RouteKeyPrefix(lower) != length) break;
+
+                uint32_t halfBit = 1u << (32 - length);
+                if ((RouteKeyAddress(lower) & halfBit) != 0 || RouteKeyAddress(upper) != (RouteKeyAddress(lower) | halfBit)) {
+                    break;
+                }
+                merged.pop_back();
+                merged.back() = MakeRouteKey(RouteKeyAddress(lower), length - 1);
+            }
+        }
+
+        ranges = std::move(merged);
+    }
+
+    void NormalizeRanges6(std::vector<Route6Key>& ranges) {
+        auto less = [](const Route6Key& a, const Route6Key& b) {
+            return a.address != b.address ? a.address < b.address : a.prefixLength < b.prefixLength;
+        };
+        std::ranges::sort(ranges, less);
+
+        std::vector<Route6Key> kept;
+        kept.reserve(ranges.size());
+        for (const Route6Key& key : ranges) {
+            if (!kept.empty() && kept.back().prefixLength <= key.prefixLength &&
+                key.address.Masked(kept.back().prefixLength) == kept.back().address) {
+                continue;
+            }
+            kept.push_back(key);
+        }
+
+        ranges = std::move(kept);
+    }
+}
+
+std::shared_ptr<const PreloadSet> PreloadSet::Load(const std::string& sourcePath, const std::string& cachePath) {
+    PERF_TIMER("PreloadSet::Load");
+
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+    if (!StatSource(sourcePath, size, writeTime)) {
+        Logger::Instance().Error(std::format("PreloadSet: cannot stat {}", sourcePath));
+        return nullptr;
+    }
+
+    auto cached = std::make_shared<PreloadSet>();
+    if (cached->ReadCache(cachePath) && cached->sourceSize == size && cached->sourceWriteTime == writeTime) {
+        PERF_COUNT("PreloadSet.CacheHit");
+        LOG_DEBUG("PreloadSet: loaded {} services, {} ranges from cache", cached->services.size(), cached->RangeCount());
+        return cached;
+    }
+
+    std::vector<PreloadSource> sources;
+    if (!ParseSource(sourcePath, sources)) {
+        return nullptr;
+    }
+
+    auto compiled = std::const_pointer_cast<PreloadSet>(Compile(sources));
+    compiled->sourceSize = size;
+    compiled->sourceWriteTime = writeTime;
+    PERF_COUNT("PreloadSet.Compiled");
+
+    if (!compiled->WriteCache(cachePath)) {
+        Logger::Instance().Warning(std::format("PreloadSet: failed to write cache {}", cachePath));
+    }
+    return compiled;
+}
+
+std::shared_ptr<const PreloadSet> PreloadSet::Compile(const std::vector<PreloadSource>& sources) {
+    auto set = std::make_shared<PreloadSet>();
+    size_t listed = 0;
+    size_t rejected = 0;
+
+    for (const auto& source : sources) {
+        if (source.name.empty()) continue;
+
+        PreloadService service;
+        service.name = source.name;
+        service.enabled = source.enabled;
+        for (const auto& range : source.ranges) {
+            listed++;
+            if (!ParseRange(range, service.ranges, service.ranges6)) {
+                rejected++;
+                LOG_DEBUG("PreloadSet: skipping invalid or private range '{}' of {}", range, source.name);
+            }
+        }
+        NormalizeRanges(service.ranges);
+        NormalizeRanges6(service.ranges6);
+
+        if (!service.ranges.empty() || !service.ranges6.empty()) {
+            set->services.push_back(std::move(service));
+        }
+    }
+
+    Logger::Instance().Info(std::format("PreloadSet: compiled {} services, {} ranges listed, {} after merge, {} rejected",
+        set->services.size(), listed, set->RangeCount(), rejected));
+    return set;
+}
+
+bool PreloadSet::IsCurrent(const std::string& sourcePath) const {
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+    return StatSource(sourcePath, size, writeTime) && size == sourceSize && writeTime == sourceWriteTime;
+}
+
+const PreloadService* PreloadSet::Find(std::string_view name) const {
+    auto it = std::ranges::find(services, name, &PreloadService::name);
+    return it != services.end() ? &*it : nullptr;
+}
+
+size_t PreloadSet::RangeCount() const {
+    size_t count = 0;
+    for (const auto& service : services) {
+        count += service.ranges.size() + service.ranges6.size();
+    }
+    return count;
+}
+
+bool PreloadSet::StatSource(const std::string& sourcePath, uint64_t& size, int64_t& writeTime) {
+    std::error_code ec;
+    size = std::filesystem::file_size(sourcePath, ec);
+    if (ec) return false;
+    auto time = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec) return false;
+    writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+bool PreloadSet::ParseSource(const std::string& sourcePath, std::vector<PreloadSource>& sources) {
+    std::ifstream file(sourcePath);
+    if (!file.is_open()) {
+        Logger::Instance().Error(std::format("Failed to open preload config: {}", sourcePath));
+        return false;
+    }
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors)) {
+        Logger::Instance().Error(std::format("Failed to parse preload config: {}", errors));
+        return false;
+    }
+
+    const Json::Value& servicesJson = root["services"];
+    if (!servicesJson.isArray()) {
+        Logger::Instance().Error("Invalid preload config format");
+        return false;
+    }
+
+    for (const auto& serviceJson : servicesJson) {
+        PreloadSource source;
+        source.name = serviceJson.get("name", "").asString();
+        source.enabled = serviceJson.get("enabled", true).asBool();
+
+        const Json::Value& rangesJson = serviceJson["ranges"];
+        if (rangesJson.isArray()) {
+            for (const auto& range : rangesJson) {
+                source.ranges.push_back(range.asString());
+            }
+        }
+
+        if (!source.name.empty() && !source.ranges.empty()) {
+            sources.push_back(std::move(source));
+        }
+    }
+
+    Logger::Instance().Info(std::format("Loaded {} services from preload config", sources.size()));
+    return true;
+}
+
+bool PreloadSet::ReadCache(const std::string& cachePath) {
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::span<const uint8_t> data(bytes);
+
+    size_t offset = 0;
+    PreloadCacheHeader header{};
+    if (!ReadPod(data, offset, header) || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+        return false;
+    }
+
+    services.clear();
+    services.reserve(header.serviceCount);
+    for (uint16_t i = 0; i < header.serviceCount; i++) {
+        PreloadCacheService record{};
+        if (!ReadPod(data, offset, record)) return false;
+
+        size_t rangesBytes = size_t(record.rangeCount) * sizeof(RouteKey) + size_t(record.range6Count) * sizeof(PreloadCacheRange6);
+        if (offset + record.nameLength + rangesBytes > data.size()) {
+            Logger::Instance().Warning("PreloadSet: cache is truncated, recompiling");
+            return false;
+        }
+
+        PreloadService service;
+        service.name.assign(reinterpret_cast<const char*>(data.data() + offset), record.nameLength);
+        offset += record.nameLength;
+        service.enabled = record.enabled != 0;
+
+        service.ranges.resize(record.rangeCount);
+        std::memcpy(service.ranges.data(), data.data() + offset, record.rangeCount * sizeof(RouteKey));
+        offset += record.rangeCount * sizeof(RouteKey);
+
+        service.ranges6.reserve(record.range6Count);
+        for (uint32_t j = 0; j < record.range6Count; j++) {
+            PreloadCacheRange6 range{};
+            ReadPod(data, offset, range);
+            service.ranges6.push_back({ Ipv6Address{ range.hi, range.lo }, range.prefixLength });
+        }
+
+        services.push_back(std::move(service));
+    }
+
+    sourceSize = header.sourceSize;
+    sourceWriteTime = header.sourceWriteTime;
+    return true;
+}
+
+bool PreloadSet::WriteCache(const std::string& cachePath) const {
+    PreloadCacheHeader header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.serviceCount = static_cast<uint16_t>((std::min)(services.size(), size_t(UINT16_MAX)));
+    header.sourceSize = sourceSize;
+    header.sourceWriteTime = sourceWriteTime;
+
+    std::string tmpPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+
+        WritePod(file, header);
+        for (uint16_t i = 0; i < header.serviceCount; i++) {
+            const PreloadService& service = services[i];
+            PreloadCacheService record{};
+            record.nameLength = static_cast<uint16_t>((std::min)(service.name.size(), size_t(UINT16_MAX)));
+            record.enabled = service.enabled ? 1 : 0;
+            record.rangeCount = static_cast<uint32_t>(service.ranges.size());
+            record.range6Count = static_cast<uint32_t>(service.ranges6.size());
+
+            WritePod(file, record);
+            file.write(service.name.data(), record.nameLength);
+            file.write(reinterpret_cast<const char*>(service.ranges.data()),
+                static_cast<std::streamsize>(service.ranges.size() * sizeof(RouteKey)));
+            for (const Route6Key& key : service.ranges6) {
+                WritePod(file, PreloadCacheRange6{ key.address.hi, key.address.lo, key.prefixLength });
+            }
+        }
+
+        if (!file.good()) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    return !ec;
+}
@@ -0,0 +1,56 @@
+// src/service/PreloadSet.h
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Ipv6Address.h"
+#include "RouteTable.h"
+
+// Preload ranges as they appear in preload_ips.json
+struct PreloadSource {
+    std::string name;
+    bool enabled = true;
+    std::vector<std::string> ranges;
+};
+
+struct PreloadService {
+    std::string name;
+    bool enabled = true;
+    std::vector<RouteKey> ranges;           // Замаскированы, без покрытых, соседи слиты; по возрастанию
+    std::vector<Route6Key> ranges6;
+};
+
+// Compiled form of the preload config. Ranges are validated, masked,
+// deduplicated and sibling-merged once per service when the config file
+// changes; the result is cached in a packed binary file next to it, so an
+// unchanged config is loaded without jsoncpp. A range listed under two
+// services stays in both: the route belongs to whichever installs it first.
+class PreloadSet {
+public:
+    // Кэш, если он снят с этой же версии источника (размер и mtime), иначе компиляция JSON.
+    // nullptr - источник не читается и не разбирается
+    static std::shared_ptr<const PreloadSet> Load(const std::string& sourcePath, const std::string& cachePath);
+    static std::shared_ptr<const PreloadSet> Compile(const std::vector<PreloadSource>& sources);
+
+    // Источник не менялся с момента компиляции
+    bool IsCurrent(const std::string& sourcePath) const;
+
+    const std::vector<PreloadService>& Services() const { return services; }
+    const PreloadService* Find(std::string_view name) const;
+    size_t RangeCount() const;
+
+private:
+    static constexpr uint32_t CACHE_MAGIC = 0x4C504D52;     // "RMPL"
+    static constexpr uint16_t CACHE_VERSION = 1;
+
+    std::vector<PreloadService> services;
+    uint64_t sourceSize = 0;
+    int64_t sourceWriteTime = 0;
+
+    static bool StatSource(const std::string& sourcePath, uint64_t& size, int64_t& writeTime);
+    static bool ParseSource(const std::string& sourcePath, std::vector<PreloadSource>& sources);
+    bool ReadCache(const std::string& cachePath);
+    bool WriteCache(const std::string& cachePath) const;
+};
@@ -0,0 +1,167 @@
+// src/service/ProcessEventTracer.cpp
+#include "ProcessEventTracer.h"
+#include "PerformanceMonitor.h"
+#include "../common/Logger.h"
+#include <tdh.h>
+#include <cstring>
+#include <format>
+#include <string>
+
+#pragma comment(lib, "tdh.lib")
+
+namespace {
+    // Microsoft-Windows-Kernel-Process
+    constexpr GUID KERNEL_PROCESS_PROVIDER =
+    { 0x22FB2CD6, 0x0E7B, 0x422B, { 0xA0, 0xC7, 0x2F, 0xAD, 0x1F, 0xD0, 0xE7, 0x16 } };
+
+    bool ReadUInt32Property(PEVENT_RECORD record, const wchar_t* name, ULONG& value) {
+        PROPERTY_DATA_DESCRIPTOR descriptor{};
+        descriptor.PropertyName = reinterpret_cast<ULONGLONG>(name);
+        descriptor.ArrayIndex = ULONG_MAX;
+        return TdhGetProperty(record, 0, nullptr, 1, &descriptor, sizeof(value),
+            reinterpret_cast<PBYTE>(&value)) == ERROR_SUCCESS;
+    }
+
+    bool ReadStringProperty(PEVENT_RECORD record, const wchar_t* name, std::wstring& value) {
+        PROPERTY_DATA_DESCRIPTOR descriptor{};
+        descriptor.PropertyName = reinterpret_cast<ULONGLONG>(name);
+        descriptor.ArrayIndex = ULONG_MAX;
+
+        ULONG size = 0;
+        if (TdhGetPropertySize(record, 0, nullptr, 1, &descriptor, &size) != ERROR_SUCCESS || size < sizeof(wchar_t)) {
+            return false;
+        }
+
+        value.resize(size / sizeof(wchar_t));
+        if (TdhGetProperty(record, 0, nullptr, 1, &descriptor, size, reinterpret_cast<PBYTE>(value.data())) != ERROR_SUCCESS) {
+            return false;
+        }
+        value.resize(wcsnlen(value.c_str(), value.size()));
+        return true;
+    }
+}
+
+ProcessEventTracer::ProcessEventTracer(StartCallback startCallback, StopCallback stopCallback)
+    : onStart(std::move(startCallback)), onStop(std::move(stopCallback)) {
+}
+
+ProcessEventTracer::~ProcessEventTracer() {
+    Stop();
+}
+
+EVENT_TRACE_PROPERTIES* ProcessEventTracer::ResetProperties() {
+    size_t nameBytes = (wcslen(SESSION_NAME) + 1) * sizeof(wchar_t);
+    properties.assign(sizeof(EVENT_TRACE_PROPERTIES) + nameBytes, 0);
+
+    auto* props = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(properties.data());
+    props->Wnode.BufferSize = static_cast<ULONG>(properties.size());
+    props->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    props->Wnode.ClientContext = 1;     // QPC
+    props->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+    props->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+    return props;
+}
+
+bool ProcessEventTracer::Start() {
+    if (running.load()) {
+        return true;
+    }
+
+    ULONG status = StartTraceW(&sessionHandle, SESSION_NAME, ResetProperties());
+    if (status == ERROR_ALREADY_EXISTS) {
+        // Сессия пережила аварийное завершение прошлого экземпляра
+        ControlTraceW(0, SESSION_NAME, ResetProperties(), EVENT_TRACE_CONTROL_STOP);
+        status = StartTraceW(&sessionHandle, SESSION_NAME, ResetProperties());
+    }
+    if (status != ERROR_SUCCESS) {
+        Logger::Instance().Warning(std::format("ProcessEventTracer::Start - StartTrace failed: {}", status));
+        sessionHandle = 0;
+        return false;
+    }
+
+    status = EnableTraceEx2(sessionHandle, &KERNEL_PROCESS_PROVIDER, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+        TRACE_LEVEL_INFORMATION, KEYWORD_PROCESS, 0, 0, nullptr);
+    if (status != ERROR_SUCCESS) {
+        Logger::Instance().Warning(std::format("ProcessEventTracer::Start - EnableTraceEx2 failed: {}", status));
+        StopSession();
+        return false;
+    }
+
+    EVENT_TRACE_LOGFILEW logFile{};
+    logFile.LoggerName = const_cast<LPWSTR>(SESSION_NAME);
+    logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
+    logFile.EventRecordCallback = &ProcessEventTracer::OnEventRecord;
+    logFile.Context = this;
+
+    traceHandle = OpenTraceW(&logFile);
+    if (traceHandle == INVALID_PROCESSTRACE_HANDLE) {
+        Logger::Instance().Warning(std::format("ProcessEventTracer::Start - OpenTrace failed: {}", GetLastError()));
+        StopSession();
+        return false;
+    }
+
+    running = true;
+    // ProcessTrace блокирует поток до CloseTrace
+    traceThread = std::jthread([this](std::stop_token) {
+        ULONG result = ProcessTrace(&traceHandle, 1, nullptr, nullptr);
+        if (result != ERROR_SUCCESS && result != ERROR_CANCELLED) {
+            Logger::Instance().Warning(std::format("ProcessEventTracer - ProcessTrace ended: {}", result));
+        }
+        running = false;
+    });
+
+    Logger::Instance().Info("ProcessEventTracer::Start - Kernel process trace started");
+    return true;
+}
+
+void ProcessEventTracer::Stop() {
+    if (traceHandle != INVALID_PROCESSTRACE_HANDLE) {
+        CloseTrace(traceHandle);
+    }
+    StopSession();
+
+    if (traceThread.joinable()) {
+        traceThread.join();
+    }
+    traceHandle = INVALID_PROCESSTRACE_HANDLE;
+    running = false;
+}
+
+void ProcessEventTracer::StopSession() {
+    if (sessionHandle != 0) {
+        ControlTraceW(sessionHandle, nullptr, ResetProperties(), EVENT_TRACE_CONTROL_STOP);
+        sessionHandle = 0;
+    }
+}
+
+void WINAPI ProcessEventTracer::OnEventRecord(PEVENT_RECORD record) {
+    auto* self = static_cast<ProcessEventTracer*>(record->UserContext);
+    if (self && IsEqualGUID(record->EventHeader.ProviderId, KERNEL_PROCESS_PROVIDER)) {
+        self->HandleEvent(record);
+    }
+}
+
+void ProcessEventTracer::HandleEvent(PEVENT_RECORD record) {
+    USHORT id = record->EventHeader.EventDescriptor.Id;
+    if (id != EVENT_PROCESS_START && id != EVENT_PROCESS_STOP) {
+        return;
+    }
+
+    // EventHeader.ProcessId у старта - родитель, поэтому pid берём из полезной нагрузки
+    ULONG pid = 0;
+    if (!ReadUInt32Property(record, L"ProcessID", pid) || pid == 0) {
+        PERF_COUNT("ProcessEventTracer.BadEvent");
+        return;
+    }
+
+    if (id == EVENT_PROCESS_START) {
+        std::wstring imagePath;
+        ReadStringProperty(record, L"ImageName", imagePath);
+        PERF_COUNT("ProcessEventTracer.Start");
+        if (onStart) onStart(pid, imagePath);
+    }
+    else {
+        PERF_COUNT("ProcessEventTracer.Stop");
+        if (onStop) onStop(pid);
+    }
+}
@@ -0,0 +1,50 @@
+// src/service/ProcessEventTracer.h
+#pragma once
+#include <windows.h>
+#include <evntrace.h>
+#include <evntcons.h>
+#include <atomic>
+#include <functional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Real-time ETW session on the Microsoft-Windows-Kernel-Process provider.
+// Reports process start (with the NT image path) and stop as they happen,
+// so the PID cache is maintained incrementally instead of being rebuilt
+// from periodic snapshots. Callbacks run one at a time on the trace thread.
+// Needs administrator rights, which the service already has; Start() fails
+// cleanly otherwise and the caller keeps polling.
+class ProcessEventTracer {
+public:
+    using StartCallback = std::function<void(DWORD pid, std::wstring_view imagePath)>;
+    using StopCallback = std::function<void(DWORD pid)>;
+
+    ProcessEventTracer(StartCallback onStart, StopCallback onStop);
+    ~ProcessEventTracer();
+
+    bool Start();
+    void Stop();
+    [[nodiscard]] bool IsRunning() const { return running.load(); }
+
+private:
+    static constexpr const wchar_t* SESSION_NAME = L"RouteManagerPro-ProcessTrace";
+    static constexpr ULONGLONG KEYWORD_PROCESS = 0x10;     // WINEVENT_KEYWORD_PROCESS
+    static constexpr USHORT EVENT_PROCESS_START = 1;
+    static constexpr USHORT EVENT_PROCESS_STOP = 2;
+
+    StartCallback onStart;
+    StopCallback onStop;
+
+    TRACEHANDLE sessionHandle = 0;
+    TRACEHANDLE traceHandle = INVALID_PROCESSTRACE_HANDLE;
+    std::vector<uint8_t> properties;    // EVENT_TRACE_PROPERTIES и имя сессии за ними
+    std::jthread traceThread;
+    std::atomic<bool> running{ false };
+
+    EVENT_TRACE_PROPERTIES* ResetProperties();
+    void StopSession();
+
+    static void WINAPI OnEventRecord(PEVENT_RECORD record);
+    void HandleEvent(PEVENT_RECORD record);
+};
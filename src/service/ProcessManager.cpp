@@ -4,13 +4,19 @@
 #include "../common/Logger.h"
 #include "../common/ShutdownCoordinator.h"
 #include "PerformanceMonitor.h"
+#include "../common/Constants.h"
 #include <windows.h>
 #include <tlhelp32.h>
 #include <psapi.h>
 #include <algorithm>
 #include <format>
 #include <ranges>
-#include <execution>
+
+namespace {
+    uint64_t FileTimeValue(const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    }
+}
 
 ProcessManager::ProcessManager(const ServiceConfig& config, const PerformanceConfig& perfCfg)
     : running(true), perfConfig(perfCfg), m_pidMissCache(perfCfg.missCacheMaxSize),
@@ -19,8 +25,20 @@ ProcessManager::ProcessManager(const ServiceConfig& config, const PerformanceCon
 
     Logger::Instance().Debug("ProcessManager::ProcessManager - Constructor called");
 
+    perfConfig.mainCacheMaxSize = (std::max)(perfConfig.mainCacheMaxSize, size_t{ 1 });
+    clockReferenced = std::make_unique<std::atomic<uint8_t>[]>(perfConfig.mainCacheMaxSize);
+    clockVerifiedMs = std::make_unique<std::atomic<uint64_t>[]>(perfConfig.mainCacheMaxSize);
+    clockPids.assign(perfConfig.mainCacheMaxSize, 0);
+    ResetClockLocked();
+    pidView.store(std::make_shared<const PidCacheView>());
+
+    processVersion = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    removedFloor = processVersion;
+
     selectedProcesses.clear();
     selectedProcesses.insert(config.selectedProcesses.begin(), config.selectedProcesses.end());
+    selectionMatcher.store(std::make_shared<const ProcessSelectionMatcher>(config.selectedProcesses));
 
     Logger::Instance().Info(std::format("ProcessManager initialized with {} selected processes:",
         selectedProcesses.size()));
@@ -28,21 +46,64 @@ ProcessManager::ProcessManager(const ServiceConfig& config, const PerformanceCon
         Logger::Instance().Info(std::format("  - {}", proc));
     }
 
+    processTracer = std::make_unique<ProcessEventTracer>(
+        [this](DWORD pid, std::wstring_view imagePath) { OnProcessStarted(pid, imagePath); },
+        [this](DWORD pid) { OnProcessStopped(pid); });
+    if (!processTracer->Start()) {
+        Logger::Instance().Warning(std::format("ProcessManager - ETW process trace unavailable, polling every {}s",
+            Constants::PROCESS_SNAPSHOT_INTERVAL_SEC));
+    }
+
     updateThread = std::jthread([this](std::stop_token token) { UpdateThreadFunc(token); });
 }
 
 ProcessManager::~ProcessManager() {
     Logger::Instance().Debug("ProcessManager::~ProcessManager - Destructor called");
     running = false;
+    // Поток обновления читает processTracer, поэтому дожидаемся его до остановки сессии
+    if (updateThread.joinable()) {
+        updateThread.request_stop();
+        updateThread.join();
+    }
+    // Колбэки трассировки обращаются к кэшам, сессию останавливаем до разрушения членов
+    processTracer.reset();
 }
 
 bool ProcessManager::IsSelectedProcessByPid(DWORD pid) {
     PERF_TIMER("ProcessManager::IsSelectedProcessByPid");
 
-    // Check cache first
+    if (pidViewStale.load(std::memory_order_relaxed)) {
+        PublishStalePidView();
+    }
+
+    // Горячий путь: опубликованный view, без блокировок и копий CachedProcessInfo
+    {
+        auto view = pidView.load(std::memory_order_acquire);
+        if (const PidCacheView::Slot* slot = view->Find(pid)) {
+            // Раз в verificationInterval сверяем creationTime: PID мог достаться новому процессу
+            const uint64_t intervalMs = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(perfConfig.verificationInterval).count());
+            auto& verified = clockVerifiedMs[slot->clockSlot];
+            uint64_t nowMs = GetTickCount64();
+            bool fresh = nowMs - verified.load(std::memory_order_relaxed) < intervalMs;
+            if (!fresh && ConfirmCreationTime(pid, slot->creationTime)) {
+                verified.store(nowMs, std::memory_order_relaxed);
+                stats.verificationChecks.fetch_add(1, std::memory_order_relaxed);
+                fresh = true;
+            }
+            if (fresh) {
+                MarkReferenced(slot->clockSlot);
+                RecordLookup(true);
+                return slot->isSelected;
+            }
+            DropReusedPid(pid, slot->creationTime);
+        }
+    }
+
+    // Check miss cache (with promotion) before doing a full lookup
     auto cachedInfo = GetCachedInfo(pid);
     if (cachedInfo.has_value()) {
-        stats.hits.fetch_add(1, std::memory_order_relaxed);
+        RecordLookup(true);
         return cachedInfo->isSelected;
     }
 
@@ -52,23 +113,18 @@ bool ProcessManager::IsSelectedProcessByPid(DWORD pid) {
         // CRITICAL FIX: Add to BOTH caches immediately
         {
             std::unique_lock lock(cachesMutex);
-
-            // Add to main cache if there's room
-            if (m_pidCache.size() < perfConfig.mainCacheMaxSize) {
-                m_pidCache[pid] = *info;
-                Logger::Instance().Debug(std::format("Added PID {} to main cache immediately", pid));
-            }
+            MarkPidViewStaleLocked(AddToPidCacheLocked(pid, *info));
         }
 
         // Also add to miss cache for redundancy
-        m_pidMissCache.put(pid, *info);
+        m_pidMissCache.Put(pid, *info);
 
-        stats.misses.fetch_add(1, std::memory_order_relaxed);
+        RecordLookup(false);
         stats.newProcessChecks.fetch_add(1, std::memory_order_relaxed);
         return info->isSelected;
     }
 
-    stats.misses.fetch_add(1, std::memory_order_relaxed);
+    RecordLookup(false);
     return false;
 }
 
@@ -78,46 +134,30 @@ std::optional<CachedProcessInfo> ProcessManager::GetCachedInfo(DWORD pid) {
         std::shared_lock lock(cachesMutex);
 
         if (auto it = m_pidCache.find(pid); it != m_pidCache.end()) {
-            // OPTIMIZATION: Update access time for LRU-like behavior
-            it->second.lastVerified = std::chrono::steady_clock::now();
-            stats.hits.fetch_add(1, std::memory_order_relaxed);
+            // Под shared-блокировкой пишем только атомарный бит CLOCK
+            MarkReferenced(it->second.clockSlot);
+            RecordLookup(true);
             return it->second;
         }
     }
 
     // Check miss cache
-    auto missInfo = m_pidMissCache.get(pid);
+    auto missInfo = m_pidMissCache.Get(pid);
     if (missInfo.has_value()) {
         // OPTIMIZATION: Promote from miss cache to main cache if frequently accessed
         PromoteToMainCache(pid, *missInfo);
-        stats.hits.fetch_add(1, std::memory_order_relaxed);
+        RecordLookup(true);
         return missInfo;
     }
 
-    stats.misses.fetch_add(1, std::memory_order_relaxed);
+    RecordLookup(false);
     return std::nullopt;
 }
 
 void ProcessManager::PromoteToMainCache(DWORD pid, const CachedProcessInfo& info) {
     std::unique_lock lock(cachesMutex);
-
-    // Only promote if there's room or if we can evict old entries
-    if (m_pidCache.size() >= perfConfig.mainCacheMaxSize) {
-        // Find and remove the oldest entry
-        auto oldest = std::min_element(m_pidCache.begin(), m_pidCache.end(),
-            [](const auto& a, const auto& b) {
-                return a.second.lastVerified < b.second.lastVerified;
-            });
-
-        if (oldest != m_pidCache.end()) {
-            Logger::Instance().Debug(std::format("Evicting old PID {} from main cache", oldest->first));
-            m_pidCache.erase(oldest);
-            stats.cacheEvictions.fetch_add(1, std::memory_order_relaxed);
-        }
-    }
-
-    m_pidCache[pid] = info;
-    Logger::Instance().Debug(std::format("Promoted PID {} from miss cache to main cache", pid));
+    MarkPidViewStaleLocked(AddToPidCacheLocked(pid, info));
+    LOG_DEBUG("Promoted PID {} from miss cache to main cache", pid);
 }
 
 std::optional<CachedProcessInfo> ProcessManager::CheckProcessAndCache(DWORD pid) {
@@ -133,11 +173,9 @@ std::optional<CachedProcessInfo> ProcessManager::CheckProcessAndCache(DWORD pid)
         // Add to both caches
         {
             std::unique_lock lock(cachesMutex);
-            if (m_pidCache.size() < perfConfig.mainCacheMaxSize) {
-                m_pidCache[pid] = *info;
-            }
+            MarkPidViewStaleLocked(AddToPidCacheLocked(pid, *info));
         }
-        m_pidMissCache.put(pid, *info);
+        m_pidMissCache.Put(pid, *info);
         return info;
     }
 
@@ -149,32 +187,203 @@ void ProcessManager::UpdateVerificationTime(DWORD pid) {
 
     if (auto it = m_pidCache.find(pid); it != m_pidCache.end()) {
         it->second.lastVerified = std::chrono::steady_clock::now();
+        clockVerifiedMs[it->second.clockSlot].store(GetTickCount64(), std::memory_order_relaxed);
+        MarkReferenced(it->second.clockSlot);
         stats.verificationChecks.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
 void ProcessManager::AddToPidCache(DWORD pid, const CachedProcessInfo& info) {
     std::unique_lock lock(cachesMutex);
+    MarkPidViewStaleLocked(AddToPidCacheLocked(pid, info));
+}
 
-    if (m_pidCache.size() >= perfConfig.mainCacheMaxSize) {
-        // Evict oldest entry
-        auto oldest = std::min_element(m_pidCache.begin(), m_pidCache.end(),
-            [](const auto& a, const auto& b) {
-                return a.second.lastVerified < b.second.lastVerified;
-            });
+bool ProcessManager::AddToPidCacheLocked(DWORD pid, const CachedProcessInfo& info) {
+    // View, где этот PID принадлежит другому процессу, нельзя оставлять до следующего перестроения
+    const PidCacheView::Slot* published = pidView.load(std::memory_order_relaxed)->Find(pid);
+    bool reused = published && published->creationTime != FileTimeValue(info.creationTime);
 
-        if (oldest != m_pidCache.end()) {
-            m_pidCache.erase(oldest);
-            stats.cacheEvictions.fetch_add(1, std::memory_order_relaxed);
+    if (auto it = m_pidCache.find(pid); it != m_pidCache.end()) {
+        uint32_t slot = it->second.clockSlot;
+        it->second = info;
+        it->second.clockSlot = slot;
+        clockVerifiedMs[slot].store(GetTickCount64(), std::memory_order_relaxed);
+        MarkReferenced(slot);
+        return reused;
+    }
+
+    uint32_t slot;
+    if (!freeClockSlots.empty()) {
+        slot = freeClockSlots.back();
+        freeClockSlots.pop_back();
+    }
+    else {
+        slot = EvictClockSlotLocked();
+    }
+
+    clockPids[slot] = pid;
+    clockReferenced[slot].store(1, std::memory_order_relaxed);
+    clockVerifiedMs[slot].store(GetTickCount64(), std::memory_order_relaxed);
+    CachedProcessInfo& entry = m_pidCache.insert_or_assign(pid, info).first->second;
+    entry.clockSlot = slot;
+    return reused;
+}
+
+uint32_t ProcessManager::EvictClockSlotLocked() {
+    // Стрелка сбрасывает биты ссылок; вытесняется первый слот без обращений за круг, максимум два оборота
+    const size_t capacity = clockPids.size();
+    for (;;) {
+        size_t hand = clockHand;
+        clockHand = (clockHand + 1) % capacity;
+
+        if (clockPids[hand] == 0) {
+            return static_cast<uint32_t>(hand);
+        }
+        if (clockReferenced[hand].exchange(0, std::memory_order_relaxed) != 0) {
+            continue;
+        }
+
+        m_pidCache.erase(clockPids[hand]);
+        clockPids[hand] = 0;
+        stats.cacheEvictions.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<uint32_t>(hand);
+    }
+}
+
+void ProcessManager::ErasePidLocked(DWORD pid) {
+    auto it = m_pidCache.find(pid);
+    if (it == m_pidCache.end()) {
+        return;
+    }
+    uint32_t slot = it->second.clockSlot;
+    if (slot < clockPids.size() && clockPids[slot] == pid) {
+        clockPids[slot] = 0;
+        freeClockSlots.push_back(slot);
+    }
+    m_pidCache.erase(it);
+}
+
+void ProcessManager::ResetClockLocked() {
+    // После замены кэша снимком раздаём слоты заново; лишнее сверх ёмкости отбрасываем
+    const size_t capacity = clockPids.size();
+    while (m_pidCache.size() > capacity) {
+        m_pidCache.erase(m_pidCache.begin());
+        stats.cacheEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::fill(clockPids.begin(), clockPids.end(), 0);
+    uint32_t next = 0;
+    uint64_t nowMs = GetTickCount64();
+    for (auto& [pid, info] : m_pidCache) {
+        info.clockSlot = next;
+        clockPids[next] = pid;
+        clockReferenced[next].store(1, std::memory_order_relaxed);
+        clockVerifiedMs[next].store(nowMs, std::memory_order_relaxed);
+        next++;
+    }
+
+    freeClockSlots.clear();
+    for (size_t slot = capacity; slot > next; slot--) {
+        freeClockSlots.push_back(static_cast<uint32_t>(slot - 1));
+    }
+    clockHand = 0;
+}
+
+void ProcessManager::PublishPidViewLocked() {
+    PERF_COUNT("ProcessManager.PidView.Published");
+    pidView.store(std::make_shared<const PidCacheView>(m_pidCache), std::memory_order_release);
+    pidViewPublishedMs.store(GetTickCount64(), std::memory_order_relaxed);
+    pidViewStale.store(false, std::memory_order_relaxed);
+}
+
+void ProcessManager::MarkPidViewStaleLocked(bool reused) {
+    // Одиночное изменение после паузы публикуется сразу, всплеск - одним перестроением за интервал
+    if (reused || GetTickCount64() - pidViewPublishedMs.load(std::memory_order_relaxed) >=
+        Constants::PID_VIEW_PUBLISH_INTERVAL_MS) {
+        PublishPidViewLocked();
+        return;
+    }
+    pidViewStale.store(true, std::memory_order_relaxed);
+}
+
+void ProcessManager::PublishStalePidView() {
+    if (GetTickCount64() - pidViewPublishedMs.load(std::memory_order_relaxed) < Constants::PID_VIEW_PUBLISH_INTERVAL_MS) {
+        return;
+    }
+    // Блокировку держит писатель - перестроит он или следующий воркер
+    std::unique_lock lock(cachesMutex, std::try_to_lock);
+    if (lock.owns_lock() && pidViewStale.load(std::memory_order_relaxed)) {
+        PublishPidViewLocked();
+    }
+}
+
+bool ProcessManager::ConfirmCreationTime(DWORD pid, uint64_t creationTime) const {
+    // Время создания неизвестно (процесс был закрыт для запросов) - сверять не с чем
+    if (creationTime == 0) {
+        return true;
+    }
+    UniqueHandle process(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid), HandleDeleter{});
+    FILETIME created, exited, kernelTime, userTime;
+    return process && GetProcessTimes(process.get(), &created, &exited, &kernelTime, &userTime) &&
+        FileTimeValue(created) == creationTime;
+}
+
+void ProcessManager::DropReusedPid(DWORD pid, uint64_t creationTime) {
+    PERF_COUNT("ProcessManager.PidCache.Reused");
+    {
+        std::unique_lock lock(cachesMutex);
+        // Запись уже могли заменить свежей - её не трогаем
+        if (auto it = m_pidCache.find(pid); it != m_pidCache.end() &&
+            FileTimeValue(it->second.creationTime) == creationTime) {
+            ErasePidLocked(pid);
         }
+        PublishPidViewLocked();
     }
+    m_pidMissCache.Erase(pid);
+    LOG_DEBUG("ProcessManager - PID {} no longer belongs to the cached process", pid);
+}
 
-    m_pidCache[pid] = info;
+void ProcessManager::MarkReferenced(uint32_t clockSlot) const {
+    // Читаем перед записью, чтобы горячие попадания не гоняли строку кэша между ядрами
+    auto& referenced = clockReferenced[clockSlot];
+    if (referenced.load(std::memory_order_relaxed) == 0) {
+        referenced.store(1, std::memory_order_relaxed);
+    }
 }
 
 std::vector<ProcessInfo> ProcessManager::GetAllProcesses() const {
     std::shared_lock lock(cachesMutex);
-    return allProcesses;
+    std::vector<ProcessInfo> processes;
+    processes.reserve(processEntries.size());
+    for (const auto& [pid, entry] : processEntries) {
+        processes.push_back(entry.info);
+    }
+    return processes;
+}
+
+ProcessListDelta ProcessManager::GetProcessChangesSince(uint64_t since) const {
+    PERF_TIMER("ProcessManager::GetProcessChangesSince");
+
+    ProcessListDelta delta;
+    std::shared_lock lock(cachesMutex);
+    delta.version = processVersion;
+    delta.fullResync = since < removedFloor || since > processVersion;
+    if (!delta.fullResync && since == processVersion) {
+        return delta;
+    }
+
+    // Сотни записей: проход по всем дешевле, чем держать отдельный индекс по версиям
+    for (const auto& [pid, entry] : processEntries) {
+        if (delta.fullResync || entry.version > since) {
+            delta.upserts.push_back(entry.info);
+        }
+    }
+    if (!delta.fullResync) {
+        for (auto it = removedProcesses.rbegin(); it != removedProcesses.rend() && it->second > since; ++it) {
+            delta.removed.push_back(it->first);
+        }
+    }
+    return delta;
 }
 
 bool ProcessManager::IsProcessSelected(const std::string& processName) const {
@@ -182,46 +391,52 @@ bool ProcessManager::IsProcessSelected(const std::string& processName) const {
 }
 
 bool ProcessManager::IsProcessSelectedInternal(const std::string& processName) const {
-    std::lock_guard<std::mutex> lock(selectedMutex);
-
-    if (selectedProcesses.size() > 100) {
-        return std::any_of(std::execution::par_unseq,
-            selectedProcesses.begin(), selectedProcesses.end(),
-            [&processName, this](const auto& selected) {
-                if (selected.contains('*')) {
-                    return MatchesWildcard(processName, selected);
-                }
-                return _stricmp(processName.c_str(), selected.c_str()) == 0;
-            });
-    }
-    else {
-        return std::ranges::any_of(selectedProcesses, [&processName, this](const auto& selected) {
-            if (selected.contains('*')) {
-                return MatchesWildcard(processName, selected);
-            }
-            return _stricmp(processName.c_str(), selected.c_str()) == 0;
-            });
-    }
+    return selectionMatcher.load(std::memory_order_acquire)->Matches(processName);
 }
 
 void ProcessManager::SetSelectedProcesses(const std::vector<std::string>& processes) {
+    // Компилируем вне блокировок; записи, добавленные после store, сразу получают новый вердикт
+    auto matcher = std::make_shared<const ProcessSelectionMatcher>(processes);
     {
         std::lock_guard<std::mutex> lock(selectedMutex);
         selectedProcesses.clear();
         selectedProcesses.insert(processes.begin(), processes.end());
     }
+    selectionMatcher.store(matcher, std::memory_order_release);
+
+    // Вердикты считаем под shared-блокировкой: монитор тем временем читает прежний view
+    std::vector<std::pair<DWORD, bool>> verdicts;
+    {
+        std::shared_lock lock(cachesMutex);
+        verdicts.reserve(m_pidCache.size());
+        for (const auto& [pid, info] : m_pidCache) {
+            verdicts.emplace_back(pid, matcher->Matches(CachedWStringToString(info.name)));
+        }
+    }
 
-    // Don't clear caches completely - just mark entries as needing verification
+    // Don't clear caches completely - just apply the new verdicts
     {
         std::unique_lock lock(cachesMutex);
-        for (auto& [pid, info] : m_pidCache) {
-            // Recalculate isSelected for existing entries
-            info.isSelected = IsProcessSelectedInternal(CachedWStringToString(info.name));
+        for (const auto& [pid, selected] : verdicts) {
+            if (auto it = m_pidCache.find(pid); it != m_pidCache.end()) {
+                it->second.isSelected = selected;
+            }
         }
+        for (auto& [pid, entry] : processEntries) {
+            auto it = m_pidCache.find(pid);
+            if (it != m_pidCache.end() && entry.info.isSelected != it->second.isSelected) {
+                entry.info.isSelected = it->second.isSelected;
+                entry.version = ++processVersion;
+            }
+        }
+        PublishPidViewLocked();
     }
 
+    Logger::Instance().Info(std::format("ProcessManager - Selection compiled: {} exact names, {} wildcard patterns",
+        matcher->ExactCount(), matcher->WildcardCount()));
+
     // Clear miss cache as it might have outdated selection info
-    m_pidMissCache.clear();
+    m_pidMissCache.Clear();
 }
 
 std::vector<std::string> ProcessManager::GetSelectedProcesses() const {
@@ -234,11 +449,19 @@ void ProcessManager::UpdateThreadFunc(std::stop_token stopToken) {
 
     std::mutex updateMutex;
     std::condition_variable_any updateCV;
+    // С ETW уже запущенные процессы известны только из снимка, поэтому первый делаем сразу
+    bool firstPass = true;
 
     while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
         std::unique_lock<std::mutex> lock(updateMutex);
 
-        if (updateCV.wait_for(lock, stopToken, std::chrono::seconds(5),
+        bool eventDriven = processTracer && processTracer->IsRunning();
+        auto interval = std::chrono::seconds(eventDriven
+            ? (firstPass ? 0 : Constants::PROCESS_RECONCILE_INTERVAL_SEC)
+            : Constants::PROCESS_SNAPSHOT_INTERVAL_SEC);
+        firstPass = false;
+
+        if (updateCV.wait_for(lock, stopToken, interval,
             [&stopToken] { return stopToken.stop_requested(); })) {
             break;
         }
@@ -250,6 +473,7 @@ void ProcessManager::UpdateThreadFunc(std::stop_token stopToken) {
         try {
             PERF_TIMER("ProcessManager::UpdateSnapshot");
 
+            auto snapshotStart = std::chrono::steady_clock::now();
             auto newCache = BuildProcessSnapshot();
 
             // Merge with existing cache to preserve frequently accessed entries
@@ -257,24 +481,20 @@ void ProcessManager::UpdateThreadFunc(std::stop_token stopToken) {
 
             {
                 std::unique_lock lock(cachesMutex);
+                // Процессы, добавленные ETW-событиями во время обхода, снимок мог не застать
+                for (auto& [pid, info] : m_pidCache) {
+                    if (info.lastVerified >= snapshotStart) {
+                        newCache.try_emplace(pid, std::move(info));
+                    }
+                }
                 m_pidCache = std::move(newCache);
+                ResetClockLocked();
+                PublishPidViewLocked();
 
                 // Don't clear miss cache - it has valuable data
-                // m_pidMissCache.clear();
-
-                allProcesses.clear();
-                allProcesses.reserve(m_pidCache.size());
-
-                for (const auto& [pid, info] : m_pidCache) {
-                    ProcessInfo procInfo;
-                    procInfo.name = info.name;
-                    procInfo.executablePath = CachedStringToWString(info.processPath);
-                    procInfo.pid = pid;
-                    procInfo.isSelected = info.isSelected;
-                    procInfo.isGame = Utils::IsGameProcess(CachedWStringToString(info.name));
-                    procInfo.isDiscord = Utils::IsDiscordProcess(CachedWStringToString(info.name));
-                    allProcesses.push_back(std::move(procInfo));
-                }
+                // m_pidMissCache.Clear();
+
+                ReplaceProcessesLocked();
             }
 
             LogPerformanceStats();
@@ -287,6 +507,112 @@ void ProcessManager::UpdateThreadFunc(std::stop_token stopToken) {
     Logger::Instance().Debug("ProcessManager::UpdateThreadFunc - Exiting");
 }
 
+ProcessInfo ProcessManager::MakeProcessInfo(DWORD pid, const CachedProcessInfo& info, const std::wstring& executablePath) {
+    ProcessInfo procInfo;
+    procInfo.name = info.name;
+    procInfo.executablePath = executablePath;
+    procInfo.pid = pid;
+    procInfo.isSelected = info.isSelected;
+    procInfo.isGame = info.isGame;
+    procInfo.isDiscord = info.isDiscord;
+    procInfo.creationTime = FileTimeValue(info.creationTime);
+    return procInfo;
+}
+
+void ProcessManager::UpsertProcessLocked(ProcessInfo&& info) {
+    auto [it, inserted] = processEntries.try_emplace(info.pid);
+    if (!inserted) {
+        if (it->second.info == info) {
+            return;
+        }
+        if (it->second.info.creationTime != info.creationTime) {
+            // PID переиспользован до события стопа: прежний процесс для клиента завершён
+            AddTombstoneLocked(it->second.info);
+        }
+    }
+    it->second.info = std::move(info);
+    it->second.version = ++processVersion;
+}
+
+void ProcessManager::RemoveProcessLocked(DWORD pid) {
+    if (auto it = processEntries.find(pid); it != processEntries.end()) {
+        AddTombstoneLocked(it->second.info);
+        processEntries.erase(it);
+    }
+}
+
+void ProcessManager::AddTombstoneLocked(const ProcessInfo& info) {
+    removedProcesses.push_back({ { info.pid, info.creationTime }, ++processVersion });
+    if (removedProcesses.size() > Constants::PROCESS_TOMBSTONE_CAPACITY) {
+        removedFloor = removedProcesses.front().second;
+        removedProcesses.pop_front();
+    }
+}
+
+// Сверка со свежим снимком: версии получают только действительно изменившиеся процессы
+void ProcessManager::ReplaceProcessesLocked() {
+    for (auto it = processEntries.begin(); it != processEntries.end();) {
+        if (!m_pidCache.contains(it->first)) {
+            AddTombstoneLocked(it->second.info);
+            it = processEntries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    for (const auto& [pid, info] : m_pidCache) {
+        UpsertProcessLocked(MakeProcessInfo(pid, info, CachedStringToWString(info.processPath)));
+    }
+}
+
+void ProcessManager::OnProcessStarted(DWORD pid, std::wstring_view imagePath) {
+    PERF_TIMER("ProcessManager::OnProcessStarted");
+
+    // Классифицируем сразу: первый пакет нового процесса попадёт уже в кэш
+    auto info = GetCompleteProcessInfo(pid);
+    if (!info.has_value()) {
+        // Процесс защищён или уже завершился: хватает имени образа из события
+        if (imagePath.empty()) {
+            return;
+        }
+        size_t slash = imagePath.find_last_of(L'\\');
+        std::wstring name(slash == std::wstring_view::npos ? imagePath : imagePath.substr(slash + 1));
+        std::string narrowName = CachedWStringToString(name);
+
+        info.emplace();
+        info->creationTime = {};
+        info->name = std::move(name);
+        info->processPath = CachedWStringToString(std::wstring(imagePath));
+        info->isSelected = IsProcessSelectedInternal(narrowName);
+        info->isGame = Utils::IsGameProcess(narrowName);
+        info->isDiscord = Utils::IsDiscordProcess(narrowName);
+        info->lastVerified = std::chrono::steady_clock::now();
+    }
+
+    std::wstring executablePath = CachedStringToWString(info->processPath);
+    {
+        std::unique_lock lock(cachesMutex);
+        MarkPidViewStaleLocked(AddToPidCacheLocked(pid, *info));
+        UpsertProcessLocked(MakeProcessInfo(pid, *info, executablePath));
+    }
+    m_pidMissCache.Erase(pid);
+
+    if (info->isSelected) {
+        Logger::Instance().Info(std::format("ProcessManager - Selected process started: {} (PID {})",
+            CachedWStringToString(info->name), pid));
+    }
+}
+
+void ProcessManager::OnProcessStopped(DWORD pid) {
+    {
+        std::unique_lock lock(cachesMutex);
+        ErasePidLocked(pid);
+        MarkPidViewStaleLocked();
+        RemoveProcessLocked(pid);
+    }
+    m_pidMissCache.Erase(pid);
+}
+
 void ProcessManager::MergeWithExistingCache(std::unordered_map<DWORD, CachedProcessInfo>& newCache) {
     std::shared_lock lock(cachesMutex);
 
@@ -361,14 +687,17 @@ std::optional<CachedProcessInfo> ProcessManager::GetCompleteProcessInfo(DWORD pi
     info.creationTime = creationTime;
     info.processPath = CachedWStringToString(path);
     info.name = CachedStringToWString(Utils::GetProcessNameFromPath(info.processPath));
-    info.isSelected = IsProcessSelectedInternal(CachedWStringToString(info.name));
+    std::string narrowName = CachedWStringToString(info.name);
+    info.isSelected = IsProcessSelectedInternal(narrowName);
+    info.isGame = Utils::IsGameProcess(narrowName);
+    info.isDiscord = Utils::IsDiscordProcess(narrowName);
     info.lastVerified = std::chrono::steady_clock::now();
 
     return info;
 }
 
 void ProcessManager::MergeMissCacheIntoMain(std::unordered_map<DWORD, CachedProcessInfo>& mainCache) {
-    m_pidMissCache.forEach([&](DWORD pid, const CachedProcessInfo& cachedInfo) {
+    m_pidMissCache.ForEach([&](DWORD pid, const CachedProcessInfo& cachedInfo) {
         if (!mainCache.contains(pid)) {
             auto currentInfo = GetCompleteProcessInfo(pid);
             if (currentInfo.has_value()) {
@@ -383,6 +712,76 @@ void ProcessManager::GetCacheStats(uint64_t& hits, uint64_t& misses) const {
     misses = stats.misses.load(std::memory_order_relaxed);
 }
 
+size_t ProcessManager::GetCacheMemoryBytes() const {
+    // Узел unordered_map - значение плюс указатель и хэш, корзина - указатель
+    constexpr size_t NODE_OVERHEAD = sizeof(void*) * 2;
+    size_t bytes = 0;
+    {
+        std::shared_lock lock(cachesMutex);
+        bytes += m_pidCache.bucket_count() * sizeof(void*);
+        for (const auto& [pid, info] : m_pidCache) {
+            bytes += sizeof(std::pair<const DWORD, CachedProcessInfo>) + NODE_OVERHEAD +
+                info.name.capacity() * sizeof(wchar_t) + info.processPath.capacity();
+        }
+        bytes += processEntries.bucket_count() * sizeof(void*);
+        for (const auto& [pid, entry] : processEntries) {
+            bytes += sizeof(std::pair<const DWORD, ProcessEntry>) + NODE_OVERHEAD +
+                (entry.info.name.capacity() + entry.info.executablePath.capacity()) * sizeof(wchar_t);
+        }
+        bytes += removedProcesses.size() * sizeof(std::pair<ProcessKey, uint64_t>);
+        bytes += clockPids.capacity() * (sizeof(DWORD) + sizeof(std::atomic<uint8_t>)) +
+            freeClockSlots.capacity() * sizeof(uint32_t);
+    }
+    if (auto view = pidView.load(std::memory_order_acquire)) {
+        bytes += view->MemoryBytes();
+    }
+
+    bytes += m_pidMissCache.MemoryBytes();
+    bytes += m_wstringToStringCache.MemoryBytes() + m_stringToWstringCache.MemoryBytes();
+    m_wstringToStringCache.ForEach([&bytes](const std::wstring& key, const std::string& value) {
+        bytes += key.capacity() * sizeof(wchar_t) + value.capacity();
+        });
+    m_stringToWstringCache.ForEach([&bytes](const std::string& key, const std::wstring& value) {
+        bytes += key.capacity() + value.capacity() * sizeof(wchar_t);
+        });
+    return bytes;
+}
+
+void ProcessManager::TrimCaches(MemoryPressure pressure) {
+    if (pressure == MemoryPressure::Normal) {
+        return;
+    }
+
+    size_t released = 0;
+    if (pressure == MemoryPressure::Shed) {
+        released = m_pidMissCache.Size() + m_wstringToStringCache.Size() + m_stringToWstringCache.Size();
+        m_pidMissCache.Clear();
+        m_wstringToStringCache.Clear();
+        m_stringToWstringCache.Clear();
+    }
+    else {
+        // Холодная половина: записи с битом ссылки CLOCK переживают ужатие
+        released += m_pidMissCache.Shrink(m_pidMissCache.Size() / 2);
+        released += m_wstringToStringCache.Shrink(m_wstringToStringCache.Size() / 2);
+        released += m_stringToWstringCache.Shrink(m_stringToWstringCache.Size() / 2);
+    }
+    LOG_DEBUG("ProcessManager::TrimCaches - Released {} cache entries", released);
+}
+
+void ProcessManager::RecordLookup(bool hit) {
+    (hit ? stats.hits : stats.misses).fetch_add(1, std::memory_order_relaxed);
+    uint64_t hits = stats.hits.load(std::memory_order_relaxed);
+    uint64_t misses = stats.misses.load(std::memory_order_relaxed);
+    PERF_GAUGE("ProcessManager.Cache.HitRatePercent", hits * 100 / (std::max)(hits + misses, uint64_t{ 1 }));
+}
+
+void ProcessManager::RecordStringLookup(bool hit) {
+    (hit ? stats.stringCacheHits : stats.stringCacheMisses).fetch_add(1, std::memory_order_relaxed);
+    uint64_t hits = stats.stringCacheHits.load(std::memory_order_relaxed);
+    uint64_t misses = stats.stringCacheMisses.load(std::memory_order_relaxed);
+    PERF_GAUGE("ProcessManager.StringCache.HitRatePercent", hits * 100 / (std::max)(hits + misses, uint64_t{ 1 }));
+}
+
 void ProcessManager::LogPerformanceStats() const {
     auto hits = stats.hits.load(std::memory_order_relaxed);
     auto misses = stats.misses.load(std::memory_order_relaxed);
@@ -402,61 +801,16 @@ void ProcessManager::LogPerformanceStats() const {
     ));
 
     Logger::Instance().Info(std::format(
-        "String Cache: {} hits, {} misses ({:.1f}% hit rate)",
-        stringHits, stringMisses, stringHitRate
+        "String Cache: {} hits, {} misses ({:.1f}% hit rate), {} evictions",
+        stringHits, stringMisses, stringHitRate,
+        m_wstringToStringCache.GetStats().evictions + m_stringToWstringCache.GetStats().evictions
     ));
-}
-
-bool ProcessManager::MatchesWildcard(const std::string& processName, const std::string& pattern) const {
-    static thread_local std::unordered_map<std::string, bool> matchCache;
-
-    std::string cacheKey = processName + "|" + pattern;
-    if (auto it = matchCache.find(cacheKey); it != matchCache.end()) {
-        return it->second;
-    }
-
-    if (matchCache.size() > 1000) {
-        matchCache.clear();
-    }
-
-    std::string lowerProcess = processName;
-    std::string lowerPattern = pattern;
-
-    std::ranges::transform(lowerProcess, lowerProcess.begin(), ::tolower);
-    std::ranges::transform(lowerPattern, lowerPattern.begin(), ::tolower);
-
-    size_t patternPos = 0;
-    size_t processPos = 0;
-    size_t starPos = std::string::npos;
-    size_t matchPos = 0;
-
-    while (processPos < lowerProcess.length()) {
-        if (patternPos < lowerPattern.length() &&
-            (lowerPattern[patternPos] == lowerProcess[processPos] || lowerPattern[patternPos] == '?')) {
-            patternPos++;
-            processPos++;
-        }
-        else if (patternPos < lowerPattern.length() && lowerPattern[patternPos] == '*') {
-            starPos = patternPos++;
-            matchPos = processPos;
-        }
-        else if (starPos != std::string::npos) {
-            patternPos = starPos + 1;
-            processPos = ++matchPos;
-        }
-        else {
-            matchCache[cacheKey] = false;
-            return false;
-        }
-    }
 
-    while (patternPos < lowerPattern.length() && lowerPattern[patternPos] == '*') {
-        patternPos++;
-    }
-
-    bool result = (patternPos == lowerPattern.length());
-    matchCache[cacheKey] = result;
-    return result;
+    auto missCache = m_pidMissCache.GetStats();
+    Logger::Instance().Info(std::format(
+        "PID Miss Cache: {}/{} entries, {} hits, {} misses, {} evictions",
+        missCache.size, missCache.capacity, missCache.hits, missCache.misses, missCache.evictions
+    ));
 }
 
 void ProcessManager::CleanupStalePids(std::unordered_map<DWORD, CachedProcessInfo>& cache,
@@ -473,16 +827,17 @@ void ProcessManager::CleanupStalePids(std::unordered_map<DWORD, CachedProcessInf
 std::string ProcessManager::CachedWStringToString(const std::wstring& wstr) {
     PERF_TIMER("ProcessManager::StringConversion");
 
-    auto cached = m_wstringToStringCache.get(wstr);
-    if (cached.has_value()) {
-        stats.stringCacheHits.fetch_add(1, std::memory_order_relaxed);
-        return *cached;
+    // Строка копируется один раз, прямо из узла кэша
+    std::string result;
+    if (m_wstringToStringCache.Visit(wstr, [&result](const std::string& cached) { result = cached; })) {
+        RecordStringLookup(true);
+        return result;
     }
 
-    stats.stringCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    RecordStringLookup(false);
 
-    std::string result = Utils::WStringToString(wstr);
-    m_wstringToStringCache.put(wstr, result);
+    result = Utils::WStringToString(wstr);
+    m_wstringToStringCache.Put(wstr, result);
 
     return result;
 }
@@ -490,16 +845,16 @@ std::string ProcessManager::CachedWStringToString(const std::wstring& wstr) {
 std::wstring ProcessManager::CachedStringToWString(const std::string& str) {
     PERF_TIMER("ProcessManager::StringConversion");
 
-    auto cached = m_stringToWstringCache.get(str);
-    if (cached.has_value()) {
-        stats.stringCacheHits.fetch_add(1, std::memory_order_relaxed);
-        return *cached;
+    std::wstring result;
+    if (m_stringToWstringCache.Visit(str, [&result](const std::wstring& cached) { result = cached; })) {
+        RecordStringLookup(true);
+        return result;
     }
 
-    stats.stringCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    RecordStringLookup(false);
 
-    std::wstring result = Utils::StringToWString(str);
-    m_stringToWstringCache.put(str, result);
+    result = Utils::StringToWString(str);
+    m_stringToWstringCache.Put(str, result);
 
     return result;
 }
\ No newline at end of file
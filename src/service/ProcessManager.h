@@ -10,9 +10,16 @@
 #include <chrono>
 #include <optional>
 #include <list>
+#include <deque>
 #include <concepts>
+#include <memory>
+#include <bit>
+#include <algorithm>
 #include "../common/Models.h"
 #include "../common/WinHandles.h"
+#include "ProcessEventTracer.h"
+#include "ProcessSelectionMatcher.h"
+#include "ShardedLruCache.h"
 
 struct CachedProcessInfo {
     bool isSelected;
@@ -20,6 +27,67 @@ struct CachedProcessInfo {
     std::wstring name;
     std::string processPath;
     std::chrono::steady_clock::time_point lastVerified;
+    bool isGame = false;        // Классифицируется один раз при добавлении
+    bool isDiscord = false;
+    uint32_t clockSlot = 0;     // Позиция в кольце CLOCK-вытеснения
+};
+
+// Immutable open-addressing snapshot of the PID cache, published RCU-style:
+// IsSelectedProcessByPid probes it after one atomic load, with no lock, no
+// copy and no write except the CLOCK reference and verification stamps of
+// the hit entry. Bulk changes (snapshot, selection) rebuild it at once;
+// single-PID changes from misses, promotions and ETW events only mark it
+// stale and are folded into one rebuild per PID_VIEW_PUBLISH_INTERVAL_MS;
+// meanwhile a new PID is served from the main cache under the shared lock.
+// Slots carry the process creation time, re-checked once per
+// verificationInterval, and a view that hands a reused PID to the wrong
+// process is rebuilt at once.
+class PidCacheView {
+public:
+    struct Slot {
+        DWORD pid = 0;                  // 0 - пустой слот (System Idle в кэш не попадает)
+        uint32_t clockSlot = 0;
+        uint64_t creationTime = 0;
+        bool isSelected = false;
+    };
+
+    PidCacheView() = default;
+
+    explicit PidCacheView(const std::unordered_map<DWORD, CachedProcessInfo>& cache) {
+        // Заполнение не выше половины: пробы короткие и всегда упираются в пустой слот
+        slots.resize(std::bit_ceil((std::max)(cache.size() * 2, size_t{ 16 })));
+        mask = slots.size() - 1;
+        for (const auto& [pid, info] : cache) {
+            size_t index = Hash(pid) & mask;
+            while (slots[index].pid != 0) {
+                index = (index + 1) & mask;
+            }
+            slots[index] = { pid, info.clockSlot,
+                (static_cast<uint64_t>(info.creationTime.dwHighDateTime) << 32) | info.creationTime.dwLowDateTime,
+                info.isSelected };
+            count++;
+        }
+    }
+
+    const Slot* Find(DWORD pid) const {
+        if (slots.empty() || pid == 0) return nullptr;
+        for (size_t index = Hash(pid) & mask;; index = (index + 1) & mask) {
+            const Slot& slot = slots[index];
+            if (slot.pid == pid) return &slot;
+            if (slot.pid == 0) return nullptr;
+        }
+    }
+
+    size_t Size() const { return count; }
+    size_t MemoryBytes() const { return sizeof(*this) + slots.capacity() * sizeof(Slot); }
+
+private:
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+
+    // PID кратны 4, поэтому младшие биты перемешиваем умножением
+    static size_t Hash(DWORD pid) { return static_cast<size_t>((pid * 0x9E3779B97F4A7C15ull) >> 29); }
 };
 
 struct PerformanceConfig {
@@ -40,83 +108,13 @@ struct CacheStats {
     std::atomic<uint64_t> stringCacheMisses{ 0 };
 };
 
-template<typename K, typename V>
-class ThreadSafeLRUCache {
-public:
-    ThreadSafeLRUCache(size_t cap) : capacity(cap) {
-        if (capacity == 0) capacity = 1;
-    }
-
-    void put(const K& key, const V& value) {
-        std::unique_lock lock(mutex);
-
-        auto it = map.find(key);
-        if (it != map.end()) {
-            it->second->value = value;
-            list.splice(list.begin(), list, it->second);
-            return;
-        }
-
-        if (map.size() >= capacity) {
-            K last_key = list.back().key;
-            list.pop_back();
-            map.erase(last_key);
-        }
-
-        list.emplace_front(key, value);
-        map[key] = list.begin();
-    }
-
-    std::optional<V> get(const K& key) const {
-        std::shared_lock lock(mutex);
-
-        auto it = map.find(key);
-        if (it == map.end()) {
-            return std::nullopt;
-        }
-
-        return it->second->value;
-    }
-
-    void clear() {
-        std::unique_lock lock(mutex);
-        map.clear();
-        list.clear();
-    }
-
-    size_t size() const {
-        std::shared_lock lock(mutex);
-        return map.size();
-    }
-
-    template<typename Func>
-        requires std::invocable<Func, const K&, const V&>
-    void forEach(Func func) const {
-        std::shared_lock lock(mutex);
-        for (const auto& node : list) {
-            func(node.key, node.value);
-        }
-    }
-
-private:
-    struct CacheNode {
-        K key;
-        V value;
-        CacheNode(const K& k, const V& v) : key(k), value(v) {}
-    };
-
-    size_t capacity;
-    mutable std::list<CacheNode> list;
-    mutable std::unordered_map<K, typename std::list<CacheNode>::iterator> map;
-    mutable std::shared_mutex mutex;
-};
-
 class ProcessManager {
 public:
     ProcessManager(const ServiceConfig& config, const PerformanceConfig& perfConfig = {});
     ~ProcessManager();
 
     std::vector<ProcessInfo> GetAllProcesses() const;
+    ProcessListDelta GetProcessChangesSince(uint64_t since) const;
     bool IsProcessSelected(const std::string& processName) const;
     bool IsSelectedProcessByPid(DWORD pid);
 
@@ -131,30 +129,82 @@ public:
     void GetCacheStats(uint64_t& hits, uint64_t& misses) const;
     void LogPerformanceStats() const;
 
+    // Для Watchdog: оценка памяти кэшей и их ужатие. Основной кэш PID и список
+    // процессов не трогаются - без них IsSelectedProcessByPid пойдёт в систему
+    size_t GetCacheMemoryBytes() const;
+    void TrimCaches(MemoryPressure pressure);
+
 private:
     mutable std::shared_mutex cachesMutex;
     mutable std::mutex selectedMutex;
 
     std::unordered_map<DWORD, CachedProcessInfo> m_pidCache;
-    ThreadSafeLRUCache<DWORD, CachedProcessInfo> m_pidMissCache;
 
-    // String conversion cache
-    ThreadSafeLRUCache<std::wstring, std::string> m_wstringToStringCache{ 5000 };
-    ThreadSafeLRUCache<std::string, std::wstring> m_stringToWstringCache{ 5000 };
+    // Путь чтения без блокировок; кольцо CLOCK фиксированного размера mainCacheMaxSize.
+    // Биты ссылок живут отдельно от view, поэтому переживают его перестроение
+    std::atomic<std::shared_ptr<const PidCacheView>> pidView;
+    std::unique_ptr<std::atomic<uint8_t>[]> clockReferenced;
+    std::unique_ptr<std::atomic<uint64_t>[]> clockVerifiedMs; // GetTickCount64() последней сверки creationTime
+    std::atomic<bool> pidViewStale{ false };    // В m_pidCache есть изменения, которых нет во view
+    std::atomic<uint64_t> pidViewPublishedMs{ 0 };
+    std::vector<DWORD> clockPids;               // Владелец слота, 0 - свободен (защищён cachesMutex)
+    std::vector<uint32_t> freeClockSlots;
+    size_t clockHand = 0;
+    ShardedLruCache<DWORD, CachedProcessInfo> m_pidMissCache;
 
-    std::unordered_set<std::string> selectedProcesses;
-    std::vector<ProcessInfo> allProcesses;
+    // String conversion cache
+    ShardedLruCache<std::wstring, std::string> m_wstringToStringCache{ 5000 };
+    ShardedLruCache<std::string, std::wstring> m_stringToWstringCache{ 5000 };
+
+    std::unordered_set<std::string> selectedProcesses;      // Исходные шаблоны для UI, защищён selectedMutex
+    std::atomic<std::shared_ptr<const ProcessSelectionMatcher>> selectionMatcher;
+
+    // Список для UI. Каждое изменение получает следующую версию, завершённые процессы
+    // оставляют надгробие: клиент с версией не ниже removedFloor догоняет дельтой.
+    // Версии начинаются с микросекунд wall clock, как номера журнала маршрутов,
+    // так что версия из прошлого запуска сервиса всегда ведёт к полному списку
+    struct ProcessEntry {
+        ProcessInfo info;
+        uint64_t version = 0;
+    };
+    std::unordered_map<DWORD, ProcessEntry> processEntries;        // Защищены cachesMutex
+    std::deque<std::pair<ProcessKey, uint64_t>> removedProcesses;  // По возрастанию версии
+    uint64_t processVersion = 0;
+    uint64_t removedFloor = 0;
 
     std::atomic<bool> running;
     std::jthread updateThread;
 
+    // Старт/стоп процессов из ETW; пока сессия работает, полный снимок раз в несколько минут
+    std::unique_ptr<ProcessEventTracer> processTracer;
+
     PerformanceConfig perfConfig;
     mutable CacheStats stats;
 
     void UpdateThreadFunc(std::stop_token stopToken);
+    void OnProcessStarted(DWORD pid, std::wstring_view imagePath);
+    void OnProcessStopped(DWORD pid);
+    // true - view отдаёт этот PID другому процессу (PID переиспользован)
+    bool AddToPidCacheLocked(DWORD pid, const CachedProcessInfo& info);
+    void ErasePidLocked(DWORD pid);
+    uint32_t EvictClockSlotLocked();
+    void ResetClockLocked();
+    void PublishPidViewLocked();
+    void MarkPidViewStaleLocked(bool reused = false);
+    void PublishStalePidView();
+    bool ConfirmCreationTime(DWORD pid, uint64_t creationTime) const;
+    void DropReusedPid(DWORD pid, uint64_t creationTime);
+    void MarkReferenced(uint32_t clockSlot) const;
+    // Счётчик и гейдж доли попаданий обновляются вместе: PerfPanel видит текущую долю
+    void RecordLookup(bool hit);
+    void RecordStringLookup(bool hit);
+    void UpsertProcessLocked(ProcessInfo&& info);
+    void RemoveProcessLocked(DWORD pid);
+    void AddTombstoneLocked(const ProcessInfo& info);
+    void ReplaceProcessesLocked();
+    static ProcessInfo MakeProcessInfo(DWORD pid, const CachedProcessInfo& info, const std::wstring& executablePath);
     std::unordered_map<DWORD, CachedProcessInfo> BuildProcessSnapshot();
     std::optional<CachedProcessInfo> GetCompleteProcessInfo(DWORD pid);
-    bool MatchesWildcard(const std::string& processName, const std::string& pattern) const;
     bool IsProcessSelectedInternal(const std::string& processName) const;
     void MergeMissCacheIntoMain(std::unordered_map<DWORD, CachedProcessInfo>& mainCache);
     void CleanupStalePids(std::unordered_map<DWORD, CachedProcessInfo>& cache,
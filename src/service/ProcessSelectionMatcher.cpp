@@ -0,0 +1,127 @@
+// src/service/ProcessSelectionMatcher.cpp
+#include "ProcessSelectionMatcher.h"
+#include <algorithm>
+#include <mutex>
+
+ProcessSelectionMatcher::ProcessSelectionMatcher(const std::vector<std::string>& patterns) {
+    for (const auto& pattern : patterns) {
+        std::string folded = Fold(pattern);
+        if (folded.empty()) continue;
+
+        if (folded.find_first_of("*?") == std::string::npos) {
+            exact.insert(std::move(folded));
+        }
+        else {
+            globs.push_back(Compile(folded));
+        }
+    }
+}
+
+std::string ProcessSelectionMatcher::Fold(std::string_view value) {
+    std::string result(value);
+    // Имена образов сравнивались через _stricmp, т.е. без учёта регистра ASCII
+    std::ranges::transform(result, result.begin(), [](char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+    return result;
+}
+
+ProcessSelectionMatcher::Glob ProcessSelectionMatcher::Compile(std::string_view pattern) {
+    Glob glob;
+    glob.anchoredStart = pattern.front() != '*';
+    glob.anchoredEnd = pattern.back() != '*';
+
+    size_t start = 0;
+    while (start <= pattern.size()) {
+        size_t star = pattern.find('*', start);
+        std::string_view segment = pattern.substr(start, star == std::string_view::npos ? std::string_view::npos : star - start);
+        if (!segment.empty()) {
+            glob.segments.emplace_back(segment);
+        }
+        if (star == std::string_view::npos) break;
+        start = star + 1;
+    }
+    return glob;
+}
+
+bool ProcessSelectionMatcher::SegmentAt(std::string_view text, size_t position, std::string_view segment) {
+    if (position + segment.size() > text.size()) return false;
+    for (size_t i = 0; i < segment.size(); i++) {
+        if (segment[i] != '?' && segment[i] != text[position + i]) return false;
+    }
+    return true;
+}
+
+bool ProcessSelectionMatcher::MatchesGlob(std::string_view text, const Glob& glob) {
+    const auto& segments = glob.segments;
+    if (segments.empty()) {
+        return true;    // Только звёздочки
+    }
+
+    // Без '*' - один сегмент, привязанный с обеих сторон
+    if (glob.anchoredStart && glob.anchoredEnd && segments.size() == 1) {
+        return text.size() == segments[0].size() && SegmentAt(text, 0, segments[0]);
+    }
+
+    size_t first = 0;
+    size_t last = segments.size();
+    size_t position = 0;
+    size_t end = text.size();
+
+    if (glob.anchoredStart) {
+        if (!SegmentAt(text, 0, segments[0])) return false;
+        position = segments[0].size();
+        first = 1;
+    }
+    if (glob.anchoredEnd) {
+        const std::string& tail = segments.back();
+        if (tail.size() > end || end - tail.size() < position || !SegmentAt(text, end - tail.size(), tail)) return false;
+        end -= tail.size();
+        last--;
+    }
+
+    // Средние сегменты жадно, самое левое вхождение: для шаблонов вида A*B*C этого достаточно
+    for (size_t i = first; i < last; i++) {
+        const std::string& segment = segments[i];
+        bool found = false;
+        for (; position + segment.size() <= end; position++) {
+            if (SegmentAt(text, position, segment)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) return false;
+        position += segment.size();
+    }
+    return true;
+}
+
+bool ProcessSelectionMatcher::Matches(std::string_view processName) const {
+    if (exact.empty() && globs.empty()) {
+        return false;
+    }
+
+    std::string folded = Fold(processName);
+    if (exact.contains(std::string_view(folded))) {
+        return true;
+    }
+    if (globs.empty()) {
+        return false;
+    }
+
+    {
+        std::shared_lock lock(verdictsMutex);
+        if (auto it = verdicts.find(std::string_view(folded)); it != verdicts.end()) {
+            return it->second;
+        }
+    }
+
+    bool matched = std::ranges::any_of(globs, [&folded](const Glob& glob) { return MatchesGlob(folded, glob); });
+
+    std::unique_lock lock(verdictsMutex);
+    if (verdicts.size() >= MAX_CACHED_VERDICTS) {
+        verdicts.clear();
+    }
+    verdicts.emplace(std::move(folded), matched);
+    return matched;
+}
@@ -0,0 +1,49 @@
+// src/service/ProcessSelectionMatcher.h
+#pragma once
+#include <cstddef>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Process selection compiled once per SetSelectedProcesses: exact names go
+// into a case-folded hash set, wildcard patterns ('*', '?') are split into
+// literal segments matched left to right in linear time. The set itself is
+// immutable and swapped as a whole; only the verdict cache for names that
+// reached the wildcard stage is mutable, under its own lock.
+class ProcessSelectionMatcher {
+public:
+    explicit ProcessSelectionMatcher(const std::vector<std::string>& patterns);
+
+    bool Matches(std::string_view processName) const;
+
+    size_t ExactCount() const { return exact.size(); }
+    size_t WildcardCount() const { return globs.size(); }
+
+private:
+    struct Glob {
+        std::vector<std::string> segments;      // Части между '*', '?' внутри сегмента - любой символ
+        bool anchoredStart = true;
+        bool anchoredEnd = true;
+    };
+
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const noexcept { return std::hash<std::string_view>{}(value); }
+    };
+
+    static constexpr size_t MAX_CACHED_VERDICTS = 4096;
+
+    std::unordered_set<std::string, StringHash, std::equal_to<>> exact;
+    std::vector<Glob> globs;
+
+    mutable std::shared_mutex verdictsMutex;
+    mutable std::unordered_map<std::string, bool, StringHash, std::equal_to<>> verdicts;
+
+    static std::string Fold(std::string_view value);
+    static Glob Compile(std::string_view pattern);
+    static bool SegmentAt(std::string_view text, size_t position, std::string_view segment);
+    static bool MatchesGlob(std::string_view text, const Glob& glob);
+};
@@ -0,0 +1,88 @@
+// src/service/RouteChangeJournal.h
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "RouteTable.h"
+
+// Bounded, sequence-numbered journal of route table changes for UI
+// subscribers. A record holds only the key (and a refcount), so appending
+// under routesMutex costs a few stores; names and addresses are materialized
+// when a subscriber reads. A cursor older than the window, or one from another
+// service run, cannot be served and the reader falls back to a full list, as
+// it does when a Clear record is in its window.
+// Sequences start at the wall clock in microseconds, so a new run always
+// continues above the cursors a client kept from the previous one.
+class RouteChangeJournal {
+public:
+    enum class Op : uint8_t { Add, Remove, RefCount, Clear };
+
+    struct Record {
+        uint64_t sequence = 0;
+        Op op = Op::Add;
+        bool ipv6 = false;
+        RouteKey key = 0;           // IPv4
+        Route6Key key6;             // IPv6
+        int refCount = 0;           // Только для RefCount
+    };
+
+    explicit RouteChangeJournal(size_t capacity)
+        : records(capacity),
+          first(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count())),
+          last(first) {
+    }
+
+    void Append(Op op, RouteKey key, int refCount = 0) {
+        Record record;
+        record.op = op;
+        record.key = key;
+        record.refCount = refCount;
+        Push(record);
+    }
+
+    void Append6(Op op, const Route6Key& key, int refCount = 0) {
+        Record record;
+        record.op = op;
+        record.ipv6 = true;
+        record.key6 = key;
+        record.refCount = refCount;
+        Push(record);
+    }
+
+    uint64_t Sequence() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return last;
+    }
+
+    size_t MemoryBytes() const { return records.capacity() * sizeof(Record); }
+
+    // Записи с номером больше since по порядку; false, если часть из них уже вытеснена
+    bool ReadSince(uint64_t since, std::vector<Record>& out, uint64_t& sequence) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        sequence = last;
+        uint64_t oldest = last - (std::min)(static_cast<uint64_t>(records.size()), last - first);
+        if (since < oldest || since > last) {
+            return false;
+        }
+        out.reserve(static_cast<size_t>(last - since));
+        for (uint64_t s = since + 1; s <= last; s++) {
+            out.push_back(records[s % records.size()]);
+        }
+        return true;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Record> records;    // Кольцо: запись с номером s лежит в records[s % size]
+    uint64_t first;                 // Номер до первой записи этого запуска
+    uint64_t last;                  // Номер последней записи
+
+    void Push(Record& record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        record.sequence = ++last;
+        records[last % records.size()] = record;
+    }
+};
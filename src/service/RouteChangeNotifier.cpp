@@ -0,0 +1,53 @@
+// src/service/RouteChangeNotifier.cpp
+#include "RouteChangeNotifier.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include <windows.h>
+#include <condition_variable>
+#include <format>
+#include <mutex>
+
+RouteChangeNotifier::RouteChangeNotifier(std::function<size_t()> provider)
+    : countProvider(std::move(provider)) {
+    notifyThread = std::jthread([this](std::stop_token token) { NotifyThreadFunc(token); });
+}
+
+RouteChangeNotifier::~RouteChangeNotifier() {
+    notifyThread.request_stop();
+    // Будим поток, ждущий на sequence.wait()
+    Signal();
+}
+
+void RouteChangeNotifier::NotifyThreadFunc(std::stop_token stopToken) {
+    std::mutex waitMutex;
+    std::condition_variable_any waitCV;
+    uint64_t published = 0;
+
+    try {
+        while (!stopToken.stop_requested()) {
+            sequence.wait(published, std::memory_order_acquire);
+            if (stopToken.stop_requested()) {
+                break;
+            }
+
+            // Передний фронт: публикуем сразу, дальше копим изменения до конца интервала
+            uint64_t current = sequence.load(std::memory_order_acquire);
+            size_t count = countProvider();
+
+            HWND uiWindow = FindWindow(L"RouteManagerProWindow", nullptr);
+            if (uiWindow) {
+                PostMessage(uiWindow, Constants::WM_ROUTE_COUNT_CHANGED,
+                    static_cast<WPARAM>(count), static_cast<LPARAM>(current));
+            }
+            PERF_COUNT("RouteChangeNotifier.Posted");
+            published = current;
+
+            std::unique_lock<std::mutex> lock(waitMutex);
+            waitCV.wait_for(lock, stopToken, Constants::ROUTE_NOTIFY_DEBOUNCE, [] { return false; });
+        }
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("RouteChangeNotifier thread exception: {}", e.what()));
+    }
+}
@@ -0,0 +1,35 @@
+// src/service/RouteChangeNotifier.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Coalesces route-count changes into at most one UI notification per
+// ROUTE_NOTIFY_DEBOUNCE. Signal() is a single atomic increment and may be
+// called from any thread, including under routesMutex. The posted message
+// carries the latest route count (wParam) and change sequence (lParam).
+// countProvider runs on the notifier thread right before each message, so the
+// owner may do coalesced work there (RouteController publishes its route view).
+class RouteChangeNotifier {
+public:
+    explicit RouteChangeNotifier(std::function<size_t()> countProvider);
+    ~RouteChangeNotifier();
+
+    RouteChangeNotifier(const RouteChangeNotifier&) = delete;
+    RouteChangeNotifier& operator=(const RouteChangeNotifier&) = delete;
+
+    void Signal() noexcept {
+        sequence.fetch_add(1, std::memory_order_release);
+        sequence.notify_one();
+    }
+
+    uint64_t Sequence() const noexcept { return sequence.load(std::memory_order_acquire); }
+
+private:
+    std::function<size_t()> countProvider;
+    std::atomic<uint64_t> sequence{ 0 };
+    std::jthread notifyThread;
+
+    void NotifyThreadFunc(std::stop_token stopToken);
+};
@@ -5,6 +5,7 @@
 #include <netioapi.h>
 #include "RouteController.h"
 #include "RouteOptimizer.h"
+#include "IpHelperApi.h"
 #include "../common/Constants.h"
 #include "../common/Utils.h"
 #include "../common/Logger.h"
@@ -20,6 +21,9 @@
 #include <unordered_map>
 #include <ranges>
 #include <algorithm>
+#include <iterator>
+#include <utility>
+#include <tuple>
 #include <bit>
 
 #pragma comment(lib, "iphlpapi.lib")
@@ -29,25 +33,100 @@
 thread_local MIB_IPFORWARD_ROW2 tlRoute = { 0 };
 thread_local bool tlRouteInitialized = false;
 thread_local MIB_IPFORWARDROW tlOldRoute = { 0 };
-thread_local std::unordered_map<std::string, uint32_t> tlIPCache;
+
+static int64_t UnixSeconds(std::chrono::system_clock::time_point tp = std::chrono::system_clock::now()) {
+    return std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+}
+
+static constexpr int64_t ROUTE_IDLE_TTL_SEC = int64_t(Constants::ROUTE_CLEANUP_HOURS) * 3600;
+
+static int64_t IdleTtlOf(const RouteEntry& entry) {
+    int64_t idleTtl = entry.idleTtl.load(std::memory_order_relaxed);
+    return idleTtl > 0 ? idleTtl : ROUTE_IDLE_TTL_SEC;
+}
+
+// Обычное использование (flow, явное добавление) переводит DNS-маршрут на общий TTL,
+// повторный DNS-ответ только продлевает его собственный
+static void MergeIdleTtl(RouteEntry& entry, int64_t idleTtl) {
+    int64_t current = entry.idleTtl.load(std::memory_order_relaxed);
+    if (current == 0) return;
+    if (idleTtl == 0 || idleTtl > current) {
+        entry.idleTtl.store(idleTtl, std::memory_order_relaxed);
+    }
+}
+
+// Захват routesMutex с учётом ожидания: без конкуренции ничего не пишем, иначе
+// время ожидания уходит в PerformanceMonitor под именем пути (RouteLockWait.*)
+template<typename Lock>
+static Lock LockRoutes(std::shared_mutex& mutex, const char* path) {
+    Lock lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        auto start = std::chrono::high_resolution_clock::now();
+        lock.lock();
+        PerformanceMonitor::Instance().RecordOperation(std::format("RouteLockWait.{}", path),
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start));
+    }
+    return lock;
+}
+
+using SharedRoutesLock = std::shared_lock<std::shared_mutex>;
+using UniqueRoutesLock = std::unique_lock<std::shared_mutex>;
+
+static Ipv4IntervalSet BuildIntervalSet(const std::vector<SystemRoute>& systemRoutes) {
+    Ipv4IntervalSet set;
+    for (const auto& route : systemRoutes) {
+        set.Add(route.address, route.prefixLength);
+    }
+    set.Build();
+    return set;
+}
+
+static OptimizerConfig MakeOptimizerConfig(const OptimizerSettings& settings) {
+    OptimizerConfig optConfig;
+    optConfig.min_hosts_to_aggregate = settings.minHostsToAggregate;
+    optConfig.waste_thresholds = settings.wasteThresholds;
+    optConfig.cost_based = settings.costBased;
+    optConfig.route_cost = settings.routeCost;
+    optConfig.wasted_address_cost = settings.wastedAddressCost;
+    optConfig.max_routes = settings.maxRoutes;
+    optConfig.min_aggregate_prefix = settings.minAggregatePrefix;
+    optConfig.worker_threads = settings.workerThreads;
+    return optConfig;
+}
 
 RouteController::RouteController(const ServiceConfig& cfg) : config(cfg), running(true),
 lastSaveTime(std::chrono::steady_clock::now()), cachedInterfaceIndex(0),
-lastOptimizationTime(std::chrono::steady_clock::now()) {
+lastOptimizationTime(std::chrono::steady_clock::now()),
+stateStore(Constants::STATE_SNAPSHOT_FILE, Constants::STATE_JOURNAL_FILE),
+changeJournal(Constants::ROUTE_JOURNAL_CAPACITY),
+routeNotifier([this] {
+    size_t count = PublishRouteView() + routes6Count.load(std::memory_order_relaxed);
+    NotifyChangeListener();
+    return count;
+    }),
+expiryWheel(Constants::ROUTE_EXPIRY_TICK.count(), UnixSeconds()) {
+    routeView.store(std::make_shared<const RouteTableView>());
+    aggregator.Configure(config.optimizerSettings.minHostsToAggregate, config.optimizerSettings.wasteThresholds);
+
     LoadRoutesFromDisk();
 
-    OptimizerConfig optConfig;
-    optConfig.min_hosts_to_aggregate = config.optimizerSettings.minHostsToAggregate;
-    optConfig.waste_thresholds = config.optimizerSettings.wasteThresholds;
-    optimizer = std::make_unique<RouteOptimizer>(optConfig);
+    optimizer = std::make_unique<RouteOptimizer>(MakeOptimizerConfig(config.optimizerSettings));
+
+    gatewayAddress.store(inet_addr(config.gatewayIp.c_str()), std::memory_order_relaxed);
+    preloadOverrides = config.preloadServiceOverrides;
+    RegisterChangeNotifications();
 
     verifyThread = std::jthread([this](std::stop_token token) { VerifyRoutesThreadFunc(token); });
     persistThread = std::jthread([this](std::stop_token token) { PersistenceThreadFunc(token); });
     optimizationThread = std::jthread([this](std::stop_token token) { OptimizationThreadFunc(token); });
 
-    if (config.aiPreloadEnabled) {
-        PreloadAIRoutes();
+    for (int i = 0; i < Constants::ROUTE_PROGRAMMER_THREADS; i++) {
+        programmerThreads.emplace_back([this](std::stop_token token) { RouteProgrammerThreadFunc(token); });
     }
+    migrationThread = std::jthread([this](std::stop_token token) { MigrationThreadFunc(token); });
+
+    // Установка сохранённых маршрутов, preload и очистка идут в фоне, мониторинг стартует сразу
+    restoreThread = std::jthread([this](std::stop_token token) { RestoreRoutesThreadFunc(token); });
 }
 
 RouteController::~RouteController() {
@@ -56,6 +135,23 @@ RouteController::~RouteController() {
     running = false;
     optimizationCV.notify_all();
 
+    if (restoreThread.joinable()) {
+        restoreThread.request_stop();
+        restoreThread.join();
+    }
+
+    // Недостроенная миграция завершается cut-over: дальше очередь программирования доводит остаток
+    if (migrationThread.joinable()) {
+        migrationThread.request_stop();
+        migrationThread.join();
+    }
+
+    // CancelMibChangeNotify2 ждёт завершения выполняющихся callback'ов
+    UnregisterChangeNotifications();
+
+    // Останавливаем writer-потоки до финального сохранения, чтобы текущий батч успел попасть в routes
+    programmerThreads.clear();
+
     // std::jthread автоматически вызовет request_stop() и join()
 
     if (routesDirty.load()) {
@@ -70,21 +166,32 @@ void RouteController::OptimizationThreadFunc(std::stop_token stopToken) {
     Logger::Instance().Info("RouteController optimization thread started");
 
     try {
+        auto nextFullRun = std::chrono::steady_clock::now() + std::chrono::hours(1);
         while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
             std::unique_lock<std::mutex> lock(optimizationMutex);
 
-            auto waitUntil = std::chrono::steady_clock::now() + std::chrono::hours(1);
-            optimizationCV.wait_until(lock, waitUntil, [&stopToken, this] {
-                return stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown;
+            bool woken = optimizationCV.wait_until(lock, nextFullRun, [&stopToken, this] {
+                return stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown ||
+                    optimizationRequested || !pendingIncrementalPlan.changes.empty();
                 });
 
             if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
                 break;
             }
+            bool fullRun = optimizationRequested || !woken;
+            optimizationRequested = false;
+            OptimizationPlan incremental = std::exchange(pendingIncrementalPlan, OptimizationPlan{});
 
             lock.unlock();
-            RunOptimization();
-            lastOptimizationTime = std::chrono::steady_clock::now();
+            if (fullRun) {
+                // Полный план пересчитывается по таблице и покрывает собранное инкрементально
+                RunOptimization();
+                lastOptimizationTime = std::chrono::steady_clock::now();
+                nextFullRun = lastOptimizationTime + std::chrono::hours(1);
+            }
+            else {
+                ApplyOptimizationPlan(incremental, true);
+            }
         }
     }
     catch (const std::exception& e) {
@@ -95,67 +202,86 @@ void RouteController::OptimizationThreadFunc(std::stop_token stopToken) {
 }
 
 std::vector<SystemRoute> RouteController::GetSystemRoutesForGateway() {
-    std::vector<SystemRoute> systemRoutes;
-    return GetSystemRoutesOldAPI();
-}
+    auto keys = GetSystemRouteKeys();
 
-std::vector<SystemRoute> RouteController::GetSystemRoutesOldAPI() {
     std::vector<SystemRoute> systemRoutes;
+    systemRoutes.reserve(keys.size());
+    for (RouteKey key : keys) {
+        SystemRoute route;
+        route.address = RouteKeyAddress(key);
+        route.prefixLength = RouteKeyPrefix(key);
+        route.mask = RoutePrefixIndex::MaskFor(route.prefixLength);
+        systemRoutes.push_back(route);
+    }
 
-    PMIB_IPFORWARDTABLE pIpForwardTable = nullptr;
-    DWORD dwSize = 0;
+    return systemRoutes;
+}
 
-    if (GetIpForwardTable(pIpForwardTable, &dwSize, FALSE) == ERROR_INSUFFICIENT_BUFFER) {
-        pIpForwardTable = (PMIB_IPFORWARDTABLE)malloc(dwSize);
+std::vector<RouteKey> RouteController::GetSystemRouteKeys(bool forceRefresh) {
+    std::lock_guard<std::mutex> lock(systemRoutesMutex);
 
-        if (pIpForwardTable && GetIpForwardTable(pIpForwardTable, &dwSize, FALSE) == NO_ERROR) {
-            DWORD targetGateway = inet_addr(config.gatewayIp.c_str());
+    // Без уведомлений снимок не поддерживается инкрементально - читаем таблицу каждый раз
+    if (!systemRoutesValid || forceRefresh || !routeChangeHandle) {
+        LoadSystemRouteKeysLocked();
+    }
 
-            for (DWORD i = 0; i < pIpForwardTable->dwNumEntries; i++) {
-                const auto& row = pIpForwardTable->table[i];
+    return systemRouteKeys;
+}
 
-                if (row.dwForwardNextHop == targetGateway) {
-                    SystemRoute route;
-                    route.address = ntohl(row.dwForwardDest);
-                    route.mask = ntohl(row.dwForwardMask);
-                    route.prefixLength = CountBits(route.mask);
+void RouteController::LoadSystemRouteKeysLocked() {
+    PERF_TIMER("RouteController::LoadSystemRouteKeys");
 
-                    struct in_addr addr;
-                    addr.s_addr = row.dwForwardDest;
-                    char ipStr[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &addr, ipStr, INET_ADDRSTRLEN);
-                    route.ipString = ipStr;
+    systemRouteKeys.clear();
 
-                    systemRoutes.push_back(route);
+    PMIB_IPFORWARD_TABLE2 table = nullptr;
+    DWORD result = IpHelper::Api().GetIpForwardTable2(AF_INET, &table);
+    if (result != NO_ERROR || !table) {
+        Logger::Instance().Error(std::format("GetIpForwardTable2 failed: {}", result));
+        systemRoutesValid = false;
+        return;
+    }
 
-                    if (systemRoutes.size() <= 5 || route.prefixLength < 32) {
-                        Logger::Instance().Debug(std::format("Route: {}/{} addr={} mask={}",
-                            route.ipString, route.prefixLength, route.address, route.mask));
-                    }
-                }
-            }
-        }
+    ULONG targetGateway = gatewayAddress.load(std::memory_order_relaxed);
+    for (ULONG i = 0; i < table->NumEntries; i++) {
+        const auto& row = table->Table[i];
+        if (row.NextHop.Ipv4.sin_addr.s_addr != targetGateway) continue;
 
-        if (pIpForwardTable) {
-            free(pIpForwardTable);
-        }
+        systemRouteKeys.push_back(MakeRouteKey(ntohl(row.DestinationPrefix.Prefix.Ipv4.sin_addr.s_addr),
+            row.DestinationPrefix.PrefixLength));
     }
+    IpHelper::Api().FreeMibTable(table);
 
-    Logger::Instance().Info(std::format("Found {} routes for gateway {}",
-        systemRoutes.size(), config.gatewayIp));
+    std::ranges::sort(systemRouteKeys);
+    auto duplicates = std::ranges::unique(systemRouteKeys);
+    systemRouteKeys.erase(duplicates.begin(), duplicates.end());
 
-    std::unordered_map<int, int> prefixCounts;
-    for (const auto& route : systemRoutes) {
-        prefixCounts[route.prefixLength]++;
-    }
+    systemRoutesValid = true;
+    systemRouteVersion++;
+
+    Logger::Instance().Info(std::format("Loaded {} system routes for gateway {} (snapshot v{})",
+        systemRouteKeys.size(), ActiveGatewayIp(), systemRouteVersion));
+}
+
+void RouteController::ApplySystemRouteChange(RouteKey key, bool added) {
+    std::lock_guard<std::mutex> lock(systemRoutesMutex);
+    if (!systemRoutesValid) return;
 
-    std::string distribution = "Route distribution by prefix: ";
-    for (const auto& [prefix, count] : prefixCounts) {
-        distribution += std::format("/{}={} ", prefix, count);
+    auto it = std::ranges::lower_bound(systemRouteKeys, key);
+    bool present = it != systemRouteKeys.end() && *it == key;
+
+    if (added && !present) {
+        systemRouteKeys.insert(it, key);
+        systemRouteVersion++;
+    }
+    else if (!added && present) {
+        systemRouteKeys.erase(it);
+        systemRouteVersion++;
     }
-    Logger::Instance().Info(distribution);
+}
 
-    return systemRoutes;
+void RouteController::InvalidateSystemRouteSnapshot() {
+    std::lock_guard<std::mutex> lock(systemRoutesMutex);
+    systemRoutesValid = false;
 }
 
 int RouteController::CountBits(uint32_t mask) {
@@ -167,31 +293,34 @@ void RouteController::RunOptimization() {
 
     auto systemRoutes = GetSystemRoutesForGateway();
     Logger::Instance().Info(std::format("Found {} total routes in system for gateway {}",
-        systemRoutes.size(), config.gatewayIp));
+        systemRoutes.size(), ActiveGatewayIp()));
 
     std::vector<HostRoute> allRoutesForOptimization;
     std::vector<SystemRoute> largeAggregatedRoutes;
 
-    for (const auto& route : systemRoutes) {
-        if (route.prefixLength < 24) {
-            largeAggregatedRoutes.push_back(route);
-        }
-        else {
-            HostRoute hr;
-            hr.ip = route.ipString;
-            hr.ipNum = route.address;
-            hr.prefixLength = route.prefixLength;
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "Optimization");
 
-            std::string routeKey = std::format("{}/{}", route.ipString, route.prefixLength);
-            auto it = routes.find(routeKey);
-            if (it != routes.end()) {
-                hr.processName = it->second->processName;
+        for (const auto& route : systemRoutes) {
+            if (route.prefixLength < 24) {
+                largeAggregatedRoutes.push_back(route);
             }
             else {
-                hr.processName = "Unknown";
-            }
+                HostRoute hr;
+                hr.ip = Utils::FastUIntToIP(route.address);
+                hr.ipNum = route.address;
+                hr.prefixLength = route.prefixLength;
+
+                auto it = routes.find(MakeRouteKey(route.address, route.prefixLength));
+                if (it != routes.end()) {
+                    hr.processName = processNames.Lookup(it->second->processId);
+                }
+                else {
+                    hr.processName = "Unknown";
+                }
 
-            allRoutesForOptimization.push_back(hr);
+                allRoutesForOptimization.push_back(hr);
+            }
         }
     }
 
@@ -229,18 +358,14 @@ void RouteController::RunOptimization() {
     }
 
     std::vector<HostRoute> uncoveredRoutes;
+    uint64_t contentHash = 0;   // Ключ кэша планов ведём по ходу сбора, без второго прохода
     int coveredCount = 0;
 
+    Ipv4IntervalSet largeAggregates = BuildIntervalSet(largeAggregatedRoutes);
     for (const auto& route : allRoutesForOptimization) {
-        bool isCovered = std::ranges::any_of(largeAggregatedRoutes, [&](const auto& aggRoute) {
-            uint32_t routeAddr = route.ipNum;
-            uint32_t aggAddr = aggRoute.address;
-            uint32_t mask = aggRoute.mask;
-            return (routeAddr & mask) == (aggAddr & mask);
-            });
-
-        if (!isCovered) {
+        if (!largeAggregates.Contains(route.ipNum)) {
             uncoveredRoutes.push_back(route);
+            contentHash += RouteOptimizer::RouteHash(route.ipNum, route.prefixLength);
         }
         else {
             coveredCount++;
@@ -250,7 +375,7 @@ void RouteController::RunOptimization() {
     Logger::Instance().Info(std::format("Filtered routes: {} already covered by large aggregates, {} routes need optimization",
         coveredCount, uncoveredRoutes.size()));
 
-    auto plan = optimizer->OptimizeRoutes(uncoveredRoutes);
+    auto plan = optimizer->OptimizeRoutes(uncoveredRoutes, contentHash);
 
     if (plan.routesBefore > 0) {
         Logger::Instance().Info("Optimization Results:");
@@ -263,8 +388,8 @@ void RouteController::RunOptimization() {
         for (const auto& change : plan.changes) {
             if (change.type == OptimizationPlan::RouteChange::ADD) {
                 adds++;
-                Logger::Instance().Debug(std::format("  + Add: {}/{} ({})",
-                    change.ip, change.prefixLength, change.reason));
+                LOG_DEBUG("  + Add: {}/{} ({})",
+                    change.ip, change.prefixLength, change.reason);
             }
             else {
                 removes++;
@@ -280,6 +405,8 @@ void RouteController::RunOptimization() {
         ApplyOptimizationPlan(plan);
     }
 
+    RunIpv6Optimization();
+
     Logger::Instance().Info("=== Route Optimization Completed ===");
 }
 
@@ -291,20 +418,15 @@ void RouteController::RemoveRedundantSystemRoutes(
 
     int removedCount = 0;
     int failedCount = 0;
+    std::vector<RouteKey> removedKeys;
 
+    // Системные вызовы без блокировки, удаление из таблицы - одной unique-блокировкой в конце
+    Ipv4IntervalSet aggregates = BuildIntervalSet(aggregatedRoutes);
     for (const auto& hostRoute : allHostRoutes) {
-        bool isCovered = std::ranges::any_of(aggregatedRoutes, [&](const auto& aggRoute) {
-            return (hostRoute.ipNum & aggRoute.mask) == (aggRoute.address & aggRoute.mask);
-            });
-
-        if (isCovered) {
-            if (RemoveSystemRouteWithMask(hostRoute.ip, 32, config.gatewayIp)) {
+        if (aggregates.Contains(hostRoute.ipNum)) {
+            if (RemoveSystemRouteWithMask(hostRoute.ip, 32, ActiveGatewayIp())) {
                 removedCount++;
-
-                std::lock_guard<std::shared_mutex> lock(routesMutex);
-                std::string routeKey = std::format("{}/32", hostRoute.ip);
-                routes.erase(routeKey);
-                routesDirty = true;
+                removedKeys.push_back(MakeRouteKey(hostRoute.ipNum, 32));
             }
             else {
                 failedCount++;
@@ -312,6 +434,14 @@ void RouteController::RemoveRedundantSystemRoutes(
         }
     }
 
+    if (!removedKeys.empty()) {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "RemoveRedundant");
+        for (RouteKey key : removedKeys) {
+            EraseRouteLocked(key);
+        }
+        routesDirty = true;
+    }
+
     Logger::Instance().Info(std::format("Removed {} redundant routes, {} failed",
         removedCount, failedCount));
 
@@ -323,49 +453,38 @@ void RouteController::RemoveRedundantSystemRoutes(
 void RouteController::SyncWithSystemTable() {
     Logger::Instance().Info("Syncing with system routing table");
 
-    auto systemRoutes = GetSystemRoutesForGateway();
+    PERF_TIMER("RouteController::SyncWithSystemTable");
 
-    std::unordered_set<std::string> systemRouteKeys;
-    for (const auto& route : systemRoutes) {
-        std::string key = std::format("{}/{}", route.ipString, route.prefixLength);
-        systemRouteKeys.insert(key);
-    }
+    auto systemKeys = GetSystemRouteKeys();
 
-    std::vector<std::string> toRemove;
-    {
-        std::shared_lock<std::shared_mutex> lock(routesMutex);
+    // Ключи view уже отсортированы; расхождения перепроверяются под unique-блокировкой
+    PublishRouteView();
+    auto view = GetRouteView();
+    std::span<const RouteKey> stateKeys = view->Keys();
 
-        for (const auto& [routeKey, routeInfo] : routes) {
-            if (!systemRouteKeys.contains(routeKey)) {
-                Logger::Instance().Warning(std::format("Route {} exists in state but not in system, marking for removal",
-                    routeKey));
-                toRemove.push_back(routeKey);
-            }
-        }
-    }
+    // Линейный merge-diff двух отсортированных массивов
+    std::vector<RouteKey> toRemove;
+    std::vector<RouteKey> toAdd;
+    std::ranges::set_difference(stateKeys, systemKeys, std::back_inserter(toRemove));
+    std::ranges::set_difference(systemKeys, stateKeys, std::back_inserter(toAdd));
 
-    {
-        std::unique_lock<std::shared_mutex> lock(routesMutex);
-        for (const auto& key : toRemove) {
-            routes.erase(key);
-        }
+    for (RouteKey key : toRemove) {
+        Logger::Instance().Warning(std::format("Route {}/{} exists in state but not in system, marking for removal",
+            Utils::FastUIntToIP(RouteKeyAddress(key)), RouteKeyPrefix(key)));
     }
 
     int addedCount = 0;
-    for (const auto& sysRoute : systemRoutes) {
-        std::string key = std::format("{}/{}", sysRoute.ipString, sysRoute.prefixLength);
-
-        std::unique_lock<std::shared_mutex> lock(routesMutex);
-        if (!routes.contains(key)) {
-            auto route = std::make_unique<RouteInfo>();
-            route->ip = sysRoute.ipString;
-            route->prefixLength = sysRoute.prefixLength;
-            route->refCount = 1;
-            route->processName = "System";
-            route->createdAt = std::chrono::system_clock::now();
-
-            routes[key] = std::move(route);
-            addedCount++;
+    {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "Sync");
+        for (RouteKey key : toRemove) {
+            EraseRouteLocked(key);
+        }
+        for (RouteKey key : toAdd) {
+            // Состояние могло измениться между снимком и блокировкой
+            if (!routes.contains(key)) {
+                InsertRouteLocked(RouteKeyAddress(key), RouteKeyPrefix(key), "System");
+                addedCount++;
+            }
         }
     }
 
@@ -398,7 +517,7 @@ void RouteController::CleanupRedundantRoutes() {
     for (const auto& route : systemRoutes) {
         if (route.prefixLength == 32) {
             HostRoute hr;
-            hr.ip = route.ipString;
+            hr.ip = Utils::FastUIntToIP(route.address);
             hr.ipNum = route.address;
             hr.processName = "System";
             hostRoutes.push_back(hr);
@@ -413,77 +532,244 @@ void RouteController::CleanupRedundantRoutes() {
     Logger::Instance().Info("CleanupRedundantRoutes - Completed");
 }
 
-void RouteController::ApplyOptimizationPlan(const OptimizationPlan& plan) {
-    std::vector<std::pair<std::string, int>> toRemove;
-    std::vector<std::pair<std::string, int>> toAdd;
-    std::vector<std::pair<std::string, int>> addedRoutes;
+void RouteController::ApplyOptimizationPlan(const OptimizationPlan& plan, bool incremental) {
+    PERF_TIMER("RouteController::ApplyOptimizationPlan");
+    std::lock_guard<std::mutex> applyLock(planApplyMutex);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Шаг плана: агрегат и маршруты, которые он заменяет. REMOVE до первого ADD - шаг без агрегата
+    struct PlanStep {
+        const OptimizationPlan::RouteChange* aggregate = nullptr;
+        std::vector<const OptimizationPlan::RouteChange*> covered;
+    };
 
+    std::vector<PlanStep> steps;
     for (const auto& change : plan.changes) {
         if (change.type == OptimizationPlan::RouteChange::ADD) {
-            toAdd.emplace_back(change.ip, change.prefixLength);
+            steps.push_back({ &change, {} });
         }
         else {
-            toRemove.emplace_back(change.ip, change.prefixLength);
+            if (steps.empty()) steps.emplace_back();
+            steps.back().covered.push_back(&change);
         }
     }
 
-    bool addFailed = false;
-    for (const auto& [ip, prefix] : toAdd) {
-        if (AddSystemRouteWithMask(ip, prefix)) {
-            addedRoutes.emplace_back(ip, prefix);
-        }
-        else {
-            Logger::Instance().Error(std::format("Failed to add aggregated route: {}/{}", ip, prefix));
-            addFailed = true;
-            break;
+    if (incremental) {
+        // План собран раньше: агрегат мог уже поставить другой план, покрытые - истечь
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "IncrementalPlan");
+        auto missing = [this](const OptimizationPlan::RouteChange* change) {
+            return !routes.contains(MakeRouteKey(Utils::FastIPToUInt(change->ip), change->prefixLength));
+        };
+        std::erase_if(steps, [&](PlanStep& step) {
+            if (!step.aggregate || !missing(step.aggregate)) return true;
+            std::erase_if(step.covered, missing);
+            return step.covered.empty();
+            });
+        if (steps.empty()) {
+            PERF_COUNT("RouteController.IncrementalPlanStale");
+            return;
         }
     }
 
-    if (addFailed) {
-        Logger::Instance().Warning("Rolling back optimization due to add failure");
-        for (const auto& [ip, prefix] : addedRoutes) {
-            RemoveSystemRouteWithMask(ip, prefix, config.gatewayIp);
+    // Темп системных вызовов: таблица не раздувается вдвое, IP Helper не заваливается
+    int rate = config.optimizerSettings.planSyscallsPerSecond;
+    auto interval = rate > 0 ? std::chrono::microseconds(1'000'000 / rate) : std::chrono::microseconds(0);
+    auto nextSyscall = std::chrono::steady_clock::now();
+    PlanExecutionStats result;
+    auto pace = [&] {
+        result.syscalls++;
+        if (interval.count() == 0) return;
+        auto now = std::chrono::steady_clock::now();
+        if (nextSyscall > now) {
+            std::this_thread::sleep_for(nextSyscall - now);
+            now = nextSyscall;
         }
-        return;
-    }
+        nextSyscall = now + interval;
+    };
 
-    for (const auto& [ip, prefix] : toRemove) {
-        if (!RemoveSystemRouteWithMask(ip, prefix, config.gatewayIp)) {
-            Logger::Instance().Warning(std::format("Failed to remove host route: {}/{}", ip, prefix));
+    size_t stepIndex = 0;
+    for (; stepIndex < steps.size(); stepIndex++) {
+        if (!running || ShutdownCoordinator::Instance().isShuttingDown) {
+            break;
         }
-    }
 
-    {
-        std::unique_lock<std::shared_mutex> lock(routesMutex);
+        const PlanStep& step = steps[stepIndex];
 
-        for (const auto& change : plan.changes) {
-            if (change.type == OptimizationPlan::RouteChange::ADD) {
-                std::string routeKey = std::format("{}/{}", change.ip, change.prefixLength);
-                auto routeInfo = std::make_unique<RouteInfo>(change.ip, "Optimized");
-                routeInfo->prefixLength = change.prefixLength;
-                routes[routeKey] = std::move(routeInfo);
+        // Make-before-break: сначала покрывающий префикс должен появиться в ядре
+        if (step.aggregate) {
+            const auto& aggregate = *step.aggregate;
+            pace();
+            if (!AddSystemRouteWithMask(aggregate.ip, aggregate.prefixLength)) {
+                Logger::Instance().Error(std::format("Failed to add aggregated route: {}/{}", aggregate.ip, aggregate.prefixLength));
+                result.failures++;
+                result.aggregatesFailed++;
+                continue;
+            }
+
+            pace();
+            if (!VerifySystemRoute(aggregate.ip, aggregate.prefixLength)) {
+                Logger::Instance().Warning(std::format("Aggregated route {}/{} not found after install, rolling back",
+                    aggregate.ip, aggregate.prefixLength));
+                result.failures++;
+                result.aggregatesFailed++;
+                pace();
+                RemoveSystemRouteWithMask(aggregate.ip, aggregate.prefixLength, ActiveGatewayIp());
+                continue;
             }
         }
 
-        for (const auto& change : plan.changes) {
-            if (change.type == OptimizationPlan::RouteChange::REMOVE) {
-                std::string routeKey = std::format("{}/{}", change.ip, change.prefixLength);
-                routes.erase(routeKey);
+        // Покрытые маршруты снимаются только под установленным агрегатом; неудачный остаётся и в состоянии
+        std::vector<RouteKey> retired;
+        retired.reserve(step.covered.size());
+        for (const auto* change : step.covered) {
+            pace();
+            if (RemoveSystemRouteWithMask(change->ip, change->prefixLength, ActiveGatewayIp())) {
+                retired.push_back(MakeRouteKey(Utils::FastIPToUInt(change->ip), change->prefixLength));
+            }
+            else {
+                Logger::Instance().Warning(std::format("Failed to remove host route: {}/{}", change->ip, change->prefixLength));
+                result.failures++;
             }
         }
 
-        routesDirty = true;
+        // Состояние фиксируется пошагово: короткая блокировка, таблица всегда согласована с ядром
+        {
+            auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "ApplyOptimization");
+            if (step.aggregate) {
+                InsertRouteLocked(Utils::FastIPToUInt(step.aggregate->ip), step.aggregate->prefixLength, "Optimized");
+                result.aggregatesApplied++;
+            }
+            for (RouteKey key : retired) {
+                EraseRouteLocked(key);
+            }
+            routesDirty = true;
+        }
+        result.routesRetired += retired.size();
+    }
+
+    result.stepsSkipped = steps.size() - stepIndex;
+    result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    result.completedAt = std::chrono::system_clock::now();
+
+    PERF_RECORD("RouteController.PlanApply", result.duration);
+    Logger::Instance().Info(std::format("Plan applied in {}ms: {} aggregates, {} routes retired, {} failed, "
+        "{} syscalls, {} failures, {} steps skipped", result.duration.count(), result.aggregatesApplied,
+        result.routesRetired, result.aggregatesFailed, result.syscalls, result.failures, result.stepsSkipped));
+
+    if (incremental) {
+        std::lock_guard<std::mutex> lock(planStatsMutex);
+        incrementalPlanStats.aggregatesApplied += result.aggregatesApplied;
+        incrementalPlanStats.aggregatesFailed += result.aggregatesFailed;
+        incrementalPlanStats.routesRetired += result.routesRetired;
+        incrementalPlanStats.syscalls += result.syscalls;
+        incrementalPlanStats.failures += result.failures;
+        incrementalPlanStats.duration += result.duration;
+        incrementalPlanStats.completedAt = result.completedAt;
+        PerformanceMonitor::Instance().SetGauge("RouteController.Incremental.AggregatesApplied",
+            incrementalPlanStats.aggregatesApplied);
+        PerformanceMonitor::Instance().SetGauge("RouteController.Incremental.RoutesRetired",
+            incrementalPlanStats.routesRetired);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(planStatsMutex);
+        lastPlanStats = result;
     }
 
     NotifyUIRouteCountChanged();
 }
 
-void RouteController::NotifyUIRouteCountChanged() {
-    // Асинхронное уведомление UI без блокировки
-    HWND uiWindow = FindWindow(L"RouteManagerProWindow", nullptr);
-    if (uiWindow) {
-        PostMessage(uiWindow, WM_USER + 101, 0, 0);
+RouteController::PlanExecutionStats RouteController::GetLastPlanStats() const {
+    std::lock_guard<std::mutex> lock(planStatsMutex);
+    return lastPlanStats;
+}
+
+bool RouteController::VerifySystemRoute(const std::string& ip, int prefixLength) {
+    MIB_IPFORWARD_ROW2 row;
+    InitializeIpForwardEntry(&row);
+    row.InterfaceIndex = ResolveGatewayInterface();
+    if (row.InterfaceIndex == 0) {
+        return false;
+    }
+
+    row.DestinationPrefix.Prefix.si_family = AF_INET;
+    inet_pton(AF_INET, ip.c_str(), &row.DestinationPrefix.Prefix.Ipv4.sin_addr);
+    row.DestinationPrefix.PrefixLength = static_cast<UINT8>(prefixLength);
+    row.NextHop.si_family = AF_INET;
+    row.NextHop.Ipv4.sin_addr.s_addr = gatewayAddress.load(std::memory_order_relaxed);
+
+    return IpHelper::Api().GetIpForwardEntry2(&row) == NO_ERROR;
+}
+
+void RouteController::CollectIncrementalPlanLocked(std::span<const RouteKey> added, OptimizationPlan& plan) {
+    if (!config.optimizerSettings.incremental) return;
+
+    PERF_TIMER("RouteController::CollectIncrementalPlan");
+    for (RouteKey key : added) {
+        auto aggregate = aggregator.FindAggregate(RouteKeyAddress(key), RouteKeyPrefix(key));
+        if (!aggregate) continue;
+
+        // Несколько маршрутов одного батча приводят к одному и тому же агрегату
+        std::string network = Utils::FastUIntToIP(aggregate->network);
+        bool duplicate = std::ranges::any_of(plan.changes, [&](const auto& change) {
+            return change.type == OptimizationPlan::RouteChange::ADD &&
+                change.prefixLength == aggregate->prefixLength && change.ip == network;
+            });
+        if (duplicate) continue;
+
+        plan.changes.push_back({ OptimizationPlan::RouteChange::ADD, network, aggregate->prefixLength, "Incremental" });
+        for (RouteKey coveredKey : aggregate->covered) {
+            auto it = routes.find(coveredKey);
+            plan.changes.push_back({ OptimizationPlan::RouteChange::REMOVE,
+                Utils::FastUIntToIP(RouteKeyAddress(coveredKey)), RouteKeyPrefix(coveredKey),
+                it != routes.end() ? std::string(processNames.Lookup(it->second->processId)) : std::string("Unknown") });
+        }
+
+        plan.routesBefore += static_cast<int>(aggregate->covered.size());
+        plan.routesAfter++;
+        PERF_COUNT("RouteController.IncrementalAggregation");
+    }
+}
+
+void RouteController::QueueIncrementalPlan(OptimizationPlan&& plan) {
+    if (plan.changes.empty()) return;
+
+    // Порог числа хостов не знает цены маршрутов: при cost-based агрегат выбирает
+    // полный оптимизатор, сработавший порог лишь будит его
+    if (config.optimizerSettings.costBased) {
+        PERF_COUNT("RouteController.IncrementalAggregation.Deferred");
+        RequestOptimization();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(optimizationMutex);
+
+        // Соседние батчи до применения могут собрать один и тот же агрегат: в очереди он один
+        auto& queued = pendingIncrementalPlan.changes;
+        bool skipping = false;
+        for (auto& change : plan.changes) {
+            if (change.type == OptimizationPlan::RouteChange::ADD) {
+                skipping = std::ranges::any_of(queued, [&change](const auto& existing) {
+                    return existing.type == OptimizationPlan::RouteChange::ADD &&
+                        existing.prefixLength == change.prefixLength && existing.ip == change.ip;
+                    });
+                if (!skipping) {
+                    Logger::Instance().Info(std::format("Incremental aggregation: {}/{}", change.ip, change.prefixLength));
+                }
+            }
+            if (!skipping) {
+                queued.push_back(std::move(change));
+            }
+        }
+        pendingIncrementalPlan.routesBefore += plan.routesBefore;
+        pendingIncrementalPlan.routesAfter += plan.routesAfter;
     }
+    optimizationCV.notify_one();
+}
+
+void RouteController::NotifyUIRouteCountChanged() {
+    // Только атомарный инкремент: безопасно под routesMutex, сообщение UI отправит поток notifier'а
+    routeNotifier.Signal();
 }
 
 void RouteController::RunOptimizationManual() {
@@ -492,6 +778,56 @@ void RouteController::RunOptimizationManual() {
     lastOptimizationTime = std::chrono::steady_clock::now();
 }
 
+void RouteController::RequestOptimization() {
+    {
+        std::lock_guard<std::mutex> lock(optimizationMutex);
+        optimizationRequested = true;
+    }
+    optimizationCV.notify_one();
+}
+
+size_t RouteController::GetMemoryBytes() {
+    // Оценка по числу маршрутов: узел таблицы, RouteEntry с блоком shared_ptr, слот view,
+    // индекс LPM, дерево агрегации и таймер колеса - порядка сотни байт на маршрут
+    constexpr size_t NODE_OVERHEAD = sizeof(void*) * 2;
+    constexpr size_t PER_ROUTE = sizeof(std::pair<const RouteKey, std::shared_ptr<RouteEntry>>) + NODE_OVERHEAD +
+        sizeof(RouteEntry) + sizeof(void*) * 2 +
+        sizeof(RouteKey) + sizeof(RouteTableView::EntryPtr) +
+        sizeof(RouteKey) * 4;
+    size_t bytes = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(routesMutex);
+        bytes += routes.bucket_count() * sizeof(void*) + routes.size() * PER_ROUTE;
+    }
+    {
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        bytes += expiryWheel.Size() * (sizeof(RouteKey) + sizeof(int64_t)) * 3;
+    }
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        bytes += routes6.bucket_count() * sizeof(void*) +
+            routes6.size() * (sizeof(std::pair<const Route6Key, Route6Entry>) + NODE_OVERHEAD);
+    }
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+        bytes += pendingRoutes.size() * (sizeof(std::pair<const RouteKey, PendingRoute>) + NODE_OVERHEAD) +
+            programQueue.size() * sizeof(RouteKey);
+    }
+    return bytes + changeJournal.MemoryBytes();
+}
+
+void RouteController::TrimMemory(MemoryPressure pressure) {
+    if (pressure == MemoryPressure::Normal) {
+        return;
+    }
+
+    RequestOptimization();
+    if (pressure == MemoryPressure::Shed) {
+        memoryEvictTarget.store(GetRouteCount() * 3 / 4, std::memory_order_relaxed);
+        CleanupOldRoutes();
+    }
+}
+
 void RouteController::InvalidateInterfaceCache() {
     std::unique_lock<std::shared_mutex> lock(interfaceCacheMutex);
     cachedInterfaceIndex = 0;
@@ -499,138 +835,470 @@ void RouteController::InvalidateInterfaceCache() {
 }
 
 void RouteController::UpdateConfig(const ServiceConfig& newConfig) {
-    std::unique_lock<std::shared_mutex> lock(routesMutex);
+    bool gatewayChanged = false;
+    bool metricChanged = false;
+    {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "UpdateConfig");
 
-    bool gatewayChanged = (config.gatewayIp != newConfig.gatewayIp);
-    bool metricChanged = (config.metric != newConfig.metric);
+        gatewayChanged = (config.gatewayIp != newConfig.gatewayIp);
+        metricChanged = (config.metric != newConfig.metric);
 
-    std::string oldGateway = config.gatewayIp;
-    config = newConfig;
+        // gatewayAddress не трогаем: до cut-over миграции горячий путь ставит маршруты через прежний шлюз
+        config = newConfig;
 
-    if (optimizer) {
-        OptimizerConfig optConfig;
-        optConfig.min_hosts_to_aggregate = config.optimizerSettings.minHostsToAggregate;
-        optConfig.waste_thresholds = config.optimizerSettings.wasteThresholds;
-        optimizer->UpdateConfig(optConfig);
+        if (optimizer) {
+            optimizer->UpdateConfig(MakeOptimizerConfig(config.optimizerSettings));
+        }
+        aggregator.Configure(config.optimizerSettings.minHostsToAggregate, config.optimizerSettings.wasteThresholds);
     }
 
-    if (gatewayChanged) {
-        Logger::Instance().Info(std::format("Gateway changed from {} to {}", oldGateway, config.gatewayIp));
-        InvalidateInterfaceCache();
-        MigrateExistingRoutes(oldGateway, config.gatewayIp);
-    }
-    else if (metricChanged) {
-        Logger::Instance().Info("Metric changed, updating all routes");
-        MigrateExistingRoutes(config.gatewayIp, config.gatewayIp);
+    if (gatewayChanged || metricChanged) {
+        GatewayChange change;
+        change.gateway = newConfig.gatewayIp;
+        change.gatewayChanged = gatewayChanged;
+        change.metricChanged = metricChanged;
+        uint64_t generation = RequestGatewayChange(std::move(change));
+        Logger::Instance().Info(std::format("Config generation {}: {} queued for background migration",
+            generation, gatewayChanged ? std::format("gateway {}", newConfig.gatewayIp) : std::string("metric change")));
     }
 }
 
-void RouteController::MigrateExistingRoutes(const std::string& oldGateway, const std::string& newGateway) {
-    std::vector<std::pair<std::string, int>> routesToMigrate;
-    for (const auto& [key, routeInfo] : routes) {
-        routesToMigrate.emplace_back(routeInfo->ip, routeInfo->prefixLength);
-    }
-
-    Logger::Instance().Info(std::format("Migrating {} routes from gateway {} to {}",
-        routesToMigrate.size(), oldGateway, newGateway));
-
-    int successCount = 0;
-    int failCount = 0;
-
-    for (const auto& [ip, prefix] : routesToMigrate) {
-        RemoveSystemRouteWithMask(ip, prefix, oldGateway);
-
-        if (AddSystemRouteWithMask(ip, prefix)) {
-            successCount++;
+uint64_t RouteController::RequestGatewayChange(GatewayChange change) {
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(migrationMutex);
+        generation = ++requestedGeneration;
+        change.generation = generation;
+        if (change.live) {
+            // Переключение пула не отменяет ожидающее изменение конфигурации: оно выполнится следом
+            pendingSwitch = std::move(change);
         }
         else {
-            failCount++;
-            Logger::Instance().Error(std::format("Failed to migrate route: {}/{}", ip, prefix));
+            // Новая конфигурация описывает целевой шлюз целиком, но что именно менялось,
+            // накапливаем: откат шлюза не должен терять переустановку с новой метрикой
+            if (pendingConfig) {
+                change.gatewayChanged |= pendingConfig->gatewayChanged;
+                change.metricChanged |= pendingConfig->metricChanged;
+            }
+            if (change.gatewayChanged) {
+                // Сменив основной шлюз, проба сама вернётся на него без переключения
+                pendingSwitch.reset();
+            }
+            pendingConfig = std::move(change);
         }
+        changePending.store(true, std::memory_order_relaxed);
     }
-
-    Logger::Instance().Info(std::format("Migration complete. Success: {}, Failed: {}",
-        successCount, failCount));
+    migrationCV.notify_one();
+    return generation;
 }
 
-void RouteController::PersistenceThreadFunc(std::stop_token stopToken) {
-    Logger::Instance().Info("RouteController persistence thread started");
+void RouteController::MigrationThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("RouteController migration thread started");
 
     try {
         while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
-            for (int i = 0; i < 60 && !stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown; i++) {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-            }
-
-            if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
-                break;
-            }
+            GatewayChange change;
+            {
+                std::unique_lock<std::mutex> lock(migrationMutex);
+                migrationCV.wait(lock, stopToken, [this] {
+                    return pendingSwitch.has_value() || pendingConfig.has_value() ||
+                        ShutdownCoordinator::Instance().isShuttingDown;
+                    });
 
-            auto now = std::chrono::steady_clock::now();
-            auto timeSinceLastSave = now - lastSaveTime;
+                if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
+                    break;
+                }
 
-            if (routesDirty.load() && timeSinceLastSave >= SAVE_INTERVAL) {
-                Logger::Instance().Info("Periodic save of routes (dirty flag set)");
-                SaveRoutesToDiskAsync();
+                // Переключение пула первым: текущий шлюз, скорее всего, уже нездоров
+                auto& next = pendingSwitch ? pendingSwitch : pendingConfig;
+                change = std::move(*next);
+                next.reset();
+                changePending.store(pendingSwitch.has_value() || pendingConfig.has_value(), std::memory_order_relaxed);
             }
-        }
 
-        if (routesDirty.load()) {
-            Logger::Instance().Info("Persistence thread: Final save of routes");
-            SaveRoutesToDisk();
+            if (change.live) {
+                ApplyGatewaySwitch(change.gateway);
+            }
+            else {
+                MigrateGateway(stopToken, change);
+            }
+            // Переключение пула выполняется раньше ожидавшей конфигурации, но номер у него больше
+            if (change.generation > appliedGeneration.load(std::memory_order_relaxed)) {
+                appliedGeneration.store(change.generation, std::memory_order_relaxed);
+            }
         }
     }
     catch (const std::exception& e) {
-        Logger::Instance().Error(std::format("PersistenceThreadFunc exception: {}", e.what()));
+        Logger::Instance().Error(std::format("MigrationThreadFunc exception: {}", e.what()));
     }
 
-    Logger::Instance().Info("RouteController persistence thread exiting");
+    Logger::Instance().Info("RouteController migration thread exiting");
 }
 
-void RouteController::SaveRoutesToDiskAsync() {
-    std::vector<std::pair<std::string, RouteInfo>> snapshot;
-    {
-        std::shared_lock<std::shared_mutex> lock(routesMutex);
-        for (const auto& [key, routeInfo] : routes) {
-            snapshot.emplace_back(key, *routeInfo);
-        }
+void RouteController::MigrateGateway(std::stop_token stopToken, const GatewayChange& change) {
+    PERF_TIMER("RouteController::MigrateGateway");
+
+    std::string oldGateway = ActiveGatewayIp();
+    // Только метрика: переустанавливаем через тот шлюз пула, на котором маршруты стоят сейчас
+    std::string targetGateway = change.gatewayChanged ? change.gateway : oldGateway;
+    uint32_t newAddress = inet_addr(targetGateway.c_str());
+    bool sameGateway = newAddress == gatewayAddress.load(std::memory_order_relaxed);
+    if (sameGateway && !change.metricChanged) {
+        Logger::Instance().Info(std::format("Routes already use gateway {}, nothing to migrate", targetGateway));
+        return;
     }
 
-    std::ofstream file(Constants::STATE_FILE + ".tmp");
-    if (!file.is_open()) {
-        Logger::Instance().Error("Failed to open state file for writing");
+    NET_IFINDEX targetInterface = 0;
+    if (sameGateway) {
+        targetInterface = ResolveGatewayInterface();
+    }
+    else if (IpHelper::Api().GetBestInterface(newAddress, &targetInterface) != NO_ERROR) {
+        targetInterface = 0;
+    }
+    if (targetInterface == 0) {
+        // Строить заранее не через что: переключаемся сразу, маршруты переставит очередь программирования
+        Logger::Instance().Warning(std::format("No interface towards gateway {}, switching without prebuild", targetGateway));
+        if (!sameGateway) {
+            ApplyGatewaySwitch(targetGateway);
+        }
         return;
     }
 
-    file << "version=3\n";
+    // Самые используемые переносятся первыми: число ссылок, затем давность использования.
+    // Ключи, уже стоящие в очереди программирования, доведёт она же после cut-over
+    PublishRouteView();
+    auto view = GetRouteView();
+    struct Candidate {
+        RouteKey key;
+        int refCount;
+        int64_t lastUsed;
+    };
+    std::vector<Candidate> order;
+    order.reserve(view->Size());
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+        auto keys = view->Keys();
+        auto entries = view->Entries();
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (entries[i]->removed.load(std::memory_order_relaxed) || pendingRoutes.contains(keys[i])) continue;
+            order.push_back({ keys[i], entries[i]->refCount.load(std::memory_order_relaxed),
+                entries[i]->lastUsed.load(std::memory_order_relaxed) });
+        }
+    }
+    std::ranges::sort(order, [](const Candidate& a, const Candidate& b) {
+        return a.refCount != b.refCount ? a.refCount > b.refCount : a.lastUsed > b.lastUsed;
+        });
 
-    auto now = std::chrono::system_clock::now();
-    auto nowSeconds = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-    file << std::format("timestamp={}\n", nowSeconds);
-    file << std::format("gateway={}\n", config.gatewayIp);
+    auto startTime = std::chrono::steady_clock::now();
+    migrationTotal.store(order.size(), std::memory_order_relaxed);
+    migrationDone.store(0, std::memory_order_relaxed);
+    migrationFailed.store(0, std::memory_order_relaxed);
+    migrationStartedAt.store(startTime.time_since_epoch().count(), std::memory_order_relaxed);
+    migrationActive.store(true, std::memory_order_release);
+
+    Logger::Instance().Info(std::format("Migrating {} routes from gateway {} to {} in background (generation {})",
+        order.size(), oldGateway, targetGateway, change.generation));
+
+    std::vector<RouteKey> migrated;
+    std::vector<RouteKey> lost;             // Только смена метрики: старый снят, новый не встал
+    migrated.reserve(order.size());
+    bool interrupted = false;
+    for (const Candidate& candidate : order) {
+        if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown ||
+            changePending.load(std::memory_order_relaxed)) {
+            // Новое изменение или остановка: текущий перенос завершается cut-over с того места, где он есть
+            interrupted = true;
+            break;
+        }
 
-    for (const auto& [routeKey, route] : snapshot) {
-        auto createdSeconds = std::chrono::duration_cast<std::chrono::seconds>(
-            route.createdAt.time_since_epoch()).count();
+        std::string ip = Utils::FastUIntToIP(RouteKeyAddress(candidate.key));
+        int prefixLength = RouteKeyPrefix(candidate.key);
+        bool moved = false;
+        if (sameGateway) {
+            // Тот же шлюз с другой метрикой ядро не поставит рядом, поэтому здесь снимаем первым
+            RemoveSystemRouteWithMask(ip, prefixLength, oldGateway);
+            moved = AddSystemRouteVia(ip, prefixLength, newAddress, targetInterface);
+            if (!moved) {
+                lost.push_back(candidate.key);
+            }
+        }
+        else {
+            // Make-before-break: старый маршрут снимаем, только когда новый уже в таблице
+            moved = AddSystemRouteVia(ip, prefixLength, newAddress, targetInterface);
+            if (moved) {
+                RemoveSystemRouteWithMask(ip, prefixLength, oldGateway);
+            }
+        }
 
-        file << std::format("route={},{},{},{},{}\n",
-            route.ip, route.processName, createdSeconds, route.prefixLength, config.gatewayIp);
+        if (moved) {
+            migrated.push_back(candidate.key);
+        }
+        else {
+            migrationFailed.fetch_add(1, std::memory_order_relaxed);
+            Logger::Instance().Error(std::format("Failed to migrate route: {}/{}", ip, prefixLength));
+        }
+        migrationDone.fetch_add(1, std::memory_order_relaxed);
     }
 
-    file.close();
+    // Починка и аудит ждали конца сборки: до cut-over они поставили бы перенесённые маршруты
+    // обратно через старый шлюз. Отпускаем их, когда gatewayAddress уже указывает на цель
+    auto finishBuild = [this, startTime] {
+        lastMigrationMs.store(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count(), std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(repairMutex);
+            migrationActive.store(false, std::memory_order_release);
+        }
+        repairCV.notify_one();
+    };
 
-    if (std::filesystem::exists(Constants::STATE_FILE + ".tmp")) {
-        std::filesystem::rename(Constants::STATE_FILE + ".tmp", Constants::STATE_FILE);
-    }
+    size_t leftToQueue = 0;
+    if (!sameGateway) {
+        // Cut-over: с этого момента горячий путь и очередь программирования работают через новый шлюз
+        NET_IFINDEX oldInterface = 0;
+        {
+            std::shared_lock<std::shared_mutex> interfaceLock(interfaceCacheMutex);
+            oldInterface = cachedInterfaceIndex;
+        }
+        // Сверка перед cut-over: копию через старый шлюз мог поставить проход починки,
+        // начатый до сборки. После переключения перенесённые ключи старый шлюз уже не снимет
+        std::ranges::sort(migrated);
+        size_t leftovers = 0;
+        for (RouteKey key : GetSystemRouteKeys(true)) {
+            if (std::ranges::binary_search(migrated, key)) {
+                RemoveSystemRouteWithMask(Utils::FastUIntToIP(RouteKeyAddress(key)), RouteKeyPrefix(key), oldGateway);
+                leftovers++;
+            }
+        }
+        if (leftovers > 0) {
+            Logger::Instance().Warning(std::format("Removed {} leftover routes via old gateway {}", leftovers, oldGateway));
+        }
 
-    routesDirty = false;
-    lastSaveTime = std::chrono::steady_clock::now();
+        gatewayAddress.store(newAddress, std::memory_order_relaxed);
+        InvalidateSystemRouteSnapshot();
+        InvalidateInterfaceCache();
+        finishBuild();
+
+        // Добавленные во время переноса и не перенесённые маршруты доводит очередь, make-before-break;
+        // перенесённые, но уже удалённые из таблицы, снимаем с нового шлюза
+        PublishRouteView();
+        auto current = GetRouteView();
+        std::vector<RouteKey> remaining;
+        for (RouteKey key : current->Keys()) {
+            if (!std::ranges::binary_search(migrated, key)) {
+                remaining.push_back(key);
+            }
+        }
+        for (RouteKey key : migrated) {
+            if (!current->Find(key)) {
+                RemoveSystemRouteWithMask(Utils::FastUIntToIP(RouteKeyAddress(key)), RouteKeyPrefix(key), targetGateway);
+            }
+        }
+        EnqueueReroutes(remaining, oldGateway);
+        leftToQueue = remaining.size();
 
-    Logger::Instance().Info(std::format("Routes saved to disk: {} routes", snapshot.size()));
-}
+        MigrateIpv6Routes(oldInterface);
+        PERF_COUNT("RouteController.GatewaySwitches");
+    }
+    else {
+        finishBuild();
+        if (!lost.empty()) {
+            ReinstallRoutes(lost);
+        }
+        MigrateIpv6Routes(targetInterface);
+    }
 
-bool RouteController::AddRoute(const std::string& ip, const std::string& processName) {
-    return AddRouteWithMask(ip, 32, processName);
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    lastMigrationMs.store(duration.count(), std::memory_order_relaxed);
+    PERF_RECORD("RouteController.MigrationTotal", duration);
+
+    Logger::Instance().Info(std::format("Migration to {} {}: {} moved, {} failed, {} left to the programming queue in {}ms",
+        targetGateway, interrupted ? "cut over early" : "complete", migrated.size(),
+        migrationFailed.load(std::memory_order_relaxed), leftToQueue, duration.count()));
+}
+
+RouteController::MigrationProgress RouteController::GetMigrationProgress() const {
+    MigrationProgress progress;
+    progress.active = migrationActive.load(std::memory_order_acquire);
+    progress.total = migrationTotal.load(std::memory_order_relaxed);
+    progress.done = migrationDone.load(std::memory_order_relaxed);
+    progress.failed = migrationFailed.load(std::memory_order_relaxed);
+    progress.generation = appliedGeneration.load(std::memory_order_relaxed);
+    if (progress.active) {
+        auto started = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(migrationStartedAt.load(std::memory_order_relaxed)));
+        progress.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    }
+    else {
+        progress.duration = std::chrono::milliseconds(lastMigrationMs.load(std::memory_order_relaxed));
+    }
+    return progress;
+}
+
+std::string RouteController::ActiveGatewayIp() const {
+    return Utils::FastUIntToIP(ntohl(gatewayAddress.load(std::memory_order_relaxed)));
+}
+
+void RouteController::SwitchGateway(const std::string& gatewayIp) {
+    // Переключение пула не ждёт предварительной сборки: текущий шлюз, скорее всего, уже нездоров
+    GatewayChange change;
+    change.gateway = gatewayIp;
+    change.live = true;
+    RequestGatewayChange(std::move(change));
+}
+
+void RouteController::ApplyGatewaySwitch(const std::string& gatewayIp) {
+    uint32_t newAddress = inet_addr(gatewayIp.c_str());
+    uint32_t oldAddress = gatewayAddress.exchange(newAddress, std::memory_order_relaxed);
+    if (oldAddress == newAddress) return;
+
+    std::string oldGateway = Utils::FastUIntToIP(ntohl(oldAddress));
+    Logger::Instance().Info(std::format("Switching routes from gateway {} to {}", oldGateway, gatewayIp));
+
+    // Новые добавления сразу идут через новый шлюз; снимок системной таблицы был по старому
+    InvalidateSystemRouteSnapshot();
+    NET_IFINDEX oldInterface = 0;
+    {
+        std::shared_lock<std::shared_mutex> interfaceLock(interfaceCacheMutex);
+        oldInterface = cachedInterfaceIndex;
+    }
+    InvalidateInterfaceCache();
+
+    PublishRouteView();
+    auto view = GetRouteView();
+    size_t queued = EnqueueReroutes(view->Keys(), oldGateway);
+
+    PERF_COUNT("RouteController.GatewaySwitches");
+    Logger::Instance().Info(std::format("Queued {} routes to move to gateway {}", queued, gatewayIp));
+
+    // IPv6 привязан к интерфейсу шлюза; таблица маленькая, переносим сразу
+    MigrateIpv6Routes(oldInterface);
+}
+
+void RouteController::RetryReroutesLater(std::vector<PendingRoute>&& failed) {
+    if (failed.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(programMutex);
+    for (PendingRoute& pending : failed) {
+        auto delay = (std::min)(Constants::ROUTE_REROUTE_RETRY_MIN * (1 << (std::min)(pending.rerouteFailures, 6)),
+            Constants::ROUTE_REROUTE_RETRY_MAX);
+        pending.op = PendingOp::Reroute;
+        pending.rerouteFailures++;
+        pending.hits = 0;
+        rerouteRetries.emplace_back(now + delay, std::move(pending));
+    }
+    PerformanceMonitor::Instance().SetGauge("RouteController.Reroute.Retries", rerouteRetries.size());
+    // Спящий программист должен пересчитать срок ожидания
+    programCV.notify_one();
+}
+
+void RouteController::EnqueueDueReroutesLocked(std::chrono::steady_clock::time_point now) {
+    size_t before = rerouteRetries.size();
+    std::erase_if(rerouteRetries, [&](auto& retry) {
+        if (retry.first > now) {
+            return false;
+        }
+        PendingRoute& pending = retry.second;
+        RouteKey key = MakeRouteKey(pending.address, pending.prefixLength);
+        auto [it, inserted] = pendingRoutes.try_emplace(key, std::move(pending));
+        if (inserted) {
+            it->second.enqueuedAt = now;
+            programQueue.push_back(key);
+        }
+        else if (it->second.fromGateway.empty()) {
+            // Ключ уже в очереди по другой причине: перенос выполнится вместе с ней
+            it->second.fromGateway = std::move(pending.fromGateway);
+        }
+        return true;
+        });
+    if (rerouteRetries.size() != before) {
+        programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
+        PerformanceMonitor::Instance().SetGauge("RouteController.Reroute.Retries", rerouteRetries.size());
+    }
+}
+
+size_t RouteController::EnqueueReroutes(std::span<const RouteKey> keys, const std::string& fromGateway) {
+    size_t queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+
+        // Как и удаления, переносы не ограничены ROUTE_PROGRAM_QUEUE_LIMIT: маршрут остался бы на старом шлюзе
+        for (RouteKey key : keys) {
+            auto it = pendingRoutes.find(key);
+            if (it != pendingRoutes.end()) {
+                // Ключ уже в очереди: запоминаем, где маршрут стоит на самом деле, если ещё не знаем
+                if (it->second.fromGateway.empty()) {
+                    it->second.fromGateway = fromGateway;
+                }
+                continue;
+            }
+
+            PendingRoute pending;
+            pending.op = PendingOp::Reroute;
+            pending.address = RouteKeyAddress(key);
+            pending.prefixLength = RouteKeyPrefix(key);
+            pending.ip = Utils::FastUIntToIP(pending.address);
+            pending.fromGateway = fromGateway;
+            pending.enqueuedAt = std::chrono::steady_clock::now();
+
+            pendingRoutes.emplace(key, std::move(pending));
+            programQueue.push_back(key);
+            queued++;
+        }
+        programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
+    }
+    programCV.notify_all();
+    return queued;
+}
+
+void RouteController::PersistenceThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("RouteController persistence thread started");
+
+    try {
+        auto lastFlush = std::chrono::steady_clock::now();
+
+        while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
+                break;
+            }
+
+            // Истёкшие и вытесняемые маршруты уходят в очередь программирования, без routesMutex
+            CleanupOldRoutes();
+
+            auto now = std::chrono::steady_clock::now();
+
+            // Компактим журнал в новый снимок, когда он разросся или давно не сохранялись
+            if (routesDirty.load() && (stateStore.JournalRecordCount() >= Constants::JOURNAL_COMPACT_RECORDS ||
+                now - lastSaveTime >= SAVE_INTERVAL)) {
+                Logger::Instance().Info("Compacting route journal into a new snapshot");
+                SaveRoutesToDisk();
+                lastFlush = now;
+            }
+            else if (now - lastFlush >= Constants::JOURNAL_FLUSH_INTERVAL) {
+                stateStore.FlushJournal();
+                lastFlush = now;
+            }
+        }
+
+        if (routesDirty.load()) {
+            Logger::Instance().Info("Persistence thread: Final save of routes");
+            SaveRoutesToDisk();
+        }
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("PersistenceThreadFunc exception: {}", e.what()));
+    }
+
+    Logger::Instance().Info("RouteController persistence thread exiting");
+}
+
+bool RouteController::AddRoute(const std::string& ip, const std::string& processName) {
+    return AddRouteWithMask(ip, 32, processName);
 }
 
 bool RouteController::AddRouteWithMask(const std::string& ip, int prefixLength, const std::string& processName) {
@@ -639,6 +1307,10 @@ bool RouteController::AddRouteWithMask(const std::string& ip, int prefixLength,
 
     // Супер-быстрая проверка валидности IP (без regex)
     if (!Utils::IsValidIPv4(ip)) {
+        // IPv6 (например, из preload-конфига) разбираем только после провала IPv4-проверки
+        if (Ipv6Address address; Ipv6Address::Parse(ip, address)) {
+            return AddRoute6(address, prefixLength, processName);
+        }
         PERF_COUNT("RouteController.InvalidIP");
         return false;
     }
@@ -646,18 +1318,23 @@ bool RouteController::AddRouteWithMask(const std::string& ip, int prefixLength,
     // Супер-быстрая проверка приватных IP (только битовые операции)
     if (Utils::IsPrivateIP(ip)) {
         PERF_COUNT("RouteController.PrivateIPSkipped");
-        Logger::Instance().Debug(std::format("Skipping private IP: {}", ip));
+        LOG_DEBUG("Skipping private IP: {}", ip);
         return false;
     }
 
-    std::string routeKey = std::format("{}/{}", ip, prefixLength);
+    uint32_t ipAddr = Utils::FastIPToUInt(ip);
+    RouteKey routeKey = MakeRouteKey(ipAddr, prefixLength);
+
+    if (TouchPublishedRoute(ipAddr, prefixLength, 1)) {
+        return true;
+    }
 
-    // ОПТИМИЗАЦИЯ: Сначала проверяем существование с read-only lock
+    // Маршрут мог появиться после последней публикации view - проверяем под read-only lock
     {
-        std::shared_lock<std::shared_mutex> lock(routesMutex);
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "AddRoute");
 
-        // Быстрая проверка покрытия
-        if (IsIPCoveredByExistingRoute(ip)) {
+        // Быстрая проверка покрытия (заодно продлевает покрывающий маршрут)
+        if (IsIPCoveredByExistingRoute(ipAddr, prefixLength)) {
             PERF_COUNT("RouteController.IPAlreadyCovered");
             Logger::Instance().Info(std::format("IP {} is already covered by an aggregated route", ip));
             return true;
@@ -666,10 +1343,12 @@ bool RouteController::AddRouteWithMask(const std::string& ip, int prefixLength,
         // Проверяем существование маршрута
         auto it = routes.find(routeKey);
         if (it != routes.end()) {
-            it->second->refCount.fetch_add(1, std::memory_order_relaxed);
+            AddRouteRefs(*it->second, 1);
+            it->second->lastUsed.store(UnixSeconds(), std::memory_order_relaxed);
+            MergeIdleTtl(*it->second, 0);
             PERF_COUNT("RouteController.RouteExists");
-            Logger::Instance().Info(std::format("Route exists, ref count: {} (refs: {})",
-                routeKey, it->second->refCount.load(std::memory_order_relaxed)));
+            Logger::Instance().Info(std::format("Route exists, ref count: {}/{} (refs: {})",
+                ip, prefixLength, it->second->refCount.load(std::memory_order_relaxed)));
             return true;
         }
     }
@@ -686,230 +1365,1008 @@ bool RouteController::AddRouteWithMask(const std::string& ip, int prefixLength,
     PERF_COUNT("RouteController.SystemRouteAdded");
 
     // Теперь быстро обновляем внутренние структуры
+    OptimizationPlan incrementalPlan;
     {
-        std::unique_lock<std::shared_mutex> lock(routesMutex);
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "AddRoute");
 
         // Двойная проверка после блокировки
         auto it = routes.find(routeKey);
         if (it != routes.end()) {
-            it->second->refCount.fetch_add(1, std::memory_order_relaxed);
+            AddRouteRefs(*it->second, 1);
             return true;
         }
 
-        // Проверка лимитов
+        // Лимит мягкий: вытеснение idle-маршрутов сделает persistence-поток вне блокировки
         if (routes.size() >= Constants::MAX_ROUTES) {
-            CleanupOldRoutes();
+            evictionRequested.store(true, std::memory_order_relaxed);
         }
 
         // Быстрое добавление
-        auto routeInfo = std::make_unique<RouteInfo>(ip, processName);
-        routeInfo->prefixLength = prefixLength;
-        routes[routeKey] = std::move(routeInfo);
+        InsertRouteLocked(ipAddr, prefixLength, processName);
+        CollectIncrementalPlanLocked(std::span(&routeKey, 1), incrementalPlan);
 
         routesDirty.store(true, std::memory_order_relaxed);
     }
 
+    QueueIncrementalPlan(std::move(incrementalPlan));
+
     // Метрика времени добавления
     auto routeEndTime = std::chrono::high_resolution_clock::now();
     auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(routeEndTime - routeStartTime);
-    PerformanceMonitor::Instance().RecordOperation("RouteController.AddRouteTotal", totalTime);
+    PERF_RECORD("RouteController.AddRouteTotal", totalTime);
 
-    Logger::Instance().Info(std::format("Added route: {} for {}, time: {}µs",
-        routeKey, processName, totalTime.count()));
+    Logger::Instance().Info(std::format("Added route: {}/{} for {}, time: {}µs",
+        ip, prefixLength, processName, totalTime.count()));
 
-    // ОПТИМИЗАЦИЯ: Асинхронное уведомление UI (не блокирует)
-    std::thread([this]() {
-        NotifyUIRouteCountChanged();
-        }).detach();
+    NotifyUIRouteCountChanged();
 
     return true;
 }
 
-bool RouteController::RemoveRoute(const std::string& ip) {
-    return RemoveRouteWithMask(ip, 32);
+bool RouteController::EnqueueRoute(const std::string& ip, const std::string& processName) {
+    if (!Utils::IsValidIPv4(ip)) {
+        PERF_COUNT("RouteController.InvalidIP");
+        return false;
+    }
+
+    return EnqueueRoute(Utils::FastIPToUInt(ip), processName);
 }
 
-bool RouteController::RemoveRouteWithMask(const std::string& ip, int prefixLength) {
-    std::unique_lock<std::shared_mutex> lock(routesMutex);
+bool RouteController::TouchRoute(uint32_t address, int64_t idleTtl) {
+    return TouchPublishedRoute(address, 32, 0, idleTtl);
+}
+
+bool RouteController::EnqueueRoute(uint32_t address, std::string_view processName, int64_t idleTtl) {
+    if (Utils::IsPrivateIPv4(address)) {
+        PERF_COUNT("RouteController.PrivateIPSkipped");
+        return false;
+    }
 
-    std::string routeKey = std::format("{}/{}", ip, prefixLength);
-    auto it = routes.find(routeKey);
-    if (it == routes.end()) return false;
+    RouteKey routeKey = MakeRouteKey(address, 32);
 
-    if (--it->second->refCount <= 0) {
-        if (RemoveSystemRouteWithMask(ip, prefixLength, config.gatewayIp)) {
-            Logger::Instance().Info(std::format("Removed route: {}", routeKey));
-            routes.erase(it);
-            routesDirty = true;
+    // Уже установленный или покрытый маршрут продлеваем через view, не трогая очередь
+    if (TouchPublishedRoute(address, 32, 1, idleTtl)) {
+        return true;
+    }
 
-            NotifyUIRouteCountChanged();
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+
+        auto it = pendingRoutes.find(routeKey);
+        if (it != pendingRoutes.end()) {
+            if (it->second.bulk) {
+                // Адрес из фонового набора нужен прямо сейчас - переводим в основную очередь
+                it->second.bulk = false;
+                bulkPending--;
+                bulkIndex.Erase(address, 32);
+                programQueue.push_back(routeKey);
+                programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
+            }
+            if (it->second.op != PendingOp::Add) {
+                // Маршрут снова используется: вместо удаления только продлеваем его
+                it->second.op = PendingOp::Add;
+                it->second.processName = processName;
+                it->second.hits = 0;
+                it->second.idleTtl = idleTtl;
+            }
+            else if (it->second.idleTtl != 0 && (idleTtl == 0 || idleTtl > it->second.idleTtl)) {
+                it->second.idleTtl = idleTtl;
+            }
+            // Уже ждёт программирования - только учитываем ссылку
+            it->second.hits++;
+            PERF_COUNT("RouteController.ProgramQueue.Deduplicated");
             return true;
         }
+
+        // Адрес внутри ещё не установленного фонового диапазона: вперёд встаёт сам диапазон,
+        // отдельный /32 ему не нужен
+        if (int covering = bulkIndex.FindCovering(address); covering >= 0) {
+            RouteKey rangeKey = MakeRouteKey(address & RoutePrefixIndex::MaskFor(covering), covering);
+            auto range = pendingRoutes.find(rangeKey);
+            if (range != pendingRoutes.end() && range->second.bulk) {
+                range->second.bulk = false;
+                bulkPending--;
+                bulkIndex.Erase(RouteKeyAddress(rangeKey), covering);
+                programQueue.push_back(rangeKey);
+                programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
+                PERF_COUNT("RouteController.BulkQueue.Promoted");
+                programCV.notify_one();
+                return true;
+            }
+        }
+
+        if (programQueue.size() >= Constants::ROUTE_PROGRAM_QUEUE_LIMIT) {
+            PERF_COUNT("RouteController.ProgramQueue.Dropped");
+            Logger::Instance().Warning(std::format("Route programming queue full, dropping {}",
+                Utils::FastUIntToIP(address)));
+            return false;
+        }
+
+        PendingRoute pending;
+        pending.ip = Utils::FastUIntToIP(address);
+        pending.address = address;
+        pending.prefixLength = 32;
+        pending.processName = processName;
+        pending.idleTtl = idleTtl;
+        pending.enqueuedAt = std::chrono::steady_clock::now();
+
+        pendingRoutes.emplace(routeKey, std::move(pending));
+        programQueue.push_back(routeKey);
+        programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
     }
 
+    programCV.notify_one();
+    PERF_COUNT("RouteController.ProgramQueue.Enqueued");
     return true;
 }
 
-void RouteController::CleanupAllRoutes() {
-    Logger::Instance().Info("CleanupAllRoutes - Starting cleanup of all routes");
+void RouteController::RouteProgrammerThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("RouteController programmer thread started");
 
-    // Sync with system table first to catch any routes not in our internal map
-    SyncWithSystemTable();
+    try {
+        std::vector<PendingRoute> batch;
+        batch.reserve(Constants::ROUTE_PROGRAM_BATCH_SIZE);
+        std::vector<std::pair<Route6Key, std::string>> batch6;
 
-    std::vector<std::pair<std::string, int>> routesToDelete;
-    bool hadPreloadRoutes = false;
-    {
-        std::unique_lock<std::shared_mutex> lock(routesMutex);
-        if (routes.empty()) {
-            Logger::Instance().Info("CleanupAllRoutes - No routes to clean");
-            return;
-        }
+        while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+            size_t depth = 0;
+            size_t bulkDepth = 0;
+            {
+                std::unique_lock<std::mutex> lock(programMutex);
+                auto hasWork = [this] {
+                    return !programQueue.empty() || !programQueue6.empty() || bulkPending > 0 ||
+                        ShutdownCoordinator::Instance().isShuttingDown;
+                };
+                if (rerouteRetries.empty()) {
+                    programCV.wait(lock, stopToken, hasWork);
+                }
+                else {
+                    auto due = std::ranges::min_element(rerouteRetries, {}, &decltype(rerouteRetries)::value_type::first)->first;
+                    programCV.wait_until(lock, stopToken, due, hasWork);
+                }
 
-        for (const auto& [routeKey, routeInfo] : routes) {
-            routesToDelete.emplace_back(routeInfo->ip, routeInfo->prefixLength);
-            if (routeInfo->processName.starts_with("Preload-")) {
-                hadPreloadRoutes = true;
-            }
-        }
+                if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
+                    break;
+                }
 
-        routes.clear();
-        routesDirty = true;
-    }
+                EnqueueDueReroutesLocked(std::chrono::steady_clock::now());
 
-    int successCount = 0;
-    int failCount = 0;
+                while (!programQueue.empty() && batch.size() < Constants::ROUTE_PROGRAM_BATCH_SIZE) {
+                    auto node = pendingRoutes.extract(programQueue.front());
+                    programQueue.pop_front();
+                    if (!node.empty()) {
+                        if (node.mapped().bulk) {
+                            bulkPending--;
+                            bulkIndex.Erase(node.mapped().address, node.mapped().prefixLength);
+                        }
+                        batch.push_back(std::move(node.mapped()));
+                    }
+                }
 
-    for (const auto& [ip, prefixLength] : routesToDelete) {
-        if (RemoveSystemRouteWithMask(ip, prefixLength, config.gatewayIp)) {
-            successCount++;
-        }
-        else {
-            Logger::Instance().Error(std::format("Failed to remove Windows route for: {}/{}", ip, prefixLength));
-            failCount++;
+                // Фоновые маршруты - только когда живых нет, и малой пачкой: новый flow ждёт не дольше неё
+                while (programQueue.empty() && !bulkQueue.empty() && batch.size() < Constants::ROUTE_BULK_BATCH_SIZE) {
+                    RouteKey key = bulkQueue.front();
+                    bulkQueue.pop_front();
+                    auto it = pendingRoutes.find(key);
+                    if (it == pendingRoutes.end() || !it->second.bulk) {
+                        continue;   // Снят или переведён в основную очередь
+                    }
+                    bulkIndex.Erase(it->second.address, it->second.prefixLength);
+                    batch.push_back(std::move(pendingRoutes.extract(it).mapped()));
+                    bulkPending--;
+                }
+
+                while (!programQueue6.empty() && batch6.size() < Constants::ROUTE_PROGRAM_BATCH_SIZE) {
+                    auto node = pendingRoutes6.extract(programQueue6.front());
+                    programQueue6.pop_front();
+                    if (!node.empty()) {
+                        batch6.emplace_back(node.key(), std::move(node.mapped()));
+                    }
+                }
+
+                depth = programQueue.size();
+                bulkDepth = bulkPending;
+                programQueueDepth.store(depth, std::memory_order_relaxed);
+            }
+
+            PerformanceMonitor::Instance().SetGauge("RouteController.ProgramQueue.Depth", depth);
+            PerformanceMonitor::Instance().SetGauge("RouteController.BulkQueue.Depth", bulkDepth);
+            if (!batch.empty()) {
+                ProgramRouteBatch(batch);
+                batch.clear();
+            }
+            for (const auto& [key, processName] : batch6) {
+                AddRoute6(key.address, key.prefixLength, processName);
+            }
+            batch6.clear();
         }
     }
-
-    if (hadPreloadRoutes) {
-        config.aiPreloadEnabled = false;
-        Logger::Instance().Info("CleanupAllRoutes - Disabled AI preload since preload routes were removed");
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("RouteProgrammerThreadFunc exception: {}", e.what()));
     }
 
-    SaveRoutesToDisk();
-    NotifyUIRouteCountChanged();
-
-    Logger::Instance().Info(std::format("CleanupAllRoutes - Completed. Removed: {}, Failed: {}",
-        successCount, failCount));
+    Logger::Instance().Info("RouteController programmer thread exiting");
 }
 
-void RouteController::CleanupOldRoutes() {
-    auto now = std::chrono::system_clock::now();
-    auto cutoff = now - std::chrono::hours(Constants::ROUTE_CLEANUP_HOURS);
+void RouteController::ProgramRouteBatch(std::vector<PendingRoute>& batch) {
+    PERF_TIMER("RouteController::ProgramRouteBatch");
+
+    // 1. Под одной shared-блокировкой отсекаем покрытые и уже установленные маршруты,
+    //    а из кандидатов на удаление - те, что успели снова использоваться
+    std::vector<PendingRoute*> toInstall;
+    std::vector<PendingRoute*> toRemove;
+    std::vector<PendingRoute*> toReroute;
+    std::vector<std::tuple<RouteKey, int64_t, int64_t>> toReschedule;
+    toInstall.reserve(batch.size());
+    int64_t nowSeconds = UnixSeconds();
+    std::string activeGateway = ActiveGatewayIp();
+    // Маршрут остаётся в таблице, но стоит ещё через прежний шлюз пула
+    auto needsReroute = [&activeGateway](const PendingRoute& pending) {
+        return !pending.fromGateway.empty() && pending.fromGateway != activeGateway;
+    };
+    // Expire и Evict снимают только простаивающий маршрут
+    auto usedRecently = [this](const RouteEntry& entry, PendingOp op, int64_t now) {
+        int64_t minIdle = op == PendingOp::Expire ? IdleTtlOf(entry) :
+            std::chrono::duration_cast<std::chrono::seconds>(Constants::ROUTE_EVICT_MIN_IDLE).count();
+        return now - entry.lastUsed.load(std::memory_order_relaxed) < minIdle;
+    };
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "ProgramBatch");
 
-    bool anyRemoved = false;
-    for (auto it = routes.begin(); it != routes.end();) {
-        if (it->second->createdAt < cutoff) {
-            RemoveSystemRouteWithMask(it->second->ip, it->second->prefixLength, config.gatewayIp);
-            it = routes.erase(it);
-            anyRemoved = true;
-        }
-        else {
-            ++it;
-        }
-    }
+        for (auto& pending : batch) {
+            if (pending.op == PendingOp::Reroute) {
+                if (routes.contains(MakeRouteKey(pending.address, pending.prefixLength)) && needsReroute(pending)) {
+                    toReroute.push_back(&pending);
+                }
+                continue;
+            }
 
-    if (anyRemoved) {
-        routesDirty = true;
-        NotifyUIRouteCountChanged();
-    }
-}
+            if (pending.op != PendingOp::Add) {
+                RouteKey key = MakeRouteKey(pending.address, pending.prefixLength);
+                auto it = routes.find(key);
+                if (it == routes.end()) {
+                    continue;
+                }
 
-size_t RouteController::GetRouteCount() const {
-    std::shared_lock<std::shared_mutex> lock(routesMutex);
-    return routes.size();
-}
+                if (pending.op == PendingOp::Remove) {
+                    toRemove.push_back(&pending);
+                    continue;
+                }
 
-std::vector<RouteInfo> RouteController::GetActiveRoutes() const {
-    std::shared_lock<std::shared_mutex> lock(routesMutex);
-    std::vector<RouteInfo> result;
+                int64_t lastUsed = it->second->lastUsed.load(std::memory_order_relaxed);
+                if (usedRecently(*it->second, pending.op, nowSeconds)) {
+                    toReschedule.emplace_back(key, lastUsed, it->second->idleTtl.load(std::memory_order_relaxed));
+                    PERF_COUNT("RouteController.Expiry.Refreshed");
+                    if (needsReroute(pending)) {
+                        toReroute.push_back(&pending);
+                    }
+                    continue;
+                }
 
-    for (const auto& [key, routeInfo] : routes) {
-        result.push_back(*routeInfo);
-    }
+                toRemove.push_back(&pending);
+                continue;
+            }
 
-    std::ranges::sort(result, [](const RouteInfo& a, const RouteInfo& b) {
-        return a.createdAt > b.createdAt;
-        });
+            if (IsIPCoveredByExistingRoute(pending.address, pending.prefixLength)) {
+                PERF_COUNT("RouteController.IPAlreadyCovered");
+                continue;
+            }
 
-    return result;
-}
+            RouteKey key = MakeRouteKey(pending.address, pending.prefixLength);
+            auto it = routes.find(key);
+            if (it != routes.end()) {
+                AddRouteRefs(*it->second, pending.hits);
+                it->second->lastUsed.store(nowSeconds, std::memory_order_relaxed);
+                MergeIdleTtl(*it->second, pending.idleTtl);
+                // Это может быть отменённое Expire/Evict: таймер колесо уже отдало, ставим заново
+                toReschedule.emplace_back(key, nowSeconds, it->second->idleTtl.load(std::memory_order_relaxed));
+                PERF_COUNT("RouteController.RouteExists");
+                if (needsReroute(pending)) {
+                    toReroute.push_back(&pending);
+                }
+                continue;
+            }
 
-bool RouteController::IsIPCoveredByExistingRoute(const std::string& ip) {
-    // Используем быстрое преобразование IP
-    uint32_t ipAddr = 0;
+            toInstall.push_back(&pending);
+        }
+    }
 
-    // Проверяем thread-local кэш
-    auto it = tlIPCache.find(ip);
-    if (it != tlIPCache.end()) {
-        ipAddr = it->second;
+    for (const auto& [key, lastUsed, idleTtl] : toReschedule) {
+        ScheduleRouteExpiry(key, lastUsed, idleTtl);
     }
-    else {
-        ipAddr = Utils::FastIPToUInt(ip);
-        if (tlIPCache.size() > 1000) {
-            tlIPCache.clear();
+
+    // 2. Системные вызовы без блокировок
+    std::vector<PendingRoute*> installed;
+    installed.reserve(toInstall.size());
+    for (PendingRoute* pending : toInstall) {
+        if (AddSystemRouteWithMask(pending->ip, pending->prefixLength)) {
+            PERF_COUNT("RouteController.SystemRouteAdded");
+            installed.push_back(pending);
+        }
+        else {
+            PERF_COUNT("RouteController.SystemRouteAddFailed");
+            Logger::Instance().Error(std::format("Failed to add route for {}", pending->ip));
         }
-        tlIPCache[ip] = ipAddr;
     }
 
-    // ОПТИМИЗАЦИЯ: Сначала проверяем крупные агрегаты (более вероятны)
-    for (const auto& [routeKey, routeInfo] : routes) {
-        if (routeInfo->prefixLength >= 24) continue;
-
-        uint32_t routeAddr = IPToUInt(routeInfo->ip);
-        uint32_t mask = CreateMask(routeInfo->prefixLength);
+    // Make-before-break: сначала маршрут через новый шлюз, потом снимаем старый
+    size_t rerouted = 0;
+    std::vector<PendingRoute> rerouteFailed;
+    for (PendingRoute* pending : toReroute) {
+        if (!AddSystemRouteWithMask(pending->ip, pending->prefixLength)) {
+            PERF_COUNT("RouteController.RerouteFailed");
+            Logger::Instance().Error(std::format("Failed to move route {}/{} to gateway {}, will retry",
+                pending->ip, pending->prefixLength, activeGateway));
+            // Копия: Expire/Evict с этим же pending ещё может быть в toRemove
+            rerouteFailed.push_back(*pending);
+            continue;
+        }
+        RemoveSystemRouteWithMask(pending->ip, pending->prefixLength, pending->fromGateway);
+        PERF_COUNT("RouteController.Rerouted");
+        rerouted++;
+    }
+    RetryReroutesLater(std::move(rerouteFailed));
 
-        if ((ipAddr & mask) == (routeAddr & mask)) {
-            PERF_COUNT("RouteController.CoveredByLargeAggregate");
-            return true;
+    for (PendingRoute* pending : toRemove) {
+        RemoveSystemRouteWithMask(pending->ip, pending->prefixLength,
+            needsReroute(*pending) ? pending->fromGateway : activeGateway);
+        if (pending->op == PendingOp::Expire) {
+            PERF_COUNT("RouteController.Expiry.Expired");
+        }
+        else if (pending->op == PendingOp::Remove) {
+            PERF_COUNT("RouteController.Removed");
+        }
+        else {
+            PERF_COUNT("RouteController.Expiry.Evicted");
         }
     }
 
-    // Затем проверяем /24 сети
-    uint32_t network24 = ipAddr & 0xFFFFFF00;
-    for (const auto& [routeKey, routeInfo] : routes) {
-        if (routeInfo->prefixLength != 24) continue;
+    // 3. Одна unique-блокировка на весь батч
+    OptimizationPlan incrementalPlan;
+    std::vector<std::tuple<PendingRoute*, int64_t, int64_t>> revived;
+    std::vector<PendingRoute*> revokedPreload;
+    if (!installed.empty() || !toRemove.empty()) {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "ProgramBatch");
+
+        int64_t eraseSeconds = UnixSeconds();
+        for (PendingRoute* pending : toRemove) {
+            RouteKey key = MakeRouteKey(pending->address, pending->prefixLength);
+            // Пока ядро снимало маршрут без блокировки, по нему снова пошёл трафик - запись оставляем
+            auto it = routes.find(key);
+            if (it != routes.end() && pending->op != PendingOp::Remove &&
+                usedRecently(*it->second, pending->op, eraseSeconds)) {
+                revived.emplace_back(pending, it->second->lastUsed.load(std::memory_order_relaxed),
+                    it->second->idleTtl.load(std::memory_order_relaxed));
+                continue;
+            }
+            EraseRouteLocked(key);
+        }
 
-        uint32_t routeNetwork = IPToUInt(routeInfo->ip) & 0xFFFFFF00;
-        if (network24 == routeNetwork) {
-            PERF_COUNT("RouteController.CoveredBy24");
-            return true;
+        std::vector<RouteKey> insertedKeys;
+        insertedKeys.reserve(installed.size());
+        for (PendingRoute* pending : installed) {
+            auto it = routes.find(MakeRouteKey(pending->address, pending->prefixLength));
+            if (it != routes.end()) {
+                AddRouteRefs(*it->second, pending->hits);
+                continue;
+            }
+            // Сервис выключили, пока диапазон был в батче: системный маршрут снимем ниже
+            if (pending->revoked && pending->revoked->load(std::memory_order_acquire)) {
+                revokedPreload.push_back(pending);
+                continue;
+            }
+            insertedKeys.push_back(MakeRouteKey(pending->address, pending->prefixLength));
+
+            if (routes.size() >= Constants::MAX_ROUTES) {
+                evictionRequested.store(true, std::memory_order_relaxed);
+            }
+
+            RouteEntry& entry = InsertRouteLocked(pending->address, pending->prefixLength, pending->processName);
+            entry.refCount.store(pending->hits, std::memory_order_relaxed);
+            if (pending->idleTtl > 0) {
+                entry.idleTtl.store(pending->idleTtl, std::memory_order_relaxed);
+                ScheduleRouteExpiry(MakeRouteKey(pending->address, pending->prefixLength),
+                    entry.lastUsed.load(std::memory_order_relaxed), pending->idleTtl);
+            }
         }
+
+        // Агрегаты считаются после всего батча: соседние адреса одного батча дают один план
+        CollectIncrementalPlanLocked(insertedKeys, incrementalPlan);
+        routesDirty.store(true, std::memory_order_relaxed);
     }
 
-    return false;
-}
+    QueueIncrementalPlan(std::move(incrementalPlan));
 
-uint32_t RouteController::IPToUInt(const std::string& ip) {
-    // Проверяем thread-local кэш
-    auto it = tlIPCache.find(ip);
-    if (it != tlIPCache.end()) {
-        return it->second;
+    for (PendingRoute* pending : revokedPreload) {
+        PERF_COUNT("RouteController.BulkQueue.Revoked");
+        RemoveSystemRouteWithMask(pending->ip, pending->prefixLength, activeGateway);
+        // Тот же ключ мог за это время поставить другой программист
+        bool reinstated = false;
+        {
+            auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "ProgramBatch");
+            reinstated = routes.contains(MakeRouteKey(pending->address, pending->prefixLength));
+        }
+        if (reinstated) {
+            AddSystemRouteWithMask(pending->ip, pending->prefixLength);
+        }
     }
 
-    uint32_t result = Utils::FastIPToUInt(ip);
+    // Ожившим маршрутам возвращаем снятый системный маршрут и таймер простоя
+    for (const auto& [pending, lastUsed, idleTtl] : revived) {
+        PERF_COUNT("RouteController.Expiry.Revived");
+        if (!AddSystemRouteWithMask(pending->ip, pending->prefixLength)) {
+            Logger::Instance().Error(std::format("Failed to reinstall revived route {}/{}", pending->ip, pending->prefixLength));
+        }
+        ScheduleRouteExpiry(MakeRouteKey(pending->address, pending->prefixLength), lastUsed, idleTtl);
+    }
 
-    // Ограничиваем размер кэша
-    if (tlIPCache.size() > 1000) {
-        tlIPCache.clear();
+    // Латентность "от постановки в очередь до ядра"
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& pending : batch) {
+        if (pending.op != PendingOp::Add || pending.bulk) continue;
+        PERF_RECORD("RouteAddLatency", now - pending.enqueuedAt);
     }
 
-    tlIPCache[ip] = result;
-    return result;
+    if (!installed.empty() || !toRemove.empty()) {
+        Logger::Instance().Info(std::format("Programmed {} routes, expired {} (batch of {})",
+            installed.size(), toRemove.size(), batch.size()));
+        NotifyUIRouteCountChanged();
+    }
+    if (rerouted > 0) {
+        LOG_DEBUG("Moved {} routes to gateway {} (batch of {})", rerouted, activeGateway, batch.size());
+    }
 }
 
-constexpr uint32_t RouteController::CreateMask(int prefixLength) {
-    if (prefixLength <= 0) return 0;
-    if (prefixLength >= 32) return 0xFFFFFFFF;
-    return ~((1u << (32 - prefixLength)) - 1);
+bool RouteController::RemoveRoute(const std::string& ip) {
+    return RemoveRouteWithMask(ip, 32);
+}
+
+bool RouteController::RemoveRouteWithMask(const std::string& ip, int prefixLength) {
+    if (ip.contains(':')) {
+        Ipv6Address address;
+        return Ipv6Address::Parse(ip, address) && RemoveRoute6(address, prefixLength);
+    }
+
+    RouteKey routeKey = MakeRouteKey(Utils::FastIPToUInt(ip), prefixLength);
+    std::shared_ptr<RouteEntry> entry;
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "RemoveRoute");
+        auto it = routes.find(routeKey);
+        if (it == routes.end()) return false;
+
+        if (AddRouteRefs(*it->second, -1) > 0) {
+            return true;
+        }
+        entry = it->second;
+    }
+
+    // Системный вызов без блокировки. За это время Touch/Enqueue могли снова взять ссылку
+    // на запись или поставить новую - тогда системный маршрут возвращаем
+    if (RemoveSystemRouteWithMask(ip, prefixLength, ActiveGatewayIp())) {
+        bool revived = false;
+        {
+            auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "RemoveRoute");
+            auto it = routes.find(routeKey);
+            if (it != routes.end()) {
+                if (it->second == entry && entry->refCount.load() <= 0) {
+                    Logger::Instance().Info(std::format("Removed route: {}/{}", ip, prefixLength));
+                    EraseRouteLocked(routeKey);
+                    routesDirty = true;
+                }
+                else {
+                    revived = true;
+                }
+            }
+        }
+        if (revived) {
+            PERF_COUNT("RouteController.RemoveRoute.Revived");
+            if (!AddSystemRouteWithMask(ip, prefixLength)) {
+                Logger::Instance().Error(std::format("Failed to reinstall revived route {}/{}", ip, prefixLength));
+            }
+        }
+    }
+
+    return true;
+}
+
+void RouteController::CleanupAllRoutes() {
+    Logger::Instance().Info("CleanupAllRoutes - Starting cleanup of all routes");
+
+    // Очистка снимает и preload: фоновая установка не должна вернуть маршруты после неё
+    bool hadPreloadRoutes = false;
+    {
+        std::lock_guard<std::mutex> preloadLock(preloadMutex);
+        hadPreloadRoutes = std::exchange(preloadActive, false);
+        preloadRoutes6.clear();     // IPv6 снимает CleanupAllRoutes6 ниже
+        RevokePreloadLocked({});
+    }
+    DropBulkRoutes({}, {});
+
+    // Sync with system table first to catch any routes not in our internal map
+    SyncWithSystemTable();
+
+    size_t removed6 = CleanupAllRoutes6();
+    if (removed6 > 0) {
+        Logger::Instance().Info(std::format("CleanupAllRoutes - Removed {} IPv6 routes", removed6));
+        NotifyUIRouteCountChanged();
+    }
+
+    std::vector<std::pair<std::string, int>> routesToDelete;
+    {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "CleanupAll");
+        if (routes.empty()) {
+            Logger::Instance().Info("CleanupAllRoutes - No routes to clean");
+            if (hadPreloadRoutes) {
+                config.aiPreloadEnabled = false;
+            }
+            return;
+        }
+
+        routesToDelete.reserve(routes.size());
+        for (const auto& [routeKey, entry] : routes) {
+            routesToDelete.emplace_back(Utils::FastUIntToIP(entry->address), entry->prefixLength);
+            if (processNames.Lookup(entry->processId).starts_with("Preload-")) {
+                hadPreloadRoutes = true;
+            }
+            entry->removed.store(true, std::memory_order_release);
+        }
+
+        routes.clear();
+        changeJournal.Append(RouteChangeJournal::Op::Clear, 0);
+        routesVersion++;
+        routeIndex.Clear();
+        aggregator.Clear();
+        {
+            std::lock_guard<std::mutex> expiryLock(expiryMutex);
+            expiryWheel.Clear();
+        }
+        stateStore.Append(RouteStateStore::JournalOp::Clear, 0, 0);
+        routesDirty = true;
+    }
+
+    int successCount = 0;
+    int failCount = 0;
+
+    for (const auto& [ip, prefixLength] : routesToDelete) {
+        if (RemoveSystemRouteWithMask(ip, prefixLength, ActiveGatewayIp())) {
+            successCount++;
+        }
+        else {
+            Logger::Instance().Error(std::format("Failed to remove Windows route for: {}/{}", ip, prefixLength));
+            failCount++;
+        }
+    }
+
+    if (hadPreloadRoutes) {
+        config.aiPreloadEnabled = false;
+        Logger::Instance().Info("CleanupAllRoutes - Disabled AI preload since preload routes were removed");
+    }
+
+    SaveRoutesToDisk();
+    NotifyUIRouteCountChanged();
+
+    Logger::Instance().Info(std::format("CleanupAllRoutes - Completed. Removed: {}, Failed: {}",
+        successCount, failCount));
+}
+
+void RouteController::CleanupOldRoutes() {
+    // Не вызывать под routesMutex: продвигаем колесо и отдаём кандидатов writer-потокам
+    std::vector<RouteKey> expired;
+    std::vector<RouteKey> evicted;
+    size_t routeCount = GetRouteCount();
+    bool overLimit = evictionRequested.exchange(false, std::memory_order_relaxed) ||
+        routeCount >= Constants::MAX_ROUTES;
+    size_t memoryTarget = memoryEvictTarget.exchange(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        expiryWheel.Advance(UnixSeconds(), expired);
+
+        size_t target = Constants::MAX_ROUTES - Constants::ROUTE_EVICT_HEADROOM;
+        if (memoryTarget > 0 && memoryTarget < target) {
+            target = memoryTarget;
+            overLimit = true;
+        }
+        if (overLimit && routeCount > target + expired.size()) {
+            // Ближайшие дедлайны = давнее всего не использованные маршруты
+            expiryWheel.TakeEarliest(routeCount - target - expired.size(), evicted);
+        }
+    }
+
+    if (!expired.empty()) {
+        EnqueueRouteRemovals(expired, PendingOp::Expire);
+    }
+    if (!evicted.empty()) {
+        Logger::Instance().Info(std::format("Route table at limit ({} routes), evicting up to {} idle routes",
+            routeCount, evicted.size()));
+        EnqueueRouteRemovals(evicted, PendingOp::Evict);
+    }
+
+    ExpireIpv6Routes();
+}
+
+void RouteController::EnqueueRouteRemovals(std::span<const RouteKey> keys, PendingOp op) {
+    std::vector<RouteKey> pendingAdds;
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+
+        // Удаления не ограничены ROUTE_PROGRAM_QUEUE_LIMIT: потерянный таймер означал бы вечный маршрут
+        for (RouteKey key : keys) {
+            auto it = pendingRoutes.find(key);
+            if (it != pendingRoutes.end()) {
+                // Явное удаление сильнее отложенных истечения и переноса; fromGateway сохраняется
+                if (op == PendingOp::Remove && it->second.op != PendingOp::Add) {
+                    it->second.op = PendingOp::Remove;
+                    continue;
+                }
+                // Маршрут ждёт добавления, т.е. используется прямо сейчас
+                pendingAdds.push_back(key);
+                continue;
+            }
+
+            PendingRoute pending;
+            pending.op = op;
+            pending.address = RouteKeyAddress(key);
+            pending.prefixLength = RouteKeyPrefix(key);
+            pending.ip = Utils::FastUIntToIP(pending.address);
+            pending.enqueuedAt = std::chrono::steady_clock::now();
+
+            pendingRoutes.emplace(key, std::move(pending));
+            programQueue.push_back(key);
+        }
+        programQueueDepth.store(programQueue.size(), std::memory_order_relaxed);
+    }
+
+    for (RouteKey key : pendingAdds) {
+        ScheduleRouteExpiry(key, UnixSeconds());
+    }
+
+    programCV.notify_all();
+}
+
+void RouteController::ScheduleRouteExpiry(RouteKey key, int64_t lastUsed, int64_t idleTtl) {
+    std::lock_guard<std::mutex> lock(expiryMutex);
+    expiryWheel.Schedule(key, lastUsed + (idleTtl > 0 ? idleTtl : ROUTE_IDLE_TTL_SEC));
+}
+
+bool RouteController::TouchPublishedRoute(uint32_t address, int prefixLength, int hits, int64_t idleTtl) {
+    auto view = GetRouteView();
+
+    if (RouteEntry* entry = view->Find(MakeRouteKey(address, prefixLength))) {
+        if (!entry->removed.load(std::memory_order_acquire)) {
+            if (hits > 0) {
+                AddRouteRefs(*entry, hits);
+            }
+            entry->lastUsed.store(UnixSeconds(), std::memory_order_relaxed);
+            MergeIdleTtl(*entry, idleTtl);
+            PERF_COUNT("RouteController.RouteExists");
+            return true;
+        }
+    }
+
+    if (RouteEntry* covering = view->FindCovering(address, prefixLength)) {
+        if (!covering->removed.load(std::memory_order_acquire)) {
+            covering->lastUsed.store(UnixSeconds(), std::memory_order_relaxed);
+            PERF_COUNT("RouteController.IPAlreadyCovered");
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t RouteController::GetRouteCount() const {
+    return GetRouteView()->Size() + routes6Count.load(std::memory_order_relaxed);
+}
+
+std::vector<RouteInfo> RouteController::GetActiveRoutes() const {
+    // Читаем опубликованный view без routesMutex; отставание не больше интервала notifier'а
+    auto view = GetRouteView();
+    std::vector<RouteInfo> result;
+    result.reserve(view->Size());
+
+    for (const auto& entry : view->Entries()) {
+        result.push_back(MaterializeRoute(*entry, *view));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        for (const auto& [key, entry] : routes6) {
+            RouteInfo& info = result.emplace_back(key.address.ToString(), processNames6.Lookup(entry.processId));
+            info.refCount = entry.refCount;
+            info.createdAt = entry.createdAt;
+            info.prefixLength = key.prefixLength;
+        }
+    }
+
+    std::ranges::sort(result, [](const RouteInfo& a, const RouteInfo& b) {
+        return a.createdAt > b.createdAt;
+        });
+
+    return result;
+}
+
+RouteChangeSet RouteController::GetRouteChangesSince(uint64_t since) {
+    PERF_TIMER("RouteController::GetRouteChangesSince");
+    JournalDirtyRefCounts();
+
+    RouteChangeSet result;
+    std::vector<RouteChangeJournal::Record> records;
+    bool served = changeJournal.ReadSince(since, records, result.sequence);
+    served = served && std::ranges::none_of(records, [](const RouteChangeJournal::Record& record) {
+        return record.op == RouteChangeJournal::Op::Clear;
+        });
+
+    if (!served) {
+        // Курсор вне окна журнала: отдаём таблицу целиком, номер берём под теми же блокировками
+        PERF_COUNT("RouteController.RouteChanges.FullResync");
+        result.fullResync = true;
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "GetRouteChangesSince");
+        std::lock_guard<std::mutex> lock6(routes6Mutex);
+        result.sequence = changeJournal.Sequence();
+        result.routes.reserve(routes.size() + routes6.size());
+        for (const auto& [routeKey, entry] : routes) {
+            result.routes.push_back(MaterializeRouteLocked(*entry));
+        }
+        for (const auto& [key, entry] : routes6) {
+            result.routes.push_back(MaterializeRoute6Locked(key, entry));
+        }
+        std::ranges::sort(result.routes, [](const RouteInfo& a, const RouteInfo& b) {
+            return a.createdAt > b.createdAt;
+            });
+        return result;
+    }
+
+    if (records.empty()) {
+        return result;
+    }
+
+    result.changes.reserve(records.size());
+    auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "GetRouteChangesSince");
+    std::lock_guard<std::mutex> lock6(routes6Mutex);
+    for (const RouteChangeJournal::Record& record : records) {
+        RouteChange& change = result.changes.emplace_back();
+        if (record.op == RouteChangeJournal::Op::Add) {
+            // Добавление материализуем из живой записи; если её уже удалили, дальше в журнале есть Remove
+            change.type = RouteChangeType::Added;
+            if (record.ipv6) {
+                auto it = routes6.find(record.key6);
+                if (it != routes6.end()) {
+                    change.route = MaterializeRoute6Locked(it->first, it->second);
+                    continue;
+                }
+            }
+            else {
+                auto it = routes.find(record.key);
+                if (it != routes.end()) {
+                    change.route = MaterializeRouteLocked(*it->second);
+                    continue;
+                }
+            }
+            result.changes.pop_back();
+            continue;
+        }
+
+        change.type = record.op == RouteChangeJournal::Op::Remove ? RouteChangeType::Removed : RouteChangeType::RefCount;
+        if (record.ipv6) {
+            change.route.ip = record.key6.address.ToString();
+            change.route.prefixLength = record.key6.prefixLength;
+        }
+        else {
+            change.route.ip = Utils::FastUIntToIP(RouteKeyAddress(record.key));
+            change.route.prefixLength = RouteKeyPrefix(record.key);
+        }
+        change.route.refCount = record.refCount;
+    }
+    return result;
+}
+
+uint64_t RouteController::GetRouteChangeSequence() {
+    // Номер должен учитывать и накопленные изменения refCount
+    JournalDirtyRefCounts();
+    return changeJournal.Sequence();
+}
+
+void RouteController::SetChangeListener(std::function<void(uint64_t sequence)> listener) {
+    std::lock_guard<std::mutex> lock(changeListenerMutex);
+    changeListener = std::move(listener);
+}
+
+void RouteController::NotifyChangeListener() {
+    std::lock_guard<std::mutex> lock(changeListenerMutex);
+    if (changeListener) {
+        changeListener(changeJournal.Sequence());
+    }
+}
+
+int RouteController::AddRouteRefs(RouteEntry& entry, int hits) {
+    // Горячий путь: только атомики; ключ ставится в очередь один раз до следующего чтения журнала
+    int refCount = entry.refCount.fetch_add(hits) + hits;
+    if (!entry.refCountDirty.exchange(true)) {
+        std::lock_guard<std::mutex> lock(refDirtyMutex);
+        // Больше окна журнала всё равно не догнать дельтой: без читателя очередь не растёт
+        if (refDirtyKeys.size() < Constants::ROUTE_JOURNAL_CAPACITY) {
+            refDirtyKeys.push_back(MakeRouteKey(entry.address, entry.prefixLength));
+        }
+        else {
+            refDirtyOverflow = true;
+        }
+    }
+    return refCount;
+}
+
+void RouteController::JournalDirtyRefCounts() {
+    std::vector<RouteKey> keys;
+    bool overflow = false;
+    {
+        std::lock_guard<std::mutex> lock(refDirtyMutex);
+        keys.swap(refDirtyKeys);
+        overflow = std::exchange(refDirtyOverflow, false);
+    }
+    if (keys.empty() && !overflow) {
+        return;
+    }
+
+    auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "JournalDirtyRefCounts");
+    if (overflow) {
+        // Часть ключей в очередь не попала: вместо них читатели получат полный список
+        PERF_COUNT("RouteController.RouteChanges.RefDirtyOverflow");
+        for (const auto& [key, entry] : routes) {
+            entry->refCountDirty.store(false);
+        }
+        changeJournal.Append(RouteChangeJournal::Op::Clear, 0);
+        return;
+    }
+    for (RouteKey key : keys) {
+        auto it = routes.find(key);
+        if (it == routes.end()) {
+            continue;
+        }
+        // Флаг снимается до чтения: инкремент после него снова поставит ключ в очередь
+        it->second->refCountDirty.store(false);
+        changeJournal.Append(RouteChangeJournal::Op::RefCount, key, it->second->refCount.load());
+    }
+}
+
+bool RouteController::IsIPCoveredByExistingRoute(uint32_t ipAddr, int prefixLength) {
+    // Вызывается под routesMutex. Ищем самый длинный установленный префикс,
+    // строго короче запрошенного, который покрывает адрес.
+    int coveringLength = routeIndex.FindCovering(ipAddr, prefixLength);
+    if (coveringLength < 0) {
+        return false;
+    }
+
+    // Трафик на покрытый адрес - это использование покрывающего маршрута
+    auto it = routes.find(MakeRouteKey(ipAddr & RoutePrefixIndex::MaskFor(coveringLength), coveringLength));
+    if (it != routes.end()) {
+        it->second->lastUsed.store(UnixSeconds(), std::memory_order_relaxed);
+    }
+
+    if (coveringLength == 24) {
+        PERF_COUNT("RouteController.CoveredBy24");
+    }
+    else {
+        PERF_COUNT("RouteController.CoveredByLargeAggregate");
+    }
+    return true;
+}
+
+RouteEntry& RouteController::InsertRouteLocked(uint32_t address, int prefixLength, std::string_view processName) {
+    // Вызывается под unique-блокировкой routesMutex; существующая запись заменяется новой,
+    // т.к. опубликованные view могут всё ещё читать старую
+    auto& slot = routes[MakeRouteKey(address, prefixLength)];
+    if (slot) {
+        slot->removed.store(true, std::memory_order_release);
+    }
+    slot = std::make_shared<RouteEntry>();
+    RouteEntry& entry = *slot;
+    entry.address = address;
+    entry.prefixLength = static_cast<uint8_t>(prefixLength);
+    entry.processId = processNames.Intern(processName);
+    entry.refCount.store(1, std::memory_order_relaxed);
+    entry.createdAt = std::chrono::system_clock::now();
+    entry.lastUsed.store(UnixSeconds(entry.createdAt), std::memory_order_relaxed);
+
+    routeIndex.Insert(address, prefixLength);
+    aggregator.Insert(address, prefixLength);
+    ScheduleRouteExpiry(MakeRouteKey(address, prefixLength), UnixSeconds(entry.createdAt));
+    if (!restoringState) {
+        stateStore.Append(RouteStateStore::JournalOp::Add, address, prefixLength, processName, entry.createdAt);
+    }
+    changeJournal.Append(RouteChangeJournal::Op::Add, MakeRouteKey(address, prefixLength));
+    routesVersion++;
+    routeNotifier.Signal();
+    return entry;
+}
+
+bool RouteController::EraseRouteLocked(RouteKey key) {
+    auto it = routes.find(key);
+    if (it == routes.end()) {
+        return false;
+    }
+
+    routeIndex.Erase(it->second->address, it->second->prefixLength);
+    aggregator.Erase(it->second->address, it->second->prefixLength);
+    stateStore.Append(RouteStateStore::JournalOp::Remove, it->second->address, it->second->prefixLength);
+    {
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        expiryWheel.Cancel(key);
+    }
+    it->second->removed.store(true, std::memory_order_release);
+    routes.erase(it);
+    changeJournal.Append(RouteChangeJournal::Op::Remove, key);
+    routesVersion++;
+    routeNotifier.Signal();
+    return true;
+}
+
+size_t RouteController::PublishRouteView() {
+    PERF_TIMER("RouteController::PublishRouteView");
+    std::lock_guard<std::mutex> publishLock(publishMutex);
+
+    auto current = GetRouteView();
+    std::shared_ptr<const RouteTableView> next;
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "PublishView");
+        if (current && routesVersion == current->Version()) {
+            return current->Size();
+        }
+
+        std::vector<std::pair<RouteKey, RouteTableView::EntryPtr>> entries;
+        entries.reserve(routes.size());
+        for (const auto& [key, entry] : routes) {
+            entries.emplace_back(key, entry);
+        }
+
+        // Интернер только растёт: копируем имена, лишь когда появились новые
+        if (!viewNames || viewNames->size() != processNames.Size()) {
+            auto names = std::make_shared<std::vector<std::string>>();
+            names->reserve(processNames.Size());
+            for (size_t id = 0; id < processNames.Size(); id++) {
+                names->push_back(processNames.Lookup(static_cast<StringInterner::Id>(id)));
+            }
+            viewNames = std::move(names);
+        }
+
+        uint64_t version = routesVersion;
+        lock.unlock();
+
+        std::ranges::sort(entries, {}, &std::pair<RouteKey, RouteTableView::EntryPtr>::first);
+        next = std::make_shared<const RouteTableView>(version, std::move(entries), viewNames);
+    }
+
+    routeView.store(next, std::memory_order_release);
+    PerformanceMonitor::Instance().SetGauge("RouteController.View.Version", next->Version());
+    return next->Size();
+}
+
+RouteInfo RouteController::MaterializeRoute(const RouteEntry& entry, const RouteTableView& view) const {
+    RouteInfo info(Utils::FastUIntToIP(entry.address), view.ProcessName(entry.processId));
+    info.prefixLength = entry.prefixLength;
+    info.refCount = entry.refCount.load(std::memory_order_relaxed);
+    info.createdAt = entry.createdAt;
+    return info;
+}
+
+RouteInfo RouteController::MaterializeRouteLocked(const RouteEntry& entry) const {
+    RouteInfo info(Utils::FastUIntToIP(entry.address), processNames.Lookup(entry.processId));
+    info.prefixLength = entry.prefixLength;
+    info.refCount = entry.refCount.load(std::memory_order_relaxed);
+    info.createdAt = entry.createdAt;
+    return info;
+}
+
+RouteInfo RouteController::MaterializeRoute6Locked(const Route6Key& key, const Route6Entry& entry) const {
+    RouteInfo info(key.address.ToString(), processNames6.Lookup(entry.processId));
+    info.prefixLength = key.prefixLength;
+    info.refCount = entry.refCount;
+    info.createdAt = entry.createdAt;
+    return info;
+}
+
+constexpr uint32_t RouteController::CreateMask(int prefixLength) {
+    if (prefixLength <= 0) return 0;
+    if (prefixLength >= 32) return 0xFFFFFFFF;
+    return ~((1u << (32 - prefixLength)) - 1);
 }
 
 bool RouteController::AddSystemRoute(const std::string& ip) {
@@ -917,6 +2374,15 @@ bool RouteController::AddSystemRoute(const std::string& ip) {
 }
 
 bool RouteController::AddSystemRouteWithMask(const std::string& ip, int prefixLength) {
+    NET_IFINDEX bestInterface = ResolveGatewayInterface();
+    if (bestInterface == 0) {
+        return false;
+    }
+
+    return AddSystemRouteVia(ip, prefixLength, gatewayAddress.load(std::memory_order_relaxed), bestInterface);
+}
+
+bool RouteController::AddSystemRouteVia(const std::string& ip, int prefixLength, uint32_t gateway, NET_IFINDEX interfaceIndex) {
     PERF_TIMER("RouteController::AddSystemRouteWithMask");
 
     // Используем thread-local структуру для избежания аллокаций
@@ -932,232 +2398,1075 @@ bool RouteController::AddSystemRouteWithMask(const std::string& ip, int prefixLe
     inet_pton(AF_INET, ip.c_str(), &destAddr.Ipv4.sin_addr);
 
     nextHop.si_family = AF_INET;
-    inet_pton(AF_INET, config.gatewayIp.c_str(), &nextHop.Ipv4.sin_addr);
+    nextHop.Ipv4.sin_addr.s_addr = gateway;
 
-    NET_IFINDEX bestInterface = 0;
+    // Переиспользуем thread-local структуру
+    tlRoute.InterfaceIndex = interfaceIndex;
+    tlRoute.DestinationPrefix.Prefix = destAddr;
+    tlRoute.DestinationPrefix.PrefixLength = prefixLength;
+    tlRoute.NextHop = nextHop;
+    tlRoute.Protocol = MIB_IPPROTO_NETMGMT;
+    tlRoute.Metric = config.metric;
 
-    // Используем кэшированный интерфейс
-    {
-        std::shared_lock<std::shared_mutex> lock(interfaceCacheMutex);
-        bestInterface = cachedInterfaceIndex;
-    }
+    DWORD result = IpHelper::Api().CreateIpForwardEntry2(&tlRoute);
 
-    if (bestInterface == 0) {
-        DWORD result = GetBestInterface(nextHop.Ipv4.sin_addr.s_addr, &bestInterface);
-        if (result != NO_ERROR) {
-            return false;
+    if (result == NO_ERROR || result == ERROR_OBJECT_ALREADY_EXISTS) {
+        PERF_COUNT("RouteController.SystemRouteSuccess");
+        return true;
+    }
+
+    // Fallback на старый API
+    if (result == ERROR_NOT_FOUND || result == ERROR_INVALID_FUNCTION) {
+        return AddSystemRouteOldAPIWithMask(ip, prefixLength, gateway);
+    }
+
+    return false;
+}
+
+NET_IFINDEX RouteController::ResolveGatewayInterface() {
+    // Используем кэшированный интерфейс
+    {
+        std::shared_lock<std::shared_mutex> lock(interfaceCacheMutex);
+        if (cachedInterfaceIndex != 0) {
+            return cachedInterfaceIndex;
         }
+    }
 
-        std::unique_lock<std::shared_mutex> lock(interfaceCacheMutex);
-        cachedInterfaceIndex = bestInterface;
+    NET_IFINDEX bestInterface = 0;
+    DWORD result = IpHelper::Api().GetBestInterface(gatewayAddress.load(std::memory_order_relaxed), &bestInterface);
+    if (result != NO_ERROR) {
+        return 0;
     }
 
+    std::unique_lock<std::shared_mutex> lock(interfaceCacheMutex);
+    cachedInterfaceIndex = bestInterface;
+    return bestInterface;
+}
+
+bool RouteController::AddSystemRouteOldAPI(const std::string& ip) {
+    return AddSystemRouteOldAPIWithMask(ip, 32);
+}
+
+bool RouteController::AddSystemRouteOldAPIWithMask(const std::string& ip, int prefixLength, uint32_t gateway) {
+    PERF_TIMER("RouteController::AddSystemRouteOldAPI");
+
     // Переиспользуем thread-local структуру
-    tlRoute.InterfaceIndex = bestInterface;
-    tlRoute.DestinationPrefix.Prefix = destAddr;
-    tlRoute.DestinationPrefix.PrefixLength = prefixLength;
-    tlRoute.NextHop = nextHop;
-    tlRoute.Protocol = MIB_IPPROTO_NETMGMT;
-    tlRoute.Metric = config.metric;
+    tlOldRoute.dwForwardDest = inet_addr(ip.c_str());
+    if (tlOldRoute.dwForwardDest == INADDR_NONE) {
+        return false;
+    }
+
+    DWORD mask = prefixLength == 0 ? 0 : (0xFFFFFFFF << (32 - prefixLength));
+    tlOldRoute.dwForwardMask = htonl(mask);
+    tlOldRoute.dwForwardPolicy = 0;
+    tlOldRoute.dwForwardNextHop = gateway != 0 ? gateway : gatewayAddress.load(std::memory_order_relaxed);
+
+    DWORD bestInterface = 0;
+    IpHelper::Api().GetBestInterface(tlOldRoute.dwForwardNextHop, &bestInterface);
+    tlOldRoute.dwForwardIfIndex = bestInterface;
+
+    tlOldRoute.dwForwardType = 4;
+    tlOldRoute.dwForwardProto = 3;
+    tlOldRoute.dwForwardAge = 0;
+    tlOldRoute.dwForwardNextHopAS = 0;
+    tlOldRoute.dwForwardMetric1 = config.metric;
+    tlOldRoute.dwForwardMetric2 = 0xFFFFFFFF;
+    tlOldRoute.dwForwardMetric3 = 0xFFFFFFFF;
+    tlOldRoute.dwForwardMetric4 = 0xFFFFFFFF;
+    tlOldRoute.dwForwardMetric5 = 0xFFFFFFFF;
+
+    DWORD result = IpHelper::Api().CreateIpForwardEntry(&tlOldRoute);
+    return (result == NO_ERROR || result == ERROR_OBJECT_ALREADY_EXISTS);
+}
+
+bool RouteController::RemoveSystemRoute(const std::string& ip, const std::string& gatewayIp) {
+    return RemoveSystemRouteWithMask(ip, 32, gatewayIp);
+}
+
+bool RouteController::RemoveSystemRouteWithMask(const std::string& ip, int prefixLength, const std::string& gatewayIp) {
+    MIB_IPFORWARDROW route;
+    ZeroMemory(&route, sizeof(MIB_IPFORWARDROW));
+
+    route.dwForwardDest = inet_addr(ip.c_str());
+    if (route.dwForwardDest == INADDR_NONE) {
+        Logger::Instance().Error(std::format("Invalid IP address: {}", ip));
+        return false;
+    }
+
+    DWORD mask = prefixLength == 0 ? 0 : (0xFFFFFFFF << (32 - prefixLength));
+    route.dwForwardMask = htonl(mask);
+
+    route.dwForwardNextHop = inet_addr(gatewayIp.c_str());
+
+    // Помечаем удаление как своё, чтобы OnRouteChange не поставил маршрут на переустановку.
+    // Без подписки уведомления не придут и метку некому будет снять
+    SelfRemoval selfKey{ MakeRouteKey(ntohl(route.dwForwardDest), prefixLength), route.dwForwardNextHop };
+    bool tagged = routeChangeHandle != nullptr;
+    if (tagged) {
+        std::lock_guard<std::mutex> lock(repairMutex);
+        selfRemovedKeys.insert(selfKey);
+    }
+
+    ULONG bestInterface;
+    if (IpHelper::Api().GetBestInterface(route.dwForwardNextHop, &bestInterface) == NO_ERROR) {
+        route.dwForwardIfIndex = bestInterface;
+    }
+
+    DWORD result = IpHelper::Api().DeleteIpForwardEntry(&route);
+
+    if (result != NO_ERROR && tagged) {
+        // Уведомления об удалении не будет
+        std::lock_guard<std::mutex> lock(repairMutex);
+        selfRemovedKeys.erase(selfKey);
+    }
+
+    if (result == NO_ERROR) {
+        LOG_DEBUG("Successfully removed route via API: {}/{}", ip, prefixLength);
+        return true;
+    }
+    else if (result == ERROR_NOT_FOUND) {
+        LOG_DEBUG("Route not found: {}/{}", ip, prefixLength);
+        return true;
+    }
+    else {
+        Logger::Instance().Error(std::format("Failed to remove route via API: {}/{}, error: {}",
+            ip, prefixLength, result));
+        return false;
+    }
+}
+
+bool RouteController::TouchRoute6(const Ipv6Address& address) {
+    Route6Key key{ address, 128 };
+    int64_t now = UnixSeconds();
+    std::lock_guard<std::mutex> lock(routes6Mutex);
+
+    auto it = routes6.find(key);
+    if (it == routes6.end()) {
+        int coveringLength = routeIndex6.FindCovering(address, 128);
+        if (coveringLength < 0) {
+            return false;
+        }
+        it = routes6.find({ address.Masked(coveringLength), static_cast<uint8_t>(coveringLength) });
+        if (it == routes6.end()) {
+            return false;
+        }
+    }
+    it->second.lastUsed = now;
+    return true;
+}
+
+bool RouteController::EnqueueRoute6(const Ipv6Address& address, std::string_view processName) {
+    if (!address.IsGlobalUnicast()) {
+        PERF_COUNT("RouteController.PrivateIPSkipped");
+        return false;
+    }
+
+    Route6Key key{ address, 128 };
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+        if (pendingRoutes6.contains(key)) {
+            PERF_COUNT("RouteController.ProgramQueue.Deduplicated");
+            return true;
+        }
+        if (programQueue6.size() >= Constants::ROUTE_PROGRAM_QUEUE_LIMIT) {
+            PERF_COUNT("RouteController.ProgramQueue.Dropped");
+            return false;
+        }
+        pendingRoutes6.emplace(key, std::string(processName));
+        programQueue6.push_back(key);
+    }
+
+    programCV.notify_one();
+    PERF_COUNT("RouteController.ProgramQueue.Enqueued");
+    return true;
+}
+
+bool RouteController::AddRoute6(const Ipv6Address& address, int prefixLength, std::string_view processName) {
+    PERF_TIMER("RouteController::AddRoute6");
+
+    if (prefixLength < 0 || prefixLength > 128) {
+        PERF_COUNT("RouteController.InvalidIP");
+        return false;
+    }
+
+    if (!address.IsGlobalUnicast()) {
+        PERF_COUNT("RouteController.PrivateIPSkipped");
+        return false;
+    }
+
+    Route6Key key{ address.Masked(prefixLength), static_cast<uint8_t>(prefixLength) };
+    int64_t now = UnixSeconds();
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+
+        auto it = routes6.find(key);
+        if (it != routes6.end()) {
+            it->second.refCount++;
+            it->second.lastUsed = now;
+            changeJournal.Append6(RouteChangeJournal::Op::RefCount, key, it->second.refCount);
+            PERF_COUNT("RouteController.RouteExists");
+            return true;
+        }
+
+        int coveringLength = routeIndex6.FindCovering(key.address, prefixLength);
+        if (coveringLength >= 0) {
+            auto covering = routes6.find({ key.address.Masked(coveringLength), static_cast<uint8_t>(coveringLength) });
+            if (covering != routes6.end()) {
+                covering->second.lastUsed = now;
+            }
+            PERF_COUNT("RouteController.IPAlreadyCovered");
+            return true;
+        }
+
+        if (routes6.size() >= Constants::MAX_ROUTES) {
+            PERF_COUNT("RouteController.Route6LimitReached");
+            return false;
+        }
+    }
+
+    if (!AddSystemRoute6(key.address, prefixLength)) {
+        PERF_COUNT("RouteController.SystemRouteAddFailed");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        auto it = routes6.find(key);
+        if (it != routes6.end()) {
+            it->second.refCount++;
+            it->second.lastUsed = now;
+            changeJournal.Append6(RouteChangeJournal::Op::RefCount, key, it->second.refCount);
+        }
+        else {
+            InsertRoute6Locked(key, processName, now);
+        }
+    }
+
+    Logger::Instance().Info(std::format("Added IPv6 route: {}/{} for {}", key.address.ToString(), prefixLength, processName));
+    NotifyUIRouteCountChanged();
+    return true;
+}
+
+bool RouteController::RemoveRoute6(const Ipv6Address& address, int prefixLength) {
+    if (prefixLength < 0 || prefixLength > 128) return false;
+
+    Route6Key key{ address.Masked(prefixLength), static_cast<uint8_t>(prefixLength) };
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        auto it = routes6.find(key);
+        if (it == routes6.end()) return false;
+
+        --it->second.refCount;
+        changeJournal.Append6(RouteChangeJournal::Op::RefCount, key, it->second.refCount);
+        if (it->second.refCount > 0) {
+            return true;
+        }
+    }
+
+    if (RemoveSystemRoute6(key.address, prefixLength)) {
+        bool revived = false;
+        {
+            std::lock_guard<std::mutex> lock(routes6Mutex);
+            auto it = routes6.find(key);
+            // Пока шёл системный вызов, маршрут могли снова начать использовать - тогда возвращаем его в ядро
+            if (it != routes6.end()) {
+                if (it->second.refCount <= 0) {
+                    EraseRoute6Locked(key);
+                    Logger::Instance().Info(std::format("Removed IPv6 route: {}/{}", key.address.ToString(), prefixLength));
+                }
+                else {
+                    revived = true;
+                }
+            }
+        }
+        if (revived) {
+            PERF_COUNT("RouteController.RemoveRoute6.Revived");
+            if (!AddSystemRoute6(key.address, prefixLength)) {
+                Logger::Instance().Error(std::format("Failed to reinstall revived IPv6 route {}/{}", key.address.ToString(), prefixLength));
+            }
+        }
+    }
+
+    NotifyUIRouteCountChanged();
+    return true;
+}
+
+void RouteController::InsertRoute6Locked(const Route6Key& key, std::string_view processName, int64_t now) {
+    Route6Entry& entry = routes6[key];
+    entry.processId = processNames6.Intern(processName);
+    entry.lastUsed = now;
+    routeIndex6.Insert(key.address, key.prefixLength);
+    routes6Count.store(routes6.size(), std::memory_order_relaxed);
+    changeJournal.Append6(RouteChangeJournal::Op::Add, key);
+
+    uint8_t bytes[16];
+    key.address.ToBytes(bytes);
+    stateStore.Append6(RouteStateStore::JournalOp::Add6, bytes, key.prefixLength, processName, entry.createdAt);
+    routesDirty = true;
+}
+
+void RouteController::EraseRoute6Locked(const Route6Key& key) {
+    if (routes6.erase(key) > 0) {
+        routeIndex6.Erase(key.address, key.prefixLength);
+        routes6Count.store(routes6.size(), std::memory_order_relaxed);
+        changeJournal.Append6(RouteChangeJournal::Op::Remove, key);
+
+        uint8_t bytes[16];
+        key.address.ToBytes(bytes);
+        stateStore.Append6(RouteStateStore::JournalOp::Remove6, bytes, key.prefixLength);
+        routesDirty = true;
+    }
+}
+
+bool RouteController::AddSystemRoute6(const Ipv6Address& address, int prefixLength) {
+    PERF_TIMER("RouteController::AddSystemRoute6");
+
+    NET_IFINDEX tunnelInterface = ResolveGatewayInterface();
+    if (tunnelInterface == 0) {
+        return false;
+    }
 
-    DWORD result = CreateIpForwardEntry2(&tlRoute);
+    MIB_IPFORWARD_ROW2 row;
+    InitializeIpForwardEntry(&row);
+    row.InterfaceIndex = tunnelInterface;
+    row.DestinationPrefix.Prefix.si_family = AF_INET6;
+    address.ToBytes(row.DestinationPrefix.Prefix.Ipv6.sin6_addr.u.Byte);
+    row.DestinationPrefix.PrefixLength = static_cast<UINT8>(prefixLength);
+    // Шлюз у нас IPv4, поэтому IPv6-маршрут ставится on-link на интерфейс туннеля (next hop ::)
+    row.NextHop.si_family = AF_INET6;
+    row.Protocol = MIB_IPPROTO_NETMGMT;
+    row.Metric = config.metric;
 
+    DWORD result = IpHelper::Api().CreateIpForwardEntry2(&row);
     if (result == NO_ERROR || result == ERROR_OBJECT_ALREADY_EXISTS) {
-        PERF_COUNT("RouteController.SystemRouteSuccess");
+        PERF_COUNT("RouteController.SystemRoute6Success");
         return true;
     }
 
-    // Fallback на старый API
-    if (result == ERROR_NOT_FOUND || result == ERROR_INVALID_FUNCTION) {
-        return AddSystemRouteOldAPIWithMask(ip, prefixLength);
+    Logger::Instance().Error(std::format("Failed to add IPv6 route {}/{} on interface {}: {}",
+        address.ToString(), prefixLength, tunnelInterface, result));
+    return false;
+}
+
+bool RouteController::RemoveSystemRoute6(const Ipv6Address& address, int prefixLength, NET_IFINDEX interfaceIndex) {
+    NET_IFINDEX tunnelInterface = interfaceIndex != 0 ? interfaceIndex : ResolveGatewayInterface();
+
+    MIB_IPFORWARD_ROW2 row;
+    InitializeIpForwardEntry(&row);
+    row.InterfaceIndex = tunnelInterface;
+    row.DestinationPrefix.Prefix.si_family = AF_INET6;
+    address.ToBytes(row.DestinationPrefix.Prefix.Ipv6.sin6_addr.u.Byte);
+    row.DestinationPrefix.PrefixLength = static_cast<UINT8>(prefixLength);
+    row.NextHop.si_family = AF_INET6;
+
+    DWORD result = IpHelper::Api().DeleteIpForwardEntry2(&row);
+    if (result == NO_ERROR || result == ERROR_NOT_FOUND) {
+        return true;
+    }
+
+    Logger::Instance().Error(std::format("Failed to remove IPv6 route {}/{}: {}", address.ToString(), prefixLength, result));
+    return false;
+}
+
+void RouteController::ExpireIpv6Routes() {
+    // Таблица IPv6 небольшая, полный проход раз в тик колеса IPv4 дешевле отдельного таймера
+    auto steadyNow = std::chrono::steady_clock::now();
+    if (steadyNow - lastIpv6Expiry < Constants::ROUTE_EXPIRY_TICK) return;
+    lastIpv6Expiry = steadyNow;
+
+    int64_t now = UnixSeconds();
+    std::vector<Route6Key> idle;
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        for (const auto& [key, entry] : routes6) {
+            if (entry.lastUsed + ROUTE_IDLE_TTL_SEC <= now) {
+                idle.push_back(key);
+            }
+        }
+    }
+
+    size_t removed = 0;
+    for (const Route6Key& key : idle) {
+        if (!RemoveSystemRoute6(key.address, key.prefixLength)) continue;
+
+        bool revived = false;
+        {
+            std::lock_guard<std::mutex> lock(routes6Mutex);
+            auto it = routes6.find(key);
+            if (it != routes6.end()) {
+                if (it->second.lastUsed + ROUTE_IDLE_TTL_SEC <= UnixSeconds()) {
+                    EraseRoute6Locked(key);
+                    removed++;
+                }
+                else {
+                    revived = true;
+                }
+            }
+        }
+        // Трафик пошёл, пока маршрут снимался без блокировки: запись осталась, возвращаем и системный
+        if (revived) {
+            PERF_COUNT("RouteController.Route6Revived");
+            AddSystemRoute6(key.address, key.prefixLength);
+        }
+    }
+
+    if (removed > 0) {
+        PERF_COUNT("RouteController.Route6Expired");
+        Logger::Instance().Info(std::format("Expired {} idle IPv6 routes", removed));
+        NotifyUIRouteCountChanged();
+    }
+}
+
+void RouteController::MigrateIpv6Routes(NET_IFINDEX oldInterface) {
+    std::vector<Route6Key> keys;
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        keys.reserve(routes6.size());
+        for (const auto& [key, entry] : routes6) {
+            keys.push_back(key);
+        }
+    }
+    if (keys.empty()) return;
+
+    int failCount = 0;
+    for (const Route6Key& key : keys) {
+        if (oldInterface != 0) {
+            RemoveSystemRoute6(key.address, key.prefixLength, oldInterface);
+        }
+        if (!AddSystemRoute6(key.address, key.prefixLength)) {
+            failCount++;
+        }
+    }
+
+    Logger::Instance().Info(std::format("IPv6 migration complete. Routes: {}, Failed: {}", keys.size(), failCount));
+}
+
+size_t RouteController::CleanupAllRoutes6() {
+    std::vector<Route6Key> keys;
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        keys.reserve(routes6.size());
+        for (const auto& [key, entry] : routes6) {
+            keys.push_back(key);
+        }
+        routes6.clear();
+        changeJournal.Append6(RouteChangeJournal::Op::Clear, {});
+        routeIndex6.Clear();
+        routes6Count.store(0, std::memory_order_relaxed);
+    }
+
+    for (const Route6Key& key : keys) {
+        RemoveSystemRoute6(key.address, key.prefixLength);
+    }
+    return keys.size();
+}
+
+void RouteController::RunIpv6Optimization() {
+    std::vector<Host6Route> hostRoutes;
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        hostRoutes.reserve(routes6.size());
+        for (const auto& [key, entry] : routes6) {
+            hostRoutes.push_back({ key.address, key.prefixLength, processNames6.Lookup(entry.processId) });
+        }
+    }
+
+    if (hostRoutes.size() < 2) return;
+
+    auto plan = optimizer->OptimizeRoutes6(hostRoutes);
+    if (plan.changes.empty()) return;
+
+    Logger::Instance().Info(std::format("IPv6 optimization: {} -> {} routes", plan.routesBefore, plan.routesAfter));
+
+    // Как и для IPv4: сначала агрегаты, при ошибке откатываемся, затем удаляем покрытые
+    std::vector<Route6Key> added;
+    std::vector<Route6Key> removed;
+    for (const auto& change : plan.changes) {
+        Ipv6Address address;
+        if (!Ipv6Address::Parse(change.ip, address)) continue;
+        Route6Key key{ address, static_cast<uint8_t>(change.prefixLength) };
+
+        if (change.type == OptimizationPlan::RouteChange::REMOVE) {
+            removed.push_back(key);
+            continue;
+        }
+
+        if (!AddSystemRoute6(key.address, key.prefixLength)) {
+            Logger::Instance().Warning("Rolling back IPv6 optimization due to add failure");
+            for (const Route6Key& rollback : added) {
+                RemoveSystemRoute6(rollback.address, rollback.prefixLength);
+            }
+            return;
+        }
+        added.push_back(key);
+    }
+
+    for (const Route6Key& key : removed) {
+        if (!RemoveSystemRoute6(key.address, key.prefixLength)) {
+            Logger::Instance().Warning(std::format("Failed to remove IPv6 route: {}/{}", key.address.ToString(), key.prefixLength));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(routes6Mutex);
+        int64_t now = UnixSeconds();
+        for (const Route6Key& key : added) {
+            if (!routes6.contains(key)) {
+                InsertRoute6Locked(key, "Optimized", now);
+            }
+        }
+        for (const Route6Key& key : removed) {
+            EraseRoute6Locked(key);
+        }
+    }
+
+    NotifyUIRouteCountChanged();
+}
+
+namespace {
+    // Финализатор splitmix64: порядок-независимая контрольная сумма набора ключей через XOR
+    inline uint64_t MixRouteKey(RouteKey key) {
+        key ^= key >> 30;
+        key *= 0xBF58476D1CE4E5B9ull;
+        key ^= key >> 27;
+        key *= 0x94D049BB133111EBull;
+        key ^= key >> 31;
+        return key;
+    }
+}
+
+void RouteController::RegisterChangeNotifications() {
+    DWORD result = IpHelper::Api().NotifyRouteChange2(AF_INET, &RouteController::OnRouteChange, this, FALSE, &routeChangeHandle);
+    if (result != NO_ERROR) {
+        routeChangeHandle = nullptr;
+        Logger::Instance().Warning(std::format("NotifyRouteChange2 failed: {}, falling back to polling verification", result));
+        return;
+    }
+
+    result = IpHelper::Api().NotifyIpInterfaceChange(AF_INET, &RouteController::OnInterfaceChange, this, FALSE, &interfaceChangeHandle);
+    if (result != NO_ERROR) {
+        interfaceChangeHandle = nullptr;
+        Logger::Instance().Warning(std::format("NotifyIpInterfaceChange failed: {}", result));
+    }
+
+    Logger::Instance().Info("Subscribed to route and interface change notifications");
+}
+
+void RouteController::UnregisterChangeNotifications() {
+    if (routeChangeHandle) {
+        IpHelper::Api().CancelMibChangeNotify2(routeChangeHandle);
+        routeChangeHandle = nullptr;
+    }
+    if (interfaceChangeHandle) {
+        IpHelper::Api().CancelMibChangeNotify2(interfaceChangeHandle);
+        interfaceChangeHandle = nullptr;
+    }
+}
+
+VOID NETIOAPI_API_ RouteController::OnRouteChange(PVOID context, PMIB_IPFORWARD_ROW2 row, MIB_NOTIFICATION_TYPE type) {
+    // Выполняется в пуле потоков системы: только фильтрация и постановка в очередь, без routesMutex
+    auto* self = static_cast<RouteController*>(context);
+    if (!self || !row) return;
+    if (type != MibAddInstance && type != MibDeleteInstance) return;
+    if (row->DestinationPrefix.Prefix.si_family != AF_INET) return;
+
+    RouteKey key = MakeRouteKey(ntohl(row->DestinationPrefix.Prefix.Ipv4.sin_addr.s_addr),
+        row->DestinationPrefix.PrefixLength);
+    uint32_t nextHop = row->NextHop.Ipv4.sin_addr.s_addr;
+
+    // Своё удаление гасим до фильтра шлюза: удаления через прежний шлюз пула тоже оставляют метку
+    bool selfRemoved = false;
+    if (type == MibDeleteInstance) {
+        std::lock_guard<std::mutex> lock(self->repairMutex);
+        selfRemoved = self->selfRemovedKeys.erase(SelfRemoval{ key, nextHop }) > 0;
+    }
+
+    if (nextHop != self->gatewayAddress.load(std::memory_order_relaxed)) return;
+
+    self->ApplySystemRouteChange(key, type == MibAddInstance);
+    if (type != MibDeleteInstance || selfRemoved) return;
+
+    {
+        std::lock_guard<std::mutex> lock(self->repairMutex);
+        self->repairKeys.insert(key);
+    }
+
+    PERF_COUNT("RouteController.RouteDeletedExternally");
+    self->repairCV.notify_one();
+}
+
+VOID NETIOAPI_API_ RouteController::OnInterfaceChange(PVOID context, PMIB_IPINTERFACE_ROW row, MIB_NOTIFICATION_TYPE type) {
+    auto* self = static_cast<RouteController*>(context);
+    if (!self || !row || type == MibInitialNotification) return;
+
+    NET_IFINDEX watchedInterface = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(self->interfaceCacheMutex);
+        watchedInterface = self->cachedInterfaceIndex;
+    }
+    if (watchedInterface != 0 && row->InterfaceIndex != watchedInterface) return;
+
+    {
+        std::lock_guard<std::mutex> lock(self->repairMutex);
+        self->interfaceFlapped = true;
+    }
+
+    PERF_COUNT("RouteController.InterfaceChanged");
+    self->repairCV.notify_one();
+}
+
+void RouteController::VerifyRoutesThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info("RouteController verify thread started");
+
+    // С уведомлениями чиним только то, что реально удалено; аудит остаётся страховкой.
+    // Без уведомлений аудит выполняется с прежней частотой опроса.
+    const auto auditInterval = routeChangeHandle
+        ? std::chrono::seconds(Constants::ROUTE_AUDIT_INTERVAL_SEC)
+        : std::chrono::seconds(Constants::ROUTE_VERIFY_INTERVAL_SEC);
+    auto nextAudit = std::chrono::steady_clock::now() + auditInterval;
+
+    try {
+        while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+            std::vector<RouteKey> keys;
+            bool flapped = false;
+            {
+                std::unique_lock<std::mutex> lock(repairMutex);
+                repairCV.wait_until(lock, stopToken, nextAudit, [this] {
+                    return !repairKeys.empty() || interfaceFlapped;
+                    });
+
+                if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
+                    break;
+                }
+
+                if (migrationActive.load(std::memory_order_acquire)) {
+                    // Идёт сборка маршрутов через новый шлюз: чинить через старый нельзя,
+                    // накопленное разберём после cut-over (finishBuild будит этот поток)
+                    repairCV.wait(lock, stopToken, [this] {
+                        return !migrationActive.load(std::memory_order_acquire) ||
+                            ShutdownCoordinator::Instance().isShuttingDown;
+                        });
+                    continue;
+                }
+
+                if (!repairKeys.empty() || interfaceFlapped) {
+                    // Даём соседним уведомлениям собраться в один проход
+                    repairCV.wait_for(lock, stopToken, Constants::ROUTE_REPAIR_DEBOUNCE, [] { return false; });
+
+                    keys.assign(repairKeys.begin(), repairKeys.end());
+                    repairKeys.clear();
+                    flapped = std::exchange(interfaceFlapped, false);
+                }
+            }
+
+            if (flapped) {
+                InvalidateInterfaceCache();
+                if (!IsGatewayReachable()) {
+                    // Интерфейс ещё не поднялся - следующее уведомление запустит переустановку
+                    continue;
+                }
+
+                Logger::Instance().Info("Gateway interface changed, reinstalling routes");
+                PublishRouteView();
+                auto view = GetRouteView();
+                keys.assign(view->Keys().begin(), view->Keys().end());
+            }
+
+            if (!keys.empty()) {
+                ReinstallRoutes(keys);
+                continue;
+            }
+
+            if (std::chrono::steady_clock::now() >= nextAudit) {
+                if (IsGatewayReachable()) {
+                    AuditSystemRoutes();
+                }
+                else {
+                    InvalidateInterfaceCache();
+                }
+                nextAudit = std::chrono::steady_clock::now() + auditInterval;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("VerifyRoutesThreadFunc exception: {}", e.what()));
+    }
+
+    Logger::Instance().Info("RouteController verify thread exiting");
+}
+
+void RouteController::ReinstallRoutes(std::span<const RouteKey> keys) {
+    PERF_TIMER("RouteController::ReinstallRoutes");
+
+    // Берём только ключи, которые всё ещё числятся за нами
+    std::vector<std::tuple<RouteKey, std::string, int>> toInstall;
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "Reinstall");
+        for (RouteKey key : keys) {
+            auto it = routes.find(key);
+            if (it != routes.end()) {
+                toInstall.emplace_back(key, Utils::FastUIntToIP(it->second->address), it->second->prefixLength);
+            }
+        }
+    }
+
+    int repaired = 0;
+    for (size_t i = 0; i < toInstall.size(); i++) {
+        if (ShutdownCoordinator::Instance().isShuttingDown) {
+            Logger::Instance().Info("Route repair interrupted by shutdown");
+            return;
+        }
+        if (migrationActive.load(std::memory_order_acquire)) {
+            // Миграция началась посреди прохода: остаток дочиним после cut-over через новый шлюз
+            std::lock_guard<std::mutex> lock(repairMutex);
+            for (size_t rest = i; rest < toInstall.size(); rest++) {
+                repairKeys.insert(std::get<0>(toInstall[rest]));
+            }
+            Logger::Instance().Info(std::format("Route repair deferred for {} routes until gateway migration completes",
+                toInstall.size() - i));
+            return;
+        }
+        const auto& [key, ip, prefixLength] = toInstall[i];
+        if (AddSystemRouteWithMask(ip, prefixLength)) {
+            repaired++;
+            PERF_COUNT("RouteController.RouteRepaired");
+        }
+    }
+
+    if (!toInstall.empty()) {
+        Logger::Instance().Info(std::format("Reinstalled {} of {} routes", repaired, toInstall.size()));
     }
-
-    return false;
 }
 
-bool RouteController::AddSystemRouteOldAPI(const std::string& ip) {
-    return AddSystemRouteOldAPIWithMask(ip, 32);
-}
+void RouteController::AuditSystemRoutes() {
+    PERF_TIMER("RouteController::AuditSystemRoutes");
 
-bool RouteController::AddSystemRouteOldAPIWithMask(const std::string& ip, int prefixLength) {
-    PERF_TIMER("RouteController::AddSystemRouteOldAPI");
+    // Аудит - страховка и для самого снимка, поэтому всегда перечитываем таблицу
+    auto systemKeys = GetSystemRouteKeys(true);
 
-    // Переиспользуем thread-local структуру
-    tlOldRoute.dwForwardDest = inet_addr(ip.c_str());
-    if (tlOldRoute.dwForwardDest == INADDR_NONE) {
-        return false;
+    uint64_t systemChecksum = 0;
+    for (RouteKey key : systemKeys) {
+        systemChecksum ^= MixRouteKey(key);
     }
 
-    DWORD mask = prefixLength == 0 ? 0 : (0xFFFFFFFF << (32 - prefixLength));
-    tlOldRoute.dwForwardMask = htonl(mask);
-    tlOldRoute.dwForwardPolicy = 0;
-    tlOldRoute.dwForwardNextHop = inet_addr(config.gatewayIp.c_str());
+    // Аудит читает view: ложные расхождения отсеет ReinstallRoutes под блокировкой
+    auto view = GetRouteView();
+    uint64_t stateChecksum = 0;
+    for (RouteKey key : view->Keys()) {
+        stateChecksum ^= MixRouteKey(key);
+    }
 
-    DWORD bestInterface = 0;
-    GetBestInterface(tlOldRoute.dwForwardNextHop, &bestInterface);
-    tlOldRoute.dwForwardIfIndex = bestInterface;
+    if (stateChecksum == systemChecksum) {
+        PERF_COUNT("RouteController.AuditClean");
+        return;
+    }
 
-    tlOldRoute.dwForwardType = 4;
-    tlOldRoute.dwForwardProto = 3;
-    tlOldRoute.dwForwardAge = 0;
-    tlOldRoute.dwForwardNextHopAS = 0;
-    tlOldRoute.dwForwardMetric1 = config.metric;
-    tlOldRoute.dwForwardMetric2 = 0xFFFFFFFF;
-    tlOldRoute.dwForwardMetric3 = 0xFFFFFFFF;
-    tlOldRoute.dwForwardMetric4 = 0xFFFFFFFF;
-    tlOldRoute.dwForwardMetric5 = 0xFFFFFFFF;
+    // Контрольные суммы расходятся - ищем конкретные пропавшие маршруты
+    std::vector<RouteKey> missing;
+    for (RouteKey key : view->Keys()) {
+        if (!std::ranges::binary_search(systemKeys, key)) {
+            missing.push_back(key);
+        }
+    }
 
-    DWORD result = CreateIpForwardEntry(&tlOldRoute);
-    return (result == NO_ERROR || result == ERROR_OBJECT_ALREADY_EXISTS);
-}
+    PERF_COUNT("RouteController.AuditMismatch");
+    Logger::Instance().Warning(std::format("Route audit mismatch: {} routes missing from system table", missing.size()));
 
-bool RouteController::RemoveSystemRoute(const std::string& ip, const std::string& gatewayIp) {
-    return RemoveSystemRouteWithMask(ip, 32, gatewayIp);
+    if (!missing.empty()) {
+        ReinstallRoutes(missing);
+    }
 }
 
-bool RouteController::RemoveSystemRouteWithMask(const std::string& ip, int prefixLength, const std::string& gatewayIp) {
-    MIB_IPFORWARDROW route;
-    ZeroMemory(&route, sizeof(MIB_IPFORWARDROW));
+void RouteController::SaveRoutesToDisk() {
+    PERF_TIMER("RouteController::SaveRoutesToDisk");
 
-    route.dwForwardDest = inet_addr(ip.c_str());
-    if (route.dwForwardDest == INADDR_NONE) {
-        Logger::Instance().Error(std::format("Invalid IP address: {}", ip));
-        return false;
+    // Пока не все сохранённые маршруты восстановлены, снимок потерял бы их; пишем только журнал
+    if (!restoreComplete.load()) {
+        stateStore.FlushJournal();
+        return;
     }
 
-    DWORD mask = prefixLength == 0 ? 0 : (0xFFFFFFFF << (32 - prefixLength));
-    route.dwForwardMask = htonl(mask);
+    std::lock_guard<std::mutex> saveLock(saveMutex);
 
-    route.dwForwardNextHop = inet_addr(gatewayIp.c_str());
+    // Под shared-блокировкой только копируем компактные записи; запись файла идёт без блокировки
+    std::vector<StateRouteRecord> records;
+    std::vector<StateRoute6Record> records6;
+    std::vector<std::string> names;
+    {
+        auto lock = LockRoutes<SharedRoutesLock>(routesMutex, "SaveSnapshot");
+        std::lock_guard<std::mutex> lock6(routes6Mutex);
+
+        records.reserve(routes.size());
+        for (const auto& [key, entry] : routes) {
+            StateRouteRecord record{};
+            record.address = entry->address;
+            record.prefixLength = entry->prefixLength;
+            record.processId = entry->processId;
+            record.refCount = entry->refCount.load(std::memory_order_relaxed);
+            record.createdAt = std::chrono::duration_cast<std::chrono::seconds>(
+                entry->createdAt.time_since_epoch()).count();
+            record.lastUsed = entry->lastUsed.load(std::memory_order_relaxed);
+            records.push_back(record);
+        }
 
-    ULONG bestInterface;
-    if (GetBestInterface(route.dwForwardNextHop, &bestInterface) == NO_ERROR) {
-        route.dwForwardIfIndex = bestInterface;
+        names.reserve(processNames.Size());
+        for (size_t id = 0; id < processNames.Size(); id++) {
+            names.push_back(processNames.Lookup(static_cast<StringInterner::Id>(id)));
+        }
+
+        // У IPv6 свой интернер: его имена дописываются в общую таблицу снимка
+        std::unordered_map<StringInterner::Id, uint16_t> names6;
+        records6.reserve(routes6.size());
+        for (const auto& [key, entry] : routes6) {
+            auto [name, added] = names6.try_emplace(entry.processId, static_cast<uint16_t>(names.size()));
+            if (added) {
+                names.emplace_back(processNames6.Lookup(entry.processId));
+            }
+
+            StateRoute6Record record{};
+            key.address.ToBytes(record.address);
+            record.prefixLength = key.prefixLength;
+            record.processId = name->second;
+            record.refCount = entry.refCount;
+            record.createdAt = std::chrono::duration_cast<std::chrono::seconds>(
+                entry.createdAt.time_since_epoch()).count();
+            record.lastUsed = entry.lastUsed;
+            records6.push_back(record);
+        }
+
+        // Append вызывается только под unique-блокировкой (IPv6 - под routes6Mutex), поэтому снимок и журнал согласованы
+        stateStore.BeginSnapshot();
+        routesDirty = false;
+    }
+
+    // Сохраняем шлюз, через который маршруты стоят сейчас: при старте они переедут на основной
+    if (!stateStore.WriteSnapshot(records, records6, names, ntohl(gatewayAddress.load(std::memory_order_relaxed)))) {
+        routesDirty = true;
+        return;
     }
 
-    DWORD result = DeleteIpForwardEntry(&route);
+    lastSaveTime = std::chrono::steady_clock::now();
+    Logger::Instance().Info(std::format("Routes saved to disk: {} routes, {} IPv6", records.size(), records6.size()));
+}
 
-    if (result == NO_ERROR) {
-        Logger::Instance().Debug(std::format("Successfully removed route via API: {}/{}", ip, prefixLength));
-        return true;
+void RouteController::LoadRoutesFromDisk() {
+    std::vector<PersistedRoute> persisted;
+    std::string savedGateway;
+    bool needsCompaction = false;
+
+    if (stateStore.HasState()) {
+        uint32_t savedGatewayAddress = 0;
+        if (!stateStore.Load(persisted, restoreQueue6, savedGatewayAddress)) {
+            return;
+        }
+        if (savedGatewayAddress != 0) {
+            savedGateway = Utils::FastUIntToIP(savedGatewayAddress);
+        }
     }
-    else if (result == ERROR_NOT_FOUND) {
-        Logger::Instance().Debug(std::format("Route not found: {}/{}", ip, prefixLength));
-        return true;
+    else if (LoadLegacyStateFile(persisted, savedGateway)) {
+        Logger::Instance().Info("LoadRoutesFromDisk - Migrating legacy text state to binary snapshot");
+        needsCompaction = true;
     }
     else {
-        Logger::Instance().Error(std::format("Failed to remove route via API: {}/{}, error: {}",
-            ip, prefixLength, result));
-        return false;
+        return;
+    }
+
+    int skippedPreloadCount = 0;
+
+    // Здесь только читаем состояние; маршруты ставит RestoreRoutesThreadFunc
+    restoreQueue.reserve(persisted.size());
+    for (auto& route : persisted) {
+        if (route.processName.starts_with("Preload-")) {
+            skippedPreloadCount++;
+            continue;
+        }
+        restoreQueue.push_back(std::move(route));
+    }
+
+    if (!savedGateway.empty() && savedGateway != config.gatewayIp) {
+        Logger::Instance().Warning(std::format("Gateway mismatch on startup. Saved: {}, Config: {}. Migrating routes.",
+            savedGateway, config.gatewayIp));
+        restoreSavedGateway = savedGateway;
     }
+
+    restoreTotal.store(restoreQueue.size());
+
+    Logger::Instance().Info(std::format("LoadRoutesFromDisk - Read {} routes, skipped {} preload routes",
+        restoreQueue.size(), skippedPreloadCount));
+
+    // Снимок должен отражать то, что реально установлено; пишется после восстановления
+    routesDirty = needsCompaction || skippedPreloadCount > 0 || !restoreSavedGateway.empty();
 }
 
-void RouteController::VerifyRoutesThreadFunc(std::stop_token stopToken) {
-    Logger::Instance().Info("RouteController verify thread started");
+void RouteController::RestoreRoutesThreadFunc(std::stop_token stopToken) {
+    Logger::Instance().Info(std::format("RouteController restore thread started, {} routes to restore",
+        restoreQueue.size()));
 
     try {
-        while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
-            // Используем condition variable вместо sleep loop
-            std::unique_lock<std::mutex> lock(optimizationMutex);
-            if (optimizationCV.wait_for(lock, std::chrono::seconds(Constants::ROUTE_VERIFY_INTERVAL_SEC),
-                [&stopToken] { return stopToken.stop_requested(); })) {
-                break;
-            }
-            lock.unlock();
+        auto startTime = std::chrono::steady_clock::now();
 
-            if (!IsGatewayReachable()) {
-                InvalidateInterfaceCache();
-                continue;
-            }
+        // Сначала маршруты с большим числом обращений, при равенстве — более свежие
+        std::ranges::sort(restoreQueue, [](const PersistedRoute& a, const PersistedRoute& b) {
+            if (a.refCount != b.refCount) return a.refCount > b.refCount;
+            return a.createdAt > b.createdAt;
+            });
 
-            // Собираем маршруты для верификации батчами
-            constexpr size_t BATCH_SIZE = 100;
-            std::vector<std::pair<std::string, int>> routeBatch;
-            routeBatch.reserve(BATCH_SIZE);
+        size_t workerCount = std::min<size_t>(Constants::ROUTE_RESTORE_THREADS,
+            (restoreQueue.size() + Constants::ROUTE_PROGRAM_BATCH_SIZE - 1) / Constants::ROUTE_PROGRAM_BATCH_SIZE);
 
-            {
-                std::shared_lock<std::shared_mutex> lock(routesMutex);
+        std::atomic<size_t> nextIndex{ 0 };
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(workerCount);
+            for (size_t i = 0; i < workerCount; i++) {
+                workers.emplace_back([this, stopToken, &nextIndex] { RestoreRouteWorker(stopToken, nextIndex); });
+            }
+        }
+
+        if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
+            Logger::Instance().Warning(std::format("Route restore interrupted: {}/{} routes processed",
+                restoreDone.load(), restoreTotal.load()));
+            return;
+        }
 
-                for (const auto& [key, routeInfo] : routes) {
-                    routeBatch.emplace_back(routeInfo->ip, routeInfo->prefixLength);
+        if (restoreFailed.load() > 0) {
+            routesDirty = true;
+        }
 
-                    if (routeBatch.size() >= BATCH_SIZE) {
-                        lock.unlock();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime);
+        Logger::Instance().Info(std::format("Route restore completed: {} restored, {} failed in {}ms",
+            restoreDone.load() - restoreFailed.load(), restoreFailed.load(), elapsed.count()));
 
-                        // Верифицируем батч
-                        for (const auto& [ip, prefixLength] : routeBatch) {
-                            if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
-                                Logger::Instance().Info("Route verification interrupted by shutdown");
-                                return;
-                            }
-                            AddSystemRouteWithMask(ip, prefixLength);
-                        }
+        restoreQueue.clear();
+        restoreQueue.shrink_to_fit();
+        RestoreIpv6Routes();
 
-                        routeBatch.clear();
-                        lock.lock();
-                    }
-                }
-            }
+        restoreComplete = true;
+        NotifyUIRouteCountChanged();
 
-            // Верифицируем оставшиеся маршруты
-            for (const auto& [ip, prefixLength] : routeBatch) {
-                if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
-                    Logger::Instance().Info("Route verification interrupted by shutdown");
-                    break;
-                }
-                AddSystemRouteWithMask(ip, prefixLength);
-            }
+        if (config.aiPreloadEnabled) {
+            PreloadAIRoutes();
         }
+
+        // Бывшие шаги 4-5 ServiceMain::StartDirect: синхронизация с системной таблицей и очистка
+        PerformFullCleanup();
     }
     catch (const std::exception& e) {
-        Logger::Instance().Error(std::format("VerifyRoutesThreadFunc exception: {}", e.what()));
+        Logger::Instance().Error(std::format("RestoreRoutesThreadFunc exception: {}", e.what()));
+        restoreComplete = true;
     }
 
-    Logger::Instance().Info("RouteController verify thread exiting");
+    Logger::Instance().Info("RouteController restore thread exiting");
 }
 
-void RouteController::SaveRoutesToDisk() {
-    std::unique_lock<std::shared_mutex> lock(routesMutex);
+void RouteController::RestoreIpv6Routes() {
+    if (restoreQueue6.empty()) return;
+
+    // Preload-маршруты, как и IPv4, не восстанавливаем; системные за собой не оставляем -
+    // очистка по шлюзу IPv6-маршруты на интерфейсе туннеля не видит
+    size_t restored = 0;
+    size_t removed = 0;
+    for (const PersistedRoute6& route : restoreQueue6) {
+        Ipv6Address address = Ipv6Address::FromBytes(route.address.data());
+        if (route.processName.starts_with("Preload-")) {
+            RemoveSystemRoute6(address, route.prefixLength);
+            removed++;
+        }
+        else if (AddRoute6(address, route.prefixLength, route.processName)) {
+            restored++;
+        }
+    }
+
+    if (removed > 0) {
+        routesDirty = true;
+    }
+    Logger::Instance().Info(std::format("IPv6 restore completed: {} restored, {} preload routes removed", restored, removed));
+    restoreQueue6.clear();
+    restoreQueue6.shrink_to_fit();
+}
 
-    std::ofstream file(Constants::STATE_FILE + ".tmp");
-    if (!file.is_open()) return;
+void RouteController::RestoreRouteWorker(std::stop_token stopToken, std::atomic<size_t>& nextIndex) {
+    bool migrateGateway = !restoreSavedGateway.empty();
 
-    file << "version=3\n";
+    std::vector<const PersistedRoute*> installed;
+    installed.reserve(Constants::ROUTE_PROGRAM_BATCH_SIZE);
+
+    while (!stopToken.stop_requested() && !ShutdownCoordinator::Instance().isShuttingDown) {
+        size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        if (index >= restoreQueue.size()) {
+            break;
+        }
 
-    auto now = std::chrono::system_clock::now();
-    auto nowSeconds = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-    file << std::format("timestamp={}\n", nowSeconds);
-    file << std::format("gateway={}\n", config.gatewayIp);
+        const PersistedRoute& route = restoreQueue[index];
+        std::string ip = Utils::FastUIntToIP(route.address);
 
-    for (const auto& [key, routeInfo] : routes) {
-        auto createdSeconds = std::chrono::duration_cast<std::chrono::seconds>(
-            routeInfo->createdAt.time_since_epoch()).count();
+        if (migrateGateway) {
+            RemoveSystemRouteWithMask(ip, route.prefixLength, restoreSavedGateway);
+        }
 
-        file << std::format("route={},{},{},{},{}\n",
-            routeInfo->ip, routeInfo->processName, createdSeconds,
-            routeInfo->prefixLength, config.gatewayIp);
+        // Системный вызов без блокировки routesMutex
+        if (AddSystemRouteWithMask(ip, route.prefixLength)) {
+            installed.push_back(&route);
+            if (installed.size() >= Constants::ROUTE_PROGRAM_BATCH_SIZE) {
+                CommitRestoredRoutes(installed);
+                installed.clear();
+            }
+        }
+        else {
+            restoreFailed.fetch_add(1, std::memory_order_relaxed);
+            restoreDone.fetch_add(1, std::memory_order_relaxed);
+        }
     }
 
-    file.close();
+    CommitRestoredRoutes(installed);
+}
+
+void RouteController::CommitRestoredRoutes(std::span<const PersistedRoute* const> installed) {
+    if (installed.empty()) return;
 
-    if (std::filesystem::exists(Constants::STATE_FILE + ".tmp")) {
-        std::filesystem::rename(Constants::STATE_FILE + ".tmp", Constants::STATE_FILE);
+    {
+        auto lock = LockRoutes<UniqueRoutesLock>(routesMutex, "Restore");
+        restoringState = true;  // Эти маршруты уже есть в снимке/журнале
+
+        for (const PersistedRoute* route : installed) {
+            // Поток мониторинга мог успеть добавить маршрут раньше — его запись уже в журнале
+            if (routes.contains(MakeRouteKey(route->address, route->prefixLength))) {
+                continue;
+            }
+
+            RouteEntry& entry = InsertRouteLocked(route->address, route->prefixLength, route->processName);
+            entry.createdAt = route->createdAt;
+            entry.refCount.store(route->refCount, std::memory_order_relaxed);
+            // Легаси-состояние не знает lastUsed: отсчитываем TTL от старта
+            int64_t lastUsed = route->lastUsed.time_since_epoch().count() > 0 ?
+                UnixSeconds(route->lastUsed) : UnixSeconds();
+            entry.lastUsed.store(lastUsed, std::memory_order_relaxed);
+            ScheduleRouteExpiry(MakeRouteKey(route->address, route->prefixLength), lastUsed);
+        }
+
+        restoringState = false;
     }
 
-    routesDirty = false;
-    lastSaveTime = std::chrono::steady_clock::now();
+    restoreDone.fetch_add(installed.size(), std::memory_order_relaxed);
 }
 
-void RouteController::LoadRoutesFromDisk() {
-    if (!Utils::FileExists(Constants::STATE_FILE)) return;
+RouteController::RestoreProgress RouteController::GetRestoreProgress() const {
+    RestoreProgress progress;
+    progress.total = restoreTotal.load(std::memory_order_relaxed);
+    progress.done = restoreDone.load(std::memory_order_relaxed);
+    progress.failed = restoreFailed.load(std::memory_order_relaxed);
+    progress.complete = restoreComplete.load();
+    return progress;
+}
+
+bool RouteController::LoadLegacyStateFile(std::vector<PersistedRoute>& persisted, std::string& savedGateway) {
+    if (!Utils::FileExists(Constants::STATE_FILE)) return false;
 
     std::ifstream file(Constants::STATE_FILE);
-    if (!file.is_open()) return;
+    if (!file.is_open()) return false;
 
     std::string line;
-    int loadedCount = 0;
-    int skippedPreloadCount = 0;
-    std::string savedGateway;
 
     while (std::getline(file, line)) {
         if (line.starts_with("gateway=")) {
@@ -1167,22 +3476,17 @@ void RouteController::LoadRoutesFromDisk() {
             std::string routeData = line.substr(6);
             auto parts = Utils::SplitString(routeData, ',');
             if (parts.size() >= 2) {
+                PersistedRoute route;
                 std::string ip = parts[0];
-                std::string process = parts[1];
-                int prefixLength = 32;
-
-                if (process.starts_with("Preload-")) {
-                    skippedPreloadCount++;
-                    continue;
-                }
-
-                std::chrono::system_clock::time_point createdAt = std::chrono::system_clock::now();
+                route.address = Utils::FastIPToUInt(ip);
+                route.processName = parts[1];
+                route.createdAt = std::chrono::system_clock::now();
 
                 if (parts.size() >= 3 && !parts[2].empty()) {
                     try {
                         int64_t timestamp = std::stoll(parts[2]);
                         if (timestamp > 0 && timestamp < 9999999999LL) {
-                            createdAt = std::chrono::system_clock::time_point(
+                            route.createdAt = std::chrono::system_clock::time_point(
                                 std::chrono::seconds(timestamp));
                         }
                     }
@@ -1193,137 +3497,318 @@ void RouteController::LoadRoutesFromDisk() {
 
                 if (parts.size() >= 4) {
                     try {
-                        prefixLength = std::stoi(parts[3]);
+                        route.prefixLength = std::stoi(parts[3]);
                     }
                     catch (...) {
                         Logger::Instance().Warning(std::format("Failed to parse prefix length for route: {}", ip));
                     }
                 }
 
-                std::string routeGateway = config.gatewayIp;
-                if (parts.size() >= 5) {
-                    routeGateway = parts[4];
-                }
-
-                if (AddSystemRouteWithMask(ip, prefixLength)) {
-                    std::string routeKey = std::format("{}/{}", ip, prefixLength);
-                    auto routeInfo = std::make_unique<RouteInfo>(ip, process);
-                    routeInfo->prefixLength = prefixLength;
-                    routeInfo->createdAt = createdAt;
-                    routes[routeKey] = std::move(routeInfo);
-                    loadedCount++;
-                }
+                persisted.push_back(std::move(route));
             }
         }
     }
 
-    if (!savedGateway.empty() && savedGateway != config.gatewayIp) {
-        Logger::Instance().Warning(std::format("Gateway mismatch on startup. Saved: {}, Config: {}. Migrating routes.",
-            savedGateway, config.gatewayIp));
-        MigrateExistingRoutes(savedGateway, config.gatewayIp);
-    }
-
-    Logger::Instance().Info(std::format("LoadRoutesFromDisk - Loaded {} routes, skipped {} preload routes",
-        loadedCount, skippedPreloadCount));
-
-    routesDirty = false;
+    return true;
 }
 
 bool RouteController::IsGatewayReachable() {
-    ULONG destAddr = inet_addr(config.gatewayIp.c_str());
+    ULONG destAddr = gatewayAddress.load(std::memory_order_relaxed);
     ULONG srcAddr = INADDR_ANY;
     ULONG bestIfIndex;
 
-    if (GetBestInterface(destAddr, &bestIfIndex) != NO_ERROR) {
+    if (IpHelper::Api().GetBestInterface(destAddr, &bestIfIndex) != NO_ERROR) {
         return false;
     }
 
     return true;
 }
 
-void RouteController::PreloadAIRoutes() {
-    if (aiRoutesPreloaded.exchange(true)) {
-        Logger::Instance().Info("PreloadRoutes - AI routes already preloaded, skipping");
-        return;
-    }
+// Preload-маршруты отличаются от остальных только именем процесса
+static constexpr std::string_view PRELOAD_NAME_PREFIX = "Preload-";
 
-    Logger::Instance().Info("PreloadRoutes - Starting preload of IP ranges from config");
+static bool IsPreloadRouteOf(std::string_view processName, std::string_view service) {
+    if (!processName.starts_with(PRELOAD_NAME_PREFIX)) return false;
+    return service.empty() || processName.substr(PRELOAD_NAME_PREFIX.size()) == service;
+}
 
-    auto services = LoadPreloadConfig();
+void RouteController::PreloadAIRoutes() {
+    std::lock_guard<std::mutex> lock(preloadMutex);
+
+    auto previous = preloadSet;
+    auto set = LoadPreloadSetLocked();
+    bool wasActive = std::exchange(preloadActive, true);
+
+    // Файл перекомпилирован - снимаем диапазоны, которых в нём больше нет
+    if (wasActive && previous && previous != set) {
+        std::unordered_set<RouteKey> keep;
+        std::unordered_set<Route6Key, Route6KeyHash> keep6;
+        for (const auto& service : set->Services()) {
+            if (!IsPreloadServiceEnabledLocked(service)) continue;
+            keep.insert(service.ranges.begin(), service.ranges.end());
+            keep6.insert(service.ranges6.begin(), service.ranges6.end());
+        }
+        size_t removed = RemovePreloadRoutesLocked({}, keep, keep6);
+        Logger::Instance().Info(std::format("PreloadRoutes - Config changed, removing {} stale ranges", removed));
+    }
 
-    int totalRoutes = 0;
-    for (const auto& service : services) {
-        if (!service.enabled) {
+    size_t queued = 0;
+    for (const auto& service : set->Services()) {
+        if (!IsPreloadServiceEnabledLocked(service)) {
             Logger::Instance().Info(std::format("Skipping disabled service: {}", service.name));
             continue;
         }
+        queued += InstallPreloadServiceLocked(service);
+    }
 
-        Logger::Instance().Info(std::format("Processing {} ranges", service.name));
-        for (const auto& range : service.ranges) {
-            if (range.contains('/')) {
-                if (AddCIDRRoute(range, service.name)) {
-                    totalRoutes++;
-                }
-            }
-            else {
-                if (AddRoute(range, std::format("Preload-{}", service.name))) {
-                    totalRoutes++;
-                }
-            }
+    Logger::Instance().Info(std::format("PreloadRoutes - {} services, {} ranges, {} queued for background install",
+        set->Services().size(), set->RangeCount(), queued));
+}
+
+void RouteController::RemovePreloadRoutes() {
+    std::lock_guard<std::mutex> lock(preloadMutex);
+    preloadActive = false;
+    size_t removed = RemovePreloadRoutesLocked({}, {}, {});
+    Logger::Instance().Info(std::format("PreloadRoutes - Disabled, removing {} ranges", removed));
+}
+
+bool RouteController::SetPreloadServiceEnabled(const std::string& service, bool enabled) {
+    std::lock_guard<std::mutex> lock(preloadMutex);
+
+    // Набор уже скомпилирован при включении; переключатель файл не перечитывает
+    auto set = preloadSet ? preloadSet : LoadPreloadSetLocked();
+    const PreloadService* found = set->Find(service);
+    if (!found) {
+        return false;
+    }
+
+    preloadOverrides[service] = enabled;
+    if (!preloadActive) {
+        return true;
+    }
+
+    if (enabled) {
+        size_t queued = InstallPreloadServiceLocked(*found);
+        Logger::Instance().Info(std::format("PreloadRoutes - Enabled {}, {} ranges queued", service, queued));
+    }
+    else {
+        size_t removed = RemovePreloadRoutesLocked(service, {}, {});
+        Logger::Instance().Info(std::format("PreloadRoutes - Disabled {}, removing {} ranges", service, removed));
+    }
+    return true;
+}
+
+PreloadStatus RouteController::GetPreloadStatus() {
+    std::lock_guard<std::mutex> lock(preloadMutex);
+
+    PreloadStatus status;
+    status.active = preloadActive;
+    {
+        std::lock_guard<std::mutex> programLock(programMutex);
+        status.queued = bulkPending;
+    }
+
+    // Статус только читает: файл перечитывает и сверяет установленное лишь PreloadAIRoutes,
+    // иначе опрос подменил бы набор и удалённые из файла диапазоны остались бы в таблице
+    if (!preloadSet) {
+        return status;
+    }
+    const PreloadSet& set = *preloadSet;
+    auto view = GetRouteView();
+    std::unordered_map<std::string_view, uint64_t> installed;
+    auto keys = view->Keys();
+    auto entries = view->Entries();
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::string_view name = view->ProcessName(entries[i]->processId);
+        if (name.starts_with(PRELOAD_NAME_PREFIX)) {
+            installed[name.substr(PRELOAD_NAME_PREFIX.size())]++;
         }
     }
-    Logger::Instance().Info(std::format("PreloadRoutes - Completed, added {} routes", totalRoutes));
+    for (const auto& [key, service] : preloadRoutes6) {
+        installed[service]++;
+    }
+
+    status.services.reserve(set.Services().size());
+    for (const auto& service : set.Services()) {
+        PreloadServiceStatus serviceStatus;
+        serviceStatus.name = service.name;
+        serviceStatus.enabled = IsPreloadServiceEnabledLocked(service);
+        serviceStatus.ranges = service.ranges.size() + service.ranges6.size();
+        auto it = installed.find(service.name);
+        serviceStatus.installed = it != installed.end() ? it->second : 0;
+        status.services.push_back(std::move(serviceStatus));
+    }
+    return status;
+}
+
+bool RouteController::IsPreloadServiceEnabledLocked(const PreloadService& service) const {
+    auto it = preloadOverrides.find(service.name);
+    return it != preloadOverrides.end() ? it->second : service.enabled;
 }
 
-std::vector<RouteController::PreloadService> RouteController::LoadPreloadConfig() {
-    std::vector<PreloadService> services;
+std::shared_ptr<const PreloadSet> RouteController::LoadPreloadSetLocked() {
+    std::string directory = Utils::GetCurrentDirectory();
+    std::string sourcePath = std::format("{}\\{}", directory, Constants::PRELOAD_CONFIG_FILE);
 
-    std::string configPath = std::format("{}\\preload_ips.json", Utils::GetCurrentDirectory());
+    // Неизменный файл не перечитываем: достаточно размера и времени записи
+    if (preloadSet && preloadSet->IsCurrent(sourcePath)) {
+        return preloadSet;
+    }
 
-    if (!Utils::FileExists(configPath)) {
-        CreateDefaultPreloadConfig(configPath);
+    if (!Utils::FileExists(sourcePath)) {
+        CreateDefaultPreloadConfig(sourcePath);
     }
 
-    std::ifstream file(configPath);
-    if (!file.is_open()) {
-        Logger::Instance().Error(std::format("Failed to open preload config: {}", configPath));
-        return GetDefaultPreloadServices();
+    auto set = PreloadSet::Load(sourcePath, std::format("{}\\{}", directory, Constants::PRELOAD_CACHE_FILE));
+    if (!set) {
+        set = PreloadSet::Compile(GetDefaultPreloadServices());
     }
+    preloadSet = set;
+    return set;
+}
 
-    Json::Value root;
-    Json::CharReaderBuilder builder;
-    std::string errors;
+size_t RouteController::InstallPreloadServiceLocked(const PreloadService& service) {
+    // Уже установленные и покрытые отсекаем по view, остальное уходит в фоновую очередь
+    auto view = GetRouteView();
+    std::vector<RouteKey> missing;
+    missing.reserve(service.ranges.size());
+    for (RouteKey key : service.ranges) {
+        if (view->Find(key) || view->FindCovering(RouteKeyAddress(key), RouteKeyPrefix(key))) {
+            continue;
+        }
+        missing.push_back(key);
+    }
 
-    if (!Json::parseFromStream(builder, file, &root, &errors)) {
-        Logger::Instance().Error(std::format("Failed to parse preload config: {}", errors));
-        return GetDefaultPreloadServices();
+    std::string processName = std::format("{}{}", PRELOAD_NAME_PREFIX, service.name);
+    auto& revoked = preloadRevoked[service.name];
+    if (!revoked) {
+        revoked = std::make_shared<std::atomic<bool>>(false);
     }
+    EnqueueBulkRoutes(missing, processName, revoked);
 
-    const Json::Value& servicesJson = root["services"];
-    if (!servicesJson.isArray()) {
-        Logger::Instance().Error("Invalid preload config format");
-        return GetDefaultPreloadServices();
+    // IPv6-диапазонов в наборе единицы, а AddRoute6 и так синхронный
+    for (const Route6Key& key : service.ranges6) {
+        if (preloadRoutes6.contains(key)) continue;
+        if (AddRoute6(key.address, key.prefixLength, processName)) {
+            preloadRoutes6.emplace(key, service.name);
+        }
     }
 
-    for (const auto& serviceJson : servicesJson) {
-        PreloadService service;
-        service.name = serviceJson.get("name", "").asString();
-        service.enabled = serviceJson.get("enabled", true).asBool();
+    return missing.size();
+}
 
-        const Json::Value& rangesJson = serviceJson["ranges"];
-        if (rangesJson.isArray()) {
-            for (const auto& range : rangesJson) {
-                service.ranges.push_back(range.asString());
-            }
+size_t RouteController::RemovePreloadRoutesLocked(std::string_view service, const std::unordered_set<RouteKey>& keep,
+    const std::unordered_set<Route6Key, Route6KeyHash>& keep6) {
+    // Сначала отзыв: диапазоны, которые программист уже взял в батч, в таблицу не попадут,
+    // а успевшие до отзыва увидит свежий view ниже
+    RevokePreloadLocked(service);
+    size_t dropped = DropBulkRoutes(service, keep);
+
+    // Установленные снимаются через очередь программирования, как истёкшие
+    PublishRouteView();
+    auto view = GetRouteView();
+    std::vector<RouteKey> stale;
+    auto keys = view->Keys();
+    auto entries = view->Entries();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (IsPreloadRouteOf(view->ProcessName(entries[i]->processId), service) && !keep.contains(keys[i])) {
+            stale.push_back(keys[i]);
+        }
+    }
+    if (!stale.empty()) {
+        EnqueueRouteRemovals(stale, PendingOp::Remove);
+    }
+
+    size_t removed6 = 0;
+    for (auto it = preloadRoutes6.begin(); it != preloadRoutes6.end();) {
+        if ((service.empty() || it->second == service) && !keep6.contains(it->first)) {
+            RemoveRoute6(it->first.address, it->first.prefixLength);
+            it = preloadRoutes6.erase(it);
+            removed6++;
+        }
+        else {
+            ++it;
+        }
+    }
+
+    if (dropped > 0) {
+        LOG_DEBUG("PreloadRoutes - Dropped {} ranges still waiting in the background queue", dropped);
+    }
+    return dropped + stale.size() + removed6;
+}
+
+void RouteController::RevokePreloadLocked(std::string_view service) {
+    for (auto it = preloadRevoked.begin(); it != preloadRevoked.end();) {
+        if (service.empty() || it->first == service) {
+            // Следующая установка сервиса получит новый флаг
+            it->second->store(true, std::memory_order_release);
+            it = preloadRevoked.erase(it);
+        }
+        else {
+            ++it;
         }
+    }
+}
+
+void RouteController::EnqueueBulkRoutes(std::span<const RouteKey> keys, std::string_view processName,
+    std::shared_ptr<const std::atomic<bool>> revoked) {
+    if (keys.empty()) return;
+
+    size_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+        auto now = std::chrono::steady_clock::now();
+
+        // Лимит основной очереди не действует: набор ограничен файлом и ждёт своей очереди
+        for (RouteKey key : keys) {
+            if (pendingRoutes.contains(key)) continue;
+
+            PendingRoute pending;
+            pending.address = RouteKeyAddress(key);
+            pending.prefixLength = RouteKeyPrefix(key);
+            pending.ip = Utils::FastUIntToIP(pending.address);
+            pending.processName = processName;
+            pending.bulk = true;
+            pending.revoked = revoked;
+            pending.enqueuedAt = now;
+
+            pendingRoutes.emplace(key, std::move(pending));
+            bulkQueue.push_back(key);
+            bulkIndex.Insert(RouteKeyAddress(key), RouteKeyPrefix(key));
+            added++;
+        }
+        bulkPending += added;
+    }
+
+    programCV.notify_all();
+    PERF_COUNT("RouteController.BulkQueue.Enqueued");
+}
+
+size_t RouteController::DropBulkRoutes(std::string_view service, const std::unordered_set<RouteKey>& keep) {
+    std::lock_guard<std::mutex> lock(programMutex);
+    if (bulkPending == 0) {
+        return 0;
+    }
 
-        if (!service.name.empty() && !service.ranges.empty()) {
-            services.push_back(service);
+    size_t dropped = 0;
+    for (RouteKey key : bulkQueue) {
+        auto it = pendingRoutes.find(key);
+        if (it == pendingRoutes.end() || !it->second.bulk || keep.contains(key) ||
+            !IsPreloadRouteOf(it->second.processName, service)) {
+            continue;
         }
+        bulkIndex.Erase(it->second.address, it->second.prefixLength);
+        pendingRoutes.erase(it);
+        dropped++;
     }
 
-    Logger::Instance().Info(std::format("Loaded {} services from preload config", services.size()));
-    return services;
+    bulkPending -= dropped;
+    if (bulkPending == 0) {
+        // Остались только ключи снятых или переведённых в основную очередь записей
+        bulkQueue.clear();
+        bulkIndex.Clear();
+    }
+    return dropped;
 }
 
 void RouteController::CreateDefaultPreloadConfig(const std::string& path) {
@@ -1362,31 +3847,8 @@ void RouteController::CreateDefaultPreloadConfig(const std::string& path) {
     }
 }
 
-std::vector<RouteController::PreloadService> RouteController::GetDefaultPreloadServices() {
+std::vector<PreloadSource> RouteController::GetDefaultPreloadServices() {
     return {
         {"Discord", true, { "162.159.128.0/19" }}
     };
-}
-
-bool RouteController::AddCIDRRoute(const std::string& cidr, const std::string& service) {
-    size_t slashPos = cidr.find('/');
-    if (slashPos == std::string::npos) return false;
-
-    std::string baseIp = cidr.substr(0, slashPos);
-    int prefixLen = 0;
-    try {
-        prefixLen = std::stoi(cidr.substr(slashPos + 1));
-    } catch (const std::exception& e) {
-        Logger::Instance().Error(std::format("Invalid CIDR prefix in '{}': {}", cidr, e.what()));
-        return false;
-    }
-
-    if (prefixLen < 0 || prefixLen > 32) {
-        Logger::Instance().Error(std::format("CIDR prefix length {} out of range [0..32] in '{}'", prefixLen, cidr));
-        return false;
-    }
-
-    Logger::Instance().Info(std::format("Adding CIDR route: {} for {}", cidr, service));
-
-    return AddRouteWithMask(baseIp, prefixLen, std::format("Preload-{}", service));
 }
\ No newline at end of file
@@ -9,7 +9,12 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <deque>
+#include <span>
+#include <unordered_set>
 #include <condition_variable>
+#include <functional>
+#include <optional>
 #include <winsock2.h>
 #include <windows.h>
 #ifndef _NTDEF_
@@ -20,12 +25,21 @@ typedef NTSTATUS *PNTSTATUS;
 #include "../common/Models.h"
 #include "../common/Result.h"
 #include "RouteOptimizer.h"
+#include "RoutePrefixIndex.h"
+#include "IncrementalAggregator.h"
+#include "Ipv4IntervalSet.h"
+#include "StringInterner.h"
+#include "RouteTable.h"
+#include "RouteStateStore.h"
+#include "RouteChangeNotifier.h"
+#include "RouteExpiryWheel.h"
+#include "RouteChangeJournal.h"
+#include "PreloadSet.h"
 
 struct SystemRoute {
     uint32_t address;
     uint32_t mask;
     int prefixLength;
-    std::string ipString;
 };
 
 class RouteController {
@@ -36,16 +50,89 @@ public:
     // Public API
     bool AddRoute(const std::string& ip, const std::string& processName);
     bool AddRouteWithMask(const std::string& ip, int prefixLength, const std::string& processName);
+    // Неблокирующее добавление: маршрут ставится в очередь и программируется writer-потоками
+    bool EnqueueRoute(const std::string& ip, const std::string& processName);
+    // Двоичный вариант для горячего пути: покрытый адрес не аллоцирует, строки строятся только при промахе.
+    // idleTtl > 0 - маршрут из DNS-ответа: истекает через idleTtl без использования, пока flow не
+    // переведёт его на общий TTL; 0 - обычный маршрут (и повышение уже стоящего DNS-маршрута)
+    bool EnqueueRoute(uint32_t address, std::string_view processName, int64_t idleTtl = 0);
+    // Продлевает установленный маршрут без учёта ссылки; false, если маршрута нет
+    bool TouchRoute(uint32_t address, int64_t idleTtl = 0);
+    size_t GetPendingRouteCount() const { return programQueueDepth.load(std::memory_order_relaxed); }
+
+    struct RestoreProgress {
+        size_t total = 0;
+        size_t done = 0;        // Включая неудачные
+        size_t failed = 0;
+        bool complete = false;
+    };
+    RestoreProgress GetRestoreProgress() const;
     bool RemoveRoute(const std::string& ip);
     bool RemoveRouteWithMask(const std::string& ip, int prefixLength);
+    // IPv6 программируется синхронно: вызывается из воркеров классификации, не из потока захвата
+    bool AddRoute6(const Ipv6Address& address, int prefixLength, std::string_view processName);
+    // Для пути пакетов (DNS-ответы): продление без новой ссылки и установка через потоки программирования
+    bool TouchRoute6(const Ipv6Address& address);
+    bool EnqueueRoute6(const Ipv6Address& address, std::string_view processName);
+    bool RemoveRoute6(const Ipv6Address& address, int prefixLength);
     void CleanupAllRoutes();
     void CleanupOldRoutes();
     size_t GetRouteCount() const;
     std::vector<RouteInfo> GetActiveRoutes() const;
+    // Дельта таблицы для UI после номера since; стоимость растёт с числом изменений, а не с таблицей
+    RouteChangeSet GetRouteChangesSince(uint64_t since);
+    uint64_t GetRouteChangeSequence();
+    // Вызывается с потока уведомлений после каждой пачки вставок и удалений; nullptr снимает
+    void SetChangeListener(std::function<void(uint64_t sequence)> listener);
+    // Preload: скомпилированный набор ставится фоновыми пачками через очередь программирования.
+    // Повторный вызов сверяет установленное с текущим файлом и переключателями сервисов
     void PreloadAIRoutes();
+    // Снимает ожидающие установки и ставит в очередь удаление всех preload-маршрутов
+    void RemovePreloadRoutes();
+    // Переключатель одного сервиса поверх preload_ips.json; false - сервиса нет в наборе
+    bool SetPreloadServiceEnabled(const std::string& service, bool enabled);
+    // По уже загруженному набору, файл не перечитывает; до первой загрузки список сервисов пуст
+    PreloadStatus GetPreloadStatus();
     ServiceConfig GetConfig() const { return config; }
     void UpdateConfig(const ServiceConfig& newConfig);
+    // Шлюз пула, через который ставятся маршруты; установленные переносятся через очередь программирования
+    void SwitchGateway(const std::string& gatewayIp);
+
+    // Смена шлюза или метрики из конфигурации: маршруты заранее строятся через новый шлюз в фоне,
+    // пока старые обслуживают трафик, затем одно переключение gatewayAddress
+    struct MigrationProgress {
+        uint64_t generation = 0;            // Последнее применённое изменение конфигурации
+        bool active = false;
+        size_t total = 0;
+        size_t done = 0;                    // Включая неудачные
+        size_t failed = 0;
+        std::chrono::milliseconds duration{ 0 };    // Текущей миграции или последней завершённой
+    };
+    MigrationProgress GetMigrationProgress() const;
     void RunOptimizationManual();
+    // Будит поток оптимизации, не дожидаясь часового интервала
+    void RequestOptimization();
+
+    // Для Watchdog. Маршруты: Trim просит оптимизацию (агрегаты заменяют хосты),
+    // Shed вдобавок вытесняет давно не использованную четверть таблицы.
+    // Оптимизатор: буферы и кэш планов освобождаются между прогонами
+    size_t GetMemoryBytes();
+    void TrimMemory(MemoryPressure pressure);
+    size_t GetOptimizerMemoryBytes() { return optimizer ? optimizer->GetMemoryBytes() : 0; }
+    bool ReleaseOptimizerMemory() { return optimizer && optimizer->ReleaseMemory(); }
+
+    // Итог последнего полного плана оптимизации, отдаётся по IPC в статусе
+    struct PlanExecutionStats {
+        size_t aggregatesApplied = 0;
+        size_t aggregatesFailed = 0;        // Не установлен или откатан после проверки
+        size_t routesRetired = 0;
+        size_t syscalls = 0;
+        size_t failures = 0;
+        size_t stepsSkipped = 0;            // Прерван остановкой сервиса
+        std::chrono::milliseconds duration{ 0 };
+        std::chrono::system_clock::time_point completedAt;
+    };
+    PlanExecutionStats GetLastPlanStats() const;
 
     void SyncWithSystemTable();
     void PerformFullCleanup();
@@ -54,27 +141,168 @@ public:
     const RouteError& GetLastError() const { return lastError; }
 
 private:
+    friend struct BenchAccess;              // bench/: горячие пути без публичного API
+
     ServiceConfig config;
-    std::unordered_map<std::string, std::unique_ptr<RouteInfo>> routes;
-    mutable std::shared_mutex routesMutex;  // Read-write lock для маршрутов
+    std::unordered_map<RouteKey, std::shared_ptr<RouteEntry>> routes;
+    mutable std::shared_mutex routesMutex;  // Writer'ы и согласованные чтения; остальные читают routeView
+    RoutePrefixIndex routeIndex;            // LPM-индекс по routes, защищён routesMutex
+    IncrementalAggregator aggregator;       // Дерево агрегации по routes, защищён routesMutex
+    StringInterner processNames;            // Имена процессов маршрутов, защищён routesMutex
+    uint64_t routesVersion = 0;             // Растёт при каждой вставке/удалении, защищён routesMutex
+
+    // RCU-публикация: неизменяемая копия таблицы, читается одной атомарной загрузкой
+    std::atomic<std::shared_ptr<const RouteTableView>> routeView;
+    std::mutex publishMutex;                // Сериализует PublishRouteView
+    RouteTableView::NameTable viewNames;    // Кэш имён для view, защищён publishMutex
+    // Журнал изменений для UI: вставки и удаления пишутся под routesMutex, а смена refCount
+    // только помечает запись и ставит ключ в очередь - горячий путь блокировку не берёт
+    RouteChangeJournal changeJournal;
+    std::mutex refDirtyMutex;
+    std::vector<RouteKey> refDirtyKeys;     // Не длиннее ROUTE_JOURNAL_CAPACITY, защищён refDirtyMutex
+    bool refDirtyOverflow = false;          // Ключ не поместился - при чтении журнала полная пересинхронизация
+    std::mutex changeListenerMutex;
+    std::function<void(uint64_t)> changeListener;
+    RouteChangeNotifier routeNotifier;      // Дебаунс уведомлений UI о смене числа маршрутов
     std::atomic<bool> running;
 
     std::jthread verifyThread;
     std::jthread persistThread;
     std::jthread optimizationThread;
 
+    // Очередь программирования маршрутов: дедупликация по RouteKey, FIFO по ключам.
+    // Кроме добавлений через неё же идут удаления по истечению (Expire) и при переполнении (Evict)
+    // и перенос на другой шлюз пула (Reroute), явное удаление без проверки простоя (Remove).
+    // Фоновые добавления (bulk, preload) ждут в bulkQueue и берутся, только когда programQueue пуста.
+    enum class PendingOp : uint8_t { Add, Expire, Evict, Reroute, Remove };
+
+    struct PendingRoute {
+        PendingOp op = PendingOp::Add;
+        std::string ip;
+        uint32_t address = 0;
+        int prefixLength = 32;
+        std::string processName;
+        int hits = 1;
+        int64_t idleTtl = 0;
+        std::string fromGateway;            // Не пусто - в ядре маршрут ещё стоит через этот шлюз
+        int rerouteFailures = 0;            // Подряд неудачных переносов, от них пауза перед следующим
+        bool bulk = false;                  // Стоит в bulkQueue
+        std::shared_ptr<const std::atomic<bool>> revoked;   // Preload: сервис выключили, пока диапазон ждал
+        std::chrono::steady_clock::time_point enqueuedAt;
+    };
+
+    std::unordered_map<RouteKey, PendingRoute> pendingRoutes;
+    std::deque<RouteKey> programQueue;
+    std::unordered_map<Route6Key, std::string, Route6KeyHash> pendingRoutes6;  // /128 -> владелец
+    std::deque<Route6Key> programQueue6;
+    std::deque<RouteKey> bulkQueue;
+    size_t bulkPending = 0;                 // Записей bulk в pendingRoutes; в bulkQueue бывают и устаревшие ключи
+    RoutePrefixIndex bulkIndex;             // Префиксы записей bulk: живой flow находит покрывающий диапазон
+    // Переносы, которые ядро отклонило: ждут своего срока, прежний шлюз не забывается
+    std::vector<std::pair<std::chrono::steady_clock::time_point, PendingRoute>> rerouteRetries;
+    std::mutex programMutex;
+    std::condition_variable_any programCV;
+    std::atomic<size_t> programQueueDepth{ 0 };
+    std::vector<std::jthread> programmerThreads;
+
+    // Истечение маршрутов по времени последнего использования (ленивый таймер: при срабатывании
+    // сверяемся с RouteEntry::lastUsed и переносим, если маршрут использовался)
+    RouteExpiryWheel expiryWheel;
+    std::mutex expiryMutex;                         // expiryWheel; берётся после routesMutex, не наоборот
+    std::atomic<bool> evictionRequested{ false };   // Таблица упёрлась в MAX_ROUTES
+    std::atomic<size_t> memoryEvictTarget{ 0 };     // Бюджет памяти: ужать таблицу до стольких маршрутов, 0 - нет
+
+    // IPv6: своя таблица, индекс покрытия и имена, IPv4-путь их не касается. Сохраняется в тот же снимок
+    std::unordered_map<Route6Key, Route6Entry, Route6KeyHash> routes6;
+    Route6PrefixIndex routeIndex6;
+    StringInterner processNames6;
+    mutable std::mutex routes6Mutex;                // routes6, routeIndex6, processNames6
+    std::atomic<size_t> routes6Count{ 0 };
+    std::chrono::steady_clock::time_point lastIpv6Expiry = std::chrono::steady_clock::now();
+
+    // Фоновое восстановление сохранённых маршрутов: сначала часто используемые и свежие
+    std::jthread restoreThread;
+    std::vector<PersistedRoute> restoreQueue;       // Заполняется до старта restoreThread, дальше только читается
+    std::vector<PersistedRoute6> restoreQueue6;
+    std::string restoreSavedGateway;
+    std::atomic<size_t> restoreTotal{ 0 };
+    std::atomic<size_t> restoreDone{ 0 };
+    std::atomic<size_t> restoreFailed{ 0 };
+    std::atomic<bool> restoreComplete{ false };
+
+    // Изменения шлюза применяются по одному потоком миграции. Ожидают не больше двух: переключение
+    // пула и изменение конфигурации, каждое новое сливается с ожидающим того же вида
+    struct GatewayChange {
+        uint64_t generation = 0;
+        std::string gateway;
+        bool live = false;                  // Переключение пула: сразу, без предварительной сборки
+        bool gatewayChanged = false;        // Из конфигурации: сменился основной шлюз
+        bool metricChanged = false;         // Из конфигурации: переустановка с новой метрикой
+    };
+    std::jthread migrationThread;
+    std::mutex migrationMutex;
+    std::condition_variable_any migrationCV;
+    std::optional<GatewayChange> pendingSwitch;     // Защищены migrationMutex
+    std::optional<GatewayChange> pendingConfig;
+    uint64_t requestedGeneration = 0;               // Защищён migrationMutex
+    std::atomic<bool> changePending{ false };       // Прерывает сборку: цель уже устарела
+    std::atomic<uint64_t> appliedGeneration{ 0 };
+    std::atomic<bool> migrationActive{ false };
+    std::atomic<size_t> migrationTotal{ 0 };
+    std::atomic<size_t> migrationDone{ 0 };
+    std::atomic<size_t> migrationFailed{ 0 };
+    std::atomic<int64_t> migrationStartedAt{ 0 };   // steady_clock, тики
+    std::atomic<int64_t> lastMigrationMs{ 0 };
+
     std::unique_ptr<RouteOptimizer> optimizer;
     std::chrono::steady_clock::time_point lastOptimizationTime;
+    PlanExecutionStats lastPlanStats;
+    PlanExecutionStats incrementalPlanStats;        // Сумма инкрементальных планов, статус полного не перетирает
+    mutable std::mutex planStatsMutex;
+    std::mutex planApplyMutex;                      // Планы применяются по одному: агрегат не строится дважды
     std::condition_variable optimizationCV;
     std::mutex optimizationMutex;
+    bool optimizationRequested = false;             // Защищён optimizationMutex
+    // Инкрементальные агрегаты применяет поток оптимизации: план идёт в темпе системных
+    // вызовов и не должен задерживать программирование маршрутов
+    OptimizationPlan pendingIncrementalPlan;        // Защищён optimizationMutex
 
     NET_IFINDEX cachedInterfaceIndex;
     mutable std::shared_mutex interfaceCacheMutex;  // Read-write lock для кэша интерфейса
 
-    std::atomic<bool> routesDirty{ false };
+    // Уведомления об изменениях таблицы маршрутов и интерфейсов
+    HANDLE routeChangeHandle = nullptr;
+    HANDLE interfaceChangeHandle = nullptr;
+    std::atomic<uint32_t> gatewayAddress{ 0 };      // Активный шлюз пула, network order, читается из callback'ов
+    std::mutex repairMutex;
+    std::condition_variable_any repairCV;
+    std::unordered_set<RouteKey> repairKeys;        // Удалённые извне маршруты, ждут переустановки
+    // Наши собственные удаления, не чиним. Метка - ключ и шлюз (network order), через который
+    // удаляли: OnRouteChange гасит её по NextHop уведомления ещё до фильтра активного шлюза
+    using SelfRemoval = std::pair<RouteKey, uint32_t>;
+    struct SelfRemovalHash {
+        size_t operator()(const SelfRemoval& tag) const {
+            return std::hash<uint64_t>{}(tag.first ^ (static_cast<uint64_t>(tag.second) * 0x9E3779B97F4A7C15ull));
+        }
+    };
+    std::unordered_set<SelfRemoval, SelfRemovalHash> selfRemovedKeys;
+    bool interfaceFlapped = false;
+
+    // Версионированный снимок маршрутов шлюза в системной таблице (отсортированные RouteKey).
+    // Полная загрузка один раз, дальше поддерживается из OnRouteChange.
+    std::vector<RouteKey> systemRouteKeys;
+    uint64_t systemRouteVersion = 0;
+    bool systemRoutesValid = false;
+    mutable std::mutex systemRoutesMutex;
+
+    std::atomic<bool> routesDirty{ false };          // Есть изменения после последнего снимка
     std::chrono::steady_clock::time_point lastSaveTime;
     static constexpr auto SAVE_INTERVAL = std::chrono::minutes(10);
 
+    RouteStateStore stateStore;                     // Бинарный снимок + журнал дельт
+    std::mutex saveMutex;                           // Сериализует снимки: BeginSnapshot..WriteSnapshot
+    bool restoringState = false;                    // Не журналируем вставки при загрузке, защищён routesMutex
+
     // Error tracking
     mutable RouteError lastError;
     mutable std::mutex errorMutex;
@@ -83,9 +311,16 @@ private:
     bool AddSystemRoute(const std::string& ip);
     bool AddSystemRouteWithMask(const std::string& ip, int prefixLength);
     bool AddSystemRouteOldAPI(const std::string& ip);
-    bool AddSystemRouteOldAPIWithMask(const std::string& ip, int prefixLength);
+    // gateway - network order; интерфейс уже найден вызывающим
+    bool AddSystemRouteVia(const std::string& ip, int prefixLength, uint32_t gateway, NET_IFINDEX interfaceIndex);
+    bool AddSystemRouteOldAPIWithMask(const std::string& ip, int prefixLength, uint32_t gateway = 0);
     bool RemoveSystemRoute(const std::string& ip, const std::string& gatewayIp);
     bool RemoveSystemRouteWithMask(const std::string& ip, int prefixLength, const std::string& gatewayIp);
+    bool VerifySystemRoute(const std::string& ip, int prefixLength);
+
+    bool AddSystemRoute6(const Ipv6Address& address, int prefixLength);
+    bool RemoveSystemRoute6(const Ipv6Address& address, int prefixLength, NET_IFINDEX interfaceIndex = 0);
+    NET_IFINDEX ResolveGatewayInterface();
 
     Result<void> AddSystemRouteEx(const std::string& ip, int prefixLength);
     Result<void> RemoveSystemRouteEx(const std::string& ip, int prefixLength, const std::string& gatewayIp);
@@ -94,39 +329,91 @@ private:
     void ClearLastError();
 
     void VerifyRoutesThreadFunc(std::stop_token stopToken);
+    void RegisterChangeNotifications();
+    void UnregisterChangeNotifications();
+    static VOID NETIOAPI_API_ OnRouteChange(PVOID context, PMIB_IPFORWARD_ROW2 row, MIB_NOTIFICATION_TYPE type);
+    static VOID NETIOAPI_API_ OnInterfaceChange(PVOID context, PMIB_IPINTERFACE_ROW row, MIB_NOTIFICATION_TYPE type);
+    void ReinstallRoutes(std::span<const RouteKey> keys);
+    void AuditSystemRoutes();
     void PersistenceThreadFunc(std::stop_token stopToken);
     void OptimizationThreadFunc(std::stop_token stopToken);
+    void RouteProgrammerThreadFunc(std::stop_token stopToken);
+    void ProgramRouteBatch(std::vector<PendingRoute>& batch);
+    void RestoreRoutesThreadFunc(std::stop_token stopToken);
+    void RestoreRouteWorker(std::stop_token stopToken, std::atomic<size_t>& nextIndex);
+    void CommitRestoredRoutes(std::span<const PersistedRoute* const> installed);
+    void EnqueueRouteRemovals(std::span<const RouteKey> keys, PendingOp op);
+    void ScheduleRouteExpiry(RouteKey key, int64_t lastUsed, int64_t idleTtl = 0);
+    void ExpireIpv6Routes();
+    void MigrateIpv6Routes(NET_IFINDEX oldInterface);
+    void RestoreIpv6Routes();
+    void RunIpv6Optimization();
+    size_t CleanupAllRoutes6();
+    void InsertRoute6Locked(const Route6Key& key, std::string_view processName, int64_t now);
+    void EraseRoute6Locked(const Route6Key& key);
 
     void SaveRoutesToDisk();
-    void SaveRoutesToDiskAsync();
     void LoadRoutesFromDisk();
+    bool LoadLegacyStateFile(std::vector<PersistedRoute>& persisted, std::string& savedGateway);
 
     bool IsGatewayReachable();
+    std::string ActiveGatewayIp() const;
     void InvalidateInterfaceCache();
-    void MigrateExistingRoutes(const std::string& oldGateway, const std::string& newGateway);
+    uint64_t RequestGatewayChange(GatewayChange change);
+    void MigrationThreadFunc(std::stop_token stopToken);
+    void MigrateGateway(std::stop_token stopToken, const GatewayChange& change);
+    void ApplyGatewaySwitch(const std::string& gatewayIp);
+    size_t EnqueueReroutes(std::span<const RouteKey> keys, const std::string& fromGateway);
+    void RetryReroutesLater(std::vector<PendingRoute>&& failed);
+    void EnqueueDueReroutesLocked(std::chrono::steady_clock::time_point now);
     void RunOptimization();
-    void ApplyOptimizationPlan(const OptimizationPlan& plan);
-    bool IsIPCoveredByExistingRoute(const std::string& ip);
-    uint32_t IPToUInt(const std::string& ip);
+    void ApplyOptimizationPlan(const OptimizationPlan& plan, bool incremental = false);
+    // Локальный план для только что вставленных маршрутов; отдаётся потоку оптимизации уже без блокировки
+    void CollectIncrementalPlanLocked(std::span<const RouteKey> added, OptimizationPlan& plan);
+    void QueueIncrementalPlan(OptimizationPlan&& plan);
+    bool IsIPCoveredByExistingRoute(uint32_t ipAddr, int prefixLength);
+    RouteEntry& InsertRouteLocked(uint32_t address, int prefixLength, std::string_view processName);
+    bool EraseRouteLocked(RouteKey key);
+    RouteInfo MaterializeRoute(const RouteEntry& entry, const RouteTableView& view) const;
+    RouteInfo MaterializeRouteLocked(const RouteEntry& entry) const;
+    RouteInfo MaterializeRoute6Locked(const Route6Key& key, const Route6Entry& entry) const;
+    int AddRouteRefs(RouteEntry& entry, int hits);
+    void JournalDirtyRefCounts();
+    void NotifyChangeListener();
+    size_t PublishRouteView();
+    bool TouchPublishedRoute(uint32_t address, int prefixLength, int hits, int64_t idleTtl = 0);
+    std::shared_ptr<const RouteTableView> GetRouteView() const { return routeView.load(std::memory_order_acquire); }
     static constexpr uint32_t CreateMask(int prefixLength);
     void NotifyUIRouteCountChanged();
 
     std::vector<SystemRoute> GetSystemRoutesForGateway();
-    std::vector<SystemRoute> GetSystemRoutesOldAPI();
+    std::vector<RouteKey> GetSystemRouteKeys(bool forceRefresh = false);
+    void LoadSystemRouteKeysLocked();
+    void ApplySystemRouteChange(RouteKey key, bool added);
+    void InvalidateSystemRouteSnapshot();
     void RemoveRedundantSystemRoutes(const std::vector<HostRoute>& hostRoutes,
         const std::vector<SystemRoute>& aggregatedRoutes);
     int CountBits(uint32_t mask);
 
-    struct PreloadService {
-        std::string name;
-        bool enabled;
-        std::vector<std::string> ranges;
-    };
+    // Preload. preloadMutex берётся до programMutex и routes6Mutex, не наоборот
+    std::mutex preloadMutex;
+    std::shared_ptr<const PreloadSet> preloadSet;
+    std::unordered_map<std::string, bool> preloadOverrides;
+    std::unordered_map<Route6Key, std::string, Route6KeyHash> preloadRoutes6;  // IPv6 ставится синхронно
+    bool preloadActive = false;
+    // Флаг отзыва на сервис: его видят и диапазоны, уже взятые программистом в батч
+    std::unordered_map<std::string, std::shared_ptr<std::atomic<bool>>> preloadRevoked;
 
-    std::vector<PreloadService> LoadPreloadConfig();
+    std::shared_ptr<const PreloadSet> LoadPreloadSetLocked();
+    bool IsPreloadServiceEnabledLocked(const PreloadService& service) const;
+    size_t InstallPreloadServiceLocked(const PreloadService& service);
+    // Все preload-маршруты (service пуст) или одного сервиса, кроме keep; возвращает число снятых
+    size_t RemovePreloadRoutesLocked(std::string_view service, const std::unordered_set<RouteKey>& keep,
+        const std::unordered_set<Route6Key, Route6KeyHash>& keep6);
+    void RevokePreloadLocked(std::string_view service);
+    void EnqueueBulkRoutes(std::span<const RouteKey> keys, std::string_view processName,
+        std::shared_ptr<const std::atomic<bool>> revoked);
+    size_t DropBulkRoutes(std::string_view service, const std::unordered_set<RouteKey>& keep);
     void CreateDefaultPreloadConfig(const std::string& path);
-    std::vector<PreloadService> GetDefaultPreloadServices();
-    bool AddCIDRRoute(const std::string& cidr, const std::string& service);
-
-    std::atomic<bool> aiRoutesPreloaded{ false };
+    std::vector<PreloadSource> GetDefaultPreloadServices();
 };
\ No newline at end of file
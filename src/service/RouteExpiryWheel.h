@@ -0,0 +1,140 @@
+// src/service/RouteExpiryWheel.h
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timer wheel for route expiry: three levels of 64 slots, so with
+// a one-minute tick level 0 spans ~1 hour, level 1 ~68 hours and level 2 ~182
+// days. Schedule/Cancel are O(1); Advance touches only the slots that come due.
+// A key has at most one live deadline; stale slot entries left behind by
+// Cancel or a reschedule are dropped lazily when their slot is processed.
+// Not thread-safe, the owner serializes access.
+class RouteExpiryWheel {
+public:
+    using Key = uint64_t;
+
+    RouteExpiryWheel(int64_t tickSeconds, int64_t now)
+        : tickSeconds(tickSeconds > 0 ? tickSeconds : 1), currentTick(now / this->tickSeconds) {
+    }
+
+    // deadline в секундах от эпохи; повторный вызов переносит таймер
+    void Schedule(Key key, int64_t deadline) {
+        deadlines[key] = deadline;
+        Place({ key, deadline }, currentTick + 1);
+    }
+
+    void Cancel(Key key) {
+        deadlines.erase(key);
+    }
+
+    // Moves keys whose deadline is <= now into 'due' and forgets them
+    void Advance(int64_t now, std::vector<Key>& due) {
+        int64_t targetTick = now / tickSeconds;
+        while (currentTick < targetTick) {
+            currentTick++;
+
+            // Каскад: на границе оборота нижнего уровня раскладываем слот верхнего
+            if ((currentTick & SLOT_MASK) == 0) {
+                if (((currentTick >> SLOT_BITS) & SLOT_MASK) == 0) {
+                    Cascade(2, (currentTick >> (SLOT_BITS * 2)) & SLOT_MASK);
+                }
+                Cascade(1, (currentTick >> SLOT_BITS) & SLOT_MASK);
+            }
+
+            auto& slot = levels[0][currentTick & SLOT_MASK];
+            std::vector<Timer> fired;
+            fired.swap(slot);
+            for (const Timer& timer : fired) {
+                if (!IsLive(timer)) continue;
+                if (timer.deadline <= now) {
+                    deadlines.erase(timer.key);
+                    due.push_back(timer.key);
+                }
+                else {
+                    Place(timer, currentTick + 1);
+                }
+            }
+        }
+    }
+
+    // Takes up to 'limit' keys with the nearest deadlines, regardless of whether
+    // they are due. Ordering is exact to one slot of the level they sit in.
+    void TakeEarliest(size_t limit, std::vector<Key>& out) {
+        for (int level = 0; level < LEVELS && limit > 0; level++) {
+            int64_t levelTick = currentTick >> (SLOT_BITS * level);
+            for (int64_t i = 1; i <= SLOTS && limit > 0; i++) {
+                auto& slot = levels[level][(levelTick + i) & SLOT_MASK];
+                for (const Timer& timer : slot) {
+                    if (limit == 0) break;
+                    if (!IsLive(timer)) continue;
+                    deadlines.erase(timer.key);
+                    out.push_back(timer.key);
+                    limit--;
+                }
+            }
+        }
+    }
+
+    size_t Size() const { return deadlines.size(); }
+
+    void Clear() {
+        for (auto& level : levels) {
+            for (auto& slot : level) {
+                slot.clear();
+            }
+        }
+        deadlines.clear();
+    }
+
+private:
+    static constexpr int LEVELS = 3;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int64_t SLOTS = 1 << SLOT_BITS;
+    static constexpr int64_t SLOT_MASK = SLOTS - 1;
+
+    struct Timer {
+        Key key;
+        int64_t deadline;
+    };
+
+    int64_t tickSeconds;
+    int64_t currentTick;
+    std::array<std::array<std::vector<Timer>, SLOTS>, LEVELS> levels;
+    std::unordered_map<Key, int64_t> deadlines;
+
+    bool IsLive(const Timer& timer) const {
+        auto it = deadlines.find(timer.key);
+        return it != deadlines.end() && it->second == timer.deadline;
+    }
+
+    void Place(const Timer& timer, int64_t minTick) {
+        int64_t tick = (timer.deadline + tickSeconds - 1) / tickSeconds;
+        if (tick < minTick) tick = minTick;
+
+        int64_t delta = tick - currentTick;
+        if (delta < SLOTS) {
+            levels[0][tick & SLOT_MASK].push_back(timer);
+        }
+        else if (delta < SLOTS * SLOTS) {
+            levels[1][(tick >> SLOT_BITS) & SLOT_MASK].push_back(timer);
+        }
+        else {
+            // Дальше горизонта кладём в последний слот; при каскаде таймер переложится
+            int64_t horizon = (std::min)(delta, SLOTS * SLOTS * SLOTS - 1);
+            levels[2][((currentTick + horizon) >> (SLOT_BITS * 2)) & SLOT_MASK].push_back(timer);
+        }
+    }
+
+    void Cascade(int level, int64_t index) {
+        std::vector<Timer> timers;
+        timers.swap(levels[level][index]);
+        for (const Timer& timer : timers) {
+            if (IsLive(timer)) {
+                Place(timer, currentTick);
+            }
+        }
+    }
+};
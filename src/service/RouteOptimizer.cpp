@@ -2,6 +2,7 @@
 #include "RouteOptimizer.h"
 #include "../common/Logger.h"
 #include "../service/PerformanceMonitor.h"
+#include "../common/Constants.h"
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <algorithm>
@@ -9,6 +10,10 @@
 #include <cmath>
 #include <set>
 #include <bit>
+#include <iterator>
+#include <array>
+#include <atomic>
+#include <thread>
 
 RouteOptimizer::RouteOptimizer(const OptimizerConfig& cfg) : config(cfg) {
     Logger::Instance().Info("RouteOptimizer initialized with caching support");
@@ -24,11 +29,15 @@ void RouteOptimizer::UpdateConfig(const OptimizerConfig& newConfig) {
 }
 
 OptimizationPlan RouteOptimizer::OptimizeRoutes(const std::vector<HostRoute>& hostRoutes) {
+    return OptimizeRoutes(hostRoutes, ContentHash(hostRoutes));
+}
+
+OptimizationPlan RouteOptimizer::OptimizeRoutes(const std::vector<HostRoute>& hostRoutes, uint64_t contentHash) {
     PERF_TIMER("RouteOptimizer::OptimizeRoutes");
     auto startTime = std::chrono::high_resolution_clock::now();
 
     // Check cache first
-    auto cachedPlan = GetCachedPlan(hostRoutes);
+    auto cachedPlan = GetCachedPlan(contentHash, hostRoutes.size());
     if (cachedPlan.has_value()) {
         PERF_COUNT("RouteOptimizer.CacheHit");
         Logger::Instance().Debug("RouteOptimizer: Using cached optimization plan");
@@ -38,39 +47,55 @@ OptimizationPlan RouteOptimizer::OptimizeRoutes(const std::vector<HostRoute>& ho
     PERF_COUNT("RouteOptimizer.CacheMiss");
     OptimizationPlan plan;
 
-    // Filter out private IPs
-    std::vector<HostRoute> publicRoutes;
-    publicRoutes.reserve(hostRoutes.size()); // Pre-allocate for efficiency
-
-    for (const auto& route : hostRoutes) {
-        if (!IsPrivateNetwork(route.ipNum)) {
-            publicRoutes.push_back(route);
-        }
+    OptimizerConfig settings;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        settings = config;
     }
+    uint64_t minHosts = static_cast<uint64_t>((std::max)(settings.min_hosts_to_aggregate, 0));
+    std::vector<std::pair<int, float>> thresholds(settings.waste_thresholds.begin(), settings.waste_thresholds.end());
+    std::ranges::sort(thresholds);
 
-    plan.routesBefore = static_cast<int>(publicRoutes.size());
-
-    if (publicRoutes.size() < config.min_hosts_to_aggregate) {
-        Logger::Instance().Info("Not enough public routes to optimize: " +
-            std::to_string(publicRoutes.size()));
-        plan.routesAfter = plan.routesBefore;
-        return plan;
-    }
+    int removedRoutes = 0;
+    size_t publicCount = 0;
+    size_t workerCount = 1;
+    {
+        std::lock_guard<std::mutex> poolLock(poolMutex);
+        PartitionSummary summary = PartitionRoutes(hostRoutes, CanPartition(settings));
+        publicCount = summary.publicCount;
+        plan.routesBefore = static_cast<int>(publicCount);
+
+        if (publicCount < minHosts) {
+            Logger::Instance().Info("Not enough public routes to optimize: " +
+                std::to_string(publicCount));
+            plan.routesAfter = plan.routesBefore;
+            return plan;
+        }
 
-    // Build enhanced trie that handles different prefix lengths
-    auto trieRoot = std::make_unique<TrieNode>();
-    BuildEnhancedTrie(trieRoot, publicRoutes);
+        if (summary.nonEmpty > 1 && summary.listed >= Constants::ROUTE_OPTIMIZER_PARALLEL_MIN_ROUTES) {
+            int requested = settings.worker_threads > 0 ? settings.worker_threads :
+                static_cast<int>(std::thread::hardware_concurrency());
+            workerCount = (std::min)(static_cast<size_t>(std::clamp(requested, 1, Constants::ROUTE_OPTIMIZER_MAX_THREADS)),
+                summary.nonEmpty);
+        }
 
-    // Run aggregation with consideration for existing aggregates
-    AggregateEnhancedTrie(trieRoot.get(), 0);
+        // Маршруты вне разделов (префикс 0) остаются в таблице и входят в лимит
+        RunPartitions(hostRoutes, settings, thresholds, publicCount - summary.listed, workerCount);
 
-    // Generate optimization plan
-    std::unordered_map<std::string, RouteInfo> processedRoutes;
-    GenerateEnhancedPlan(trieRoot.get(), 0, 0, plan, processedRoutes);
+        // Разделы упорядочены по адресу, поэтому склейка по порядку даёт тот же план, что и один поток
+        size_t total = 0;
+        for (const auto& changes : partitionChanges) {
+            total += changes.size();
+        }
+        plan.changes.reserve(total);
+        for (auto& changes : partitionChanges) {
+            std::ranges::move(changes, std::back_inserter(plan.changes));
+            changes.clear();
+        }
+    }
 
     // Calculate results
     int addedRoutes = 0;
-    int removedRoutes = 0;
     for (const auto& change : plan.changes) {
         if (change.type == OptimizationPlan::RouteChange::ADD) {
             addedRoutes++;
@@ -88,24 +113,123 @@ OptimizationPlan RouteOptimizer::OptimizeRoutes(const std::vector<HostRoute>& ho
 
     // Update stats
     auto endTime = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
 
     {
         std::lock_guard<std::mutex> lock(statsMutex);
         stats.totalOptimizations++;
-        stats.totalRoutesProcessed += publicRoutes.size();
+        stats.totalRoutesProcessed += publicCount;
         stats.totalRoutesAggregated += removedRoutes;
-        stats.totalProcessingTime += duration;
+        stats.totalProcessingTime += std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+        stats.lastProcessingTime = duration;
+        stats.lastRoutesProcessed = publicCount;
         stats.lastOptimization = std::chrono::system_clock::now();
     }
 
     // Cache the result
-    CachePlan(hostRoutes, plan);
+    CachePlan(contentHash, hostRoutes.size(), plan);
 
     // Log optimization details
-    Logger::Instance().Info("RouteOptimizer: Analyzed " + std::to_string(publicRoutes.size()) +
+    Logger::Instance().Info("RouteOptimizer: Analyzed " + std::to_string(publicCount) +
         " routes, found " + std::to_string(plan.changes.size()) + " changes in " +
-        std::to_string(duration.count()) + "ms");
+        std::to_string(duration.count()) + "us");
+
+    return plan;
+}
+
+OptimizationPlan RouteOptimizer::OptimizeRoutes6(const std::vector<Host6Route>& hostRoutes) {
+    PERF_TIMER("RouteOptimizer::OptimizeRoutes6");
+
+    int minHosts = 0;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        minHosts = (std::max)(config.min_hosts_to_aggregate, 2);
+    }
+
+    struct Prefix6 {
+        Ipv6Address address;
+        int prefixLength;
+        auto operator<=>(const Prefix6&) const = default;
+    };
+
+    std::vector<Prefix6> input;
+    input.reserve(hostRoutes.size());
+    for (const auto& route : hostRoutes) {
+        if (route.address.IsGlobalUnicast()) {
+            input.push_back({ route.address.Masked(route.prefixLength), route.prefixLength });
+        }
+    }
+    std::ranges::sort(input);
+    input.erase(std::unique(input.begin(), input.end()), input.end());
+
+    OptimizationPlan plan;
+    plan.routesBefore = static_cast<int>(input.size());
+
+    // Отсортированный набор остаётся отсортированным: агрегат встаёт на место первой своей записи.
+    // Порог считается по различным префиксам childLevel внутри агрегата, а не по числу маршрутов
+    auto aggregateLevel = [](const std::vector<Prefix6>& current, int level, int childLevel, int minMembers) {
+        std::vector<Prefix6> next;
+        next.reserve(current.size());
+
+        for (size_t i = 0; i < current.size();) {
+            if (current[i].prefixLength <= level) {
+                next.push_back(current[i++]);
+                continue;
+            }
+
+            Ipv6Address network = current[i].address.Masked(level);
+            size_t end = i;
+            int children = 0;
+            Ipv6Address lastChild;
+            while (end < current.size() && current[end].prefixLength > level &&
+                current[end].address.Masked(level) == network) {
+                // Набор отсортирован, одинаковые дочерние префиксы идут подряд
+                Ipv6Address child = current[end].address.Masked(childLevel);
+                if (end == i || child != lastChild) {
+                    children++;
+                    lastChild = child;
+                }
+                end++;
+            }
+
+            if (children >= minMembers) {
+                next.push_back({ network, level });
+            }
+            else {
+                next.insert(next.end(), current.begin() + i, current.begin() + end);
+            }
+            i = end;
+        }
+        return next;
+    };
+
+    std::vector<Prefix6> result = aggregateLevel(input, IPV6_SUBNET_PREFIX, 128, minHosts);
+    result = aggregateLevel(result, IPV6_SITE_PREFIX, IPV6_SUBNET_PREFIX, IPV6_MIN_SUBNETS_PER_SITE);
+
+    std::vector<Prefix6> added;
+    std::vector<Prefix6> removed;
+    std::ranges::set_difference(result, input, std::back_inserter(added));
+    std::ranges::set_difference(input, result, std::back_inserter(removed));
+
+    for (const auto& prefix : added) {
+        plan.changes.push_back({ OptimizationPlan::RouteChange::ADD, prefix.address.ToString(), prefix.prefixLength,
+            prefix.prefixLength == IPV6_SUBNET_PREFIX ? "IPv6 /64 aggregation" : "IPv6 /48 aggregation" });
+    }
+    for (const auto& prefix : removed) {
+        plan.changes.push_back({ OptimizationPlan::RouteChange::REMOVE, prefix.address.ToString(), prefix.prefixLength,
+            "Covered by IPv6 aggregate" });
+    }
+
+    plan.routesAfter = static_cast<int>(result.size());
+    if (plan.routesBefore > 0) {
+        plan.compressionRatio = 1.0f - (static_cast<float>(plan.routesAfter) / plan.routesBefore);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.totalRoutesProcessed += input.size();
+        stats.totalRoutesAggregated += removed.size();
+    }
 
     return plan;
 }
@@ -120,21 +244,74 @@ void RouteOptimizer::ResetStats() {
     stats = Stats();
 }
 
-size_t RouteOptimizer::ComputeRouteHash(const std::vector<HostRoute>& routes) const {
-    // Create a hash based on sorted routes
-    std::vector<HostRoute> sorted = routes;
-    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
-        return a.ipNum < b.ipNum || (a.ipNum == b.ipNum && a.prefixLength < b.prefixLength);
-        });
+size_t RouteOptimizer::GetMemoryBytes() {
+    auto changesBytes = [](const std::vector<OptimizationPlan::RouteChange>& changes) {
+        size_t bytes = changes.capacity() * sizeof(OptimizationPlan::RouteChange);
+        for (const auto& change : changes) {
+            bytes += change.ip.capacity() + change.reason.capacity();
+        }
+        return bytes;
+    };
+
+    std::unique_lock<std::mutex> poolLock(poolMutex, std::try_to_lock);
+    if (poolLock.owns_lock()) {
+        size_t bytes = partitionOrder.capacity() * sizeof(uint32_t);
+        for (const auto& ws : workspaces) {
+            bytes += sizeof(Workspace) + ws->prefixes.capacity() * sizeof(PrefixEntry) +
+                ws->aggregates.capacity() * sizeof(AggregateRange) + ws->coverage.capacity() * sizeof(CoverageSum);
+        }
+        for (const auto& changes : partitionChanges) {
+            bytes += changesBytes(changes);
+        }
+        poolMemoryBytes.store(bytes, std::memory_order_relaxed);
+        poolLock.unlock();
+    }
+
+    size_t cacheBytes = 0;
+    {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex);
+        for (const auto& [hash, cached] : optimizationCache) {
+            cacheBytes += sizeof(CachedOptimization) + changesBytes(cached.plan.changes);
+        }
+    }
+    return poolMemoryBytes.load(std::memory_order_relaxed) + cacheBytes;
+}
+
+bool RouteOptimizer::ReleaseMemory() {
+    {
+        std::lock_guard<std::mutex> cacheLock(cacheMutex);
+        optimizationCache.clear();
+    }
 
-    std::hash<std::string> hasher;
-    size_t hash = 0;
+    std::unique_lock<std::mutex> poolLock(poolMutex, std::try_to_lock);
+    if (!poolLock.owns_lock()) {
+        return false;
+    }
 
-    for (const auto& route : sorted) {
-        hash ^= hasher(route.ip) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-        hash ^= std::hash<int>{}(route.prefixLength) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    // Следующий прогон выделит буферы заново
+    workspaces.clear();
+    workspaces.shrink_to_fit();
+    std::vector<uint32_t>().swap(partitionOrder);
+    for (auto& changes : partitionChanges) {
+        std::vector<OptimizationPlan::RouteChange>().swap(changes);
     }
+    poolMemoryBytes.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+uint64_t RouteOptimizer::RouteHash(uint32_t address, int prefixLength) {
+    uint64_t value = ((static_cast<uint64_t>(address) << 8) | static_cast<uint8_t>(prefixLength)) * 0x9E3779B97F4A7C15ull;
+    value ^= value >> 29;
+    value *= 0xBF58476D1CE4E5B9ull;
+    return value ^ (value >> 32);
+}
 
+uint64_t RouteOptimizer::ContentHash(const std::vector<HostRoute>& hostRoutes) {
+    // Сумма не зависит от порядка и обновляется добавлением/вычитанием одного маршрута
+    uint64_t hash = 0;
+    for (const auto& route : hostRoutes) {
+        hash += RouteHash(route.ipNum, route.prefixLength);
+    }
     return hash;
 }
 
@@ -151,17 +328,15 @@ void RouteOptimizer::CleanupExpiredCache() {
     }
 }
 
-std::optional<OptimizationPlan> RouteOptimizer::GetCachedPlan(const std::vector<HostRoute>& routes) {
+std::optional<OptimizationPlan> RouteOptimizer::GetCachedPlan(uint64_t contentHash, size_t routeCount) {
     std::lock_guard<std::mutex> lock(cacheMutex);
 
     CleanupExpiredCache();
 
-    size_t hash = ComputeRouteHash(routes);
-    auto it = optimizationCache.find(hash);
+    auto it = optimizationCache.find(contentHash);
 
     if (it != optimizationCache.end()) {
-        // Verify the cached entry matches exactly
-        if (it->second.inputRoutes.size() == routes.size()) {
+        if (it->second.routeCount == routeCount) {
             return it->second.plan;
         }
     }
@@ -169,7 +344,7 @@ std::optional<OptimizationPlan> RouteOptimizer::GetCachedPlan(const std::vector<
     return std::nullopt;
 }
 
-void RouteOptimizer::CachePlan(const std::vector<HostRoute>& routes, const OptimizationPlan& plan) {
+void RouteOptimizer::CachePlan(uint64_t contentHash, size_t routeCount, const OptimizationPlan& plan) {
     std::lock_guard<std::mutex> lock(cacheMutex);
 
     // Limit cache size
@@ -184,201 +359,344 @@ void RouteOptimizer::CachePlan(const std::vector<HostRoute>& routes, const Optim
         optimizationCache.erase(oldest);
     }
 
-    size_t hash = ComputeRouteHash(routes);
     CachedOptimization cached;
-    cached.inputRoutes = routes;
+    cached.routeCount = routeCount;
     cached.plan = plan;
     cached.timestamp = std::chrono::system_clock::now();
 
-    optimizationCache[hash] = std::move(cached);
+    optimizationCache[contentHash] = std::move(cached);
 }
 
-void RouteOptimizer::BuildEnhancedTrie(std::unique_ptr<TrieNode>& root, const std::vector<HostRoute>& routes) {
-    PERF_TIMER("RouteOptimizer::BuildEnhancedTrie");
+bool RouteOptimizer::CanPartition(const OptimizerConfig& settings) {
+    if (settings.cost_based) {
+        // Лимит маршрутов общий на всю таблицу, его не разделить
+        return settings.max_routes <= 0 && settings.min_aggregate_prefix >= PARTITION_PREFIX;
+    }
+    return std::ranges::all_of(settings.waste_thresholds, [](const auto& threshold) {
+        return threshold.first >= PARTITION_PREFIX || threshold.first < 0;
+        });
+}
 
-    for (const auto& route : routes) {
-        TrieNode* current = root.get();
-        uint32_t ip = route.ipNum;
+RouteOptimizer::PartitionSummary RouteOptimizer::PartitionRoutes(const std::vector<HostRoute>& routes, bool partitioned) {
+    PERF_TIMER("RouteOptimizer::PartitionRoutes");
 
-        // For routes with prefix length < 32, we mark the node at that depth
-        int targetDepth = route.prefixLength;
+    // Сортировка подсчётом по старшему байту; без разделения всё попадает в раздел 0
+    std::array<uint32_t, PARTITIONS> counts{};
+    PartitionSummary summary;
+    auto partitionOf = [&partitioned](const HostRoute& route) {
+        return partitioned ? static_cast<size_t>(route.ipNum >> (32 - PARTITION_PREFIX)) : size_t{ 0 };
+    };
+    auto listed = [this](const HostRoute& route) {
+        // Префикс 0 в дереве не помечает ни одного узла
+        return route.prefixLength > 0 && route.prefixLength <= 32 && !IsPrivateNetwork(route.ipNum);
+    };
 
-        for (int i = 31; i >= (32 - targetDepth); --i) {
-            int bit = (ip >> i) & 1;
-            if (!current->children[bit]) {
-                current->children[bit] = std::make_unique<TrieNode>();
-            }
-            current = current->children[bit].get();
-
-            // Mark intermediate nodes if this is an aggregated route
-            if (i == (32 - targetDepth)) {
-                current->isRoute = true;
-                current->prefixLength = route.prefixLength;
-                current->processName = route.processName;
-                current->routeCount++;
-
-                Logger::Instance().Debug("Added route " + route.ip + "/" +
-                    std::to_string(route.prefixLength) + " to trie at depth " +
-                    std::to_string(targetDepth));
-            }
+    for (const auto& route : routes) {
+        if (IsPrivateNetwork(route.ipNum)) continue;
+        summary.publicCount++;
+        if (!listed(route)) continue;
+        summary.listed++;
+        // Маршрут короче раздела покрывает несколько разделов сразу
+        if (route.prefixLength < PARTITION_PREFIX) {
+            partitioned = false;
         }
     }
-}
-
-int RouteOptimizer::AggregateEnhancedTrie(TrieNode* node, int depth) {
-    if (!node) return 0;
 
-    // If this node represents an existing route, count all routes below it
-    if (node->isRoute) {
-        return CountRoutesInSubtree(node);
+    for (const auto& route : routes) {
+        if (listed(route)) {
+            counts[partitionOf(route)]++;
+        }
     }
 
-    // Count routes in children
-    int leftCount = 0, rightCount = 0;
-    if (node->children[0]) {
-        leftCount = AggregateEnhancedTrie(node->children[0].get(), depth + 1);
+    partitionStart[0] = 0;
+    for (size_t p = 0; p < PARTITIONS; p++) {
+        partitionStart[p + 1] = partitionStart[p] + counts[p];
+        if (counts[p] > 0) summary.nonEmpty++;
     }
-    if (node->children[1]) {
-        rightCount = AggregateEnhancedTrie(node->children[1].get(), depth + 1);
+
+    partitionOrder.resize(summary.listed);
+    std::array<uint32_t, PARTITIONS> cursor;
+    std::copy_n(partitionStart.begin(), PARTITIONS, cursor.begin());
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (listed(routes[i])) {
+            partitionOrder[cursor[partitionOf(routes[i])]++] = static_cast<uint32_t>(i);
+        }
     }
+    return summary;
+}
 
-    int totalCount = leftCount + rightCount + node->routeCount;
+void RouteOptimizer::RunPartitions(const std::vector<HostRoute>& routes, const OptimizerConfig& settings,
+    const std::vector<std::pair<int, float>>& thresholds, uint64_t fixedRoutes, size_t workerCount) {
+    PERF_TIMER("RouteOptimizer::RunPartitions");
 
-    // Check if we should aggregate at this level
-    if (totalCount >= config.min_hosts_to_aggregate && depth < 32) {
-        int prefixLen = depth;
+    while (workspaces.size() < workerCount) {
+        workspaces.push_back(std::make_unique<Workspace>());
+    }
 
-        // Check waste threshold
-        auto it = config.waste_thresholds.find(prefixLen);
-        if (it != config.waste_thresholds.end()) {
-            long double totalPossibleHosts = std::exp2l(32 - depth); // More efficient than pow
-            float wasteRatio = static_cast<float>((totalPossibleHosts - totalCount) / totalPossibleHosts);
+    const uint64_t minHosts = static_cast<uint64_t>((std::max)(settings.min_hosts_to_aggregate, 0));
+    std::atomic<size_t> nextPartition{ 0 };
 
-            if (wasteRatio <= it->second) {
-                // Only aggregate if it would actually reduce route count
-                int existingRouteCount = CountExistingRoutes(node);
+    // Разделы разбираются потоками по одному, каждый поток пишет только в свои partitionChanges[p]
+    auto work = [&](Workspace& ws) {
+        for (size_t p = nextPartition.fetch_add(1, std::memory_order_relaxed); p < PARTITIONS;
+            p = nextPartition.fetch_add(1, std::memory_order_relaxed)) {
+            if (partitionStart[p] == partitionStart[p + 1]) continue;
 
-                if (existingRouteCount > 1) {  // Only aggregate if we have more than 1 route
-                    node->isAggregated = true;
-                    PERF_COUNT("RouteOptimizer.Aggregation");
-                    Logger::Instance().Debug("Aggregating at depth " + std::to_string(depth) +
-                        " with " + std::to_string(totalCount) + " routes (was " +
-                        std::to_string(existingRouteCount) + " routes)");
-                }
+            std::span<const uint32_t> order(partitionOrder.data() + partitionStart[p], partitionStart[p + 1] - partitionStart[p]);
+            BuildPrefixPool(ws, routes, order);
+            if (settings.cost_based) {
+                AggregateByCost(ws, settings, fixedRoutes);
             }
+            else {
+                AggregatePrefixPool(ws, minHosts, thresholds);
+            }
+            GeneratePlan(ws, routes, partitionChanges[p]);
         }
+    };
+
+    if (workerCount <= 1) {
+        work(*workspaces[0]);
+        return;
     }
 
-    return totalCount;
+    std::vector<std::jthread> workers;
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back([&work, &ws = *workspaces[i]] { work(ws); });
+    }
 }
 
-int RouteOptimizer::CountRoutesInSubtree(TrieNode* node) {
-    if (!node) return 0;
+void RouteOptimizer::BuildPrefixPool(Workspace& ws, const std::vector<HostRoute>& routes, std::span<const uint32_t> order) {
+    PERF_TIMER("RouteOptimizer::BuildPrefixPool");
+
+    ws.prefixes.clear();
+    for (uint32_t i : order) {
+        const auto& route = routes[i];
+        PrefixEntry entry;
+        entry.network = route.ipNum & CreateMask(route.prefixLength);
+        entry.routeCount = 1;
+        entry.routeIndex = i;
+        entry.prefixLength = static_cast<uint8_t>(route.prefixLength);
+        ws.prefixes.push_back(entry);
+    }
 
-    int count = node->routeCount;
+    std::ranges::sort(ws.prefixes, [](const PrefixEntry& a, const PrefixEntry& b) {
+        return a.network != b.network ? a.network < b.network : a.prefixLength < b.prefixLength;
+        });
 
-    if (node->children[0]) {
-        count += CountRoutesInSubtree(node->children[0].get());
+    // Одинаковые префиксы - один узел дерева; имя процесса от последнего маршрута
+    size_t unique = 0;
+    for (size_t i = 0; i < ws.prefixes.size(); i++) {
+        if (unique > 0 && ws.prefixes[unique - 1].network == ws.prefixes[i].network &&
+            ws.prefixes[unique - 1].prefixLength == ws.prefixes[i].prefixLength) {
+            PrefixEntry& merged = ws.prefixes[unique - 1];
+            merged.routeCount++;
+            merged.routeIndex = (std::max)(merged.routeIndex, ws.prefixes[i].routeIndex);
+            continue;
+        }
+        ws.prefixes[unique++] = ws.prefixes[i];
     }
-    if (node->children[1]) {
-        count += CountRoutesInSubtree(node->children[1].get());
+    ws.prefixes.resize(unique);
+
+    // Стек вложенных префиксов: в прямом обходе предок всегда идёт перед потомками
+    std::array<uint32_t, 33> ancestors;
+    size_t depth = 0;
+    for (size_t i = 0; i < ws.prefixes.size(); i++) {
+        PrefixEntry& entry = ws.prefixes[i];
+        while (depth > 0) {
+            const PrefixEntry& top = ws.prefixes[ancestors[depth - 1]];
+            if ((entry.network & CreateMask(top.prefixLength)) == top.network) break;
+            depth--;
+        }
+        entry.coverPrefix = depth > 0 ? ws.prefixes[ancestors[depth - 1]].coverPrefix : entry.prefixLength;
+        ancestors[depth++] = static_cast<uint32_t>(i);
     }
-
-    return count;
 }
 
-int RouteOptimizer::CountExistingRoutes(TrieNode* node) {
-    if (!node) return 0;
+void RouteOptimizer::AggregatePrefixPool(Workspace& ws, uint64_t minHosts, const std::vector<std::pair<int, float>>& thresholds) {
+    PERF_TIMER("RouteOptimizer::AggregatePrefixPool");
 
-    int count = 0;
-    if (node->isRoute) count++;
+    ws.aggregates.clear();
+    const size_t count = ws.prefixes.size();
 
-    if (node->children[0]) {
-        count += CountExistingRoutes(node->children[0].get());
-    }
-    if (node->children[1]) {
-        count += CountExistingRoutes(node->children[1].get());
-    }
-
-    return count;
-}
+    // От коротких префиксов к длинным: выбирается самый верхний узел, подходящий под порог
+    for (const auto& [depth, threshold] : thresholds) {
+        if (depth < 0 || depth >= 32) continue;
 
-void RouteOptimizer::GenerateEnhancedPlan(TrieNode* node, uint32_t currentSubnet, int depth,
-    OptimizationPlan& plan,
-    std::unordered_map<std::string, RouteInfo>& processedRoutes) {
+        const uint32_t mask = CreateMask(depth);
+        const long double totalPossibleHosts = std::exp2l(32 - depth);
 
-    if (!node) return;
+        for (size_t i = 0; i < count;) {
+            const PrefixEntry& first = ws.prefixes[i];
+            if (first.consumed || first.prefixLength <= depth) {
+                i++;
+                continue;
+            }
 
-    if (node->isAggregated) {
-        // Add the new aggregated route
-        std::string aggregatedIp = UIntToIP(currentSubnet);
-        plan.changes.push_back({
-            OptimizationPlan::RouteChange::ADD,
-            aggregatedIp,
-            depth,
-            "Aggregated"
-            });
+            // Поддерево узла глубины depth - непрерывный отрезок массива
+            const uint32_t network = first.network & mask;
+            uint64_t totalCount = 0;
+            size_t end = i;
+            while (end < count && (ws.prefixes[end].network & mask) == network) {
+                totalCount += ws.prefixes[end].routeCount;
+                end++;
+            }
 
-        // Find all existing routes under this node to remove
-        std::vector<RouteInfo> routesToRemove;
-        CollectRoutesForRemoval(node, currentSubnet, depth, routesToRemove);
-
-        // Add removal entries for each route
-        for (const auto& route : routesToRemove) {
-            std::string routeKey = route.ip + "/" + std::to_string(route.prefixLength);
-
-            if (processedRoutes.find(routeKey) == processedRoutes.end()) {
-                plan.changes.push_back({
-                    OptimizationPlan::RouteChange::REMOVE,
-                    route.ip,
-                    route.prefixLength,
-                    route.processName
-                    });
-                processedRoutes[routeKey] = route;
+            // Узел сам является маршрутом или лежит под маршрутом - не агрегируется
+            bool eligible = first.coverPrefix > depth && end - i > 1 && totalCount >= minHosts;
+            if (eligible) {
+                float wasteRatio = static_cast<float>((totalPossibleHosts - totalCount) / totalPossibleHosts);
+                if (wasteRatio <= threshold) {
+                    ws.aggregates.push_back({ network, depth, static_cast<uint32_t>(i), static_cast<uint32_t>(end) });
+                    for (size_t j = i; j < end; j++) {
+                        ws.prefixes[j].consumed = true;
+                    }
+                    PERF_COUNT("RouteOptimizer.Aggregation");
+                }
             }
+            i = end;
         }
+    }
+
+    // Агрегаты не пересекаются: порядок по адресу совпадает с обходом дерева
+    std::ranges::sort(ws.aggregates, {}, &AggregateRange::network);
+}
+
+void RouteOptimizer::AggregateByCost(Workspace& ws, const OptimizerConfig& settings, uint64_t fixedRoutes) {
+    PERF_TIMER("RouteOptimizer::AggregateByCost");
+
+    const uint32_t count = static_cast<uint32_t>(ws.prefixes.size());
+    ws.aggregates.clear();
+    if (count == 0) return;
 
-        return; // Don't process children of aggregated nodes
+    ws.coverage.assign(count + 1, CoverageSum());
+    for (uint32_t i = 0; i < count; i++) {
+        const PrefixEntry& entry = ws.prefixes[i];
+        ws.coverage[i + 1].addresses = ws.coverage[i].addresses +
+            (entry.coverPrefix == entry.prefixLength ? (1ull << (32 - entry.prefixLength)) : 0);
+        ws.coverage[i + 1].routes = ws.coverage[i].routes + 1;
     }
 
-    // If this is a route that wasn't aggregated, keep it
-    if (node->isRoute && !node->isAggregated) {
-        // This route stays as-is, no changes needed
+    const double wastedAddressCost = (std::max)(static_cast<double>(settings.wasted_address_cost), 0.0);
+    const int minPrefix = std::clamp(settings.min_aggregate_prefix, 1, 31);
+    double routeCost = (std::max)(static_cast<double>(settings.route_cost), 1e-6);
+
+    auto solve = [&](double cost) {
+        ws.aggregates.clear();
+        return SolveCostRange(ws, 0, count, 0, 0, cost, wastedAddressCost, minPrefix);
+    };
+
+    CostResult result = solve(routeCost);
+    if (settings.max_routes <= 0) return;
+
+    const uint64_t maxRoutes = static_cast<uint64_t>(settings.max_routes) > fixedRoutes ?
+        static_cast<uint64_t>(settings.max_routes) - fixedRoutes : 0;
+    if (result.routes <= maxRoutes) return;
+
+    // Лагранжева релаксация: число маршрутов не растёт с ценой маршрута, ищем наименьшую допустимую
+    double low = routeCost;
+    double high = routeCost;
+    for (int i = 0; i < 64 && result.routes > maxRoutes; i++) {
+        low = high;
+        high *= 2.0;
+        result = solve(high);
     }
 
-    // Continue traversing
-    if (depth < 32) {
-        if (node->children[0]) {
-            GenerateEnhancedPlan(node->children[0].get(), currentSubnet, depth + 1, plan, processedRoutes);
+    if (result.routes > maxRoutes) {
+        Logger::Instance().Warning("RouteOptimizer: route budget " + std::to_string(maxRoutes) +
+            " is unreachable with aggregates up to /" + std::to_string(minPrefix) +
+            ", best plan keeps " + std::to_string(result.routes) + " routes");
+        return;
+    }
+
+    // Цена растёт геометрически, поэтому и делим отрезок по среднему геометрическому
+    // ws.aggregates держит решение последнего вызова, допустимое решение восстанавливаем в конце
+    bool poolFeasible = true;
+    for (int i = 0; i < 20 && high / low > 1.001; i++) {
+        double middle = std::sqrt(low * high);
+        CostResult candidate = solve(middle);
+        poolFeasible = candidate.routes <= maxRoutes;
+        if (poolFeasible) {
+            high = middle;
+            result = candidate;
+            if (candidate.routes == maxRoutes) break;
         }
-        if (node->children[1]) {
-            GenerateEnhancedPlan(node->children[1].get(), currentSubnet | (1u << (31 - depth)), depth + 1, plan, processedRoutes);
+        else {
+            low = middle;
         }
     }
+    if (!poolFeasible) {
+        result = solve(high);
+    }
+
+    Logger::Instance().Debug("RouteOptimizer: route budget " + std::to_string(maxRoutes) +
+        " met with " + std::to_string(result.routes) + " routes at route cost " + std::to_string(high));
 }
 
-void RouteOptimizer::CollectRoutesForRemoval(TrieNode* node, uint32_t subnet, int depth,
-    std::vector<RouteInfo>& routes) {
+RouteOptimizer::CostResult RouteOptimizer::SolveCostRange(Workspace& ws, uint32_t first, uint32_t last, uint32_t network, int depth,
+    double routeCost, double wastedAddressCost, int minPrefix) {
 
-    if (!node) return;
+    // Узел сам является маршрутом: его поддерево остаётся как есть
+    if (ws.prefixes[first].prefixLength == depth) {
+        uint64_t routes = ws.coverage[last].routes - ws.coverage[first].routes;
+        return { routeCost * static_cast<double>(routes), routes };
+    }
 
-    // If this node represents a route, add it to removal list
-    if (node->isRoute) {
-        RouteInfo info;
-        info.ip = UIntToIP(subnet);
-        info.prefixLength = node->prefixLength;
-        info.processName = node->processName;
-        routes.push_back(info);
+    const uint32_t bit = 1u << (31 - depth);
+    auto split = std::partition_point(ws.prefixes.begin() + first, ws.prefixes.begin() + last,
+        [bit](const PrefixEntry& entry) { return (entry.network & bit) == 0; });
+    const uint32_t middle = static_cast<uint32_t>(split - ws.prefixes.begin());
+
+    // Решение для детей остаётся в ws.aggregates, если агрегат здесь не выгоднее
+    const size_t mark = ws.aggregates.size();
+    CostResult children;
+    if (middle > first) {
+        CostResult left = SolveCostRange(ws, first, middle, network, depth + 1, routeCost, wastedAddressCost, minPrefix);
+        children.cost += left.cost;
+        children.routes += left.routes;
+    }
+    if (last > middle) {
+        CostResult right = SolveCostRange(ws, middle, last, network | bit, depth + 1, routeCost, wastedAddressCost, minPrefix);
+        children.cost += right.cost;
+        children.routes += right.routes;
     }
 
-    // Recursively collect from children
-    if (depth < 32) {
-        if (node->children[0]) {
-            CollectRoutesForRemoval(node->children[0].get(), subnet, depth + 1, routes);
+    if (depth >= minPrefix && last - first > 1) {
+        uint64_t covered = ws.coverage[last].addresses - ws.coverage[first].addresses;
+        uint64_t wasted = (1ull << (32 - depth)) - covered;
+        double cost = routeCost + wastedAddressCost * static_cast<double>(wasted);
+        if (cost < children.cost) {
+            ws.aggregates.resize(mark);
+            ws.aggregates.push_back({ network, depth, first, last });
+            return { cost, 1 };
         }
-        if (node->children[1]) {
-            CollectRoutesForRemoval(node->children[1].get(), subnet | (1u << (31 - depth)), depth + 1, routes);
+    }
+    return children;
+}
+
+void RouteOptimizer::GeneratePlan(const Workspace& ws, const std::vector<HostRoute>& routes,
+    std::vector<OptimizationPlan::RouteChange>& changes) {
+    for (const auto& aggregate : ws.aggregates) {
+        changes.push_back({
+            OptimizationPlan::RouteChange::ADD,
+            UIntToIP(aggregate.network),
+            aggregate.prefixLength,
+            "Aggregated"
+            });
+
+        for (uint32_t i = aggregate.first; i < aggregate.last; i++) {
+            const PrefixEntry& entry = ws.prefixes[i];
+            changes.push_back({
+                OptimizationPlan::RouteChange::REMOVE,
+                UIntToIP(entry.network),
+                entry.prefixLength,
+                routes[entry.routeIndex].processName
+                });
         }
+
+        Logger::Instance().Debug("Aggregating " + UIntToIP(aggregate.network) + "/" +
+            std::to_string(aggregate.prefixLength) + " (was " +
+            std::to_string(aggregate.last - aggregate.first) + " routes)");
     }
 }
 
@@ -386,9 +704,8 @@ uint32_t RouteOptimizer::CreateMask(int prefixLength) {
     if (prefixLength <= 0) return 0;
     if (prefixLength >= 32) return 0xFFFFFFFF;
 
-    // Optimized version using bit rotation intrinsics
-    // This is more efficient than: return ~((1u << (32 - prefixLength)) - 1);
-    return std::rotr(0xFFFFFFFF, 32 - prefixLength);
+    // rotr от всех единиц даёт те же единицы, маску строим сдвигом
+    return 0xFFFFFFFFu << (32 - prefixLength);
 }
 
 std::string RouteOptimizer::UIntToIP(uint32_t ip) {
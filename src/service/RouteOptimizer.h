@@ -6,7 +6,12 @@
 #include <memory>
 #include <mutex>
 #include <chrono>
+#include <array>
+#include <optional>
+#include <span>
+#include <atomic>
 #include "../common/Models.h"
+#include "Ipv6Address.h"
 
 struct OptimizerConfig {
     int min_hosts_to_aggregate = 2;
@@ -14,6 +19,18 @@ struct OptimizerConfig {
         {30, 0.75f}, {29, 0.80f}, {28, 0.85f},
         {27, 0.90f}, {26, 0.90f}, {25, 0.92f}, {24, 0.95f}
     };
+
+    // Cost-based mode ignores waste_thresholds and picks the aggregate set that
+    // minimizes route_cost * routes + wasted_address_cost * unintended
+    // addresses covered. With max_routes > 0 the route cost is raised until
+    // the plan fits the budget.
+    bool cost_based = false;
+    float route_cost = 1.0f;
+    float wasted_address_cost = 0.05f;
+    int max_routes = 0;                 // 0 - без ограничения
+    int min_aggregate_prefix = 16;      // Агрегаты короче не строим даже ради лимита
+
+    int worker_threads = 0;             // 0 - по числу ядер, 1 - без параллельных разделов
 };
 
 struct OptimizationPlan {
@@ -38,12 +55,24 @@ struct HostRoute {
     int prefixLength = 32;
 };
 
+struct Host6Route {
+    Ipv6Address address;
+    int prefixLength = 128;
+    std::string processName;
+};
+
 class RouteOptimizer {
 public:
     RouteOptimizer(const OptimizerConfig& config);
     ~RouteOptimizer() = default;
 
     OptimizationPlan OptimizeRoutes(const std::vector<HostRoute>& hostRoutes);
+    // contentHash - сумма RouteHash по всем маршрутам, вызывающий может вести её по мере сбора
+    OptimizationPlan OptimizeRoutes(const std::vector<HostRoute>& hostRoutes, uint64_t contentHash);
+    static uint64_t RouteHash(uint32_t address, int prefixLength);
+    static uint64_t ContentHash(const std::vector<HostRoute>& hostRoutes);
+    // IPv6: хосты одной /64 сворачиваются в /64, несколько /64 одной /48 - в /48
+    OptimizationPlan OptimizeRoutes6(const std::vector<Host6Route>& hostRoutes);
     void UpdateConfig(const OptimizerConfig& newConfig);
 
     // Performance stats
@@ -52,24 +81,48 @@ public:
         uint64_t totalRoutesProcessed = 0;
         uint64_t totalRoutesAggregated = 0;
         std::chrono::milliseconds totalProcessingTime{ 0 };
+        // Прогон на десятках тысяч маршрутов укладывается в единицы миллисекунд
+        std::chrono::microseconds lastProcessingTime{ 0 };
+        uint64_t lastRoutesProcessed = 0;
         std::chrono::system_clock::time_point lastOptimization;
     };
 
     Stats GetStats() const;
     void ResetStats();
 
+    // Буферы разделов, рабочие области потоков и кэш планов. Пока идёт прогон,
+    // буферы не трогаются: GetMemoryBytes отдаёт прошлую оценку, ReleaseMemory - false
+    size_t GetMemoryBytes();
+    bool ReleaseMemory();
+
 private:
-    struct TrieNode {
-        std::unique_ptr<TrieNode> children[2];
-        bool isRoute = false;
-        bool isAggregated = false;
-        std::string processName;
-        int prefixLength = 32;
-        int routeCount = 0;
+    // Prefix trie stored flat: entries sorted by (network, prefix length) are
+    // the pre-order walk of the binary trie, so every subtree is a contiguous
+    // run and the trie needs no child pointers. Process names stay in the
+    // input routes and are referenced by index.
+    struct PrefixEntry {
+        uint32_t network = 0;
+        uint32_t routeCount = 0;        // Входных маршрутов с этим префиксом
+        uint32_t routeIndex = 0;        // Последний из них, по нему берётся имя процесса
+        uint8_t prefixLength = 0;
+        uint8_t coverPrefix = 0;        // Самый короткий маршрут, покрывающий запись (включая её)
+        bool consumed = false;          // Уже под агрегатом с более коротким префиксом
+    };
+
+    struct AggregateRange {
+        uint32_t network;
+        int prefixLength;
+        uint32_t first;                 // Отрезок prefixes, который заменяет агрегат
+        uint32_t last;
+    };
+
+    struct CostResult {
+        double cost = 0.0;
+        uint64_t routes = 0;
     };
 
     struct CachedOptimization {
-        std::vector<HostRoute> inputRoutes;
+        size_t routeCount = 0;          // Дополнительная проверка к хэшу содержимого
         OptimizationPlan plan;
         std::chrono::system_clock::time_point timestamp;
     };
@@ -85,25 +138,60 @@ private:
     std::unordered_map<size_t, CachedOptimization> optimizationCache;
     mutable std::mutex cacheMutex;
     static constexpr size_t MAX_CACHE_SIZE = 10;
+    // Доля "пустых" адресов для IPv6 бессмысленна, границы агрегации фиксированные
+    static constexpr int IPV6_SUBNET_PREFIX = 64;
+    static constexpr int IPV6_SITE_PREFIX = 48;
+    static constexpr int IPV6_MIN_SUBNETS_PER_SITE = 4;
     static constexpr auto CACHE_EXPIRY = std::chrono::minutes(5);
 
-    void BuildEnhancedTrie(std::unique_ptr<TrieNode>& root, const std::vector<HostRoute>& routes);
-    int AggregateEnhancedTrie(TrieNode* node, int depth);
-    void GenerateEnhancedPlan(TrieNode* node, uint32_t currentSubnet, int depth,
-        OptimizationPlan& plan, std::unordered_map<std::string, RouteInfo>& processedRoutes);
+    struct CoverageSum {
+        uint64_t addresses = 0;         // Покрытые маршрутами адреса, вложенные не считаются дважды
+        uint64_t routes = 0;            // Различные префиксы: повторы - один маршрут ядра
+    };
+
+    // Буферы одного потока: очищаются без освобождения памяти, после первого запуска не аллоцируют
+    struct Workspace {
+        std::vector<PrefixEntry> prefixes;
+        std::vector<AggregateRange> aggregates;
+        std::vector<CoverageSum> coverage;      // Префиксные суммы по prefixes
+    };
+
+    // При порогах не короче /8 агрегаты не пересекают границу /8: разделы считаются независимо
+    static constexpr int PARTITION_PREFIX = 8;
+    static constexpr size_t PARTITIONS = size_t{ 1 } << PARTITION_PREFIX;
+
+    // Всё ниже защищено poolMutex
+    std::vector<std::unique_ptr<Workspace>> workspaces;     // По одному на поток
+    std::vector<uint32_t> partitionOrder;                   // Индексы входа, сгруппированные по разделам
+    std::array<uint32_t, PARTITIONS + 1> partitionStart{};
+    std::array<std::vector<OptimizationPlan::RouteChange>, PARTITIONS> partitionChanges;
+    std::mutex poolMutex;
+    std::atomic<size_t> poolMemoryBytes{ 0 };
+
+    struct PartitionSummary {
+        size_t publicCount = 0;
+        size_t listed = 0;              // Попали в разделы (префикс 1..32)
+        size_t nonEmpty = 0;
+    };
 
-    int CountRoutesInSubtree(TrieNode* node);
-    int CountExistingRoutes(TrieNode* node);
-    void CollectRoutesForRemoval(TrieNode* node, uint32_t subnet, int depth,
-        std::vector<RouteInfo>& routes);
+    static bool CanPartition(const OptimizerConfig& settings);
+    PartitionSummary PartitionRoutes(const std::vector<HostRoute>& routes, bool partitioned);
+    void RunPartitions(const std::vector<HostRoute>& routes, const OptimizerConfig& settings,
+        const std::vector<std::pair<int, float>>& thresholds, uint64_t fixedRoutes, size_t workerCount);
+    void BuildPrefixPool(Workspace& ws, const std::vector<HostRoute>& routes, std::span<const uint32_t> order);
+    void AggregatePrefixPool(Workspace& ws, uint64_t minHosts, const std::vector<std::pair<int, float>>& thresholds);
+    void AggregateByCost(Workspace& ws, const OptimizerConfig& settings, uint64_t fixedRoutes);
+    CostResult SolveCostRange(Workspace& ws, uint32_t first, uint32_t last, uint32_t network, int depth,
+        double routeCost, double wastedAddressCost, int minPrefix);
+    void GeneratePlan(const Workspace& ws, const std::vector<HostRoute>& routes,
+        std::vector<OptimizationPlan::RouteChange>& changes);
 
     uint32_t CreateMask(int prefixLength);
     std::string UIntToIP(uint32_t ip);
     bool IsPrivateNetwork(uint32_t ip);
 
     // Cache helpers
-    size_t ComputeRouteHash(const std::vector<HostRoute>& routes) const;
     void CleanupExpiredCache();
-    std::optional<OptimizationPlan> GetCachedPlan(const std::vector<HostRoute>& routes);
-    void CachePlan(const std::vector<HostRoute>& routes, const OptimizationPlan& plan);
+    std::optional<OptimizationPlan> GetCachedPlan(uint64_t contentHash, size_t routeCount);
+    void CachePlan(uint64_t contentHash, size_t routeCount, const OptimizationPlan& plan);
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+// src/service/RoutePrefixIndex.h
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <unordered_set>
+#include "Ipv6Address.h"
+
+// Longest-prefix-match index over installed IPv4 routes.
+// One hash set of network addresses per prefix length plus a bitmap of the
+// lengths that are populated, so a lookup costs at most 33 hash probes
+// regardless of how many routes are installed.
+class RoutePrefixIndex {
+public:
+    static constexpr uint32_t MaskFor(int prefixLength) {
+        if (prefixLength <= 0) return 0;
+        if (prefixLength >= 32) return 0xFFFFFFFF;
+        return ~((1u << (32 - prefixLength)) - 1);
+    }
+
+    void Insert(uint32_t address, int prefixLength) {
+        if (prefixLength < 0 || prefixLength > 32) return;
+        tables[prefixLength].insert(address & MaskFor(prefixLength));
+        presentLengths |= (1ull << prefixLength);
+    }
+
+    void Erase(uint32_t address, int prefixLength) {
+        if (prefixLength < 0 || prefixLength > 32) return;
+        auto& table = tables[prefixLength];
+        table.erase(address & MaskFor(prefixLength));
+        if (table.empty()) {
+            presentLengths &= ~(1ull << prefixLength);
+        }
+    }
+
+    bool Contains(uint32_t address, int prefixLength) const {
+        if (prefixLength < 0 || prefixLength > 32) return false;
+        if (!(presentLengths & (1ull << prefixLength))) return false;
+        return tables[prefixLength].contains(address & MaskFor(prefixLength));
+    }
+
+    // Returns the longest installed prefix length strictly shorter than
+    // 'shorterThan' that covers 'address', or -1 when none does.
+    int FindCovering(uint32_t address, int shorterThan = 33) const {
+        uint64_t candidates = presentLengths;
+        if (shorterThan <= 0) return -1;
+        if (shorterThan < 64) {
+            candidates &= (1ull << shorterThan) - 1;
+        }
+
+        while (candidates) {
+            int prefixLength = 63 - std::countl_zero(candidates);
+            if (tables[prefixLength].contains(address & MaskFor(prefixLength))) {
+                return prefixLength;
+            }
+            candidates &= ~(1ull << prefixLength);
+        }
+        return -1;
+    }
+
+    void Clear() {
+        for (auto& table : tables) {
+            table.clear();
+        }
+        presentLengths = 0;
+    }
+
+    size_t Size() const {
+        size_t total = 0;
+        for (const auto& table : tables) {
+            total += table.size();
+        }
+        return total;
+    }
+
+private:
+    std::array<std::unordered_set<uint32_t>, 33> tables;
+    uint64_t presentLengths = 0;
+};
+
+// Same scheme for IPv6: one set per prefix length 0..128 and a 129-bit
+// presence bitmap. Kept separate so the IPv4 index stays 32-bit keyed.
+class Route6PrefixIndex {
+public:
+    void Insert(const Ipv6Address& address, int prefixLength) {
+        if (prefixLength < 0 || prefixLength > 128) return;
+        tables[prefixLength].insert(address.Masked(prefixLength));
+        presentLengths[prefixLength / 64] |= (1ull << (prefixLength % 64));
+    }
+
+    void Erase(const Ipv6Address& address, int prefixLength) {
+        if (prefixLength < 0 || prefixLength > 128) return;
+        auto& table = tables[prefixLength];
+        table.erase(address.Masked(prefixLength));
+        if (table.empty()) {
+            presentLengths[prefixLength / 64] &= ~(1ull << (prefixLength % 64));
+        }
+    }
+
+    // Longest installed prefix strictly shorter than 'shorterThan' covering 'address', or -1
+    int FindCovering(const Ipv6Address& address, int shorterThan = 129) const {
+        for (int word = (std::min)(shorterThan - 1, 128) / 64; word >= 0; word--) {
+            uint64_t candidates = presentLengths[word];
+            int limit = shorterThan - word * 64;
+            if (limit <= 0) continue;
+            if (limit < 64) {
+                candidates &= (1ull << limit) - 1;
+            }
+
+            while (candidates) {
+                int bit = 63 - std::countl_zero(candidates);
+                int prefixLength = word * 64 + bit;
+                if (tables[prefixLength].contains(address.Masked(prefixLength))) {
+                    return prefixLength;
+                }
+                candidates &= ~(1ull << bit);
+            }
+        }
+        return -1;
+    }
+
+    void Clear() {
+        for (auto& table : tables) {
+            table.clear();
+        }
+        presentLengths = {};
+    }
+
+private:
+    std::array<std::unordered_set<Ipv6Address, Ipv6AddressHash>, 129> tables;
+    std::array<uint64_t, 3> presentLengths{};
+};
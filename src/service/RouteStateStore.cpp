@@ -0,0 +1,459 @@
+// src/service/RouteStateStore.cpp
+#include "RouteStateStore.h"
+#include "PerformanceMonitor.h"
+#include "../common/Logger.h"
+#include "../common/WinHandles.h"
+#include <windows.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <span>
+#include <unordered_map>
+
+namespace {
+    // Read-only отображение файла в память; пустой span, если файла нет
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+            UniqueHandle file(CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+            if (file.get() == INVALID_HANDLE_VALUE) return;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file.get(), &size) || size.QuadPart == 0) return;
+
+            UniqueHandle mapping(CreateFileMappingA(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            if (!mapping) return;
+
+            view = static_cast<const uint8_t*>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+            if (view) {
+                length = static_cast<size_t>(size.QuadPart);
+            }
+        }
+
+        ~MappedFile() {
+            if (view) UnmapViewOfFile(view);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::span<const uint8_t> Data() const { return { view, length }; }
+
+    private:
+        const uint8_t* view = nullptr;
+        size_t length = 0;
+    };
+
+    template<typename T>
+    bool ReadPod(std::span<const uint8_t> data, size_t& offset, T& out) {
+        if (offset + sizeof(T) > data.size()) return false;
+        std::memcpy(&out, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    int64_t ToSeconds(std::chrono::system_clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+    }
+
+    std::chrono::system_clock::time_point FromSeconds(int64_t seconds) {
+        if (seconds <= 0) return std::chrono::system_clock::now();
+        return std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+    }
+
+    uint64_t MakeKey(uint32_t address, int prefixLength) {
+        return (static_cast<uint64_t>(address) << 8) | static_cast<uint8_t>(prefixLength);
+    }
+
+    std::string MakeKey6(const std::array<uint8_t, 16>& address, int prefixLength) {
+        std::string key(reinterpret_cast<const char*>(address.data()), address.size());
+        key.push_back(static_cast<char>(prefixLength));
+        return key;
+    }
+}
+
+RouteStateStore::RouteStateStore(std::string snapshot, std::string journal)
+    : snapshotPath(std::move(snapshot)), journalPath(std::move(journal)) {
+}
+
+bool RouteStateStore::HasState() const {
+    std::error_code ec;
+    return std::filesystem::exists(snapshotPath, ec) || std::filesystem::exists(journalPath, ec);
+}
+
+bool RouteStateStore::Load(std::vector<PersistedRoute>& routes, std::vector<PersistedRoute6>& routes6, uint32_t& gatewayAddress) {
+    PERF_TIMER("RouteStateStore::Load");
+    std::lock_guard<std::mutex> lock(fileMutex);
+
+    routes.clear();
+    routes6.clear();
+    gatewayAddress = 0;
+    uint64_t snapshotGeneration = 0;
+
+    {
+        MappedFile snapshot(snapshotPath);
+        auto data = snapshot.Data();
+
+        if (!data.empty()) {
+            size_t offset = 0;
+            StateFileHeader header{};
+            bool headerRead = ReadPod(data, offset, header);
+            bool knownLayout = ((header.version == SNAPSHOT_VERSION || header.version == 2) &&
+                header.recordSize == sizeof(StateRouteRecord)) ||
+                (header.version == 1 && header.recordSize == SNAPSHOT_V1_RECORD_SIZE);
+            if (!headerRead || header.magic != SNAPSHOT_MAGIC || !knownLayout) {
+                Logger::Instance().Error("RouteStateStore: snapshot header is invalid, ignoring state");
+                return false;
+            }
+
+            size_t recordsBytes = static_cast<size_t>(header.routeCount) * header.recordSize;
+            if (offset + recordsBytes + header.namesBytes > data.size()) {
+                Logger::Instance().Error("RouteStateStore: snapshot is truncated, ignoring state");
+                return false;
+            }
+
+            // Таблица имён лежит после записей
+            std::vector<std::string> names;
+            names.reserve(header.nameCount);
+            size_t nameOffset = offset + recordsBytes;
+            for (uint32_t i = 0; i < header.nameCount; i++) {
+                uint16_t nameLength = 0;
+                if (!ReadPod(data, nameOffset, nameLength) || nameOffset + nameLength > data.size()) {
+                    Logger::Instance().Error("RouteStateStore: snapshot name table is corrupt");
+                    return false;
+                }
+                names.emplace_back(reinterpret_cast<const char*>(data.data() + nameOffset), nameLength);
+                nameOffset += nameLength;
+            }
+
+            routes.reserve(header.routeCount);
+            for (uint32_t i = 0; i < header.routeCount; i++) {
+                // Записи версии 1 короче: недостающий lastUsed остаётся 0 и читается как "сейчас"
+                StateRouteRecord record{};
+                std::memcpy(&record, data.data() + offset, header.recordSize);
+                offset += header.recordSize;
+
+                PersistedRoute route;
+                route.address = record.address;
+                route.prefixLength = record.prefixLength;
+                route.processName = record.processId < names.size() ? names[record.processId] : "Unknown";
+                route.refCount = record.refCount > 0 ? record.refCount : 1;
+                route.createdAt = FromSeconds(record.createdAt);
+                route.lastUsed = FromSeconds(record.lastUsed);
+                routes.push_back(std::move(route));
+            }
+
+            // IPv6 - с версии 3, после таблицы имён
+            uint32_t route6Count = 0;
+            if (header.version >= 3 && (!ReadPod(data, nameOffset, route6Count) ||
+                nameOffset + static_cast<size_t>(route6Count) * sizeof(StateRoute6Record) > data.size())) {
+                Logger::Instance().Error("RouteStateStore: snapshot IPv6 block is truncated, ignoring state");
+                routes.clear();
+                return false;
+            }
+            routes6.reserve(route6Count);
+            for (uint32_t i = 0; i < route6Count; i++) {
+                StateRoute6Record record;
+                ReadPod(data, nameOffset, record);
+
+                PersistedRoute6 route;
+                std::memcpy(route.address.data(), record.address, route.address.size());
+                route.prefixLength = record.prefixLength;
+                route.processName = record.processId < names.size() ? names[record.processId] : "Unknown";
+                route.refCount = record.refCount > 0 ? record.refCount : 1;
+                route.createdAt = FromSeconds(record.createdAt);
+                route.lastUsed = FromSeconds(record.lastUsed);
+                routes6.push_back(std::move(route));
+            }
+
+            gatewayAddress = header.gatewayAddress;
+            snapshotGeneration = header.generation;
+        }
+    }
+
+    generation = snapshotGeneration;
+    journalHeaderWritten = ReplayJournal(snapshotGeneration, routes, routes6);
+    journalRecords.store(0, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool RouteStateStore::ReplayJournal(uint64_t expectedGeneration, std::vector<PersistedRoute>& routes,
+    std::vector<PersistedRoute6>& routes6) {
+    MappedFile journal(journalPath);
+    auto data = journal.Data();
+    if (data.empty()) return false;
+
+    size_t offset = 0;
+    JournalFileHeader header{};
+    // Журнал версии 1 отличается только отсутствием IPv6-операций
+    if (!ReadPod(data, offset, header) || header.magic != JOURNAL_MAGIC ||
+        (header.version != JOURNAL_VERSION && header.version != 1)) {
+        Logger::Instance().Warning("RouteStateStore: journal header is invalid, ignoring journal");
+        return false;
+    }
+
+    if (header.generation != expectedGeneration) {
+        Logger::Instance().Info(std::format("RouteStateStore: journal generation {} does not match snapshot {}, ignoring",
+            header.generation, expectedGeneration));
+        return false;
+    }
+
+    std::unordered_map<uint64_t, size_t> positions;
+    positions.reserve(routes.size());
+    for (size_t i = 0; i < routes.size(); i++) {
+        positions[MakeKey(routes[i].address, routes[i].prefixLength)] = i;
+    }
+
+    std::vector<bool> removed(routes.size(), false);
+    size_t replayed = 0;
+
+    // IPv6-маршрутов единицы, снимаемые просто вычёркиваются из вектора
+    auto find6 = [&routes6](const std::string& key) {
+        return std::ranges::find_if(routes6, [&key](const PersistedRoute6& route) {
+            return MakeKey6(route.address, route.prefixLength) == key;
+            });
+    };
+
+    JournalRecord record;
+    while (ReadPod(data, offset, record)) {
+        std::array<uint8_t, 16> address6{};
+        bool ipv6 = record.op == static_cast<uint8_t>(JournalOp::Add6) || record.op == static_cast<uint8_t>(JournalOp::Remove6);
+        if (ipv6) {
+            if (offset + address6.size() > data.size()) break;
+            std::memcpy(address6.data(), data.data() + offset, address6.size());
+            offset += address6.size();
+        }
+        if (offset + record.nameLength > data.size()) {
+            // Хвост, оборванный при аварийном завершении
+            break;
+        }
+        std::string_view name(reinterpret_cast<const char*>(data.data() + offset), record.nameLength);
+        offset += record.nameLength;
+
+        uint64_t key = MakeKey(record.address, record.prefixLength);
+        switch (static_cast<JournalOp>(record.op)) {
+        case JournalOp::Add: {
+            PersistedRoute route;
+            route.address = record.address;
+            route.prefixLength = record.prefixLength;
+            route.processName = std::string(name);
+            route.createdAt = FromSeconds(record.createdAt);
+            route.lastUsed = route.createdAt;
+
+            auto it = positions.find(key);
+            if (it != positions.end()) {
+                routes[it->second] = std::move(route);
+                removed[it->second] = false;
+            }
+            else {
+                positions[key] = routes.size();
+                routes.push_back(std::move(route));
+                removed.push_back(false);
+            }
+            break;
+        }
+        case JournalOp::Remove: {
+            auto it = positions.find(key);
+            if (it != positions.end()) {
+                removed[it->second] = true;
+                positions.erase(it);
+            }
+            break;
+        }
+        case JournalOp::Clear:
+            positions.clear();
+            std::fill(removed.begin(), removed.end(), true);
+            routes6.clear();
+            break;
+        case JournalOp::Add6: {
+            PersistedRoute6 route;
+            route.address = address6;
+            route.prefixLength = record.prefixLength;
+            route.processName = std::string(name);
+            route.createdAt = FromSeconds(record.createdAt);
+            route.lastUsed = route.createdAt;
+
+            auto it = find6(MakeKey6(address6, record.prefixLength));
+            if (it != routes6.end()) {
+                *it = std::move(route);
+            }
+            else {
+                routes6.push_back(std::move(route));
+            }
+            break;
+        }
+        case JournalOp::Remove6: {
+            auto it = find6(MakeKey6(address6, record.prefixLength));
+            if (it != routes6.end()) {
+                routes6.erase(it);
+            }
+            break;
+        }
+        default:
+            Logger::Instance().Warning(std::format("RouteStateStore: unknown journal op {}, stopping replay",
+                static_cast<int>(record.op)));
+            offset = data.size();
+            break;
+        }
+        replayed++;
+    }
+
+    if (std::ranges::find(removed, true) != removed.end()) {
+        std::vector<PersistedRoute> kept;
+        kept.reserve(positions.size());
+        for (size_t i = 0; i < routes.size(); i++) {
+            if (!removed[i]) kept.push_back(std::move(routes[i]));
+        }
+        routes = std::move(kept);
+    }
+
+    Logger::Instance().Info(std::format("RouteStateStore: replayed {} journal records", replayed));
+    return true;
+}
+
+void RouteStateStore::Append(JournalOp op, uint32_t address, int prefixLength,
+    std::string_view processName, std::chrono::system_clock::time_point createdAt) {
+    JournalRecord record{};
+    record.op = static_cast<uint8_t>(op);
+    record.prefixLength = static_cast<uint8_t>(prefixLength);
+    record.nameLength = static_cast<uint16_t>((std::min)(processName.size(), size_t(UINT16_MAX)));
+    record.address = address;
+    record.createdAt = op == JournalOp::Add ? ToSeconds(createdAt) : 0;
+    AppendRecord(record, {}, processName);
+}
+
+void RouteStateStore::Append6(JournalOp op, const uint8_t address[16], int prefixLength,
+    std::string_view processName, std::chrono::system_clock::time_point createdAt) {
+    JournalRecord record{};
+    record.op = static_cast<uint8_t>(op);
+    record.prefixLength = static_cast<uint8_t>(prefixLength);
+    record.nameLength = static_cast<uint16_t>((std::min)(processName.size(), size_t(UINT16_MAX)));
+    record.createdAt = op == JournalOp::Add6 ? ToSeconds(createdAt) : 0;
+    AppendRecord(record, std::span<const uint8_t>(address, 16), processName);
+}
+
+void RouteStateStore::AppendRecord(const JournalRecord& record, std::span<const uint8_t> address6, std::string_view processName) {
+    std::lock_guard<std::mutex> lock(journalMutex);
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+    pendingJournal.insert(pendingJournal.end(), bytes, bytes + sizeof(record));
+    pendingJournal.insert(pendingJournal.end(), address6.begin(), address6.end());
+    pendingJournal.insert(pendingJournal.end(), processName.begin(), processName.begin() + record.nameLength);
+    journalRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RouteStateStore::FlushJournal() {
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+
+    // Пока снимок не записан, дельты относятся к следующему поколению - держим в памяти
+    if (snapshotPending) return true;
+
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        if (pendingJournal.empty()) return true;
+        buffer.swap(pendingJournal);
+    }
+
+    PERF_TIMER("RouteStateStore::FlushJournal");
+
+    std::ofstream file;
+    if (journalHeaderWritten) {
+        file.open(journalPath, std::ios::binary | std::ios::app);
+    }
+    else {
+        file.open(journalPath, std::ios::binary | std::ios::trunc);
+        if (file.is_open()) {
+            JournalFileHeader header{ JOURNAL_MAGIC, JOURNAL_VERSION, 0, generation };
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+    }
+
+    if (!file.is_open()) {
+        Logger::Instance().Error("RouteStateStore: failed to open journal for writing");
+        std::lock_guard<std::mutex> lock(journalMutex);
+        buffer.insert(buffer.end(), pendingJournal.begin(), pendingJournal.end());
+        pendingJournal.swap(buffer);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    file.flush();
+    journalHeaderWritten = true;
+    return file.good();
+}
+
+void RouteStateStore::BeginSnapshot() {
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+    std::lock_guard<std::mutex> lock(journalMutex);
+    pendingJournal.clear();
+    journalRecords.store(0, std::memory_order_relaxed);
+    snapshotPending = true;
+}
+
+bool RouteStateStore::WriteSnapshot(const std::vector<StateRouteRecord>& records, const std::vector<StateRoute6Record>& records6,
+    const std::vector<std::string>& processNames, uint32_t gatewayAddress) {
+    PERF_TIMER("RouteStateStore::WriteSnapshot");
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+
+    uint32_t namesBytes = 0;
+    for (const auto& name : processNames) {
+        namesBytes += static_cast<uint32_t>(sizeof(uint16_t) + (std::min)(name.size(), size_t(UINT16_MAX)));
+    }
+
+    StateFileHeader header{};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.recordSize = sizeof(StateRouteRecord);
+    header.generation = generation + 1;
+    header.gatewayAddress = gatewayAddress;
+    header.routeCount = static_cast<uint32_t>(records.size());
+    header.nameCount = static_cast<uint32_t>(processNames.size());
+    header.namesBytes = namesBytes;
+    header.savedAt = ToSeconds(std::chrono::system_clock::now());
+
+    std::string tmpPath = snapshotPath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            Logger::Instance().Error("RouteStateStore: failed to open snapshot for writing");
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()),
+            static_cast<std::streamsize>(records.size() * sizeof(StateRouteRecord)));
+        for (const auto& name : processNames) {
+            uint16_t nameLength = static_cast<uint16_t>((std::min)(name.size(), size_t(UINT16_MAX)));
+            file.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+            file.write(name.data(), nameLength);
+        }
+        uint32_t route6Count = static_cast<uint32_t>(records6.size());
+        file.write(reinterpret_cast<const char*>(&route6Count), sizeof(route6Count));
+        file.write(reinterpret_cast<const char*>(records6.data()),
+            static_cast<std::streamsize>(records6.size() * sizeof(StateRoute6Record)));
+
+        if (!file.good()) {
+            Logger::Instance().Error("RouteStateStore: failed to write snapshot");
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, snapshotPath, ec);
+    if (ec) {
+        Logger::Instance().Error(std::format("RouteStateStore: failed to replace snapshot: {}", ec.message()));
+        return false;
+    }
+
+    // Новый журнал начнётся с заголовка следующего поколения при первом сбросе
+    generation = header.generation;
+    journalHeaderWritten = false;
+    snapshotPending = false;
+    std::filesystem::remove(journalPath, ec);
+
+    return true;
+}
@@ -0,0 +1,135 @@
+// src/service/RouteStateStore.h
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary route state: a snapshot file (fixed header, packed route records,
+// process name table, then since version 3 a count-prefixed block of IPv6
+// records) plus an append-only journal of deltas made since the snapshot.
+// Both carry a generation number; a journal of another generation is
+// ignored on load.
+
+#pragma pack(push, 1)
+struct StateFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t generation;
+    uint32_t gatewayAddress;     // host order
+    uint32_t routeCount;
+    uint32_t nameCount;
+    uint32_t namesBytes;
+    int64_t savedAt;             // seconds since epoch
+};
+
+struct StateRouteRecord {
+    uint32_t address;            // host order
+    uint8_t prefixLength;
+    uint8_t reserved;
+    uint16_t processId;          // index into the snapshot name table
+    int32_t refCount;
+    int64_t createdAt;           // seconds since epoch
+    int64_t lastUsed;            // seconds since epoch, since snapshot version 2
+};
+
+struct StateRoute6Record {
+    uint8_t address[16];         // network order
+    uint8_t prefixLength;
+    uint8_t reserved;
+    uint16_t processId;          // index into the snapshot name table
+    int32_t refCount;
+    int64_t createdAt;           // seconds since epoch
+    int64_t lastUsed;            // seconds since epoch
+};
+
+struct JournalFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t generation;
+};
+
+struct JournalRecord {
+    uint8_t op;
+    uint8_t prefixLength;
+    uint16_t nameLength;         // process name bytes follow the record
+    uint32_t address;            // 0 for IPv6 ops: 16 address bytes follow before the name
+    int64_t createdAt;
+};
+#pragma pack(pop)
+
+struct PersistedRoute {
+    uint32_t address = 0;
+    int prefixLength = 32;
+    std::string processName;
+    int refCount = 1;
+    std::chrono::system_clock::time_point createdAt;
+    std::chrono::system_clock::time_point lastUsed;
+};
+
+struct PersistedRoute6 {
+    std::array<uint8_t, 16> address{};
+    int prefixLength = 128;
+    std::string processName;
+    int refCount = 1;
+    std::chrono::system_clock::time_point createdAt;
+    std::chrono::system_clock::time_point lastUsed;
+};
+
+class RouteStateStore {
+public:
+    // Clear снимает и IPv4, и IPv6
+    enum class JournalOp : uint8_t { Add = 1, Remove = 2, Clear = 3, Add6 = 4, Remove6 = 5 };
+
+    RouteStateStore(std::string snapshotPath, std::string journalPath);
+
+    bool HasState() const;
+
+    // Maps the snapshot, replays the journal on top of it and returns the result
+    bool Load(std::vector<PersistedRoute>& routes, std::vector<PersistedRoute6>& routes6, uint32_t& gatewayAddress);
+
+    // Buffers a delta in memory; it reaches the disk on the next FlushJournal
+    void Append(JournalOp op, uint32_t address, int prefixLength,
+        std::string_view processName = {}, std::chrono::system_clock::time_point createdAt = {});
+    void Append6(JournalOp op, const uint8_t address[16], int prefixLength,
+        std::string_view processName = {}, std::chrono::system_clock::time_point createdAt = {});
+    bool FlushJournal();
+    size_t JournalRecordCount() const { return journalRecords.load(std::memory_order_relaxed); }
+
+    // BeginSnapshot must be called while the caller excludes Append (it drops
+    // buffered deltas that the snapshot already contains). WriteSnapshot may
+    // then run without that lock; it starts an empty journal of the next generation.
+    void BeginSnapshot();
+    bool WriteSnapshot(const std::vector<StateRouteRecord>& records, const std::vector<StateRoute6Record>& records6,
+        const std::vector<std::string>& processNames, uint32_t gatewayAddress);
+
+private:
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x53504D52;  // "RMPS"
+    static constexpr uint32_t JOURNAL_MAGIC = 0x4A504D52;   // "RMPJ"
+    static constexpr uint16_t SNAPSHOT_VERSION = 3;
+    static constexpr uint16_t JOURNAL_VERSION = 2;
+    static constexpr uint16_t SNAPSHOT_V1_RECORD_SIZE = 20;   // без lastUsed
+
+    std::string snapshotPath;
+    std::string journalPath;
+
+    std::mutex journalMutex;           // pendingJournal
+    std::vector<uint8_t> pendingJournal;
+    std::atomic<size_t> journalRecords{ 0 };
+
+    std::mutex fileMutex;              // generation, snapshotPending and file writes
+    uint64_t generation = 0;
+    bool snapshotPending = false;
+    bool journalHeaderWritten = false;
+
+    bool ReplayJournal(uint64_t expectedGeneration, std::vector<PersistedRoute>& routes,
+        std::vector<PersistedRoute6>& routes6);
+    void AppendRecord(const JournalRecord& record, std::span<const uint8_t> address6, std::string_view processName);
+};
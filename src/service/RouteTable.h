@@ -0,0 +1,124 @@
+// src/service/RouteTable.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "RoutePrefixIndex.h"
+#include "StringInterner.h"
+
+// Упакованный ключ маршрута: адрес в старших битах, длина префикса в младшем байте
+using RouteKey = uint64_t;
+
+constexpr RouteKey MakeRouteKey(uint32_t address, int prefixLength) {
+    return (static_cast<uint64_t>(address) << 8) | static_cast<uint8_t>(prefixLength);
+}
+
+constexpr uint32_t RouteKeyAddress(RouteKey key) { return static_cast<uint32_t>(key >> 8); }
+constexpr int RouteKeyPrefix(RouteKey key) { return static_cast<int>(key & 0xFF); }
+
+// Внутреннее представление маршрута. Строки (ip, имя процесса) материализуются
+// только на границе IPC/логирования через RouteController::MaterializeRoute.
+// address/prefixLength/processId не меняются после публикации записи в RouteTableView.
+struct RouteEntry {
+    uint32_t address = 0;
+    uint8_t prefixLength = 32;
+    StringInterner::Id processId = StringInterner::OverflowId;
+    std::atomic<int> refCount{ 1 };
+    std::chrono::system_clock::time_point createdAt = std::chrono::system_clock::now();
+    std::atomic<int64_t> lastUsed{ 0 };     // Секунды от эпохи; обновляется и под shared-блокировкой
+    std::atomic<int64_t> idleTtl{ 0 };      // 0 - общий idle TTL; DNS-маршрут живёт TTL записи + grace, пока им не воспользуется flow
+    std::atomic<bool> removed{ false };     // Запись удалена из таблицы, но может жить в старом view
+    std::atomic<bool> refCountDirty{ false };   // Ключ ждёт в очереди журнала, новый refCount ещё не записан
+};
+
+// Immutable copy of the route table, published RCU-style: readers take the
+// current view with one atomic load and never wait on routesMutex. Entries are
+// shared with the live table, so refCount/lastUsed touched through a view land
+// on the real route; a route removed after publication has 'removed' set.
+class RouteTableView {
+public:
+    using EntryPtr = std::shared_ptr<RouteEntry>;
+    using NameTable = std::shared_ptr<const std::vector<std::string>>;
+
+    RouteTableView() = default;
+
+    // 'entries' must be sorted by key
+    RouteTableView(uint64_t version, std::vector<std::pair<RouteKey, EntryPtr>> entries, NameTable names)
+        : version(version), names(std::move(names)) {
+        keys.reserve(entries.size());
+        routes.reserve(entries.size());
+        for (auto& [key, entry] : entries) {
+            keys.push_back(key);
+            routes.push_back(std::move(entry));
+            presentLengths |= (1ull << RouteKeyPrefix(key));
+        }
+    }
+
+    uint64_t Version() const { return version; }
+    size_t Size() const { return keys.size(); }
+    std::span<const RouteKey> Keys() const { return keys; }
+    std::span<const EntryPtr> Entries() const { return routes; }
+
+    RouteEntry* Find(RouteKey key) const {
+        auto it = std::ranges::lower_bound(keys, key);
+        if (it == keys.end() || *it != key) return nullptr;
+        return routes[it - keys.begin()].get();
+    }
+
+    // Longest published prefix strictly shorter than 'shorterThan' covering 'address'
+    RouteEntry* FindCovering(uint32_t address, int shorterThan = 33) const {
+        uint64_t candidates = presentLengths;
+        if (shorterThan <= 0) return nullptr;
+        if (shorterThan < 64) {
+            candidates &= (1ull << shorterThan) - 1;
+        }
+
+        while (candidates) {
+            int prefixLength = 63 - std::countl_zero(candidates);
+            if (RouteEntry* entry = Find(MakeRouteKey(address & RoutePrefixIndex::MaskFor(prefixLength), prefixLength))) {
+                return entry;
+            }
+            candidates &= ~(1ull << prefixLength);
+        }
+        return nullptr;
+    }
+
+    const std::string& ProcessName(StringInterner::Id id) const {
+        static const std::string unknown = "Unknown";
+        return names && id < names->size() ? (*names)[id] : unknown;
+    }
+
+private:
+    uint64_t version = 0;
+    std::vector<RouteKey> keys;
+    std::vector<EntryPtr> routes;       // Параллельно keys
+    uint64_t presentLengths = 0;
+    NameTable names;
+};
+
+// IPv6-маршруты живут в отдельной таблице RouteController под своей блокировкой
+struct Route6Key {
+    Ipv6Address address;            // Уже замаскирован по prefixLength
+    uint8_t prefixLength = 128;
+
+    bool operator==(const Route6Key&) const = default;
+};
+
+struct Route6KeyHash {
+    size_t operator()(const Route6Key& key) const {
+        return Ipv6AddressHash{}(key.address) ^ (static_cast<size_t>(key.prefixLength) * 0x9E3779B9u);
+    }
+};
+
+struct Route6Entry {
+    StringInterner::Id processId = StringInterner::OverflowId;
+    int refCount = 1;
+    std::chrono::system_clock::time_point createdAt = std::chrono::system_clock::now();
+    int64_t lastUsed = 0;           // Секунды от эпохи
+};
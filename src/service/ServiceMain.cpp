@@ -8,17 +8,70 @@
 #include "Watchdog.h"
 #include "ConfigManager.h"
 #include "DnsProxy.h"
+#include "GatewayProber.h"
+#include "PerfEtwProvider.h"
+#include "PerformanceMonitor.h"
+#include "PipeServer.h"
+#include "StatusPublisher.h"
 #include "StartupManager.h"
+#include "TrafficCapture.h"
 #include "../common/Constants.h"
 #include "../common/IPCProtocol.h"
 #include "../common/Logger.h"
 #include "../common/ShutdownCoordinator.h"
+#include <algorithm>
 #include <thread>
 #include <format>
 
 HANDLE ServiceMain::stopEvent = nullptr;
 
-ServiceMain::ServiceMain() : running(false), pipeThread(nullptr) {
+// Очистка и оптимизация идут на отдельном потоке заданий и отвечают по завершении;
+// подписка на маршруты остаётся открытой до отключения клиента
+static PipeServer::Mode ClassifyRequest(IPCMessageType type) {
+    switch (type) {
+    case IPCMessageType::ClearRoutes:
+    case IPCMessageType::OptimizeRoutes:
+    case IPCMessageType::CleanupRedundantRoutes:
+    case IPCMessageType::SetAIPreload:      // Первое включение компилирует preload_ips.json
+        return PipeServer::Mode::Job;
+    case IPCMessageType::SubscribeRoutes:
+        return PipeServer::Mode::Subscribe;
+    default:
+        return PipeServer::Mode::Inline;
+    }
+}
+
+// Отчёт PerformanceMonitor в виде для IPC, имена по алфавиту: строки панели не прыгают
+static PerfReportData BuildPerfReport() {
+    auto report = PerformanceMonitor::Instance().GetReport();
+
+    PerfReportData data;
+    data.uptimeMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+
+    data.counters.assign(report.counters.begin(), report.counters.end());
+    std::ranges::sort(data.counters);
+    data.gauges.assign(report.gauges.begin(), report.gauges.end());
+    std::ranges::sort(data.gauges);
+
+    data.timers.reserve(report.operations.size());
+    for (const auto& op : report.operations) {
+        PerfTimerSample timer;
+        timer.name = op.name;
+        timer.count = op.count;
+        timer.avgUs = static_cast<uint64_t>(op.avgTime.count());
+        timer.p50Us = static_cast<uint64_t>(op.p50Time.count());
+        timer.p99Us = static_cast<uint64_t>(op.p99Time.count());
+        timer.p999Us = static_cast<uint64_t>(op.p999Time.count());
+        timer.maxUs = static_cast<uint64_t>(op.maxTime.count());
+        data.timers.push_back(std::move(timer));
+    }
+    std::ranges::sort(data.timers, {}, &PerfTimerSample::name);
+
+    return data;
+}
+
+ServiceMain::ServiceMain() : running(false) {
     Logger::Instance().Debug("ServiceMain::ServiceMain() - Constructor called");
 }
 
@@ -54,26 +107,54 @@ void ServiceMain::StartDirect() {
         Logger::Instance().Debug("Step 2: Creating RouteController");
         routeController = std::make_unique<RouteController>(config);
 
-        Logger::Instance().Debug("Step 3: Routes loaded from disk in constructor");
-
-        Logger::Instance().Info("Step 4: Syncing with system routing table");
-        routeController->SyncWithSystemTable();
-
-        Logger::Instance().Info("Step 5: Performing smart cleanup of redundant routes");
-        routeController->PerformFullCleanup();
+        // Сохранённые маршруты восстанавливаются в фоне, синхронизация и очистка — по его завершении
+        Logger::Instance().Debug("Step 3: Persisted routes are being restored in background");
 
         Logger::Instance().Debug("Step 6: Creating ProcessManager");
         processManager = std::make_unique<ProcessManager>(config);
 
         Logger::Instance().Debug("Step 7: Creating NetworkMonitor");
         networkMonitor = std::make_unique<NetworkMonitor>(
-            routeController.get(), processManager.get());
+            routeController.get(), processManager.get(), config.monitorSettings);
 
         Logger::Instance().Debug("Step 8: Creating DnsProxy");
-        dnsProxy = std::make_unique<DnsProxy>(processManager.get(), routeController.get());
+        dnsProxy = std::make_unique<DnsProxy>(processManager.get(), routeController.get(), config.dnsProxySettings);
 
         Logger::Instance().Debug("Step 9: Creating Watchdog");
-        watchdog = std::make_unique<Watchdog>(this);
+        watchdog = std::make_unique<Watchdog>(this, config.memoryBudgets);
+        // Watchdog останавливается первым, поэтому подсистемы переживают все вызовы
+        RouteController* routes = routeController.get();
+        watchdog->RegisterSubsystem(MemorySubsystem::Routes,
+            [routes] { return routes->GetMemoryBytes(); },
+            [routes](MemoryPressure pressure) { routes->TrimMemory(pressure); });
+        watchdog->RegisterSubsystem(MemorySubsystem::Optimizer,
+            [routes] { return routes->GetOptimizerMemoryBytes(); },
+            [routes](MemoryPressure) { routes->ReleaseOptimizerMemory(); });
+        NetworkMonitor* monitor = networkMonitor.get();
+        watchdog->RegisterSubsystem(MemorySubsystem::Flows,
+            [monitor] { return monitor->GetMemoryBytes(); },
+            [monitor](MemoryPressure pressure) { monitor->TrimMemory(pressure); });
+        ProcessManager* processes = processManager.get();
+        watchdog->RegisterSubsystem(MemorySubsystem::ProcessCaches,
+            [processes] { return processes->GetCacheMemoryBytes(); },
+            [processes](MemoryPressure pressure) { processes->TrimCaches(pressure); });
+        DnsProxy* dns = dnsProxy.get();
+        watchdog->RegisterSubsystem(MemorySubsystem::Dns,
+            [dns] { return dns->GetMemoryBytes(); },
+            [dns](MemoryPressure pressure) { dns->TrimMemory(pressure); });
+        watchdog->RegisterSubsystem(MemorySubsystem::Logger,
+            [] { return Logger::Instance().MemoryBytes(); });
+
+        // Пробер шлюзов живёт меньше RouteController и ProcessManager, указатели в callback'ах безопасны
+        gatewayProber = std::make_unique<GatewayProber>(config.gatewayIp, config.gatewaySettings,
+            [routes](const std::string& gatewayIp) { routes->SwitchGateway(gatewayIp); },
+            [processes] { return processes->GetAllProcesses(); });
+
+        // Запись включается до приёма, чтобы в файл попали первые события после старта
+        if (config.captureSettings.enabled) {
+            TrafficCapture::Instance().Start(config.captureSettings.path,
+                static_cast<uint64_t>((std::max)(config.captureSettings.maxMB, 0)) << 20);
+        }
 
         Logger::Instance().Debug("Step 10: Starting NetworkMonitor");
         networkMonitor->Start();
@@ -83,11 +164,35 @@ void ServiceMain::StartDirect() {
             dnsProxy->Start();
         }
 
-        Logger::Instance().Debug("Step 12: Starting Watchdog");
+        Logger::Instance().Debug("Step 12: Starting Watchdog and gateway prober");
         watchdog->Start();
+        if (!gatewayProber->Start()) {
+            Logger::Instance().Warning("ServiceMain::StartDirect - Gateway probing unavailable, staying on the primary gateway");
+        }
+
+        perfEtwProvider = std::make_unique<PerfEtwProvider>();
+        perfEtwProvider->Start();
+
+        Logger::Instance().Debug("Step 13: Starting pipe server");
+        pipeServer = std::make_unique<PipeServer>(
+            [this](const IPCMessage& message) { return HandleRequest(message); }, &ClassifyRequest);
+        if (!pipeServer->Start()) {
+            Logger::Instance().Error("ServiceMain::StartDirect - Pipe server failed to start, UI will not connect");
+        }
+
+        Logger::Instance().Debug("Step 14: Publishing status section");
+        statusPublisher = std::make_unique<StatusPublisher>(this, routeController.get());
+        if (!statusPublisher->Start()) {
+            Logger::Instance().Warning("ServiceMain::StartDirect - Status section unavailable, UI will poll the pipe");
+            statusPublisher.reset();
+        }
 
-        Logger::Instance().Debug("Step 13: Creating pipe server thread");
-        pipeThread = CreateThread(nullptr, 0, PipeServerThread, this, 0, nullptr);
+        routeController->SetChangeListener([server = pipeServer.get(), publisher = statusPublisher.get()](uint64_t sequence) {
+            if (publisher) {
+                publisher->RequestPublish();
+            }
+            server->Publish(IPCMessageType::SubscribeRoutes, IPCSerializer::SerializeSequence(sequence));
+            });
 
         running = true;
         Logger::Instance().Info("=== Service initialization completed ===");
@@ -130,27 +235,25 @@ void ServiceMain::StopDirect() {
     }
 
     try {
-        if (pipeThread) {
-            Logger::Instance().Info("Stopping pipe server thread");
-            HANDLE tempPipe = CreateFileA(
-                Constants::PIPE_NAME.c_str(),
-                GENERIC_READ | GENERIC_WRITE,
-                0, nullptr, OPEN_EXISTING, 0, nullptr
-            );
-            if (tempPipe != INVALID_HANDLE_VALUE) {
-                CloseHandle(tempPipe);
-            }
+        if (routeController) {
+            routeController->SetChangeListener(nullptr);
+        }
 
-            DWORD result = WaitForSingleObject(pipeThread, 3000);
-            if (result == WAIT_TIMEOUT) {
-                Logger::Instance().Warning("Pipe thread did not exit in time, terminating");
-                TerminateThread(pipeThread, 1);
-            }
-            else {
-                Logger::Instance().Debug("Pipe thread stopped successfully");
-            }
-            CloseHandle(pipeThread);
-            pipeThread = nullptr;
+        if (statusPublisher) {
+            Logger::Instance().Info("Stopping status publisher");
+            statusPublisher->Stop();
+            statusPublisher.reset();
+        }
+
+        if (pipeServer) {
+            Logger::Instance().Info("Stopping pipe server");
+            pipeServer->Stop();
+            pipeServer.reset();
+        }
+
+        if (perfEtwProvider) {
+            perfEtwProvider->Stop();
+            perfEtwProvider.reset();
         }
 
         if (watchdog) {
@@ -161,6 +264,12 @@ void ServiceMain::StopDirect() {
             Logger::Instance().Debug("Watchdog destroyed successfully");
         }
 
+        if (gatewayProber) {
+            Logger::Instance().Info("Stopping gateway prober");
+            gatewayProber->Stop();
+            gatewayProber.reset();
+        }
+
         if (dnsProxy) {
             Logger::Instance().Info("Stopping DnsProxy");
             dnsProxy->Stop();
@@ -176,6 +285,9 @@ void ServiceMain::StopDirect() {
             Logger::Instance().Debug("NetworkMonitor destroyed successfully");
         }
 
+        // Источники записи остановлены - дописываем буфер и закрываем файл
+        TrafficCapture::Instance().Stop();
+
         if (processManager) {
             Logger::Instance().Info("Destroying ProcessManager");
             processManager.reset();
@@ -213,251 +325,235 @@ void ServiceMain::StopDirect() {
     Logger::Instance().Info("ServiceMain::StopDirect - Completed");
 }
 
-DWORD WINAPI ServiceMain::PipeServerThread(LPVOID param) {
-    ServiceMain* service = static_cast<ServiceMain*>(param);
-    Logger::Instance().Info("PipeServerThread: Starting pipe server");
-
-    OVERLAPPED overlapped = { 0 };
-    overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-
-    while (service->running && !ShutdownCoordinator::Instance().isShuttingDown) {
-        Logger::Instance().Debug("PipeServerThread: Creating named pipe");
-
-        HANDLE pipe = CreateNamedPipeA(
-            Constants::PIPE_NAME.c_str(),
-            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
-            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
-            PIPE_UNLIMITED_INSTANCES,
-            4096,
-            4096,
-            0,
-            nullptr
-        );
-
-        if (pipe == INVALID_HANDLE_VALUE) {
-            Logger::Instance().Error(std::format("PipeServerThread: Failed to create pipe: {}", ::GetLastError()));
-            Sleep(1000);
-            continue;
-        }
+ServiceStatus ServiceMain::CollectStatus() const {
+    ServiceStatus status;
+    status.isRunning = running;
+    status.monitorActive = networkMonitor && networkMonitor->IsActive();
+    status.activeRoutes = routeController ? routeController->GetRouteCount() : 0;
+    status.memoryUsageMB = watchdog ? watchdog->GetMemoryUsageMB() : 0;
+    status.uptime = watchdog ? watchdog->GetUptime() : std::chrono::seconds(0);
+    if (routeController) {
+        auto progress = routeController->GetRestoreProgress();
+        status.routesRestored = progress.complete;
+        status.restoreTotal = progress.total;
+        status.restoreDone = progress.done;
+
+        auto plan = routeController->GetLastPlanStats();
+        status.lastPlanAggregates = plan.aggregatesApplied;
+        status.lastPlanRolledBack = plan.aggregatesFailed;
+        status.lastPlanRoutesRetired = plan.routesRetired;
+        status.lastPlanFailures = plan.failures;
+        status.lastPlanDurationMs = plan.duration.count();
+        status.lastPlanSyscalls = plan.syscalls;
+
+        auto migration = routeController->GetMigrationProgress();
+        status.migrationActive = migration.active;
+        status.configGeneration = migration.generation;
+        status.migrationTotal = migration.total;
+        status.migrationDone = migration.done;
+        status.migrationFailed = migration.failed;
+        status.migrationDurationMs = migration.duration.count();
+    }
+    return status;
+}
 
-        BOOL connected = ConnectNamedPipe(pipe, &overlapped);
-        if (!connected && ::GetLastError() == ERROR_IO_PENDING) {
-            HANDLE waitHandles[] = { overlapped.hEvent, ShutdownCoordinator::Instance().shutdownEvent };
-            DWORD waitResult = WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE);
+// Вызывается параллельно из потоков PipeServer; исключения ловит PipeServer
+IPCResponse ServiceMain::HandleRequest(const IPCMessage& message) {
+    IPCResponse response;
+    response.success = true;
 
-            if (waitResult == WAIT_OBJECT_0) {
-                DWORD bytesTransferred;
-                if (GetOverlappedResult(pipe, &overlapped, &bytesTransferred, FALSE)) {
-                    Logger::Instance().Debug("Client connected");
-                    service->HandlePipeClient(pipe);
-                }
-            }
-            else if (waitResult == WAIT_OBJECT_0 + 1) {
-                Logger::Instance().Info("PipeServerThread: Shutdown requested");
-                CancelIo(pipe);
-                CloseHandle(pipe);
-                break;
-            }
-        }
-        else if (connected) {
-            service->HandlePipeClient(pipe);
-        }
+    switch (message.type) {
+    case IPCMessageType::GetStatus:
+        response.data = IPCSerializer::SerializeServiceStatus(CollectStatus());
+        break;
 
-        CloseHandle(pipe);
+    case IPCMessageType::GetConfig: {
+        auto config = configManager->GetConfig();
+        response.data = IPCSerializer::SerializeServiceConfig(config);
+        break;
     }
 
-    CloseHandle(overlapped.hEvent);
-    Logger::Instance().Info("PipeServerThread: Exiting");
-    return 0;
-}
+    case IPCMessageType::SetConfig: {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        auto newConfig = IPCSerializer::DeserializeServiceConfig(message.data);
+        auto oldConfig = configManager->GetConfig();
+        newConfig.monitorSettings = oldConfig.monitorSettings;  // Не передаётся через IPC
+        newConfig.dnsProxySettings = oldConfig.dnsProxySettings;
+        newConfig.memoryBudgets = oldConfig.memoryBudgets;
+        newConfig.captureSettings = oldConfig.captureSettings;
+        newConfig.gatewaySettings = oldConfig.gatewaySettings;
+        newConfig.preloadServiceOverrides = oldConfig.preloadServiceOverrides;
 
-void ServiceMain::HandlePipeClient(HANDLE pipe) {
-    Logger::Instance().Debug("ServiceMain::HandlePipeClient - Starting");
+        configManager->SetConfig(newConfig);
 
-    while (running && !ShutdownCoordinator::Instance().isShuttingDown) {
-        DWORD bytesRead;
-        std::vector<uint8_t> buffer(4096);
-
-        if (!ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, nullptr)) {
-            DWORD error = ::GetLastError();
-            if (error != ERROR_BROKEN_PIPE) {
-                Logger::Instance().Debug(std::format("HandlePipeClient: ReadFile failed: {}", error));
-            }
-            break;
+        if (routeController) {
+            routeController->UpdateConfig(newConfig);
         }
 
-        if (bytesRead < sizeof(IPCMessageType)) {
-            continue;
+        if (gatewayProber && oldConfig.gatewayIp != newConfig.gatewayIp) {
+            gatewayProber->UpdateConfig(newConfig.gatewayIp, newConfig.gatewaySettings);
         }
 
-        IPCMessageType msgType = *reinterpret_cast<IPCMessageType*>(buffer.data());
-        std::vector<uint8_t> msgData(buffer.begin() + sizeof(IPCMessageType),
-            buffer.begin() + bytesRead);
-
-        IPCResponse response;
-        response.success = true;
-
-        try {
-            switch (msgType) {
-            case IPCMessageType::GetStatus: {
-                ServiceStatus status;
-                status.isRunning = running;
-                status.monitorActive = networkMonitor && networkMonitor->IsActive();
-                status.activeRoutes = routeController ? routeController->GetRouteCount() : 0;
-                status.memoryUsageMB = watchdog ? watchdog->GetMemoryUsageMB() : 0;
-                status.uptime = watchdog ? watchdog->GetUptime() : std::chrono::seconds(0);
-                response.data = IPCSerializer::SerializeServiceStatus(status);
-                break;
-            }
-
-            case IPCMessageType::GetConfig: {
-                auto config = configManager->GetConfig();
-                response.data = IPCSerializer::SerializeServiceConfig(config);
-                break;
-            }
-
-            case IPCMessageType::SetConfig: {
-                auto newConfig = IPCSerializer::DeserializeServiceConfig(msgData);
-                auto oldConfig = configManager->GetConfig();
+        if (processManager && oldConfig.selectedProcesses != newConfig.selectedProcesses) {
+            processManager->SetSelectedProcesses(newConfig.selectedProcesses);
+        }
 
-                configManager->SetConfig(newConfig);
+        if (oldConfig.startWithWindows != newConfig.startWithWindows) {
+            StartupManager::SetStartWithWindows(newConfig.startWithWindows);
+        }
 
-                if (routeController) {
-                    routeController->UpdateConfig(newConfig);
-                }
+        break;
+    }
 
-                if (processManager && oldConfig.selectedProcesses != newConfig.selectedProcesses) {
-                    processManager->SetSelectedProcesses(newConfig.selectedProcesses);
-                }
+    case IPCMessageType::GetProcesses: {
+        auto processes = processManager->GetAllProcesses();
+        response.data = IPCSerializer::SerializeProcessList(processes);
+        break;
+    }
 
-                if (oldConfig.startWithWindows != newConfig.startWithWindows) {
-                    StartupManager::SetStartWithWindows(newConfig.startWithWindows);
-                }
+    case IPCMessageType::GetProcessChangesSince: {
+        uint64_t since = IPCSerializer::DeserializeSequence(message.data);
+        response.data = IPCSerializer::SerializeProcessChanges(processManager->GetProcessChangesSince(since));
+        break;
+    }
 
-                break;
-            }
+    case IPCMessageType::GetMemoryReport:
+        if (!watchdog) {
+            response.success = false;
+            response.error = "Watchdog not running";
+            break;
+        }
+        response.data = IPCSerializer::SerializeMemoryReport(watchdog->GetMemoryReport());
+        break;
 
-            case IPCMessageType::GetProcesses: {
-                auto processes = processManager->GetAllProcesses();
-                response.data = IPCSerializer::SerializeProcessList(processes);
-                break;
-            }
+    case IPCMessageType::SetSelectedProcesses: {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        auto processes = IPCSerializer::DeserializeStringList(message.data);
+        processManager->SetSelectedProcesses(processes);
+        auto config = configManager->GetConfig();
+        config.selectedProcesses = processes;
+        configManager->SetConfig(config);
+        break;
+    }
 
-            case IPCMessageType::SetSelectedProcesses: {
-                auto processes = IPCSerializer::DeserializeStringList(msgData);
-                processManager->SetSelectedProcesses(processes);
-                auto config = configManager->GetConfig();
-                config.selectedProcesses = processes;
-                configManager->SetConfig(config);
-                break;
-            }
+    case IPCMessageType::GetRoutes: {
+        auto routes = routeController->GetActiveRoutes();
+        response.data = IPCSerializer::SerializeRouteList(routes);
+        break;
+    }
 
-            case IPCMessageType::GetRoutes: {
-                auto routes = routeController->GetActiveRoutes();
-                response.data = IPCSerializer::SerializeRouteList(routes);
-                break;
-            }
+    case IPCMessageType::SubscribeRoutes:
+        // Первый ответ - текущий номер; дальше PipeServer шлёт номера после каждой пачки изменений
+        response.data = IPCSerializer::SerializeSequence(routeController->GetRouteChangeSequence());
+        break;
 
-            case IPCMessageType::ClearRoutes: {
-                routeController->CleanupAllRoutes();
-                auto currentConfig = configManager->GetConfig();
-                auto routeConfig = routeController->GetConfig();
-                if (currentConfig.aiPreloadEnabled && !routeConfig.aiPreloadEnabled) {
-                    currentConfig.aiPreloadEnabled = false;
-                    configManager->SetConfig(currentConfig);
-                    Logger::Instance().Info("ServiceMain: Disabled AI preload in config after route cleanup");
-                }
-                break;
-            }
+    case IPCMessageType::GetRouteChangesSince: {
+        uint64_t since = IPCSerializer::DeserializeSequence(message.data);
+        response.data = IPCSerializer::SerializeRouteChanges(routeController->GetRouteChangesSince(since));
+        break;
+    }
 
-            case IPCMessageType::SetAIPreload: {
-                if (!msgData.empty()) {
-                    bool enabled = msgData[0] != 0;
-                    configManager->SetAIPreloadEnabled(enabled);
-                    if (enabled && routeController) {
-                        routeController->PreloadAIRoutes();
-                    }
-                }
-                break;
-            }
+    case IPCMessageType::ClearRoutes: {
+        routeController->CleanupAllRoutes();
+        std::lock_guard<std::mutex> lock(commandMutex);
+        auto currentConfig = configManager->GetConfig();
+        auto routeConfig = routeController->GetConfig();
+        if (currentConfig.aiPreloadEnabled && !routeConfig.aiPreloadEnabled) {
+            currentConfig.aiPreloadEnabled = false;
+            configManager->SetConfig(currentConfig);
+            Logger::Instance().Info("ServiceMain: Disabled AI preload in config after route cleanup");
+        }
+        break;
+    }
 
-            case IPCMessageType::OptimizeRoutes: {
-                if (routeController) {
-                    routeController->RunOptimizationManual();
+    case IPCMessageType::SetAIPreload: {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        if (!message.data.empty()) {
+            bool enabled = message.data[0] != 0;
+            configManager->SetAIPreloadEnabled(enabled);
+            // Обе операции только ставят работу в очередь программирования
+            if (routeController) {
+                if (enabled) {
+                    routeController->PreloadAIRoutes();
                 }
-                break;
-            }
-
-            case IPCMessageType::CleanupRedundantRoutes: {
-                if (routeController) {
-                    routeController->CleanupRedundantRoutes();
+                else {
+                    routeController->RemovePreloadRoutes();
                 }
-                break;
             }
+        }
+        break;
+    }
 
-            case IPCMessageType::SetDnsProxy: {
-                if (!msgData.empty()) {
-                    bool enabled = msgData[0] != 0;
-                    configManager->SetDnsProxyEnabled(enabled);
-                    if (dnsProxy) {
-                        if (enabled && !dnsProxy->IsActive()) {
-                            dnsProxy->Start();
-                            if (dnsProxy->IsActive()) {
-                                Logger::Instance().Info("ServiceMain: DNS proxy started via IPC");
-                            } else {
-                                Logger::Instance().Error("ServiceMain: DNS proxy failed to start via IPC");
-                            }
-                        }
-                        else if (!enabled && dnsProxy->IsActive()) {
-                            dnsProxy->Stop();
-                            Logger::Instance().Info("ServiceMain: DNS proxy stopped via IPC");
-                        }
-                    }
-                }
-                break;
-            }
+    case IPCMessageType::GetPreloadStatus:
+        response.data = IPCSerializer::SerializePreloadStatus(routeController->GetPreloadStatus());
+        break;
 
-            default:
-                response.success = false;
-                response.error = "Unknown message type";
-                break;
-            }
-        }
-        catch (const std::exception& e) {
-            Logger::Instance().Error(std::format("HandlePipeClient: Exception processing message: {}", e.what()));
+    case IPCMessageType::SetPreloadService: {
+        std::string service;
+        bool enabled = false;
+        if (!IPCSerializer::DeserializePreloadService(message.data, service, enabled)) {
             response.success = false;
-            response.error = e.what();
+            response.error = "Invalid preload service request";
+            break;
         }
 
-        std::vector<uint8_t> responseBuffer;
-        responseBuffer.resize(sizeof(bool) + sizeof(size_t) + response.data.size() +
-            sizeof(size_t) + response.error.size());
-
-        size_t offset = 0;
-        memcpy(responseBuffer.data() + offset, &response.success, sizeof(bool));
-        offset += sizeof(bool);
-
-        size_t dataSize = response.data.size();
-        memcpy(responseBuffer.data() + offset, &dataSize, sizeof(size_t));
-        offset += sizeof(size_t);
+        std::lock_guard<std::mutex> lock(commandMutex);
+        if (!routeController->SetPreloadServiceEnabled(service, enabled)) {
+            response.success = false;
+            response.error = std::format("Unknown preload service: {}", service);
+            break;
+        }
+        configManager->SetPreloadServiceEnabled(service, enabled);
+        break;
+    }
 
-        if (dataSize > 0) {
-            memcpy(responseBuffer.data() + offset, response.data.data(), dataSize);
-            offset += dataSize;
+    case IPCMessageType::OptimizeRoutes: {
+        if (routeController) {
+            routeController->RunOptimizationManual();
         }
+        break;
+    }
 
-        size_t errorSize = response.error.size();
-        memcpy(responseBuffer.data() + offset, &errorSize, sizeof(size_t));
-        offset += sizeof(size_t);
+    case IPCMessageType::CleanupRedundantRoutes: {
+        if (routeController) {
+            routeController->CleanupRedundantRoutes();
+        }
+        break;
+    }
 
-        if (errorSize > 0) {
-            memcpy(responseBuffer.data() + offset, response.error.data(), errorSize);
+    case IPCMessageType::SetDnsProxy: {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        if (!message.data.empty()) {
+            bool enabled = message.data[0] != 0;
+            configManager->SetDnsProxyEnabled(enabled);
+            if (dnsProxy) {
+                if (enabled && !dnsProxy->IsActive()) {
+                    dnsProxy->Start();
+                    if (dnsProxy->IsActive()) {
+                        Logger::Instance().Info("ServiceMain: DNS proxy started via IPC");
+                    } else {
+                        Logger::Instance().Error("ServiceMain: DNS proxy failed to start via IPC");
+                    }
+                }
+                else if (!enabled && dnsProxy->IsActive()) {
+                    dnsProxy->Stop();
+                    Logger::Instance().Info("ServiceMain: DNS proxy stopped via IPC");
+                }
+            }
         }
+        break;
+    }
 
-        DWORD bytesWritten;
-        WriteFile(pipe, responseBuffer.data(), static_cast<DWORD>(responseBuffer.size()),
-            &bytesWritten, nullptr);
+    case IPCMessageType::GetPerfReport: {
+        response.data = IPCSerializer::SerializePerfReport(BuildPerfReport());
+        break;
     }
 
-    Logger::Instance().Debug("ServiceMain::HandlePipeClient - Exiting");
-}
\ No newline at end of file
+    default:
+        response.success = false;
+        response.error = "Unknown message type";
+        break;
+    }
+
+    return response;
+}
@@ -3,6 +3,8 @@
 #include <windows.h>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include "../common/IPCProtocol.h"
 
 class NetworkMonitor;
 class RouteController;
@@ -10,6 +12,10 @@ class ProcessManager;
 class Watchdog;
 class ConfigManager;
 class DnsProxy;
+class GatewayProber;
+class PerfEtwProvider;
+class PipeServer;
+class StatusPublisher;
 
 class ServiceMain {
 public:
@@ -19,6 +25,9 @@ public:
     void StartDirect();
     void StopDirect();
 
+    // Снимок состояния для GetStatus и секции общей памяти
+    ServiceStatus CollectStatus() const;
+
 private:
     static HANDLE stopEvent;
 
@@ -28,10 +37,13 @@ private:
     std::unique_ptr<Watchdog> watchdog;
     std::unique_ptr<ConfigManager> configManager;
     std::unique_ptr<DnsProxy> dnsProxy;
+    std::unique_ptr<GatewayProber> gatewayProber;
+    std::unique_ptr<PerfEtwProvider> perfEtwProvider;
+    std::unique_ptr<PipeServer> pipeServer;
+    std::unique_ptr<StatusPublisher> statusPublisher;
 
     std::atomic<bool> running;
-    HANDLE pipeThread;
+    std::mutex commandMutex;        // Запросы разных клиентов, меняющие конфигурацию, по одному
 
-    static DWORD WINAPI PipeServerThread(LPVOID param);
-    void HandlePipeClient(HANDLE pipe);
+    IPCResponse HandleRequest(const IPCMessage& message);
 };
\ No newline at end of file
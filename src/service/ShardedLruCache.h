@@ -0,0 +1,334 @@
+// src/service/ShardedLruCache.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
+// Concurrent bounded cache with CLOCK (second-chance) eviction. Capacity is
+// split across lock shards; each shard owns a node pool allocated once in the
+// constructor and an open-addressing index into it, so neither hits nor
+// misses allocate (only the key/value copies on Put do). A hit takes the
+// shard's shared lock, sets the node's reference bit and hands the value to
+// the caller in place; the clock hand of a full shard skips referenced nodes
+// once before evicting. Visit() callbacks run under the shared lock and must
+// not re-enter the cache.
+template<typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<>>
+class ShardedLruCache {
+public:
+    struct Stats {
+        size_t size = 0;
+        size_t capacity = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    explicit ShardedLruCache(size_t capacity, size_t shardCount = 16)
+        : shardMask(std::bit_ceil((std::max)(shardCount, size_t{ 1 })) - 1),
+        shards(std::make_unique<Shard[]>(shardMask + 1)) {
+        size_t perShard = (std::max)((capacity + shardMask) / (shardMask + 1), size_t{ 1 });
+        for (size_t i = 0; i <= shardMask; i++) {
+            shards[i].Init(perShard);
+        }
+    }
+
+    ShardedLruCache(const ShardedLruCache&) = delete;
+    ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+    // fn(const V&) on a hit, without copying the value
+    template<typename Key, typename Fn>
+        requires std::invocable<Fn, const V&>
+    bool Visit(const Key& key, Fn&& fn) const {
+        size_t hash = Hash{}(key);
+        const Shard& shard = ShardFor(hash);
+
+        std::shared_lock lock(shard.mutex);
+        uint32_t index = shard.Find(key, hash);
+        if (index == Shard::NONE) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const Node& node = shard.nodes[index];
+        if (node.referenced.load(std::memory_order_relaxed) == 0) {
+            node.referenced.store(1, std::memory_order_relaxed);
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        std::invoke(fn, node.value);
+        return true;
+    }
+
+    template<typename Key>
+    std::optional<V> Get(const Key& key) const {
+        std::optional<V> result;
+        Visit(key, [&result](const V& value) { result = value; });
+        return result;
+    }
+
+    void Put(const K& key, V value) {
+        size_t hash = Hash{}(key);
+        Shard& shard = ShardFor(hash);
+
+        std::unique_lock lock(shard.mutex);
+        uint32_t index = shard.Find(key, hash);
+        if (index != Shard::NONE) {
+            shard.nodes[index].value = std::move(value);
+            shard.nodes[index].referenced.store(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (shard.NeedsEviction()) {
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.Insert(key, hash, std::move(value));
+    }
+
+    template<typename Key>
+    bool Erase(const Key& key) {
+        size_t hash = Hash{}(key);
+        Shard& shard = ShardFor(hash);
+
+        std::unique_lock lock(shard.mutex);
+        return shard.Erase(key, hash);
+    }
+
+    void Clear() {
+        for (size_t i = 0; i <= shardMask; i++) {
+            std::unique_lock lock(shards[i].mutex);
+            shards[i].Clear();
+        }
+    }
+
+    // Вытесняет узлы CLOCK-ом, пока в кэше не останется targetSize записей. Пул
+    // узлов не уменьшается: освобождаются ключи и значения, которые держат кучу
+    size_t Shrink(size_t targetSize) {
+        size_t perShard = targetSize / (shardMask + 1);
+        size_t released = 0;
+        for (size_t i = 0; i <= shardMask; i++) {
+            std::unique_lock lock(shards[i].mutex);
+            released += shards[i].ShrinkTo(perShard);
+        }
+        evictions.fetch_add(released, std::memory_order_relaxed);
+        return released;
+    }
+
+    // Пул узлов и индексы шардов; куча внутри ключей и значений не учитывается
+    size_t MemoryBytes() const {
+        size_t total = 0;
+        for (size_t i = 0; i <= shardMask; i++) {
+            total += sizeof(Shard) + shards[i].capacity * sizeof(Node) +
+                shards[i].index.capacity() * sizeof(uint32_t) + shards[i].freeNodes.capacity() * sizeof(uint32_t);
+        }
+        return total;
+    }
+
+    size_t Size() const {
+        size_t total = 0;
+        for (size_t i = 0; i <= shardMask; i++) {
+            std::shared_lock lock(shards[i].mutex);
+            total += shards[i].count;
+        }
+        return total;
+    }
+
+    template<typename Func>
+        requires std::invocable<Func, const K&, const V&>
+    void ForEach(Func func) const {
+        for (size_t i = 0; i <= shardMask; i++) {
+            std::shared_lock lock(shards[i].mutex);
+            for (const Node& node : shards[i].Nodes()) {
+                if (node.used) func(node.key, node.value);
+            }
+        }
+    }
+
+    Stats GetStats() const {
+        Stats stats;
+        stats.size = Size();
+        for (size_t i = 0; i <= shardMask; i++) {
+            stats.capacity += shards[i].capacity;
+        }
+        stats.hits = hits.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.evictions = evictions.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Node {
+        K key{};
+        V value{};
+        size_t hash = 0;
+        bool used = false;
+        mutable std::atomic<uint8_t> referenced{ 0 };   // Пишется и под shared-блокировкой
+    };
+
+    struct alignas(64) Shard {
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        mutable std::shared_mutex mutex;
+        std::unique_ptr<Node[]> nodes;
+        std::vector<uint32_t> index;        // Индекс узла + 1, 0 - пусто; linear probing
+        size_t indexMask = 0;
+        size_t capacity = 0;
+        size_t count = 0;
+        size_t hand = 0;                    // Стрелка CLOCK
+        size_t nextFresh = 0;               // Узлы пула до этого индекса уже выдавались
+        std::vector<uint32_t> freeNodes;
+
+        void Init(size_t nodeCount) {
+            capacity = nodeCount;
+            nodes = std::make_unique<Node[]>(capacity);
+            // Заполнение индекса не выше половины
+            index.assign(std::bit_ceil(capacity * 2), 0);
+            indexMask = index.size() - 1;
+            freeNodes.reserve(capacity);
+        }
+
+        std::span<const Node> Nodes() const { return { nodes.get(), capacity }; }
+
+        template<typename Key>
+        uint32_t Find(const Key& key, size_t hash) const {
+            for (size_t slot = Mix(hash) & indexMask;; slot = (slot + 1) & indexMask) {
+                uint32_t entry = index[slot];
+                if (entry == 0) return NONE;
+                const Node& node = nodes[entry - 1];
+                if (node.hash == hash && KeyEqual{}(node.key, key)) return entry - 1;
+            }
+        }
+
+        bool NeedsEviction() const { return freeNodes.empty() && nextFresh >= capacity; }
+
+        void Insert(const K& key, size_t hash, V&& value) {
+            uint32_t target;
+            if (!freeNodes.empty()) {
+                target = freeNodes.back();
+                freeNodes.pop_back();
+            }
+            else if (nextFresh < capacity) {
+                target = static_cast<uint32_t>(nextFresh++);
+            }
+            else {
+                target = EvictOne();
+            }
+
+            Node& node = nodes[target];
+            node.key = key;
+            node.value = std::move(value);
+            node.hash = hash;
+            node.used = true;
+            node.referenced.store(1, std::memory_order_relaxed);
+
+            size_t slot = Mix(hash) & indexMask;
+            while (index[slot] != 0) {
+                slot = (slot + 1) & indexMask;
+            }
+            index[slot] = target + 1;
+            count++;
+        }
+
+        template<typename Key>
+        bool Erase(const Key& key, size_t hash) {
+            uint32_t target = Find(key, hash);
+            if (target == NONE) return false;
+            Release(target);
+            freeNodes.push_back(target);
+            return true;
+        }
+
+        void Clear() {
+            for (size_t i = 0; i < capacity; i++) {
+                if (nodes[i].used) {
+                    nodes[i].key = K{};
+                    nodes[i].value = V{};
+                    nodes[i].used = false;
+                }
+            }
+            std::fill(index.begin(), index.end(), 0);
+            freeNodes.clear();
+            count = 0;
+            hand = 0;
+            nextFresh = 0;
+        }
+
+        size_t ShrinkTo(size_t target) {
+            size_t released = 0;
+            // Два оборота стрелки: первый снимает биты ссылки, второй гарантированно вытесняет
+            for (size_t step = 0; count > target && step < capacity * 2; step++) {
+                Node& node = nodes[hand];
+                uint32_t current = static_cast<uint32_t>(hand);
+                hand = (hand + 1) % capacity;
+                if (!node.used) continue;
+                if (node.referenced.exchange(0, std::memory_order_relaxed) != 0) continue;
+                Release(current);
+                freeNodes.push_back(current);
+                released++;
+            }
+            return released;
+        }
+
+        // Второй шанс: узел с битом ссылки пропускается один раз
+        uint32_t EvictOne() {
+            for (;;) {
+                Node& node = nodes[hand];
+                uint32_t current = static_cast<uint32_t>(hand);
+                hand = (hand + 1) % capacity;
+                if (!node.used) return current;
+                if (node.referenced.exchange(0, std::memory_order_relaxed) != 0) continue;
+                Release(current);
+                return current;
+            }
+        }
+
+        // Удаление из индекса со сдвигом назад, без надгробий
+        void Release(uint32_t target) {
+            size_t slot = Mix(nodes[target].hash) & indexMask;
+            while (index[slot] != target + 1) {
+                slot = (slot + 1) & indexMask;
+            }
+
+            size_t hole = slot;
+            for (size_t next = (hole + 1) & indexMask; index[next] != 0; next = (next + 1) & indexMask) {
+                size_t home = Mix(nodes[index[next] - 1].hash) & indexMask;
+                // Элемент можно сдвинуть в дыру, если его домашний слот не лежит в (hole, next]
+                if (((next - home) & indexMask) >= ((next - hole) & indexMask)) {
+                    index[hole] = index[next];
+                    hole = next;
+                }
+            }
+            index[hole] = 0;
+
+            nodes[target].used = false;
+            nodes[target].key = K{};
+            nodes[target].value = V{};
+            count--;
+        }
+
+        // std::hash для целых - тождество, а PID кратны 4: перемешиваем перед использованием
+        static size_t Mix(size_t hash) {
+            uint64_t value = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(value ^ (value >> 32));
+        }
+    };
+
+    const size_t shardMask;
+    std::unique_ptr<Shard[]> shards;
+
+    mutable std::atomic<uint64_t> hits{ 0 };
+    mutable std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> evictions{ 0 };
+
+    // Индекс шарда берётся из старших битов: младшие этого же хэша адресуют индекс внутри шарда
+    Shard& ShardFor(size_t hash) { return shards[(Shard::Mix(hash) >> 24) & shardMask]; }
+    const Shard& ShardFor(size_t hash) const { return shards[(Shard::Mix(hash) >> 24) & shardMask]; }
+};
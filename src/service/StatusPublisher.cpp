@@ -0,0 +1,247 @@
+// src/service/StatusPublisher.cpp
+#include "StatusPublisher.h"
+#include "ServiceMain.h"
+#include "RouteController.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include <sddl.h>
+#include <algorithm>
+#include <format>
+
+StatusPublisher::StatusPublisher(ServiceMain* service, RouteController* routeController)
+    : service(service), routeController(routeController) {
+}
+
+StatusPublisher::~StatusPublisher() {
+    Stop();
+}
+
+bool StatusPublisher::Start() {
+    // Писать может только сервис, читать - любой вошедший пользователь
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorA("D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GR;;;AU)",
+        SDDL_REVISION_1, &descriptor, nullptr)) {
+        Logger::Instance().Error(std::format("StatusPublisher::Start - Security descriptor failed: {}", ::GetLastError()));
+        return false;
+    }
+    SECURITY_ATTRIBUTES attributes{ sizeof(attributes), descriptor, FALSE };
+
+    // Global\ требует SeCreateGlobalPrivilege; без него (консольный режим) - сессия пользователя
+    for (const std::string& name : { Constants::STATUS_SECTION_NAME, Constants::STATUS_SECTION_LOCAL_NAME }) {
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, &attributes, PAGE_READWRITE,
+            0, static_cast<DWORD>(sizeof(SharedStatus::Section)), name.c_str());
+        if (mapping) {
+            break;
+        }
+        Logger::Instance().Warning(std::format("StatusPublisher::Start - CreateFileMapping {} failed: {}", name, ::GetLastError()));
+    }
+    LocalFree(descriptor);
+    if (!mapping) {
+        return false;
+    }
+
+    section = static_cast<SharedStatus::Section*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(SharedStatus::Section)));
+    if (!section) {
+        Logger::Instance().Error(std::format("StatusPublisher::Start - MapViewOfFile failed: {}", ::GetLastError()));
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+
+    // Секцию мог оставить открытой UI от прошлого запуска: generation продолжаем, а не сбрасываем
+    section->magic = SharedStatus::MAGIC;
+    section->version = SharedStatus::VERSION;
+    publishedJournalSequence = 0;
+    mirrorRoutes.clear();
+    publishedRows.clear();
+
+    publishThread = std::jthread([this](std::stop_token token) { PublishThreadFunc(token); });
+    Logger::Instance().Info(std::format("StatusPublisher::Start - Publishing {} KB status section",
+        sizeof(SharedStatus::Section) / 1024));
+    return true;
+}
+
+void StatusPublisher::Stop() {
+    if (publishThread.joinable()) {
+        publishThread.request_stop();
+        publishThread.join();
+    }
+
+    if (section) {
+        // Читатель увидит isRunning = 0 и перейдёт на канал
+        SharedStatus::Write(section->statusGeneration, [this] {
+            section->status.isRunning = 0;
+            section->status.publishedTick = GetTickCount64();
+            });
+        UnmapViewOfFile(section);
+        section = nullptr;
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+}
+
+void StatusPublisher::RequestPublish() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakeRequested = true;
+    }
+    wakeCV.notify_one();
+}
+
+void StatusPublisher::PublishThreadFunc(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        try {
+            // Журнал учитывает и refCount, которые не будят notifier
+            if (routeController) {
+                ApplyRouteChanges(routeController->GetRouteChangesSince(publishedJournalSequence));
+            }
+            PublishStatus(publishedJournalSequence);
+        }
+        catch (const std::exception& e) {
+            Logger::Instance().Error(std::format("StatusPublisher::PublishThreadFunc - Exception: {}", e.what()));
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCV.wait_for(lock, stopToken, Constants::STATUS_PUBLISH_INTERVAL, [this] { return wakeRequested; });
+        wakeRequested = false;
+    }
+}
+
+void StatusPublisher::PublishStatus(uint64_t journalSequence) {
+    PERF_TIMER("StatusPublisher::PublishStatus");
+
+    ServiceStatus status = service->CollectStatus();
+    auto report = PerformanceMonitor::Instance().GetReport();
+    std::vector<std::pair<std::string, uint64_t>> counters(report.counters.begin(), report.counters.end());
+    std::ranges::sort(counters);
+
+    SharedStatus::Write(section->statusGeneration, [&] {
+        SharedStatus::Status& shared = section->status;
+        shared.isRunning = status.isRunning;
+        shared.monitorActive = status.monitorActive;
+        shared.routesRestored = status.routesRestored;
+        shared.activeRoutes = status.activeRoutes;
+        shared.memoryUsageMB = status.memoryUsageMB;
+        shared.uptimeSeconds = status.uptime.count();
+        shared.restoreTotal = status.restoreTotal;
+        shared.restoreDone = status.restoreDone;
+        shared.lastPlanAggregates = status.lastPlanAggregates;
+        shared.lastPlanRolledBack = status.lastPlanRolledBack;
+        shared.lastPlanRoutesRetired = status.lastPlanRoutesRetired;
+        shared.lastPlanFailures = status.lastPlanFailures;
+        shared.lastPlanDurationMs = status.lastPlanDurationMs;
+        shared.lastPlanSyscalls = status.lastPlanSyscalls;
+        shared.migrationActive = status.migrationActive;
+        shared.configGeneration = status.configGeneration;
+        shared.migrationTotal = status.migrationTotal;
+        shared.migrationDone = status.migrationDone;
+        shared.migrationFailed = status.migrationFailed;
+        shared.migrationDurationMs = status.migrationDurationMs;
+        shared.routeJournalSequence = journalSequence;
+        shared.publishedTick = GetTickCount64();
+
+        size_t count = (std::min)(counters.size(), SharedStatus::MAX_COUNTERS);
+        for (size_t i = 0; i < count; i++) {
+            SharedStatus::CopyName(section->counters[i].name, SharedStatus::COUNTER_NAME_SIZE, counters[i].first);
+            section->counters[i].value = counters[i].second;
+        }
+        section->counterCount = static_cast<uint32_t>(count);
+        });
+}
+
+std::string StatusPublisher::RowKey(const RouteInfo& route) {
+    return std::format("{}/{}", route.ip, route.prefixLength);
+}
+
+void StatusPublisher::ApplyRouteChanges(RouteChangeSet&& changes) {
+    if (!changes.fullResync && changes.changes.empty()) {
+        publishedJournalSequence = changes.sequence;
+        return;
+    }
+
+    bool structural = changes.fullResync;
+    if (changes.fullResync) {
+        mirrorRoutes.clear();
+        for (RouteInfo& route : changes.routes) {
+            std::string key = RowKey(route);
+            mirrorRoutes.insert_or_assign(std::move(key), std::move(route));
+        }
+    }
+    for (RouteChange& change : changes.changes) {
+        std::string key = RowKey(change.route);
+        switch (change.type) {
+        case RouteChangeType::Added:
+            mirrorRoutes.insert_or_assign(std::move(key), std::move(change.route));
+            structural = true;
+            break;
+        case RouteChangeType::Removed:
+            structural |= mirrorRoutes.erase(key) != 0;
+            break;
+        case RouteChangeType::RefCount:
+            if (auto it = mirrorRoutes.find(key); it != mirrorRoutes.end()) {
+                it->second.refCount.store(change.route.refCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            break;
+        }
+    }
+
+    if (structural) {
+        RepackRoutes(changes.sequence);
+    }
+    else {
+        PatchRefCounts(changes.changes, changes.sequence);
+    }
+    publishedJournalSequence = changes.sequence;
+}
+
+void StatusPublisher::RepackRoutes(uint64_t snapshotSequence) {
+    PERF_TIMER("StatusPublisher::RepackRoutes");
+
+    // Порядок как у GetActiveRoutes: новые первыми
+    std::vector<std::pair<const std::string*, const RouteInfo*>> ordered;
+    ordered.reserve(mirrorRoutes.size());
+    for (const auto& [key, route] : mirrorRoutes) {
+        ordered.emplace_back(&key, &route);
+    }
+    std::ranges::sort(ordered, [](const auto& a, const auto& b) { return a.second->createdAt > b.second->createdAt; });
+    size_t count = (std::min)(ordered.size(), SharedStatus::MAX_ROUTES);
+
+    publishedRows.clear();
+    publishedRows.reserve(count);
+    SharedStatus::Write(section->routesGeneration, [&] {
+        for (size_t i = 0; i < count; i++) {
+            const RouteInfo& route = *ordered[i].second;
+            SharedStatus::Route& shared = section->routes[i];
+            SharedStatus::CopyName(shared.ip, SharedStatus::IP_SIZE, route.ip);
+            shared.prefixLength = static_cast<uint8_t>(route.prefixLength);
+            shared.reserved = 0;
+            shared.refCount = route.refCount.load(std::memory_order_relaxed);
+            shared.createdAt = std::chrono::duration_cast<std::chrono::seconds>(route.createdAt.time_since_epoch()).count();
+            SharedStatus::CopyName(shared.processName, SharedStatus::PROCESS_NAME_SIZE, route.processName);
+            publishedRows.emplace(*ordered[i].first, static_cast<uint32_t>(i));
+        }
+        section->routeCount = static_cast<uint32_t>(count);
+        section->routeSequence = snapshotSequence;
+        section->routesTruncated = ordered.size() > count;
+        });
+
+    if (ordered.size() > count) {
+        PERF_COUNT("StatusPublisher.RoutesTruncated");
+    }
+}
+
+void StatusPublisher::PatchRefCounts(const std::vector<RouteChange>& changes, uint64_t snapshotSequence) {
+    PERF_TIMER("StatusPublisher::PatchRefCounts");
+    SharedStatus::Write(section->routesGeneration, [&] {
+        for (const RouteChange& change : changes) {
+            // Маршрут за пределами MAX_ROUTES в секцию не попал
+            if (auto it = publishedRows.find(RowKey(change.route)); it != publishedRows.end()) {
+                section->routes[it->second].refCount = change.route.refCount.load(std::memory_order_relaxed);
+            }
+        }
+        section->routeSequence = snapshotSequence;
+        });
+}
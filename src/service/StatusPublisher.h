@@ -0,0 +1,61 @@
+// src/service/StatusPublisher.h
+#pragma once
+#include <winsock2.h>
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "../common/Models.h"
+#include "../common/SharedStatus.h"
+
+class ServiceMain;
+class RouteController;
+
+// Publishes ServiceStatus, PerformanceMonitor counters and a packed route
+// table into the STATUS_SECTION_NAME file mapping once per
+// STATUS_PUBLISH_INTERVAL, so the UI and tools read status without a pipe
+// round trip. The route table is kept as a mirror fed by the route journal,
+// like the UI's: a tick with only refCount movement patches those rows in
+// place, and only an added or removed route (or a journal gap) re-sorts and
+// rewrites the table. The route change listener calls RequestPublish() so a
+// change reaches readers before the next tick.
+class StatusPublisher {
+public:
+    StatusPublisher(ServiceMain* service, RouteController* routeController);
+    ~StatusPublisher();
+
+    StatusPublisher(const StatusPublisher&) = delete;
+    StatusPublisher& operator=(const StatusPublisher&) = delete;
+
+    bool Start();
+    void Stop();
+    void RequestPublish();
+
+private:
+    ServiceMain* service;
+    RouteController* routeController;
+
+    HANDLE mapping = nullptr;
+    SharedStatus::Section* section = nullptr;
+    uint64_t publishedJournalSequence = 0;
+
+    // Зеркало таблицы маршрутов по ключу "ip/prefix" и строки секции, где они лежат
+    std::unordered_map<std::string, RouteInfo> mirrorRoutes;
+    std::unordered_map<std::string, uint32_t> publishedRows;
+
+    std::mutex wakeMutex;
+    std::condition_variable_any wakeCV;
+    bool wakeRequested = false;
+    std::jthread publishThread;
+
+    void PublishThreadFunc(std::stop_token stopToken);
+    void PublishStatus(uint64_t journalSequence);
+    void ApplyRouteChanges(RouteChangeSet&& changes);
+    void RepackRoutes(uint64_t snapshotSequence);
+    void PatchRefCounts(const std::vector<RouteChange>& changes, uint64_t snapshotSequence);
+    static std::string RowKey(const RouteInfo& route);
+};
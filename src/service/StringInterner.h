@@ -0,0 +1,57 @@
+// src/service/StringInterner.h
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Maps repeated strings (process names) to small integer IDs.
+// Not thread-safe: the owner serialises access with its own lock.
+// Entries are never removed, so returned references stay valid.
+class StringInterner {
+public:
+    using Id = uint16_t;
+    static constexpr Id OverflowId = 0;
+
+    StringInterner() {
+        names.emplace_back("Unknown");
+        ids.emplace(names.back(), OverflowId);
+    }
+
+    Id Intern(std::string_view value) {
+        auto it = ids.find(value);
+        if (it != ids.end()) {
+            return it->second;
+        }
+
+        if (names.size() > UINT16_MAX) {
+            return OverflowId;
+        }
+
+        Id id = static_cast<Id>(names.size());
+        names.emplace_back(value);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+
+    // Поиск без вставки
+    bool Find(std::string_view value, Id& id) const {
+        auto it = ids.find(value);
+        if (it == ids.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    const std::string& Lookup(Id id) const {
+        return id < names.size() ? names[id] : names[OverflowId];
+    }
+
+    size_t Size() const { return names.size(); }
+
+private:
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Id> ids;  // views into 'names'
+};
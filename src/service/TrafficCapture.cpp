@@ -0,0 +1,280 @@
+// src/service/TrafficCapture.cpp
+#include "TrafficCapture.h"
+#include "PerformanceMonitor.h"
+#include "../common/Constants.h"
+#include "../common/Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iterator>
+
+namespace {
+    template<typename T>
+    bool ReadPod(std::span<const uint8_t> data, size_t& offset, T& out) {
+        if (offset + sizeof(T) > data.size()) return false;
+        std::memcpy(&out, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    CaptureFlowPayload ToPayload(const FlowRecord& record) {
+        CaptureFlowPayload payload{};
+        payload.endpointId = record.endpointId;
+        payload.processId = record.processId;
+        std::memcpy(payload.localAddr, record.localAddr, sizeof(payload.localAddr));
+        std::memcpy(payload.remoteAddr, record.remoteAddr, sizeof(payload.remoteAddr));
+        payload.localPort = record.localPort;
+        payload.remotePort = record.remotePort;
+        payload.protocol = record.protocol;
+        payload.event = record.event;
+        return payload;
+    }
+
+    // QPC-метка драйвера при воспроизведении не имеет смысла - остаётся 0
+    FlowRecord FromPayload(const CaptureFlowPayload& payload) {
+        FlowRecord record;
+        record.endpointId = payload.endpointId;
+        record.processId = payload.processId;
+        std::memcpy(record.localAddr, payload.localAddr, sizeof(record.localAddr));
+        std::memcpy(record.remoteAddr, payload.remoteAddr, sizeof(record.remoteAddr));
+        record.localPort = payload.localPort;
+        record.remotePort = payload.remotePort;
+        record.protocol = payload.protocol;
+        record.event = payload.event;
+        return record;
+    }
+}
+
+bool TrafficCapture::Start(const std::string& path, uint64_t limitBytes) {
+    std::lock_guard<std::mutex> control(controlMutex);
+    if (recording.load()) {
+        Logger::Instance().Warning("TrafficCapture: already recording");
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        Logger::Instance().Error(std::format("TrafficCapture: failed to open {}", path));
+        return false;
+    }
+
+    CaptureFileHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.startedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        pending.clear();
+        pending.reserve(Constants::CAPTURE_FLUSH_BYTES * 2);
+        reservedBytes = sizeof(header);
+        maxBytes = limitBytes;
+        stats = {};
+        startTime = std::chrono::steady_clock::now();
+    }
+
+    writerThread = std::jthread([this](std::stop_token token) { WriterThreadFunc(token); });
+    recording.store(true, std::memory_order_release);
+
+    Logger::Instance().Info(std::format("TrafficCapture: recording to {} (limit {} MB)", path, limitBytes >> 20));
+    return true;
+}
+
+void TrafficCapture::Stop() {
+    std::lock_guard<std::mutex> control(controlMutex);
+    if (!recording.exchange(false) && !writerThread.joinable()) {
+        return;
+    }
+
+    // Писатель дописывает остаток буфера перед выходом
+    if (writerThread.joinable()) {
+        writerThread.request_stop();
+        writerThread.join();
+    }
+    file.close();
+
+    Stats final = GetStats();
+    Logger::Instance().Info(std::format("TrafficCapture: stopped, {} records, {} bytes, {} dropped",
+        final.records, final.bytesWritten, final.dropped));
+}
+
+uint64_t TrafficCapture::ElapsedNs() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+}
+
+bool TrafficCapture::AppendLocked(CaptureRecordType type, uint64_t timeNs, const void* payload, size_t length,
+    const void* tail, size_t tailLength) {
+    size_t total = length + tailLength;
+    size_t recordBytes = sizeof(CaptureRecordHeader) + total;
+    if (total > UINT16_MAX || pending.size() + recordBytes > Constants::CAPTURE_MAX_PENDING_BYTES ||
+        (maxBytes > 0 && reservedBytes + recordBytes > maxBytes)) {
+        stats.dropped++;
+        return false;
+    }
+
+    CaptureRecordHeader header{ timeNs, static_cast<uint8_t>(type), 0, static_cast<uint16_t>(total) };
+    const auto* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+    pending.insert(pending.end(), headerBytes, headerBytes + sizeof(header));
+    const auto* payloadBytes = static_cast<const uint8_t*>(payload);
+    pending.insert(pending.end(), payloadBytes, payloadBytes + length);
+    if (tailLength > 0) {
+        const auto* tailBytes = static_cast<const uint8_t*>(tail);
+        pending.insert(pending.end(), tailBytes, tailBytes + tailLength);
+    }
+    reservedBytes += recordBytes;
+    stats.records++;
+    return true;
+}
+
+void TrafficCapture::RecordFlows(std::span<const FlowRecord> records) {
+    if (records.empty() || !IsRecording()) return;
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        uint64_t timeNs = ElapsedNs();
+        for (const FlowRecord& record : records) {
+            CaptureFlowPayload payload = ToPayload(record);
+            AppendLocked(CaptureRecordType::Flow, timeNs, &payload, sizeof(payload));
+        }
+        wake = pending.size() >= Constants::CAPTURE_FLUSH_BYTES;
+    }
+    if (wake) flushCV.notify_one();
+}
+
+void TrafficCapture::RecordDnsResponse(std::span<const uint8_t> message) {
+    if (!IsRecording()) return;
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        AppendLocked(CaptureRecordType::DnsResponse, ElapsedNs(), message.data(), message.size());
+        wake = pending.size() >= Constants::CAPTURE_FLUSH_BYTES;
+    }
+    if (wake) flushCV.notify_one();
+}
+
+void TrafficCapture::RecordProcess(uint32_t processId, std::string_view name) {
+    if (!IsRecording()) return;
+
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    CaptureProcessPayload payload{ processId };
+    AppendLocked(CaptureRecordType::Process, ElapsedNs(), &payload, sizeof(payload), name.data(), name.size());
+}
+
+TrafficCapture::Stats TrafficCapture::GetStats() const {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    return stats;
+}
+
+void TrafficCapture::WriterThreadFunc(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        {
+            std::unique_lock<std::mutex> lock(bufferMutex);
+            flushCV.wait_for(lock, stopToken, Constants::CAPTURE_FLUSH_INTERVAL,
+                [this] { return pending.size() >= Constants::CAPTURE_FLUSH_BYTES; });
+        }
+        WritePending();
+    }
+    WritePending();
+}
+
+void TrafficCapture::WritePending() {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(Constants::CAPTURE_FLUSH_BYTES * 2);
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        if (pending.empty()) return;
+        buffer.swap(pending);
+    }
+
+    PERF_TIMER("TrafficCapture::WritePending");
+    file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    file.flush();
+
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    if (file.good()) {
+        stats.bytesWritten += buffer.size();
+    }
+    // Предел файла достигнут: дальше записи только отбрасывались бы
+    if (maxBytes > 0 && reservedBytes + sizeof(CaptureRecordHeader) >= maxBytes && recording.exchange(false)) {
+        Logger::Instance().Warning(std::format("TrafficCapture: file limit of {} MB reached, recording stopped", maxBytes >> 20));
+    }
+    PerformanceMonitor::Instance().SetGauge("TrafficCapture.Bytes", static_cast<size_t>(stats.bytesWritten));
+}
+
+bool CaptureReader::Load(const std::string& path) {
+    records.clear();
+    truncated = false;
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) {
+        Logger::Instance().Error(std::format("CaptureReader: failed to open {}", path));
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::span<const uint8_t> bytes(data);
+
+    size_t offset = 0;
+    CaptureFileHeader header{};
+    if (!ReadPod(bytes, offset, header) || header.magic != TrafficCapture::MAGIC || header.version != TrafficCapture::VERSION) {
+        Logger::Instance().Error(std::format("CaptureReader: {} is not a capture file", path));
+        return false;
+    }
+    startedAt = header.startedAt;
+
+    CaptureRecordHeader recordHeader{};
+    while (ReadPod(bytes, offset, recordHeader)) {
+        if (offset + recordHeader.length > bytes.size()) {
+            truncated = true;
+            break;
+        }
+        std::span<const uint8_t> payload = bytes.subspan(offset, recordHeader.length);
+        offset += recordHeader.length;
+
+        Record record;
+        record.timeNs = recordHeader.timeNs;
+        record.type = static_cast<CaptureRecordType>(recordHeader.type);
+        size_t payloadOffset = 0;
+        switch (record.type) {
+        case CaptureRecordType::Flow: {
+            CaptureFlowPayload flow{};
+            if (!ReadPod(payload, payloadOffset, flow)) continue;
+            record.flow = FromPayload(flow);
+            break;
+        }
+        case CaptureRecordType::DnsResponse:
+            record.message.assign(payload.begin(), payload.end());
+            break;
+        case CaptureRecordType::Process: {
+            CaptureProcessPayload process{};
+            if (!ReadPod(payload, payloadOffset, process)) continue;
+            record.processId = process.processId;
+            record.processName.assign(reinterpret_cast<const char*>(payload.data() + payloadOffset),
+                payload.size() - payloadOffset);
+            break;
+        }
+        default:
+            // Типы из более новой версии пропускаем по длине
+            continue;
+        }
+        records.push_back(std::move(record));
+    }
+    if (offset < bytes.size()) {
+        truncated = true;
+    }
+
+    Logger::Instance().Info(std::format("CaptureReader: loaded {} records from {}{}", records.size(), path,
+        truncated ? " (truncated)" : ""));
+    return true;
+}
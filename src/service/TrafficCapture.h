@@ -0,0 +1,139 @@
+// src/service/TrafficCapture.h
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "FlowRing.h"
+
+// Recording of the traffic that drives route decisions, for offline replay:
+// FLOW events as the capture thread hands them to the workers, DNS responses
+// as the proxy parses them, and the name of each selected process the first
+// time one of its flows is classified. A record is a small header (time since
+// the capture started, type, length) followed by a packed payload. Hot paths
+// only append to an in-memory buffer under a short lock; a writer thread moves
+// the buffer to disk.
+
+#pragma pack(push, 1)
+struct CaptureFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int64_t startedAt;           // ms since epoch
+};
+
+struct CaptureRecordHeader {
+    uint64_t timeNs;             // since the capture started
+    uint8_t type;                // CaptureRecordType
+    uint8_t reserved;
+    uint16_t length;             // payload bytes that follow
+};
+
+struct CaptureFlowPayload {
+    uint64_t endpointId;
+    uint32_t processId;
+    uint32_t localAddr[4];       // WinDivert order, IPv4 as ::ffff:a.b.c.d
+    uint32_t remoteAddr[4];
+    uint16_t localPort;
+    uint16_t remotePort;
+    uint8_t protocol;
+    uint8_t event;               // WINDIVERT_EVENT_*
+};
+
+struct CaptureProcessPayload {
+    uint32_t processId;          // UTF-8 name bytes follow
+};
+#pragma pack(pop)
+
+enum class CaptureRecordType : uint8_t {
+    Flow = 1,
+    DnsResponse = 2,             // DNS message as passed to ParseDnsResponseAndAddRoutes
+    Process = 3
+};
+
+class TrafficCapture {
+public:
+    static constexpr uint32_t MAGIC = 0x50434D52;  // "RMCP"
+    static constexpr uint16_t VERSION = 1;
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t dropped = 0;    // Буфер переполнен или файл достиг предела
+    };
+
+    static TrafficCapture& Instance() {
+        static TrafficCapture instance;
+        return instance;
+    }
+
+    // Новый файл поверх старого; maxBytes == 0 - без предела
+    bool Start(const std::string& path, uint64_t maxBytes);
+    void Stop();
+
+    // Проверка до сборки записи: выключенная запись стоит одной relaxed-загрузки
+    bool IsRecording() const { return recording.load(std::memory_order_relaxed); }
+
+    void RecordFlows(std::span<const FlowRecord> records);
+    void RecordDnsResponse(std::span<const uint8_t> message);
+    void RecordProcess(uint32_t processId, std::string_view name);
+
+    Stats GetStats() const;
+
+private:
+    TrafficCapture() = default;
+    ~TrafficCapture() { Stop(); }
+
+    std::atomic<bool> recording{ false };
+    std::mutex controlMutex;                // Start/Stop
+
+    mutable std::mutex bufferMutex;         // pending, счётчики и лимит
+    std::condition_variable_any flushCV;
+    std::vector<uint8_t> pending;
+    uint64_t reservedBytes = 0;             // Файл + буфер, для проверки maxBytes
+    uint64_t maxBytes = 0;
+    Stats stats;
+
+    std::chrono::steady_clock::time_point startTime;
+    std::ofstream file;                     // Только поток записи после Start
+    std::jthread writerThread;
+
+    uint64_t ElapsedNs() const;
+    // Вызывается под bufferMutex; false - запись отброшена
+    bool AppendLocked(CaptureRecordType type, uint64_t timeNs, const void* payload, size_t length,
+        const void* tail = nullptr, size_t tailLength = 0);
+    void WriterThreadFunc(std::stop_token stopToken);
+    void WritePending();
+};
+
+// Reads a whole capture into memory for replay. Record times are taken under
+// the append lock, so records come back in time order.
+class CaptureReader {
+public:
+    struct Record {
+        uint64_t timeNs = 0;
+        CaptureRecordType type = CaptureRecordType::Flow;
+        FlowRecord flow;                    // Flow
+        uint32_t processId = 0;             // Process
+        std::string processName;            // Process
+        std::vector<uint8_t> message;       // DnsResponse
+    };
+
+    bool Load(const std::string& path);
+    const std::vector<Record>& Records() const { return records; }
+    int64_t StartedAt() const { return startedAt; }
+    // Записи, обрезанные концом файла (запись прервана аварийно)
+    bool Truncated() const { return truncated; }
+
+private:
+    std::vector<Record> records;
+    int64_t startedAt = 0;
+    bool truncated = false;
+};
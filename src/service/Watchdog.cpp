@@ -3,14 +3,30 @@
 #include <windows.h>
 #include "Watchdog.h"
 #include "ServiceMain.h"
+#include "PerformanceMonitor.h"
 #include "../common/Constants.h"
 #include "../common/Logger.h"
 #include "../common/ShutdownCoordinator.h"
 #include <psapi.h>
+#include <algorithm>
+#include <format>
 
-Watchdog::Watchdog(ServiceMain* svc) : service(svc), running(false),
+namespace {
+    constexpr const char* SUBSYSTEM_NAMES[] = { "Routes", "Flows", "ProcessCaches", "Dns", "Logger", "Optimizer" };
+    static_assert(std::size(SUBSYSTEM_NAMES) == static_cast<size_t>(MemorySubsystem::Count));
+
+    size_t MegabytesToBytes(int megabytes) {
+        return static_cast<size_t>((std::max)(megabytes, 0)) * 1024 * 1024;
+    }
+}
+
+Watchdog::Watchdog(ServiceMain* svc, const MemoryBudgetSettings& budgets) : service(svc), running(false),
 startTime(std::chrono::system_clock::now()) {
     Logger::Instance().Debug("Watchdog::Watchdog - Constructor called");
+    for (size_t i = 0; i < subsystems.size(); i++) {
+        subsystems[i].name = SUBSYSTEM_NAMES[i];
+    }
+    UpdateBudgets(budgets);
 }
 
 Watchdog::~Watchdog() {
@@ -29,18 +45,57 @@ void Watchdog::Start() {
 void Watchdog::Stop() {
     Logger::Instance().Debug("Watchdog::Stop - Stopping watchdog");
     running = false;
-    // std::jthread автоматически вызовет request_stop() и join()
+    if (watchThread.joinable()) {
+        watchThread.request_stop();
+        watchThread.join();
+    }
+}
+
+void Watchdog::RegisterSubsystem(MemorySubsystem id, MeasureFunc measure, RelieveFunc relieve) {
+    std::lock_guard<std::mutex> lock(subsystemsMutex);
+    Subsystem& subsystem = subsystems[static_cast<size_t>(id)];
+    subsystem.measure = std::move(measure);
+    subsystem.relieve = std::move(relieve);
+}
+
+void Watchdog::UpdateBudgets(const MemoryBudgetSettings& budgets) {
+    std::lock_guard<std::mutex> lock(subsystemsMutex);
+    totalBudgetBytes = MegabytesToBytes(budgets.totalMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::Routes)].budgetBytes = MegabytesToBytes(budgets.routesMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::Flows)].budgetBytes = MegabytesToBytes(budgets.flowsMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::ProcessCaches)].budgetBytes = MegabytesToBytes(budgets.processCachesMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::Dns)].budgetBytes = MegabytesToBytes(budgets.dnsMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::Logger)].budgetBytes = MegabytesToBytes(budgets.loggerMB);
+    subsystems[static_cast<size_t>(MemorySubsystem::Optimizer)].budgetBytes = MegabytesToBytes(budgets.optimizerMB);
+}
+
+MemoryReport Watchdog::GetMemoryReport() const {
+    std::lock_guard<std::mutex> lock(subsystemsMutex);
+    MemoryReport report;
+    report.workingSetBytes = workingSetBytes;
+    report.budgetBytes = totalBudgetBytes;
+    report.pressure = pressure;
+    report.sheds = sheds;
+    for (const Subsystem& subsystem : subsystems) {
+        if (!subsystem.measure) continue;
+        report.subsystems.push_back({ subsystem.name, subsystem.usedBytes, subsystem.budgetBytes, subsystem.trims });
+    }
+    return report;
 }
 
 size_t Watchdog::GetMemoryUsageMB() const {
+    return GetWorkingSetBytes() / (1024 * 1024);
+}
+
+size_t Watchdog::GetWorkingSetBytes() const {
     try {
         PROCESS_MEMORY_COUNTERS_EX pmc;
         if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc))) {
-            return pmc.WorkingSetSize / (1024 * 1024);
+            return pmc.WorkingSetSize;
         }
     }
     catch (const std::exception& e) {
-        Logger::Instance().Error("Watchdog::GetMemoryUsageMB - Exception: " + std::string(e.what()));
+        Logger::Instance().Error("Watchdog::GetWorkingSetBytes - Exception: " + std::string(e.what()));
     }
     return 0;
 }
@@ -61,28 +116,120 @@ void Watchdog::WatchThreadFunc(std::stop_token stopToken) {
             Logger::Instance().Error("Watchdog::WatchThreadFunc - Exception: " + std::string(e.what()));
         }
 
-        for (int i = 0; i < Constants::WATCHDOG_INTERVAL_SEC * 10; i++) {
-            if (stopToken.stop_requested() || ShutdownCoordinator::Instance().isShuttingDown) {
-                break;
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCV.wait_for(lock, stopToken, std::chrono::seconds(Constants::WATCHDOG_INTERVAL_SEC), [] {
+            return ShutdownCoordinator::Instance().isShuttingDown.load();
+            });
     }
 
     Logger::Instance().Debug("Watchdog::WatchThreadFunc - Exiting");
 }
 
 void Watchdog::CheckMemoryUsage() {
-    size_t memoryMB = GetMemoryUsageMB();
+    PERF_TIMER("Watchdog::CheckMemoryUsage");
+
+    // Замеры берут блокировки подсистем, поэтому идут вне subsystemsMutex
+    std::array<size_t, static_cast<size_t>(MemorySubsystem::Count)> used{};
+    for (size_t i = 0; i < subsystems.size(); i++) {
+        if (subsystems[i].measure) {
+            used[i] = subsystems[i].measure();
+        }
+    }
+    size_t workingSet = GetWorkingSetBytes();
+
+    std::array<size_t, static_cast<size_t>(MemorySubsystem::Count)> budgets{};
+    size_t totalBudget = 0;
+    {
+        std::lock_guard<std::mutex> lock(subsystemsMutex);
+        for (size_t i = 0; i < subsystems.size(); i++) {
+            subsystems[i].usedBytes = used[i];
+            budgets[i] = subsystems[i].budgetBytes;
+        }
+        workingSetBytes = workingSet;
+        totalBudget = totalBudgetBytes;
+    }
+
+    // Ступень 1: подсистема сверх своего бюджета ужимается сама, остальные не трогаются
+    MemoryPressure level = MemoryPressure::Normal;
+    std::array<bool, static_cast<size_t>(MemorySubsystem::Count)> trimmed{};
+    for (size_t i = 0; i < subsystems.size(); i++) {
+        if (budgets[i] > 0 && used[i] > budgets[i] && subsystems[i].relieve) {
+            Logger::Instance().Warning(std::format("Watchdog::CheckMemoryUsage - {} over budget: {} KB of {} KB",
+                subsystems[i].name, used[i] / 1024, budgets[i] / 1024));
+            Relieve(i, MemoryPressure::Trim);
+            trimmed[i] = true;
+            level = MemoryPressure::Trim;
+        }
+    }
+
+    if (totalBudget > 0 && workingSet > totalBudget) {
+        checksOverTotal++;
+        if (checksOverTotal < Constants::MEMORY_SHED_AFTER_CHECKS) {
+            // Ступень 2: ужимаются все, начиная с тех, кто дальше всего за бюджетом
+            Logger::Instance().Warning(std::format("Watchdog::CheckMemoryUsage - High memory usage: {}MB, trimming caches",
+                workingSet / (1024 * 1024)));
+            std::array<size_t, static_cast<size_t>(MemorySubsystem::Count)> order{};
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            auto overage = [&](size_t i) {
+                return static_cast<int64_t>(used[i]) - static_cast<int64_t>(budgets[i] > 0 ? budgets[i] : used[i]);
+            };
+            std::ranges::sort(order, [&](size_t a, size_t b) { return overage(a) > overage(b); });
+
+            for (size_t i : order) {
+                if (!trimmed[i] && subsystems[i].relieve) {
+                    Relieve(i, MemoryPressure::Trim);
+                }
+            }
+            level = MemoryPressure::Trim;
+        }
+        else {
+            // Ступень 3: ужатие не помогло - сбрасываем всё восстановимое и отдаём рабочий набор
+            Logger::Instance().Error(std::format("Watchdog::CheckMemoryUsage - Memory still high after trim: {}MB, shedding",
+                workingSet / (1024 * 1024)));
+            for (size_t i = 0; i < subsystems.size(); i++) {
+                if (subsystems[i].relieve) {
+                    Relieve(i, MemoryPressure::Shed);
+                }
+            }
+            ForceGarbageCollection();
+            level = MemoryPressure::Shed;
+            checksOverTotal = 0;
+            std::lock_guard<std::mutex> lock(subsystemsMutex);
+            sheds++;
+        }
+    }
+    else {
+        checksOverTotal = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(subsystemsMutex);
+        pressure = level;
+    }
+    PublishGauges();
+}
 
-    if (memoryMB > Constants::MAX_MEMORY_MB) {
-        Logger::Instance().Warning("Watchdog::CheckMemoryUsage - High memory usage: " + std::to_string(memoryMB) + "MB");
-        ForceGarbageCollection();
+void Watchdog::Relieve(size_t index, MemoryPressure level) {
+    Subsystem& subsystem = subsystems[index];
+    try {
+        subsystem.relieve(level);
+    }
+    catch (const std::exception& e) {
+        Logger::Instance().Error(std::format("Watchdog::Relieve - {} failed: {}", subsystem.name, e.what()));
+    }
 
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+    std::lock_guard<std::mutex> lock(subsystemsMutex);
+    subsystem.trims++;
+}
 
-        if (GetMemoryUsageMB() > Constants::MAX_MEMORY_MB) {
-            Logger::Instance().Error("Watchdog::CheckMemoryUsage - Memory still high after GC");
+void Watchdog::PublishGauges() {
+    auto& perf = PerformanceMonitor::Instance();
+    std::lock_guard<std::mutex> lock(subsystemsMutex);
+    perf.SetGauge("Watchdog.Memory.WorkingSetBytes", workingSetBytes);
+    perf.SetGauge("Watchdog.Memory.Pressure", static_cast<uint64_t>(pressure));
+    for (const Subsystem& subsystem : subsystems) {
+        if (subsystem.measure) {
+            perf.SetGauge(std::format("Watchdog.Memory.{}Bytes", subsystem.name), subsystem.usedBytes);
         }
     }
 }
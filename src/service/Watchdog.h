@@ -2,15 +2,37 @@
 #pragma once
 #include <thread>
 #include <atomic>
+#include <array>
 #include <chrono>
-#include <unordered_map>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
+#include "../common/Models.h"
 
 class ServiceMain;
 
+enum class MemorySubsystem : size_t {
+    Routes,
+    Flows,
+    ProcessCaches,
+    Dns,
+    Logger,
+    Optimizer,
+    Count
+};
+
+// Memory budget controller. Every check measures the registered subsystems
+// and the process working set. A subsystem over its own budget is asked to
+// trim; a working set over the total budget first trims every consumer,
+// largest overage first, and only if it is still over on the next checks are
+// the subsystems told to shed and the working set emptied. Subsystems are
+// registered before Start and measured on the watchdog thread only.
 class Watchdog {
 public:
-    Watchdog(ServiceMain* service);
+    using MeasureFunc = std::function<size_t()>;
+    using RelieveFunc = std::function<void(MemoryPressure)>;
+
+    Watchdog(ServiceMain* service, const MemoryBudgetSettings& budgets = {});
     ~Watchdog();
 
     void Start();
@@ -18,13 +40,41 @@ public:
     size_t GetMemoryUsageMB() const;
     std::chrono::seconds GetUptime() const;
 
+    // relieve == nullptr - подсистема только учитывается
+    void RegisterSubsystem(MemorySubsystem id, MeasureFunc measure, RelieveFunc relieve = nullptr);
+    void UpdateBudgets(const MemoryBudgetSettings& budgets);
+    MemoryReport GetMemoryReport() const;
+
 private:
+    struct Subsystem {
+        const char* name = "";
+        MeasureFunc measure;
+        RelieveFunc relieve;
+        size_t budgetBytes = 0;             // 0 - без ограничения
+        size_t usedBytes = 0;
+        uint64_t trims = 0;
+    };
+
     ServiceMain* service;
     std::atomic<bool> running;
     std::jthread watchThread;
+    std::mutex wakeMutex;
+    std::condition_variable_any wakeCV;
     std::chrono::system_clock::time_point startTime;
 
+    // Функции подсистем неизменны после Start; mutex защищает замеры и бюджеты
+    std::array<Subsystem, static_cast<size_t>(MemorySubsystem::Count)> subsystems;
+    mutable std::mutex subsystemsMutex;
+    size_t totalBudgetBytes = 0;
+    size_t workingSetBytes = 0;
+    MemoryPressure pressure = MemoryPressure::Normal;
+    uint64_t sheds = 0;
+    int checksOverTotal = 0;                // Только поток watchdog
+
     void WatchThreadFunc(std::stop_token stopToken);
     void CheckMemoryUsage();
+    void Relieve(size_t index, MemoryPressure level);
+    void PublishGauges();
+    size_t GetWorkingSetBytes() const;
     void ForceGarbageCollection();
-};
\ No newline at end of file
+};
@@ -14,6 +14,7 @@
 #include "SystemTray.h"
 #include "ProcessPanel.h"
 #include "RouteTable.h"
+#include "PerfPanel.h"
 #include "../common/Constants.h"
 #include "../common/Utils.h"
 #include "../common/Logger.h"
@@ -108,6 +109,7 @@ bool MainWindow::CreateMainWindow(int nCmdShow) {
     systemTray = std::make_unique<SystemTray>(hwnd);
     processPanel = std::make_unique<ProcessPanel>(hwnd, serviceClient.get());
     routeTable = std::make_unique<RouteTable>(hwnd, serviceClient.get());
+    perfPanel = std::make_unique<PerfPanel>(hInstance, hwnd, serviceClient.get());
 
     CreateControls();
 
@@ -190,6 +192,10 @@ void MainWindow::CreateControls() {
         WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
         250, 580, 120, 30, hwnd, (HMENU)1006, hInstance, nullptr);
 
+    performanceButton = CreateWindow(L"BUTTON", L"Performance",
+        WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        380, 580, 100, 30, hwnd, (HMENU)1009, hInstance, nullptr);
+
     EnumChildWindows(hwnd, [](HWND hwnd, LPARAM lParam) -> BOOL {
         SendMessage(hwnd, WM_SETFONT, (WPARAM)lParam, TRUE);
         return TRUE;
@@ -214,6 +220,7 @@ LRESULT CALLBACK MainWindow::WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
         case 1006: instance->OnOptimizeRoutes(); break;
         case 1007: instance->OnDnsProxyToggle(); break;
         case 1008: instance->OnAutostartToggle(); break;
+        case 1009: instance->OnShowPerformance(); break;
         default:
             if (instance->processPanel) {
                 instance->processPanel->HandleCommand(wParam);
@@ -263,6 +270,9 @@ LRESULT CALLBACK MainWindow::WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
         if (instance->processPanel) {
             instance->processPanel->HandleNotify(pnmh);
         }
+        if (instance->routeTable) {
+            instance->routeTable->HandleNotify(pnmh);
+        }
         return 0;
     }
 
@@ -316,16 +326,46 @@ void MainWindow::OnEditPreload() {
 
 void MainWindow::OnOptimizeRoutes() {
     if (serviceClient && serviceClient->IsConnected()) {
-        serviceClient->OptimizeRoutes();
-        MessageBox(hwnd, L"Route optimization completed.\nCheck logs for details.", L"Optimization", MB_OK | MB_ICONINFORMATION);
+        // Сервис ответит по завершении; до тех пор окно и опрос статуса работают
+        if (serviceClient->BeginOptimizeRoutes() != 0) {
+            EnableWindow(optimizeRoutesButton, FALSE);
+            SetWindowText(optimizeRoutesButton, L"Optimizing...");
+        }
+    }
+}
 
-        // Refresh route table to show optimized routes
-        if (routeTable) {
+void MainWindow::OnRequestCompleted(IPCMessageType type, const IPCResponse& response) {
+    if (type == IPCMessageType::SubscribeRoutes) {
+        // Таблица изменилась: забираем дельту, а не весь список
+        if (response.success && routeTable) {
             routeTable->Refresh();
         }
+        return;
+    }
+    if (type != IPCMessageType::OptimizeRoutes) {
+        return;
+    }
+
+    EnableWindow(optimizeRoutesButton, TRUE);
+    SetWindowText(optimizeRoutesButton, L"Optimize Routes");
 
-        // Update status to reflect new route count
-        UpdateStatus();
+    if (!response.success) {
+        std::wstring message = L"Route optimization failed:\n" + Utils::StringToWString(response.error);
+        MessageBox(hwnd, message.c_str(), L"Optimization", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    // Refresh route table to show optimized routes
+    if (routeTable) {
+        routeTable->Refresh();
+    }
+
+    MessageBox(hwnd, L"Route optimization completed.\nCheck logs for details.", L"Optimization", MB_OK | MB_ICONINFORMATION);
+}
+
+void MainWindow::OnShowPerformance() {
+    if (perfPanel) {
+        perfPanel->Show();
     }
 }
 
@@ -351,6 +391,7 @@ void MainWindow::OnSize(int width, int height) {
     SetWindowPos(minimizeButton, NULL, 10, height - 50, 120, 30, SWP_NOZORDER);
     SetWindowPos(viewLogsButton, NULL, 140, height - 50, 100, 30, SWP_NOZORDER);
     SetWindowPos(optimizeRoutesButton, NULL, 250, height - 50, 120, 30, SWP_NOZORDER);
+    SetWindowPos(performanceButton, NULL, 380, height - 50, 100, 30, SWP_NOZORDER);
 }
 
 void MainWindow::OnClose() {
@@ -378,6 +419,7 @@ void MainWindow::OnClose() {
         systemTray.reset();
     }
 
+    perfPanel.reset();
     processPanel.reset();
     routeTable.reset();
     serviceClient.reset();
@@ -403,11 +445,24 @@ void MainWindow::UpdateStatus() {
     }
 
     status = serviceClient->GetStatus();
+    serviceClient->SubscribeRoutes();
+
+    // Ответы на долгие команды и уведомления подписки приходят вместе с обычным опросом
+    for (const auto& request : serviceClient->TakeCompleted()) {
+        OnRequestCompleted(request.type, request.response);
+    }
 
     std::wstringstream ss;
     ss << L"Service: " << (status.isRunning ? L"●" : L"○") << L" Running\r\n";
     ss << L"Monitor: " << (status.monitorActive ? L"●" : L"○") << L" Active\r\n";
-    ss << L"Routes: " << status.activeRoutes << L" active\r\n";
+    ss << L"Routes: " << status.activeRoutes << L" active";
+    if (!status.routesRestored) {
+        ss << L" (restoring " << status.restoreDone << L"/" << status.restoreTotal << L")";
+    }
+    if (status.migrationActive) {
+        ss << L" (migrating " << status.migrationDone << L"/" << status.migrationTotal << L")";
+    }
+    ss << L"\r\n";
     ss << L"Memory: " << status.memoryUsageMB << L" MB\r\n";
     ss << L"Uptime: " << Utils::StringToWString(Utils::FormatDuration(status.uptime));
 
@@ -6,11 +6,13 @@
 #include <string>
 #include <atomic>
 #include "../common/Models.h"
+#include "../common/IPCProtocol.h"
 
-class ServiceClient;
 class SystemTray;
 class ProcessPanel;
 class RouteTable;
+class PerfPanel;
+class ServiceClient;
 
 class MainWindow {
 public:
@@ -27,6 +29,7 @@ private:
     std::unique_ptr<SystemTray> systemTray;
     std::unique_ptr<ProcessPanel> processPanel;
     std::unique_ptr<RouteTable> routeTable;
+    std::unique_ptr<PerfPanel> perfPanel;
 
     HWND configGroupBox;
     HWND statusGroupBox;
@@ -41,6 +44,7 @@ private:
     HWND minimizeButton;
     HWND viewLogsButton;
     HWND optimizeRoutesButton;
+    HWND performanceButton;
 
     ServiceConfig config;
     ServiceStatus status;
@@ -61,6 +65,8 @@ private:
     void OnDnsProxyToggle();
     void OnAutostartToggle();
     void OnOptimizeRoutes();
+    void OnRequestCompleted(IPCMessageType type, const IPCResponse& response);
+    void OnShowPerformance();
     void LoadConfiguration();
     void OnClose();
     void OnSize(int width, int height);
@@ -0,0 +1,282 @@
+// src/ui/PerfPanel.cpp
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <windows.h>
+#include <commctrl.h>
+#include <format>
+
+#include "PerfPanel.h"
+#include "ServiceClient.h"
+#include "../common/Constants.h"
+#include "../common/Utils.h"
+#include "../common/Logger.h"
+
+#pragma comment(lib, "comctl32.lib")
+
+namespace {
+    const wchar_t* PANEL_CLASS = L"RouteManagerProPerfPanel";
+
+    enum Column { NAME, VALUE, RATE, AVG, P50, P99, P999, MAX, COLUMN_COUNT };
+
+    uint64_t FindValue(const std::vector<std::pair<std::string, uint64_t>>& values, std::string_view name) {
+        for (const auto& [key, value] : values) {
+            if (key == name) return value;
+        }
+        return 0;
+    }
+
+    const PerfTimerSample* FindTimer(const PerfReportData& report, std::string_view name) {
+        for (const auto& timer : report.timers) {
+            if (timer.name == name) return &timer;
+        }
+        return nullptr;
+    }
+
+    std::wstring FormatRate(double rate) {
+        return rate < 10.0 ? std::format(L"{:.1f}", rate) : std::format(L"{:.0f}", rate);
+    }
+}
+
+PerfPanel::PerfPanel(HINSTANCE instance, HWND owner, ServiceClient* client)
+    : hInstance(instance), ownerWnd(owner), hwnd(nullptr), summaryLabel(nullptr), listView(nullptr),
+    serviceClient(client), previousUptimeMs(0) {
+}
+
+PerfPanel::~PerfPanel() {
+    if (hwnd) {
+        KillTimer(hwnd, REFRESH_TIMER);
+        DestroyWindow(hwnd);
+    }
+}
+
+void PerfPanel::Show() {
+    if (!hwnd && !CreatePanelWindow()) {
+        Logger::Instance().Error("PerfPanel::Show - Failed to create window");
+        return;
+    }
+
+    ShowWindow(hwnd, SW_SHOW);
+    SetForegroundWindow(hwnd);
+    Refresh();
+    SetTimer(hwnd, REFRESH_TIMER, Constants::PERF_PANEL_REFRESH_MS, nullptr);
+}
+
+bool PerfPanel::CreatePanelWindow() {
+    static bool classRegistered = false;
+    if (!classRegistered) {
+        WNDCLASSEXW wcex = { sizeof(WNDCLASSEXW) };
+        wcex.lpfnWndProc = WindowProc;
+        wcex.hInstance = hInstance;
+        wcex.hCursor = LoadCursor(nullptr, IDC_ARROW);
+        wcex.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+        wcex.lpszClassName = PANEL_CLASS;
+        if (!RegisterClassExW(&wcex)) {
+            return false;
+        }
+        classRegistered = true;
+    }
+
+    hwnd = CreateWindowExW(WS_EX_TOOLWINDOW, PANEL_CLASS, L"Performance",
+        WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, 760, 520,
+        ownerWnd, nullptr, hInstance, this);
+    if (!hwnd) {
+        return false;
+    }
+
+    summaryLabel = CreateWindow(L"STATIC", L"", WS_CHILD | WS_VISIBLE,
+        10, 10, 730, 80, hwnd, nullptr, hInstance, nullptr);
+
+    listView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, L"",
+        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL,
+        10, 95, 730, 380, hwnd, nullptr, hInstance, nullptr);
+    ListView_SetExtendedListViewStyle(listView, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES | LVS_EX_DOUBLEBUFFER);
+
+    const struct { const wchar_t* title; int width; } columns[COLUMN_COUNT] = {
+        { L"Metric", 250 }, { L"Value", 80 }, { L"Rate/s", 65 }, { L"Avg us", 60 },
+        { L"p50 us", 60 }, { L"p99 us", 60 }, { L"p999 us", 60 }, { L"Max us", 65 }
+    };
+
+    LVCOLUMN column;
+    column.mask = LVCF_TEXT | LVCF_WIDTH;
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+        column.pszText = const_cast<LPWSTR>(columns[i].title);
+        column.cx = columns[i].width;
+        ListView_InsertColumn(listView, i, &column);
+    }
+
+    HFONT hFont = (HFONT)GetStockObject(DEFAULT_GUI_FONT);
+    SendMessage(summaryLabel, WM_SETFONT, (WPARAM)hFont, TRUE);
+    SendMessage(listView, WM_SETFONT, (WPARAM)hFont, TRUE);
+
+    return true;
+}
+
+LRESULT CALLBACK PerfPanel::WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    PerfPanel* panel = reinterpret_cast<PerfPanel*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+
+    switch (msg) {
+    case WM_CREATE: {
+        CREATESTRUCT* cs = (CREATESTRUCT*)lParam;
+        SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)cs->lpCreateParams);
+        return 0;
+    }
+
+    case WM_TIMER:
+        if (panel && wParam == REFRESH_TIMER) {
+            panel->Refresh();
+        }
+        return 0;
+
+    case WM_SIZE:
+        if (panel && wParam != SIZE_MINIMIZED) {
+            panel->OnSize(LOWORD(lParam), HIWORD(lParam));
+        }
+        return 0;
+
+    case WM_CLOSE:
+        if (panel) {
+            panel->OnClose();
+        }
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+void PerfPanel::OnClose() {
+    // Окно только прячется: закрытая панель не опрашивает сервис
+    KillTimer(hwnd, REFRESH_TIMER);
+    ShowWindow(hwnd, SW_HIDE);
+    previousCounts.clear();
+    previousUptimeMs = 0;
+}
+
+void PerfPanel::OnSize(int width, int height) {
+    if (width == 0 || height == 0) return;
+
+    SetWindowPos(summaryLabel, NULL, 10, 10, width - 20, 80, SWP_NOZORDER);
+    SetWindowPos(listView, NULL, 10, 95, width - 20, height - 105, SWP_NOZORDER);
+}
+
+void PerfPanel::Refresh() {
+    if (!serviceClient || !serviceClient->IsConnected()) {
+        SetWindowText(summaryLabel, L"Service: not connected");
+        return;
+    }
+
+    PerfReportData report = serviceClient->GetPerfReport();
+    if (report.uptimeMs == 0) {
+        return;
+    }
+
+    double elapsedSec = previousUptimeMs > 0 && report.uptimeMs > previousUptimeMs
+        ? (report.uptimeMs - previousUptimeMs) / 1000.0 : 0.0;
+
+    auto rateOf = [&](const std::string& name, uint64_t count) -> std::wstring {
+        auto it = previousCounts.find(name);
+        if (elapsedSec <= 0.0 || it == previousCounts.end() || count < it->second) return L"";
+        return FormatRate((count - it->second) / elapsedSec);
+    };
+
+    std::vector<std::vector<std::wstring>> newRows;
+    newRows.reserve(report.counters.size() + report.gauges.size() + report.timers.size());
+
+    for (const auto& [name, value] : report.counters) {
+        newRows.push_back({ Utils::StringToWString(name), std::to_wstring(value), rateOf(name, value),
+            L"", L"", L"", L"", L"" });
+    }
+    for (const auto& [name, value] : report.gauges) {
+        newRows.push_back({ Utils::StringToWString(name), std::to_wstring(value), L"",
+            L"", L"", L"", L"", L"" });
+    }
+    for (const auto& timer : report.timers) {
+        newRows.push_back({ Utils::StringToWString(timer.name), std::to_wstring(timer.count), rateOf(timer.name, timer.count),
+            std::to_wstring(timer.avgUs), std::to_wstring(timer.p50Us), std::to_wstring(timer.p99Us),
+            std::to_wstring(timer.p999Us), std::to_wstring(timer.maxUs) });
+    }
+
+    UpdateSummary(report, elapsedSec);
+    UpdateTable(newRows);
+
+    previousCounts.clear();
+    for (const auto& [name, value] : report.counters) previousCounts[name] = value;
+    for (const auto& timer : report.timers) previousCounts[timer.name] = timer.count;
+    previousUptimeMs = report.uptimeMs;
+}
+
+void PerfPanel::UpdateSummary(const PerfReportData& report, double elapsedSec) {
+    auto rate = [&](std::string_view name) -> double {
+        auto it = previousCounts.find(std::string(name));
+        uint64_t now = FindValue(report.counters, name);
+        if (elapsedSec <= 0.0 || it == previousCounts.end() || now < it->second) return 0.0;
+        return (now - it->second) / elapsedSec;
+    };
+    auto ratio = [&](std::string_view hits, std::string_view misses) -> std::wstring {
+        uint64_t h = FindValue(report.counters, hits);
+        uint64_t m = FindValue(report.counters, misses);
+        return h + m == 0 ? L"-" : std::format(L"{:.1f}%", h * 100.0 / (h + m));
+    };
+    auto latency = [&](std::string_view name) -> std::wstring {
+        const PerfTimerSample* timer = FindTimer(report, name);
+        return timer ? std::format(L"{}/{}/{} us", timer->p50Us, timer->p99Us, timer->p999Us) : L"-";
+    };
+
+    uint64_t natSize = FindValue(report.gauges, "DnsProxy.Nat.Size");
+    uint64_t natCapacity = FindValue(report.gauges, "DnsProxy.Nat.Capacity");
+
+    std::wstring text;
+    text += std::format(L"Throughput: {} flow events/s, {} DNS batches/s, {} routes added/s\r\n",
+        FormatRate(rate("NetworkMonitor.Recv.Events")),
+        FormatRate(rate("DnsProxy.Outbound.Batches") + rate("DnsProxy.Inbound.Batches")),
+        FormatRate(rate("RouteController.SystemRouteAdded")));
+    text += std::format(L"Latency p50/p99/p999: route add {}, capture {}, DNS {}\r\n",
+        latency("RouteAddLatency"), latency("NetworkMonitor.CaptureLatency"), latency("DnsProxy.OutboundLatency"));
+    text += std::format(L"Cache hits: DNS PID {}, process {}%, optimizer plan {}\r\n",
+        ratio("DnsProxy.PidCache.Hit", "DnsProxy.PidCache.Miss"),
+        FindValue(report.gauges, "ProcessManager.Cache.HitRatePercent"),
+        ratio("RouteOptimizer.CacheHit", "RouteOptimizer.CacheMiss"));
+    text += std::format(L"DNS NAT: {}/{}{}, TCP streams {}; program queue {}; flow ring {}",
+        natSize, natCapacity,
+        natCapacity > 0 ? std::format(L" ({:.0f}%)", natSize * 100.0 / natCapacity) : L"",
+        FindValue(report.gauges, "DnsProxy.Tcp.Streams"),
+        FindValue(report.gauges, "RouteController.ProgramQueue.Depth"),
+        FindValue(report.gauges, "NetworkMonitor.Ring.Occupancy"));
+
+    SetWindowText(summaryLabel, text.c_str());
+}
+
+void PerfPanel::UpdateTable(const std::vector<std::vector<std::wstring>>& newRows) {
+    bool rebuild = newRows.size() != rows.size();
+    for (size_t i = 0; !rebuild && i < newRows.size(); i++) {
+        rebuild = newRows[i][NAME] != rows[i][NAME];
+    }
+
+    if (rebuild) {
+        SendMessage(listView, WM_SETREDRAW, FALSE, 0);
+        ListView_DeleteAllItems(listView);
+        for (size_t i = 0; i < newRows.size(); i++) {
+            LVITEM item = { 0 };
+            item.mask = LVIF_TEXT;
+            item.iItem = static_cast<int>(i);
+            item.pszText = const_cast<LPWSTR>(newRows[i][NAME].c_str());
+            int index = ListView_InsertItem(listView, &item);
+            for (int column = VALUE; index != -1 && column < COLUMN_COUNT; column++) {
+                ListView_SetItemText(listView, index, column, const_cast<LPWSTR>(newRows[i][column].c_str()));
+            }
+        }
+        SendMessage(listView, WM_SETREDRAW, TRUE, 0);
+        InvalidateRect(listView, NULL, TRUE);
+        rows = newRows;
+        return;
+    }
+
+    // Набор метрик тот же: трогаем только изменившиеся ячейки, без мерцания и перестроения
+    for (size_t i = 0; i < newRows.size(); i++) {
+        for (int column = VALUE; column < COLUMN_COUNT; column++) {
+            if (newRows[i][column] != rows[i][column]) {
+                ListView_SetItemText(listView, static_cast<int>(i), column, const_cast<LPWSTR>(newRows[i][column].c_str()));
+                rows[i][column] = newRows[i][column];
+            }
+        }
+    }
+}
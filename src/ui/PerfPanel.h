@@ -0,0 +1,47 @@
+// src/ui/PerfPanel.h
+#pragma once
+#include <windows.h>
+#include <commctrl.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../common/Models.h"
+
+class ServiceClient;
+
+// Separate tool window with the service's live performance metrics: a summary
+// of throughput, latency percentiles, cache hit ratios and DNS NAT occupancy,
+// and a table of every counter, gauge and timer. Polls GetPerfReport once per
+// PERF_PANEL_REFRESH_MS only while the window is visible, and rewrites only
+// the table cells whose text changed.
+class PerfPanel {
+public:
+    PerfPanel(HINSTANCE instance, HWND owner, ServiceClient* client);
+    ~PerfPanel();
+
+    void Show();
+
+private:
+    static constexpr UINT_PTR REFRESH_TIMER = 1;
+
+    HINSTANCE hInstance;
+    HWND ownerWnd;
+    HWND hwnd;
+    HWND summaryLabel;
+    HWND listView;
+    ServiceClient* serviceClient;
+
+    // Предыдущий снимок для скоростей: имя -> count
+    std::unordered_map<std::string, uint64_t> previousCounts;
+    uint64_t previousUptimeMs;
+    std::vector<std::vector<std::wstring>> rows;    // Текст, уже выставленный в ячейках
+
+    static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+    bool CreatePanelWindow();
+    void Refresh();
+    void UpdateSummary(const PerfReportData& report, double elapsedSec);
+    void UpdateTable(const std::vector<std::vector<std::wstring>>& newRows);
+    void OnSize(int width, int height);
+    void OnClose();
+};
@@ -4,12 +4,14 @@
 #include <ws2tcpip.h>
 #include <windows.h>
 #include <windowsx.h>
+#include <shellapi.h>
 #include <commctrl.h>
 #include <tlhelp32.h>
 #include <psapi.h>
 #include <algorithm>
+#include <array>
+#include <cwctype>
 #include <unordered_set>
-#include <unordered_map>
 
 #include "ProcessPanel.h"
 #include "ServiceClient.h"
@@ -17,6 +19,7 @@
 #include "../common/Logger.h"
 
 #pragma comment(lib, "psapi.lib")
+#pragma comment(lib, "shell32.lib")
 
 #ifndef EM_SETCUEBANNER
 #define EM_SETCUEBANNER 0x1501
@@ -25,11 +28,16 @@
 ProcessPanel::ProcessPanel(HWND parent, ServiceClient* client)
     : parentWnd(parent), serviceClient(client), groupBox(nullptr), searchEdit(nullptr),
     availableListView(nullptr), selectedListView(nullptr), addButton(nullptr),
-    removeButton(nullptr), addAllButton(nullptr), removeAllButton(nullptr),
+    removeButton(nullptr), addAllButton(nullptr), removeAllButton(nullptr), imageList(nullptr),
+    processVersion(0), viewsDirty(true), defaultImage(-1),
     isUpdating(false), lastInteractionTime(0), isUserInteracting(false) {
 }
 
 ProcessPanel::~ProcessPanel() {
+    // Списки созданы с LVS_SHAREIMAGELISTS и сами его не уничтожают
+    if (imageList) {
+        ImageList_Destroy(imageList);
+    }
 }
 
 void ProcessPanel::Create(int x, int y, int width, int height) {
@@ -46,7 +54,7 @@ void ProcessPanel::Create(int x, int y, int width, int height) {
         }
     }
 
-    Refresh();
+    UpdateProcessList();
 }
 
 void ProcessPanel::CreateControls(int x, int y, int width, int height) {
@@ -67,7 +75,7 @@ void ProcessPanel::CreateControls(int x, int y, int width, int height) {
     int listHeight = height - 70;
 
     availableListView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, L"",
-        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS,
+        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS | LVS_OWNERDATA | LVS_SHAREIMAGELISTS,
         x + 10, y + 55, listWidth, listHeight,
         parentWnd, (HMENU)3002, hInstance, nullptr);
 
@@ -98,13 +106,25 @@ void ProcessPanel::CreateControls(int x, int y, int width, int height) {
         parentWnd, (HMENU)3006, hInstance, nullptr);
 
     selectedListView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, L"",
-        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS,
+        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS | LVS_OWNERDATA | LVS_SHAREIMAGELISTS,
         buttonX + 40, y + 55, listWidth, listHeight,
         parentWnd, (HMENU)3007, hInstance, nullptr);
 
     ListView_SetExtendedListViewStyle(selectedListView,
         LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES | LVS_EX_DOUBLEBUFFER);
 
+    // Общий список иконок; иконки процессов добавляются по мере отрисовки
+    imageList = ImageList_Create(GetSystemMetrics(SM_CXSMICON), GetSystemMetrics(SM_CYSMICON),
+        ILC_COLOR32 | ILC_MASK, 32, 32);
+    SHFILEINFOW fileInfo = { 0 };
+    if (SHGetFileInfoW(L".exe", FILE_ATTRIBUTE_NORMAL, &fileInfo, sizeof(fileInfo),
+        SHGFI_USEFILEATTRIBUTES | SHGFI_ICON | SHGFI_SMALLICON) && fileInfo.hIcon) {
+        defaultImage = ImageList_AddIcon(imageList, fileInfo.hIcon);
+        DestroyIcon(fileInfo.hIcon);
+    }
+    ListView_SetImageList(availableListView, imageList, LVSIL_SMALL);
+    ListView_SetImageList(selectedListView, imageList, LVSIL_SMALL);
+
     LVCOLUMN column = { 0 };
     column.mask = LVCF_TEXT | LVCF_WIDTH;
 
@@ -120,345 +140,237 @@ void ProcessPanel::CreateControls(int x, int y, int width, int height) {
 void ProcessPanel::Refresh() {
     if (serviceClient && serviceClient->IsConnected()) {
         auto config = serviceClient->GetConfig();
-        selectedProcesses = config.selectedProcesses;
-        Logger::Instance().Info("ProcessPanel::Refresh - Reloaded selected processes: " +
-            std::to_string(selectedProcesses.size()));
+        if (config.selectedProcesses != selectedProcesses) {
+            selectedProcesses = config.selectedProcesses;
+            viewsDirty = true;
+            Logger::Instance().Info("ProcessPanel::Refresh - Reloaded selected processes: " +
+                std::to_string(selectedProcesses.size()));
+        }
     }
 
     UpdateProcessList();
 }
 
-std::wstring ProcessPanel::GetBaseProcessNameFromDisplayName(const std::wstring& displayName) {
-    size_t notRunningPos = displayName.find(L" (Not running)");
-    if (notRunningPos != std::wstring::npos) {
-        return displayName.substr(0, notRunningPos);
-    }
-
-    size_t lastSpace = displayName.find_last_of(L' ');
-    if (lastSpace != std::wstring::npos &&
-        displayName.length() > lastSpace + 1 &&
-        displayName[lastSpace + 1] == L'(') {
-        if (displayName.back() == L')') {
-            return displayName.substr(0, lastSpace);
-        }
-    }
-
-    return displayName;
+bool ProcessPanel::IsUserInteracting() const {
+    DWORD currentTime = GetTickCount();
+    return (currentTime - lastInteractionTime) < 2000;
 }
 
-ProcessPanel::ScrollState ProcessPanel::SaveDetailedScrollPosition(HWND listView) {
-    ScrollState state;
-
-    state.topIndex = ListView_GetTopIndex(listView);
-
-    if (state.topIndex >= 0) {
-        RECT itemRect;
-        if (ListView_GetItemRect(listView, state.topIndex, &itemRect, LVIR_BOUNDS)) {
-            RECT clientRect;
-            GetClientRect(listView, &clientRect);
-            state.pixelOffset = itemRect.top - clientRect.top;
-        }
-    }
-
-    state.scrollInfo.cbSize = sizeof(SCROLLINFO);
-    state.scrollInfo.fMask = SIF_ALL;
-    GetScrollInfo(listView, SB_VERT, &state.scrollInfo);
+void ProcessPanel::OnUserInteraction() {
+    lastInteractionTime = GetTickCount();
+    isUserInteracting = true;
+}
 
-    int selectedIndex = ListView_GetNextItem(listView, -1, LVNI_SELECTED);
-    if (selectedIndex >= 0) {
-        state.selectedItemName = GetBaseProcessNameFromDisplayName(GetItemText(listView, selectedIndex));
-        state.hasSelection = true;
+void ProcessPanel::UpdateProcessList() {
+    if (IsUserInteracting()) {
+        LOG_DEBUG("UpdateProcessList: Skipped - user is interacting");
+        return;
     }
 
-    int focusedIndex = ListView_GetNextItem(listView, -1, LVNI_FOCUSED);
-    if (focusedIndex >= 0) {
-        state.focusedItemName = GetBaseProcessNameFromDisplayName(GetItemText(listView, focusedIndex));
+    ProcessListDelta delta;
+    if (serviceClient && serviceClient->IsConnected()) {
+        if (!serviceClient->GetProcessChangesSince(processVersion, delta)) {
+            LOG_DEBUG("UpdateProcessList: Process changes request failed");
+            return;
+        }
     }
-
-    Logger::Instance().Debug("SaveScrollPosition: topIndex=" + std::to_string(state.topIndex) +
-        ", pixelOffset=" + std::to_string(state.pixelOffset));
-
-    return state;
-}
-
-void ProcessPanel::RestoreDetailedScrollPosition(HWND listView, const ScrollState& state) {
-    if (state.topIndex < 0 && state.selectedItemName.empty() && state.focusedItemName.empty()) {
-        return;
+    else {
+        delta = LoadLocalProcesses();
     }
 
-    int itemCount = ListView_GetItemCount(listView);
-    if (itemCount == 0) {
+    bool changed = delta.fullResync || !delta.upserts.empty() || !delta.removed.empty();
+    if (!changed && !viewsDirty) {
+        processVersion = delta.version;
         return;
     }
 
-    int targetIndex = -1;
+    // Указатели в availableView перестанут быть действительными, поэтому имена берём заранее
+    std::wstring availableName = GetSelectedName(availableListView);
+    std::wstring selectedName = GetSelectedName(selectedListView);
 
-    if (state.topIndex >= 0 && state.topIndex < itemCount) {
-        targetIndex = state.topIndex;
-    }
+    size_t upserts = delta.upserts.size();
+    size_t removed = delta.removed.size();
+    bool fullResync = delta.fullResync;
+    ApplyProcessDelta(std::move(delta));
+    RebuildViews();
 
-    if (targetIndex == -1 && !state.selectedItemName.empty()) {
-        for (int i = 0; i < itemCount; i++) {
-            std::wstring itemName = GetBaseProcessNameFromDisplayName(GetItemText(listView, i));
-            if (itemName == state.selectedItemName) {
-                targetIndex = i;
-                break;
-            }
+    isUpdating = true;
+    for (int i = 0; i < static_cast<int>(availableView.size()); i++) {
+        if (!availableName.empty() && availableView[i]->name == availableName) {
+            SelectItem(availableListView, i);
+            break;
         }
     }
-
-    if (targetIndex == -1 && !state.focusedItemName.empty()) {
-        for (int i = 0; i < itemCount; i++) {
-            std::wstring itemName = GetBaseProcessNameFromDisplayName(GetItemText(listView, i));
-            if (itemName == state.focusedItemName) {
-                targetIndex = i;
-                break;
-            }
+    for (int i = 0; i < static_cast<int>(selectedView.size()); i++) {
+        if (!selectedName.empty() && selectedView[i].name == selectedName) {
+            SelectItem(selectedListView, i);
+            break;
         }
     }
+    isUpdating = false;
 
-    if (targetIndex >= 0) {
-        ListView_EnsureVisible(listView, targetIndex, FALSE);
+    LOG_DEBUG("ProcessPanel::UpdateProcessList - {}: {} upserts, {} removed; available {}, selected {}",
+        fullResync ? "full list" : "delta", upserts, removed, availableView.size(), selectedView.size());
+}
 
-        RECT currentItemRect;
-        if (ListView_GetItemRect(listView, targetIndex, &currentItemRect, LVIR_BOUNDS)) {
-            int scrollAmount = currentItemRect.top - state.pixelOffset;
-            if (scrollAmount != 0) {
-                ListView_Scroll(listView, 0, scrollAmount);
-            }
-        }
+// Без сервиса список строим сами - так же, как его строил бы сервис при полной синхронизации
+ProcessListDelta ProcessPanel::LoadLocalProcesses() {
+    ProcessListDelta delta;
+    delta.fullResync = true;
 
-        if (state.hasSelection && !state.selectedItemName.empty()) {
-            for (int i = 0; i < itemCount; i++) {
-                std::wstring itemName = GetBaseProcessNameFromDisplayName(GetItemText(listView, i));
-                if (itemName == state.selectedItemName) {
-                    ListView_SetItemState(listView, i, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
-                    break;
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return delta;
+    }
+
+    PROCESSENTRY32W pe32;
+    pe32.dwSize = sizeof(PROCESSENTRY32W);
+    if (Process32FirstW(snapshot, &pe32)) {
+        do {
+            ProcessInfo process{};
+            process.pid = pe32.th32ProcessID;
+            process.name = pe32.szExeFile;
+
+            HANDLE handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pe32.th32ProcessID);
+            if (handle) {
+                wchar_t path[MAX_PATH];
+                DWORD size = MAX_PATH;
+                if (QueryFullProcessImageNameW(handle, 0, path, &size)) {
+                    process.executablePath = path;
                 }
+                CloseHandle(handle);
             }
-        }
 
-        Logger::Instance().Debug("RestoreScrollPosition: Restored to index " + std::to_string(targetIndex));
+            delta.upserts.push_back(std::move(process));
+        } while (Process32NextW(snapshot, &pe32));
     }
-}
+    CloseHandle(snapshot);
 
-bool ProcessPanel::IsUserInteracting() const {
-    DWORD currentTime = GetTickCount();
-    return (currentTime - lastInteractionTime) < 2000;
+    // Версия 0 ниже любой версии сервиса: после подключения придёт полный список
+    delta.version = 0;
+    return delta;
 }
 
-void ProcessPanel::OnUserInteraction() {
-    lastInteractionTime = GetTickCount();
-    isUserInteracting = true;
-}
-
-void ProcessPanel::UpdateProcessList() {
-    if (IsUserInteracting()) {
-        Logger::Instance().Debug("UpdateProcessList: Skipped - user is interacting");
-        return;
+void ProcessPanel::ApplyProcessDelta(ProcessListDelta&& delta) {
+    if (delta.fullResync) {
+        processes.clear();
+        rows.clear();
     }
 
-    isUpdating = true;
-
-    char searchText[256] = "";
-    GetWindowTextA(searchEdit, searchText, sizeof(searchText));
-    std::string currentSearchFilter = searchText;
-    std::transform(currentSearchFilter.begin(), currentSearchFilter.end(),
-        currentSearchFilter.begin(), ::tolower);
-
-    bool searchChanged = (currentSearchFilter != lastSearchFilter);
-    lastSearchFilter = currentSearchFilter;
-
-    ScrollState availableScrollState;
-    ScrollState selectedScrollState;
-    if (!searchChanged) {
-        availableScrollState = SaveDetailedScrollPosition(availableListView);
-        selectedScrollState = SaveDetailedScrollPosition(selectedListView);
+    for (const ProcessKey& key : delta.removed) {
+        auto it = processes.find(key.pid);
+        // Надгробие мог обогнать новый процесс с тем же PID
+        if (it != processes.end() && it->second.creationTime == key.creationTime) {
+            RemoveInstance(it->second);
+            processes.erase(it);
+        }
     }
 
-    Logger::Instance().Info("ProcessPanel::UpdateProcessList - Starting with " +
-        std::to_string(selectedProcesses.size()) + " selected processes");
-
-    availableProcesses.clear();
-    selectedProcessesDisplay.clear();
-
-    // Build case-insensitive selected set (lowercase keys)
-    std::unordered_set<std::string> selectedSet;
-    for (const auto& proc : selectedProcesses) {
-        std::string lower = proc;
-        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-        selectedSet.insert(lower);
+    for (ProcessInfo& process : delta.upserts) {
+        auto [it, inserted] = processes.try_emplace(process.pid);
+        if (!inserted) {
+            RemoveInstance(it->second);
+        }
+        it->second = std::move(process);
+        AddInstance(it->second);
     }
 
-    std::unordered_map<std::string, ProcessDisplayInfo> runningSelected;
-
-    std::unordered_map<std::wstring, ProcessDisplayInfo> uniqueProcesses;
+    processVersion = delta.version;
+    viewsDirty = true;
+}
 
-    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-    if (snapshot != INVALID_HANDLE_VALUE) {
-        PROCESSENTRY32W pe32;
-        pe32.dwSize = sizeof(PROCESSENTRY32W);
-
-        if (Process32FirstW(snapshot, &pe32)) {
-            do {
-                std::wstring processName = pe32.szExeFile;
-                std::string processNameStr = Utils::WStringToString(processName);
-
-                if (processNameStr == "System" || processNameStr == "Registry" ||
-                    processNameStr == "Idle" || processNameStr.empty() ||
-                    processNameStr.contains("svchost") ||
-                    processNameStr.contains("RuntimeBroker") ||
-                    processNameStr.contains("backgroundTask") ||
-                    processNameStr.contains("conhost")) {
-                    continue;
-                }
+void ProcessPanel::AddInstance(const ProcessInfo& process) {
+    if (process.name.empty()) {
+        return;
+    }
 
-                if (uniqueProcesses.find(processName) == uniqueProcesses.end()) {
-                    // Case-insensitive check if this process is selected
-                    std::string processNameLower = processNameStr;
-                    std::transform(processNameLower.begin(), processNameLower.end(), processNameLower.begin(), ::tolower);
-                    bool isSelected = (selectedSet.find(processNameLower) != selectedSet.end());
-
-                    std::wstring processPath;
-                    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pe32.th32ProcessID);
-                    if (process) {
-                        wchar_t path[MAX_PATH];
-                        DWORD size = MAX_PATH;
-                        if (QueryFullProcessImageNameW(process, 0, path, &size)) {
-                            processPath = path;
-
-                            std::wstring pathLower = processPath;
-                            std::transform(pathLower.begin(), pathLower.end(), pathLower.begin(), ::tolower);
-
-                            // Don't filter out selected processes even if they're in system paths
-                            if (!isSelected &&
-                                (pathLower.contains(L"windows\\system32") ||
-                                pathLower.contains(L"windows\\syswow64") ||
-                                pathLower.contains(L"\\windowsapps\\"))) {
-                                CloseHandle(process);
-                                continue;
-                            }
-                        }
-                        CloseHandle(process);
-                    }
-
-                    ProcessDisplayInfo info;
-                    info.name = processName;
-                    info.path = processPath;
-                    info.isRunning = true;
-                    info.isSelected = isSelected;
-
-                    uniqueProcesses[processName] = info;
-
-                    if (info.isSelected) {
-                        // Store with lowercase key for case-insensitive lookup
-                        runningSelected[processNameLower] = info;
-                    }
-                }
+    auto [it, inserted] = rows.try_emplace(ToLower(process.name));
+    ProcessRow& row = it->second;
+    if (inserted) {
+        static constexpr std::array<std::wstring_view, 4> hiddenParts = {
+            L"svchost", L"runtimebroker", L"backgroundtask", L"conhost"
+        };
+        const std::wstring& lower = it->first;
+        row.name = process.name;
+        row.systemProcess = lower == L"system" || lower == L"registry" || lower == L"idle" ||
+            std::ranges::any_of(hiddenParts, [&lower](std::wstring_view part) { return lower.contains(part); });
+    }
+    if (row.path.empty() && !process.executablePath.empty()) {
+        row.path = process.executablePath;
+        std::wstring pathLower = ToLower(row.path);
+        row.systemProcess = row.systemProcess ||
+            pathLower.contains(L"windows\\system32") ||
+            pathLower.contains(L"windows\\syswow64") ||
+            pathLower.contains(L"\\windowsapps\\");
+    }
+    row.instances++;
+}
 
-            } while (Process32NextW(snapshot, &pe32));
-        }
-        CloseHandle(snapshot);
+void ProcessPanel::RemoveInstance(const ProcessInfo& process) {
+    if (process.name.empty()) {
+        return;
     }
 
-    for (const auto& [name, info] : uniqueProcesses) {
-        if (!info.isSelected) {
-            if (!currentSearchFilter.empty()) {
-                std::string nameLower = Utils::WStringToString(info.name);
-                std::transform(nameLower.begin(), nameLower.end(), nameLower.begin(), ::tolower);
-                if (!nameLower.contains(currentSearchFilter)) {
-                    continue;
-                }
-            }
-
-            availableProcesses.push_back(info);
-        }
+    auto it = rows.find(ToLower(process.name));
+    if (it != rows.end() && --it->second.instances <= 0) {
+        rows.erase(it);
     }
+}
 
+void ProcessPanel::RebuildViews() {
+    std::unordered_set<std::wstring> selectedSet;
+    selectedView.clear();
+    selectedView.reserve(selectedProcesses.size());
     for (const auto& selectedName : selectedProcesses) {
-        // Case-insensitive lookup
-        std::string selectedNameLower = selectedName;
-        std::transform(selectedNameLower.begin(), selectedNameLower.end(), selectedNameLower.begin(), ::tolower);
-        auto it = runningSelected.find(selectedNameLower);
-        if (it != runningSelected.end()) {
-            selectedProcessesDisplay.push_back(it->second);
-        }
-        else {
-            ProcessDisplayInfo info;
-            info.name = Utils::StringToWString(selectedName);
-            info.path = L"(Not running)";
-            info.isSelected = true;
-            info.isRunning = false;
-            selectedProcessesDisplay.push_back(info);
+        SelectedRow selected;
+        selected.configName = selectedName;
+        selected.name = Utils::StringToWString(selectedName);
+        std::wstring lower = ToLower(selected.name);
+        if (auto it = rows.find(lower); it != rows.end()) {
+            selected.running = &it->second;
+            selected.name = it->second.name;
         }
+        selectedSet.insert(std::move(lower));
+        selectedView.push_back(std::move(selected));
     }
-
-    std::sort(availableProcesses.begin(), availableProcesses.end(),
-        [](const ProcessDisplayInfo& a, const ProcessDisplayInfo& b) {
-            return _wcsicmp(a.name.c_str(), b.name.c_str()) < 0;
+    std::ranges::sort(selectedView, [](const SelectedRow& a, const SelectedRow& b) {
+        return _wcsicmp(a.name.c_str(), b.name.c_str()) < 0;
         });
 
-    std::sort(selectedProcessesDisplay.begin(), selectedProcessesDisplay.end(),
-        [](const ProcessDisplayInfo& a, const ProcessDisplayInfo& b) {
-            return _wcsicmp(a.name.c_str(), b.name.c_str()) < 0;
-        });
-
-    LockWindowUpdate(parentWnd);
-
-    ListView_DeleteAllItems(availableListView);
-
-    for (size_t i = 0; i < availableProcesses.size(); i++) {
-        const auto& proc = availableProcesses[i];
-
-        LVITEM item = { 0 };
-        item.mask = LVIF_TEXT;
-        item.iItem = static_cast<int>(i);
-        item.pszText = const_cast<LPWSTR>(proc.name.c_str());
-
-        ListView_InsertItem(availableListView, &item);
-    }
-
-    ListView_DeleteAllItems(selectedListView);
-
-    for (size_t i = 0; i < selectedProcessesDisplay.size(); i++) {
-        const auto& proc = selectedProcessesDisplay[i];
-
-        LVITEM item = { 0 };
-        item.mask = LVIF_TEXT;
-        item.iItem = static_cast<int>(i);
-
-        std::wstring displayName = proc.name;
-        if (!proc.isRunning) {
-            displayName += L" (Not running)";
+    // rows упорядочены по имени в нижнем регистре - сортировать не нужно
+    availableView.clear();
+    for (const auto& [lower, row] : rows) {
+        if (row.systemProcess || selectedSet.contains(lower)) {
+            continue;
         }
-        item.pszText = const_cast<LPWSTR>(displayName.c_str());
-
-        ListView_InsertItem(selectedListView, &item);
+        if (!filter.empty() && !lower.contains(filter)) {
+            continue;
+        }
+        availableView.push_back(&row);
     }
 
-    LockWindowUpdate(NULL);
+    // Позиция прокрутки сохраняется; перерисуются только видимые строки
+    isUpdating = true;
+    ListView_SetItemState(availableListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemState(selectedListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemCountEx(availableListView, static_cast<int>(availableView.size()), LVSICF_NOSCROLL);
+    ListView_SetItemCountEx(selectedListView, static_cast<int>(selectedView.size()), LVSICF_NOSCROLL);
+    isUpdating = false;
+    InvalidateRect(availableListView, NULL, FALSE);
+    InvalidateRect(selectedListView, NULL, FALSE);
 
     LVCOLUMN column = { 0 };
     column.mask = LVCF_TEXT;
 
-    std::wstring availableHeader = L"Available Processes (" + std::to_wstring(availableProcesses.size()) + L")";
+    std::wstring availableHeader = L"Available Processes (" + std::to_wstring(availableView.size()) + L")";
     column.pszText = const_cast<LPWSTR>(availableHeader.c_str());
     ListView_SetColumn(availableListView, 0, &column);
 
-    std::wstring selectedHeader = L"Selected Processes (" + std::to_wstring(selectedProcessesDisplay.size()) + L")";
+    std::wstring selectedHeader = L"Selected Processes (" + std::to_wstring(selectedView.size()) + L")";
     column.pszText = const_cast<LPWSTR>(selectedHeader.c_str());
     ListView_SetColumn(selectedListView, 0, &column);
 
-    if (!searchChanged) {
-        RestoreDetailedScrollPosition(availableListView, availableScrollState);
-        RestoreDetailedScrollPosition(selectedListView, selectedScrollState);
-    }
-
-    isUpdating = false;
-
-    Logger::Instance().Info("ProcessPanel::UpdateProcessList completed - Available: " +
-        std::to_string(availableProcesses.size()) + ", Selected: " +
-        std::to_string(selectedProcessesDisplay.size()));
+    viewsDirty = false;
 }
 
 void ProcessPanel::HandleCommand(WPARAM wParam) {
@@ -487,12 +399,19 @@ void ProcessPanel::HandleCommand(WPARAM wParam) {
 }
 
 void ProcessPanel::HandleNotify(LPNMHDR pnmh) {
-    if (pnmh->code == LVN_BEGINSCROLL) {
-        OnUserInteraction();
-        Logger::Instance().Debug("User scrolling detected");
+    if (pnmh->hwndFrom != availableListView && pnmh->hwndFrom != selectedListView) {
+        return;
     }
 
-    if (pnmh->code == NM_DBLCLK) {
+    switch (pnmh->code) {
+    case LVN_GETDISPINFO:
+        OnGetDispInfo(pnmh->hwndFrom, reinterpret_cast<NMLVDISPINFO*>(pnmh));
+        break;
+    case LVN_BEGINSCROLL:
+        OnUserInteraction();
+        LOG_DEBUG("User scrolling detected");
+        break;
+    case NM_DBLCLK:
         OnUserInteraction();
         if (pnmh->idFrom == 3002) {
             OnAddProcess();
@@ -500,41 +419,92 @@ void ProcessPanel::HandleNotify(LPNMHDR pnmh) {
         else if (pnmh->idFrom == 3007) {
             OnRemoveProcess();
         }
+        break;
+    case LVN_ITEMCHANGED:
+        // Выделение, которое панель восстанавливает сама, не считается действием пользователя
+        if (!isUpdating) {
+            OnUserInteraction();
+        }
+        break;
+    case NM_HOVER:
+        OnUserInteraction();
+        break;
     }
+}
 
-    if (pnmh->code == LVN_ITEMCHANGED) {
-        OnUserInteraction();
+void ProcessPanel::OnGetDispInfo(HWND listView, NMLVDISPINFO* info) {
+    int index = info->item.iItem;
+    const ProcessRow* row = nullptr;
+    std::wstring text;
+
+    if (listView == availableListView) {
+        if (index < 0 || index >= static_cast<int>(availableView.size())) {
+            return;
+        }
+        row = availableView[index];
+        text = row->name;
+    }
+    else {
+        if (index < 0 || index >= static_cast<int>(selectedView.size())) {
+            return;
+        }
+        const SelectedRow& selected = selectedView[index];
+        row = selected.running;
+        text = row ? selected.name : selected.name + L" (Not running)";
     }
 
-    if (pnmh->code == NM_HOVER) {
-        OnUserInteraction();
+    if (info->item.mask & LVIF_TEXT) {
+        wcsncpy_s(info->item.pszText, info->item.cchTextMax, text.c_str(), _TRUNCATE);
+    }
+    if (info->item.mask & LVIF_IMAGE) {
+        info->item.iImage = row ? ResolveImage(row->path) : defaultImage;
     }
 }
 
+int ProcessPanel::ResolveImage(const std::wstring& path) {
+    if (path.empty() || !imageList) {
+        return defaultImage;
+    }
+
+    // Иконку читаем из файла только для видимых строк и один раз на путь
+    auto [it, inserted] = imageByPath.try_emplace(path, defaultImage);
+    if (inserted) {
+        SHFILEINFOW fileInfo = { 0 };
+        if (SHGetFileInfoW(path.c_str(), 0, &fileInfo, sizeof(fileInfo), SHGFI_ICON | SHGFI_SMALLICON) && fileInfo.hIcon) {
+            int image = ImageList_AddIcon(imageList, fileInfo.hIcon);
+            DestroyIcon(fileInfo.hIcon);
+            if (image >= 0) {
+                it->second = image;
+            }
+        }
+    }
+    return it->second;
+}
+
 int ProcessPanel::GetSelectedIndex(HWND listView) {
     return ListView_GetNextItem(listView, -1, LVNI_SELECTED);
 }
 
-std::wstring ProcessPanel::GetItemText(HWND listView, int index) {
-    if (index < 0) return L"";
-
-    wchar_t buffer[256] = { 0 };
-    LVITEM item = { 0 };
-    item.mask = LVIF_TEXT;
-    item.iItem = index;
-    item.pszText = buffer;
-    item.cchTextMax = 256;
-
-    if (ListView_GetItem(listView, &item)) {
-        return std::wstring(buffer);
+std::wstring ProcessPanel::GetSelectedName(HWND listView) {
+    int index = GetSelectedIndex(listView);
+    if (listView == availableListView && index >= 0 && index < static_cast<int>(availableView.size())) {
+        return availableView[index]->name;
+    }
+    if (listView == selectedListView && index >= 0 && index < static_cast<int>(selectedView.size())) {
+        return selectedView[index].name;
     }
     return L"";
 }
 
+void ProcessPanel::SelectItem(HWND listView, int index) {
+    ListView_SetItemState(listView, index, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_EnsureVisible(listView, index, FALSE);
+}
+
 void ProcessPanel::OnAddProcess() {
     int index = GetSelectedIndex(availableListView);
-    if (index >= 0 && index < availableProcesses.size()) {
-        std::string processName = Utils::WStringToString(availableProcesses[index].name);
+    if (index >= 0 && index < static_cast<int>(availableView.size())) {
+        std::string processName = Utils::WStringToString(availableView[index]->name);
 
         if (std::find(selectedProcesses.begin(), selectedProcesses.end(), processName) == selectedProcesses.end()) {
             selectedProcesses.push_back(processName);
@@ -551,15 +521,8 @@ void ProcessPanel::OnAddProcess() {
 
 void ProcessPanel::OnRemoveProcess() {
     int index = GetSelectedIndex(selectedListView);
-    if (index >= 0 && index < selectedProcessesDisplay.size()) {
-        std::wstring processName = selectedProcessesDisplay[index].name;
-
-        size_t pos = processName.find(L" (Not running)");
-        if (pos != std::wstring::npos) {
-            processName = processName.substr(0, pos);
-        }
-
-        std::string processNameStr = Utils::WStringToString(processName);
+    if (index >= 0 && index < static_cast<int>(selectedView.size())) {
+        std::string processNameStr = selectedView[index].configName;
 
         auto it = std::find(selectedProcesses.begin(), selectedProcesses.end(), processNameStr);
         if (it != selectedProcesses.end()) {
@@ -576,8 +539,8 @@ void ProcessPanel::OnRemoveProcess() {
 }
 
 void ProcessPanel::OnAddAllProcesses() {
-    for (const auto& proc : availableProcesses) {
-        std::string processName = Utils::WStringToString(proc.name);
+    for (const ProcessRow* row : availableView) {
+        std::string processName = Utils::WStringToString(row->name);
         if (std::find(selectedProcesses.begin(), selectedProcesses.end(), processName) == selectedProcesses.end()) {
             selectedProcesses.push_back(processName);
         }
@@ -603,212 +566,36 @@ void ProcessPanel::OnRemoveAllProcesses() {
 }
 
 void ProcessPanel::OnSearchChanged() {
-    UpdateProcessList();
+    wchar_t buffer[256] = { 0 };
+    GetWindowText(searchEdit, buffer, static_cast<int>(std::size(buffer)));
+    std::wstring newFilter = ToLower(buffer);
+    if (newFilter == filter) {
+        return;
+    }
+    filter = std::move(newFilter);
+    RebuildViews();
 }
 
+// Список процессов не меняется - только раскладка по двум спискам
 void ProcessPanel::UpdateListsImmediately() {
     int availableIndex = GetSelectedIndex(availableListView);
     int selectedIndex = GetSelectedIndex(selectedListView);
 
-    std::wstring availableSelectedName;
-    std::wstring selectedSelectedName;
-
-    if (availableIndex >= 0 && availableIndex < availableProcesses.size()) {
-        availableSelectedName = availableProcesses[availableIndex].name;
-    }
-
-    if (selectedIndex >= 0 && selectedIndex < selectedProcessesDisplay.size()) {
-        selectedSelectedName = selectedProcessesDisplay[selectedIndex].name;
-    }
-
-    SendMessage(availableListView, WM_SETREDRAW, FALSE, 0);
-    SendMessage(selectedListView, WM_SETREDRAW, FALSE, 0);
-
-    ListView_DeleteAllItems(availableListView);
-    ListView_DeleteAllItems(selectedListView);
-
-    availableProcesses.clear();
-    selectedProcessesDisplay.clear();
-
-    // Build case-insensitive selected set (lowercase keys)
-    std::unordered_set<std::string> selectedSet;
-    for (const auto& proc : selectedProcesses) {
-        std::string lower = proc;
-        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-        selectedSet.insert(lower);
-    }
-
-    char searchText[256] = "";
-    GetWindowTextA(searchEdit, searchText, sizeof(searchText));
-    std::string currentSearchFilter = searchText;
-    std::transform(currentSearchFilter.begin(), currentSearchFilter.end(),
-        currentSearchFilter.begin(), ::tolower);
+    RebuildViews();
 
-    std::unordered_map<std::wstring, ProcessDisplayInfo> uniqueProcesses;
-    std::unordered_map<std::string, ProcessDisplayInfo> runningSelected;
-
-    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-    if (snapshot != INVALID_HANDLE_VALUE) {
-        PROCESSENTRY32W pe32;
-        pe32.dwSize = sizeof(PROCESSENTRY32W);
-
-        if (Process32FirstW(snapshot, &pe32)) {
-            do {
-                std::wstring processName = pe32.szExeFile;
-                std::string processNameStr = Utils::WStringToString(processName);
-
-                if (processNameStr == "System" || processNameStr == "Registry" ||
-                    processNameStr == "Idle" || processNameStr.empty() ||
-                    processNameStr.contains("svchost") ||
-                    processNameStr.contains("RuntimeBroker") ||
-                    processNameStr.contains("backgroundTask") ||
-                    processNameStr.contains("conhost")) {
-                    continue;
-                }
-
-                if (uniqueProcesses.find(processName) == uniqueProcesses.end()) {
-                    // Case-insensitive check if this process is selected
-                    std::string processNameLower = processNameStr;
-                    std::transform(processNameLower.begin(), processNameLower.end(), processNameLower.begin(), ::tolower);
-                    bool isSelected = (selectedSet.find(processNameLower) != selectedSet.end());
-
-                    std::wstring processPath;
-                    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pe32.th32ProcessID);
-                    if (process) {
-                        wchar_t path[MAX_PATH];
-                        DWORD size = MAX_PATH;
-                        if (QueryFullProcessImageNameW(process, 0, path, &size)) {
-                            processPath = path;
-
-                            std::wstring pathLower = processPath;
-                            std::transform(pathLower.begin(), pathLower.end(), pathLower.begin(), ::tolower);
-
-                            // Don't filter out selected processes even if they're in system paths
-                            if (!isSelected &&
-                                (pathLower.contains(L"windows\\system32") ||
-                                pathLower.contains(L"windows\\syswow64") ||
-                                pathLower.contains(L"\\windowsapps\\"))) {
-                                CloseHandle(process);
-                                continue;
-                            }
-                        }
-                        CloseHandle(process);
-                    }
-
-                    ProcessDisplayInfo info;
-                    info.name = processName;
-                    info.path = processPath;
-                    info.isRunning = true;
-                    info.isSelected = isSelected;
-
-                    uniqueProcesses[processName] = info;
-
-                    if (info.isSelected) {
-                        // Store with lowercase key for case-insensitive lookup
-                        runningSelected[processNameLower] = info;
-                    }
-                }
-
-            } while (Process32NextW(snapshot, &pe32));
-        }
-        CloseHandle(snapshot);
-    }
-
-    for (const auto& [name, info] : uniqueProcesses) {
-        if (!info.isSelected) {
-            if (!currentSearchFilter.empty()) {
-                std::string nameLower = Utils::WStringToString(info.name);
-                std::transform(nameLower.begin(), nameLower.end(), nameLower.begin(), ::tolower);
-                if (!nameLower.contains(currentSearchFilter)) {
-                    continue;
-                }
-            }
-
-            availableProcesses.push_back(info);
-        }
-    }
-
-    for (const auto& selectedName : selectedProcesses) {
-        // Case-insensitive lookup
-        std::string selectedNameLower = selectedName;
-        std::transform(selectedNameLower.begin(), selectedNameLower.end(), selectedNameLower.begin(), ::tolower);
-        auto it = runningSelected.find(selectedNameLower);
-        if (it != runningSelected.end()) {
-            selectedProcessesDisplay.push_back(it->second);
-        }
-        else {
-            ProcessDisplayInfo info;
-            info.name = Utils::StringToWString(selectedName);
-            info.path = L"(Not running)";
-            info.isSelected = true;
-            info.isRunning = false;
-            selectedProcessesDisplay.push_back(info);
-        }
-    }
-
-    std::sort(availableProcesses.begin(), availableProcesses.end(),
-        [](const ProcessDisplayInfo& a, const ProcessDisplayInfo& b) {
-            return _wcsicmp(a.name.c_str(), b.name.c_str()) < 0;
-        });
-
-    std::sort(selectedProcessesDisplay.begin(), selectedProcessesDisplay.end(),
-        [](const ProcessDisplayInfo& a, const ProcessDisplayInfo& b) {
-            return _wcsicmp(a.name.c_str(), b.name.c_str()) < 0;
-        });
-
-    for (size_t i = 0; i < availableProcesses.size(); i++) {
-        const auto& proc = availableProcesses[i];
-
-        LVITEM item = { 0 };
-        item.mask = LVIF_TEXT;
-        item.iItem = static_cast<int>(i);
-        item.pszText = const_cast<LPWSTR>(proc.name.c_str());
-
-        ListView_InsertItem(availableListView, &item);
-    }
-
-    for (size_t i = 0; i < selectedProcessesDisplay.size(); i++) {
-        const auto& proc = selectedProcessesDisplay[i];
-
-        LVITEM item = { 0 };
-        item.mask = LVIF_TEXT;
-        item.iItem = static_cast<int>(i);
-
-        std::wstring displayName = proc.name;
-        if (!proc.isRunning) {
-            displayName += L" (Not running)";
-        }
-        item.pszText = const_cast<LPWSTR>(displayName.c_str());
-
-        ListView_InsertItem(selectedListView, &item);
+    isUpdating = true;
+    if (availableIndex >= 0 && !availableView.empty()) {
+        SelectItem(availableListView, (std::min)(availableIndex, static_cast<int>(availableView.size()) - 1));
     }
-
-    LVCOLUMN column = { 0 };
-    column.mask = LVCF_TEXT;
-
-    std::wstring availableHeader = L"Available Processes (" + std::to_wstring(availableProcesses.size()) + L")";
-    column.pszText = const_cast<LPWSTR>(availableHeader.c_str());
-    ListView_SetColumn(availableListView, 0, &column);
-
-    std::wstring selectedHeader = L"Selected Processes (" + std::to_wstring(selectedProcessesDisplay.size()) + L")";
-    column.pszText = const_cast<LPWSTR>(selectedHeader.c_str());
-    ListView_SetColumn(selectedListView, 0, &column);
-
-    SendMessage(availableListView, WM_SETREDRAW, TRUE, 0);
-    SendMessage(selectedListView, WM_SETREDRAW, TRUE, 0);
-
-    InvalidateRect(availableListView, NULL, TRUE);
-    InvalidateRect(selectedListView, NULL, TRUE);
-
-    if (availableIndex > 0 && availableIndex < ListView_GetItemCount(availableListView)) {
-        ListView_SetItemState(availableListView, availableIndex - 1, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
-        ListView_EnsureVisible(availableListView, availableIndex - 1, FALSE);
+    if (selectedIndex >= 0 && !selectedView.empty()) {
+        SelectItem(selectedListView, (std::min)(selectedIndex, static_cast<int>(selectedView.size()) - 1));
     }
+    isUpdating = false;
+}
 
-    if (selectedIndex >= 0 && selectedIndex < ListView_GetItemCount(selectedListView)) {
-        ListView_SetItemState(selectedListView, selectedIndex, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
-        ListView_EnsureVisible(selectedListView, selectedIndex, FALSE);
-    }
+std::wstring ProcessPanel::ToLower(std::wstring text) {
+    std::ranges::transform(text, text.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    return text;
 }
 
 void ProcessPanel::Resize(int x, int y, int width, int height) {
@@ -832,4 +619,4 @@ void ProcessPanel::Resize(int x, int y, int width, int height) {
 
     ListView_SetColumnWidth(availableListView, 0, listWidth - 20);
     ListView_SetColumnWidth(selectedListView, 0, listWidth - 20);
-}
\ No newline at end of file
+}
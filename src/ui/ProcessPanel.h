@@ -2,35 +2,26 @@
 #pragma once
 #include <windows.h>
 #include <commctrl.h>
+#include <cstdint>
+#include <map>
 #include <vector>
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include "../common/Models.h"
 
 class ServiceClient;
 
-struct ProcessDisplayInfo {
-    std::wstring name;
-    std::wstring path;
-    bool isSelected;
-    bool isRunning;
-};
-
+// Virtual (LVS_OWNERDATA) lists of available and selected executables. The
+// panel keeps a copy of the service's process list keyed by pid and creation
+// time and brings it up to date with GetProcessChangesSince deltas, so a
+// refresh with nothing started or stopped moves a dozen bytes. Processes are
+// grouped into one row per executable name; the controls ask for the text and
+// icon of visible rows through LVN_GETDISPINFO, and icons are loaded from the
+// executable on first display and cached by path. The search box filters the
+// local rows and never queries the service.
 class ProcessPanel {
 public:
-    struct ScrollState {
-        int topIndex;
-        int pixelOffset;
-        SCROLLINFO scrollInfo;
-        std::wstring selectedItemName;
-        std::wstring focusedItemName;
-        bool hasSelection;
-
-        ScrollState() : topIndex(-1), pixelOffset(0), hasSelection(false) {
-            scrollInfo.cbSize = sizeof(SCROLLINFO);
-        }
-    };
-
     ProcessPanel(HWND parent, ServiceClient* client);
     ~ProcessPanel();
 
@@ -40,9 +31,20 @@ public:
     void HandleNotify(LPNMHDR pnmh);
     void Resize(int x, int y, int width, int height);
 
-    void RestoreDetailedScrollPosition(HWND listView, const ScrollState& state);
-
 private:
+    struct ProcessRow {
+        std::wstring name;
+        std::wstring path;                      // Путь первого экземпляра, из него берётся иконка
+        int instances = 0;
+        bool systemProcess = false;             // Не показывается в доступных, пока не выбран
+    };
+
+    struct SelectedRow {
+        std::string configName;                 // Как записано в конфигурации
+        std::wstring name;
+        const ProcessRow* running = nullptr;    // nullptr - не запущен
+    };
+
     HWND parentWnd;
     HWND groupBox;
     HWND searchEdit;
@@ -52,37 +54,49 @@ private:
     HWND removeButton;
     HWND addAllButton;
     HWND removeAllButton;
+    HIMAGELIST imageList;
 
     ServiceClient* serviceClient;
 
-    std::vector<ProcessDisplayInfo> availableProcesses;
-    std::vector<ProcessDisplayInfo> selectedProcessesDisplay;
+    std::unordered_map<DWORD, ProcessInfo> processes;       // Копия списка сервиса
+    uint64_t processVersion;                                // Версия сервиса, до которой копия актуальна
+    std::map<std::wstring, ProcessRow> rows;                // Ключ - имя в нижнем регистре, порядок отображения
+    std::vector<const ProcessRow*> availableView;
+    std::vector<SelectedRow> selectedView;
     std::vector<std::string> selectedProcesses;
+    std::wstring filter;                                    // В нижнем регистре
+    bool viewsDirty;
+
+    std::unordered_map<std::wstring, int> imageByPath;
+    int defaultImage;
 
     bool isUpdating;
 
     DWORD lastInteractionTime;
     bool isUserInteracting;
 
-    std::string lastSearchFilter;
-
     void CreateControls(int x, int y, int width, int height);
     void UpdateProcessList();
+    ProcessListDelta LoadLocalProcesses();
+    void ApplyProcessDelta(ProcessListDelta&& delta);
+    void AddInstance(const ProcessInfo& process);
+    void RemoveInstance(const ProcessInfo& process);
+    void RebuildViews();
     void UpdateListsImmediately();
     void OnAddProcess();
     void OnRemoveProcess();
     void OnAddAllProcesses();
     void OnRemoveAllProcesses();
     void OnSearchChanged();
-    void FilterProcesses(const std::string& filter);
-
-    ScrollState SaveDetailedScrollPosition(HWND listView);
+    void OnGetDispInfo(HWND listView, NMLVDISPINFO* info);
+    int ResolveImage(const std::wstring& path);
 
     bool IsUserInteracting() const;
     void OnUserInteraction();
 
     int GetSelectedIndex(HWND listView);
-    std::wstring GetItemText(HWND listView, int index);
+    std::wstring GetSelectedName(HWND listView);
+    void SelectItem(HWND listView, int index);
 
-    std::wstring GetBaseProcessNameFromDisplayName(const std::wstring& displayName);
-};
\ No newline at end of file
+    static std::wstring ToLower(std::wstring text);
+};
@@ -4,9 +4,9 @@
 #include <ws2tcpip.h>
 #include <windows.h>
 #include <commctrl.h>
-#include <sstream>
-#include <iomanip>
 #include <chrono>
+#include <algorithm>
+#include <cwctype>
 
 #include "RouteTable.h"
 #include "ServiceClient.h"
@@ -18,7 +18,8 @@
 #define WM_ROUTES_CLEARED (WM_USER + 100)
 
 RouteTable::RouteTable(HWND parent, ServiceClient* client)
-    : parentWnd(parent), groupBox(nullptr), listView(nullptr), cleanRoutesButton(nullptr), serviceClient(client), currentScrollPos(-1) {
+    : parentWnd(parent), groupBox(nullptr), listView(nullptr), searchEdit(nullptr), cleanRoutesButton(nullptr),
+    serviceClient(client), sortColumn(ColumnCreated), sortAscending(false), routeSequence(0) {
 }
 
 RouteTable::~RouteTable() {
@@ -37,11 +38,11 @@ void RouteTable::CreateControls(int x, int y, int width, int height) {
         x, y, width, height, parentWnd, nullptr, hInstance, nullptr);
 
     listView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, L"",
-        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL,
+        WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_OWNERDATA,
         x + 10, y + 25, width - 20, height - 65,
         parentWnd, (HMENU)5001, hInstance, nullptr);
 
-    ListView_SetExtendedListViewStyle(listView, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
+    ListView_SetExtendedListViewStyle(listView, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES | LVS_EX_DOUBLEBUFFER);
 
     LVCOLUMN column;
     column.mask = LVCF_TEXT | LVCF_WIDTH;
@@ -62,118 +63,345 @@ void RouteTable::CreateControls(int x, int y, int width, int height) {
     column.cx = 50;
     ListView_InsertColumn(listView, 3, &column);
 
+    UpdateSortIndicator();
+
     cleanRoutesButton = CreateWindow(L"BUTTON", L"Clean All Routes",
         WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
         x + 10, y + height - 35, 120, 25,
         parentWnd, (HMENU)5003, hInstance, nullptr);
+
+    searchEdit = CreateWindow(L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+        x + 140, y + height - 33, width - 150, 22,
+        parentWnd, (HMENU)5004, hInstance, nullptr);
+
+    SendMessage(searchEdit, EM_SETCUEBANNER, 0, (LPARAM)L"🔍 Filter by address or process...");
 }
 
 void RouteTable::Refresh() {
-    Logger::Instance().Debug("RouteTable::Refresh - Starting");
+    LOG_DEBUG("RouteTable::Refresh - Starting");
     UpdateRouteList();
 }
 
-void RouteTable::SaveScrollPosition() {
-    SCROLLINFO si;
-    si.cbSize = sizeof(si);
-    si.fMask = SIF_POS;
-    if (GetScrollInfo(listView, SB_VERT, &si)) {
-        currentScrollPos = si.nPos;
+void RouteTable::UpdateRouteList() {
+    // Номер журнала в общей памяти не сдвинулся - запрос по каналу не нужен
+    uint64_t published = serviceClient->GetRouteJournalSequence();
+    if (published != 0 && published == routeSequence) {
+        RefreshVisibleAges();
+        return;
+    }
+
+    // Тянем только изменения после routeSequence; список целиком - при первом запросе или отставании
+    RouteChangeSet changes;
+    if (!serviceClient->GetRouteChangesSince(routeSequence, changes)) {
+        return;
+    }
+
+    if (changes.fullResync) {
+        LOG_DEBUG("RouteTable::UpdateRouteList - Full list of {} routes", changes.routes.size());
+        RebuildRouteList(std::move(changes.routes));
+    }
+    else if (!changes.changes.empty()) {
+        LOG_DEBUG("RouteTable::UpdateRouteList - Applying {} changes", changes.changes.size());
+        for (const RouteChange& change : changes.changes) {
+            ApplyRouteChange(change);
+        }
+        UpdateItemCount();
     }
+    routeSequence = changes.sequence;
+
+    RefreshVisibleAges();
 }
 
-void RouteTable::RestoreScrollPosition() {
-    if (currentScrollPos >= 0) {
-        ListView_EnsureVisible(listView, currentScrollPos, FALSE);
-        currentScrollPos = -1;
+void RouteTable::RebuildRouteList(std::vector<RouteInfo>&& newRoutes) {
+    rows.clear();
+    freeRows.clear();
+    rowByKey.clear();
+    rows.reserve(newRoutes.size());
+    rowByKey.reserve(newRoutes.size());
+
+    for (const RouteInfo& route : newRoutes) {
+        auto existing = rowByKey.find(route.ip + "/" + std::to_string(route.prefixLength));
+        if (existing != rowByKey.end()) {
+            RemoveRow(existing->second);
+        }
+        AddRow(route);
     }
+
+    RebuildOrder();
 }
 
-void RouteTable::UpdateRouteList() {
-    SaveScrollPosition();
+void RouteTable::ApplyRouteChange(const RouteChange& change) {
+    auto it = rowByKey.find(change.route.ip + "/" + std::to_string(change.route.prefixLength));
 
-    routes = serviceClient->GetRoutes();
+    switch (change.type) {
+    case RouteChangeType::Added:
+        if (it != rowByKey.end()) {
+            EraseOrdered(it->second);
+            RemoveRow(it->second);
+        }
+        InsertOrdered(AddRow(change.route));
+        break;
 
-    Logger::Instance().Debug("RouteTable::UpdateRouteList - Got " + std::to_string(routes.size()) + " routes");
+    case RouteChangeType::Removed:
+        if (it != rowByKey.end()) {
+            EraseOrdered(it->second);
+            RemoveRow(it->second);
+        }
+        break;
+
+    case RouteChangeType::RefCount:
+        if (it != rowByKey.end()) {
+            // Позиция зависит от refCount только при сортировке по нему
+            bool moves = sortColumn == ColumnRefs;
+            if (moves) {
+                EraseOrdered(it->second);
+            }
+            rows[it->second].route.refCount = change.route.refCount.load();
+            if (moves) {
+                InsertOrdered(it->second);
+            }
+        }
+        break;
+    }
+}
 
-    SendMessage(listView, WM_SETREDRAW, FALSE, 0);
-    ListView_DeleteAllItems(listView);
+uint32_t RouteTable::AddRow(const RouteInfo& route) {
+    uint32_t slot;
+    if (!freeRows.empty()) {
+        slot = freeRows.back();
+        freeRows.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(rows.size());
+        rows.emplace_back();
+    }
 
-    for (size_t i = 0; i < routes.size(); i++) {
-        const RouteInfo& route = routes[i];
+    RouteRow& row = rows[slot];
+    row.route = route;
+    row.key = route.ip + "/" + std::to_string(route.prefixLength);
+    row.addressKey.fill(0);
+    in_addr address4;
+    in6_addr address6;
+    if (inet_pton(AF_INET, route.ip.c_str(), &address4) == 1) {
+        memcpy(row.addressKey.data() + 1, &address4, sizeof(address4));
+    }
+    else if (inet_pton(AF_INET6, route.ip.c_str(), &address6) == 1) {
+        row.addressKey[0] = 1;
+        memcpy(row.addressKey.data() + 1, &address6, sizeof(address6));
+    }
+    row.ipText = Utils::StringToWString(row.key);
+    row.processText = Utils::StringToWString(route.processName);
+    row.searchText = row.ipText + L" " + row.processText;
+    std::ranges::transform(row.searchText, row.searchText.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    row.alive = true;
+
+    rowByKey[row.key] = slot;
+    return slot;
+}
 
-        LVITEM item = { 0 };
-        item.mask = LVIF_TEXT;
-        item.iItem = static_cast<int>(i);
+void RouteTable::RemoveRow(uint32_t slot) {
+    RouteRow& row = rows[slot];
+    rowByKey.erase(row.key);
+    row.alive = false;
+    row.key.clear();
+    row.ipText.clear();
+    row.processText.clear();
+    row.searchText.clear();
+    freeRows.push_back(slot);
+}
 
-        std::wstring ipDisplay = Utils::StringToWString(route.ip) + L"/" + std::to_wstring(route.prefixLength);
-        item.iSubItem = 0;
-        item.pszText = const_cast<LPWSTR>(ipDisplay.c_str());
-        int index = ListView_InsertItem(listView, &item);
+bool RouteTable::RowLess(uint32_t a, uint32_t b) const {
+    const RouteRow& left = rows[a];
+    const RouteRow& right = rows[b];
+
+    int order = 0;
+    switch (sortColumn) {
+    case ColumnProcess:
+        order = _wcsicmp(left.processText.c_str(), right.processText.c_str());
+        break;
+    case ColumnCreated:
+        order = left.route.createdAt < right.route.createdAt ? -1 : (right.route.createdAt < left.route.createdAt ? 1 : 0);
+        break;
+    case ColumnRefs:
+        order = left.route.refCount.load() - right.route.refCount.load();
+        break;
+    default:
+        break;
+    }
+    if (order != 0) {
+        return sortAscending ? order < 0 : order > 0;
+    }
 
-        if (index != -1) {
-            std::wstring process = Utils::StringToWString(route.processName);
-            ListView_SetItemText(listView, index, 1, const_cast<LPWSTR>(process.c_str()));
+    // Адрес и префикс уникальны, поэтому порядок полный и строку можно найти бинарным поиском
+    if (left.addressKey != right.addressKey) {
+        return left.addressKey < right.addressKey;
+    }
+    return left.route.prefixLength < right.route.prefixLength;
+}
 
-            auto now = std::chrono::system_clock::now();
-            auto duration = now - route.createdAt;
+bool RouteTable::MatchesFilter(const RouteRow& row) const {
+    return filter.empty() || row.searchText.find(filter) != std::wstring::npos;
+}
 
-            std::wstring timeStr;
+void RouteTable::InsertOrdered(uint32_t slot) {
+    if (!MatchesFilter(rows[slot])) {
+        return;
+    }
+    auto position = std::ranges::upper_bound(order, slot, [this](uint32_t a, uint32_t b) { return RowLess(a, b); });
+    order.insert(position, slot);
+}
 
-            if (duration.count() < 0 || duration > std::chrono::hours(24 * 365 * 10)) {
-                timeStr = L"Just now";
-            }
-            else {
-                auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
-                auto minutes = std::chrono::duration_cast<std::chrono::minutes>(duration).count();
-                auto hours = std::chrono::duration_cast<std::chrono::hours>(duration).count();
-                auto days = hours / 24;
-                auto weeks = days / 7;
-                auto months = days / 30;
-                auto years = days / 365;
-
-                if (seconds < 60) {
-                    timeStr = L"Just now";
-                }
-                else if (minutes < 60) {
-                    timeStr = std::to_wstring(minutes) + L"m ago";
-                }
-                else if (hours < 24) {
-                    timeStr = std::to_wstring(hours) + L"h ago";
-                }
-                else if (days < 7) {
-                    timeStr = std::to_wstring(days) + L"d ago";
-                }
-                else if (weeks < 4) {
-                    timeStr = std::to_wstring(weeks) + L"w ago";
-                }
-                else if (months < 12) {
-                    timeStr = std::to_wstring(months) + L"mo ago";
-                }
-                else {
-                    timeStr = std::to_wstring(years) + L"y ago";
-                }
-            }
+void RouteTable::EraseOrdered(uint32_t slot) {
+    // Вызывается до изменения полей строки, пока её позиция в order ещё верна
+    auto position = std::ranges::lower_bound(order, slot, [this](uint32_t a, uint32_t b) { return RowLess(a, b); });
+    if (position != order.end() && *position == slot) {
+        order.erase(position);
+    }
+}
 
-            ListView_SetItemText(listView, index, 2, const_cast<LPWSTR>(timeStr.c_str()));
+void RouteTable::RebuildOrder() {
+    order.clear();
+    order.reserve(rowByKey.size());
+    for (uint32_t slot = 0; slot < rows.size(); slot++) {
+        if (rows[slot].alive && MatchesFilter(rows[slot])) {
+            order.push_back(slot);
+        }
+    }
+    std::ranges::sort(order, [this](uint32_t a, uint32_t b) { return RowLess(a, b); });
+    UpdateItemCount();
+}
 
-            std::wstring refs = std::to_wstring(route.refCount.load());
-            ListView_SetItemText(listView, index, 3, const_cast<LPWSTR>(refs.c_str()));
+void RouteTable::UpdateItemCount() {
+    // Позиция прокрутки сохраняется; перерисуются только видимые строки
+    ListView_SetItemCountEx(listView, static_cast<int>(order.size()), LVSICF_NOSCROLL);
+    InvalidateRect(listView, NULL, FALSE);
+}
+
+void RouteTable::UpdateSortIndicator() {
+    HWND header = ListView_GetHeader(listView);
+    for (int column = ColumnAddress; column <= ColumnRefs; column++) {
+        HDITEM item = { 0 };
+        item.mask = HDI_FORMAT;
+        Header_GetItem(header, column, &item);
+        item.fmt &= ~(HDF_SORTUP | HDF_SORTDOWN);
+        if (column == sortColumn) {
+            item.fmt |= sortAscending ? HDF_SORTUP : HDF_SORTDOWN;
         }
+        Header_SetItem(header, column, &item);
+    }
+}
+
+void RouteTable::HandleNotify(LPNMHDR pnmh) {
+    if (pnmh->hwndFrom != listView) {
+        return;
+    }
+
+    switch (pnmh->code) {
+    case LVN_GETDISPINFO:
+        OnGetDispInfo(reinterpret_cast<NMLVDISPINFO*>(pnmh));
+        break;
+    case LVN_COLUMNCLICK:
+        OnColumnClick(reinterpret_cast<NMLISTVIEW*>(pnmh)->iSubItem);
+        break;
+    }
+}
+
+void RouteTable::OnGetDispInfo(NMLVDISPINFO* info) {
+    if (!(info->item.mask & LVIF_TEXT) || info->item.iItem < 0 || info->item.iItem >= static_cast<int>(order.size())) {
+        return;
+    }
+
+    const RouteRow& row = rows[order[info->item.iItem]];
+    std::wstring formatted;
+    const std::wstring* text = &formatted;
+    switch (info->item.iSubItem) {
+    case ColumnAddress: text = &row.ipText; break;
+    case ColumnProcess: text = &row.processText; break;
+    case ColumnCreated: formatted = FormatAge(row.route.createdAt); break;
+    case ColumnRefs: formatted = std::to_wstring(row.route.refCount.load()); break;
+    }
+    wcsncpy_s(info->item.pszText, info->item.cchTextMax, text->c_str(), _TRUNCATE);
+}
+
+void RouteTable::OnColumnClick(int column) {
+    if (column == sortColumn) {
+        sortAscending = !sortAscending;
+    }
+    else {
+        sortColumn = column;
+        // Новые и самые используемые маршруты интереснее видеть сверху
+        sortAscending = column == ColumnAddress || column == ColumnProcess;
+    }
+    UpdateSortIndicator();
+    RebuildOrder();
+}
+
+void RouteTable::OnSearchChanged() {
+    wchar_t buffer[256] = { 0 };
+    GetWindowText(searchEdit, buffer, static_cast<int>(std::size(buffer)));
+    filter = buffer;
+    std::ranges::transform(filter, filter.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    RebuildOrder();
+}
+
+void RouteTable::RefreshVisibleAges() {
+    // Возраст меняется у всех строк сразу; текст берётся при отрисовке, так что достаточно перерисовать видимые
+    if (order.empty()) {
+        return;
+    }
+    int first = ListView_GetTopIndex(listView);
+    int last = (std::min)(first + ListView_GetCountPerPage(listView), static_cast<int>(order.size()) - 1);
+    ListView_RedrawItems(listView, first, last);
+}
+
+std::wstring RouteTable::FormatAge(std::chrono::system_clock::time_point createdAt) {
+    auto now = std::chrono::system_clock::now();
+    auto duration = now - createdAt;
+
+    if (duration.count() < 0 || duration > std::chrono::hours(24 * 365 * 10)) {
+        return L"Just now";
     }
 
-    SendMessage(listView, WM_SETREDRAW, TRUE, 0);
-    InvalidateRect(listView, NULL, TRUE);
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+    auto minutes = std::chrono::duration_cast<std::chrono::minutes>(duration).count();
+    auto hours = std::chrono::duration_cast<std::chrono::hours>(duration).count();
+    auto days = hours / 24;
+    auto weeks = days / 7;
+    auto months = days / 30;
+    auto years = days / 365;
 
-    RestoreScrollPosition();
+    if (seconds < 60) {
+        return L"Just now";
+    }
+    else if (minutes < 60) {
+        return std::to_wstring(minutes) + L"m ago";
+    }
+    else if (hours < 24) {
+        return std::to_wstring(hours) + L"h ago";
+    }
+    else if (days < 7) {
+        return std::to_wstring(days) + L"d ago";
+    }
+    else if (weeks < 4) {
+        return std::to_wstring(weeks) + L"w ago";
+    }
+    else if (months < 12) {
+        return std::to_wstring(months) + L"mo ago";
+    }
+    return std::to_wstring(years) + L"y ago";
 }
 
 void RouteTable::HandleCommand(WPARAM wParam) {
     WORD id = LOWORD(wParam);
+    WORD notifyCode = HIWORD(wParam);
 
     if (id == 5003) {
         OnCleanAllRoutes();
     }
+    else if (id == 5004 && notifyCode == EN_CHANGE) {
+        OnSearchChanged();
+    }
 }
 
 void RouteTable::OnCleanAllRoutes() {
@@ -198,6 +426,7 @@ void RouteTable::Resize(int x, int y, int width, int height) {
     SetWindowPos(groupBox, NULL, x, y, width, height, SWP_NOZORDER);
     SetWindowPos(listView, NULL, x + 10, y + 25, width - 20, height - 65, SWP_NOZORDER);
     SetWindowPos(cleanRoutesButton, NULL, x + 10, y + height - 35, 120, 25, SWP_NOZORDER);
+    SetWindowPos(searchEdit, NULL, x + 140, y + height - 33, width - 150, 22, SWP_NOZORDER);
 
     LVCOLUMN column = { 0 };
     column.mask = LVCF_WIDTH;
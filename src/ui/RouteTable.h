@@ -2,11 +2,21 @@
 #pragma once
 #include <windows.h>
 #include <commctrl.h>
+#include <array>
 #include <vector>
+#include <string>
+#include <chrono>
+#include <unordered_map>
 #include "../common/Models.h"
 
 class ServiceClient;
 
+// Virtual (LVS_OWNERDATA) list of active routes. The control holds no
+// rows: it asks for the text of visible cells through LVN_GETDISPINFO, so a
+// refresh costs the same at 100 rows and at 100k. Routes live in `rows`
+// with their display strings formatted once; `order` lists the rows that
+// pass the search filter, kept sorted by the current column and updated by
+// binary-search insert and erase as deltas arrive.
 class RouteTable {
 public:
     RouteTable(HWND parent, ServiceClient* client);
@@ -15,20 +25,57 @@ public:
     void Create(int x, int y, int width, int height);
     void Refresh();
     void HandleCommand(WPARAM wParam);
+    void HandleNotify(LPNMHDR pnmh);
     void Resize(int x, int y, int width, int height);
 
 private:
+    enum Column { ColumnAddress, ColumnProcess, ColumnCreated, ColumnRefs };
+
+    struct RouteRow {
+        RouteInfo route;
+        std::string key;                        // "ip/prefix"
+        std::array<uint8_t, 17> addressKey{};   // Семейство и байты адреса для числовой сортировки
+        std::wstring ipText;
+        std::wstring processText;
+        std::wstring searchText;                // ipText и processText в нижнем регистре
+        bool alive = false;
+    };
+
     HWND parentWnd;
     HWND groupBox;
     HWND listView;
+    HWND searchEdit;
     HWND cleanRoutesButton;
     ServiceClient* serviceClient;
-    std::vector<RouteInfo> routes;
-    int currentScrollPos;
+
+    std::vector<RouteRow> rows;
+    std::vector<uint32_t> freeRows;
+    std::unordered_map<std::string, uint32_t> rowByKey;
+    std::vector<uint32_t> order;                // Видимые строки в порядке отображения
+    int sortColumn;
+    bool sortAscending;
+    std::wstring filter;                        // В нижнем регистре
+    uint64_t routeSequence;                     // Номер журнала сервиса, до которого список актуален
 
     void CreateControls(int x, int y, int width, int height);
     void UpdateRouteList();
+    void RebuildRouteList(std::vector<RouteInfo>&& newRoutes);
+    void ApplyRouteChange(const RouteChange& change);
+    uint32_t AddRow(const RouteInfo& route);
+    void RemoveRow(uint32_t slot);
+
+    bool RowLess(uint32_t a, uint32_t b) const;
+    bool MatchesFilter(const RouteRow& row) const;
+    void InsertOrdered(uint32_t slot);
+    void EraseOrdered(uint32_t slot);
+    void RebuildOrder();
+    void UpdateItemCount();
+    void UpdateSortIndicator();
+
+    void OnGetDispInfo(NMLVDISPINFO* info);
+    void OnColumnClick(int column);
+    void OnSearchChanged();
     void OnCleanAllRoutes();
-    void SaveScrollPosition();
-    void RestoreScrollPosition();
-};
\ No newline at end of file
+    void RefreshVisibleAges();
+    static std::wstring FormatAge(std::chrono::system_clock::time_point createdAt);
+};
@@ -4,13 +4,99 @@
 #include "../common/Logger.h"
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
 
-ServiceClient::ServiceClient() : pipe(INVALID_HANDLE_VALUE), connected(false) {
+ServiceClient::ServiceClient() : pipe(INVALID_HANDLE_VALUE), connected(false), nextRequestId(1), routeSubscriptionId(0),
+statusMapping(nullptr), statusSection(nullptr) {
     Logger::Instance().Info("ServiceClient: Created, NOT connecting immediately");
 }
 
 ServiceClient::~ServiceClient() {
     Disconnect();
+    CloseStatusSection();
+}
+
+bool ServiceClient::OpenStatusSection() {
+    if (statusSection) {
+        return true;
+    }
+
+    for (const std::string& name : { Constants::STATUS_SECTION_NAME, Constants::STATUS_SECTION_LOCAL_NAME }) {
+        statusMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (statusMapping) {
+            break;
+        }
+    }
+    if (!statusMapping) {
+        return false;
+    }
+
+    statusSection = static_cast<const SharedStatus::Section*>(
+        MapViewOfFile(statusMapping, FILE_MAP_READ, 0, 0, sizeof(SharedStatus::Section)));
+    if (!statusSection || statusSection->magic != SharedStatus::MAGIC || statusSection->version != SharedStatus::VERSION) {
+        Logger::Instance().Warning("ServiceClient::OpenStatusSection - Status section has unexpected layout");
+        CloseStatusSection();
+        return false;
+    }
+
+    Logger::Instance().Info("ServiceClient::OpenStatusSection - Reading status from shared memory");
+    return true;
+}
+
+void ServiceClient::CloseStatusSection() {
+    if (statusSection) {
+        UnmapViewOfFile(statusSection);
+        statusSection = nullptr;
+    }
+    if (statusMapping) {
+        CloseHandle(statusMapping);
+        statusMapping = nullptr;
+    }
+}
+
+bool ServiceClient::ReadSharedStatus(SharedStatus::Status& status) {
+    if (!OpenStatusSection()) {
+        return false;
+    }
+    if (!SharedStatus::Read(statusSection->statusGeneration, [&] { status = statusSection->status; })) {
+        return false;
+    }
+    // Остановленный или зависший сервис секцию не обновляет - тогда спрашиваем по каналу
+    return status.isRunning && GetTickCount64() - status.publishedTick < Constants::STATUS_STALE_MS;
+}
+
+bool ServiceClient::ReadSharedRoutes(std::vector<RouteInfo>& routes) {
+    SharedStatus::Status status;
+    if (!ReadSharedStatus(status)) {
+        return false;
+    }
+
+    std::vector<SharedStatus::Route> packed;
+    bool consistent = SharedStatus::Read(statusSection->routesGeneration, [&] {
+        size_t count = (std::min)(static_cast<size_t>(statusSection->routeCount), SharedStatus::MAX_ROUTES);
+        packed.assign(statusSection->routes, statusSection->routes + count);
+        });
+    if (!consistent) {
+        return false;
+    }
+
+    routes.clear();
+    routes.reserve(packed.size());
+    for (const SharedStatus::Route& shared : packed) {
+        RouteInfo& route = routes.emplace_back(
+            std::string(shared.ip, strnlen(shared.ip, SharedStatus::IP_SIZE)),
+            std::string(shared.processName, strnlen(shared.processName, SharedStatus::PROCESS_NAME_SIZE)));
+        route.prefixLength = shared.prefixLength;
+        route.refCount = shared.refCount;
+        route.createdAt = std::chrono::system_clock::time_point(std::chrono::seconds(shared.createdAt));
+    }
+    return true;
+}
+
+uint64_t ServiceClient::GetRouteJournalSequence() {
+    SharedStatus::Status status;
+    return ReadSharedStatus(status) ? status.routeJournalSequence : 0;
 }
 
 bool ServiceClient::Connect() {
@@ -62,93 +148,161 @@ void ServiceClient::Disconnect() {
         pipe = INVALID_HANDLE_VALUE;
     }
     connected = false;
-}
 
-IPCResponse ServiceClient::SendMessage(const IPCMessage& message) {
-    IPCResponse response;
-    response.success = false;
-
-    if (!connected) {
-        response.error = "Not connected to service";
-        return response;
+    // Ответа на незавершённые команды уже не будет
+    for (const auto& [requestId, type] : pendingRequests) {
+        IPCResponse response;
+        response.requestId = requestId;
+        response.error = "Connection to service lost";
+        completed.push_back({ type, std::move(response) });
     }
+    pendingRequests.clear();
+    routeSubscriptionId = 0;
+}
 
-    std::vector<uint8_t> buffer(sizeof(IPCMessageType) + message.data.size());
-    memcpy(buffer.data(), &message.type, sizeof(IPCMessageType));
-    if (!message.data.empty()) {
-        memcpy(buffer.data() + sizeof(IPCMessageType), message.data.data(), message.data.size());
+uint32_t ServiceClient::WriteRequest(IPCMessage& message) {
+    message.requestId = nextRequestId++;
+    if (nextRequestId == 0) {
+        nextRequestId = 1;  // 0 сервис ставит в ответ на нераспознанный кадр
     }
 
+    auto frame = IPCSerializer::SerializeRequest(message);
     DWORD bytesWritten;
-    if (!WriteFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesWritten, nullptr)) {
+    if (!WriteFile(pipe, frame.data(), static_cast<DWORD>(frame.size()), &bytesWritten, nullptr)) {
         DWORD error = GetLastError();
-        Logger::Instance().Error("ServiceClient::SendMessage - WriteFile failed: " + std::to_string(error));
+        Logger::Instance().Error("ServiceClient::WriteRequest - WriteFile failed: " + std::to_string(error));
         Disconnect();
-        response.error = "Failed to write to pipe";
-        return response;
+        return 0;
     }
+    return message.requestId;
+}
 
-    const size_t INITIAL_BUFFER_SIZE = 65536;
-    buffer.resize(INITIAL_BUFFER_SIZE);
-    DWORD bytesRead = 0;
+bool ServiceClient::ReadResponse(IPCResponse& response) {
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> chunk(Constants::IPC_INITIAL_BUFFER_SIZE);
 
-    BOOL readResult = ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, nullptr);
+    for (;;) {
+        DWORD bytesRead = 0;
+        BOOL readResult = ReadFile(pipe, chunk.data(), static_cast<DWORD>(chunk.size()), &bytesRead, nullptr);
+        DWORD error = readResult ? ERROR_SUCCESS : GetLastError();
+        if (!readResult && error != ERROR_MORE_DATA) {
+            Logger::Instance().Error("ServiceClient::ReadResponse - ReadFile failed: " + std::to_string(error));
+            Disconnect();
+            return false;
+        }
 
-    if (!readResult) {
-        DWORD error = GetLastError();
-        if (error == ERROR_MORE_DATA) {
-            Logger::Instance().Debug("ServiceClient::SendMessage - More data available, resizing buffer");
-            DWORD bytesAvailable = 0;
-            if (PeekNamedPipe(pipe, nullptr, 0, nullptr, &bytesAvailable, nullptr) && bytesAvailable > 0) {
-                size_t totalSize = bytesRead + bytesAvailable;
-                buffer.resize(totalSize);
-                DWORD additionalBytesRead = 0;
-                if (ReadFile(pipe, buffer.data() + bytesRead, bytesAvailable, &additionalBytesRead, nullptr)) {
-                    bytesRead += additionalBytesRead;
-                }
-                else {
-                    Logger::Instance().Error("ServiceClient::SendMessage - Failed to read additional data: " + std::to_string(GetLastError()));
-                    Disconnect();
-                    response.error = "Failed to read additional data from pipe";
-                    return response;
-                }
-            }
+        frame.insert(frame.end(), chunk.begin(), chunk.begin() + bytesRead);
+        if (readResult) {
+            break;
         }
-        else {
-            Logger::Instance().Error("ServiceClient::SendMessage - ReadFile failed: " + std::to_string(error));
-            Disconnect();
-            response.error = "Failed to read from pipe";
-            return response;
+    }
+
+    if (!IPCSerializer::DeserializeResponse(frame, response)) {
+        Logger::Instance().Error("ServiceClient::ReadResponse - Malformed response of " + std::to_string(frame.size()) + " bytes");
+        return false;
+    }
+    return true;
+}
+
+void ServiceClient::StoreCompleted(IPCResponse&& response) {
+    auto it = pendingRequests.find(response.requestId);
+    if (it == pendingRequests.end()) {
+        Logger::Instance().Debug("ServiceClient - Dropping response to unknown request " + std::to_string(response.requestId));
+        return;
+    }
+    completed.push_back({ it->second, std::move(response) });
+    // Подписка отвечает многократно, пока сервис её не отклонит
+    if (it->first != routeSubscriptionId || !completed.back().response.success) {
+        if (it->first == routeSubscriptionId) {
+            routeSubscriptionId = 0;
         }
+        pendingRequests.erase(it);
     }
+}
 
-    if (bytesRead >= sizeof(bool) + sizeof(size_t)) {
-        size_t offset = 0;
-        response.success = *reinterpret_cast<bool*>(&buffer[offset]);
-        offset += sizeof(bool);
+IPCResponse ServiceClient::SendMessage(IPCMessage message) {
+    IPCResponse response;
 
-        size_t dataSize = *reinterpret_cast<size_t*>(&buffer[offset]);
-        offset += sizeof(size_t);
+    if (!connected) {
+        response.error = "Not connected to service";
+        return response;
+    }
 
-        if (dataSize > 0 && offset + dataSize <= bytesRead) {
-            response.data.assign(buffer.begin() + offset, buffer.begin() + offset + dataSize);
-            offset += dataSize;
+    uint32_t requestId = WriteRequest(message);
+    if (requestId == 0) {
+        response.error = "Failed to write to pipe";
+        return response;
+    }
+
+    // Ответы на ранее начатые долгие команды могут прийти раньше нашего
+    while (connected) {
+        IPCResponse received;
+        if (!ReadResponse(received)) {
+            continue;
         }
+        if (received.requestId == requestId) {
+            return received;
+        }
+        StoreCompleted(std::move(received));
+    }
 
-        if (offset + sizeof(size_t) <= bytesRead) {
-            size_t errorSize = *reinterpret_cast<size_t*>(&buffer[offset]);
-            offset += sizeof(size_t);
+    response.error = "Failed to read from pipe";
+    return response;
+}
+
+uint32_t ServiceClient::BeginRequest(IPCMessage message) {
+    if (!connected) return 0;
+
+    uint32_t requestId = WriteRequest(message);
+    if (requestId != 0) {
+        pendingRequests[requestId] = message.type;
+    }
+    return requestId;
+}
 
-            if (errorSize > 0 && offset + errorSize <= bytesRead) {
-                response.error.assign(buffer.begin() + offset, buffer.begin() + offset + errorSize);
-            }
+std::vector<ServiceClient::CompletedRequest> ServiceClient::TakeCompleted() {
+    // Уже пришедшие ответы забираются без ожидания
+    DWORD available = 0;
+    while (connected && !pendingRequests.empty() &&
+        PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr) && available > 0) {
+        IPCResponse received;
+        if (ReadResponse(received)) {
+            StoreCompleted(std::move(received));
         }
     }
 
-    return response;
+    std::vector<CompletedRequest> result;
+    result.swap(completed);
+    return result;
 }
 
 ServiceStatus ServiceClient::GetStatus() {
+    SharedStatus::Status shared;
+    if (ReadSharedStatus(shared)) {
+        ServiceStatus status;
+        status.isRunning = shared.isRunning != 0;
+        status.monitorActive = shared.monitorActive != 0;
+        status.activeRoutes = static_cast<size_t>(shared.activeRoutes);
+        status.memoryUsageMB = static_cast<size_t>(shared.memoryUsageMB);
+        status.uptime = std::chrono::seconds(shared.uptimeSeconds);
+        status.routesRestored = shared.routesRestored != 0;
+        status.restoreTotal = static_cast<size_t>(shared.restoreTotal);
+        status.restoreDone = static_cast<size_t>(shared.restoreDone);
+        status.lastPlanAggregates = static_cast<size_t>(shared.lastPlanAggregates);
+        status.lastPlanRolledBack = static_cast<size_t>(shared.lastPlanRolledBack);
+        status.lastPlanRoutesRetired = static_cast<size_t>(shared.lastPlanRoutesRetired);
+        status.lastPlanFailures = static_cast<size_t>(shared.lastPlanFailures);
+        status.lastPlanDurationMs = shared.lastPlanDurationMs;
+        status.lastPlanSyscalls = static_cast<size_t>(shared.lastPlanSyscalls);
+        status.migrationActive = shared.migrationActive != 0;
+        status.configGeneration = shared.configGeneration;
+        status.migrationTotal = static_cast<size_t>(shared.migrationTotal);
+        status.migrationDone = static_cast<size_t>(shared.migrationDone);
+        status.migrationFailed = static_cast<size_t>(shared.migrationFailed);
+        status.migrationDurationMs = shared.migrationDurationMs;
+        return status;
+    }
+
     if (!connected) {
         return ServiceStatus();
     }
@@ -223,6 +377,11 @@ void ServiceClient::SetSelectedProcesses(const std::vector<std::string>& process
 }
 
 std::vector<RouteInfo> ServiceClient::GetRoutes() {
+    std::vector<RouteInfo> shared;
+    if (ReadSharedRoutes(shared)) {
+        return shared;
+    }
+
     if (!connected) return std::vector<RouteInfo>();
 
     IPCMessage msg;
@@ -236,6 +395,52 @@ std::vector<RouteInfo> ServiceClient::GetRoutes() {
     return std::vector<RouteInfo>();
 }
 
+bool ServiceClient::GetRouteChangesSince(uint64_t since, RouteChangeSet& changes) {
+    if (!connected) return false;
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::GetRouteChangesSince;
+    msg.data = IPCSerializer::SerializeSequence(since);
+
+    auto response = SendMessage(msg);
+    return response.success && IPCSerializer::DeserializeRouteChanges(response.data, changes);
+}
+
+bool ServiceClient::GetProcessChangesSince(uint64_t since, ProcessListDelta& delta) {
+    if (!connected) return false;
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::GetProcessChangesSince;
+    msg.data = IPCSerializer::SerializeSequence(since);
+
+    auto response = SendMessage(msg);
+    return response.success && IPCSerializer::DeserializeProcessChanges(response.data, delta);
+}
+
+PerfReportData ServiceClient::GetPerfReport() {
+    if (!connected) return PerfReportData();
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::GetPerfReport;
+
+    auto response = SendMessage(msg);
+    if (response.success) {
+        return IPCSerializer::DeserializePerfReport(response.data);
+    }
+
+    return PerfReportData();
+}
+
+bool ServiceClient::GetMemoryReport(MemoryReport& report) {
+    if (!connected) return false;
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::GetMemoryReport;
+
+    auto response = SendMessage(msg);
+    return response.success && IPCSerializer::DeserializeMemoryReport(response.data, report);
+}
+
 void ServiceClient::ClearRoutes() {
     if (!connected) return;
 
@@ -255,6 +460,26 @@ void ServiceClient::SetAIPreload(bool enabled) {
     SendMessage(msg);
 }
 
+bool ServiceClient::GetPreloadStatus(PreloadStatus& status) {
+    if (!connected) return false;
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::GetPreloadStatus;
+
+    auto response = SendMessage(msg);
+    return response.success && IPCSerializer::DeserializePreloadStatus(response.data, status);
+}
+
+bool ServiceClient::SetPreloadService(const std::string& service, bool enabled) {
+    if (!connected) return false;
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::SetPreloadService;
+    msg.data = IPCSerializer::SerializePreloadService(service, enabled);
+
+    return SendMessage(msg).success;
+}
+
 void ServiceClient::SetDnsProxy(bool enabled) {
     if (!connected) return;
 
@@ -265,20 +490,28 @@ void ServiceClient::SetDnsProxy(bool enabled) {
     SendMessage(msg);
 }
 
-void ServiceClient::OptimizeRoutes() {
-    if (!connected) return;
-
+uint32_t ServiceClient::BeginOptimizeRoutes() {
     IPCMessage msg;
     msg.type = IPCMessageType::OptimizeRoutes;
 
-    SendMessage(msg);
+    return BeginRequest(msg);
 }
 
-void ServiceClient::CleanupRedundantRoutes() {
-    if (!connected) return;
-
+uint32_t ServiceClient::BeginCleanupRedundantRoutes() {
     IPCMessage msg;
     msg.type = IPCMessageType::CleanupRedundantRoutes;
 
-    SendMessage(msg);
+    return BeginRequest(msg);
+}
+
+uint32_t ServiceClient::SubscribeRoutes() {
+    if (routeSubscriptionId != 0) {
+        return routeSubscriptionId;
+    }
+
+    IPCMessage msg;
+    msg.type = IPCMessageType::SubscribeRoutes;
+
+    routeSubscriptionId = BeginRequest(msg);
+    return routeSubscriptionId;
 }
\ No newline at end of file
@@ -7,8 +7,10 @@
 #include <windows.h>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "../common/Models.h"
 #include "../common/IPCProtocol.h"
+#include "../common/SharedStatus.h"
 
 class ServiceClient {
 public:
@@ -25,16 +27,54 @@ public:
     std::vector<ProcessInfo> GetProcesses();
     void SetSelectedProcesses(const std::vector<std::string>& processes);
     std::vector<RouteInfo> GetRoutes();
+    // Номер журнала маршрутов из общей памяти; 0, если секция недоступна
+    uint64_t GetRouteJournalSequence();
+    // Изменения таблицы после since; при fullResync в changes.routes вся таблица
+    bool GetRouteChangesSince(uint64_t since, RouteChangeSet& changes);
+    bool GetProcessChangesSince(uint64_t since, ProcessListDelta& delta);
     void ClearRoutes();
     void RestartService();
     void SetAIPreload(bool enabled);
+    // Прогресс фоновой установки preload и состояние сервисов
+    bool GetPreloadStatus(PreloadStatus& status);
+    bool SetPreloadService(const std::string& service, bool enabled);
     void SetDnsProxy(bool enabled);
-    void OptimizeRoutes();
-    void CleanupRedundantRoutes();
+    PerfReportData GetPerfReport();
+    bool GetMemoryReport(MemoryReport& report);
+
+    // Долгие команды не ждут ответа: он приходит с тем же ID через TakeCompleted
+    struct CompletedRequest {
+        IPCMessageType type;
+        IPCResponse response;
+    };
+
+    uint32_t BeginOptimizeRoutes();
+    uint32_t BeginCleanupRedundantRoutes();
+    // Сервис присылает номер журнала маршрутов после каждой пачки изменений как ответ
+    // SubscribeRoutes с тем же ID; повторный вызов при живой подписке ничего не делает
+    uint32_t SubscribeRoutes();
+    std::vector<CompletedRequest> TakeCompleted();
 
 private:
     HANDLE pipe;
     bool connected;
+    uint32_t nextRequestId;
+    uint32_t routeSubscriptionId;
+    std::unordered_map<uint32_t, IPCMessageType> pendingRequests;
+    std::vector<CompletedRequest> completed;
+
+    // Статус и снимок маршрутов читаются из секции сервиса без обращения к каналу
+    HANDLE statusMapping;
+    const SharedStatus::Section* statusSection;
+
+    bool OpenStatusSection();
+    void CloseStatusSection();
+    bool ReadSharedStatus(SharedStatus::Status& status);
+    bool ReadSharedRoutes(std::vector<RouteInfo>& routes);
 
-    IPCResponse SendMessage(const IPCMessage& message);
+    IPCResponse SendMessage(IPCMessage message);
+    uint32_t BeginRequest(IPCMessage message);
+    uint32_t WriteRequest(IPCMessage& message);
+    bool ReadResponse(IPCResponse& response);
+    void StoreCompleted(IPCResponse&& response);
 };
\ No newline at end of file